@@ -8,22 +8,54 @@
 #pragma once
 
 #include <borealis.hpp>
+#include "BoxArtManager.hpp"
 #include "GameStreamClient.hpp"
+#include "UIIconAtlas.hpp"
 
 using namespace brls;
 
+#define BOXART_CORNER_RADIUS 12
+
 class AppCell : public Box {
   public:
+    AppCell();
     AppCell(const Host& host, const AppInfo& app, int currentApp);
+    ~AppCell() override;
+
+    // Shows another app, so grid can reuse cell while scrolling
+    void bind(const Host& host, const AppInfo& app, int currentApp);
 
+    // Only holds place of box art, it is drawn by cell from shared texture
     BRLS_BIND(Image, image, "image");
     BRLS_BIND(Label, title, "title");
-    BRLS_BIND(Image, currentAppImage, "current_app_image");
-    BRLS_BIND(Image, favoriteAppImage, "favorite_app_image");
+    BRLS_BIND(Box, currentAppImage, "current_app_image");
+    BRLS_BIND(Box, favoriteAppImage, "favorite_app_image");
     BRLS_BIND(Rectangle, unactiveLayer, "unactive_layer");
 
     void setFavorite(bool favorite);
+    // Stream is started from cached host state, see StreamingView
+    void setFastLaunch(bool fastLaunch) { m_fast_launch = fastLaunch; }
+
+    void draw(NVGcontext* vg, float x, float y, float width, float height,
+              Style style, FrameContext* ctx) override;
 
   private:
     void updateFavoriteAction(Host host, AppInfo app);
+    void drawBoxArt(NVGcontext* vg, int texture);
+    // Last frame of running app's stream
+    void drawPreview(NVGcontext* vg, int texture);
+    void drawBadge(NVGcontext* vg, View* badge, UIIcon icon);
+    void requestBoxArt(const Host& host, const AppInfo& app, bool refresh);
+
+    std::string m_address;
+    int m_app_id;
+    BoxArtId m_boxart_id;
+    // Box art is requested and cell wasn't shown on screen yet
+    bool m_boxart_pending = false;
+    bool m_boxart_ready = false;
+    bool m_running = false;
+    bool m_fast_launch = false;
+    // Cancelled when cell is rebound or destroyed, so box art of cells
+    // scrolled past isn't downloaded ahead of visible ones
+    GSCancelToken m_boxart_token;
 };
@@ -13,6 +13,7 @@
 #include <Settings.hpp>
 #include <borealis.hpp>
 #include "GameStreamClient.hpp"
+#include "AppSearchIndex.hpp"
 
 #include <optional>
 
@@ -21,6 +22,7 @@ using namespace brls;
 class AppListView : public Box {
   public:
     AppListView(const Host& host);
+    ~AppListView() override;
 
     void onLayout() override;
     void willAppear(bool resetState) override;
@@ -32,13 +34,25 @@ class AppListView : public Box {
     bool loading = false;
     bool inputBlocked = false;
     LoadingOverlay* loader = nullptr;
+    // Pending app list request is dropped along with view
+    GSCancelToken cancelToken = GSCancellation::create();
     void blockInput(bool block);
 
     GridView* gridView;
+    // What grid shows, cells are bound from it
+    AppInfoList apps;
+    // Whole list, grid shows part of it matching search
+    AppInfoList library;
+    AppSearchIndex searchIndex;
+    std::string searchQuery;
+    int currentGame = 0;
     BRLS_BIND(Box, container, "container");
 
     void setCurrentApp(const AppInfo& app);
     void terninateApp();
     void updateAppList();
+    void showApps(const AppInfoList& newApps, int newCurrentGame);
+    void showFiltered(int newCurrentGame);
+    void openSearch();
     void updateFavoriteAction(AppCell* cell, Host host, const AppInfo& app);
 };
@@ -0,0 +1,105 @@
+//
+//  grid_benchmark_view.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "GameStreamClient.hpp"
+#include "grid_view.hpp"
+#include <Settings.hpp>
+#include <borealis.hpp>
+#include <cstdint>
+#include <vector>
+
+// Columns of app grid, same as AppListView has
+#define GRID_BENCH_COLUMNS 7
+// Frames before script starts, layout and first screen of box art settle
+#define GRID_BENCH_WARMUP_FRAMES 30
+// Focus moves once per this many frames, close to held D-pad repeat
+#define GRID_BENCH_STEP_FRAMES 4
+// Rows skipped per step when paging back up
+#define GRID_BENCH_PAGE_ROWS 4
+// Random far jumps at the end, as search results or touch flings
+#define GRID_BENCH_JUMP_COUNT 32
+// Frame above this many medians is counted as a hitch
+#define GRID_BENCH_HITCH_FACTOR 2
+
+enum GridBenchPhase : int {
+    GRID_BENCH_WARMUP,
+    // Row by row down to the last one
+    GRID_BENCH_ROWS,
+    // Page by page back to the top
+    GRID_BENCH_PAGES,
+    GRID_BENCH_JUMPS,
+    GRID_BENCH_DONE,
+};
+
+struct GridBenchFrame {
+    GridBenchPhase phase;
+    // Since previous frame started
+    float frame_ms;
+    // Grid layout and draw only
+    float draw_ms;
+    uint32_t uploads;
+    uint32_t evictions;
+    uint32_t allocations;
+    // Cells bound to other apps, grid recycling at work
+    uint32_t binds;
+    uint32_t texture_kb;
+};
+
+struct GridBenchSummary {
+    uint32_t frames;
+    float p50_ms;
+    float p95_ms;
+    float p99_ms;
+    float max_ms;
+    uint32_t hitches;
+    float uploads_per_frame;
+    uint32_t max_uploads;
+    uint64_t evictions;
+    float allocations_per_frame;
+    uint32_t max_allocations;
+    uint64_t binds;
+};
+
+// Scripted focus navigation over synthetic library of generated box art,
+// measures smoothness of app grid, its cell recycling and box art cache
+class GridBenchmarkView : public brls::Box {
+  public:
+    GridBenchmarkView();
+    ~GridBenchmarkView() override;
+
+    void draw(NVGcontext* vg, float x, float y, float width, float height,
+              brls::Style style, brls::FrameContext* ctx) override;
+
+  private:
+    Host host;
+    AppInfoList apps;
+    GridView* gridView;
+    BRLS_BIND(brls::Box, container, "container");
+
+    GridBenchPhase phase = GRID_BENCH_WARMUP;
+    uint32_t phaseFrames = 0;
+    int focusIndex = 0;
+    int jumps = 0;
+    uint32_t jumpSeed = 1;
+
+    std::vector<GridBenchFrame> frames;
+    uint64_t lastFrameUs = 0;
+    float lastDrawMs = 0;
+    uint64_t lastUploads = 0;
+    uint64_t lastEvictions = 0;
+    uint64_t lastAllocations = 0;
+    uint32_t binds = 0;
+    size_t startInflations = 0;
+    size_t startParses = 0;
+    std::string results;
+
+    void record(uint64_t now);
+    void step();
+    void finish();
+    [[nodiscard]] GridBenchSummary summary() const;
+    void save() const;
+};
@@ -8,9 +8,17 @@
 #pragma once
 
 #include <borealis.hpp>
+#include <functional>
+#include <unordered_map>
 
 using namespace brls;
 
+// Row height in recycling mode, cell height plus spacing between rows
+#define GRID_ROW_HEIGHT 212
+#define GRID_ROW_SPACING 12
+// Rows above and below the screen which keep their cells
+#define GRID_PREFETCH_ROWS 2
+
 class GridView : public Box {
   public:
     GridView();
@@ -20,14 +28,36 @@ class GridView : public Box {
     void clearViews(bool free = true) override;
     View* getParentNavigationDecision(View* from, View* newFocus,
                                       FocusDirection direction) override;
+    void draw(NVGcontext* vg, float x, float y, float width, float height,
+              Style style, FrameContext* ctx) override;
     std::vector<View*>& getChildren();
     int getItemIndex(View* view);
     int getRows();
     int getItemsInRow(int row);
 
+    // Recycling mode, only rows near the screen have cells. Cells are
+    // made by create() once and then reused for other items via bind()
+    void setItems(int count, const std::function<View*()>& create,
+                  const std::function<void(View*, int)>& bind);
+    // Keeps shown cells, only ones changed() returns true for are rebound
+    void updateItems(int count, const std::function<bool(int)>& changed);
+    void focusItem(int index);
+    bool hasItems() { return bindCell != nullptr; }
+
   private:
     int columls = 1;
     Box* lastContainer = nullptr;
     View* lastView = nullptr;
     std::vector<View*> children;
+    std::unordered_map<View*, int> indices;
+
+    std::function<View*()> createCell;
+    std::function<void(View*, int)> bindCell;
+    std::vector<Box*> rows;
+    std::vector<View*> pool;
+
+    void showRow(int row);
+    void hideRow(int row, bool force = false);
+    void addRow();
+    void updateVisibleRows(float top, float bottom);
 };
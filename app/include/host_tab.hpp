@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include "GameStreamClient.hpp"
+#include "HostPinger.hpp"
 #include <Settings.hpp>
 #include <borealis.hpp>
 
@@ -15,13 +17,20 @@ enum HostState { FETCHING, AVAILABLE, UNAVAILABLE };
 class HostTab : public brls::Box {
   public:
     HostTab(const Host& host);
-    void reloadHost();
+    ~HostTab() override;
+    // After wake up, app list is opened as soon as host answers
+    void reloadHost(bool openApps = false);
 
     BRLS_BIND(brls::DetailCell, connect, "connect");
     BRLS_BIND(brls::DetailCell, remove, "remove");
     BRLS_BIND(brls::Header, header, "header");
 
   private:
+    void updateState(const GSResult<SERVER_DATA>& result);
+    void updateLatency(const HostLatency& latency);
+
     Host host;
     HostState state = HostState::FETCHING;
+    HostStatusEvent::Subscription statusSubscription;
+    HostLatencyEvent::Subscription latencySubscription;
 };
@@ -14,7 +14,7 @@
 class IngameOverlay : public brls::Box {
   public:
     explicit IngameOverlay(StreamingView* streamView);
-    ~IngameOverlay() override = default;
+    ~IngameOverlay() override;
 
     brls::AppletFrame* getAppletFrame() override;
     bool isTranslucent() override { return true; }
@@ -59,11 +59,17 @@ class OptionsTab : public brls::Box {
     BRLS_BIND(brls::SelectorCell, guideBySystemButton, "guide_by_system_button");
     BRLS_BIND(brls::Header, volumeHeader, "volume_header");
     BRLS_BIND(brls::Slider, volumeSlider, "volume_slider");
+    BRLS_BIND(brls::BooleanCell, audioOnlyButton, "audio_only");
     BRLS_BIND(brls::Header, rumbleForceHeader, "rumble_slider_header");
     BRLS_BIND(brls::Slider, rumbleForceSlider, "rumble_slider");
     BRLS_BIND(brls::BooleanCell, swapStickToDpad, "swap_stick_to_dpad");
     BRLS_BIND(brls::Header, mouseHeader, "mouse_speed_header");
     BRLS_BIND(brls::Slider, mouseSlider, "mouse_speed_slider");
+    BRLS_BIND(brls::DetailCell, screenshotButton, "screenshot");
+    BRLS_BIND(brls::BooleanCell, recordButton, "record_stream");
     BRLS_BIND(brls::BooleanCell, debugButton, "debug");
+    BRLS_BIND(brls::BooleanCell, frameGraphButton, "frame_graph");
     BRLS_BIND(brls::BooleanCell, onscreenLogButton, "onscreen_log");
+    BRLS_BIND(brls::BooleanCell, latencyProbeButton, "latency_probe");
+    BRLS_BIND(brls::BooleanCell, pipelineTraceButton, "pipeline_trace");
 };
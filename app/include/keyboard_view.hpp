@@ -8,7 +8,12 @@
 #pragma once
 
 #include <borealis.hpp>
+#include <bit>
+#include <cstdint>
+#include <initializer_list>
 #include <map>
+#include <string>
+#include <vector>
 
 enum KeyboardKeys
 {
@@ -27,66 +32,146 @@ struct KeyboardLocale {
     std::string name;
     std::string localization[_VK_KEY_MAX][2];
     std::map<KeyboardKeys, KeyboardKeys> keyMapper;
+    // Plain and shifted title of every key with mapper applied, filled once
+    std::string titles[_VK_KEY_MAX][2];
 };
 
-struct KeyboardState {
-    bool keys[_VK_KEY_MAX];
-    KeyboardState() = default;
+// Key without virtual key code, acts on keyboard itself
+enum KeyboardAction : uint8_t {
+    KEYBOARD_ACTION_NONE,
+    KEYBOARD_ACTION_NUMPAD,
+    KEYBOARD_ACTION_LETTERS,
+    KEYBOARD_ACTION_LANGUAGE,
 };
 
-class KeyboardView;
+struct KeyboardKeyDef {
+    KeyboardKeys key = _VK_KEY_MAX;
+    float width = 90;
+    // Stays pressed until pressed again, for modifiers
+    bool toggle = false;
+    float fontSize = 21;
+    float marginLeft = 4;
+    float marginRight = 4;
+    KeyboardAction action = KEYBOARD_ACTION_NONE;
+    // Title of action keys, others take it from locale
+    const char* title = nullptr;
+};
 
-class ButtonView : public brls::Box {
-  public:
-    explicit ButtonView(KeyboardView* keyboardView);
-    ~ButtonView() override;
-    brls::Label* charLabel;
-    void setKey(KeyboardKeys key);
-    void registerCallback();
-    bool triggerType = false;
-    KeyboardKeys key;
-    std::function<void(void)> event = nullptr;
+struct KeyboardLayout {
+    std::vector<std::vector<KeyboardKeyDef>> rows;
+    // Compact layouts have English letters only
+    bool englishOnly = false;
 
-    void draw(NVGcontext* vg, float x, float y, float width, float height,
-              brls::Style style, brls::FrameContext* ctx) override;
-    void onFocusGained() override;
-    void onFocusLost() override;
+    // Appends keys of the same size to a row
+    static void addKeys(std::vector<KeyboardKeyDef>& row, std::initializer_list<KeyboardKeys> keys,
+                        float width, float fontSize = 27);
+};
+
+#define KEYBOARD_KEY_HEIGHT 56
+#define KEYBOARD_KEY_MARGIN 4
+#define KEYBOARD_PADDING 24
+// Hit-testing grid step, narrower than any key
+#define KEYBOARD_GRID_CELL 8
+
+struct KeyboardKeyRect {
+    const KeyboardKeyDef* def;
+    float x, y, width, height;
+    int row;
+};
+
+// Key rectangles of a layout relative to its top left corner, built once
+// per layout. Touches are found by a grid of key indexes, gaps between
+// keys belong to the nearest one
+struct KeyboardGeometry {
+    explicit KeyboardGeometry(const KeyboardLayout& layout);
+
+    // Key index or -1 outside of keys
+    [[nodiscard]] int hitTest(float x, float y) const;
+    // Key of the row closest to x
+    [[nodiscard]] int nearestKey(int row, float x) const;
+    [[nodiscard]] int rows() const { return (int)rowStart.size() - 1; }
+
+    std::vector<KeyboardKeyRect> keys;
+    // First key of every row, and keys count at the end
+    std::vector<int> rowStart;
+    float width = 0;
+    float height = 0;
 
   private:
-    brls::VoidEvent::Subscription shiftSubscription;
-    bool dummy = true;
-    bool eventPressed = false;
-    bool focusJustGained = false;
+    std::vector<int16_t> m_grid;
+    int m_columns = 0;
+};
+
+// Pressed keys as bits, so changes are found a word at a time
+template <int N>
+struct KeyBitset {
+    uint64_t words[(N + 63) / 64] = {};
 
-    void applyTitle();
-    KeyboardLocale getCurrentLocale();
-    KeyboardView* keyboardView;
+    bool test(int key) const { return (words[key / 64] >> (key % 64)) & 1; }
+    void set(int key, bool pressed) {
+        if (pressed)
+            words[key / 64] |= 1ull << (key % 64);
+        else
+            words[key / 64] &= ~(1ull << (key % 64));
+    }
+    void flip(int key) { words[key / 64] ^= 1ull << (key % 64); }
+
+    // Calls callback with every key which state differs from other
+    template <typename Callback>
+    void forEachChanged(const KeyBitset& other, Callback callback) const {
+        for (int i = 0; i < (N + 63) / 64; i++) {
+            for (uint64_t diff = words[i] ^ other.words[i]; diff; diff &= diff - 1)
+                callback(i * 64 + std::countr_zero(diff));
+        }
+    }
+
+    template <typename Callback>
+    void forEachSet(Callback callback) const { forEachChanged(KeyBitset(), callback); }
 };
 
+using KeyboardState = KeyBitset<_VK_KEY_MAX>;
+
+// Whole keyboard is a single view, keys are drawn as one NanoVG batch from
+// cached layout geometry instead of a borealis view per key
 class KeyboardView : public brls::Box {
   public:
-    inline static brls::VoidEvent shiftUpdated;
-    inline static std::vector<KeyboardLocale> getLocales() { return locales; }
+    inline static const std::vector<KeyboardLocale>& getLocales() { return locales; }
 
     explicit KeyboardView(bool focusable);
     ~KeyboardView() override;
     KeyboardState getKeyboardState();
     short getKeyCode(KeyboardKeys key);
 
-    View* getParentNavigationDecision(View* from, View* newFocus,
-                                      brls::FocusDirection direction) override;
     void draw(NVGcontext* vg, float x, float y, float width, float height,
               brls::Style style, brls::FrameContext* ctx) override;
+    void onFocusGained() override;
+    void onFocusLost() override;
 
   private:
-    int keyboardLangLock = -1;
     bool needFocus = false;
-    void createEnglishLayout();
-    void createNumpadLayout();
-    void createFullLayout();
+    const KeyboardLayout* layout = nullptr;
+    const KeyboardGeometry* geometry = nullptr;
+    int focusedKey = 0;
+    // Key held by touch or by A button, -1 when none
+    int touchedKey = -1;
+    int controllerKey = -1;
+    bool focusJustGained = false;
+    brls::ControllerState oldController;
+    float originX = 0;
+    float originY = 0;
+
+    void setLayout(const KeyboardLayout& layout);
+    const KeyboardLocale& currentLocale();
+    void pressKey(int index);
+    void releaseKey(int index, bool trigger);
+    bool moveFocus(brls::FocusDirection direction);
+    void drawKeys(NVGcontext* vg, float x, float y);
+
+    static const KeyboardLayout& englishLayout();
+    static const KeyboardLayout& numpadLayout();
+    static const KeyboardLayout& fullLayout();
+    static const KeyboardGeometry& geometryFor(const KeyboardLayout& layout);
     static void changeLang(int lang);
-    void createLocales();
+    static void createLocales();
     inline static std::vector<KeyboardLocale> locales;
-
-    friend class ButtonView;
 };
@@ -8,4 +8,19 @@
 
 #pragma once
 
-bool startFromArgs(int argc, char** argv);
+#include "GameStreamClient.hpp"
+#include "Settings.hpp"
+#include <optional>
+
+// Saved host and app given by home menu forwarder
+struct LaunchArgs {
+    Host host;
+    AppInfo app;
+};
+
+// Needs settings loaded, not the window, so connection to host can be
+// started while the rest of UI comes up
+std::optional<LaunchArgs> parseLaunchArgs(int argc, char** argv);
+
+// False when main activity has to be shown
+bool startFromArgs(const std::optional<LaunchArgs>& launch);
@@ -20,6 +20,7 @@ class MainTabs : public brls::TabFrame {
     static View* create();
 
     void willAppear(bool resetState) override;
+    // Null until favorites tab was opened first time
     FavoriteTab* getFavoriteTab() { return favoriteTab; }
     void updateFavoritesIfNeeded();
 
@@ -29,5 +30,5 @@ class MainTabs : public brls::TabFrame {
     bool lastHasAnyFavorites = false;
     inline static MainTabs* instanse;
 
-    FavoriteTab* favoriteTab;
+    FavoriteTab* favoriteTab = nullptr;
 };
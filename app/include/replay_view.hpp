@@ -0,0 +1,49 @@
+//
+//  replay_view.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "AVFrameHolder.hpp"
+#include "IAudioRenderer.hpp"
+#include "IVideoRenderer.hpp"
+#include "SessionReplay.hpp"
+#include "SoakTest.hpp"
+#include "StreamReplay.hpp"
+#include <borealis.hpp>
+
+enum ReplayMode {
+    // Recorded video stream through decoder and renderer
+    REPLAY_FULL_SPEED,
+    REPLAY_AS_RECORDED,
+    // Recorded session with audio, with loss and jitter from settings
+    REPLAY_SESSION,
+    // Recorded session for hours, with reconnects and memory tracking
+    REPLAY_SOAK,
+};
+
+// Benchmark of decoder and renderer on stream recorded in debug settings
+class ReplayView : public brls::Box {
+  public:
+    ReplayView(ReplayMode mode);
+    ~ReplayView();
+
+    void draw(NVGcontext* vg, float x, float y, float width, float height,
+              brls::Style style, brls::FrameContext* ctx) override;
+
+  private:
+    ReplayMode mode;
+    StreamReplay replay;
+    SessionReplay sessionReplay;
+    SoakTest soak;
+    AVFrameHolder frames;
+    IVideoDecoder* decoder = nullptr;
+    IVideoRenderer* renderer = nullptr;
+    IAudioRenderer* audio = nullptr;
+    bool saved = false;
+
+    std::string streamStats();
+    std::string sessionStats();
+    std::string soakStats();
+};
@@ -19,24 +19,49 @@ class SettingsTab : public brls::Box {
     BRLS_BIND(brls::SelectorCell, codec, "codec");
     BRLS_BIND(brls::BooleanCell, requestHdr, "request_hdr");
     BRLS_BIND(brls::SelectorCell, decoder, "decoder");
+    BRLS_BIND(brls::SelectorCell, decoderThreading, "decoder_threading");
+    BRLS_BIND(brls::SelectorCell, framePacing, "frame_pacing");
+    BRLS_BIND(brls::SelectorCell, presentMode, "present_mode");
+    BRLS_BIND(brls::SelectorCell, videoScaling, "video_scaling");
+    BRLS_BIND(brls::BooleanCell, variableRefresh, "variable_refresh");
+    BRLS_BIND(brls::BooleanCell, vicScaling, "vic_scaling");
     BRLS_BIND(brls::BooleanCell, hwDecoding, "use_hw_decoding");
+    BRLS_BIND(brls::BooleanCell, directSurface, "direct_surface");
+    BRLS_BIND(brls::BooleanCell, decoderThread, "decoder_thread");
+    BRLS_BIND(brls::BooleanCell, decoderUpload, "decoder_upload");
+    BRLS_BIND(brls::BooleanCell, autoTune, "auto_tune");
     BRLS_BIND(brls::Header, header, "header");
     BRLS_BIND(brls::Slider, slider, "slider");
+    BRLS_BIND(brls::BooleanCell, limitToDisplay, "limit_to_display");
+    BRLS_BIND(brls::BooleanCell, autoBitrate, "auto_bitrate");
+    BRLS_BIND(brls::BooleanCell, networkProbe, "network_probe");
+    BRLS_BIND(brls::BooleanCell, qosMarking, "qos_marking");
+    BRLS_BIND(brls::BooleanCell, batterySaver, "battery_saver");
+    BRLS_BIND(brls::BooleanCell, audioOnly, "audio_only");
     BRLS_BIND(brls::SelectorCell, audioBackend, "audio_backend");
+    BRLS_BIND(brls::SelectorCell, audioChannels, "audio_channels");
+    BRLS_BIND(brls::SelectorCell, audioLatency, "audio_latency");
+    BRLS_BIND(brls::BooleanCell, audioThread, "audio_thread");
     BRLS_BIND(brls::BooleanCell, optimal, "optimal");
     BRLS_BIND(brls::BooleanCell, pcAudio, "pcAudio");
     BRLS_BIND(brls::BooleanCell, swapUi, "swap_ui");
     BRLS_BIND(brls::DetailCell, swapGame, "swap_game");
     BRLS_BIND(brls::DetailCell, deadzoneStickLeft, "dead_zone_stick_left");
     BRLS_BIND(brls::DetailCell, deadzoneStickRight, "dead_zone_stick_right");
+    BRLS_BIND(brls::SelectorCell, deadzoneType, "dead_zone_type");
+    BRLS_BIND(brls::SelectorCell, antiDeadzone, "anti_dead_zone");
+    BRLS_BIND(brls::SelectorCell, stickCurve, "stick_curve");
     BRLS_BIND(brls::Header, rumbleForceHeader, "rumble_slider_header");
     BRLS_BIND(brls::Slider, rumbleForceSlider, "rumble_slider");
     BRLS_BIND(brls::BooleanCell, swapStickToDpad, "swap_stick_to_dpad");
+    BRLS_BIND(brls::SelectorCell, inputRate, "input_rate");
+    BRLS_BIND(brls::SelectorCell, motionRate, "motion_rate");
     BRLS_BIND(brls::DetailCell, guideKeyButtons, "guide_key_buttons");
     BRLS_BIND(brls::SelectorCell, guideBySystemButton, "guide_by_system_button");
     BRLS_BIND(brls::SelectorCell, overlayTime, "overlay_time");
     BRLS_BIND(brls::DetailCell, overlayButtons, "overlay_buttons");
     BRLS_BIND(brls::SelectorCell, overlayBySystemButton, "overlay_by_system_button");
+    BRLS_BIND(brls::BooleanCell, overlayFreezeVideo, "overlay_freeze_video");
     BRLS_BIND(brls::SelectorCell, mouseInputTime, "mouse_input_time");
     BRLS_BIND(brls::DetailCell, mouseInputButtons, "mouse_input_buttons");
     BRLS_BIND(brls::SelectorCell, keyboardType, "keyboard_type");
@@ -45,9 +70,27 @@ class SettingsTab : public brls::Box {
     BRLS_BIND(brls::BooleanCell, touchscreenMouseMode, "touchscreen_mouse_mode");
     BRLS_BIND(brls::BooleanCell, swapMouseKeys, "swap_mouse_keys");
     BRLS_BIND(brls::BooleanCell, swapMouseScroll, "swap_mouse_scroll");
+    BRLS_BIND(brls::BooleanCell, gyroMouse, "gyro_mouse");
+    BRLS_BIND(brls::SelectorCell, gyroMouseSensitivity, "gyro_mouse_sensitivity");
+    BRLS_BIND(brls::SelectorCell, gyroMouseRatchet, "gyro_mouse_ratchet");
     BRLS_BIND(brls::Header, mouseSpeedHeader, "mouse_speed_header");
     BRLS_BIND(brls::Slider, mouseSpeedSlider, "mouse_speed_slider");
+    BRLS_BIND(brls::SelectorCell, boxartCache, "boxart_cache");
     BRLS_BIND(brls::BooleanCell, writeLog, "writeLog");
+    BRLS_BIND(brls::BooleanCell, recordVideo, "recordVideo");
+    BRLS_BIND(brls::DetailCell, replayFullSpeed, "replayFullSpeed");
+    BRLS_BIND(brls::DetailCell, replayAsRecorded, "replayAsRecorded");
+    BRLS_BIND(brls::BooleanCell, recordSession, "recordSession");
+    BRLS_BIND(brls::SelectorCell, replayLoss, "replayLoss");
+    BRLS_BIND(brls::SelectorCell, replayJitter, "replayJitter");
+    BRLS_BIND(brls::DetailCell, replaySession, "replaySession");
+    BRLS_BIND(brls::SelectorCell, soakDuration, "soakDuration");
+    BRLS_BIND(brls::SelectorCell, soakReconnects, "soakReconnects");
+    BRLS_BIND(brls::DetailCell, soakTest, "soakTest");
+    BRLS_BIND(brls::SelectorCell, gridBenchmarkApps, "gridBenchmarkApps");
+    BRLS_BIND(brls::DetailCell, gridBenchmark, "gridBenchmark");
+    BRLS_BIND(brls::DetailCell, runBenchmarks, "runBenchmarks");
+    BRLS_BIND(brls::DetailCell, runHostBenchmarks, "runHostBenchmarks");
 
     static brls::View* create();
 
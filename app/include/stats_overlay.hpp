@@ -0,0 +1,47 @@
+//
+//  stats_overlay.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "MoonlightSession.hpp"
+#include <borealis.hpp>
+#include <string>
+#include <vector>
+
+// Text is rebuilt at the rate stats caches update, not every frame
+#define STATS_OVERLAY_REFRESH_US 200000
+#define STATS_OVERLAY_FONT_SIZE 20
+#define STATS_GRAPH_SAMPLES 120
+// Graph height matches this frame time, longer frames are clipped
+#define STATS_GRAPH_MAX_MS 50.0f
+
+// Debug info drawn over the stream. Lines and their box are laid out
+// on refresh only, and drawn once without blurred shadow, so overlay
+// cost stays small. That cost is measured and shown with the stats
+class StatsOverlay {
+  public:
+    void draw(NVGcontext* vg, float width, float height, MoonlightSession* session, bool graph);
+
+    // Next draw starts a new graph, called when overlay gets hidden
+    void reset();
+
+  private:
+    void update(NVGcontext* vg, MoonlightSession* session);
+    void drawGraph(NVGcontext* vg, float x, float y, float width, float height);
+
+    std::vector<std::string> m_lines;
+    float m_box_width = 0;
+    float m_line_height = 0;
+    uint64_t m_updated_us = 0;
+
+    float m_frame_times[STATS_GRAPH_SAMPLES] = {};
+    size_t m_frame_index = 0;
+    size_t m_frame_count = 0;
+    uint64_t m_last_frame_us = 0;
+
+    uint64_t m_cost_us = 0;
+    uint32_t m_cost_frames = 0;
+    float m_cost_ms = 0;
+};
@@ -15,11 +15,20 @@
 #include <optional>
 #include "GameStreamClient.hpp"
 #include "MoonlightSession.hpp"
+#include "stats_overlay.hpp"
 #include "two_finger_scroll_recognizer.hpp"
 
+// Above this display runs in high refresh mode
+#define HIGH_REFRESH_MIN_HZ 65
+#define OVERLAY_UPDATE_HZ 60
+// UI loop only keeps connection going while app is in background
+#define SUSPENDED_DRAW_INTERVAL_MS 100
+
 class StreamingView : public brls::Box {
   public:
-    StreamingView(const Host& host, const AppInfo& app);
+    // With fastLaunch set and host state in cache, app is launched at once
+    // and host is validated alongside, instead of being asked first
+    StreamingView(const Host& host, const AppInfo& app, bool fastLaunch = false);
     ~StreamingView();
 
     void draw(NVGcontext* vg, float x, float y, float width, float height,
@@ -31,11 +40,15 @@ class StreamingView : public brls::Box {
     void terminate(bool terminateApp);
 
     bool draw_stats = false;
+    bool draw_frame_graph = false;
 
     Host getHost() { return host; }
 
     AppInfo getApp() { return app; }
 
+    // Null once stream is terminated
+    MoonlightSession* getSession() { return session; }
+
   private:
     Host host;
     AppInfo app;
@@ -46,15 +59,25 @@ class StreamingView : public brls::Box {
     bool blocked = false;
     bool terminated = false;
     bool tempInputLock = false;
+    bool focused = false;
+    // Children aren't drawn or laid out, see updateFastPath()
+    bool fastPath = false;
     brls::Event<brls::KeyState>::Subscription keysSubscription;
     int touchScrollCounter = 0;
     size_t bottombarDelayTask = -1;
     bool m_use_hdr = false;
+    int m_display_fps = 0;
+    uint64_t overlayUpdatedUs = 0;
     TwoFingerScrollGestureRecognizer* scrollTouchRecognizer = nullptr;
+    StatsOverlay statsOverlay;
 
+    void startSession(bool isSunshine, bool cachedHost);
+    void updateBacklight();
+    void updateFastPath();
+    void captureThumbnail();
+    void drawAudioOnly(NVGcontext* vg, float width, float height);
     void handleInput();
     void handleOverlayCombo();
-    void handleMouseInputCombo();
     void addKeyboard();
     void removeKeyboard();
 };
@@ -1,8 +1,50 @@
 package com.borealis.demo;
+import android.content.Context;
+import android.net.wifi.WifiManager;
+import android.os.Build;
+import android.os.PowerManager;
 import org.libsdl.app.SDLActivity;
 
 public class DemoActivity extends SDLActivity
 {
+    // PERF_ANDROID_COMMAND_STREAMING in PerformanceHints.hpp
+    private static final int COMMAND_STREAMING = COMMAND_USER + 1;
+
+    private WifiManager.WifiLock wifiLock;
+
+    @Override
+    protected boolean onUnhandledMessage(int command, Object param) {
+        if (command == COMMAND_STREAMING) {
+            setStreaming((Integer) param != 0);
+            return true;
+        }
+        return super.onUnhandledMessage(command, param);
+    }
+
+    // Radio doesn't go to power save between packets and clocks are kept
+    // where they can be held, while stream is shown
+    private void setStreaming(boolean streaming) {
+        if (streaming && wifiLock == null) {
+            WifiManager wifi = (WifiManager) getApplicationContext().getSystemService(Context.WIFI_SERVICE);
+            if (wifi != null) {
+                int mode = Build.VERSION.SDK_INT >= Build.VERSION_CODES.Q
+                        ? WifiManager.WIFI_MODE_FULL_LOW_LATENCY
+                        : WifiManager.WIFI_MODE_FULL_HIGH_PERF;
+                wifiLock = wifi.createWifiLock(mode, "Moonlight:stream");
+                wifiLock.setReferenceCounted(false);
+                wifiLock.acquire();
+            }
+        } else if (!streaming && wifiLock != null) {
+            wifiLock.release();
+            wifiLock = null;
+        }
+
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.N) {
+            PowerManager power = (PowerManager) getSystemService(Context.POWER_SERVICE);
+            if (power != null && power.isSustainedPerformanceModeSupported())
+                getWindow().setSustainedPerformanceMode(streaming);
+        }
+    }
 
     @Override
     protected void onDestroy() {
@@ -1,34 +1,58 @@
-#ifdef PLATFORM_TVOS
+#if defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
 
 #import <UIKit/UIKit.h>
+#import <QuartzCore/CADisplayLink.h>
+#include <atomic>
+
+#ifdef PLATFORM_TVOS
 #import <AVFoundation/AVDisplayCriteria.h>
 #import <AVKit/AVDisplayManager.h>
 #import <AVKit/UIWindow.h>
-#include "Limelight.h"
-#include "Settings.hpp"
 
 @interface AVDisplayCriteria()
 @property(readonly) int videoDynamicRange;
 @property(readonly, nonatomic) float refreshRate;
 - (id)initWithRefreshRate:(float)arg1 videoDynamicRange:(int)arg2;
 @end
+#else
+// Link which only asks for a rate, ProMotion panels run at the highest
+// rate any link asks for
+@interface DisplayRateVote : NSObject
+- (void)tick:(CADisplayLink*)link;
+@end
 
-void updatePreferredDisplayMode(bool streamActive) {
-    UIWindow* window = [[[UIApplication sharedApplication] delegate] window];
-    AVDisplayManager* displayManager = [window avDisplayManager];
+@implementation DisplayRateVote
+- (void)tick:(CADisplayLink*)link {}
+@end
 
-    // This logic comes from Kodi and MrMC
-    if (streamActive) {
-        int dynamicRange;
+static CADisplayLink* rateLink;
+#endif
 
-        if (LiGetCurrentHostDisplayHdrMode()) {
-            dynamicRange = 2; // HDR10
-        }
-        else {
-            dynamicRange = 0; // SDR
-        }
+static std::atomic<int> preferredRate = 0;
+static bool preferredHdr = false;
+
+int preferredDisplayFrameRate() {
+    return preferredRate.load(std::memory_order_relaxed);
+}
 
-        AVDisplayCriteria* displayCriteria = [[AVDisplayCriteria alloc] initWithRefreshRate:Settings::instance().fps()
+// Display mode follows stream frame rate and dynamic range while stream
+// is shown, so frames are presented without cadence judder. Main thread
+void updatePreferredDisplayMode(bool streamActive, int fps, bool hdr) {
+    int rate = streamActive ? fps : 0;
+    if (rate == preferredRate && hdr == preferredHdr)
+        return;
+    preferredRate = rate;
+    preferredHdr = hdr;
+
+#ifdef PLATFORM_TVOS
+    UIWindow* window = [[[UIApplication sharedApplication] delegate] window];
+    AVDisplayManager* displayManager = [window avDisplayManager];
+
+    // This logic comes from Kodi and MrMC, TV picks its mode closest to
+    // criteria, 50 and 60 Hz ones included when match frame rate is set
+    if (rate > 0) {
+        int dynamicRange = hdr ? 2 : 0; // HDR10 : SDR
+        AVDisplayCriteria* displayCriteria = [[AVDisplayCriteria alloc] initWithRefreshRate:rate
                                                                           videoDynamicRange:dynamicRange];
         displayManager.preferredDisplayCriteria = displayCriteria;
     }
@@ -36,6 +60,24 @@ void updatePreferredDisplayMode(bool streamActive) {
         // Switch back to the default display mode
         displayManager.preferredDisplayCriteria = nil;
     }
+#else
+    if (rate > 0) {
+        if (!rateLink) {
+            rateLink = [CADisplayLink displayLinkWithTarget:[DisplayRateVote new] selector:@selector(tick:)];
+            [rateLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+        }
+
+        if (@available(iOS 15.0, *)) {
+            rateLink.preferredFrameRateRange = CAFrameRateRangeMake(rate, rate, rate);
+        } else {
+            rateLink.preferredFramesPerSecond = rate;
+        }
+    }
+    else {
+        [rateLink invalidate];
+        rateLink = nil;
+    }
+#endif
 }
 
 #endif
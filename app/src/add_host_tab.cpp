@@ -164,6 +164,13 @@ void AddHostTab::connectHost(const std::string& address) {
                         "add_host/pair_prefix"_i18n + pin +
                         "add_host/pair_postfix"_i18n);
                     dialog->setCancelable(false);
+
+                    // Host drops half done pairing, its PIN prompt goes away
+                    auto token = GSCancellation::create();
+                    dialog->addButton("common/cancel"_i18n, [token] {
+                        token->cancel();
+                        AddHostTab::startSearching();
+                    });
                     dialog->open();
 
                     ASYNC_RETAIN
@@ -182,7 +189,7 @@ void AddHostTab::connectHost(const std::string& address) {
                                     });
                                 }
                             });
-                        });
+                        }, token);
                 } else {
                     showError(result.error(),
                               [] { AddHostTab::startSearching(); });
@@ -210,6 +217,8 @@ AddHostTab::~AddHostTab() {
         searchSubscription);
 #elif defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
     darwin_mdns_stop();
+#else
+    GameStreamClient::stop_find_hosts();
 #endif
 }
 
@@ -8,24 +8,50 @@
 #include "app_cell.hpp"
 #include "BoxArtManager.hpp"
 #include "Settings.hpp"
+#include "StreamThumbnails.hpp"
+#include "ViewTemplates.hpp"
 #include "streaming_view.hpp"
+#include <algorithm>
 
-AppCell::AppCell(const Host& host, const AppInfo& app, int currentApp) {
-    this->inflateFromXMLRes("xml/cells/app_cell.xml");
+AppCell::AppCell() {
+    // Grid makes one per visible app, XML is parsed for the first only
+    ViewTemplates::instance().inflate(this, "xml/cells/app_cell.xml");
     this->setFavorite(false);
+    this->addGestureRecognizer(new TapGestureRecognizer(this));
+    title->setTextColor(nvgRGB(255, 255, 255));
+}
+
+AppCell::AppCell(const Host& host, const AppInfo& app, int currentApp) : AppCell() {
+    bind(host, app, currentApp);
+}
+
+AppCell::~AppCell() {
+    if (m_boxart_token)
+        m_boxart_token->cancel();
+}
+
+void AppCell::bind(const Host& host, const AppInfo& app, int currentApp) {
+    if (m_boxart_token) {
+        m_boxart_token->cancel();
+        m_boxart_token = nullptr;
+    }
+
+    m_address = host.address;
+    m_app_id = app.app_id;
+    m_boxart_id = {BoxArtManager::host_id(host), app.app_id};
+    m_boxart_pending = false;
+    m_boxart_ready = false;
 
     title->setText(app.name);
-    title->setTextColor(nvgRGB(255, 255, 255));
 
     bool isUnactive = currentApp != 0 && currentApp != app.app_id;
     unactiveLayer->setVisibility(isUnactive ? Visibility::VISIBLE
                                             : Visibility::GONE);
-    currentAppImage->setVisibility(
-        currentApp == app.app_id ? Visibility::VISIBLE : Visibility::GONE);
+    m_running = currentApp == app.app_id;
+    currentAppImage->setVisibility(m_running ? Visibility::VISIBLE : Visibility::GONE);
 
-    this->addGestureRecognizer(new TapGestureRecognizer(this));
-    this->registerClickAction([host, app](View* view) {
-        auto* frame = new AppletFrame(new StreamingView(host, app));
+    this->registerClickAction([this, host, app](View* view) {
+        auto* frame = new AppletFrame(new StreamingView(host, app, m_fast_launch));
         frame->setBackground(ViewBackground::NONE);
         frame->setHeaderVisibility(brls::Visibility::GONE);
         frame->setFooterVisibility(brls::Visibility::GONE);
@@ -34,25 +60,117 @@ AppCell::AppCell(const Host& host, const AppInfo& app, int currentApp) {
     });
     this->setActionAvailable(BUTTON_A, !isUnactive);
 
-    if (BoxArtManager::instance().has_boxart(app.app_id))
-        image->setImageFromFile(
-            BoxArtManager::get_texture_path(app.app_id));
-    else {
-        ASYNC_RETAIN
-        GameStreamClient::instance().app_boxart(
-            host.address, app.app_id, [ASYNC_TOKEN, host, app](auto result) {
-                ASYNC_RELEASE
-
-                if (result.isSuccess()) {
-                    BoxArtManager::instance().set_data(result.value(),
-                                                       app.app_id);
-                    image->setImageFromFile(
-                        BoxArtManager::get_texture_path(app.app_id));
-                }
-            });
+    if (BoxArtManager::instance().has_boxart(m_boxart_id)) {
+        m_boxart_ready = true;
+        if (BoxArtManager::instance().needs_refresh(m_boxart_id))
+            requestBoxArt(host, app, true);
+    } else {
+        m_boxart_pending = true;
+        requestBoxArt(host, app, false);
     }
 }
 
+void AppCell::requestBoxArt(const Host& host, const AppInfo& app, bool refresh) {
+    m_boxart_token = GSCancellation::create();
+
+    ASYNC_RETAIN
+    GameStreamClient::instance().app_boxart(
+        host.address, app.app_id, [ASYNC_TOKEN, host, app, refresh, id = m_boxart_id](auto result) {
+            ASYNC_RELEASE
+
+            if (result.isSuccess())
+                BoxArtManager::instance().set_data(std::move(result).value(), id);
+
+            // Cell could be reused for another app meanwhile, refreshed
+            // one keeps showing stored box art anyway
+            if (refresh || m_app_id != app.app_id || m_address != host.address)
+                return;
+
+            m_boxart_pending = false;
+            m_boxart_ready = result.isSuccess();
+        }, m_boxart_token, refresh);
+}
+
+void AppCell::draw(NVGcontext* vg, float x, float y, float width, float height,
+                   Style style, FrameContext* ctx) {
+    bool visible = y + height > 0 && y < Application::contentHeight;
+
+    // Cells on screen get their box art before ones scrolled away
+    if (m_boxart_pending && visible) {
+        m_boxart_pending = false;
+        GameStreamClient::instance().prioritize_boxart(m_address, m_app_id);
+    }
+
+    // Texture is shared through BoxArtManager, only visible cells keep it resident
+    int texture = -1;
+    if (m_boxart_ready && visible)
+        texture = BoxArtManager::instance().texture(vg, m_boxart_id);
+    // Tile from app list cache stands in until texture is uploaded
+    if (texture <= 0 && visible)
+        texture = BoxArtManager::instance().placeholder_texture(vg, m_boxart_id);
+    drawBoxArt(vg, texture);
+    if (m_running && visible)
+        drawPreview(vg, StreamThumbnails::instance().texture(vg, m_boxart_id));
+
+    // Badge views only hold place, icons come from shared atlas
+    drawBadge(vg, favoriteAppImage, UI_ICON_STAR);
+    drawBadge(vg, currentAppImage, UI_ICON_PLAY);
+
+    Box::draw(vg, x, y, width, height, style, ctx);
+}
+
+void AppCell::drawBoxArt(NVGcontext* vg, int texture) {
+    float x = image->getX();
+    float y = image->getY();
+    float width = image->getWidth();
+    float height = image->getHeight();
+
+    nvgBeginPath(vg);
+    nvgRoundedRect(vg, x, y, width, height, BOXART_CORNER_RADIUS);
+
+    if (texture <= 0) {
+        nvgFillColor(vg, nvgRGBA(0, 0, 0, 0x30));
+        nvgFill(vg);
+        return;
+    }
+
+    // Same as "fill" scaling, crop to cell keeping aspect ratio
+    int imageWidth, imageHeight;
+    nvgImageSize(vg, texture, &imageWidth, &imageHeight);
+    float scale = std::max(width / (float)imageWidth, height / (float)imageHeight);
+    float drawWidth = (float)imageWidth * scale;
+    float drawHeight = (float)imageHeight * scale;
+
+    nvgFillPaint(vg, nvgImagePattern(vg, x + (width - drawWidth) / 2,
+                                     y + (height - drawHeight) / 2,
+                                     drawWidth, drawHeight, 0, texture, 1.0f));
+    nvgFill(vg);
+}
+
+void AppCell::drawPreview(NVGcontext* vg, int texture) {
+    if (texture <= 0)
+        return;
+
+    // Lower part of box art, where game was left
+    float width = image->getWidth();
+    float height = width * STREAM_THUMBNAIL_HEIGHT / STREAM_THUMBNAIL_WIDTH;
+    float x = image->getX();
+    float y = image->getY() + image->getHeight() - height;
+
+    nvgBeginPath(vg);
+    nvgRoundedRectVarying(vg, x, y, width, height, 0, 0, BOXART_CORNER_RADIUS, BOXART_CORNER_RADIUS);
+    nvgFillPaint(vg, nvgImagePattern(vg, x, y, width, height, 0, texture, 1.0f));
+    nvgFill(vg);
+}
+
+void AppCell::drawBadge(NVGcontext* vg, View* badge, UIIcon icon) {
+    if (badge->getVisibility() != Visibility::VISIBLE)
+        return;
+
+    UIIconAtlas::instance().draw(vg, icon, badge->getX(), badge->getY(), badge->getWidth(),
+                                 badge->getHeight(), badge->getAlpha());
+}
+
 void AppCell::setFavorite(bool favorite) {
     favoriteAppImage->setVisibility(favorite ? Visibility::VISIBLE
                                              : Visibility::GONE);
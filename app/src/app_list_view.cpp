@@ -6,11 +6,13 @@
 //
 
 #include "app_list_view.hpp"
+#include "HighResClock.hpp"
 #include "helper.hpp"
 #include "main_tabs_view.hpp"
 
 AppListView::AppListView(const Host& host) : host(host) {
     this->inflateFromXMLRes("xml/views/app_list_view.xml");
+    Settings::instance().set_last_host(host.address);
 
     auto* label = new brls::Label();
     label->setText(brls::Hint::getKeyIcon(ControllerButton::BUTTON_BACK) +
@@ -59,9 +61,16 @@ AppListView::AppListView(const Host& host) : host(host) {
                        this->updateAppList();
                        return true;
                    });
+    registerAction("app_list/search"_i18n, BUTTON_START,
+                   [this](View* view) {
+                       this->openSearch();
+                       return true;
+                   });
     blockInput(true);
 }
 
+AppListView::~AppListView() { cancelToken->cancel(); }
+
 void AppListView::blockInput(bool block) {
     if (block && !inputBlocked) {
         inputBlocked = block;
@@ -88,6 +97,8 @@ void AppListView::terninateApp() {
 
         loading = true;
         gridView->clearViews();
+        apps.clear();
+        library.clear();
         Application::giveFocus(this);
         loader->setHidden(false);
         blockInput(true);
@@ -116,15 +127,18 @@ void AppListView::updateAppList() {
 
     loading = true;
 
-    gridView->clearViews();
-    Application::giveFocus(this);
-    loader->setHidden(false);
-    currentApp = std::nullopt;
-    hintView->setVisibility(Visibility::GONE);
-    blockInput(true);
+    // Shown list stays while reloading and is updated in place
+    bool reload = gridView->hasItems();
+    if (!reload) {
+        Application::giveFocus(this);
+        loader->setHidden(false);
+        currentApp = std::nullopt;
+        hintView->setVisibility(Visibility::GONE);
+        blockInput(true);
 
-    getAppletFrameItem()->title = host.hostname;
-    updateAppletFrameItem();
+        getAppletFrameItem()->title = host.hostname;
+        updateAppletFrameItem();
+    }
 
     ASYNC_RETAIN
     GameStreamClient::instance().connect(
@@ -132,12 +146,11 @@ void AppListView::updateAppList() {
             ASYNC_RELEASE
 
             if (result.isSuccess()) {
-                int currentGame = result.value().currentGame;
-
+                // Cached list comes first, then again if host reports changes
                 ASYNC_RETAIN
                 GameStreamClient::instance().applist(
                     host.address,
-                    [ASYNC_TOKEN, currentGame](const GSResult<AppInfoList>& result) {
+                    [ASYNC_TOKEN](GSResult<AppInfoList>&& result) {
                         ASYNC_RELEASE
 
                         loading = false;
@@ -145,45 +158,132 @@ void AppListView::updateAppList() {
                         blockInput(false);
 
                         if (result.isSuccess()) {
-                            AppInfoList sortedApps = result.value();
-                            std::sort(
+                            int runningGame = GameStreamClient::instance()
+                                                  .read_server_data(host.address,
+                                                                    [](auto& data) { return data.currentGame; })
+                                                  .value_or(0);
+
+                            currentApp = std::nullopt;
+                            hintView->setVisibility(Visibility::GONE);
+                            getAppletFrameItem()->title = host.hostname;
+                            updateAppletFrameItem();
+
+                            // Stable, so unchanged list keeps its order and cells
+                            AppInfoList sortedApps = std::move(result).value();
+                            std::stable_sort(
                                 sortedApps.begin(), sortedApps.end(),
-                                [this, currentGame](const AppInfo& l, const AppInfo& r) {
+                                [this, runningGame](const AppInfo& l, const AppInfo& r) {
                                     int lScore = 0;
                                     int rScore = 0;
 
-                                    if (l.app_id == currentGame) lScore+=2;
+                                    if (l.app_id == runningGame) lScore+=2;
                                     if (Settings::instance().is_favorite(this->host, l.app_id)) lScore+=1;
 
-                                    if (r.app_id == currentGame) rScore+=2;
+                                    if (r.app_id == runningGame) rScore+=2;
                                     if (Settings::instance().is_favorite(this->host, r.app_id)) rScore+=1;
 
                                     return lScore > rScore;
                                 });
 
                             for (const AppInfo& app : sortedApps) {
-                                if (app.app_id == currentGame)
+                                if (app.app_id == runningGame)
                                     setCurrentApp(app);
-
-                                auto* cell =
-                                    new AppCell(host, app, currentGame);
-                                cell->setFavorite(
-                                    Settings::instance().is_favorite(
-                                        host, app.app_id));
-                                gridView->addView(cell);
-                                this->updateFavoriteAction(cell, host, app);
                             }
-                            Application::giveFocus(this);
+
+                            showApps(sortedApps, runningGame);
                         } else {
                             showError(result.error(),
                                       [this] { this->dismiss(); });
                         }
-                    });
+                    }, true, cancelToken);
             } else {
                 blockInput(false);
                 showError(result.error(), [this] { this->dismiss(); });
             }
-        });
+        }, true);
+}
+
+void AppListView::showApps(const AppInfoList& newApps, int newCurrentGame) {
+    library = newApps;
+    searchIndex.update(library);
+    showFiltered(newCurrentGame);
+}
+
+void AppListView::openSearch() {
+    Application::getPlatform()->getImeManager()->openForText(
+        [this](const std::string& text) {
+            searchQuery = text;
+            registerAction(searchQuery.empty() ? "app_list/search"_i18n
+                                               : "app_list/search"_i18n + ": " + searchQuery,
+                           BUTTON_START, [this](View* view) {
+                               this->openSearch();
+                               return true;
+                           });
+            Application::getGlobalHintsUpdateEvent()->fire();
+            showFiltered(currentGame);
+        },
+        "app_list/search"_i18n, "app_list/search_hint"_i18n, 64, searchQuery, 0);
+}
+
+void AppListView::showFiltered(int newCurrentGame) {
+    uint64_t start = HighResClock::now_us();
+    AppInfoList newApps;
+    if (searchQuery.empty()) {
+        newApps = library;
+    } else {
+        std::vector<int> matches = searchIndex.search(searchQuery);
+        newApps.reserve(matches.size());
+        for (int index : matches)
+            newApps.push_back(library[index]);
+    }
+    brls::Logger::debug("AppListView: {} of {} apps match in {} us", newApps.size(),
+                        library.size(), HighResClock::now_us() - start);
+
+    AppInfoList oldApps = apps;
+    bool gameChanged = newCurrentGame != currentGame;
+    apps = newApps;
+    currentGame = newCurrentGame;
+
+    if (!gridView->hasItems()) {
+        // Big libraries get cells only for rows near the screen
+        gridView->setItems(
+            (int)apps.size(), [] { return new AppCell(); },
+            [this](View* view, int index) {
+                auto* cell = (AppCell*)view;
+                const AppInfo& app = apps[index];
+                cell->bind(host, app, currentGame);
+                cell->setFavorite(
+                    Settings::instance().is_favorite(host, app.app_id));
+                this->updateFavoriteAction(cell, host, app);
+            });
+        Application::giveFocus(this);
+        return;
+    }
+
+    int focusIndex = gridView->getItemIndex(Application::getCurrentFocus());
+    int focusApp = focusIndex >= 0 && focusIndex < (int)oldApps.size()
+                       ? oldApps[focusIndex].app_id
+                       : -1;
+
+    // Running game changes badge and availability of every cell
+    gridView->updateItems((int)apps.size(), [&](int index) {
+        return gameChanged || index >= (int)oldApps.size() ||
+               oldApps[index].app_id != apps[index].app_id ||
+               oldApps[index].name != apps[index].name;
+    });
+
+    if (focusIndex < 0)
+        return;
+
+    auto focused = std::find_if(apps.begin(), apps.end(), [focusApp](const AppInfo& app) {
+        return app.app_id == focusApp;
+    });
+    if (focused != apps.end())
+        gridView->focusItem((int)(focused - apps.begin()));
+    else if (!apps.empty())
+        gridView->focusItem(std::min(focusIndex, (int)apps.size() - 1));
+    else
+        Application::giveFocus(this);
 }
 
 void AppListView::setCurrentApp(const AppInfo& app) {
@@ -220,7 +320,9 @@ void AppListView::updateFavoriteAction(AppCell* cell, Host host, const AppInfo&
                 App thisApp{app.name, app.app_id};
                 Settings::instance().add_favorite(host, thisApp);
             }
-            MainTabs::getInstanse()->getFavoriteTab()->setRefreshNeeded();
+            // Tab not built yet gets fresh list when it is
+            if (auto* favoriteTab = MainTabs::getInstanse()->getFavoriteTab())
+                favoriteTab->setRefreshNeeded();
             this->updateFavoriteAction(cell, host, app);
             return true;
         });
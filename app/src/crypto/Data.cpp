@@ -1,11 +1,27 @@
 #include "Data.hpp"
+#include "MemoryAccounting.hpp"
 #include <borealis.hpp>
 #include <cstdlib>
 #include <string.h>
 
-Data::Data(unsigned char* bytes, size_t size) {
+// Every buffer has room for terminator, it's counted too
+static unsigned char* data_alloc(size_t size) {
+    auto* bytes = (unsigned char*)malloc(size + 1);
+    if (bytes)
+        MemoryAccounting::add(MEM_DATA, size + 1);
+    return bytes;
+}
+
+static void data_free(unsigned char* bytes, size_t size) {
+    if (!bytes)
+        return;
+    free(bytes);
+    MemoryAccounting::remove(MEM_DATA, size + 1);
+}
+
+Data::Data(const unsigned char* bytes, size_t size) {
     if (bytes && size > 0) {
-        m_bytes = (unsigned char*)malloc(size + 1);
+        m_bytes = data_alloc(size);
         m_bytes[size] = '\0';
         memcpy(m_bytes, bytes, size);
         m_size = size;
@@ -13,19 +29,17 @@ Data::Data(unsigned char* bytes, size_t size) {
 }
 
 Data::Data(size_t capacity) {
-    m_bytes = (unsigned char*)malloc(capacity + 1);
+    m_bytes = data_alloc(capacity);
     memset(m_bytes, 0, capacity + 1);
     m_bytes[capacity] = '\0';
     m_size = capacity;
 }
 
-Data::~Data() {
-    if (m_bytes) {
-        free(m_bytes);
-    }
-}
+Data::~Data() { data_free(m_bytes, m_size); }
+
+Data::Data(DataView view) : Data(view.bytes(), view.size()) {}
 
-Data Data::subdata(size_t start, size_t size) {
+Data Data::subdata(size_t start, size_t size) const {
     if (start + size > m_size) {
         brls::Logger::error("Data: Invalid data length...");
         exit(-1);
@@ -33,23 +47,29 @@ Data Data::subdata(size_t start, size_t size) {
     return Data(&m_bytes[start], size);
 }
 
-Data Data::append(Data other) {
+Data Data::append(DataView other) const {
     if (is_empty()) {
-        return other;
+        return Data(other);
     }
 
-    Data data(m_size + other.m_size);
+    Data data(m_size + other.size());
     memcpy(data.m_bytes, m_bytes, m_size);
-    memcpy(&data.m_bytes[m_size], other.m_bytes, other.m_size);
+    memcpy(&data.m_bytes[m_size], other.bytes(), other.size());
     return data;
 }
 
-Data::Data(const Data& that) : Data(0) {
-    if (m_bytes) {
-        free(m_bytes);
+DataView DataView::subview(size_t start, size_t size) const {
+    if (start + size > m_size) {
+        brls::Logger::error("Data: Invalid data length...");
+        exit(-1);
     }
+    return DataView(&m_bytes[start], size);
+}
+
+Data::Data(const Data& that) : Data(0) {
+    data_free(m_bytes, m_size);
 
-    m_bytes = (unsigned char*)malloc(that.size() + 1);
+    m_bytes = data_alloc(that.m_size);
     memcpy(m_bytes, that.m_bytes, that.m_size);
     m_bytes[that.m_size] = '\0';
     m_size = that.m_size;
@@ -57,11 +77,9 @@ Data::Data(const Data& that) : Data(0) {
 
 Data& Data::operator=(const Data& that) {
     if (this != &that) {
-        if (m_bytes) {
-            free(m_bytes);
-        }
+        data_free(m_bytes, m_size);
 
-        m_bytes = (unsigned char*)malloc(that.m_size + 1);
+        m_bytes = data_alloc(that.m_size);
         memcpy(m_bytes, that.m_bytes, that.m_size);
         m_bytes[that.m_size] = '\0';
         m_size = that.m_size;
@@ -69,6 +87,37 @@ Data& Data::operator=(const Data& that) {
     return *this;
 }
 
+Data::Data(Data&& that) noexcept : m_bytes(that.m_bytes), m_size(that.m_size) {
+    that.m_bytes = nullptr;
+    that.m_size = 0;
+}
+
+Data& Data::operator=(Data&& that) noexcept {
+    if (this != &that) {
+        data_free(m_bytes, m_size);
+
+        m_bytes = that.m_bytes;
+        m_size = that.m_size;
+        that.m_bytes = nullptr;
+        that.m_size = 0;
+    }
+    return *this;
+}
+
+Data Data::adopt(unsigned char* bytes, size_t size) {
+    Data data;
+    if (bytes && size > 0) {
+        bytes[size] = '\0';
+        data_free(data.m_bytes, data.m_size);
+        MemoryAccounting::add(MEM_DATA, size + 1);
+        data.m_bytes = bytes;
+        data.m_size = size;
+    } else {
+        free(bytes);
+    }
+    return data;
+}
+
 Data Data::random_bytes(size_t size) {
     unsigned char* bytes = (unsigned char*)malloc(sizeof(char) * size);
 
@@ -104,7 +153,7 @@ Data Data::read_from_file(std::string path) {
     return Data();
 }
 
-void Data::write_to_file(std::string path) {
+void Data::write_to_file(std::string path) const {
     FILE* f = fopen(path.c_str(), "w");
     if (f) {
         fwrite(m_bytes, m_size, 1, f);
@@ -114,18 +163,52 @@ void Data::write_to_file(std::string path) {
     }
 }
 
+static const char hex_digits[] = "0123456789ABCDEF";
+
+// Nibble of every char, 0 for those which aren't hex digits
+struct HexNibbles {
+    unsigned char values[256] = {};
+
+    constexpr HexNibbles() {
+        for (int i = 0; i < 10; i++)
+            values['0' + i] = i;
+        for (int i = 0; i < 6; i++) {
+            values['A' + i] = 10 + i;
+            values['a' + i] = 10 + i;
+        }
+    }
+};
+
+static constexpr HexNibbles hex_nibbles;
+
+size_t Data::hex_encode(DataView data, char* output, size_t capacity) {
+    size_t length = data.size() * 2;
+    if (length + 1 > capacity)
+        return 0;
+
+    const unsigned char* bytes = data.bytes();
+    for (size_t i = 0; i < data.size(); i++) {
+        output[i * 2] = hex_digits[bytes[i] >> 4];
+        output[i * 2 + 1] = hex_digits[bytes[i] & 0xF];
+    }
+    output[length] = '\0';
+    return length;
+}
+
+size_t Data::hex_decode(const char* hex, size_t size, unsigned char* output, size_t capacity) {
+    size_t length = size / 2;
+    if (length > capacity)
+        return 0;
+
+    const unsigned char* digits = (const unsigned char*)hex;
+    for (size_t i = 0; i < length; i++)
+        output[i] = (hex_nibbles.values[digits[i * 2]] << 4) | hex_nibbles.values[digits[i * 2 + 1]];
+    return length;
+}
+
 Data Data::hex_to_bytes() const {
     Data data(m_size / 2);
-    char byte_chars[3] = {'\0', '\0', '\0'};
-    unsigned long whole_byte;
-
-    int i = 0, counter = 0;
-    while (i < m_size) {
-        byte_chars[0] = m_bytes[i++];
-        byte_chars[1] = m_bytes[i++];
-        whole_byte = strtoul(byte_chars, NULL, 16);
-        data.m_bytes[counter++] = whole_byte;
-    }
+    hex_decode((const char*)m_bytes, m_size, data.m_bytes, data.m_size);
     return data;
 }
 
@@ -135,14 +218,8 @@ Data Data::hex() const {
         return Data(&end, 1);
     }
 
-    int counter = 0;
     Data hex(m_size * 2);
-    char fmt[3] = {'\0', '\0', '\0'};
-    for (int i = 0; i < m_size; i++) {
-        sprintf(fmt, "%02X", m_bytes[i]);
-        hex.m_bytes[counter++] = fmt[0];
-        hex.m_bytes[counter++] = fmt[1];
-    }
-    hex.m_bytes[m_size * 2] = '\0';
+    // Data keeps a byte for terminator past its size
+    hex_encode(*this, (char*)hex.m_bytes, hex.m_size + 1);
     return hex;
 }
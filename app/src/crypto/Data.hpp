@@ -2,12 +2,16 @@
 #include <string>
 #pragma once
 
+class DataView;
+
 class Data {
   public:
     Data() : Data(0){};
-    Data(unsigned char* bytes, size_t size);
-    Data(char* bytes, size_t size) : Data((unsigned char*)bytes, size){};
+    Data(const unsigned char* bytes, size_t size);
+    Data(const char* bytes, size_t size) : Data((const unsigned char*)bytes, size){};
     Data(size_t capacity);
+    // Copies bytes seen by view
+    explicit Data(DataView view);
 
     ~Data();
 
@@ -15,22 +19,55 @@ class Data {
 
     size_t size() const { return m_size; }
 
-    Data subdata(size_t start, size_t size);
-    Data append(Data other);
+    Data subdata(size_t start, size_t size) const;
+    Data append(DataView other) const;
 
     Data(const Data& that);
     Data& operator=(const Data& that);
+    Data(Data&& that) noexcept;
+    Data& operator=(Data&& that) noexcept;
+
+    // Takes ownership of malloc'ed buffer with room for size + 1 bytes
+    static Data adopt(unsigned char* bytes, size_t size);
 
     static Data random_bytes(size_t size);
     static Data read_from_file(std::string path);
-    void write_to_file(std::string path);
+    void write_to_file(std::string path) const;
 
     Data hex_to_bytes() const;
     Data hex() const;
 
+    // Table driven hex codec writing into caller storage. Encode puts
+    // 2 * size uppercase digits and terminator, decode takes pairs of
+    // digits, chars which aren't digits count as 0. Both return written
+    // length, 0 when output doesn't fit
+    static size_t hex_encode(DataView data, char* output, size_t capacity);
+    static size_t hex_decode(const char* hex, size_t size, unsigned char* output, size_t capacity);
+
     bool is_empty() const { return m_size == 0; }
 
   private:
     unsigned char* m_bytes = nullptr;
     size_t m_size = 0;
 };
+
+// Read-only window into bytes owned by Data or someone else, it must
+// not outlive them. Passed by value to APIs which only read bytes, so
+// callers don't copy buffers just to call them
+class DataView {
+  public:
+    DataView(const Data& data) : m_bytes(data.bytes()), m_size(data.size()) {}
+    DataView(const unsigned char* bytes, size_t size) : m_bytes(bytes), m_size(size) {}
+
+    const unsigned char* bytes() const { return m_bytes; }
+
+    size_t size() const { return m_size; }
+
+    bool is_empty() const { return m_size == 0; }
+
+    DataView subview(size_t start, size_t size) const;
+
+  private:
+    const unsigned char* m_bytes = nullptr;
+    size_t m_size = 0;
+};
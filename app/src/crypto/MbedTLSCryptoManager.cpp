@@ -6,17 +6,45 @@
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/entropy.h>
 #include <mbedtls/error.h>
+#include <mbedtls/gcm.h>
 #include <mbedtls/sha1.h>
 #include <mbedtls/sha256.h>
 #include <mbedtls/x509.h>
 #include <mbedtls/x509_crt.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <string.h>
 
+#ifdef CRYPTO_HW_ACCELERATION
+#include <switch.h>
+
+static std::atomic<bool> m_hw_acceleration = true;
+#endif
+
 static Data m_cert;
 static Data m_key;
 
+// Parsed once for m_key and m_cert, pairing signs several times.
+// Random generator is seeded once too, entropy gathering is slow
+static std::mutex m_parsed_mutex;
+static mbedtls_pk_context m_parsed_key;
+static bool m_parsed_key_ready = false;
+static Data m_cert_signature;
+static mbedtls_entropy_context m_entropy;
+static mbedtls_ctr_drbg_context m_ctr_drbg;
+static bool m_ctr_drbg_ready = false;
+
 static bool _generate_new_cert_key_pair();
 
+static void _reset_parsed() {
+    std::lock_guard<std::mutex> lock(m_parsed_mutex);
+    if (m_parsed_key_ready)
+        mbedtls_pk_free(&m_parsed_key);
+    m_parsed_key_ready = false;
+    m_cert_signature = Data();
+}
+
 bool MbedTLSCryptoManager::load_cert_key_pair() {
     if (m_key.is_empty() || m_cert.is_empty()) {
         Data cert = Data::read_from_file(Settings::instance().key_dir() + "/" +
@@ -25,6 +53,7 @@ bool MbedTLSCryptoManager::load_cert_key_pair() {
                                         KEY_FILE_NAME);
 
         if (!cert.is_empty() && !key.is_empty()) {
+            _reset_parsed();
             m_cert = cert;
             m_key = key;
             return true;
@@ -35,6 +64,7 @@ bool MbedTLSCryptoManager::load_cert_key_pair() {
 }
 
 bool MbedTLSCryptoManager::generate_new_cert_key_pair() {
+    _reset_parsed();
     if (_generate_new_cert_key_pair()) {
         if (!m_cert.is_empty() && !m_key.is_empty()) {
             m_cert.write_to_file(Settings::instance().key_dir() + "/" +
@@ -51,15 +81,38 @@ void MbedTLSCryptoManager::remove_cert_key_pair() {
     remove(
         (Settings::instance().key_dir() + "/" + CERTIFICATE_FILE_NAME).c_str());
     remove((Settings::instance().key_dir() + "/" + KEY_FILE_NAME).c_str());
+    _reset_parsed();
     m_cert = Data();
     m_key = Data();
 }
 
-Data MbedTLSCryptoManager::cert_data() { return m_cert; }
+const Data& MbedTLSCryptoManager::cert_data() { return m_cert; }
+
+const Data& MbedTLSCryptoManager::key_data() { return m_key; }
+
+void MbedTLSCryptoManager::set_hw_acceleration(bool enabled) {
+#ifdef CRYPTO_HW_ACCELERATION
+    m_hw_acceleration = enabled;
+#endif
+}
+
+bool MbedTLSCryptoManager::hw_acceleration() {
+#ifdef CRYPTO_HW_ACCELERATION
+    return m_hw_acceleration;
+#else
+    return false;
+#endif
+}
 
-Data MbedTLSCryptoManager::key_data() { return m_key; }
+Data MbedTLSCryptoManager::SHA1_hash_data(DataView data) {
+#ifdef CRYPTO_HW_ACCELERATION
+    if (m_hw_acceleration) {
+        unsigned char sha1[SHA1_HASH_SIZE];
+        sha1CalculateHash(sha1, data.bytes(), data.size());
+        return Data(sha1, sizeof(sha1));
+    }
+#endif
 
-Data MbedTLSCryptoManager::SHA1_hash_data(Data data) {
     mbedtls_sha1_context ctx;
     unsigned char sha1[20];
     mbedtls_sha1_init(&ctx);
@@ -68,7 +121,15 @@ Data MbedTLSCryptoManager::SHA1_hash_data(Data data) {
     return Data(sha1, sizeof(sha1));
 }
 
-Data MbedTLSCryptoManager::SHA256_hash_data(Data data) {
+Data MbedTLSCryptoManager::SHA256_hash_data(DataView data) {
+#ifdef CRYPTO_HW_ACCELERATION
+    if (m_hw_acceleration) {
+        unsigned char sha256[SHA256_HASH_SIZE];
+        sha256CalculateHash(sha256, data.bytes(), data.size());
+        return Data(sha256, sizeof(sha256));
+    }
+#endif
+
     mbedtls_sha256_context ctx;
     unsigned char sha256[32];
     mbedtls_sha256_init(&ctx);
@@ -77,29 +138,42 @@ Data MbedTLSCryptoManager::SHA256_hash_data(Data data) {
     return Data(sha256, sizeof(sha256));
 }
 
-Data MbedTLSCryptoManager::create_AES_key_from_salt_SHA1(Data salted_pin) {
+Data MbedTLSCryptoManager::create_AES_key_from_salt_SHA1(DataView salted_pin) {
     return SHA1_hash_data(salted_pin).subdata(0, 16);
 }
 
-Data MbedTLSCryptoManager::create_AES_key_from_salt_SHA256(Data salted_pin) {
+Data MbedTLSCryptoManager::create_AES_key_from_salt_SHA256(DataView salted_pin) {
     return SHA256_hash_data(salted_pin).subdata(0, 16);
 }
 
-static int get_encrypt_size(Data data) {
+static int get_encrypt_size(DataView data) {
     // the size is the length of the data ceiling to the nearest 16 bytes
     return (((int)data.size() + 15) / 16) * 16;
 }
 
-Data MbedTLSCryptoManager::aes_encrypt(Data data, Data key) {
-    mbedtls_aes_context ctx;
-    mbedtls_aes_init(&ctx);
-    mbedtls_aes_setkey_enc(&ctx, key.bytes(), 128);
-
+Data MbedTLSCryptoManager::aes_encrypt(DataView data, DataView key) {
     int size = get_encrypt_size(data);
-    unsigned char* buffer = (unsigned char*)malloc(size);
+    // One more byte for terminator Data::adopt() puts there
+    unsigned char* buffer = (unsigned char*)malloc(size + 1);
     unsigned char* block_rounded_buffer = (unsigned char*)calloc(1, size);
     memcpy(block_rounded_buffer, data.bytes(), data.size());
 
+#ifdef CRYPTO_HW_ACCELERATION
+    if (m_hw_acceleration) {
+        Aes128Context aes;
+        aes128ContextCreate(&aes, key.bytes(), true);
+        for (int block_offset = 0; block_offset < size; block_offset += AES_BLOCK_SIZE)
+            aes128EncryptBlock(&aes, buffer + block_offset, block_rounded_buffer + block_offset);
+
+        free(block_rounded_buffer);
+        return Data::adopt(buffer, size);
+    }
+#endif
+
+    mbedtls_aes_context ctx;
+    mbedtls_aes_init(&ctx);
+    mbedtls_aes_setkey_enc(&ctx, key.bytes(), 128);
+
     int block_offset = 0;
     while (block_offset < size) {
         mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_ENCRYPT,
@@ -108,18 +182,29 @@ Data MbedTLSCryptoManager::aes_encrypt(Data data, Data key) {
         block_offset += 16;
     }
 
-    Data encrypted_data = Data((char*)buffer, size);
+    Data encrypted_data = Data::adopt(buffer, size);
     mbedtls_aes_free(&ctx);
-    free(buffer);
     free(block_rounded_buffer);
     return encrypted_data;
 }
 
-Data MbedTLSCryptoManager::aes_decrypt(Data data, Data key) {
+Data MbedTLSCryptoManager::aes_decrypt(DataView data, DataView key) {
+    unsigned char* buffer = (unsigned char*)malloc(data.size() + 1);
+
+#ifdef CRYPTO_HW_ACCELERATION
+    if (m_hw_acceleration) {
+        Aes128Context aes;
+        aes128ContextCreate(&aes, key.bytes(), false);
+        for (size_t block_offset = 0; block_offset < data.size(); block_offset += AES_BLOCK_SIZE)
+            aes128DecryptBlock(&aes, buffer + block_offset, data.bytes() + block_offset);
+
+        return Data::adopt(buffer, data.size());
+    }
+#endif
+
     mbedtls_aes_context ctx;
     mbedtls_aes_init(&ctx);
     mbedtls_aes_setkey_dec(&ctx, key.bytes(), 128);
-    unsigned char* buffer = (unsigned char*)malloc(data.size());
 
     int block_offset = 0;
     while (block_offset < data.size()) {
@@ -129,57 +214,298 @@ Data MbedTLSCryptoManager::aes_decrypt(Data data, Data key) {
         block_offset += 16;
     }
 
-    Data decrypted_data = Data(buffer, data.size());
+    Data decrypted_data = Data::adopt(buffer, data.size());
     mbedtls_aes_free(&ctx);
-    free(buffer);
     return decrypted_data;
 }
 
-Data MbedTLSCryptoManager::signature(Data cert) {
+#ifdef CRYPTO_HW_ACCELERATION
+// GCM on Switch: AES-CTR runs on crypto extensions through libnx, GHASH
+// uses 4-bit tables (Shoup), same as mbedTLS software path
+struct GcmHashKey {
+    uint64_t hl[16];
+    uint64_t hh[16];
+};
+
+static const uint64_t gcm_last4[16] = {0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+                                       0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0};
+
+static uint64_t gcm_load64(const unsigned char* bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value = (value << 8) | bytes[i];
+    return value;
+}
+
+static void gcm_store64(unsigned char* bytes, uint64_t value) {
+    for (int i = 7; i >= 0; i--, value >>= 8)
+        bytes[i] = (unsigned char)value;
+}
+
+static void gcm_hash_key(GcmHashKey& key, const unsigned char h[AES_BLOCK_SIZE]) {
+    uint64_t vh = gcm_load64(h);
+    uint64_t vl = gcm_load64(h + 8);
+
+    key.hl[8] = vl;
+    key.hh[8] = vh;
+    key.hl[0] = 0;
+    key.hh[0] = 0;
+
+    for (int i = 4; i > 0; i >>= 1) {
+        uint64_t t = (vl & 1) * 0xe1000000U;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ (t << 32);
+        key.hl[i] = vl;
+        key.hh[i] = vh;
+    }
+
+    for (int i = 2; i <= 8; i *= 2) {
+        for (int j = 1; j < i; j++) {
+            key.hh[i + j] = key.hh[i] ^ key.hh[j];
+            key.hl[i + j] = key.hl[i] ^ key.hl[j];
+        }
+    }
+}
+
+// x = x * H in GF(2^128)
+static void gcm_hash_mult(const GcmHashKey& key, unsigned char x[AES_BLOCK_SIZE]) {
+    uint8_t lo = x[15] & 0xf;
+    uint64_t zh = key.hh[lo];
+    uint64_t zl = key.hl[lo];
+
+    for (int i = 15; i >= 0; i--) {
+        lo = x[i] & 0xf;
+        uint8_t hi = (x[i] >> 4) & 0xf;
+
+        if (i != 15) {
+            uint8_t rem = zl & 0xf;
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ (gcm_last4[rem] << 48);
+            zh ^= key.hh[lo];
+            zl ^= key.hl[lo];
+        }
+
+        uint8_t rem = zl & 0xf;
+        zl = (zh << 60) | (zl >> 4);
+        zh = (zh >> 4) ^ (gcm_last4[rem] << 48);
+        zh ^= key.hh[hi];
+        zl ^= key.hl[hi];
+    }
+
+    gcm_store64(x, zh);
+    gcm_store64(x + 8, zl);
+}
+
+static void gcm_hash_update(const GcmHashKey& key, unsigned char y[AES_BLOCK_SIZE],
+                            const unsigned char* data, size_t size) {
+    while (size > 0) {
+        size_t length = std::min<size_t>(size, AES_BLOCK_SIZE);
+        for (size_t i = 0; i < length; i++)
+            y[i] ^= data[i];
+        gcm_hash_mult(key, y);
+        data += length;
+        size -= length;
+    }
+}
+
+static void gcm_hash_lengths(const GcmHashKey& key, unsigned char y[AES_BLOCK_SIZE],
+                             uint64_t aad_size, uint64_t size) {
+    unsigned char lengths[AES_BLOCK_SIZE];
+    gcm_store64(lengths, aad_size * 8);
+    gcm_store64(lengths + 8, size * 8);
+    gcm_hash_update(key, y, lengths, sizeof(lengths));
+}
+
+// Counter mode of GCM only increments low 32 bits, libnx carries into the
+// whole block, so the run is split where low word wraps
+static void gcm_ctr_crypt(const unsigned char* key, const unsigned char counter[AES_BLOCK_SIZE],
+                          unsigned char* output, const unsigned char* input, size_t size) {
+    unsigned char block[AES_BLOCK_SIZE];
+    memcpy(block, counter, sizeof(block));
+
+    Aes128CtrContext ctr;
+    aes128CtrContextCreate(&ctr, key, block);
+
+    uint32_t low = (uint32_t)gcm_load64(block + 8);
+    uint64_t blocks_to_wrap = (uint64_t)UINT32_MAX - low + 1;
+    size_t first = (size_t)std::min<uint64_t>(size, blocks_to_wrap * AES_BLOCK_SIZE);
+    aes128CtrCrypt(&ctr, output, input, first);
+
+    if (first < size) {
+        memset(block + 12, 0, 4);
+        aes128CtrContextResetCtr(&ctr, block);
+        aes128CtrCrypt(&ctr, output + first, input + first, size - first);
+    }
+}
+
+static void gcm_hw_crypt(bool encrypt, const unsigned char* key, DataView iv, const unsigned char* input,
+                         unsigned char* output, size_t size, unsigned char tag[AES_BLOCK_SIZE]) {
+    Aes128Context aes;
+    aes128ContextCreate(&aes, key, true);
+
+    unsigned char h[AES_BLOCK_SIZE] = {0};
+    aes128EncryptBlock(&aes, h, h);
+
+    GcmHashKey hash_key;
+    gcm_hash_key(hash_key, h);
+
+    // Pre-counter block J0
+    unsigned char j0[AES_BLOCK_SIZE] = {0};
+    if (iv.size() == 12) {
+        memcpy(j0, iv.bytes(), 12);
+        j0[15] = 1;
+    } else {
+        gcm_hash_update(hash_key, j0, iv.bytes(), iv.size());
+        gcm_hash_lengths(hash_key, j0, 0, iv.size());
+    }
+
+    unsigned char counter[AES_BLOCK_SIZE];
+    memcpy(counter, j0, sizeof(counter));
+    for (int i = 15; i >= 12 && ++counter[i] == 0; i--)
+        ;
+
+    unsigned char y[AES_BLOCK_SIZE] = {0};
+    if (!encrypt)
+        gcm_hash_update(hash_key, y, input, size);
+    gcm_ctr_crypt(key, counter, output, input, size);
+    if (encrypt)
+        gcm_hash_update(hash_key, y, output, size);
+    gcm_hash_lengths(hash_key, y, 0, size);
+
+    aes128EncryptBlock(&aes, tag, j0);
+    for (int i = 0; i < AES_BLOCK_SIZE; i++)
+        tag[i] ^= y[i];
+}
+#endif
+
+Data MbedTLSCryptoManager::aes_gcm_encrypt(DataView data, DataView key, DataView iv, Data* tag) {
+    unsigned char* buffer = (unsigned char*)malloc(data.size() + 1);
+    unsigned char tag_bytes[AES_GCM_TAG_SIZE];
+
+#ifdef CRYPTO_HW_ACCELERATION
+    if (m_hw_acceleration) {
+        gcm_hw_crypt(true, key.bytes(), iv, data.bytes(), buffer, data.size(), tag_bytes);
+        *tag = Data(tag_bytes, sizeof(tag_bytes));
+        return Data::adopt(buffer, data.size());
+    }
+#endif
+
+    mbedtls_gcm_context ctx;
+    mbedtls_gcm_init(&ctx);
+    mbedtls_gcm_setkey(&ctx, MBEDTLS_CIPHER_ID_AES, key.bytes(), 128);
+    mbedtls_gcm_crypt_and_tag(&ctx, MBEDTLS_GCM_ENCRYPT, data.size(), iv.bytes(), iv.size(),
+                              nullptr, 0, data.bytes(), buffer, sizeof(tag_bytes), tag_bytes);
+    mbedtls_gcm_free(&ctx);
+
+    *tag = Data(tag_bytes, sizeof(tag_bytes));
+    return Data::adopt(buffer, data.size());
+}
+
+Data MbedTLSCryptoManager::aes_gcm_decrypt(DataView data, DataView key, DataView iv, DataView tag) {
+    if (tag.size() != AES_GCM_TAG_SIZE)
+        return Data();
+
+    unsigned char* buffer = (unsigned char*)malloc(data.size() + 1);
+
+#ifdef CRYPTO_HW_ACCELERATION
+    if (m_hw_acceleration) {
+        unsigned char expected[AES_GCM_TAG_SIZE];
+        gcm_hw_crypt(false, key.bytes(), iv, data.bytes(), buffer, data.size(), expected);
+
+        // Constant time compare, timing must not tell how much of tag matched
+        unsigned char diff = 0;
+        for (int i = 0; i < AES_GCM_TAG_SIZE; i++)
+            diff |= expected[i] ^ tag.bytes()[i];
+        if (diff) {
+            free(buffer);
+            return Data();
+        }
+        return Data::adopt(buffer, data.size());
+    }
+#endif
+
+    mbedtls_gcm_context ctx;
+    mbedtls_gcm_init(&ctx);
+    mbedtls_gcm_setkey(&ctx, MBEDTLS_CIPHER_ID_AES, key.bytes(), 128);
+    int result = mbedtls_gcm_auth_decrypt(&ctx, data.size(), iv.bytes(), iv.size(), nullptr, 0,
+                                          tag.bytes(), tag.size(), data.bytes(), buffer);
+    mbedtls_gcm_free(&ctx);
+
+    if (result != 0) {
+        free(buffer);
+        return Data();
+    }
+    return Data::adopt(buffer, data.size());
+}
+
+Data MbedTLSCryptoManager::signature(const Data& cert) {
+    bool own_cert = cert.bytes() == m_cert.bytes();
+    if (own_cert) {
+        std::lock_guard<std::mutex> lock(m_parsed_mutex);
+        if (!m_cert_signature.is_empty())
+            return m_cert_signature;
+    }
+
     mbedtls_x509_crt x509;
     mbedtls_x509_crt_init(&x509);
-
     mbedtls_x509_crt_parse(&x509, cert.bytes(), cert.size() + 1);
 
     Data data(x509.sig.p, x509.sig.len);
     mbedtls_x509_crt_free(&x509);
+
+    if (own_cert) {
+        std::lock_guard<std::mutex> lock(m_parsed_mutex);
+        m_cert_signature = data;
+    }
     return data;
 }
 
-bool MbedTLSCryptoManager::verify_signature(Data data, Data signature,
-                                            Data cert) {
+bool MbedTLSCryptoManager::verify_signature(DataView data, DataView signature,
+                                            const Data& cert) {
     // TODO
     return true;
 }
 
-Data MbedTLSCryptoManager::sign_data(Data data, Data key) {
-    mbedtls_pk_context pk;
-    mbedtls_entropy_context entropy;
-    mbedtls_ctr_drbg_context ctr_drbg;
+Data MbedTLSCryptoManager::sign_data(DataView data, const Data& key) {
+    std::lock_guard<std::mutex> lock(m_parsed_mutex);
+
+    if (!m_ctr_drbg_ready) {
+        mbedtls_entropy_init(&m_entropy);
+        mbedtls_ctr_drbg_init(&m_ctr_drbg);
+        mbedtls_ctr_drbg_seed(&m_ctr_drbg, mbedtls_entropy_func, &m_entropy, NULL, 0);
+        m_ctr_drbg_ready = true;
+    }
+
+    // Key other than ours is parsed just for this call
+    bool own_key = key.bytes() == m_key.bytes();
+    mbedtls_pk_context temp_key;
+    mbedtls_pk_context* pk = &m_parsed_key;
+    if (!own_key) {
+        mbedtls_pk_init(&temp_key);
+        mbedtls_pk_parse_key(&temp_key, key.bytes(), key.size() + 1, NULL, 0);
+        pk = &temp_key;
+    } else if (!m_parsed_key_ready) {
+        mbedtls_pk_init(&m_parsed_key);
+        mbedtls_pk_parse_key(&m_parsed_key, key.bytes(), key.size() + 1, NULL, 0);
+        m_parsed_key_ready = true;
+    }
 
     unsigned char hash[32];
     unsigned char buf[MBEDTLS_MPI_MAX_SIZE];
     size_t size = 0;
 
-    mbedtls_entropy_init(&entropy);
-    mbedtls_ctr_drbg_init(&ctr_drbg);
-    mbedtls_pk_init(&pk);
-    mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, NULL, 0);
-
-    mbedtls_pk_parse_key(&pk, key.bytes(), key.size() + 1, NULL, 0);
     mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), data.bytes(),
                data.size(), hash);
-    mbedtls_pk_sign(&pk, MBEDTLS_MD_SHA256, hash, 0, buf, &size,
-                    mbedtls_ctr_drbg_random, &ctr_drbg);
+    mbedtls_pk_sign(pk, MBEDTLS_MD_SHA256, hash, 0, buf, &size,
+                    mbedtls_ctr_drbg_random, &m_ctr_drbg);
 
-    mbedtls_pk_free(&pk);
-    mbedtls_ctr_drbg_free(&ctr_drbg);
-    mbedtls_entropy_free(&entropy);
+    if (!own_key)
+        mbedtls_pk_free(&temp_key);
 
     if (size > 0) {
         return Data(buf, size);
     }
-    return data;
+    return Data(data);
 }
 
 // Cert and key generator
@@ -11,10 +11,27 @@
 #include <openssl/pem.h>
 #include <openssl/evp.h>
 #include <openssl/pkcs12.h>
+#include <mutex>
 
 static Data m_cert;
 static Data m_key;
 
+// Parsed once for m_key and m_cert, pairing signs several times.
+// Host certificate is kept too, it's verified more than once
+static std::mutex m_parsed_mutex;
+static EVP_PKEY* m_parsed_key = nullptr;
+static Data m_cert_signature;
+static Data m_verify_cert;
+static EVP_PKEY* m_verify_key = nullptr;
+
+static void _reset_parsed() {
+    std::lock_guard<std::mutex> lock(m_parsed_mutex);
+    if (m_parsed_key)
+        EVP_PKEY_free(m_parsed_key);
+    m_parsed_key = nullptr;
+    m_cert_signature = Data();
+}
+
 static const int NUM_BITS = 2048;
 static const int SERIAL = 0;
 static const int NUM_YEARS = 10;
@@ -27,6 +44,7 @@ bool OpenSSLCryptoManager::load_cert_key_pair() {
         Data key = Data::read_from_file(Settings::instance().key_dir() + "/" + KEY_FILE_NAME);
         
         if (!cert.is_empty() && !key.is_empty()) {
+            _reset_parsed();
             m_cert = cert;
             m_key = key;
             return true;
@@ -37,6 +55,7 @@ bool OpenSSLCryptoManager::load_cert_key_pair() {
 }
 
 bool OpenSSLCryptoManager::generate_new_cert_key_pair() {
+    _reset_parsed();
     if (_generate_new_cert_key_pair()) {
         if (!m_cert.is_empty() && !m_key.is_empty()) {
             m_cert.write_to_file(Settings::instance().key_dir() + "/" + CERTIFICATE_FILE_NAME);
@@ -50,48 +69,50 @@ bool OpenSSLCryptoManager::generate_new_cert_key_pair() {
 void OpenSSLCryptoManager::remove_cert_key_pair() {
     remove((Settings::instance().key_dir() + "/" + CERTIFICATE_FILE_NAME).c_str());
     remove((Settings::instance().key_dir() + "/" + KEY_FILE_NAME).c_str());
+    _reset_parsed();
     m_cert = Data();
     m_key = Data();
 }
 
-Data OpenSSLCryptoManager::cert_data() {
+const Data& OpenSSLCryptoManager::cert_data() {
     return m_cert;
 }
 
-Data OpenSSLCryptoManager::key_data() {
+const Data& OpenSSLCryptoManager::key_data() {
     return m_key;
 }
 
-Data OpenSSLCryptoManager::SHA1_hash_data(Data data) {
+Data OpenSSLCryptoManager::SHA1_hash_data(DataView data) {
     unsigned char sha1[20];
     SHA1(data.bytes(), data.size(), sha1);
     return Data(sha1, sizeof(sha1));
 }
 
-Data OpenSSLCryptoManager::SHA256_hash_data(Data data) {
+Data OpenSSLCryptoManager::SHA256_hash_data(DataView data) {
     unsigned char sha256[32];
     SHA256(data.bytes(), data.size(), sha256);
     return Data(sha256, sizeof(sha256));
 }
 
-Data OpenSSLCryptoManager::create_AES_key_from_salt_SHA1(Data salted_pin) {
+Data OpenSSLCryptoManager::create_AES_key_from_salt_SHA1(DataView salted_pin) {
     return SHA1_hash_data(salted_pin).subdata(0, 16);
 }
 
-Data OpenSSLCryptoManager::create_AES_key_from_salt_SHA256(Data salted_pin) {
+Data OpenSSLCryptoManager::create_AES_key_from_salt_SHA256(DataView salted_pin) {
     return SHA256_hash_data(salted_pin).subdata(0, 16);
 }
 
-static int get_encrypt_size(Data data) {
+static int get_encrypt_size(DataView data) {
     // the size is the length of the data ceiling to the nearest 16 bytes
     return (((int)data.size() + 15) / 16) * 16;
 }
 
-Data OpenSSLCryptoManager::aes_encrypt(Data data, Data key) {
+Data OpenSSLCryptoManager::aes_encrypt(DataView data, DataView key) {
     AES_KEY aes_key;
-    AES_set_encrypt_key((unsigned char*)key.bytes(), 128, &aes_key);
+    AES_set_encrypt_key(key.bytes(), 128, &aes_key);
     int size = get_encrypt_size(data);
-    unsigned char* buffer = (unsigned char*)malloc(size);
+    // One more byte for terminator Data::adopt() puts there
+    unsigned char* buffer = (unsigned char*)malloc(size + 1);
     unsigned char* block_rounded_buffer = (unsigned char*)calloc(1, size);
     memcpy(block_rounded_buffer, data.bytes(), data.size());
     
@@ -102,16 +123,15 @@ Data OpenSSLCryptoManager::aes_encrypt(Data data, Data key) {
         block_offset += 16;
     }
     
-    Data encrypted_data = Data((char*)buffer, size);
-    free(buffer);
+    Data encrypted_data = Data::adopt(buffer, size);
     free(block_rounded_buffer);
     return encrypted_data;
 }
 
-Data OpenSSLCryptoManager::aes_decrypt(Data data, Data key) {
+Data OpenSSLCryptoManager::aes_decrypt(DataView data, DataView key) {
     AES_KEY aes_key;
     AES_set_decrypt_key(key.bytes(), 128, &aes_key);
-    unsigned char* buffer = (unsigned char*)malloc(data.size());
+    unsigned char* buffer = (unsigned char*)malloc(data.size() + 1);
     
     // AES_decrypt only decrypts the first 16 bytes so iterate the entire buffer
     int block_offset = 0;
@@ -120,14 +140,85 @@ Data OpenSSLCryptoManager::aes_decrypt(Data data, Data key) {
         block_offset += 16;
     }
     
-    Data decrypted_data = Data(buffer, data.size());
-    free(buffer);
+    Data decrypted_data = Data::adopt(buffer, data.size());
     return decrypted_data;
 }
 
-Data OpenSSLCryptoManager::signature(Data cert) {
+// EVP dispatches to AES-NI / ARMv8 AES and carry-less multiply for GHASH
+static EVP_CIPHER_CTX* gcm_context(bool encrypt, DataView key, DataView iv) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (!ctx)
+        return nullptr;
+
+    if (EVP_CipherInit_ex(ctx, EVP_aes_128_gcm(), nullptr, nullptr, nullptr, encrypt) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, (int)iv.size(), nullptr) != 1 ||
+        EVP_CipherInit_ex(ctx, nullptr, nullptr, key.bytes(), iv.bytes(), encrypt) != 1) {
+        EVP_CIPHER_CTX_free(ctx);
+        return nullptr;
+    }
+    return ctx;
+}
+
+Data OpenSSLCryptoManager::aes_gcm_encrypt(DataView data, DataView key, DataView iv, Data* tag) {
+    EVP_CIPHER_CTX* ctx = gcm_context(true, key, iv);
+    if (!ctx)
+        return Data();
+
+    // GCM is a stream mode, output is never longer than input
+    unsigned char* buffer = (unsigned char*)malloc(data.size() + 1);
+    unsigned char tag_bytes[AES_GCM_TAG_SIZE];
+    int length = 0;
+    int final_length = 0;
+
+    if (EVP_EncryptUpdate(ctx, buffer, &length, data.bytes(), (int)data.size()) != 1 ||
+        EVP_EncryptFinal_ex(ctx, buffer + length, &final_length) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, sizeof(tag_bytes), tag_bytes) != 1) {
+        EVP_CIPHER_CTX_free(ctx);
+        free(buffer);
+        return Data();
+    }
+
+    EVP_CIPHER_CTX_free(ctx);
+    *tag = Data(tag_bytes, sizeof(tag_bytes));
+    return Data::adopt(buffer, length + final_length);
+}
+
+Data OpenSSLCryptoManager::aes_gcm_decrypt(DataView data, DataView key, DataView iv, DataView tag) {
+    if (tag.size() != AES_GCM_TAG_SIZE)
+        return Data();
+
+    EVP_CIPHER_CTX* ctx = gcm_context(false, key, iv);
+    if (!ctx)
+        return Data();
+
+    unsigned char* buffer = (unsigned char*)malloc(data.size() + 1);
+    int length = 0;
+    int final_length = 0;
+
+    // Final fails when tag doesn't match
+    if (EVP_DecryptUpdate(ctx, buffer, &length, data.bytes(), (int)data.size()) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, (int)tag.size(), (void*)tag.bytes()) != 1 ||
+        EVP_DecryptFinal_ex(ctx, buffer + length, &final_length) != 1) {
+        EVP_CIPHER_CTX_free(ctx);
+        free(buffer);
+        return Data();
+    }
+
+    EVP_CIPHER_CTX_free(ctx);
+    return Data::adopt(buffer, length + final_length);
+}
+
+Data OpenSSLCryptoManager::signature(const Data& cert) {
+    bool own_cert = cert.bytes() == m_cert.bytes();
+    if (own_cert) {
+        std::lock_guard<std::mutex> lock(m_parsed_mutex);
+        if (!m_cert_signature.is_empty())
+            return m_cert_signature;
+    }
+
     BIO* bio = BIO_new_mem_buf(cert.bytes(), cert.size());
     X509* x509 = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+    BIO_free(bio);
     
     if (!x509) {
 //        Logger::error("Crypto", "Unable to parse certificate in memory!");
@@ -146,42 +237,66 @@ Data OpenSSLCryptoManager::signature(Data cert) {
     
     Data sig = Data(asn_signature->data, asn_signature->length);
     X509_free(x509);
+
+    if (own_cert) {
+        std::lock_guard<std::mutex> lock(m_parsed_mutex);
+        m_cert_signature = sig;
+    }
     return sig;
 }
 
-bool OpenSSLCryptoManager::verify_signature(Data data, Data signature, Data cert) {
-    BIO* bio = BIO_new_mem_buf(cert.bytes(), cert.size());
-    X509* x509 = PEM_read_bio_X509(bio, NULL, NULL, NULL);
-    
-    BIO_free(bio);
-    
-    if (!x509) {
-//        Logger::error("Crypto", "Unable to parse certificate in memory...");
-        return false;
+bool OpenSSLCryptoManager::verify_signature(DataView data, DataView signature, const Data& cert) {
+    std::lock_guard<std::mutex> lock(m_parsed_mutex);
+
+    bool same_cert = m_verify_key && m_verify_cert.size() == cert.size() &&
+                     memcmp(m_verify_cert.bytes(), cert.bytes(), cert.size()) == 0;
+    if (!same_cert) {
+        BIO* bio = BIO_new_mem_buf(cert.bytes(), cert.size());
+        X509* x509 = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+        
+        BIO_free(bio);
+        
+        if (!x509) {
+//            Logger::error("Crypto", "Unable to parse certificate in memory...");
+            return false;
+        }
+
+        if (m_verify_key)
+            EVP_PKEY_free(m_verify_key);
+        m_verify_key = X509_get_pubkey(x509);
+        m_verify_cert = cert;
+        X509_free(x509);
     }
     
-    EVP_PKEY* pub_key = X509_get_pubkey(x509);
     EVP_MD_CTX *mdctx = NULL;
     mdctx = EVP_MD_CTX_create();
-    EVP_DigestVerifyInit(mdctx, NULL, EVP_sha256(), NULL, pub_key);
+    EVP_DigestVerifyInit(mdctx, NULL, EVP_sha256(), NULL, m_verify_key);
     EVP_DigestVerifyUpdate(mdctx, data.bytes(), data.size());
-    int result = EVP_DigestVerifyFinal(mdctx, signature.bytes(), signature.size());
+    int result = EVP_DigestVerifyFinal(mdctx, (unsigned char*)signature.bytes(), signature.size());
     
-    X509_free(x509);
-    EVP_PKEY_free(pub_key);
     EVP_MD_CTX_destroy(mdctx);
     return result > 0;
 }
 
-Data OpenSSLCryptoManager::sign_data(Data data, Data key) {
-    BIO* bio = BIO_new_mem_buf(key.bytes(), key.size());
-    EVP_PKEY* pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
-    
-    BIO_free(bio);
-    
+Data OpenSSLCryptoManager::sign_data(DataView data, const Data& key) {
+    std::lock_guard<std::mutex> lock(m_parsed_mutex);
+
+    // Key other than ours is parsed just for this call
+    bool own_key = key.bytes() == m_key.bytes();
+    EVP_PKEY* pkey = own_key ? m_parsed_key : nullptr;
     if (!pkey) {
-//        Logger::error("Crypto", "Unable to parse private key in memory...");
-        return Data();
+        BIO* bio = BIO_new_mem_buf(key.bytes(), key.size());
+        pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
+        
+        BIO_free(bio);
+        
+        if (!pkey) {
+//            Logger::error("Crypto", "Unable to parse private key in memory...");
+            return Data();
+        }
+
+        if (own_key)
+            m_parsed_key = pkey;
     }
     
     EVP_MD_CTX *mdctx = EVP_MD_CTX_create();
@@ -192,13 +307,14 @@ Data OpenSSLCryptoManager::sign_data(Data data, Data key) {
     unsigned char* signature = (unsigned char*)malloc(slen);
     int result = EVP_DigestSignFinal(mdctx, signature, &slen);
     
-    EVP_PKEY_free(pkey);
+    if (!own_key)
+        EVP_PKEY_free(pkey);
     EVP_MD_CTX_destroy(mdctx);
     
     if (result <= 0) {
         free(signature);
 //        Logger::error("Crypto", "Unable to sign data...");
-        Data();
+        return Data();
     }
     
     Data signed_data = Data(signature, slen);
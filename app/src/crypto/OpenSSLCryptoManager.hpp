@@ -6,23 +6,35 @@
 #define CERTIFICATE_FILE_NAME "client.pem"
 #define KEY_FILE_NAME "key.pem"
 
+// Stream packets are authenticated with full length tag
+#define AES_GCM_TAG_SIZE 16
+
 class OpenSSLCryptoManager {
 public:
     static bool load_cert_key_pair();
     static bool generate_new_cert_key_pair();
     static void remove_cert_key_pair();
     
-    static Data cert_data();
-    static Data key_data();
+    static const Data& cert_data();
+    static const Data& key_data();
+
+    // OpenSSL picks CPU crypto extensions itself
+    static void set_hw_acceleration(bool enabled) {}
+    static bool hw_acceleration() { return false; }
+    
+    static Data SHA1_hash_data(DataView data);
+    static Data SHA256_hash_data(DataView data);
+    static Data create_AES_key_from_salt_SHA1(DataView salted_pin);
+    static Data create_AES_key_from_salt_SHA256(DataView salted_pin);
+    static Data aes_encrypt(DataView data, DataView key);
+    static Data aes_decrypt(DataView data, DataView key);
     
-    static Data SHA1_hash_data(Data data);
-    static Data SHA256_hash_data(Data data);
-    static Data create_AES_key_from_salt_SHA1(Data salted_pin);
-    static Data create_AES_key_from_salt_SHA256(Data salted_pin);
-    static Data aes_encrypt(Data data, Data key);
-    static Data aes_decrypt(Data data, Data key);
+    // AES-128-GCM without additional data, as used for stream packets.
+    // Decrypt returns empty Data when tag doesn't match
+    static Data aes_gcm_encrypt(DataView data, DataView key, DataView iv, Data* tag);
+    static Data aes_gcm_decrypt(DataView data, DataView key, DataView iv, DataView tag);
     
-    static Data signature(Data cert);
-    static bool verify_signature(Data data, Data signature, Data cert);
-    static Data sign_data(Data data, Data key);
+    static Data signature(const Data& cert);
+    static bool verify_signature(DataView data, DataView signature, const Data& cert);
+    static Data sign_data(DataView data, const Data& key);
 };
@@ -48,6 +48,8 @@ void FavoriteTab::updateAppList() {
         for (const App& app : host.favorites) {
             AppInfo info{app.name, app.app_id};
             auto* cell = new AppCell(host, info, 0);
+            // Favorite has app id, app list isn't needed to start it
+            cell->setFastLaunch(true);
             gridView->addView(cell);
 
             cell->registerAction(
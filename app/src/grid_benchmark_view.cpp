@@ -0,0 +1,276 @@
+//
+//  grid_benchmark_view.cpp
+//  Moonlight
+//
+
+#include "grid_benchmark_view.hpp"
+#include "AllocCounter.hpp"
+#include "BoxArtManager.hpp"
+#include "HighResClock.hpp"
+#include "ViewTemplates.hpp"
+#include "app_cell.hpp"
+#include <algorithm>
+#include <cstdio>
+
+using namespace brls;
+
+static const char* phase_names[] = {"warmup", "rows", "pages", "jumps", "done"};
+
+static float percentile(const std::vector<float>& sorted, float p) {
+    if (sorted.empty())
+        return 0;
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * (float)sorted.size()))];
+}
+
+// Cover of its own per app, hue from id and a stripe, so textures differ
+static void generate_boxart(int app_id, int width, int height, unsigned char* pixels) {
+    uint32_t hash = (uint32_t)app_id * 2654435761u;
+    int red = hash & 0xFF, green = (hash >> 8) & 0xFF, blue = (hash >> 16) & 0xFF;
+    int stripe = (int)((hash >> 24) % (uint32_t)height);
+
+    for (int y = 0; y < height; y++) {
+        int shade = 128 + y * 127 / height;
+        bool band = y >= stripe && y < stripe + height / 10;
+        for (int x = 0; x < width; x++) {
+            *pixels++ = band ? 255 : (unsigned char)(red * shade / 255);
+            *pixels++ = band ? 255 : (unsigned char)(green * shade / 255);
+            *pixels++ = band ? 255 : (unsigned char)(((blue + x) & 0xFF) * shade / 255);
+            *pixels++ = 255;
+        }
+    }
+}
+
+GridBenchmarkView::GridBenchmarkView() {
+    this->inflateFromXMLRes("xml/views/app_list_view.xml");
+    Application::getPlatform()->disableScreenDimming(true);
+
+    // Host which is never contacted, box art of its apps is generated
+    host = {"grid-benchmark", "Grid benchmark", "gridbenchmark", {}};
+    BoxArtManager::instance().set_generator(BoxArtManager::host_id(host), generate_boxart);
+
+    startInflations = ViewTemplates::instance().inflations();
+    startParses = ViewTemplates::instance().parses();
+
+    int count = Settings::instance().grid_benchmark_apps();
+    apps.reserve(count);
+    for (int i = 0; i < count; i++)
+        apps.push_back({"Application " + std::to_string(i), 100000 + i});
+
+    int rows = (count + GRID_BENCH_COLUMNS - 1) / GRID_BENCH_COLUMNS;
+    uint32_t steps = rows + rows / GRID_BENCH_PAGE_ROWS + 1 + GRID_BENCH_JUMP_COUNT;
+    // Records of the run itself don't show up as allocations
+    frames.reserve(GRID_BENCH_WARMUP_FRAMES + (steps + 2) * GRID_BENCH_STEP_FRAMES * 2);
+
+    registerAction("hints/back"_i18n, ControllerButton::BUTTON_B, [](View* view) {
+        Application::popActivity();
+        return true;
+    });
+
+    container->setHideHighlight(true);
+    gridView = new GridView(GRID_BENCH_COLUMNS);
+    container->addView(gridView);
+    gridView->setItems(
+        count, [] { return new AppCell(); },
+        [this](View* view, int index) {
+            auto* cell = (AppCell*)view;
+            cell->bind(host, apps[index], 0);
+            // Nothing to launch on synthetic host
+            cell->registerClickAction([](View* view) { return true; });
+            binds++;
+        });
+
+    brls::Logger::info("GridBenchmarkView: {} apps in {} rows, alloc counter {}", count, rows,
+                       AllocCounter::enabled() ? "on" : "off");
+}
+
+GridBenchmarkView::~GridBenchmarkView() {
+    Application::getPlatform()->disableScreenDimming(false);
+    BoxArtManager::instance().clear_generator(BoxArtManager::host_id(host));
+}
+
+void GridBenchmarkView::draw(NVGcontext* vg, float x, float y, float width,
+                             float height, Style style, FrameContext* ctx) {
+    if (phase != GRID_BENCH_DONE) {
+        record(HighResClock::now_us());
+        step();
+    }
+
+    uint64_t start = HighResClock::now_us();
+    Box::draw(vg, x, y, width, height, style, ctx);
+    lastDrawMs = (float)(HighResClock::now_us() - start) / 1000.0f;
+
+    // Formatted without heap while script runs, not to count own allocations
+    char progress[96];
+    const char* text = progress;
+    if (phase == GRID_BENCH_DONE)
+        text = results.c_str();
+    else
+        snprintf(progress, sizeof(progress), "Scroll benchmark: %s, %d of %d", phase_names[phase],
+                 focusIndex + 1, (int)apps.size());
+
+    nvgFontSize(vg, 20);
+    nvgTextAlign(vg, NVG_ALIGN_LEFT | NVG_ALIGN_TOP);
+    nvgFontFaceId(vg, Application::getFont(FONT_REGULAR));
+    nvgFontBlur(vg, 3);
+    nvgFillColor(vg, nvgRGBA(0, 0, 0, 255));
+    nvgTextBox(vg, x + 20, y + 20, width, text, nullptr);
+    nvgFontBlur(vg, 0);
+    nvgFillColor(vg, nvgRGBA(255, 255, 255, 255));
+    nvgTextBox(vg, x + 20, y + 20, width, text, nullptr);
+}
+
+void GridBenchmarkView::record(uint64_t now) {
+    auto& boxart = BoxArtManager::instance();
+    uint64_t uploads = boxart.uploads();
+    uint64_t evictions = boxart.evictions();
+    uint64_t allocations = AllocCounter::count();
+
+    // Everything since previous frame started goes to it
+    if (lastFrameUs && frames.size() < frames.capacity()) {
+        frames.push_back({phase,
+                          (float)(now - lastFrameUs) / 1000.0f,
+                          lastDrawMs,
+                          (uint32_t)(uploads - lastUploads),
+                          (uint32_t)(evictions - lastEvictions),
+                          (uint32_t)(allocations - lastAllocations),
+                          binds,
+                          (uint32_t)(boxart.texture_bytes() / 1024)});
+    }
+
+    lastFrameUs = now;
+    lastUploads = uploads;
+    lastEvictions = evictions;
+    lastAllocations = allocations;
+    binds = 0;
+}
+
+void GridBenchmarkView::step() {
+    int count = (int)apps.size();
+    phaseFrames++;
+
+    if (phase == GRID_BENCH_WARMUP) {
+        // View is in activity by now, so focus is taken
+        if (phaseFrames == 1)
+            gridView->focusItem(0);
+        if (phaseFrames >= GRID_BENCH_WARMUP_FRAMES) {
+            phase = GRID_BENCH_ROWS;
+            phaseFrames = 0;
+        }
+        return;
+    }
+
+    if (phaseFrames % GRID_BENCH_STEP_FRAMES != 0)
+        return;
+
+    switch (phase) {
+        case GRID_BENCH_ROWS:
+            if (focusIndex + GRID_BENCH_COLUMNS < count) {
+                focusIndex += GRID_BENCH_COLUMNS;
+            } else {
+                phase = GRID_BENCH_PAGES;
+                phaseFrames = 0;
+            }
+            break;
+        case GRID_BENCH_PAGES:
+            if (focusIndex > 0) {
+                focusIndex = std::max(0, focusIndex - GRID_BENCH_PAGE_ROWS * GRID_BENCH_COLUMNS);
+            } else {
+                phase = GRID_BENCH_JUMPS;
+                phaseFrames = 0;
+            }
+            break;
+        case GRID_BENCH_JUMPS:
+            if (jumps < GRID_BENCH_JUMP_COUNT) {
+                // Same sequence every run, so runs are comparable
+                jumpSeed = jumpSeed * 1103515245u + 12345u;
+                focusIndex = (int)((jumpSeed >> 8) % (uint32_t)count);
+                jumps++;
+            } else {
+                finish();
+                return;
+            }
+            break;
+        default:
+            return;
+    }
+
+    gridView->focusItem(focusIndex);
+}
+
+void GridBenchmarkView::finish() {
+    phase = GRID_BENCH_DONE;
+    save();
+
+    auto result = summary();
+    results = fmt::format("Scroll benchmark: {} apps, {} frames\n"
+                          "Frame time p50 | p95 | p99 | max: {:.2f} | {:.2f} | {:.2f} | {:.2f} ms\n"
+                          "Hitches over {}x median: {}\n"
+                          "Texture uploads per frame avg | max: {:.2f} | {}, evicted: {}\n"
+                          "Allocations per frame avg | max: {}\n"
+                          "Cells bound: {}, inflated: {}, XML parses: {}\n"
+                          "Done, frames saved to grid_benchmark.csv",
+                          apps.size(), result.frames,
+                          result.p50_ms, result.p95_ms, result.p99_ms, result.max_ms,
+                          GRID_BENCH_HITCH_FACTOR, result.hitches,
+                          result.uploads_per_frame, result.max_uploads, result.evictions,
+                          AllocCounter::enabled()
+                              ? fmt::format("{:.1f} | {}", result.allocations_per_frame, result.max_allocations)
+                              : std::string("not counted, build with USE_ALLOC_COUNTER"),
+                          result.binds, ViewTemplates::instance().inflations() - startInflations,
+                          ViewTemplates::instance().parses() - startParses);
+    brls::Logger::info("GridBenchmarkView: {} apps, p50 {:.2f} ms, p99 {:.2f} ms, {} hitches, {:.2f} uploads, "
+                       "{:.1f} allocations per frame",
+                       apps.size(), result.p50_ms, result.p99_ms, result.hitches,
+                       result.uploads_per_frame, result.allocations_per_frame);
+}
+
+GridBenchSummary GridBenchmarkView::summary() const {
+    GridBenchSummary summary = {};
+    std::vector<float> times;
+    uint64_t uploads = 0, allocations = 0;
+
+    // Warm-up is inflation and first screen, not scrolling
+    for (auto& frame : frames) {
+        if (frame.phase == GRID_BENCH_WARMUP)
+            continue;
+        times.push_back(frame.frame_ms);
+        uploads += frame.uploads;
+        allocations += frame.allocations;
+        summary.max_uploads = std::max(summary.max_uploads, frame.uploads);
+        summary.max_allocations = std::max(summary.max_allocations, frame.allocations);
+        summary.evictions += frame.evictions;
+        summary.binds += frame.binds;
+    }
+
+    summary.frames = (uint32_t)times.size();
+    if (times.empty())
+        return summary;
+
+    summary.uploads_per_frame = (float)uploads / (float)times.size();
+    summary.allocations_per_frame = (float)allocations / (float)times.size();
+
+    std::sort(times.begin(), times.end());
+    summary.p50_ms = percentile(times, 0.5f);
+    summary.p95_ms = percentile(times, 0.95f);
+    summary.p99_ms = percentile(times, 0.99f);
+    summary.max_ms = times.back();
+    summary.hitches = (uint32_t)(times.end() - std::upper_bound(times.begin(), times.end(),
+                                                                summary.p50_ms * GRID_BENCH_HITCH_FACTOR));
+    return summary;
+}
+
+void GridBenchmarkView::save() const {
+    std::string path = Settings::instance().grid_benchmark_path();
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        brls::Logger::error("GridBenchmarkView: Failed to open {}", path);
+        return;
+    }
+
+    fprintf(file, "phase,frame_ms,draw_ms,uploads,evictions,allocations,binds,texture_kb\n");
+    for (auto& frame : frames)
+        fprintf(file, "%s,%.3f,%.3f,%u,%u,%u,%u,%u\n", phase_names[frame.phase], frame.frame_ms,
+                frame.draw_ms, frame.uploads, frame.evictions, frame.allocations, frame.binds,
+                frame.texture_kb);
+    fclose(file);
+}
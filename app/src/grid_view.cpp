@@ -6,6 +6,7 @@
 //
 
 #include "grid_view.hpp"
+#include <algorithm>
 
 GridView::GridView() : Box(Axis::COLUMN), columls(7) {}
 
@@ -14,7 +15,7 @@ GridView::GridView(int columns) : Box(Axis::COLUMN), columls(columns) {}
 void GridView::addView(View* view) {
     if (getChildren().size() % columls == 0) {
         if (lastContainer)
-            lastContainer->setPaddingBottom(12);
+            lastContainer->setPaddingBottom(GRID_ROW_SPACING);
 
         lastContainer = new Box(Axis::ROW);
         Box::addView(lastContainer);
@@ -22,17 +23,164 @@ void GridView::addView(View* view) {
         lastView->setMarginRight(12);
     }
     lastContainer->addView(view);
+    indices[view] = (int)children.size();
     children.push_back(view);
     lastView = view;
 }
 
 void GridView::clearViews(bool free) {
+    // Cells waiting for reuse have no parent, so Box doesn't know about them
+    if (free) {
+        for (View* view : pool)
+            delete view;
+    }
+    pool.clear();
+    rows.clear();
+    createCell = nullptr;
+    bindCell = nullptr;
+
     Box::clearViews(free);
     children.clear();
+    indices.clear();
     lastContainer = nullptr;
     lastView = nullptr;
 }
 
+void GridView::setItems(int count, const std::function<View*()>& create,
+                        const std::function<void(View*, int)>& bind) {
+    clearViews();
+    createCell = create;
+    bindCell = bind;
+    children.resize(count, nullptr);
+
+    // Empty rows keep full height, so scrolling range is right from start
+    while ((int)rows.size() * columls < count)
+        addRow();
+
+    // First screen exists right away, so it can take focus
+    updateVisibleRows(0, Application::contentHeight);
+}
+
+void GridView::addRow() {
+    if (!rows.empty())
+        rows.back()->setPaddingBottom(GRID_ROW_SPACING);
+
+    Box* box = new Box(Axis::ROW);
+    box->setHeight(GRID_ROW_HEIGHT);
+    Box::addView(box);
+    rows.push_back(box);
+}
+
+void GridView::updateItems(int count, const std::function<bool(int)>& changed) {
+    int oldCount = (int)children.size();
+
+    // Rows getting other number of cells are filled again from scratch
+    for (int row = 0; row < (int)rows.size(); row++) {
+        int oldItems = std::clamp(oldCount - row * columls, 0, columls);
+        int newItems = std::clamp(count - row * columls, 0, columls);
+        if (oldItems != newItems)
+            hideRow(row, true);
+    }
+
+    children.resize(count, nullptr);
+
+    while ((int)rows.size() * columls < count)
+        addRow();
+    while (!rows.empty() && ((int)rows.size() - 1) * columls >= count) {
+        Box::removeView(rows.back());
+        rows.pop_back();
+    }
+    if (!rows.empty())
+        rows.back()->setPaddingBottom(0);
+
+    for (int index = 0; index < count; index++) {
+        if (children[index] && changed(index))
+            bindCell(children[index], index);
+    }
+
+    updateVisibleRows(0, Application::contentHeight);
+}
+
+void GridView::focusItem(int index) {
+    if (index < 0 || index >= (int)children.size() || rows.empty())
+        return;
+
+    showRow(index / columls);
+    Application::giveFocus(children[index]);
+}
+
+void GridView::showRow(int row) {
+    Box* box = rows[row];
+    if (!box->getChildren().empty())
+        return;
+
+    int first = row * columls;
+    int last = std::min(first + columls, (int)children.size());
+    for (int index = first; index < last; index++) {
+        View* view;
+        if (pool.empty()) {
+            view = createCell();
+        } else {
+            view = pool.back();
+            pool.pop_back();
+        }
+
+        bindCell(view, index);
+        view->setMarginRight(index + 1 < last ? 12 : 0);
+        box->addView(view);
+        children[index] = view;
+        indices[view] = index;
+    }
+}
+
+void GridView::hideRow(int row, bool force) {
+    Box* box = rows[row];
+    if (box->getChildren().empty())
+        return;
+
+    // Focused cell stays, even if it was somehow scrolled away
+    View* focus = Application::getCurrentFocus();
+    for (View* view : box->getChildren()) {
+        if (view == focus && !force)
+            return;
+    }
+
+    int first = row * columls;
+    int last = std::min(first + columls, (int)children.size());
+    for (int index = first; index < last; index++) {
+        View* view = children[index];
+        box->removeView(view, false);
+        indices.erase(view);
+        children[index] = nullptr;
+        pool.push_back(view);
+    }
+}
+
+void GridView::updateVisibleRows(float top, float bottom) {
+    if (rows.empty())
+        return;
+
+    float rowsTop = getY();
+    int first = (int)((top - rowsTop) / GRID_ROW_HEIGHT) - GRID_PREFETCH_ROWS;
+    int last = (int)((bottom - rowsTop) / GRID_ROW_HEIGHT) + GRID_PREFETCH_ROWS;
+
+    // Rows going away give their cells to rows coming in
+    for (int row = 0; row < (int)rows.size(); row++) {
+        if (row < first || row > last)
+            hideRow(row);
+    }
+    for (int row = std::max(first, 0); row <= last && row < (int)rows.size(); row++)
+        showRow(row);
+}
+
+void GridView::draw(NVGcontext* vg, float x, float y, float width, float height,
+                    Style style, FrameContext* ctx) {
+    if (bindCell)
+        updateVisibleRows(0, Application::contentHeight);
+
+    Box::draw(vg, x, y, width, height, style, ctx);
+}
+
 View* GridView::getParentNavigationDecision(View* from, View* newFocus,
                                             FocusDirection direction) {
     if (newFocus && (direction == FocusDirection::UP ||
@@ -76,10 +224,9 @@ View* GridView::getParentNavigationDecision(View* from, View* newFocus,
 }
 
 int GridView::getItemIndex(View* view) {
-    for (int i = 0; i < children.size(); i++) {
-        if (children[i] == view)
-            return i;
-    }
+    auto index = indices.find(view);
+    if (index != indices.end())
+        return index->second;
 
     return -1;
 }
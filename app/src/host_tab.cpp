@@ -20,6 +20,23 @@ HostTab::HostTab(const Host& host) : host(host) {
     remove->setText("common/remove"_i18n);
     remove->title->setTextColor(RGB(229, 57, 53));
 
+    // Host could be refreshed along with others, before tab is opened
+    statusSubscription = GameStreamClient::instance().host_status_event()->subscribe(
+        [this](std::string address, GSResult<SERVER_DATA> result) {
+            if (address == this->host.address)
+                updateState(result);
+        });
+
+    latencySubscription = HostPinger::instance().latency_event()->subscribe(
+        [this](std::string address, HostLatency latency) {
+            if (address != this->host.address)
+                return;
+            updateLatency(latency);
+            // Woke up on its own, no need to wait for next refresh
+            if (latency.reachable && state == UNAVAILABLE)
+                reloadHost();
+        });
+
     reloadHost();
 
     registerAction("Rename"_i18n, ControllerButton::BUTTON_START,
@@ -51,7 +68,7 @@ HostTab::HostTab(const Host& host) : host(host) {
                     this->host, [this, loader](const GSResult<bool>& result) {
                         loader->close([this, result] {
                             if (result.isSuccess()) {
-                                reloadHost();
+                                reloadHost(true);
                             } else {
                                 showError("host/wake_up_error"_i18n);
                             }
@@ -78,26 +95,52 @@ HostTab::HostTab(const Host& host) : host(host) {
     });
 }
 
-void HostTab::reloadHost() {
+HostTab::~HostTab() {
+    GameStreamClient::instance().host_status_event()->unsubscribe(statusSubscription);
+    HostPinger::instance().latency_event()->unsubscribe(latencySubscription);
+}
+
+void HostTab::updateLatency(const HostLatency& latency) {
+    if (latency.reachable && latency.samples > 0)
+        header->setSubtitle(fmt::format("{} · {:.0f} ms ± {:.1f} ms", host.address,
+                                        latency.rtt_ms, latency.jitter_ms));
+    else
+        header->setSubtitle(host.address);
+}
+
+void HostTab::updateState(const GSResult<SERVER_DATA>& result) {
+    if (result.isSuccess()) {
+        header->setTitle("host/status"_i18n + ": " + "host/ready"_i18n);
+        connect->setText("host/connect"_i18n);
+        state = AVAILABLE;
+    } else {
+        header->setTitle("host/status"_i18n + ": " +
+                         "host/unable"_i18n);
+        connect->setText("host/wake_up"_i18n);
+        state = UNAVAILABLE;
+    }
+}
+
+void HostTab::reloadHost(bool openApps) {
     state = FETCHING;
     header->setTitle("host/status"_i18n + ": " + "host/fetching"_i18n);
-    header->setSubtitle(host.address);
+    updateLatency(HostPinger::instance().latency(host.address));
     connect->setText("host/wait"_i18n);
 
     ASYNC_RETAIN
     GameStreamClient::instance().connect(
-        host.address, [ASYNC_TOKEN](const GSResult<SERVER_DATA>& result) {
+        host.address, [ASYNC_TOKEN, openApps](const GSResult<SERVER_DATA>& result) {
             ASYNC_RELEASE
 
-            if (result.isSuccess()) {
-                header->setTitle("host/status"_i18n + ": " + "host/ready"_i18n);
-                connect->setText("host/connect"_i18n);
-                state = AVAILABLE;
-            } else {
-                header->setTitle("host/status"_i18n + ": " +
-                                 "host/unable"_i18n);
-                connect->setText("host/wake_up"_i18n);
-                state = UNAVAILABLE;
-            }
-        });
+            updateState(result);
+            if (!result.isSuccess())
+                return;
+
+            // Warm up app list, so opening it doesn't wait for host
+            if (result.value().paired)
+                GameStreamClient::instance().applist(host.address, [](auto result) {}, true);
+
+            if (openApps)
+                this->present(new AppListView(this->host));
+        }, !openApps);
 }
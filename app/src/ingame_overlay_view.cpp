@@ -9,11 +9,17 @@
 #include <borealis/platforms/switch/switch_input.hpp>
 #endif
 
+#include "AVFrameHolder.hpp"
+#include "FrameCapture.hpp"
+#include "LatencyProbe.hpp"
+#include "PipelineTrace.hpp"
+#include "StreamRecorder.hpp"
 #include "helper.hpp"
 #include "ingame_overlay_view.hpp"
 #include "streaming_input_overlay.hpp"
 #include "button_selecting_dialog.hpp"
 
+#include <ctime>
 #include <iomanip>
 #include <sstream>
 
@@ -35,6 +41,17 @@ using namespace brls;
 
 bool debug = false;
 
+// <dir>/<app>_<date>-<time>.<extension>, app name can have any characters
+static std::string capture_path(const std::string& dir, std::string app, const char* extension) {
+    for (char& c : app)
+        if (!isalnum((unsigned char)c))
+            c = '_';
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y%m%d-%H%M%S", localtime(&now));
+    return dir + "/" + app + "_" + date + "." + extension;
+}
+
 // MARK: - Ingame Overlay View
 IngameOverlay::IngameOverlay(StreamingView* streamView)
     : streamView(streamView) {
@@ -57,6 +74,15 @@ IngameOverlay::IngameOverlay(StreamingView* streamView)
     getAppletFrameItem()->title =
         streamView->getHost().hostname + ": " + streamView->getApp().name;
     updateAppletFrameItem();
+
+    // Menu navigation doesn't compete with video decoding and upload
+    if (Settings::instance().overlay_freeze_video() && streamView->getSession())
+        streamView->getSession()->frames().setFrozen(true);
+}
+
+IngameOverlay::~IngameOverlay() {
+    if (streamView->getSession())
+        streamView->getSession()->frames().setFrozen(false);
 }
 
 brls::AppletFrame* IngameOverlay::getAppletFrame() { return applet; }
@@ -137,6 +163,13 @@ OptionsTab::OptionsTab(StreamingView* streamView) : streamView(streamView) {
         });
     volumeSlider->setProgress(progress);
 
+    MoonlightSession* session = streamView->getSession();
+    audioOnlyButton->init("streaming/audio_only"_i18n, session && session->is_audio_only(),
+                          [streamView](bool value) {
+                              if (streamView->getSession())
+                                  streamView->getSession()->set_audio_only(value);
+                          });
+
     float rumbleForceProgress = Settings::instance().get_rumble_force();
     rumbleForceSlider->getProgressEvent()->subscribe([this](float value) {
         std::stringstream stream;
@@ -220,9 +253,70 @@ OptionsTab::OptionsTab(StreamingView* streamView) : streamView(streamView) {
                                 brls::Application::enableDebuggingView(value);
                             });
 
+    screenshotButton->setText("streaming/screenshot"_i18n);
+    screenshotButton->registerClickAction([this](View* view) {
+        FrameCapture::instance().request(
+            capture_path(Settings::instance().screenshots_dir(), streamView->getApp().name, "png"));
+        this->dismiss();
+        return true;
+    });
+
+    recordButton->init(
+        "streaming/record_stream"_i18n, StreamRecorder::instance().active(),
+        [this, streamView](bool value) {
+            if (!value) {
+                StreamRecorder::instance().stop();
+                return;
+            }
+
+            std::string path = capture_path(Settings::instance().recordings_dir(), streamView->getApp().name, "mkv");
+            if (!StreamRecorder::instance().start(path)) {
+                recordButton->setOn(false, false);
+                showError("streaming/record_stream_error"_i18n, [] {});
+            }
+        });
+
     debugButton->init(
         "streaming/debug_info"_i18n, streamView->draw_stats,
         [streamView](bool value) { streamView->draw_stats = value; });
+
+    // Graph is part of debug info, so it's turned on together
+    frameGraphButton->init(
+        "streaming/frame_graph"_i18n, streamView->draw_frame_graph,
+        [this, streamView](bool value) {
+            streamView->draw_frame_graph = value;
+            if (value && !streamView->draw_stats) {
+                streamView->draw_stats = true;
+                debugButton->setOn(true, false);
+            }
+        });
+
+    // Results are shown with debug info, so it's turned on together
+    latencyProbeButton->init(
+        "streaming/latency_probe"_i18n, LatencyProbe::instance().enabled(),
+        [this, streamView](bool value) {
+            LatencyProbe::instance().set_enabled(value);
+            if (value && !streamView->draw_stats) {
+                streamView->draw_stats = true;
+                debugButton->setOn(true, false);
+            }
+        });
+
+#ifdef USE_PIPELINE_TRACE
+    pipelineTraceButton->init(
+        "streaming/pipeline_trace"_i18n, PipelineTrace::enabled(),
+        [this](bool value) {
+            if (value) {
+                PipelineTrace::instance().start();
+                return;
+            }
+
+            if (!PipelineTrace::instance().stop(Settings::instance().pipeline_trace_path()))
+                showError("streaming/pipeline_trace_error"_i18n, [] {});
+        });
+#else
+    pipelineTraceButton->setVisibility(brls::Visibility::GONE);
+#endif
 }
 
 OptionsTab::~OptionsTab() { Settings::instance().save(); }
@@ -7,8 +7,10 @@
 
 #include "keyboard_view.hpp"
 #include "Settings.hpp"
+#include <algorithm>
 #include <chrono>
 #include <cmath>
+#include <map>
 #include <libretro-common/retro_timers.h>
 
 using namespace brls;
@@ -28,8 +30,7 @@ short KeyboardCodes[_VK_KEY_MAX]
 std::chrono::high_resolution_clock::time_point rumbleLastButtonClicked;
 bool rumblingActive = false;
 
-bool keysState[_VK_KEY_MAX];
-bool keysStateInited = false;
+KeyboardState keysState;
 brls::InputManager* inputManager = nullptr;
 
 void startRumbling() {
@@ -40,226 +41,273 @@ void startRumbling() {
     }
 }
 
-ButtonView::ButtonView(KeyboardView* keyboardView)
-    : keyboardView(keyboardView) {
-    setFocusable(true);
-    setHideHighlightBackground(true);
-    setHighlightCornerRadius(11);
-    setHideClickAnimation(true);
-
-    registerClickAction([](View* view) { return true; });
-
-    if (inputManager == nullptr)
-        inputManager = Application::getPlatform()->getInputManager();
-
-    setBackgroundColor(nvgRGB(60, 60, 60));
-    setWidth(90);
-    setHeight(56);
-
-    setAlignItems(AlignItems::CENTER);
-    setJustifyContent(JustifyContent::CENTER);
-
-    charLabel = new Label();
-    charLabel->setHorizontalAlign(HorizontalAlign::CENTER);
-    charLabel->setVerticalAlign(VerticalAlign::CENTER);
-    charLabel->setTextColor(nvgRGB(255, 255, 255));
-    charLabel->setFontSize(27);
-    addView(charLabel);
-
-    setCornerRadius(8);
-    setShadowVisibility(true);
-    setShadowType(ShadowType::GENERIC);
-
-    shiftSubscription = KeyboardView::shiftUpdated.subscribe([this] {
-        if (!dummy) {
-            if ((this->getClickAlpha() == 0 && keysState[this->key]) ||
-                (this->getClickAlpha() > 0 && !keysState[this->key]))
-                this->playClickAnimation(!keysState[this->key], false, true);
-        }
-        applyTitle();
-    });
-
-    registerCallback();
-}
-
-ButtonView::~ButtonView() {
-    KeyboardView::shiftUpdated.unsubscribe(shiftSubscription);
+void KeyboardLayout::addKeys(std::vector<KeyboardKeyDef>& row, std::initializer_list<KeyboardKeys> keys,
+                             float width, float fontSize) {
+    for (auto key : keys)
+        row.push_back({.key = key, .width = width, .fontSize = fontSize});
 }
 
-void ButtonView::draw(NVGcontext* vg, float x, float y, float width,
-                      float height, brls::Style style,
-                      brls::FrameContext* ctx) {
-    Box::draw(vg, x, y, width, height, style, ctx);
-    if (!focused)
-        return;
+KeyboardGeometry::KeyboardGeometry(const KeyboardLayout& layout) {
+    std::vector<float> rowWidths;
+    for (auto& row : layout.rows) {
+        float rowWidth = 0;
+        for (auto& def : row)
+            rowWidth += def.marginLeft + def.width + def.marginRight;
+        rowWidths.push_back(rowWidth);
+        width = std::max(width, rowWidth);
+    }
 
-    static ControllerState oldController;
-    ControllerState controller;
-    inputManager->updateUnifiedControllerState(&controller);
-
-    auto button = inputManager->mapControllerState(BUTTON_A);
-    if (oldController.buttons[button] != controller.buttons[button]) {
-        bool pressed = controller.buttons[button];
-        if (!triggerType) {
-            if (!dummy) {
-                keysState[key] = pressed;
-                this->playClickAnimation(!pressed, false, true);
-            }
-        } else if (pressed) {
-            keysState[key] = !keysState[key];
-            this->playClickAnimation(!keysState[key], false, true);
+    float rowHeight = KEYBOARD_KEY_HEIGHT + KEYBOARD_KEY_MARGIN * 2;
+    height = rowHeight * layout.rows.size();
+
+    // Rows are centered, as they were in column box
+    for (int row = 0; row < (int)layout.rows.size(); row++) {
+        rowStart.push_back((int)keys.size());
+        float x = (width - rowWidths[row]) / 2;
+        for (auto& def : layout.rows[row]) {
+            x += def.marginLeft;
+            keys.push_back({&def, x, row * rowHeight + KEYBOARD_KEY_MARGIN, def.width, KEYBOARD_KEY_HEIGHT, row});
+            x += def.width + def.marginRight;
         }
-
-        if (event != NULL) {
-            if (pressed && !focusJustGained) {
-                event();
-            }
+    }
+    rowStart.push_back((int)keys.size());
+
+    m_columns = (int)std::ceil(width / KEYBOARD_GRID_CELL);
+    m_grid.assign(m_columns * rows(), -1);
+    for (int row = 0; row < rows(); row++) {
+        if (rowStart[row] == rowStart[row + 1])
+            continue;
+
+        auto& first = keys[rowStart[row]];
+        auto& last = keys[rowStart[row + 1] - 1];
+        float left = first.x - first.def->marginLeft;
+        float right = last.x + last.width + last.def->marginRight;
+        for (int column = 0; column < m_columns; column++) {
+            float x = (column + 0.5f) * KEYBOARD_GRID_CELL;
+            if (x >= left && x < right)
+                m_grid[row * m_columns + column] = (int16_t)nearestKey(row, x);
         }
     }
-
-    focusJustGained = false;
-    oldController = controller;
 }
 
-void ButtonView::onFocusGained() {
-    Box::onFocusGained();
-    focusJustGained = true;
-}
+int KeyboardGeometry::hitTest(float x, float y) const {
+    if (x < 0 || y < 0 || x >= width || y >= height)
+        return -1;
 
-void ButtonView::onFocusLost() {
-    Box::onFocusLost();
-    if (!triggerType && !dummy) {
-        keysState[key] = false;
-        if (this->getClickAlpha() > 0)
-            this->playClickAnimation(true, false, true);
-    }
+    int row = std::min((int)(y / (KEYBOARD_KEY_HEIGHT + KEYBOARD_KEY_MARGIN * 2)), rows() - 1);
+    int column = std::min((int)(x / KEYBOARD_GRID_CELL), m_columns - 1);
+    return m_grid[row * m_columns + column];
 }
 
-KeyboardLocale ButtonView::getCurrentLocale() {
-    int selectedLang = keyboardView->keyboardLangLock != -1
-                           ? keyboardView->keyboardLangLock
-                           : Settings::instance().get_keyboard_locale();
-    if (KeyboardView::getLocales().size() <= selectedLang) {
-        Settings::instance().set_keyboard_locale(0);
-        selectedLang = 0;
+int KeyboardGeometry::nearestKey(int row, float x) const {
+    int nearest = rowStart[row];
+    float nearestDistance = INFINITY;
+    for (int i = rowStart[row]; i < rowStart[row + 1]; i++) {
+        float distance = std::max({keys[i].x - x, x - keys[i].x - keys[i].width, 0.f});
+        if (distance < nearestDistance) {
+            nearest = i;
+            nearestDistance = distance;
+        }
     }
-
-    return KeyboardView::getLocales()[selectedLang];
+    return nearest;
 }
 
-void ButtonView::applyTitle() {
-    if (dummy)
-        return;
+KeyboardView::KeyboardView(bool focusable)
+    : Box(Axis::COLUMN), needFocus(focusable) {
+    if (locales.empty())
+        createLocales();
 
-    // We need to map only key title, virtual keys are constant (which could be a bug in Sunshine)
-    KeyboardKeys mappedKey = key;
-    auto selectedLang = getCurrentLocale();
-    if (selectedLang.keyMapper.contains(key)) {
-        mappedKey = selectedLang.keyMapper[key];
-    }
+    if (inputManager == nullptr)
+        inputManager = Application::getPlatform()->getInputManager();
 
-    bool shifted = keysState[VK_RSHIFT];
-    charLabel->setText(selectedLang.localization[mappedKey][shifted]);
-}
+    setFocusable(focusable);
+    setHideHighlight(true);
+    setHideClickAnimation(true);
+    setBackgroundColor(nvgRGBA(120, 120, 120, 200));
 
-void ButtonView::setKey(KeyboardKeys key) {
+    registerClickAction([](View* view) { return true; });
 
-    this->dummy = false;
-    this->key = key;
-    this->applyTitle();
+    // D-pad moves between keys, focus stays on keyboard itself
+    registerAction("", BUTTON_NAV_UP, [this](View* view) { return moveFocus(FocusDirection::UP); },
+                   true, true, SOUND_FOCUS_CHANGE);
+    registerAction("", BUTTON_NAV_DOWN, [this](View* view) { return moveFocus(FocusDirection::DOWN); },
+                   true, true, SOUND_FOCUS_CHANGE);
+    registerAction("", BUTTON_NAV_LEFT, [this](View* view) { return moveFocus(FocusDirection::LEFT); },
+                   true, true, SOUND_FOCUS_CHANGE);
+    registerAction("", BUTTON_NAV_RIGHT, [this](View* view) { return moveFocus(FocusDirection::RIGHT); },
+                   true, true, SOUND_FOCUS_CHANGE);
 
-    if (keysState[key])
-        this->playClickAnimation(false, false, true);
-}
+    switch (Settings::instance().get_keyboard_type()) {
+    case COMPACT:
+        setLayout(englishLayout());
+        break;
+    case FULLSIZED:
+        setLayout(fullLayout());
+        break;
+    }
 
-void ButtonView::registerCallback() {
     auto* tapRecognizer =
         new TapGestureRecognizer([this](TapGestureStatus status, Sound* sound) {
-            if (!triggerType) {
-                this->playClickAnimation(
-                    status.state != brls::GestureState::START, false, true);
-
-                switch (status.state) {
-                case brls::GestureState::START:
+            switch (status.state) {
+            case GestureState::START:
+                touchedKey = geometry->hitTest(status.position.x - originX,
+                                               status.position.y - originY);
+                if (touchedKey != -1) {
                     startRumbling();
-
-                    if (!dummy)
-                        keysState[key] = true;
-                    break;
-                case brls::GestureState::END:
-                case brls::GestureState::FAILED:
-                    if (!dummy)
-                        keysState[key] = false;
-
-                    if (event != nullptr)
-                        event();
-                    break;
-                default:
-                    if (!dummy)
-                        keysState[key] = false;
-                    break;
+                    pressKey(touchedKey);
                 }
-            } else {
-                switch (status.state) {
-                case brls::GestureState::START:
-                    startRumbling();
-                    if (!keysState[key])
-                        this->playClickAnimation(false, false, true);
-                    break;
-                case brls::GestureState::FAILED:
-                    if (!keysState[key])
-                        this->playClickAnimation(true, false, true);
-                    break;
-                case brls::GestureState::END:
-                    keysState[key] = !keysState[key];
-                    if (event != nullptr)
-                        event();
-
-                    if (!keysState[key])
-                        this->playClickAnimation(!keysState[key], false, true);
-                    break;
-                default:
-                    break;
+                break;
+            case GestureState::END:
+            case GestureState::FAILED:
+            case GestureState::INTERRUPTED:
+                if (touchedKey != -1) {
+                    int key = touchedKey;
+                    touchedKey = -1;
+                    releaseKey(key, status.state == GestureState::END);
                 }
+                break;
+            default:
+                break;
             }
         });
     tapRecognizer->setForceRecognision(true);
     addGestureRecognizer(tapRecognizer);
+    addGestureRecognizer(new PanGestureRecognizer(
+        [](PanGestureStatus status, Sound* sound) {}, PanAxis::ANY));
 }
 
-KeyboardView::KeyboardView(bool focusable)
-    : Box(Axis::COLUMN), needFocus(focusable) {
-    createLocales();
+KeyboardView::~KeyboardView() {
+    if (rumblingActive)
+        inputManager->sendRumble(0, 0, 0);
+}
 
-    if (!keysStateInited) {
-        keysStateInited = true;
-        for (int i = 0; i < _VK_KEY_MAX; i++)
-            keysState[i] = false;
+const KeyboardGeometry& KeyboardView::geometryFor(const KeyboardLayout& layout) {
+    static std::map<const KeyboardLayout*, KeyboardGeometry> cache;
+    auto geometry = cache.find(&layout);
+    if (geometry == cache.end())
+        geometry = cache.emplace(&layout, KeyboardGeometry(layout)).first;
+    return geometry->second;
+}
+
+void KeyboardView::setLayout(const KeyboardLayout& layout) {
+    // Focus stays at the same place of new layout
+    int focusRow = 0;
+    float focusX = 0;
+    if (geometry) {
+        auto& focus = geometry->keys[focusedKey];
+        focusRow = focus.row;
+        focusX = focus.x + focus.width / 2;
     }
 
-    setBackgroundColor(nvgRGBA(120, 120, 120, 200));
-    setAlignItems(AlignItems::CENTER);
-    setPaddingTop(24);
-    setPaddingBottom(24);
+    this->layout = &layout;
+    geometry = &geometryFor(layout);
+    touchedKey = -1;
+    controllerKey = -1;
+    focusedKey = geometry->nearestKey(std::min(focusRow, geometry->rows() - 1), focusX);
+    setHeight(geometry->height + KEYBOARD_PADDING * 2);
+}
 
-    switch (Settings::instance().get_keyboard_type()) {
-    case COMPACT:
-        createEnglishLayout();
+const KeyboardLocale& KeyboardView::currentLocale() {
+    int selectedLang = layout->englishOnly ? 0 : Settings::instance().get_keyboard_locale();
+    if ((int)locales.size() <= selectedLang) {
+        Settings::instance().set_keyboard_locale(0);
+        selectedLang = 0;
+    }
+    return locales[selectedLang];
+}
+
+void KeyboardView::pressKey(int index) {
+    auto* def = geometry->keys[index].def;
+    if (!def->toggle && def->key != _VK_KEY_MAX)
+        keysState.set(def->key, true);
+}
+
+void KeyboardView::releaseKey(int index, bool trigger) {
+    auto* def = geometry->keys[index].def;
+    if (def->key != _VK_KEY_MAX) {
+        if (!def->toggle)
+            keysState.set(def->key, false);
+        else if (trigger)
+            keysState.flip(def->key);
+    }
+
+    if (!trigger)
+        return;
+
+    switch (def->action) {
+    case KEYBOARD_ACTION_NUMPAD:
+        setLayout(numpadLayout());
         break;
-    case FULLSIZED:
-        createFullLayout();
+    case KEYBOARD_ACTION_LETTERS:
+        setLayout(englishLayout());
+        break;
+    case KEYBOARD_ACTION_LANGUAGE: {
+        std::vector<std::string> langs;
+        for (auto& locale : locales)
+            langs.push_back(locale.name);
+
+        Dropdown* dropdown = new Dropdown(
+            "Select language", langs,
+            [](int selected) { changeLang(selected); },
+            Settings::instance().get_keyboard_locale());
+        Application::pushActivity(new Activity(dropdown));
+        break;
+    }
+    default:
         break;
     }
+}
 
-    addGestureRecognizer(
-        new TapGestureRecognizer([](TapGestureStatus status, Sound* sound) {}));
-    addGestureRecognizer(new PanGestureRecognizer(
-        [](PanGestureStatus status, Sound* sound) {}, PanAxis::ANY));
+bool KeyboardView::moveFocus(FocusDirection direction) {
+    auto& focus = geometry->keys[focusedKey];
+    float focusX = focus.x + focus.width / 2;
+    int target = -1;
+
+    switch (direction) {
+    case FocusDirection::LEFT:
+        if (focusedKey > geometry->rowStart[focus.row])
+            target = focusedKey - 1;
+        break;
+    case FocusDirection::RIGHT:
+        if (focusedKey + 1 < geometry->rowStart[focus.row + 1])
+            target = focusedKey + 1;
+        break;
+    case FocusDirection::UP:
+        if (focus.row > 0)
+            target = geometry->nearestKey(focus.row - 1, focusX);
+        break;
+    case FocusDirection::DOWN:
+        if (focus.row + 1 < geometry->rows())
+            target = geometry->nearestKey(focus.row + 1, focusX);
+        break;
+    default:
+        break;
+    }
+
+    if (target == -1)
+        return false;
+
+    if (controllerKey != -1) {
+        int key = controllerKey;
+        controllerKey = -1;
+        releaseKey(key, false);
+    }
+    focusedKey = target;
+    return true;
 }
 
-KeyboardView::~KeyboardView() {
-    if (rumblingActive)
-        inputManager->sendRumble(0, 0, 0);
+void KeyboardView::onFocusGained() {
+    Box::onFocusGained();
+    focusJustGained = true;
+}
+
+void KeyboardView::onFocusLost() {
+    Box::onFocusLost();
+    if (controllerKey != -1) {
+        int key = controllerKey;
+        controllerKey = -1;
+        releaseKey(key, false);
+    }
 }
 
 void KeyboardView::draw(NVGcontext* vg, float x, float y, float width,
@@ -267,6 +315,30 @@ void KeyboardView::draw(NVGcontext* vg, float x, float y, float width,
                         brls::FrameContext* ctx) {
     Box::draw(vg, x, y, width, height, style, ctx);
 
+    originX = x + (width - geometry->width) / 2;
+    originY = y + KEYBOARD_PADDING;
+    drawKeys(vg, originX, originY);
+
+    if (focused) {
+        ControllerState controller;
+        inputManager->updateUnifiedControllerState(&controller);
+
+        auto button = inputManager->mapControllerState(BUTTON_A);
+        if (oldController.buttons[button] != controller.buttons[button] && !focusJustGained) {
+            if (controller.buttons[button]) {
+                controllerKey = focusedKey;
+                pressKey(controllerKey);
+            } else if (controllerKey != -1) {
+                int key = controllerKey;
+                controllerKey = -1;
+                releaseKey(key, true);
+            }
+        }
+
+        focusJustGained = false;
+        oldController = controller;
+    }
+
     if (rumblingActive) {
         auto timeNow = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -279,42 +351,75 @@ void KeyboardView::draw(NVGcontext* vg, float x, float y, float width,
     }
 }
 
-KeyboardState KeyboardView::getKeyboardState() {
-    KeyboardState state{};
+void KeyboardView::drawKeys(NVGcontext* vg, float x, float y) {
+    auto& keys = geometry->keys;
+    auto pressed = [this, &keys](int i) {
+        auto key = keys[i].def->key;
+        return i == touchedKey || i == controllerKey ||
+               (key != _VK_KEY_MAX && keysState.test(key));
+    };
+
+    // Every layer of all keys is a single path: shadows, keys, pressed ones
+    nvgBeginPath(vg);
+    for (auto& rect : keys)
+        nvgRoundedRect(vg, x + rect.x, y + rect.y + 2, rect.width, rect.height, 8);
+    nvgFillColor(vg, nvgRGBA(0, 0, 0, 60));
+    nvgFill(vg);
+
+    nvgBeginPath(vg);
+    for (auto& rect : keys)
+        nvgRoundedRect(vg, x + rect.x, y + rect.y, rect.width, rect.height, 8);
+    nvgFillColor(vg, nvgRGB(60, 60, 60));
+    nvgFill(vg);
+
+    bool anyPressed = false;
+    nvgBeginPath(vg);
+    for (int i = 0; i < (int)keys.size(); i++) {
+        if (pressed(i)) {
+            nvgRoundedRect(vg, x + keys[i].x, y + keys[i].y, keys[i].width, keys[i].height, 8);
+            anyPressed = true;
+        }
+    }
+    if (anyPressed) {
+        nvgFillColor(vg, Application::getTheme()["brls/click_pulse"]);
+        nvgFill(vg);
+    }
 
-    for (int i = 0; i < _VK_KEY_MAX; i++)
-        state.keys[i] = keysState[i];
+    if (focused) {
+        auto& focus = keys[focusedKey];
+        nvgBeginPath(vg);
+        nvgRoundedRect(vg, x + focus.x - 2, y + focus.y - 2, focus.width + 4, focus.height + 4, 11);
+        nvgStrokeColor(vg, Application::getTheme()["brls/highlight/color1"]);
+        nvgStrokeWidth(vg, 4);
+        nvgStroke(vg);
+    }
 
-    return state;
+    // Titles share font and glyph atlas, so they end up in one draw call too
+    auto& locale = currentLocale();
+    bool shifted = keysState.test(VK_RSHIFT);
+    nvgFontFaceId(vg, Application::getFont(FONT_REGULAR));
+    nvgTextAlign(vg, NVG_ALIGN_CENTER | NVG_ALIGN_MIDDLE);
+    nvgFillColor(vg, nvgRGB(255, 255, 255));
+    float fontSize = 0;
+    for (auto& rect : keys) {
+        if (rect.def->fontSize != fontSize) {
+            fontSize = rect.def->fontSize;
+            nvgFontSize(vg, fontSize);
+        }
+        const char* title = rect.def->title ? rect.def->title
+                                            : locale.titles[rect.def->key][shifted].c_str();
+        nvgText(vg, x + rect.x + rect.width / 2, y + rect.y + rect.height / 2, title, nullptr);
+    }
 }
 
+KeyboardState KeyboardView::getKeyboardState() { return keysState; }
+
 short KeyboardView::getKeyCode(KeyboardKeys key) {
     return KeyboardCodes[key];
 }
 
-View* KeyboardView::getParentNavigationDecision(View* from, View* newFocus,
-                                                FocusDirection direction) {
-    if (newFocus && (direction == FocusDirection::UP ||
-                     direction == FocusDirection::DOWN)) {
-        View* source = Application::getCurrentFocus();
-        void* currentparentUserData = source->getParentUserData();
-
-        Box* sourceParent = source->getParent();
-        Box* newParent = newFocus->getParent();
-
-        size_t currentFocusIndex = *((size_t*)currentparentUserData);
-        size_t targetFocusIndex =
-            round((float)currentFocusIndex /
-                  (float)(sourceParent->getChildren().size() - 1) *
-                  (float)(newParent->getChildren().size() - 1));
-
-        return newParent->getChildren()[targetFocusIndex];
-    }
-    return Box::getParentNavigationDecision(from, newFocus, direction);
-}
-
 void KeyboardView::changeLang(int lang) {
+    // Titles are read from locale every frame, nothing to rebuild
     Settings::instance().set_keyboard_locale(lang);
     Settings::instance().save();
-    KeyboardView::shiftUpdated.fire();
 }
@@ -56,4 +56,14 @@ void KeyboardView::createLocales() {
     });
 
     // TODO: - Add more languages
+
+    // We need to map only key title, virtual keys are constant (which could be a bug in Sunshine)
+    for (auto& locale : locales) {
+        for (int key = 0; key < _VK_KEY_MAX; key++) {
+            auto mapped = locale.keyMapper.find((KeyboardKeys)key);
+            int source = mapped != locale.keyMapper.end() ? mapped->second : key;
+            locale.titles[key][0] = locale.localization[source][0];
+            locale.titles[key][1] = locale.localization[source][1];
+        }
+    }
 }
@@ -18,17 +18,25 @@
  */
 
 #include "Settings.hpp"
+#include "ThreadProfiler.hpp"
 #include "client.h"
 #include "CryptoManager.hpp"
 #include "errors.h"
 #include "http.h"
+#include "HostAddress.hpp"
+#ifdef __SWITCH__
+#include "SwitchPower.hpp"
+#endif
 #include <Limelight.h>
 #include <borealis/core/logger.hpp>
 #include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
-#include <sstream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
 
 #define CHANNEL_COUNT_STEREO 2
 #define CHANNEL_COUNT_51_SURROUND 6
@@ -38,6 +46,15 @@
 
 static std::string unique_id = "0123456789ABCDEF";
 
+// Names with both IPv4 and IPv6 addresses are raced for this long, before
+// the winner is pinned for HTTPS and stream
+#define GS_CONNECT_RACE_TIMEOUT_MS 2000
+
+// Host part of request URLs, IPv6 literal goes in brackets
+static std::string url_host(PSERVER_DATA server) {
+    return HostAddress{server->address, 0}.url_host();
+}
+
 int extractVersionQuadFromString(const char* string, int* quad) {
     const char* nextNumber = string;
     for (int i = 0; i < 4; i++) {
@@ -57,7 +74,7 @@ int extractVersionQuadFromString(const char* string, int* quad) {
     return 0;
 }
 
-bool _SERVER_DATA::isSunshine() {
+bool _SERVER_DATA::isSunshine() const {
     int AppVersionQuad[4];
     extractVersionQuadFromString(serverInfoAppVersion.c_str(), AppVersionQuad);
     return AppVersionQuad[3] < 0;
@@ -70,6 +87,13 @@ static int load_serverinfo(PSERVER_DATA server, bool https) {
     std::string currentGameText;
     std::string stateText;
     std::string httpsPortText;
+    int fields_status;
+    // Whole response is parsed once for all of them
+    std::map<std::string, std::string> fields = {
+        {"currentgame", ""}, {"PairStatus", ""}, {"appversion", ""},
+        {"state", ""}, {"ServerCodecModeSupport", ""}, {"gputype", ""},
+        {"GsVersion", ""}, {"hostname", ""}, {"GfeVersion", ""},
+        {"HttpsPort", ""}, {"mac", ""}};
 
     // Modern GFE versions don't allow serverinfo to be fetched over HTTPS
     // if the client is not already paired. Since we can't pair without
@@ -78,7 +102,7 @@ static int load_serverinfo(PSERVER_DATA server, bool https) {
     // doesn't accurately tell us if we're paired.
 
     snprintf(url, sizeof(url), "%s://%s:%d/serverinfo?uniqueid=%s",
-             https ? "https" : "http", server->serverInfo.address,
+             https ? "https" : "http", url_host(server).c_str(),
              https ? server->httpsPort : server->httpPort, unique_id.c_str());
 
     Data data;
@@ -88,47 +112,23 @@ static int load_serverinfo(PSERVER_DATA server, bool https) {
         goto cleanup;
     }
 
-    if (xml_status(data) == GS_ERROR) {
-        ret = GS_ERROR;
-        goto cleanup;
-    }
-
-    if (xml_search(data, "currentgame", &currentGameText) != GS_OK) {
-        goto cleanup;
-    }
-
-    if (xml_search(data, "PairStatus", &pairedText) != GS_OK)
-        goto cleanup;
-
-    if (xml_search(data, "appversion", &server->serverInfoAppVersion) !=
-        GS_OK) {
+    if ((fields_status = xml_fields(data, &fields)) != GS_OK) {
+        if (fields_status == GS_ERROR)
+            ret = GS_ERROR;
         goto cleanup;
     }
 
-    if (xml_search(data, "state", &stateText) != GS_OK)
-        goto cleanup;
-
-    if (xml_search(data, "ServerCodecModeSupport",
-                   &server->serverInfo.serverCodecModeSupport) != GS_OK)
-        goto cleanup;
-
-    if (xml_search(data, "gputype", &server->gpuType) != GS_OK)
-        goto cleanup;
-
-    if (xml_search(data, "GsVersion", &server->gsVersion) != GS_OK)
-        goto cleanup;
-
-    if (xml_search(data, "hostname", &server->hostname) != GS_OK)
-        goto cleanup;
-
-    if (xml_search(data, "GfeVersion", &server->serverInfoGfeVersion) != GS_OK)
-        goto cleanup;
-
-    if (xml_search(data, "HttpsPort", &httpsPortText) != GS_OK)
-        goto cleanup;
-
-    if (xml_search(data, "mac", &server->mac) != GS_OK)
-        goto cleanup;
+    currentGameText = fields["currentgame"];
+    pairedText = fields["PairStatus"];
+    server->serverInfoAppVersion = fields["appversion"];
+    stateText = fields["state"];
+    server->serverInfo.serverCodecModeSupport = atoi(fields["ServerCodecModeSupport"].c_str());
+    server->gpuType = fields["gputype"];
+    server->gsVersion = fields["GsVersion"];
+    server->hostname = fields["hostname"];
+    server->serverInfoGfeVersion = fields["GfeVersion"];
+    httpsPortText = fields["HttpsPort"];
+    server->mac = fields["mac"];
 
     // These fields are present on all version of GFE that this client
     // supports
@@ -197,6 +197,54 @@ static int load_server_status(PSERVER_DATA server) {
 
 static std::string _gs_error = "";
 
+static std::mutex cert_key_pair_mutex;
+static std::shared_future<bool> cert_key_pair;
+
+void gs_prepare_cert_key_pair() {
+    std::lock_guard<std::mutex> lock(cert_key_pair_mutex);
+    if (cert_key_pair.valid())
+        return;
+
+    auto promise = std::make_shared<std::promise<bool>>();
+    cert_key_pair = promise->get_future().share();
+
+    // Reading existing pair is quick, so callers see it right away
+    if (CryptoManager::load_cert_key_pair()) {
+        http_set_credentials(CryptoManager::cert_data(), CryptoManager::key_data());
+        promise->set_value(true);
+        return;
+    }
+
+    // 2048-bit RSA takes seconds on handheld CPUs
+    brls::Logger::info("Client: No certs, generate new...");
+    std::thread([promise] {
+        ThreadProfileScope profile("Key generation");
+#ifdef __SWITCH__
+        SwitchPower::set_boost(SWITCH_BOOST_KEY_GENERATION, true);
+        bool result = CryptoManager::generate_new_cert_key_pair();
+        SwitchPower::set_boost(SWITCH_BOOST_KEY_GENERATION, false);
+#else
+        bool result = CryptoManager::generate_new_cert_key_pair();
+#endif
+        if (result)
+            http_set_credentials(CryptoManager::cert_data(), CryptoManager::key_data());
+        else
+            brls::Logger::error("Client: Failed to generate certs...");
+        promise->set_value(result);
+    }).detach();
+}
+
+bool gs_wait_cert_key_pair() {
+    gs_prepare_cert_key_pair();
+
+    std::shared_future<bool> future;
+    {
+        std::lock_guard<std::mutex> lock(cert_key_pair_mutex);
+        future = cert_key_pair;
+    }
+    return future.get();
+}
+
 void gs_set_error(std::string error) { _gs_error = error; }
 
 std::string gs_error() {
@@ -213,22 +261,24 @@ int gs_unpair(PSERVER_DATA server) {
     Data data;
 
     snprintf(url, sizeof(url), "http://%s:%u/unpair?uniqueid=%s",
-             server->serverInfo.address,
+             url_host(server).c_str(),
              server->httpPort,
              unique_id.c_str());
     ret = http_request(url, &data, HTTPRequestTimeoutLow);
     return ret;
 }
 
-static int gs_pair_validate(Data& data, std::string* result) {
+// Checks status and reads "paired", or field instead when it's given,
+// from the same parse
+static int gs_pair_validate(Data& data, std::string* result, const char* field = nullptr) {
     *result = "";
 
-    int ret = GS_OK;
-    if ((ret = xml_status(data) != GS_OK)) {
-        return ret;
-    } else if ((ret = xml_search(data, "paired", result)) != GS_OK) {
+    std::map<std::string, std::string> fields = {{field ? field : "paired", ""}};
+    int ret = xml_fields(data, &fields);
+    if (ret != GS_OK) {
         return ret;
     }
+    *result = fields.begin()->second;
 
     //    if (strcmp(*result, "1") != 0) {
     //        gs_error = "Pairing failed";
@@ -238,6 +288,24 @@ static int gs_pair_validate(Data& data, std::string* result) {
     return ret;
 }
 
+// Hex parameter goes straight into url tail, no temporary string
+static bool url_append_hex(char* url, size_t size, int length, DataView data) {
+    if (length < 0 || (size_t)length >= size ||
+        (!data.is_empty() && !Data::hex_encode(data, url + length, size - length))) {
+        gs_set_error("Request URL too long");
+        return false;
+    }
+    return true;
+}
+
+static Data hex_string_to_bytes(const std::string& hex) {
+    Data data(hex.size() / 2);
+    Data::hex_decode(hex.c_str(), hex.size(), data.bytes(), data.size());
+    return data;
+}
+
+// Failed or cancelled pairing is dropped on host too, so it isn't left
+// waiting half way
 static int gs_pair_cleanup(int ret, PSERVER_DATA server, std::string* result) {
     if (ret != GS_OK) {
         gs_unpair(server);
@@ -245,7 +313,41 @@ static int gs_pair_cleanup(int ret, PSERVER_DATA server, std::string* result) {
     return ret;
 }
 
-int gs_pair(PSERVER_DATA server, char* pin) {
+// Client side of the handshake, none of it depends on host answers, so
+// it's computed while host waits for PIN to be entered
+struct PairSecrets {
+    Data aes_key;
+    Data random_challenge;
+    Data encrypted_challenge;
+    Data client_secret;
+    Data cert_signature;
+    // Secret signed with client key, the slow part on weak CPUs
+    Data client_pairing_secret;
+};
+
+static PairSecrets gs_pair_secrets(const Data& salted_pin, bool sha256) {
+    ThreadProfileScope profile("Pairing secrets");
+    PairSecrets secrets;
+    secrets.aes_key = sha256 ? CryptoManager::create_AES_key_from_salt_SHA256(salted_pin)
+                             : CryptoManager::create_AES_key_from_salt_SHA1(salted_pin);
+    secrets.random_challenge = Data::random_bytes(16);
+    secrets.encrypted_challenge = CryptoManager::aes_encrypt(secrets.random_challenge, secrets.aes_key);
+    secrets.client_secret = Data::random_bytes(16);
+    secrets.cert_signature = CryptoManager::signature(CryptoManager::cert_data());
+    secrets.client_pairing_secret = secrets.client_secret.append(
+        CryptoManager::sign_data(secrets.client_secret, CryptoManager::key_data()));
+    return secrets;
+}
+
+// Stages go out in order, each is checked before it's sent
+static bool gs_pair_cancelled(const std::atomic<bool>* cancel) {
+    if (!cancel || !cancel->load())
+        return false;
+    gs_set_error("Pairing cancelled");
+    return true;
+}
+
+int gs_pair(PSERVER_DATA server, char* pin, const std::atomic<bool>* cancel) {
     int ret = GS_OK;
     Data data;
     std::string result;
@@ -263,6 +365,11 @@ int gs_pair(PSERVER_DATA server, char* pin) {
         return GS_WRONG_STATE;
     }
 
+    if (!gs_wait_cert_key_pair()) {
+        gs_set_error("Failed to generate client certificate");
+        return GS_FAILED;
+    }
+
     brls::Logger::info("Client: Pairing with generation {} server",
                        server->serverMajorVersion);
     brls::Logger::info("Client: Start pairing stage #1");
@@ -271,86 +378,77 @@ int gs_pair(PSERVER_DATA server, char* pin) {
     Data salted_pin = salt.append(Data(pin, strlen(pin)));
 //    brls::Logger::info("Client: PIN: {}, salt {}", pin, salt.hex().bytes());
 
-    snprintf(url, sizeof(url),
+    // Gen 7 servers use SHA256 to get the key
+    bool sha256 = server->serverMajorVersion >= 7;
+    int hashLength = sha256 ? 32 : 20;
+    std::future<PairSecrets> pending_secrets =
+        std::async(std::launch::async, gs_pair_secrets, salted_pin, sha256);
+
+    char salt_hex[33];
+    Data::hex_encode(salt, salt_hex, sizeof(salt_hex));
+
+    int length = snprintf(url, sizeof(url),
              "http://%s:%u/"
              "pair?uniqueid=%s&devicename=roth&updateState=1&phrase="
-             "getservercert&salt=%s&clientcert=%s",
-             server->serverInfo.address, 
+             "getservercert&salt=%s&clientcert=",
+             url_host(server).c_str(),
              server->httpPort,
-             unique_id.c_str(), salt.hex().bytes(),
-             CryptoManager::cert_data().hex().bytes());
+             unique_id.c_str(), salt_hex);
+    if (!url_append_hex(url, sizeof(url), length, CryptoManager::cert_data()))
+        return GS_FAILED;
 
-    if ((ret = http_request(url, &data, HTTPRequestTimeoutLong)) != GS_OK) {
+    // Host answers once PIN is entered on it, cancel aborts the wait.
+    // Stages go over the same pooled keep-alive connection
+    if ((ret = http_request(url, &data, HTTPRequestTimeoutLong, cancel)) != GS_OK) {
         return gs_pair_cleanup(ret, server, &result);
     }
 
-    if ((ret = gs_pair_validate(data, &result) != GS_OK)) {
-        return gs_pair_cleanup(ret, server, &result);
-    }
-
-    if ((ret = xml_search(data, "plaincert", &result)) != GS_OK) {
+    if ((ret = gs_pair_validate(data, &result, "plaincert")) != GS_OK) {
         return gs_pair_cleanup(ret, server, &result);
     }
 
     brls::Logger::info("Client: Start pairing stage #2");
 
-    Data plainCert = Data((char*)result.c_str(), result.size());
-    Data aesKey;
-
-    // Gen 7 servers use SHA256 to get the key
-    int hashLength;
-    if (server->serverMajorVersion >= 7) {
-        aesKey = CryptoManager::create_AES_key_from_salt_SHA256(salted_pin);
-        hashLength = 32;
-    } else {
-        aesKey = CryptoManager::create_AES_key_from_salt_SHA1(salted_pin);
-        hashLength = 20;
-    }
+    Data plainCert = hex_string_to_bytes(result);
+    PairSecrets secrets = pending_secrets.get();
 
-    Data randomChallenge = Data::random_bytes(16);
-    Data encryptedChallenge =
-        CryptoManager::aes_encrypt(randomChallenge, aesKey);
+    if (gs_pair_cancelled(cancel))
+        return gs_pair_cleanup(GS_CANCELLED, server, &result);
 
-    snprintf(
+    length = snprintf(
         url, sizeof(url),
         "http://%s:%u/"
-        "pair?uniqueid=%s&devicename=roth&updateState=1&clientchallenge=%s",
-        server->serverInfo.address, 
+        "pair?uniqueid=%s&devicename=roth&updateState=1&clientchallenge=",
+        url_host(server).c_str(),
         server->httpPort,
-        unique_id.c_str(),
-        encryptedChallenge.hex().bytes());
-
-    if ((ret = http_request(url, &data, HTTPRequestTimeoutLong)) != GS_OK) {
-        return gs_pair_cleanup(ret, server, &result);
-    }
+        unique_id.c_str());
+    if (!url_append_hex(url, sizeof(url), length, secrets.encrypted_challenge))
+        return gs_pair_cleanup(GS_FAILED, server, &result);
 
-    if ((ret = gs_pair_validate(data, &result) != GS_OK)) {
+    if ((ret = http_request(url, &data, HTTPRequestTimeoutLong, cancel)) != GS_OK) {
         return gs_pair_cleanup(ret, server, &result);
     }
 
-    if (xml_search(data, "challengeresponse", &result) != GS_OK) {
-        ret = GS_INVALID;
+    if ((ret = gs_pair_validate(data, &result, "challengeresponse")) != GS_OK) {
         return gs_pair_cleanup(ret, server, &result);
     }
 
     brls::Logger::info("Client: Start pairing stage #3");
 
-    Data encServerChallengeResp =
-        Data((char*)result.c_str(), result.size()).hex_to_bytes();
+    Data encServerChallengeResp = hex_string_to_bytes(result);
     Data decServerChallengeResp =
-        CryptoManager::aes_decrypt(encServerChallengeResp, aesKey);
+        CryptoManager::aes_decrypt(encServerChallengeResp, secrets.aes_key);
     Data serverResponse = decServerChallengeResp.subdata(0, hashLength);
     Data serverChallenge = decServerChallengeResp.subdata(hashLength, 16);
 
-    Data clientSecret = Data::random_bytes(16);
     Data challengeRespHashInput =
         serverChallenge
-            .append(CryptoManager::signature(CryptoManager::cert_data()))
-            .append(clientSecret);
+            .append(secrets.cert_signature)
+            .append(secrets.client_secret);
 
     Data challengeRespHash;
 
-    if (server->serverMajorVersion >= 7) {
+    if (sha256) {
         challengeRespHash =
             CryptoManager::SHA256_hash_data(challengeRespHashInput);
     } else {
@@ -358,51 +456,49 @@ int gs_pair(PSERVER_DATA server, char* pin) {
             CryptoManager::SHA1_hash_data(challengeRespHashInput);
     }
     Data challengeRespEncrypted =
-        CryptoManager::aes_encrypt(challengeRespHash, aesKey);
+        CryptoManager::aes_encrypt(challengeRespHash, secrets.aes_key);
 
-    snprintf(
+    if (gs_pair_cancelled(cancel))
+        return gs_pair_cleanup(GS_CANCELLED, server, &result);
+
+    length = snprintf(
         url, sizeof(url),
         "http://%s:%u/"
-        "pair?uniqueid=%s&devicename=roth&updateState=1&serverchallengeresp=%s",
-        server->serverInfo.address,
+        "pair?uniqueid=%s&devicename=roth&updateState=1&serverchallengeresp=",
+        url_host(server).c_str(),
         server->httpPort,
-        unique_id.c_str(),
-        challengeRespEncrypted.hex().bytes());
-
-    if ((ret = http_request(url, &data, HTTPRequestTimeoutLong)) != GS_OK) {
-        return gs_pair_cleanup(ret, server, &result);
-    }
+        unique_id.c_str());
+    if (!url_append_hex(url, sizeof(url), length, challengeRespEncrypted))
+        return gs_pair_cleanup(GS_FAILED, server, &result);
 
-    if ((ret = gs_pair_validate(data, &result) != GS_OK)) {
+    if ((ret = http_request(url, &data, HTTPRequestTimeoutLong, cancel)) != GS_OK) {
         return gs_pair_cleanup(ret, server, &result);
     }
 
-    if (xml_search(data, "pairingsecret", &result) != GS_OK) {
-        ret = GS_INVALID;
+    if ((ret = gs_pair_validate(data, &result, "pairingsecret")) != GS_OK) {
         return gs_pair_cleanup(ret, server, &result);
     }
 
     brls::Logger::info("Client: Start pairing stage #4");
 
-    Data serverSecretResp =
-        Data((char*)result.c_str(), result.size()).hex_to_bytes();
-    Data serverSecret = serverSecretResp.subdata(0, 16);
-    Data serverSignature = serverSecretResp.subdata(16, 256);
+    Data serverSecretResp = hex_string_to_bytes(result);
+    DataView serverSecret = DataView(serverSecretResp).subview(0, 16);
+    DataView serverSignature = DataView(serverSecretResp).subview(16, 256);
 
     if (!CryptoManager::verify_signature(serverSecret, serverSignature,
-                                         plainCert.hex_to_bytes())) {
+                                         plainCert)) {
         gs_set_error("MITM attack detected");
         ret = GS_FAILED;
         return gs_pair_cleanup(ret, server, &result);
     }
 
     Data serverChallengeRespHashInput =
-        randomChallenge
-            .append(CryptoManager::signature(plainCert.hex_to_bytes()))
+        secrets.random_challenge
+            .append(CryptoManager::signature(plainCert))
             .append(serverSecret);
     Data serverChallengeRespHash;
 
-    if (server->serverMajorVersion >= 7) {
+    if (sha256) {
         serverChallengeRespHash =
             CryptoManager::SHA256_hash_data(serverChallengeRespHashInput);
     } else {
@@ -410,37 +506,41 @@ int gs_pair(PSERVER_DATA server, char* pin) {
             CryptoManager::SHA1_hash_data(serverChallengeRespHashInput);
     }
 
-    Data clientPairingSecret = clientSecret.append(
-        CryptoManager::sign_data(clientSecret, CryptoManager::key_data()));
+    if (gs_pair_cancelled(cancel))
+        return gs_pair_cleanup(GS_CANCELLED, server, &result);
 
-    snprintf(
+    length = snprintf(
         url, sizeof(url),
         "http://%s:%u/"
-        "pair?uniqueid=%s&devicename=roth&updateState=1&clientpairingsecret=%s",
-        server->serverInfo.address, 
+        "pair?uniqueid=%s&devicename=roth&updateState=1&clientpairingsecret=",
+        url_host(server).c_str(),
         server->httpPort,
-        unique_id.c_str(),
-        clientPairingSecret.hex().bytes());
-    if ((ret = http_request(url, &data, HTTPRequestTimeoutLong)) != GS_OK) {
+        unique_id.c_str());
+    if (!url_append_hex(url, sizeof(url), length, secrets.client_pairing_secret))
+        return gs_pair_cleanup(GS_FAILED, server, &result);
+    if ((ret = http_request(url, &data, HTTPRequestTimeoutLong, cancel)) != GS_OK) {
         return gs_pair_cleanup(ret, server, &result);
     }
 
-    if ((ret = gs_pair_validate(data, &result) != GS_OK)) {
+    if ((ret = gs_pair_validate(data, &result)) != GS_OK) {
         return gs_pair_cleanup(ret, server, &result);
     }
 
     brls::Logger::info("Client: Start pairing stage #5");
 
+    if (gs_pair_cancelled(cancel))
+        return gs_pair_cleanup(GS_CANCELLED, server, &result);
+
     snprintf(
         url, sizeof(url),
         "https://%s:%u/"
         "pair?uniqueid=%s&devicename=roth&updateState=1&phrase=pairchallenge",
-        server->serverInfo.address, server->httpsPort, unique_id.c_str());
-    if ((ret = http_request(url, &data, HTTPRequestTimeoutLong)) != GS_OK) {
+        url_host(server).c_str(), server->httpsPort, unique_id.c_str());
+    if ((ret = http_request(url, &data, HTTPRequestTimeoutLong, cancel)) != GS_OK) {
         return gs_pair_cleanup(ret, server, &result);
     }
 
-    if ((ret = gs_pair_validate(data, &result) != GS_OK)) {
+    if ((ret = gs_pair_validate(data, &result)) != GS_OK) {
         return gs_pair_cleanup(ret, server, &result);
     }
 
@@ -449,20 +549,22 @@ int gs_pair(PSERVER_DATA server, char* pin) {
     return gs_pair_cleanup(ret, server, &result);
 }
 
-int gs_applist(PSERVER_DATA server, PAPP_LIST* list) {
-    int ret = GS_OK;
+int gs_applist(PSERVER_DATA server, XmlAppCallback callback) {
     char url[4096];
-    Data data;
 
     snprintf(url, sizeof(url), "https://%s:%u/applist?uniqueid=%s",
-             server->serverInfo.address, server->httpsPort, unique_id.c_str());
+             url_host(server).c_str(), server->httpsPort, unique_id.c_str());
+
+    // Parse runs in curl write callback, overlapping the download
+    xml_applist_stream* stream = xml_applist_begin(std::move(callback));
+    int request = http_request_stream(url, [stream](const char* data, size_t size) {
+        return xml_applist_feed(stream, data, size);
+    }, HTTPRequestTimeoutMedium);
 
-    if (http_request(url, &data, HTTPRequestTimeoutMedium) != GS_OK)
+    // Malformed document is what stops the transfer early
+    int ret = xml_applist_end(stream);
+    if (ret != GS_INVALID && request != GS_OK)
         ret = GS_IO_ERROR;
-    else if (xml_status(data) == GS_ERROR)
-        ret = GS_ERROR;
-    else if (xml_applist(data, list) != GS_OK)
-        ret = GS_INVALID;
     return ret;
 }
 
@@ -474,7 +576,7 @@ int gs_app_boxart(PSERVER_DATA server, int app_id, Data* out) {
     snprintf(
         url, sizeof(url),
         "https://%s:%u/appasset?uniqueid=%s&appid=%d&AssetType=2&AssetIdx=0",
-        server->serverInfo.address, server->httpsPort, unique_id.c_str(), app_id);
+        url_host(server).c_str(), server->httpsPort, unique_id.c_str(), app_id);
 
     if (http_request(url, &data, HTTPRequestTimeoutMedium) != GS_OK) {
         ret = GS_IO_ERROR;
@@ -484,10 +586,21 @@ int gs_app_boxart(PSERVER_DATA server, int app_id, Data* out) {
     return ret;
 }
 
+int gs_ping(PSERVER_DATA server) {
+    char url[4096];
+    Data data;
+
+    snprintf(url, sizeof(url), "http://%s:%u/serverinfo?uniqueid=%s",
+             url_host(server).c_str(), server->httpPort, unique_id.c_str());
+
+    return http_request(url, &data, HTTPRequestTimeoutLow) == GS_OK ? GS_OK : GS_IO_ERROR;
+}
+
 int gs_start_app(PSERVER_DATA server, STREAM_CONFIGURATION* config, int appId,
                  bool sops, bool localaudio, int gamepad_mask) {
     int ret = GS_OK;
     std::string result;
+    std::map<std::string, std::string> fields = {{"gamesession", ""}, {"sessionUrl0", ""}};
 
     if (config->height >= 2160 && !server->supports4K) {
         gs_set_error("4K not supported");
@@ -496,6 +609,8 @@ int gs_start_app(PSERVER_DATA server, STREAM_CONFIGURATION* config, int appId,
 
     Data rand = Data::random_bytes(16);
     memcpy(config->remoteInputAesKey, rand.bytes(), 16);
+    char rikey_hex[33];
+    Data::hex_encode(rand, rikey_hex, sizeof(rikey_hex));
 
     char url[4096];
     int rikeyid = 0;
@@ -516,15 +631,20 @@ int gs_start_app(PSERVER_DATA server, STREAM_CONFIGURATION* config, int appId,
                  "launch?uniqueid=%s&appid=%d&mode=%dx%dx%d&additionalStates=1&"
                  "sops=%d&rikey=%s&rikeyid=%d&localAudioPlayMode=%d&"
                  "surroundAudioInfo=%d&remoteControllersBitmap=%d&gcmap=%d%s",
-                 server->serverInfo.address, server->httpsPort, unique_id.c_str(), appId,
-                 config->width, config->height, fps, sops, rand.hex().bytes(),
+                 url_host(server).c_str(), server->httpsPort, unique_id.c_str(), appId,
+                 config->width, config->height, fps, sops, rikey_hex,
                  rikeyid, localaudio, (mask << 16) + channelCounnt,
                  gamepad_mask, gamepad_mask, LiGetLaunchUrlQueryParameters());
     } else {
+        // Sunshine takes new mode on resume, so stream can follow display,
+        // GFE keeps the one app was launched with
+        int fps = sops && config->fps > 60 ? 60 : config->fps;
         snprintf(url, sizeof(url),
-                 "https://%s:%u/resume?uniqueid=%s&rikey=%s&rikeyid=%d%s",
-                 server->serverInfo.address, server->httpsPort, unique_id.c_str(),
-                 rand.hex().bytes(), rikeyid, LiGetLaunchUrlQueryParameters());
+                 "https://%s:%u/resume?uniqueid=%s&rikey=%s&rikeyid=%d&"
+                 "mode=%dx%dx%d&additionalStates=1%s",
+                 url_host(server).c_str(), server->httpsPort, unique_id.c_str(),
+                 rikey_hex, rikeyid, config->width, config->height, fps,
+                 LiGetLaunchUrlQueryParameters());
     }
 
     if ((ret = http_request(url, &data, HTTPRequestTimeoutLong)) == GS_OK) {
@@ -533,18 +653,17 @@ int gs_start_app(PSERVER_DATA server, STREAM_CONFIGURATION* config, int appId,
         goto exit;
     }
 
-    if ((ret = xml_status(data) != GS_OK)) {
-        goto exit;
-    } else if ((ret = xml_search(data, "gamesession", &result)) != GS_OK) {
+    if ((ret = xml_fields(data, &fields)) != GS_OK) {
         goto exit;
     }
 
-    if (result == "0") {
+    if (fields["gamesession"] == "0") {
         ret = GS_FAILED;
         goto exit;
     }
 
-    if (xml_search(data, "sessionUrl0", &result) == GS_OK) {
+    result = fields["sessionUrl0"];
+    if (!result.empty()) {
         const std::string::size_type size = result.size();
         server->serverInfo.rtspSessionUrl = new char[size + 1];
         memcpy((void *) server->serverInfo.rtspSessionUrl, result.c_str(), size + 1);
@@ -559,21 +678,19 @@ exit:
 int gs_quit_app(PSERVER_DATA server) {
     int ret = GS_OK;
     char url[4096];
-    std::string result;
+    std::map<std::string, std::string> fields = {{"cancel", ""}};
     Data data;
 
     snprintf(url, sizeof(url), "https://%s:%u/cancel?uniqueid=%s",
-             server->serverInfo.address, server->httpsPort, unique_id.c_str());
+             url_host(server).c_str(), server->httpsPort, unique_id.c_str());
     if ((ret = http_request(url, &data, HTTPRequestTimeoutMedium)) != GS_OK)
         goto exit;
 
-    if ((ret = xml_status(data) != GS_OK)) {
-        goto exit;
-    } else if ((ret = xml_search(data, "cancel", &result)) != GS_OK) {
+    if ((ret = xml_fields(data, &fields)) != GS_OK) {
         goto exit;
     }
 
-    if (result == "0") {
+    if (fields["cancel"] == "0") {
         ret = GS_FAILED;
         goto exit;
     }
@@ -583,36 +700,30 @@ exit:
 }
 
 int gs_init(PSERVER_DATA server, const std::string address) {
-    std::stringstream addressStream(address);
-    std::string segment;
-    std::vector<std::string> seglist;
-    unsigned short httpPort = 47989; // Default HTTP port
-
-    while(std::getline(addressStream, segment, ':'))
-    {
-       seglist.push_back(segment);
-    }
-
-    // Override port if it presented
-    if (seglist.size() > 1) {
-        httpPort = atoi(seglist[1].c_str());
-    }
-    
-    if (!CryptoManager::load_cert_key_pair()) {
-        brls::Logger::info("Client: No certs, generate new...");
-
-        if (!CryptoManager::generate_new_cert_key_pair()) {
-            brls::Logger::info("Client: Failed to generate certs...");
-            return GS_FAILED;
+    // Default HTTP port, unless address has one
+    HostAddress host = HostAddress::parse(address, 47989);
+
+    // Name with addresses of both families goes to the one connecting
+    // first, moonlight-common-c would only try the first one it resolves
+    std::vector<HostAddress> candidates = host.resolve();
+    if (candidates.size() > 1) {
+        int winner = host_connect_race(candidates, GS_CONNECT_RACE_TIMEOUT_MS);
+        if (winner >= 0) {
+            brls::Logger::info("gs_init: {} connected over {}", address, candidates[winner].host);
+            host.host = candidates[winner].host;
         }
     }
 
+    // Without key pair HTTPS request fails and serverinfo comes over
+    // HTTP, which is right, as nothing could be paired yet
+    gs_prepare_cert_key_pair();
+
     http_init(Settings::instance().key_dir());
 
     LiInitializeServerInformation(&server->serverInfo);
-    server->address = seglist[0];
+    server->address = host.host;
     server->serverInfo.address = server->address.c_str();
-    server->httpPort = httpPort;
+    server->httpPort = host.port;
     server->httpsPort = 0; /* Populated by load_server_status() */
 
     int result = load_server_status(server);
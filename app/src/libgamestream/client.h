@@ -22,6 +22,7 @@
 #include "Data.hpp"
 #include "xml.h"
 #include <Limelight.h>
+#include <atomic>
 #include <stdbool.h>
 
 #define MIN_SUPPORTED_GFE_VERSION 3
@@ -42,16 +43,28 @@ typedef struct _SERVER_DATA {
     SERVER_INFORMATION serverInfo;
     unsigned short httpPort;
     unsigned short httpsPort;
-    bool isSunshine();
+    bool isSunshine() const;
 } SERVER_DATA, *PSERVER_DATA;
 
 void gs_set_error(std::string error);
 std::string gs_error();
 
+// Loads client key pair, or starts generating it in background when there
+// is none yet. Hosts are queried over HTTP only until it's done
+void gs_prepare_cert_key_pair();
+// Blocks until key pair generation has finished
+bool gs_wait_cert_key_pair();
+
 int gs_init(PSERVER_DATA server, const std::string address);
 int gs_app_boxart(PSERVER_DATA server, int app_id, Data* out);
+// Smallest request host answers, for measuring round trip
+int gs_ping(PSERVER_DATA server);
 int gs_start_app(PSERVER_DATA server, PSTREAM_CONFIGURATION config, int appId, bool sops, bool localaudio, int gamepad_mask);
-int gs_applist(PSERVER_DATA server, PAPP_LIST* app_list);
+// Apps are handed to callback while list downloads, results must be
+// dropped unless GS_OK is returned
+int gs_applist(PSERVER_DATA server, XmlAppCallback callback);
 int gs_unpair(PSERVER_DATA server);
-int gs_pair(PSERVER_DATA server, char* pin);
+// Cancel is polled by pending request and between stages, pairing is
+// undone on host when it stops half way
+int gs_pair(PSERVER_DATA server, char* pin, const std::atomic<bool>* cancel = nullptr);
 int gs_quit_app(PSERVER_DATA server);
@@ -30,3 +30,4 @@
 #define GS_NOT_SUPPORTED_MODE -8
 #define GS_ERROR -9
 #define GS_NOT_SUPPORTED_SOPS_RESOLUTION -10
+#define GS_CANCELLED -11
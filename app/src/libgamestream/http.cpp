@@ -21,30 +21,231 @@
 #include "CryptoManager.hpp"
 #include "client.h"
 #include "errors.h"
+#include "HighResClock.hpp"
+#include "HostAddress.hpp"
+#include "Log.hpp"
+#include "MemoryAccounting.hpp"
 #include <borealis/core/logger.hpp>
 
 #include <curl/curl.h>
+#include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+// Idle handles kept per host, each one holds its own open connection
+#define HTTP_POOL_MAX_IDLE 4
+
+// Connect limit is smoothed connect time plus four deviations, as TCP
+// computes its retransmit timeout, unknown hosts get the default one
+#define HTTP_CONNECT_TIMEOUT_DEFAULT_MS 800
+#define HTTP_CONNECT_TIMEOUT_MIN_MS 250
+#define HTTP_CONNECT_TIMEOUT_MAX_MS 3000
+// Host which didn't connect is failed without a request for this long,
+// doubled with every next failure
+#define HTTP_OFFLINE_BACKOFF_MIN_MS 2000
+#define HTTP_OFFLINE_BACKOFF_MAX_MS 16000
+
+// CURLOPT_SSLCERT_BLOB and CURLOPT_SSLKEY_BLOB appeared in 7.71.0
+#if LIBCURL_VERSION_NUM >= 0x074700
+#define HTTP_USE_CREDENTIAL_BLOBS
+#endif
 
 static bool curlGlobalInit = false;
 static std::string certificateFilePath;
 static std::string keyFilePath;
 
+static std::mutex credentialsMutex;
+static Data credentialsCert;
+static Data credentialsKey;
+
+// DNS and TLS sessions are shared between all handles, so even a fresh
+// handle resumes the session instead of full handshake with client cert
+static CURLSH* curlShare = nullptr;
+static std::mutex curlShareLocks[CURL_LOCK_DATA_LAST];
+
+struct CurlDeleter {
+    void operator()(CURL* curl) const { curl_easy_cleanup(curl); }
+};
+using CurlPtr = std::unique_ptr<CURL, CurlDeleter>;
+
+static std::mutex curlPoolMutex;
+static std::map<std::string, std::vector<CurlPtr>> curlPool;
+
 CURL* makeCurl();
-void freeCurl(CURL* curl);
+
+struct HostHealth {
+    // Connect times in ms, 0 until first fresh connection
+    float connect_ms = 0;
+    float connect_deviation_ms = 0;
+    uint32_t failures = 0;
+    uint64_t offline_until_us = 0;
+};
+
+static std::mutex hostHealthMutex;
+static std::map<std::string, HostHealth> hostHealth;
+
+// Hosts served without TLS, only mock host of benchmarks
+static std::mutex plaintextMutex;
+static std::set<std::string> plaintextHosts;
+
+static void _lock_share(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr) {
+    curlShareLocks[data].lock();
+}
+
+static void _unlock_share(CURL* handle, curl_lock_data data, void* userptr) {
+    curlShareLocks[data].unlock();
+}
+
+// Returns scheme://host:port part of url, which is what connection is bound to
+static std::string pool_key(const std::string& url) {
+    size_t scheme_end = url.find("://");
+    if (scheme_end == std::string::npos)
+        return url;
+    return url.substr(0, url.find('/', scheme_end + 3));
+}
+
+// Address part of url, HTTP and HTTPS ports of host share its health
+static std::string host_key(const std::string& url) {
+    size_t start = url.find("://");
+    start = start == std::string::npos ? 0 : start + 3;
+    size_t end = url.find('/', start);
+    std::string host = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    return HostAddress::parse(host, 0).url_host();
+}
+
+// URL curl is given, https is dropped for plaintext hosts
+static std::string _request_url(const std::string& url) {
+    if (url.compare(0, 8, "https://") != 0)
+        return url;
+
+    std::lock_guard<std::mutex> lock(plaintextMutex);
+    if (plaintextHosts.empty() || !plaintextHosts.count(host_key(url)))
+        return url;
+    return "http://" + url.substr(8);
+}
+
+void http_set_plaintext_host(const std::string& address, bool plaintext) {
+    std::lock_guard<std::mutex> lock(plaintextMutex);
+    std::string host = HostAddress::parse(address, 0).url_host();
+    if (plaintext)
+        plaintextHosts.insert(host);
+    else
+        plaintextHosts.erase(host);
+}
+
+// Returns false when host is still backed off, sets connect limit otherwise
+static bool _prepare_host(CURL* curl, const std::string& host, HTTPRequestTimeout timeout) {
+    long connect_ms = HTTP_CONNECT_TIMEOUT_DEFAULT_MS;
+    {
+        std::lock_guard<std::mutex> lock(hostHealthMutex);
+        auto& health = hostHealth[host];
+        if (timeout != HTTPRequestTimeoutLong && HighResClock::now_us() < health.offline_until_us)
+            return false;
+        if (health.connect_ms > 0)
+            connect_ms = std::clamp((long)(health.connect_ms + 4 * health.connect_deviation_ms),
+                                    (long)HTTP_CONNECT_TIMEOUT_MIN_MS, (long)HTTP_CONNECT_TIMEOUT_MAX_MS);
+    }
+
+    // Long requests are user actions, e.g. connecting after wake up
+    if (timeout == HTTPRequestTimeoutLong)
+        connect_ms = std::max(connect_ms, (long)HTTP_CONNECT_TIMEOUT_MAX_MS);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, connect_ms);
+    return true;
+}
+
+static void _update_host(CURL* curl, const std::string& host, CURLcode res) {
+    curl_off_t connect_us = 0;
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect_us);
+
+    std::lock_guard<std::mutex> lock(hostHealthMutex);
+    auto& health = hostHealth[host];
+
+    // Nothing came back from host, later requests fail right away
+    if (res == CURLE_COULDNT_CONNECT || (res == CURLE_OPERATION_TIMEDOUT && connect_us == 0)) {
+        uint64_t backoff = std::min<uint64_t>((uint64_t)HTTP_OFFLINE_BACKOFF_MIN_MS << std::min(health.failures, 8u),
+                                              HTTP_OFFLINE_BACKOFF_MAX_MS);
+        health.failures++;
+        health.offline_until_us = HighResClock::now_us() + backoff * 1000;
+        CLOG_DEBUG(LOG_NET, "Curl: {} is offline, next try in {} ms", host, backoff);
+        return;
+    }
+
+    health.failures = 0;
+    health.offline_until_us = 0;
+
+    // Reused connection reports no connect time
+    if (connect_us <= 0)
+        return;
+    float sample = (float)connect_us / 1000.0f;
+    if (health.connect_ms == 0) {
+        health.connect_ms = sample;
+        health.connect_deviation_ms = sample / 2;
+    } else {
+        health.connect_deviation_ms += (std::abs(sample - health.connect_ms) - health.connect_deviation_ms) / 4;
+        health.connect_ms += (sample - health.connect_ms) / 8;
+    }
+}
+
+void http_host_reachable(const std::string& address) {
+    std::lock_guard<std::mutex> lock(hostHealthMutex);
+    auto it = hostHealth.find(HostAddress::parse(address, 0).url_host());
+    if (it != hostHealth.end()) {
+        it->second.failures = 0;
+        it->second.offline_until_us = 0;
+    }
+}
 
 struct HTTP_DATA {
     char* memory;
     size_t size;
+    size_t capacity;
+    bool out_of_memory;
+    CURL* curl;
 };
 
+// Reserves whole body when server sent Content-Length, otherwise grows
+// buffer geometrically, so large box art isn't reallocated on every chunk
+static bool _reserve(HTTP_DATA* mem, size_t required) {
+    if (required <= mem->capacity)
+        return true;
+
+    size_t capacity = std::max(mem->capacity * 2, required);
+    if (mem->capacity == 0) {
+        curl_off_t length = -1;
+        curl_easy_getinfo(mem->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+        if (length > 0)
+            capacity = std::max(capacity, (size_t)length + 1);
+    }
+
+    auto* memory = (char*)realloc(mem->memory, capacity);
+    if (memory == NULL) {
+        mem->out_of_memory = true;
+        return false;
+    }
+
+    MemoryAccounting::add(MEM_HTTP, capacity - mem->capacity);
+    mem->memory = memory;
+    mem->capacity = capacity;
+    return true;
+}
+
+// Body is freed or handed over to Data, which counts it on its own
+static void _release(HTTP_DATA* mem) {
+    MemoryAccounting::remove(MEM_HTTP, mem->capacity);
+    mem->capacity = 0;
+}
+
 static size_t _write_curl(void* contents, size_t size, size_t nmemb,
                           void* userp) {
     size_t realsize = size * nmemb;
     auto* mem = (HTTP_DATA*)userp;
 
-    mem->memory = (char*)realloc(mem->memory, mem->size + realsize + 1);
-    if (mem->memory == NULL)
+    if (!_reserve(mem, mem->size + realsize + 1))
         return 0;
 
     memcpy(&(mem->memory[mem->size]), contents, realsize);
@@ -53,6 +254,77 @@ static size_t _write_curl(void* contents, size_t size, size_t nmemb,
     return realsize;
 }
 
+struct HTTP_STREAM {
+    const HTTPConsumer* consumer;
+    size_t size;
+    bool aborted;
+};
+
+static size_t _write_curl_stream(void* contents, size_t size, size_t nmemb,
+                                 void* userp) {
+    size_t realsize = size * nmemb;
+    auto* stream = (HTTP_STREAM*)userp;
+
+    if (!(*stream->consumer)((const char*)contents, realsize)) {
+        stream->aborted = true;
+        return 0;
+    }
+
+    stream->size += realsize;
+    return realsize;
+}
+
+// Progress callback, called about once a second while host is silent
+static int _cancel_curl(void* userp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal,
+                        curl_off_t ulnow) {
+    return ((const std::atomic<bool>*)userp)->load() ? 1 : 0;
+}
+
+// Handle of one request, taken from pool of its host and given back on
+// every return path, or freed when pool is full
+class PooledCurl {
+  public:
+    explicit PooledCurl(const std::string& key) : m_key(key) {
+        {
+            std::lock_guard<std::mutex> lock(curlPoolMutex);
+            auto& handles = curlPool[key];
+            if (!handles.empty()) {
+                m_curl = std::move(handles.back());
+                handles.pop_back();
+                return;
+            }
+        }
+        m_curl.reset(makeCurl());
+    }
+
+    ~PooledCurl() {
+        if (!m_curl)
+            return;
+
+        // Handle doesn't point to request data after it goes back to pool,
+        // pooled handles are expected to collect body for http_request
+        curl_easy_setopt(m_curl.get(), CURLOPT_WRITEFUNCTION, _write_curl);
+        curl_easy_setopt(m_curl.get(), CURLOPT_WRITEDATA, nullptr);
+        curl_easy_setopt(m_curl.get(), CURLOPT_NOPROGRESS, 1L);
+        curl_easy_setopt(m_curl.get(), CURLOPT_XFERINFODATA, nullptr);
+
+        // Curl drops broken connection itself, handle is still reusable
+        std::lock_guard<std::mutex> lock(curlPoolMutex);
+        auto& handles = curlPool[m_key];
+        if (handles.size() < HTTP_POOL_MAX_IDLE)
+            handles.push_back(std::move(m_curl));
+    }
+
+    PooledCurl(const PooledCurl&) = delete;
+    PooledCurl& operator=(const PooledCurl&) = delete;
+
+    [[nodiscard]] CURL* get() const { return m_curl.get(); }
+
+  private:
+    std::string m_key;
+    CurlPtr m_curl;
+};
+
 int http_init(const std::string& key_directory) {
     if (!curlGlobalInit) {
 #if LIBCURL_VERSION_NUM >= 0x075600
@@ -64,6 +336,14 @@ int http_init(const std::string& key_directory) {
 #endif
         curl_global_init(CURL_GLOBAL_ALL);
         brls::Logger::info("Curl: {}", curl_version());
+
+        curlShare = curl_share_init();
+        if (curlShare) {
+            curl_share_setopt(curlShare, CURLSHOPT_LOCKFUNC, _lock_share);
+            curl_share_setopt(curlShare, CURLSHOPT_UNLOCKFUNC, _unlock_share);
+            curl_share_setopt(curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            curl_share_setopt(curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        }
     } else {
         return GS_OK;
     }
@@ -75,76 +355,168 @@ int http_init(const std::string& key_directory) {
     return GS_OK;
 }
 
+void http_set_credentials(const Data& cert, const Data& key) {
+    std::lock_guard<std::mutex> lock(credentialsMutex);
+    credentialsCert = cert;
+    credentialsKey = key;
+}
+
+// Set for every request, as pooled handles could be made before key pair
+// was ready. Same content doesn't prevent connection reuse
+static void _apply_credentials(CURL* curl) {
+#ifdef HTTP_USE_CREDENTIAL_BLOBS
+    std::lock_guard<std::mutex> lock(credentialsMutex);
+    if (credentialsCert.is_empty() || credentialsKey.is_empty())
+        return;
+
+    struct curl_blob cert = {credentialsCert.bytes(), credentialsCert.size(), CURL_BLOB_COPY};
+    struct curl_blob key = {credentialsKey.bytes(), credentialsKey.size(), CURL_BLOB_COPY};
+    curl_easy_setopt(curl, CURLOPT_SSLCERT_BLOB, &cert);
+    curl_easy_setopt(curl, CURLOPT_SSLKEY_BLOB, &key);
+#endif
+}
+
 CURL* makeCurl() {
     auto curl = curl_easy_init();
 
     if (!curl)
         return nullptr;
 
-    curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
     curl_easy_setopt(curl, CURLOPT_SSLENGINE_DEFAULT, 1L);
     curl_easy_setopt(curl, CURLOPT_SSLCERTTYPE, "PEM");
-    curl_easy_setopt(curl, CURLOPT_SSLCERT, certificateFilePath.c_str());
     curl_easy_setopt(curl, CURLOPT_SSLKEYTYPE, "PEM");
+#ifndef HTTP_USE_CREDENTIAL_BLOBS
+    curl_easy_setopt(curl, CURLOPT_SSLCERT, certificateFilePath.c_str());
     curl_easy_setopt(curl, CURLOPT_SSLKEY, keyFilePath.c_str());
+#endif
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, _write_curl);
     curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
-    curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    if (curlShare)
+        curl_easy_setopt(curl, CURLOPT_SHARE, curlShare);
 
     return curl;
 }
 
-void freeCurl(CURL* curl) {
-    curl_easy_cleanup(curl);
-}
+int http_request(const std::string& request_url, Data* data,
+                 HTTPRequestTimeout timeout, const std::atomic<bool>* cancel) {
+    CLOG_DEBUG(LOG_NET, "Curl: Request:\n{}", request_url.c_str());
 
-int http_request(const std::string& url, Data* data,
-                 HTTPRequestTimeout timeout) {
-    brls::Logger::info("Curl: Request:\n{}", url.c_str());
+    std::string url = _request_url(request_url);
+    PooledCurl pooled(pool_key(url));
+    CURL* curl = pooled.get();
+    if (!curl) return GS_FAILED;
 
-    auto* http_data = (HTTP_DATA*)malloc(sizeof(HTTP_DATA));
-    http_data->memory = (char*)malloc(1);
-    http_data->size = 0;
+    std::string host = host_key(url);
+    if (!_prepare_host(curl, host, timeout)) {
+        gs_set_error("Host is offline");
+        return GS_IO_ERROR;
+    }
 
-    auto curl = makeCurl();
-    if (!curl) return GS_FAILED;
+    HTTP_DATA http_data = {nullptr, 0, 0, false, curl};
 
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, http_data);
+    _apply_credentials(curl);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &http_data);
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
     curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
+    if (cancel) {
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, _cancel_curl);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, cancel);
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    }
 
     CURLcode res = curl_easy_perform(curl);
+    if (res == CURLE_ABORTED_BY_CALLBACK) {
+        // Host isn't taken as offline, user stopped waiting for it
+        gs_set_error("Request cancelled");
+        CLOG_INFO(LOG_NET, "Curl: Request cancelled");
+        _release(&http_data);
+        free(http_data.memory);
+        return GS_CANCELLED;
+    }
+    _update_host(curl, host, res);
 
-    if (res != CURLE_OK) {
+    if (http_data.out_of_memory) {
+        CLOG_ERROR(LOG_NET, "Curl: memory = NULL");
+        _release(&http_data);
+        free(http_data.memory);
+        return GS_OUT_OF_MEMORY;
+    } else if (res != CURLE_OK) {
         gs_set_error(curl_easy_strerror(res));
-        brls::Logger::error("Curl: error: {}", gs_error().c_str());
-        free(http_data->memory);
-        free(http_data);
+        CLOG_ERROR(LOG_NET, "Curl: error: {}", gs_error().c_str());
+        _release(&http_data);
+        free(http_data.memory);
         return GS_FAILED;
-    } else if (http_data->memory == nullptr) {
-        brls::Logger::error("Curl: memory = NULL");
-        free(http_data->memory);
-        free(http_data);
-        return GS_OUT_OF_MEMORY;
     }
 
-    *data = Data(http_data->memory, http_data->size);
-
-    if (http_data->size > 3000) {
-        brls::Logger::info("Curl: Response: Ok");
+    // Bodies are serverinfo and applist XML, only worth it when debugging
+    if (http_data.size > 3000) {
+        CLOG_DEBUG(LOG_NET, "Curl: Response: Ok");
     } else {
-        brls::Logger::info("Curl: Response:\n{}", http_data->memory);
+        CLOG_DEBUG(LOG_NET, "Curl: Response:\n{}", http_data.memory ? http_data.memory : "");
     }
 
-    free(http_data->memory);
-    free(http_data);
-    freeCurl(curl);
+    // Buffer goes to Data as is, without copying body once more
+    _release(&http_data);
+    *data = Data::adopt((unsigned char*)http_data.memory, http_data.size);
 
     return GS_OK;
 }
 
+int http_request_stream(const std::string& request_url, const HTTPConsumer& consumer,
+                        HTTPRequestTimeout timeout) {
+    CLOG_DEBUG(LOG_NET, "Curl: Streamed request:\n{}", request_url.c_str());
+
+    std::string url = _request_url(request_url);
+    PooledCurl pooled(pool_key(url));
+    CURL* curl = pooled.get();
+    if (!curl) return GS_FAILED;
+
+    std::string host = host_key(url);
+    if (!_prepare_host(curl, host, timeout)) {
+        gs_set_error("Host is offline");
+        return GS_IO_ERROR;
+    }
+
+    HTTP_STREAM stream = {&consumer, 0, false};
+
+    _apply_credentials(curl);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, _write_curl_stream);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &stream);
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
+
+    CURLcode res = curl_easy_perform(curl);
+    _update_host(curl, host, res);
+
+    if (stream.aborted) {
+        CLOG_ERROR(LOG_NET, "Curl: Consumer stopped after {} bytes", stream.size);
+        return GS_FAILED;
+    } else if (res != CURLE_OK) {
+        gs_set_error(curl_easy_strerror(res));
+        CLOG_ERROR(LOG_NET, "Curl: error: {}", gs_error().c_str());
+        return GS_FAILED;
+    }
+
+    CLOG_DEBUG(LOG_NET, "Curl: Response: Ok, {} bytes streamed", stream.size);
+    return GS_OK;
+}
+
 void http_cleanup() {
+    {
+        std::lock_guard<std::mutex> lock(curlPoolMutex);
+        curlPool.clear();
+    }
+
+    if (curlShare) {
+        curl_share_cleanup(curlShare);
+        curlShare = nullptr;
+    }
+
     curl_global_cleanup();
+    curlGlobalInit = false;
 }
\ No newline at end of file
@@ -20,6 +20,8 @@
 #pragma once
 
 #include "Data.hpp"
+#include <atomic>
+#include <functional>
 
 enum HTTPRequestTimeout : long {
     HTTPRequestTimeoutLow = 1,
@@ -28,5 +30,23 @@ enum HTTPRequestTimeout : long {
 };
 
 int http_init(const std::string& key_directory);
-int http_request(const std::string& url, Data* data, HTTPRequestTimeout timeout);
+// Client certificate and key in PEM, kept in memory and handed to curl
+// as blobs where it supports them, instead of being read from files
+void http_set_credentials(const Data& cert, const Data& key);
+// Timeout bounds the whole transfer, connecting has a shorter limit of
+// its own from host's connect times. Hosts which didn't answer are failed
+// right away for a growing backoff, except for long user actions.
+// Transfer is aborted with GS_CANCELLED within a second of cancel set
+int http_request(const std::string& url, Data* data, HTTPRequestTimeout timeout,
+                 const std::atomic<bool>* cancel = nullptr);
+// Body goes to consumer chunk by chunk as it arrives instead of being
+// collected, consumer returns false to abort the transfer
+using HTTPConsumer = std::function<bool(const char* data, size_t size)>;
+int http_request_stream(const std::string& url, const HTTPConsumer& consumer, HTTPRequestTimeout timeout);
+// Forgets that host was offline, when something else found it up.
+// Address is taken as saved, with or without port
+void http_host_reachable(const std::string& address);
+// Requests to address go over plain HTTP whatever their scheme is, for
+// mock host of benchmarks, which has no TLS
+void http_set_plaintext_host(const std::string& address, bool plaintext);
 
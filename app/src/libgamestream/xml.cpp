@@ -31,8 +31,26 @@ struct xml_query {
     size_t size;
     int start;
     void* data;
+    int status;
 };
 
+struct xml_fields_query {
+    std::map<std::string, std::string>* fields;
+    std::string* current;
+    int status;
+};
+
+static void _xml_parse_status(const char** atts, int* status) {
+    for (int i = 0; atts[i]; i += 2) {
+        if (strcmp("status_code", atts[i]) == 0) {
+            *status = atoi(atts[i + 1]);
+        } else if (*status != STATUS_OK &&
+                   strcmp("status_message", atts[i]) == 0) {
+            gs_set_error(atts[i + 1]);
+        }
+    }
+}
+
 static void XMLCALL _xml_start_element(void* userData, const char* name,
                                        const char** atts) {
     struct xml_query* search = (struct xml_query*)userData;
@@ -48,59 +66,38 @@ static void XMLCALL _xml_end_element(void* userData, const char* name) {
     }
 }
 
-static void XMLCALL _xml_start_applist_element(void* userData, const char* name,
-                                               const char** atts) {
-    struct xml_query* search = (struct xml_query*)userData;
-    if (strcmp("App", name) == 0) {
-        PAPP_LIST app = (PAPP_LIST)malloc(sizeof(APP_LIST));
-        if (app == NULL) {
-            return;
-        }
-
-        app->id = 0;
-        app->name = NULL;
-        app->next = (PAPP_LIST)search->data;
-        search->data = app;
-    } else if (strcmp("ID", name) == 0 || strcmp("AppTitle", name) == 0) {
-        search->memory = (char*)malloc(1);
-        search->size = 0;
-        search->start = 1;
+static void XMLCALL _xml_start_status_element(void* userData, const char* name,
+                                              const char** atts) {
+    if (strcmp("root", name) == 0) {
+        _xml_parse_status(atts, (int*)userData);
     }
 }
 
-static void XMLCALL _xml_end_applist_element(void* userData, const char* name) {
-    struct xml_query* search = (struct xml_query*)userData;
-    if (search->start) {
-        PAPP_LIST list = (PAPP_LIST)search->data;
-        if (list == NULL)
-            return;
-
-        if (strcmp("ID", name) == 0) {
-            list->id = atoi(search->memory);
-            free(search->memory);
-        } else if (strcmp("AppTitle", name) == 0) {
-            list->name = search->memory;
-        }
-        search->start = 0;
-    }
-}
+static void XMLCALL _xml_end_status_element(void* userData, const char* name) {}
 
-static void XMLCALL _xml_start_status_element(void* userData, const char* name,
+static void XMLCALL _xml_start_fields_element(void* userData, const char* name,
                                               const char** atts) {
+    struct xml_fields_query* query = (struct xml_fields_query*)userData;
     if (strcmp("root", name) == 0) {
-        int* status = (int*)userData;
-        for (int i = 0; atts[i]; i += 2) {
-            if (strcmp("status_code", atts[i]) == 0) {
-                *status = atoi(atts[i + 1]);
-            } else if (*status != STATUS_OK &&
-                       strcmp("status_message", atts[i]) == 0) {
-                gs_set_error(strdup(atts[i + 1]));
-            }
-        }
+        _xml_parse_status(atts, &query->status);
+        return;
     }
+
+    auto field = query->fields->find(name);
+    query->current = field != query->fields->end() ? &field->second : NULL;
 }
 
-static void XMLCALL _xml_end_status_element(void* userData, const char* name) {}
+static void XMLCALL _xml_end_fields_element(void* userData, const char* name) {
+    // Requested tags are leaf ones, so any closing tag ends the value
+    ((struct xml_fields_query*)userData)->current = NULL;
+}
+
+static void XMLCALL _xml_write_fields_data(void* userData, const XML_Char* s,
+                                           int len) {
+    struct xml_fields_query* query = (struct xml_fields_query*)userData;
+    if (query->current)
+        query->current->append(s, len);
+}
 
 static void XMLCALL _xml_write_data(void* userData, const XML_Char* s,
                                     int len) {
@@ -153,29 +150,97 @@ int xml_search(const Data& data, const std::string node, std::string* result) {
     return GS_OK;
 }
 
-int xml_applist(const Data& data, PAPP_LIST* app_list) {
-    struct xml_query query;
-    query.memory = (char*)calloc(1, 1);
-    query.size = 0;
-    query.start = 0;
-    query.data = NULL;
+struct xml_applist_stream {
+    XML_Parser parser;
+    XmlAppCallback callback;
+    int status;
+    bool in_app;
+    // 0 outside of fields, 1 in ID, 2 in AppTitle
+    int field;
+    int id;
+    // Reused for every field, keeps its capacity over whole list
+    std::string text;
+    std::string name;
+    XML_Error error;
+};
 
-    XML_Parser parser = XML_ParserCreate("UTF-8");
-    XML_SetUserData(parser, &query);
-    XML_SetElementHandler(parser, _xml_start_applist_element,
+static void XMLCALL _xml_start_applist_element(void* userData, const char* name,
+                                               const char** atts) {
+    auto* stream = (struct xml_applist_stream*)userData;
+    if (strcmp("root", name) == 0) {
+        _xml_parse_status(atts, &stream->status);
+    } else if (strcmp("App", name) == 0) {
+        stream->in_app = true;
+        stream->id = 0;
+        stream->name.clear();
+    } else if (stream->in_app && (strcmp("ID", name) == 0 || strcmp("AppTitle", name) == 0)) {
+        stream->field = name[0] == 'I' ? 1 : 2;
+        stream->text.clear();
+    }
+}
+
+static void XMLCALL _xml_end_applist_element(void* userData, const char* name) {
+    auto* stream = (struct xml_applist_stream*)userData;
+    if (stream->field) {
+        if (stream->field == 1)
+            stream->id = atoi(stream->text.c_str());
+        else
+            stream->name.assign(stream->text);
+        stream->field = 0;
+    } else if (stream->in_app && strcmp("App", name) == 0) {
+        stream->in_app = false;
+        stream->callback(stream->id, stream->name.c_str(), stream->name.size());
+    }
+}
+
+static void XMLCALL _xml_write_applist_data(void* userData, const XML_Char* s,
+                                            int len) {
+    auto* stream = (struct xml_applist_stream*)userData;
+    if (stream->field)
+        stream->text.append(s, len);
+}
+
+xml_applist_stream* xml_applist_begin(XmlAppCallback callback) {
+    auto* stream = new xml_applist_stream();
+    stream->parser = XML_ParserCreate("UTF-8");
+    stream->callback = std::move(callback);
+    stream->status = 0;
+    stream->in_app = false;
+    stream->field = 0;
+    stream->id = 0;
+    stream->error = XML_ERROR_NONE;
+
+    XML_SetUserData(stream->parser, stream);
+    XML_SetElementHandler(stream->parser, _xml_start_applist_element,
                           _xml_end_applist_element);
-    XML_SetCharacterDataHandler(parser, _xml_write_data);
+    XML_SetCharacterDataHandler(stream->parser, _xml_write_applist_data);
+    return stream;
+}
 
-    if (!XML_Parse(parser, (const char*)data.bytes(), (int)data.size(), 1)) {
-        XML_Error code = XML_GetErrorCode(parser);
-        gs_set_error(XML_ErrorString(code));
-        XML_ParserFree(parser);
-        return GS_INVALID;
+bool xml_applist_feed(xml_applist_stream* stream, const char* data, size_t size) {
+    if (stream->error != XML_ERROR_NONE)
+        return false;
+
+    if (!XML_Parse(stream->parser, data, (int)size, 0)) {
+        stream->error = XML_GetErrorCode(stream->parser);
+        return false;
     }
+    return true;
+}
 
-    XML_ParserFree(parser);
-    *app_list = (PAPP_LIST)query.data;
-    return GS_OK;
+int xml_applist_end(xml_applist_stream* stream) {
+    if (stream->error == XML_ERROR_NONE && !XML_Parse(stream->parser, nullptr, 0, 1))
+        stream->error = XML_GetErrorCode(stream->parser);
+
+    int ret = stream->status == STATUS_OK ? GS_OK : GS_ERROR;
+    if (stream->error != XML_ERROR_NONE) {
+        gs_set_error(XML_ErrorString(stream->error));
+        ret = GS_INVALID;
+    }
+
+    XML_ParserFree(stream->parser);
+    delete stream;
+    return ret;
 }
 
 int xml_status(const Data& data) {
@@ -195,3 +260,26 @@ int xml_status(const Data& data) {
     XML_ParserFree(parser);
     return status == STATUS_OK ? GS_OK : GS_ERROR;
 }
+
+int xml_fields(const Data& data, std::map<std::string, std::string>* fields) {
+    struct xml_fields_query query;
+    query.fields = fields;
+    query.current = NULL;
+    query.status = 0;
+
+    XML_Parser parser = XML_ParserCreate("UTF-8");
+    XML_SetUserData(parser, &query);
+    XML_SetElementHandler(parser, _xml_start_fields_element,
+                          _xml_end_fields_element);
+    XML_SetCharacterDataHandler(parser, _xml_write_fields_data);
+
+    if (!XML_Parse(parser, (const char*)data.bytes(), (int)data.size(), 1)) {
+        XML_Error code = XML_GetErrorCode(parser);
+        gs_set_error(XML_ErrorString(code));
+        XML_ParserFree(parser);
+        return GS_INVALID;
+    }
+
+    XML_ParserFree(parser);
+    return query.status == STATUS_OK ? GS_OK : GS_ERROR;
+}
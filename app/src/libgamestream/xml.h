@@ -18,15 +18,27 @@
  */
 
 #include "Data.hpp"
+#include <functional>
+#include <map>
+#include <string>
 #pragma once
 
-typedef struct _APP_LIST {
-    char* name;
-    int id;
-    struct _APP_LIST* next;
-} APP_LIST, *PAPP_LIST;
+// Called for every app once its element closes, name is valid only
+// during the call
+using XmlAppCallback = std::function<void(int id, const char* name, size_t name_size)>;
 
 int xml_search(const Data& data, const std::string node, int* result);
 int xml_search(const Data& data, const std::string node, std::string* result);
-int xml_applist(const Data& data, PAPP_LIST* app_list);
 int xml_status(const Data& data);
+
+// Fills text of every tag listed as key in fields and checks root status
+// with a single parse, returns GS_ERROR when server reported failure
+int xml_fields(const Data& data, std::map<std::string, std::string>* fields);
+
+// Applist is parsed in chunks while it downloads. Feed returns false once
+// document is malformed, end frees parser and returns GS_OK, GS_ERROR
+// when server reported failure or GS_INVALID
+struct xml_applist_stream;
+xml_applist_stream* xml_applist_begin(XmlAppCallback callback);
+bool xml_applist_feed(xml_applist_stream* stream, const char* data, size_t size);
+int xml_applist_end(xml_applist_stream* stream);
@@ -6,11 +6,12 @@
 //
 
 #include "link_cell.hpp"
+#include "ViewTemplates.hpp"
 
 using namespace brls;
 
 LinkCell::LinkCell() {
-    this->inflateFromXMLRes("xml/cells/link_cell.xml");
+    ViewTemplates::instance().inflate(this, "xml/cells/link_cell.xml");
 
     icon->setText("\uE099");
 }
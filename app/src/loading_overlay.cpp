@@ -44,4 +44,6 @@ void LoadingOverlay::layout() {
 void LoadingOverlay::setHidden(bool hide) {
     setAlpha(hide ? 0 : 1);
     progress->animate(!hide);
+    // Hidden overlay still spans its holder, so it's left out of layout
+    setVisibility(hide ? brls::Visibility::GONE : brls::Visibility::VISIBLE);
 }
@@ -22,9 +22,31 @@
 #include "main_tabs_view.hpp"
 #include "settings_tab.hpp"
 
+#include "AudrenDevice.hpp"
+#include "BoxArtManager.hpp"
+#include "DecoderCapabilities.hpp"
 #include "DiscoverManager.hpp"
+#include "GameStreamClient.hpp"
+#include "HostPinger.hpp"
+#include "Log.hpp"
 #include "MoonlightSession.hpp"
+#include "SocketQos.hpp"
+#include "StartupTrace.hpp"
 #include "SwitchMoonlightSessionDecoderAndRenderProvider.hpp"
+#include "SwitchNetwork.hpp"
+#include "SwitchPower.hpp"
+#include "ThreadAffinity.hpp"
+#include "ThreadProfiler.hpp"
+#include "UIIconAtlas.hpp"
+#include "client.h"
+
+#if defined(USE_GL_RENDERER) && !defined(BOREALIS_USE_DEKO3D) && !defined(USE_METAL_RENDERER)
+#include "GLVideoRenderer.hpp"
+#endif
+
+#if defined(USE_GL_RENDERER) && !defined(BOREALIS_USE_DEKO3D)
+#include "GLSwapControl.hpp"
+#endif
 
 
 #ifdef _WIN32
@@ -37,16 +59,51 @@
 
 using namespace brls::literals; // for _i18n
 
+// Host which app list was opened last is likely to be opened again, its
+// state, app list and favorites box art are fetched while UI is built
+static void warmUpLastHost() {
+    auto hosts = Settings::instance().hosts();
+    auto host = std::find_if(hosts.begin(), hosts.end(), [](const Host& host) {
+        return host.address == Settings::instance().last_host();
+    });
+    if (host == hosts.end())
+        return;
+
+    GameStreamClient::instance().warm_up(host->address);
+    for (const auto& app : host->favorites)
+        BoxArtManager::instance().preload({BoxArtManager::host_id(*host), app.app_id});
+}
+
+static void registerMainViews() {
+    // Register custom views (including tabs, which are views)
+    brls::Application::registerXMLView("LinkCell", LinkCell::create);
+
+    brls::Application::registerXMLView("MainTabs", MainTabs::create);
+    brls::Application::registerXMLView("HostTab", HostTab::create);
+    brls::Application::registerXMLView("AddHostTab", AddHostTab::create);
+    brls::Application::registerXMLView("SettingsTab", SettingsTab::create);
+
+    // Add custom values to the theme
+    brls::Theme::getLightTheme().addColor("captioned_image/caption",
+                                   nvgRGB(2, 176, 183));
+    brls::Theme::getDarkTheme().addColor("captioned_image/caption",
+                                  nvgRGB(51, 186, 227));
+
+    // Add custom values to the style
+    brls::getStyle().addMetric("about/padding_top_bottom", 50);
+    brls::getStyle().addMetric("about/padding_sides", 75);
+    brls::getStyle().addMetric("about/description_margin", 50);
+}
+
 int main(int argc, char* argv[]) {
+    StartupTrace::instance().start();
+
     // Enable recording for Twitter memes
 #ifdef __SWITCH__
     appletInitializeGamePlayRecording();
-    appletSetWirelessPriorityMode(AppletWirelessPriorityMode_OptimizedForWlan);
-
-    // Keep the main thread above others so that the program stays responsive
-    // when doing software decoding
-    svcSetThreadPriority(CUR_THREAD_HANDLE, 0x20);
 
+    // Main thread is moved to its UI core with configured priority
+    // once settings are loaded
     // auto at = appletGetAppletType();
     // g_application_mode = at == AppletType_Application || at == AppletType_SystemApplication;
 
@@ -57,66 +114,109 @@ int main(int argc, char* argv[]) {
     // __nx_nv_transfermem_size = (g_application_mode ? 16 : 3) * 0x100000;
 #endif
 
-    // Set log level
-    // We recommend to use INFO for real apps
-    brls::Logger::setLogLevel(brls::LogLevel::LOG_DEBUG);
+    // Debug builds log everything, release ones stop at info
+    brls::Logger::setLogLevel((brls::LogLevel)LOG_MIN_LEVEL);
 
     // Init the app and i18n
     if (!brls::Application::init()) {
         brls::Logger::error("Unable to init Borealis application");
         return EXIT_FAILURE;
     }
+    StartupTrace::instance().mark("borealis init");
 
     MoonlightSession::set_provider(
             new SwitchMoonlightSessionDecoderAndRenderProvider());
 
-    brls::Application::createWindow("title"_i18n);
-
     auto home = Application::getPlatform()->getHomeDirectory("Moonlight-Switch");
     Settings::instance().set_working_dir(home);
     brls::Logger::info("Working dir, {}", home);
 
-    // Have the application register an action on every activity that will quit
-    // when you press BUTTON_START
-    brls::Application::setGlobalQuit(false);
-    brls::Application::setFPSStatus(false);
+#ifdef __SWITCH__
+    // Applet mode only gets a part of application heap, stream fits in it
+    // with smaller pools and queues
+    AppletType appletType = appletGetAppletType();
+    if (appletType != AppletType_Application && appletType != AppletType_SystemApplication) {
+        brls::Logger::warning("Applet mode, using low memory profile");
+        Settings::instance().set_low_memory(true);
+    }
+#endif
+    StartupTrace::instance().mark("settings");
 
-    // Register custom views (including tabs, which are views)
-    brls::Application::registerXMLView("LinkCell", LinkCell::create);
+#ifdef __SWITCH__
+    // Bitrate changed later takes effect with next launch
+    SwitchNetwork::init(Settings::instance().bitrate());
+    SwitchPower::init();
+#endif
+    // Wireless priority of Switch follows the QoS option too
+    SocketQos::init(Settings::instance().qos_marking());
 
-    brls::Application::registerXMLView("MainTabs", MainTabs::create);
-    brls::Application::registerXMLView("HostTab", HostTab::create);
-    brls::Application::registerXMLView("AddHostTab", AddHostTab::create);
-    brls::Application::registerXMLView("SettingsTab", SettingsTab::create);
+    // First launch generates client key pair, host list doesn't wait for it
+    gs_prepare_cert_key_pair();
+    StartupTrace::instance().mark("network and keys");
 
-    // Add custom values to the theme
-    brls::Theme::getLightTheme().addColor("captioned_image/caption",
-                                   nvgRGB(2, 176, 183));
-    brls::Theme::getDarkTheme().addColor("captioned_image/caption",
-                                  nvgRGB(51, 186, 227));
+    // Forwarder launch asks host for its state while window is created,
+    // request started by streaming view joins this one
+    auto launch = parseLaunchArgs(argc, argv);
+    if (launch)
+        GameStreamClient::instance().connect(launch->host.address, [](auto result) {});
 
-    // Add custom values to the style
-    brls::getStyle().addMetric("about/padding_top_bottom", 50);
-    brls::getStyle().addMetric("about/padding_sides", 75);
-    brls::getStyle().addMetric("about/description_margin", 50);
+    brls::Application::createWindow("title"_i18n);
+    StartupTrace::instance().mark("window");
+
+    // Badges of first grid come from here, not from files per cell
+    UIIconAtlas::instance().load(brls::Application::getNVGContext());
+
+    DecoderCapabilities::instance().load(Settings::instance().decoder_capabilities_path());
+    StartupTrace::instance().mark("decoder capabilities");
 
-    // Create and push the main activity to the stack if cannot run game from arguments
-    if (!startFromArgs(argc, argv)) {
+    // Keep the main thread above others so that the program stays responsive
+    // when doing software decoding
+    ThreadAffinity::apply(THREAD_ROLE_UI);
+    ThreadProfiler::instance().register_current("UI");
+
+    // Have the application register an action on every activity that will quit
+    // when you press BUTTON_START
+    brls::Application::setGlobalQuit(false);
+    brls::Application::setFPSStatus(false);
+
+    // Create and push the main activity to the stack if cannot run game from arguments,
+    // streaming alone doesn't need any of main views
+    if (!startFromArgs(launch)) {
+        registerMainViews();
+        warmUpLastHost();
         brls::Application::pushActivity(new MainActivity());
     }
+    StartupTrace::instance().mark("first activity");
 
     brls::Application::enableDebuggingView(Settings::instance().write_log());
     brls::Application::setSwapInputKeys(Settings::instance().swap_ui_keys());
 
+#if defined(USE_GL_RENDERER) && !defined(BOREALIS_USE_DEKO3D) && !defined(USE_METAL_RENDERER)
+    // Runs on first main loop pass, after UI is shown, so first stream
+    // doesn't wait for shader compilation
+    brls::sync([] { GLVideoRenderer::warmupPrograms(); });
+#endif
+
     // Run the app
-    while (brls::Application::mainLoop())
-        ;
+    while (brls::Application::mainLoop()) {
+        StartupTrace::instance().frame();
+#if defined(USE_GL_RENDERER) && !defined(BOREALIS_USE_DEKO3D)
+        // Swap doesn't wait for vblank with variable refresh
+        GLSwapControl::wait_frame();
+#endif
+    }
 
+    // Stream left right before exit could still be shutting down
+    MoonlightSession::wait_teardown();
+    HostPinger::instance().stop();
     GameStreamClient::instance().stop();
     DiscoverManager::instance().pause();
+    Settings::instance().flush();
 
     // Exit
 #ifdef __SWITCH__
+    // Audio device was kept open for the next stream
+    AudrenDevice::instance().shutdown();
     nvExit();
 #elif defined(PLATFORM_TVOS)
     exit(0);
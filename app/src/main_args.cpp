@@ -10,29 +10,10 @@
 #include "streaming_view.hpp"
 #include <regex>
 
-#ifdef __SWITCH__
-#include <switch.h>
-#endif
-
 using namespace brls;
 
-bool canStartApp(int argc, char** argv) {
-#ifdef __SWITCH__
-    AppletType at = appletGetAppletType();
-    if (at != AppletType_Application && at != AppletType_SystemApplication) {
-        auto dialog = new Dialog("error/applet_not_supported"_i18n);
-        dialog->addButton("common/close"_i18n, [] {});
-        dialog->open();
-        return false;
-    }
-#endif
-    return true;
-}
-
-bool startFromArgs(int argc, char** argv) {
-    if (!canStartApp(argc, argv)) return true;
-
-    if (argc <= 1) return false;
+std::optional<LaunchArgs> parseLaunchArgs(int argc, char** argv) {
+    if (argc <= 1) return std::nullopt;
 
     std::string args_pref[4] = {"--host=", "--ip=", "--appid=", "--appname="};
     std::string args[4];
@@ -47,8 +28,6 @@ bool startFromArgs(int argc, char** argv) {
         }
     }
 
-    Application::enableDebuggingView(true);
-
     std::string mac = args[0];
     std::string ip = args[1];
     std::string appId = args[2];
@@ -61,23 +40,28 @@ bool startFromArgs(int argc, char** argv) {
     Logger::debug("Id {}", appId);
     Logger::debug("Name {}", appName);
 
-    if ((mac.empty() && ip.empty()) || appId.empty()) { return false; }
+    if ((mac.empty() && ip.empty()) || appId.empty()) { return std::nullopt; }
 
     auto hosts = Settings::instance().hosts();
     if (auto it = std::find_if(hosts.begin(), hosts.end(), [mac, ip](const Host& host) {
         return host.mac == mac || host.address == ip;
     }); it != std::end(hosts)) {
-        const Host& host = *it;
-        AppInfo info { appName, stoi(appId) };
+        return LaunchArgs { *it, AppInfo { appName, stoi(appId) } };
+    }
 
-        auto* frame = new AppletFrame(new StreamingView(host, info));
-        frame->setBackground(ViewBackground::NONE);
-        frame->setHeaderVisibility(brls::Visibility::GONE);
-        frame->setFooterVisibility(brls::Visibility::GONE);
-        Application::pushActivity(new Activity(frame));
+    return std::nullopt;
+}
 
-        return true;
-    }
+bool startFromArgs(const std::optional<LaunchArgs>& launch) {
+    if (!launch) return false;
 
-    return false;
+    Application::enableDebuggingView(true);
+
+    auto* frame = new AppletFrame(new StreamingView(launch->host, launch->app));
+    frame->setBackground(ViewBackground::NONE);
+    frame->setHeaderVisibility(brls::Visibility::GONE);
+    frame->setFooterVisibility(brls::Visibility::GONE);
+    Application::pushActivity(new Activity(frame));
+
+    return true;
 }
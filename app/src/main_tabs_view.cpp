@@ -6,6 +6,8 @@
 //
 
 #include "main_tabs_view.hpp"
+#include "GameStreamClient.hpp"
+#include "HostPinger.hpp"
 #include "Settings.hpp"
 #include "about_tab.hpp"
 #include "add_host_tab.hpp"
@@ -13,10 +15,10 @@
 #include "settings_tab.hpp"
 
 MainTabs::MainTabs() {
-    favoriteTab = new FavoriteTab();
-    favoriteTab->ptrLock();
-
     MainTabs::instanse = this;
+
+    // Every saved host is queried at once, not when its tab is opened
+    GameStreamClient::instance().refresh_hosts(Settings::instance().hosts());
     refillTabs();
     lastHasAnyFavorites = Settings::instance().has_any_favorite();
 }
@@ -24,7 +26,8 @@ MainTabs::MainTabs() {
 void MainTabs::willAppear(bool resetState) {
     Box::willAppear(resetState);
     updateFavoritesIfNeeded();
-    favoriteTab->refreshIfNeeded();
+    if (favoriteTab)
+        favoriteTab->refreshIfNeeded();
 }
 
 void MainTabs::updateFavoritesIfNeeded() {
@@ -48,15 +51,25 @@ void MainTabs::refillTabs(bool keepFocus) {
 
     bool hasAnyFavorite = Settings::instance().has_any_favorite();
     if (hasAnyFavorite) {
-        addTab("tabs/favorites"_i18n, [this] { return this->favoriteTab; });
+        addTab("tabs/favorites"_i18n, [this] {
+            // Built on first open, launch without favorites never inflates it
+            if (!this->favoriteTab) {
+                this->favoriteTab = new FavoriteTab();
+                this->favoriteTab->ptrLock();
+            }
+            return this->favoriteTab;
+        });
         addSeparator();
     }
     lastHasAnyFavorites = hasAnyFavorite;
 
     auto hosts = Settings::instance().hosts();
+    std::vector<std::string> addresses;
     for (const Host& host : hosts) {
         addTab(host.hostname, [host] { return new HostTab(host); });
+        addresses.push_back(host.address);
     }
+    HostPinger::instance().set_hosts(addresses);
     if (!hosts.empty())
         addSeparator();
 
@@ -0,0 +1,161 @@
+//
+//  replay_view.cpp
+//  Moonlight
+//
+
+#include "replay_view.hpp"
+#include "FFmpegVideoDecoder.hpp"
+#include "MoonlightSession.hpp"
+#include "Settings.hpp"
+#include "helper.hpp"
+
+using namespace brls;
+
+ReplayView::ReplayView(ReplayMode mode) : mode(mode) {
+    Application::getPlatform()->disableScreenDimming(true);
+    setFocusable(true);
+    setHideHighlight(true);
+
+    registerAction("hints/back"_i18n, ControllerButton::BUTTON_B, [](View* view) {
+        Application::popActivity();
+        return true;
+    });
+
+    // Recorder itself is not part of benchmark, so decoder is created
+    // directly, renderers are the same ones live stream would use
+    decoder = new FFmpegVideoDecoder();
+    decoder->set_frame_holder(&frames);
+    renderer = MoonlightSession::provider()->video_renderer();
+    renderer->prepare();
+
+    bool started;
+    if (mode == REPLAY_SESSION) {
+        audio = MoonlightSession::provider()->audio_renderer();
+        started = sessionReplay.load(Settings::instance().session_capture_path());
+        if (started)
+            sessionReplay.start(decoder, audio, Settings::instance().replay_loss(),
+                                Settings::instance().replay_jitter());
+    } else if (mode == REPLAY_SOAK) {
+        audio = MoonlightSession::provider()->audio_renderer();
+        started = sessionReplay.load(Settings::instance().session_capture_path()) &&
+                  soak.start(&sessionReplay, decoder, audio, Settings::instance().soak_duration(),
+                             Settings::instance().soak_reconnects());
+    } else {
+        started = replay.load(Settings::instance().video_capture_path()) &&
+                  replay.start(decoder, &frames, mode == REPLAY_AS_RECORDED);
+    }
+
+    if (!started)
+        showError("error/replay"_i18n, [] { Application::popActivity(); });
+}
+
+ReplayView::~ReplayView() {
+    Application::getPlatform()->disableScreenDimming(false);
+    soak.stop();
+    replay.stop();
+    sessionReplay.stop();
+    delete renderer;
+    delete decoder;
+    delete audio;
+}
+
+void ReplayView::draw(NVGcontext* vg, float x, float y, float width,
+                      float height, Style style, FrameContext* ctx) {
+    if (mode == REPLAY_SOAK)
+        soak.update();
+
+    int format = mode == REPLAY_SESSION || mode == REPLAY_SOAK ? sessionReplay.video_format() : replay.video_format();
+    frames.get([this, vg, width, height, format](AVFrame* frame, uint64_t generation) {
+        renderer->draw(vg, (int)width, (int)height, frame, format, generation);
+        replay.frame_drawn((uint32_t)frame->pts);
+    });
+
+    auto text = mode == REPLAY_SOAK ? soakStats() : mode == REPLAY_SESSION ? sessionStats() : streamStats();
+
+    nvgFontSize(vg, 20);
+    nvgTextAlign(vg, NVG_ALIGN_LEFT | NVG_ALIGN_TOP);
+    nvgFontFaceId(vg, Application::getFont(FONT_REGULAR));
+    nvgFontBlur(vg, 3);
+    nvgFillColor(vg, nvgRGBA(0, 0, 0, 255));
+    nvgTextBox(vg, x + 20, y + 20, width, text.c_str(), nullptr);
+    nvgFontBlur(vg, 0);
+    nvgFillColor(vg, nvgRGBA(255, 255, 255, 255));
+    nvgTextBox(vg, x + 20, y + 20, width, text.c_str(), nullptr);
+}
+
+std::string ReplayView::streamStats() {
+    auto summary = replay.summary();
+    auto decode = decoder->video_decode_stats();
+    auto text = fmt::format("Frames drawn: {} of {}\n"
+                            "Elapsed: {:.{}f} s | {:.{}f} FPS\n"
+                            "Average decoding time: {:.{}f} ms\n"
+                            "Submit to draw p50 | p95 | p99 | max: {:.{}f} | {:.{}f} | {:.{}f} | {:.{}f} ms",
+                            summary.drawn, summary.frames,
+                            summary.elapsed_s, 1, summary.draw_fps, 2,
+                            decode.session_decoding_time, 2,
+                            summary.p50_ms, 2, summary.p95_ms, 2,
+                            summary.p99_ms, 2, summary.max_ms, 2);
+
+    if (summary.finished) {
+        text += "\nDone, results saved next to recording";
+        if (!saved) {
+            saved = true;
+            replay.save_results(Application::getPlatform()->getName());
+        }
+    }
+    return text;
+}
+
+std::string ReplayView::sessionStats() {
+    auto stats = sessionReplay.stats();
+    auto decode = decoder->video_decode_stats();
+    auto audioStats = audio->audio_render_stats();
+    auto text = fmt::format("Injected loss | jitter: {}% | {} ms\n"
+                            "Video frames: {} | lost: {} | skipped till IDR: {}\n"
+                            "Decoding frame rate: {:.{}f} FPS\n"
+                            "Average decoding time: {:.{}f} ms\n"
+                            "Audio packets: {} | lost: {}\n"
+                            "Audio queue | target: {:.{}f} | {:.{}f} ms\n"
+                            "Audio underruns | dropped packets: {} | {}\n"
+                            "Audio lost packets concealed | recovered: {} | {}\n"
+                            "Poor connection reports: {}",
+                            Settings::instance().replay_loss(), Settings::instance().replay_jitter(),
+                            stats.video_units, stats.video_lost, stats.video_skipped,
+                            decode.current_decoded_fps, 2,
+                            decode.session_decoding_time, 2,
+                            stats.audio_packets, stats.audio_lost,
+                            audioStats.queued_time, 1, audioStats.target_time, 1,
+                            audioStats.underruns, audioStats.dropped_packets,
+                            audioStats.plc_packets, audioStats.fec_packets,
+                            stats.poor_status);
+
+    if (stats.finished)
+        text += "\nDone";
+    return text;
+}
+
+std::string ReplayView::soakStats() {
+    auto result = soak.report();
+    auto last = result.last;
+    auto text = fmt::format("Soak test: {:.0f} of {} min\n"
+                            "Reconnects: {} of {}\n"
+                            "Heap | process: {:.1f} | {:.1f} MB\n"
+                            "Decoder surfaces: {:.1f} MB | open descriptors: {}\n"
+                            "Growth after warm-up heap | process | descriptors: {:+.1f} MB | {:+.1f} MB | {:+}",
+                            result.elapsed_s / 60, Settings::instance().soak_duration(),
+                            result.reconnects, Settings::instance().soak_reconnects(),
+                            last.heap_kb / 1024.0f, last.process_kb / 1024.0f,
+                            last.surface_mb, last.fds,
+                            result.heap_growth_mb, result.process_growth_mb, result.fd_growth);
+
+    if (result.finished) {
+        text += fmt::format("\nDone, {}, results saved next to recording",
+                            result.passed ? "memory stayed within limits" : "memory grew beyond limits");
+        if (!saved) {
+            saved = true;
+            soak.save(Settings::instance().soak_samples_path(), Settings::instance().soak_results_path(),
+                      Application::getPlatform()->getName());
+        }
+    }
+    return text;
+}
@@ -10,11 +10,18 @@
 #endif
 
 #include "settings_tab.hpp"
+#include "DecoderCapabilities.hpp"
 #include "Settings.hpp"
+#include "SocketQos.hpp"
 #include "helper.hpp"
 #include "button_selecting_dialog.hpp"
 #include "mapping_layout_editor.hpp"
+#include "MicroBenchmark.hpp"
+#include "replay_view.hpp"
+#include "grid_benchmark_view.hpp"
+#include <algorithm>
 #include <iomanip>
+#include <iterator>
 #include <sstream>
 
 #define SET_SETTING(n, func)                                                   \
@@ -37,6 +44,13 @@ std::vector<std::string> audio_backends {
     "SDL2",
 #ifdef __SWITCH__
     "Audren",
+#endif
+    "SDL2 (callback)",
+#ifdef PLATFORM_ANDROID
+    "AAudio",
+#endif
+#ifdef __APPLE__
+    "AudioUnit",
 #endif
 };
 
@@ -51,6 +65,14 @@ SettingsTab::SettingsTab() {
         "1440p"
 #endif
     };
+
+    // Resolutions past sessions couldn't decode in time are marked
+    int resolutionHeights[] = {-1, 360, 480, 720, 1080, 1440};
+    for (size_t i = 1; i < resolutions.size(); i++) {
+        if (!DecoderCapabilities::instance().realtime(Settings::instance().video_codec(), resolutionHeights[i],
+                                                      Settings::instance().fps()))
+            resolutions[i] += " (" + "settings/decoding_too_slow"_i18n + ")";
+    }
     resolution->setText("settings/resolution"_i18n);
     resolution->setData(resolutions);
     switch (Settings::instance().resolution()) {
@@ -74,11 +96,15 @@ SettingsTab::SettingsTab() {
         }
     });
 
+    limitToDisplay->init("settings/limit_to_display"_i18n, Settings::instance().limit_to_display(),
+                         [](bool value) { Settings::instance().set_limit_to_display(value); });
+
     std::vector<std::string> fpss = {
         "30", 
         "40", 
         "60", 
 #if !defined(PLATFORM_SWITCH)
+        "90",
         "120",
 #endif
         };
@@ -89,7 +115,8 @@ SettingsTab::SettingsTab() {
         GET_SETTINGS(fps, 30, 0);
         GET_SETTINGS(fps, 40, 1);
         GET_SETTINGS(fps, 60, 2);
-        GET_SETTINGS(fps, 120, 3);
+        GET_SETTINGS(fps, 90, 3);
+        GET_SETTINGS(fps, 120, 4);
         DEFAULT;
     }
     fps->getEvent()->subscribe([](int selected) {
@@ -97,7 +124,8 @@ SettingsTab::SettingsTab() {
             SET_SETTING(0, set_fps(30));
             SET_SETTING(1, set_fps(40));
             SET_SETTING(2, set_fps(60));
-            SET_SETTING(3, set_fps(120));
+            SET_SETTING(3, set_fps(90));
+            SET_SETTING(4, set_fps(120));
             DEFAULT;
         }
     });
@@ -106,7 +134,7 @@ SettingsTab::SettingsTab() {
                                          "4"};
     decoder->setText("settings/decoder_threads"_i18n);
     decoder->setData(decoders);
-    switch (Settings::instance().decoder_threads()) {
+    switch (Settings::instance().configured_decoder_threads()) {
         GET_SETTINGS(decoder, 0, 0);
         GET_SETTINGS(decoder, 2, 1);
         GET_SETTINGS(decoder, 3, 2);
@@ -123,13 +151,68 @@ SettingsTab::SettingsTab() {
         }
     });
 
+    std::vector<std::string> threadings = {"settings/decoder_threading_auto"_i18n,
+                                           "settings/decoder_threading_slice"_i18n,
+                                           "settings/decoder_threading_frame"_i18n};
+    decoderThreading->init("settings/decoder_threading"_i18n, threadings, Settings::instance().decoder_threading(),
+                           [](int selected) { Settings::instance().set_decoder_threading((DecoderThreading)selected); });
+
+    std::vector<std::string> pacings = {"settings/frame_pacing_queue"_i18n,
+                                        "settings/frame_pacing_lowest_latency"_i18n,
+                                        "settings/frame_pacing_smoothest"_i18n};
+    framePacing->init("settings/frame_pacing"_i18n, pacings, Settings::instance().frame_pacing(),
+                      [](int selected) { Settings::instance().set_frame_pacing((FramePacing)selected); });
+
+    std::vector<std::string> presentModes = {"settings/present_mode_standard"_i18n,
+                                             "settings/present_mode_low_latency"_i18n,
+                                             "settings/present_mode_immediate"_i18n};
+    presentMode->init("settings/present_mode"_i18n, presentModes, Settings::instance().present_mode(),
+                      [](int selected) { Settings::instance().set_present_mode((PresentMode)selected); });
+#if !defined(PLATFORM_SWITCH) || !defined(BOREALIS_USE_DEKO3D)
+    // Other renderers present through borealis swap
+    presentMode->removeFromSuperView(true);
+#endif
+
+    variableRefresh->init("settings/variable_refresh"_i18n, Settings::instance().variable_refresh(),
+                          [](bool value) { Settings::instance().set_variable_refresh(value); });
+#if !defined(USE_GL_RENDERER) || defined(BOREALIS_USE_DEKO3D)
+    // Swap interval is only controlled on desktop GL
+    variableRefresh->removeFromSuperView(true);
+#endif
+
+    std::vector<std::string> scalings = {"settings/video_scaling_bilinear"_i18n,
+                                         "settings/video_scaling_bicubic"_i18n,
+                                         "settings/video_scaling_lanczos"_i18n,
+                                         "settings/video_scaling_fsr"_i18n};
+    videoScaling->init("settings/video_scaling"_i18n, scalings, Settings::instance().video_scaling(),
+                       [](int selected) { Settings::instance().set_video_scaling((VideoScaling)selected); });
+
+    vicScaling->init("settings/vic_scaling"_i18n, Settings::instance().vic_scaling(),
+                     [](bool value) { Settings::instance().set_vic_scaling(value); });
+#if !defined(PLATFORM_SWITCH) || !defined(BOREALIS_USE_DEKO3D)
+    // Only deko3d renderer takes NVTEGRA surfaces
+    vicScaling->removeFromSuperView(true);
+#endif
+
     std::vector<VideoCodec> supportedCodecs = {
 #ifndef PLATFORM_ANDROID
         H264,
 #endif
         H265,
+#ifndef BOREALIS_USE_DEKO3D
+        // Deko3d renderer only takes hardware decoded frames,
+        // Switch has no AV1 decoding block
+        AV1,
+#endif
     };
 
+    // Decoders which failed probe aren't offered, unless none is left
+    std::vector<VideoCodec> decodableCodecs;
+    std::copy_if(supportedCodecs.begin(), supportedCodecs.end(), std::back_inserter(decodableCodecs),
+                 [](VideoCodec codec) { return DecoderCapabilities::instance().can_decode(codec); });
+    if (!decodableCodecs.empty())
+        supportedCodecs = decodableCodecs;
+
     std::vector<std::string> supportedCodecNames;
     for (int i = 0; i < supportedCodecs.size(); i++) {
         supportedCodecNames.push_back(getVideoCodecName(supportedCodecs[i]));
@@ -160,6 +243,26 @@ SettingsTab::SettingsTab() {
 
     hwDecoding->setEnabled(false);
 
+    directSurface->init("settings/direct_surface"_i18n, Settings::instance().direct_surface(),
+                        [](bool value) { Settings::instance().set_direct_surface(value); });
+#ifndef PLATFORM_ANDROID
+    directSurface->removeFromSuperView(true);
+#endif
+
+    decoderThread->init("settings/decoder_thread"_i18n, Settings::instance().decoder_thread(),
+                        [](bool value) { Settings::instance().set_decoder_thread(value); });
+
+    decoderUpload->init("settings/decoder_upload"_i18n, Settings::instance().decoder_upload(),
+                        [](bool value) { Settings::instance().set_decoder_upload(value); });
+#if !defined(USE_GL_RENDERER) || defined(PLATFORM_SWITCH) || defined(PLATFORM_ANDROID) || \
+    defined(PLATFORM_IOS) || defined(PLATFORM_TVOS) || defined(__PSV__)
+    // Shared context lives in a second, hidden window, desktops only
+    decoderUpload->removeFromSuperView(true);
+#endif
+
+    autoTune->init("settings/auto_tune"_i18n, Settings::instance().auto_tune(),
+                   [](bool value) { Settings::instance().set_auto_tune(value); });
+
 #if defined(PLATFORM_SWITCH)
     const float mbpsMaxLimit = 100000;
 #else
@@ -180,9 +283,61 @@ SettingsTab::SettingsTab() {
     });
     slider->setProgress(progress);
 
+    autoBitrate->init("settings/auto_bitrate"_i18n, Settings::instance().auto_bitrate(),
+                      [](bool value) { Settings::instance().set_auto_bitrate(value); });
+
+    networkProbe->init("settings/network_probe"_i18n, Settings::instance().network_probe(),
+                       [](bool value) { Settings::instance().set_network_probe(value); });
+
+    qosMarking->init("settings/qos_marking"_i18n, Settings::instance().qos_marking(), [](bool value) {
+        Settings::instance().set_qos_marking(value);
+        SocketQos::init(value);
+    });
+
+#ifdef PLATFORM_SWITCH
+    batterySaver->init("settings/battery_saver"_i18n, Settings::instance().battery_saver(),
+                       [](bool value) { Settings::instance().set_battery_saver(value); });
+#else
+    batterySaver->removeFromSuperView();
+#endif
+
+    audioOnly->init("settings/audio_only"_i18n, Settings::instance().audio_only(),
+                    [](bool value) { Settings::instance().set_audio_only(value); });
+
     audioBackend->init("settings/audio_backend"_i18n, audio_backends, Settings::instance().audio_backend(),
                        [](int selected) { Settings::instance().set_audio_backend((AudioBackend)selected); });
 
+    std::vector<std::string> channels = {"settings/audio_channels_stereo"_i18n,
+                                         "settings/audio_channels_51"_i18n,
+                                         "settings/audio_channels_71"_i18n};
+    audioChannels->init("settings/audio_channels"_i18n, channels, Settings::instance().audio_channels(),
+                        [](int selected) { Settings::instance().set_audio_channels((AudioChannels)selected); });
+
+    std::vector<std::string> latencies = {"20 ms", "40 ms", "60 ms", "80 ms", "100 ms"};
+    audioLatency->setText("settings/audio_latency"_i18n);
+    audioLatency->setData(latencies);
+    switch (Settings::instance().audio_latency()) {
+        GET_SETTINGS(audioLatency, 20, 0);
+        GET_SETTINGS(audioLatency, 40, 1);
+        GET_SETTINGS(audioLatency, 60, 2);
+        GET_SETTINGS(audioLatency, 80, 3);
+        GET_SETTINGS(audioLatency, 100, 4);
+        DEFAULT;
+    }
+    audioLatency->getEvent()->subscribe([](int selected) {
+        switch (selected) {
+            SET_SETTING(0, set_audio_latency(20));
+            SET_SETTING(1, set_audio_latency(40));
+            SET_SETTING(2, set_audio_latency(60));
+            SET_SETTING(3, set_audio_latency(80));
+            SET_SETTING(4, set_audio_latency(100));
+            DEFAULT;
+        }
+    });
+
+    audioThread->init("settings/audio_thread"_i18n, Settings::instance().audio_thread(),
+                      [](bool value) { Settings::instance().set_audio_thread(value); });
+
     optimal->init("settings/usops"_i18n, Settings::instance().sops(),
                   [](bool value) { Settings::instance().set_sops(value); });
 
@@ -339,6 +494,46 @@ SettingsTab::SettingsTab() {
         return true;
     });
 
+    std::vector<std::string> deadzoneTypes = {"settings/deadzone/radial"_i18n, "settings/deadzone/axial"_i18n};
+    deadzoneType->init("settings/deadzone/type"_i18n, deadzoneTypes, Settings::instance().deadzone_type(),
+                       [](int selected) { Settings::instance().set_deadzone_type((DeadzoneType)selected); });
+
+    std::vector<std::string> antiDeadzones = {"hints/off"_i18n, "5%", "10%", "15%", "20%"};
+    antiDeadzone->setText("settings/deadzone/anti_deadzone"_i18n);
+    antiDeadzone->setData(antiDeadzones);
+    switch (int(Settings::instance().anti_deadzone() * 100.f + 0.5f)) {
+        GET_SETTINGS(antiDeadzone, 0, 0);
+        GET_SETTINGS(antiDeadzone, 5, 1);
+        GET_SETTINGS(antiDeadzone, 10, 2);
+        GET_SETTINGS(antiDeadzone, 15, 3);
+        GET_SETTINGS(antiDeadzone, 20, 4);
+        DEFAULT;
+    }
+    antiDeadzone->getEvent()->subscribe([](int selected) {
+        Settings::instance().set_anti_deadzone(float(selected * 5) / 100.f);
+    });
+
+    std::vector<std::string> stickCurves = {"settings/deadzone/curve_linear"_i18n,
+                                            "settings/deadzone/curve_quadratic"_i18n,
+                                            "settings/deadzone/curve_cubic"_i18n,
+                                            "settings/deadzone/curve_custom"_i18n};
+    stickCurve->init("settings/deadzone/curve"_i18n, stickCurves, Settings::instance().stick_curve(),
+                     [](int selected) {
+                         Settings::instance().set_stick_curve((StickCurve)selected);
+                         if (selected != CURVE_CUSTOM)
+                             return;
+
+                         // Custom curve asks for its exponent every time it is picked
+                         int currentValue = Settings::instance().stick_curve_exponent();
+                         Application::getImeManager()->openForNumber([](long number) {
+                                                                         if (number > 0)
+                                                                             Settings::instance().set_stick_curve_exponent((int)number);
+                                                                     },
+                                                                     "settings/deadzone/curve_custom"_i18n,
+                                                                     "settings/deadzone/curve_hint"_i18n, 3,
+                                                                     std::to_string(currentValue), "", "", 0);
+                     });
+
     float rumbleForceProgress = Settings::instance().get_rumble_force();
     rumbleForceSlider->getProgressEvent()->subscribe([this](float value) {
         std::stringstream stream;
@@ -351,6 +546,51 @@ SettingsTab::SettingsTab() {
     swapStickToDpad->init("settings/swap_stick_to_dpad"_i18n, Settings::instance().swap_joycon_stick_to_dpad(),
                           [](bool value) { Settings::instance().set_swap_joycon_stick_to_dpad(value); });
 
+#ifdef PLATFORM_SWITCH
+    std::vector<std::string> inputRates = {"settings/input_rate_frame"_i18n, "250 Hz", "500 Hz", "1000 Hz"};
+    inputRate->setText("settings/input_rate"_i18n);
+    inputRate->setData(inputRates);
+    switch (Settings::instance().input_rate()) {
+        GET_SETTINGS(inputRate, 0, 0);
+        GET_SETTINGS(inputRate, 250, 1);
+        GET_SETTINGS(inputRate, 500, 2);
+        GET_SETTINGS(inputRate, 1000, 3);
+        DEFAULT;
+    }
+    inputRate->getEvent()->subscribe([](int selected) {
+        switch (selected) {
+            SET_SETTING(0, set_input_rate(0));
+            SET_SETTING(1, set_input_rate(250));
+            SET_SETTING(2, set_input_rate(500));
+            SET_SETTING(3, set_input_rate(1000));
+            DEFAULT;
+        }
+    });
+#else
+    // Desktop and mobile backends poll gamepads on main thread only
+    inputRate->removeFromSuperView();
+#endif
+
+    std::vector<std::string> motionRates = {"settings/motion_rate_unlimited"_i18n, "60 Hz", "120 Hz", "250 Hz"};
+    motionRate->setText("settings/motion_rate"_i18n);
+    motionRate->setData(motionRates);
+    switch (Settings::instance().motion_rate()) {
+        GET_SETTINGS(motionRate, 0, 0);
+        GET_SETTINGS(motionRate, 60, 1);
+        GET_SETTINGS(motionRate, 120, 2);
+        GET_SETTINGS(motionRate, 250, 3);
+        DEFAULT;
+    }
+    motionRate->getEvent()->subscribe([](int selected) {
+        switch (selected) {
+            SET_SETTING(0, set_motion_rate(0));
+            SET_SETTING(1, set_motion_rate(60));
+            SET_SETTING(2, set_motion_rate(120));
+            SET_SETTING(3, set_motion_rate(250));
+            DEFAULT;
+        }
+    });
+
     guideKeyButtons->setText("settings/guide_key_buttons"_i18n);
     setupButtonsSelectorCell(guideKeyButtons,
                              Settings::instance().guide_key_options().buttons);
@@ -416,6 +656,9 @@ SettingsTab::SettingsTab() {
     overlayBySystemButton->setDetailTextColor(color);
 #endif
 
+    overlayFreezeVideo->init("settings/overlay_freeze_video"_i18n, Settings::instance().overlay_freeze_video(),
+                             [](bool value) { Settings::instance().set_overlay_freeze_video(value); });
+
     overlayTime->init(
         "settings/overlay_time"_i18n,
         {"settings/overlay_zero_time"_i18n, "1", "2", "3", "4", "5"},
@@ -534,6 +777,53 @@ SettingsTab::SettingsTab() {
                               Settings::instance().set_swap_mouse_scroll(value);
                           });
 
+    gyroMouse->init("settings/gyro_mouse"_i18n, Settings::instance().gyro_mouse(),
+                    [](bool value) { Settings::instance().set_gyro_mouse(value); });
+
+    std::vector<std::string> gyroSensitivities = {"50%", "100%", "150%", "200%", "300%"};
+    gyroMouseSensitivity->setText("settings/gyro_mouse_sensitivity"_i18n);
+    gyroMouseSensitivity->setData(gyroSensitivities);
+    switch (Settings::instance().gyro_mouse_sensitivity()) {
+        GET_SETTINGS(gyroMouseSensitivity, 50, 0);
+        GET_SETTINGS(gyroMouseSensitivity, 100, 1);
+        GET_SETTINGS(gyroMouseSensitivity, 150, 2);
+        GET_SETTINGS(gyroMouseSensitivity, 200, 3);
+        GET_SETTINGS(gyroMouseSensitivity, 300, 4);
+        DEFAULT;
+    }
+    gyroMouseSensitivity->getEvent()->subscribe([](int selected) {
+        switch (selected) {
+            SET_SETTING(0, set_gyro_mouse_sensitivity(50));
+            SET_SETTING(1, set_gyro_mouse_sensitivity(100));
+            SET_SETTING(2, set_gyro_mouse_sensitivity(150));
+            SET_SETTING(3, set_gyro_mouse_sensitivity(200));
+            SET_SETTING(4, set_gyro_mouse_sensitivity(300));
+            DEFAULT;
+        }
+    });
+
+    std::vector<std::string> ratchetButtons = {"hints/off"_i18n, "L", "R", "ZL", "ZR"};
+    gyroMouseRatchet->setText("settings/gyro_mouse_ratchet"_i18n);
+    gyroMouseRatchet->setData(ratchetButtons);
+    switch (Settings::instance().gyro_mouse_ratchet()) {
+        GET_SETTINGS(gyroMouseRatchet, -1, 0);
+        GET_SETTINGS(gyroMouseRatchet, BUTTON_LB, 1);
+        GET_SETTINGS(gyroMouseRatchet, BUTTON_RB, 2);
+        GET_SETTINGS(gyroMouseRatchet, BUTTON_LT, 3);
+        GET_SETTINGS(gyroMouseRatchet, BUTTON_RT, 4);
+        DEFAULT;
+    }
+    gyroMouseRatchet->getEvent()->subscribe([](int selected) {
+        switch (selected) {
+            SET_SETTING(0, set_gyro_mouse_ratchet(-1));
+            SET_SETTING(1, set_gyro_mouse_ratchet(BUTTON_LB));
+            SET_SETTING(2, set_gyro_mouse_ratchet(BUTTON_RB));
+            SET_SETTING(3, set_gyro_mouse_ratchet(BUTTON_LT));
+            SET_SETTING(4, set_gyro_mouse_ratchet(BUTTON_RT));
+            DEFAULT;
+        }
+    });
+
     float mouseProgress =
         (Settings::instance().get_mouse_speed_multiplier() / 100.0f);
     mouseSpeedSlider->getProgressEvent()->subscribe([this](float value) {
@@ -545,11 +835,171 @@ SettingsTab::SettingsTab() {
     });
     mouseSpeedSlider->setProgress(mouseProgress);
 
+    std::vector<std::string> boxartCaches = {"16 MB", "32 MB", "64 MB", "128 MB"};
+    boxartCache->setText("settings/boxart_cache"_i18n);
+    boxartCache->setData(boxartCaches);
+    switch (Settings::instance().boxart_cache_mb()) {
+        GET_SETTINGS(boxartCache, 16, 0);
+        GET_SETTINGS(boxartCache, 32, 1);
+        GET_SETTINGS(boxartCache, 64, 2);
+        GET_SETTINGS(boxartCache, 128, 3);
+        DEFAULT;
+    }
+    boxartCache->getEvent()->subscribe([](int selected) {
+        switch (selected) {
+            SET_SETTING(0, set_boxart_cache_mb(16));
+            SET_SETTING(1, set_boxart_cache_mb(32));
+            SET_SETTING(2, set_boxart_cache_mb(64));
+            SET_SETTING(3, set_boxart_cache_mb(128));
+            DEFAULT;
+        }
+    });
+
     writeLog->init("settings/debugging_view"_i18n,
                    Settings::instance().write_log(), [](bool value) {
                        Settings::instance().set_write_log(value);
                        brls::Application::enableDebuggingView(value);
                    });
+
+    recordVideo->init("settings/record_video"_i18n,
+                      Settings::instance().record_video(), [](bool value) {
+                          Settings::instance().set_record_video(value);
+                      });
+
+    recordSession->init("settings/record_session"_i18n,
+                        Settings::instance().record_session(), [](bool value) {
+                            Settings::instance().set_record_session(value);
+                        });
+
+    auto openReplay = [](ReplayMode mode) {
+        auto* frame = new brls::AppletFrame(new ReplayView(mode));
+        frame->setBackground(brls::ViewBackground::NONE);
+        frame->setHeaderVisibility(brls::Visibility::GONE);
+        frame->setFooterVisibility(brls::Visibility::GONE);
+        brls::Application::pushActivity(new brls::Activity(frame));
+    };
+
+    replayFullSpeed->setText("settings/replay_full_speed"_i18n);
+    replayFullSpeed->registerClickAction([openReplay](brls::View* view) {
+        openReplay(REPLAY_FULL_SPEED);
+        return true;
+    });
+
+    replayAsRecorded->setText("settings/replay_as_recorded"_i18n);
+    replayAsRecorded->registerClickAction([openReplay](brls::View* view) {
+        openReplay(REPLAY_AS_RECORDED);
+        return true;
+    });
+
+    std::vector<int> losses = {0, 1, 2, 5, 10};
+    std::vector<std::string> lossNames;
+    for (int loss : losses)
+        lossNames.push_back(fmt::format("{}%", loss));
+    int lossIndex = (int)(std::find(losses.begin(), losses.end(), Settings::instance().replay_loss()) - losses.begin());
+    replayLoss->init("settings/replay_loss"_i18n, lossNames, lossIndex % losses.size(),
+                     [losses](int selected) {
+                         Settings::instance().set_replay_loss(losses[selected]);
+                     });
+
+    std::vector<int> jitters = {0, 5, 10, 20, 50};
+    std::vector<std::string> jitterNames;
+    for (int jitter : jitters)
+        jitterNames.push_back(fmt::format("{} ms", jitter));
+    int jitterIndex = (int)(std::find(jitters.begin(), jitters.end(), Settings::instance().replay_jitter()) - jitters.begin());
+    replayJitter->init("settings/replay_jitter"_i18n, jitterNames, jitterIndex % jitters.size(),
+                       [jitters](int selected) {
+                           Settings::instance().set_replay_jitter(jitters[selected]);
+                       });
+
+    replaySession->setText("settings/replay_session"_i18n);
+    replaySession->registerClickAction([openReplay](brls::View* view) {
+        openReplay(REPLAY_SESSION);
+        return true;
+    });
+
+    std::vector<int> durations = {30, 60, 120, 240, 480};
+    std::vector<std::string> durationNames;
+    for (int duration : durations)
+        durationNames.push_back(duration < 60 ? fmt::format("{} min", duration) : fmt::format("{} h", duration / 60));
+    int durationIndex = (int)(std::find(durations.begin(), durations.end(), Settings::instance().soak_duration()) - durations.begin());
+    soakDuration->init("settings/soak_duration"_i18n, durationNames, durationIndex % durations.size(),
+                       [durations](int selected) {
+                           Settings::instance().set_soak_duration(durations[selected]);
+                       });
+
+    std::vector<int> reconnects = {10, 50, 100, 500};
+    std::vector<std::string> reconnectNames;
+    for (int count : reconnects)
+        reconnectNames.push_back(std::to_string(count));
+    int reconnectIndex = (int)(std::find(reconnects.begin(), reconnects.end(), Settings::instance().soak_reconnects()) - reconnects.begin());
+    soakReconnects->init("settings/soak_reconnects"_i18n, reconnectNames, reconnectIndex % reconnects.size(),
+                         [reconnects](int selected) {
+                             Settings::instance().set_soak_reconnects(reconnects[selected]);
+                         });
+
+    soakTest->setText("settings/soak_test"_i18n);
+    soakTest->registerClickAction([openReplay](brls::View* view) {
+        openReplay(REPLAY_SOAK);
+        return true;
+    });
+
+    std::vector<int> gridApps = {100, 1000, 5000};
+    std::vector<std::string> gridAppNames;
+    for (int count : gridApps)
+        gridAppNames.push_back(std::to_string(count));
+    int gridAppsIndex = (int)(std::find(gridApps.begin(), gridApps.end(), Settings::instance().grid_benchmark_apps()) - gridApps.begin());
+    gridBenchmarkApps->init("settings/grid_benchmark_apps"_i18n, gridAppNames, gridAppsIndex % gridApps.size(),
+                            [gridApps](int selected) {
+                                Settings::instance().set_grid_benchmark_apps(gridApps[selected]);
+                            });
+
+    gridBenchmark->setText("settings/grid_benchmark"_i18n);
+    gridBenchmark->registerClickAction([](brls::View* view) {
+        auto* frame = new brls::AppletFrame(new GridBenchmarkView());
+        frame->setHeaderVisibility(brls::Visibility::GONE);
+        frame->setFooterVisibility(brls::Visibility::GONE);
+        brls::Application::pushActivity(new brls::Activity(frame));
+        return true;
+    });
+
+    runBenchmarks->setText("settings/run_benchmarks"_i18n);
+    runBenchmarks->registerClickAction([](brls::View* view) {
+        brls::Dialog* dialog = createLoadingDialog("settings/running_benchmarks"_i18n);
+        dialog->setCancelable(false);
+        dialog->open();
+
+        brls::async([dialog] {
+            auto results = MicroBenchmark::run_cpu_suite();
+
+            brls::sync([dialog, results]() mutable {
+                auto ui_results = MicroBenchmark::run_ui_suite();
+                results.insert(results.end(), ui_results.begin(), ui_results.end());
+                MicroBenchmark::save(results, Settings::instance().benchmark_results_path(),
+                                     brls::Application::getPlatform()->getName());
+
+                dialog->close([results] { showAlert(MicroBenchmark::format(results)); });
+            });
+        });
+        return true;
+    });
+
+    runHostBenchmarks->setText("settings/run_host_benchmarks"_i18n);
+    runHostBenchmarks->registerClickAction([](brls::View* view) {
+        brls::Dialog* dialog = createLoadingDialog("settings/running_benchmarks"_i18n);
+        dialog->setCancelable(false);
+        dialog->open();
+
+        brls::async([dialog] {
+            auto results = MicroBenchmark::run_host_suite();
+
+            brls::sync([dialog, results] {
+                MicroBenchmark::save(results, Settings::instance().benchmark_results_path(),
+                                     brls::Application::getPlatform()->getName());
+                dialog->close([results] { showAlert(MicroBenchmark::format(results)); });
+            });
+        });
+        return true;
+    });
 }
 
 void SettingsTab::updateDeadZoneItems() {
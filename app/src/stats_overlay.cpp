@@ -0,0 +1,306 @@
+//
+//  stats_overlay.cpp
+//  Moonlight
+//
+
+#include "stats_overlay.hpp"
+#include "AVFrameHolder.hpp"
+#include "AVSync.hpp"
+#include "FrameTracer.hpp"
+#include "HighResClock.hpp"
+#include "LatencyProbe.hpp"
+#include "MemoryAccounting.hpp"
+#include "Settings.hpp"
+#include "SocketQos.hpp"
+#include "StreamPercentiles.hpp"
+#include "SwitchNetwork.hpp"
+#include "SwitchPower.hpp"
+#include "ThreadProfiler.hpp"
+#include <algorithm>
+#include <nanovg.h>
+#include <sstream>
+
+using namespace brls;
+
+#define STATS_OVERLAY_MARGIN 20
+#define STATS_OVERLAY_PADDING 8
+#define STATS_GRAPH_WIDTH 360
+#define STATS_GRAPH_HEIGHT 80
+// Threads panel stays narrow enough for handheld screen
+#define STATS_THREADS_PER_LINE 4
+#define STATS_MEMORY_TAGS_PER_LINE 3
+
+static const char* overload_mode_name(DecoderOverloadMode mode) {
+    switch (mode) {
+        case DECODER_OVERLOAD_SKIP_LOOP_FILTER:
+            return "no loop filter";
+        case DECODER_OVERLOAD_SKIP_NONREF:
+            return "no loop filter, skip non-reference frames";
+        case DECODER_OVERLOAD_FLUSH_QUEUE:
+            return "skip non-reference frames, flush queue";
+        default:
+            return "normal";
+    }
+}
+
+void StatsOverlay::reset() {
+    m_updated_us = 0;
+    m_frame_count = 0;
+    m_last_frame_us = 0;
+    m_cost_us = 0;
+    m_cost_frames = 0;
+}
+
+void StatsOverlay::draw(NVGcontext* vg, float width, float height, MoonlightSession* session, bool graph) {
+    uint64_t start = HighResClock::now_us();
+
+    if (m_last_frame_us) {
+        m_frame_times[m_frame_index] = (float)(start - m_last_frame_us) / 1000;
+        m_frame_index = (m_frame_index + 1) % STATS_GRAPH_SAMPLES;
+        m_frame_count = std::min<size_t>(m_frame_count + 1, STATS_GRAPH_SAMPLES);
+    }
+    m_last_frame_us = start;
+
+    nvgFontFaceId(vg, Application::getFont(FONT_REGULAR));
+    nvgFontSize(vg, STATS_OVERLAY_FONT_SIZE);
+    nvgTextAlign(vg, NVG_ALIGN_LEFT | NVG_ALIGN_TOP);
+
+    if (start - m_updated_us >= STATS_OVERLAY_REFRESH_US) {
+        m_updated_us = start;
+        update(vg, session);
+    }
+
+    float x = STATS_OVERLAY_MARGIN;
+    float y = STATS_OVERLAY_MARGIN;
+    float box_height = m_line_height * m_lines.size();
+
+    // Plain backdrop is one quad, blurred shadow was a second text pass
+    nvgBeginPath(vg);
+    nvgRect(vg, x - STATS_OVERLAY_PADDING, y - STATS_OVERLAY_PADDING,
+            m_box_width + STATS_OVERLAY_PADDING * 2, box_height + STATS_OVERLAY_PADDING * 2);
+    nvgFillColor(vg, nvgRGBA(0, 0, 0, 160));
+    nvgFill(vg);
+
+    nvgFillColor(vg, nvgRGBA(0, 255, 0, 255));
+    for (auto& line : m_lines) {
+        nvgText(vg, x, y, line.c_str(), nullptr);
+        y += m_line_height;
+    }
+
+    if (graph)
+        drawGraph(vg, x, y + STATS_OVERLAY_PADDING * 3, STATS_GRAPH_WIDTH, STATS_GRAPH_HEIGHT);
+
+    m_cost_us += HighResClock::now_us() - start;
+    m_cost_frames++;
+}
+
+void StatsOverlay::update(NVGcontext* vg, MoonlightSession* session) {
+    if (m_cost_frames) {
+        m_cost_ms = (float)m_cost_us / m_cost_frames / 1000;
+        m_cost_us = 0;
+        m_cost_frames = 0;
+    }
+
+    auto stats = session->session_stats();
+
+    auto statistics = fmt::format(
+                "Estimated host PC frame rate: {:.{}f} FPS\n"
+                    "Incoming frame rate from network: {:.{}f} FPS\n"
+                    "Decoding frame rate: {:.{}f} FPS\n"
+                    "Rendering frame rate: {:.{}f} FPS\n",
+                stats->video_decode_stats.current_host_fps, 2,
+                stats->video_decode_stats.current_received_fps, 2,
+                stats->video_decode_stats.current_decoded_fps, 2,
+                stats->video_render_stats.rendered_fps, 2);
+
+    statistics += fmt::format("Frames dropped by your network connection: {}\n"
+                              "Corrupt frames | IDR requests: {} | {}\n"
+                              "Backlog skips | frames skipped: {} | {}\n"
+                              "Average receive time: {:.{}f} | {:.{}f} ms\n"
+                              "Average decoding time: {:.{}f} | {:.{}f} ms\n"
+                              "Decoder threading: {} | pipeline latency: {:.{}f} ms\n"
+                              "Decoder overload mode: {}\n"
+                              "Average copy time: {:.{}f} ms | zero-copy frames: {}\n"
+                              "Peak packet size: {} KB\n"
+                              "Decoder surfaces | copied into: {} | {} ({:.{}f} of {:.{}f} MB)\n"
+                              "Average rendering time CPU | GPU: {:.{}f} | {} ms\n"
+                              "Frame holder push/get rate: {}\n"
+                              "Frames queue reuses | overflow | stale drops: {} | {} | {}\n"
+                              "Frames queue: {}\n"
+                              "Estimated display refresh: {:.{}f} Hz\n"
+                              "Audio queue | target: {:.{}f} | {:.{}f} ms\n"
+                              "Audio decoding time: {:.{}f} ms\n"
+                              "Audio underruns | dropped packets: {} | {}\n"
+                              "Audio lost packets concealed | recovered: {} | {}",
+                              stats->video_decode_stats.network_dropped_frames,
+                              stats->video_decode_stats.corrupt_frames,
+                              stats->video_decode_stats.idr_requests,
+                              stats->video_decode_stats.backlog_skips,
+                              stats->video_decode_stats.backlog_skipped_frames,
+                              stats->video_decode_stats.current_receive_time, 2,
+                              stats->video_decode_stats.session_receive_time, 2,
+                              stats->video_decode_stats.current_decoding_time, 2,
+                              stats->video_decode_stats.session_decoding_time, 2,
+                              stats->video_decode_stats.frame_threaded ? "frame" : "slice",
+                              stats->video_decode_stats.pipeline_latency, 1,
+                              overload_mode_name(stats->video_decode_stats.overload_mode),
+                              stats->video_decode_stats.current_copy_time, 3,
+                              stats->video_decode_stats.total_zero_copy_frames,
+                              stats->video_decode_stats.peak_packet_size / 1024,
+                              stats->video_decode_stats.surfaces,
+                              stats->video_decode_stats.surfaces_allocated,
+                              stats->video_decode_stats.surface_memory_mb, 1,
+                              stats->video_decode_stats.surface_budget_mb, 0,
+                              stats->video_render_stats.rendering_time, 2,
+                              stats->video_render_stats.gpu_rendering_time > 0
+                                  ? fmt::format("{:.{}f}", stats->video_render_stats.gpu_rendering_time, 2)
+                                  : "n/a",
+                              session->frames().getStat(),
+                              session->frames().getFakeFrameStat(),
+                              session->frames().getFrameOverflowStat(),
+                              session->frames().getFrameStaleStat(),
+                              session->frames().getFrameQueueSize(),
+                              session->frames().getDisplayRefreshRate(), 2,
+                              stats->audio_render_stats.queued_time, 1,
+                              stats->audio_render_stats.target_time, 1,
+                              stats->audio_render_stats.decoding_time, 3,
+                              stats->audio_render_stats.underruns,
+                              stats->audio_render_stats.dropped_packets,
+                              stats->audio_render_stats.plc_packets,
+                              stats->audio_render_stats.fec_packets);
+
+    // Whole session, spikes averages above smooth out stay in p99 and max
+    statistics += "\nSession p50 | p95 | p99 | max ms:";
+    for (int i = 0; i < STREAM_STAT_COUNT; i++) {
+        auto percentiles = StreamPercentiles::instance().summary((StreamStat)i);
+        statistics += fmt::format("\n    {}: {:.{}f} | {:.{}f} | {:.{}f} | {:.{}f}",
+                                  StreamPercentiles::name((StreamStat)i),
+                                  percentiles.p50_ms, 2, percentiles.p95_ms, 2,
+                                  percentiles.p99_ms, 2, percentiles.max_ms, 2);
+    }
+
+    auto latency = FrameTracer::instance().summary();
+    statistics += fmt::format("\nEnd-to-end latency p50 | p99: {:.{}f} | {:.{}f} ms\n"
+                              "Latency histogram <8 | <16 | <33 | <50 | 50+ ms: {} | {} | {} | {} | {}",
+                              latency.p50_ms, 2, latency.p99_ms, 2,
+                              latency.histogram[0], latency.histogram[1], latency.histogram[2],
+                              latency.histogram[3], latency.histogram[4]);
+
+    // Latency above is what the QoS option is compared by
+    if (int marked = SocketQos::marked())
+        statistics += fmt::format("\nQoS: DSCP {} on {} sockets", SOCKET_QOS_DSCP, marked);
+
+#ifdef __SWITCH__
+    // Packets the socket had no room for show up as network drops above
+    auto& network = SwitchNetwork::profile();
+    statistics += fmt::format("\nSocket UDP | TCP receive buffer: {} | {} KB{}",
+                              network.udp_rx_buffer / 1024, network.tcp_rx_buffer / 1024,
+                              network.applied ? fmt::format(" (for {} Mbps)", network.bitrate_kbps / 1000) : " (defaults)");
+
+    auto power = SwitchPower::status();
+    statistics += fmt::format("\nPower mode: {}{} | battery {}%{}",
+                              power.docked ? "docked" : "handheld", power.boosted ? ", CPU boost" : "",
+                              power.battery_percent, power.charging ? " (charging)" : "");
+#endif
+
+    if (Settings::instance().auto_bitrate())
+        statistics += fmt::format("\nAuto bitrate: {:.{}f} Mbps", session->bitrate() / 1000.f, 1);
+
+    if (LatencyProbe::instance().enabled()) {
+        auto probe = LatencyProbe::instance().summary();
+        if (!probe.supported)
+            statistics += "\nInput latency: not supported by this decoder";
+        else
+            statistics += fmt::format("\nInput latency min | p50 | p95 | max: {:.{}f} | {:.{}f} | {:.{}f} | {:.{}f} ms"
+                                      " ({} samples, {} missed)",
+                                      probe.min_ms, 1, probe.p50_ms, 1, probe.p95_ms, 1, probe.max_ms, 1,
+                                      probe.samples, probe.misses);
+    }
+
+    if (stats->audio_render_stats.output_latency > 0)
+        statistics += fmt::format("\nAudio output latency: {:.{}f} ms", stats->audio_render_stats.output_latency, 1);
+
+    auto& sync = AVSync::instance();
+    statistics += fmt::format("\nA/V offset: {:+.{}f} ms | audio queue bias: {:+.{}f} ms{}",
+                              sync.offset_ms(), 1, sync.audio_bias_ms(), 1,
+                              sync.video_max_age_us() ? " | dropping late video" : "");
+
+    auto& profile = ThreadProfiler::instance().profile();
+    for (size_t i = 0; i < profile.threads.size(); i += STATS_THREADS_PER_LINE) {
+        statistics += i == 0 ? "\nThreads CPU: " : "\n    ";
+        for (size_t j = i; j < std::min(i + STATS_THREADS_PER_LINE, profile.threads.size()); j++)
+            statistics += fmt::format("{}{} {:.{}f}%", j > i ? " | " : "",
+                                      profile.threads[j].name, profile.threads[j].cpu_percent, 0);
+    }
+    if (!profile.cores.empty()) {
+        statistics += profile.cores_app_only ? "\nCores load by app threads:" : "\nCores load:";
+        for (size_t i = 0; i < profile.cores.size(); i++)
+            statistics += fmt::format("{} {}: {:.{}f}%", i ? " |" : "", i, profile.cores[i], 0);
+    }
+
+    for (int i = 0; i < MEM_TAG_COUNT; i += STATS_MEMORY_TAGS_PER_LINE) {
+        statistics += i == 0 ? "\nMemory now | peak MB: " : "\n    ";
+        for (int j = i; j < std::min(i + STATS_MEMORY_TAGS_PER_LINE, (int)MEM_TAG_COUNT); j++) {
+            auto tag = (MemoryTag)j;
+            statistics += fmt::format("{}{} {:.{}f} | {:.{}f}", j > i ? ", " : "", MemoryAccounting::name(tag),
+                                      (float)MemoryAccounting::current(tag) / (1 << 20), 1,
+                                      (float)MemoryAccounting::peak(tag) / (1 << 20), 1);
+        }
+    }
+
+    statistics += fmt::format("\nStats overlay: {:.{}f} ms", m_cost_ms, 3);
+
+    m_lines.clear();
+    std::istringstream stream(statistics);
+    for (std::string line; std::getline(stream, line);)
+        m_lines.push_back(line);
+
+    m_box_width = 0;
+    for (auto& line : m_lines)
+        m_box_width = std::max(m_box_width, nvgTextBounds(vg, 0, 0, line.c_str(), nullptr, nullptr));
+
+    float lineh;
+    nvgTextMetrics(vg, nullptr, nullptr, &lineh);
+    m_line_height = lineh;
+}
+
+void StatsOverlay::drawGraph(NVGcontext* vg, float x, float y, float width, float height) {
+    nvgBeginPath(vg);
+    nvgRect(vg, x - STATS_OVERLAY_PADDING, y - STATS_OVERLAY_PADDING,
+            width + STATS_OVERLAY_PADDING * 2, height + STATS_OVERLAY_PADDING * 2);
+    nvgFillColor(vg, nvgRGBA(0, 0, 0, 160));
+    nvgFill(vg);
+
+    // Reference lines at 120, 60 and 30 FPS frame times
+    nvgBeginPath(vg);
+    for (float ms : {1000.f / 120, 1000.f / 60, 1000.f / 30}) {
+        float line_y = y + height - height * ms / STATS_GRAPH_MAX_MS;
+        nvgMoveTo(vg, x, line_y);
+        nvgLineTo(vg, x + width, line_y);
+    }
+    nvgStrokeColor(vg, nvgRGBA(255, 255, 255, 80));
+    nvgStrokeWidth(vg, 1);
+    nvgStroke(vg);
+
+    if (m_frame_count < 2)
+        return;
+
+    // Whole graph is a single stroked path, oldest sample on the left
+    float step = width / (STATS_GRAPH_SAMPLES - 1);
+    size_t first = (m_frame_index + STATS_GRAPH_SAMPLES - m_frame_count) % STATS_GRAPH_SAMPLES;
+    float offset = (float)(STATS_GRAPH_SAMPLES - m_frame_count) * step;
+
+    nvgBeginPath(vg);
+    for (size_t i = 0; i < m_frame_count; i++) {
+        float ms = std::min(m_frame_times[(first + i) % STATS_GRAPH_SAMPLES], STATS_GRAPH_MAX_MS);
+        float point_x = x + offset + step * i;
+        float point_y = y + height - height * ms / STATS_GRAPH_MAX_MS;
+        if (i == 0)
+            nvgMoveTo(vg, point_x, point_y);
+        else
+            nvgLineTo(vg, point_x, point_y);
+    }
+    nvgStrokeColor(vg, nvgRGBA(0, 255, 0, 255));
+    nvgStrokeWidth(vg, 2);
+    nvgStroke(vg);
+}
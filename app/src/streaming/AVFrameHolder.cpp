@@ -6,61 +6,208 @@
 //
 
 #include "AVFrameHolder.hpp"
+#include "AVSync.hpp"
+#include "DisplayVsync.hpp"
+#include "HighResClock.hpp"
+#include "PipelineTrace.hpp"
+#include <algorithm>
 
 AVFrameQueue::AVFrameQueue() {}
 
-AVFrameQueue::~AVFrameQueue() {
-    for (; !queue.empty(); queue.pop()) {
-        AVFrame* frame = queue.front();
-        av_frame_free(&frame);
-    }
+// Frames are owned by decoder, ring only stores pointers to them
+AVFrameQueue::~AVFrameQueue() = default;
 
-    for (; !freeQueue.empty(); freeQueue.pop()) {
-        AVFrame* frame = freeQueue.front();
-        av_frame_free(&frame);
-    }
+void AVFrameQueue::prepare(size_t limit, uint64_t max_age_us) {
+    this->limit = std::max<size_t>(limit, 1);
+    maxAge = max_age_us;
+    // One spare slot, so producer never writes into the slot consumer is reading
+    capacity = this->limit + 2;
+    ring = std::make_unique<std::atomic<AVFrame*>[]>(capacity);
+    timestamps = std::make_unique<std::atomic<uint64_t>[]>(capacity);
+    head = 0;
+    tail = 0;
 }
 
-void AVFrameQueue::push(AVFrame* item) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    queue.push(item);
+void AVFrameQueue::push(AVFrame* item, uint64_t timestamp) {
+    if (!ring) return;
+    TRACE_SCOPE("Queue push");
+
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
 
-    if (queue.size() > limit) {
-        queue.pop();
-        framesDroppedStat ++;
+    // Drop the oldest frame to keep queue within the limit
+    while (h - t >= limit) {
+        if (tail.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel)) {
+            framesOverflowStat.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
     }
+
+    ring[h % capacity].store(item, std::memory_order_relaxed);
+    timestamps[h % capacity].store(timestamp, std::memory_order_relaxed);
+    head.store(h + 1, std::memory_order_release);
 }
 
 AVFrame* AVFrameQueue::pop() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-
-    if (!queue.empty()) {
-        AVFrame* item = queue.front();
-        queue.pop();
-        bufferFrame = item;
-    } else {
-        fakeFrameUsedStat ++;
+    if (!ring) return bufferFrame;
+    TRACE_SCOPE("Queue pop");
+
+    size_t t = tail.load(std::memory_order_acquire);
+    while (t != head.load(std::memory_order_acquire)) {
+        AVFrame* item = ring[t % capacity].load(std::memory_order_relaxed);
+        if (tail.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel)) {
+            bufferFrame = item;
+            generation++;
+            return bufferFrame;
+        }
     }
 
+    fakeFrameUsedStat.fetch_add(1, std::memory_order_relaxed);
     return bufferFrame;
 }
 
+AVFrame* AVFrameQueue::popLatest(uint64_t deadline) {
+    if (!ring) return bufferFrame;
+    TRACE_SCOPE("Queue pop");
+
+    bool popped = false;
+    size_t t = tail.load(std::memory_order_acquire);
+    while (t != head.load(std::memory_order_acquire)) {
+        AVFrame* item = ring[t % capacity].load(std::memory_order_relaxed);
+        uint64_t timestamp = timestamps[t % capacity].load(std::memory_order_relaxed);
+        if (timestamp > deadline)
+            break;
+
+        if (tail.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel)) {
+            if (popped) framesStaleStat.fetch_add(1, std::memory_order_relaxed);
+            bufferFrame = item;
+            popped = true;
+            t++;
+        }
+    }
+
+    if (popped) generation++;
+    else fakeFrameUsedStat.fetch_add(1, std::memory_order_relaxed);
+    return bufferFrame;
+}
+
+void AVFrameQueue::dropStale(uint64_t now, uint64_t sync_age_us) {
+    uint64_t age = sync_age_us != 0 && (maxAge == 0 || sync_age_us < maxAge) ? sync_age_us : maxAge;
+    if (!ring || age == 0 || now < age) return;
+
+    uint64_t deadline = now - age;
+    size_t t = tail.load(std::memory_order_acquire);
+    while (head.load(std::memory_order_acquire) - t > 1) {
+        uint64_t timestamp = timestamps[t % capacity].load(std::memory_order_relaxed);
+        if (timestamp >= deadline)
+            break;
+
+        // Producer could have dropped it already, then t is reloaded
+        if (tail.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel)) {
+            framesStaleStat.fetch_add(1, std::memory_order_relaxed);
+            t++;
+        }
+    }
+}
+
+void AVFrameQueue::flush() {
+    if (!ring) return;
+
+    // Producer could drop the oldest one meanwhile, then t is reloaded
+    size_t t = tail.load(std::memory_order_acquire);
+    size_t h = head.load(std::memory_order_acquire);
+    while (t != h && !tail.compare_exchange_weak(t, h, std::memory_order_acq_rel))
+        h = head.load(std::memory_order_acquire);
+}
+
 size_t AVFrameQueue::size() const {
-    return queue.size();
+    // Tail first, it could never pass the head loaded after it
+    size_t t = tail.load(std::memory_order_acquire);
+    return head.load(std::memory_order_acquire) - t;
 }
 
 size_t AVFrameQueue::getFakeFrameUsage() const {
-    return fakeFrameUsedStat;
+    return fakeFrameUsedStat.load(std::memory_order_relaxed);
 }
 
 size_t AVFrameQueue::getFramesDropStat() const {
-    return framesDroppedStat;
+    return getFramesOverflowStat() + getFramesStaleStat();
+}
+
+size_t AVFrameQueue::getFramesOverflowStat() const {
+    return framesOverflowStat.load(std::memory_order_relaxed);
+}
+
+size_t AVFrameQueue::getFramesStaleStat() const {
+    return framesStaleStat.load(std::memory_order_relaxed);
 }
 
 void AVFrameQueue::cleanup() {
-    std::lock_guard<std::mutex> lock(m_mutex);
     fakeFrameUsedStat = 0;
-    framesDroppedStat = 0;
+    framesOverflowStat = 0;
+    framesStaleStat = 0;
     bufferFrame = nullptr;
-    queue = {};
-}
\ No newline at end of file
+    tail = head.load();
+}
+
+// MARK: - AVFrameHolder
+
+// Display refresh estimation limits, 20 - 240 Hz
+#define MIN_DISPLAY_INTERVAL_US (1000000 / 240)
+#define MAX_DISPLAY_INTERVAL_US (1000000 / 20)
+
+void AVFrameHolder::setFrozen(bool frozen) {
+    if (m_frozen.exchange(frozen) == frozen)
+        return;
+
+    // Frames queued before freezing are long stale by now
+    if (!frozen)
+        m_frame_queue.flush();
+}
+
+AVFrame* AVFrameHolder::nextFrame() {
+    uint64_t now = HighResClock::now_us();
+
+    // Real vsync timeline where display reports it, otherwise UI draws
+    // once per vsync, so interval between calls follows display refresh
+    uint64_t vsync = 0, period = 0;
+    bool timeline = DisplayVsync::instance().next_vsync(now, &vsync, &period);
+    if (timeline) {
+        m_display_interval_us = std::clamp<uint64_t>(period, MIN_DISPLAY_INTERVAL_US, MAX_DISPLAY_INTERVAL_US);
+    } else if (m_last_get_us != 0) {
+        uint64_t delta = std::clamp<uint64_t>(now - m_last_get_us, MIN_DISPLAY_INTERVAL_US, MAX_DISPLAY_INTERVAL_US);
+        m_display_interval_us = m_display_interval_us == 0 ? delta : (m_display_interval_us * 15 + delta) / 16;
+    }
+    m_last_get_us = now;
+
+    if (m_frozen.load(std::memory_order_relaxed))
+        return m_frame_queue.current();
+
+    // Late burst would otherwise be played back frame by frame
+    m_frame_queue.dropStale(now, AVSync::instance().video_max_age_us());
+
+    switch (m_pacing) {
+    case PACING_LOWEST_LATENCY:
+        // Always present the newest decoded frame
+        return m_frame_queue.popLatest(UINT64_MAX);
+    case PACING_SMOOTHEST:
+        // Present frames with constant delay of one and a half refresh,
+        // so arrival jitter doesn't move frame across vsync boundary.
+        // Arrival is taken after decode, so slow decodes are counted in.
+        // With known timeline delay is measured to vsync frame lands on,
+        // wake up jitter of UI thread doesn't move it either
+        if (timeline)
+            return m_frame_queue.popLatest(vsync - std::min(vsync, period * 3 / 2));
+        if (m_display_interval_us != 0)
+            return m_frame_queue.popLatest(now - std::min(now, m_display_interval_us / 2));
+        return m_frame_queue.pop();
+    case PACING_QUEUE:
+    default:
+        // Stream faster than display would fill the queue one frame per
+        // refresh, so display takes the newest and skips the rest
+        if (m_display_interval_us != 0 && m_stream_interval_us != 0 &&
+            m_stream_interval_us * 10 < m_display_interval_us * 9)
+            return m_frame_queue.popLatest(UINT64_MAX);
+        return m_frame_queue.pop();
+    }
+}
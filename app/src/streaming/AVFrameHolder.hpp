@@ -1,58 +1,103 @@
 #pragma once
 
-#include "Singleton.hpp"
-#include <mutex>
+#include <atomic>
 #include <functional>
-#include <queue>
+#include <memory>
 #include "Settings.hpp"
+#include "HighResClock.hpp"
+#include "FrameArrival.hpp"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+// Fixed capacity single producer (decoder thread) / single consumer
+// (UI thread) ring. When the ring is full, the producer drops the oldest
+// frame, so both sides could advance the tail, that's why it's moved by CAS.
 class AVFrameQueue {
 public:
     explicit AVFrameQueue();
     ~AVFrameQueue();
 
-    void push(AVFrame* item);
+    // Frames older than max_age_us are dropped by dropStale(), 0 keeps them
+    void prepare(size_t limit, uint64_t max_age_us = 0);
+    void push(AVFrame* item, uint64_t timestamp);
     AVFrame* pop();
+    // Pops every frame which arrived before deadline and returns the latest
+    // of them, older ones are counted as stale
+    AVFrame* popLatest(uint64_t deadline);
+    // Consumer side, skips frames past max age while a newer one is queued,
+    // so the newest frame is still shown when the whole queue is late.
+    // Shorter sync_age_us tightens max age while video is behind audio
+    void dropStale(uint64_t now, uint64_t sync_age_us = 0);
+
+    // Consumer side, drops everything queued
+    void flush();
+    // Frame handed out last, shown again while nothing new is popped
+    [[nodiscard]] AVFrame* current() const { return bufferFrame; }
 
     [[nodiscard]] size_t size() const;
     [[nodiscard]] size_t getFakeFrameUsage() const;
+    // Overflow drops are made by full queue on push, stale ones on pop
     [[nodiscard]] size_t getFramesDropStat() const;
+    [[nodiscard]] size_t getFramesOverflowStat() const;
+    [[nodiscard]] size_t getFramesStaleStat() const;
+    // Grows with every new frame handed out, stays the same for repeats
+    [[nodiscard]] uint64_t getGeneration() const { return generation; }
 
     void cleanup();
 
 private:
-    friend class AVFrameHolder;
-    size_t limit;
-    std::queue<AVFrame*> queue;
-    std::queue<AVFrame*> freeQueue;
+    size_t limit = 1;
+    size_t capacity = 0;
+    uint64_t maxAge = 0;
+    std::unique_ptr<std::atomic<AVFrame*>[]> ring;
+    std::unique_ptr<std::atomic<uint64_t>[]> timestamps;
+    std::atomic<size_t> head = 0;
+    std::atomic<size_t> tail = 0;
     AVFrame* bufferFrame = nullptr;
-    std::mutex m_mutex;
-    size_t fakeFrameUsedStat = 0;
-    size_t framesDroppedStat = 0;
+    uint64_t generation = 0;
+    std::atomic<size_t> fakeFrameUsedStat = 0;
+    std::atomic<size_t> framesOverflowStat = 0;
+    std::atomic<size_t> framesStaleStat = 0;
 };
 
-class AVFrameHolder : public Singleton<AVFrameHolder> {
+// Frame queue between decoder and renderer of one pipeline, session and
+// replay views own theirs, so a draining session never sees new frames
+class AVFrameHolder {
   public:
     void push(AVFrame* frame) {
-        m_frame_queue.push(frame);
+        if (m_frozen.load(std::memory_order_relaxed))
+            return;
+        m_frame_queue.push(frame, HighResClock::now_us());
         stat ++;
+        FrameArrival::notify();
     }
 
-    void get(const std::function<void(AVFrame*)>& fn) {
-        auto frame = m_frame_queue.pop();
+    // Frozen holder shows the last frame with the same generation, so
+    // renderers skip upload, and takes no new ones. Decoders check it
+    // to skip copying frames nobody would see
+    void setFrozen(bool frozen);
+    [[nodiscard]] bool isFrozen() const { return m_frozen.load(std::memory_order_relaxed); }
 
+    // Calls fn with frame to show and its generation, renderers compare
+    // it with the last drawn one to skip work for a repeated frame.
+    // Template, so draw lambda is called directly, once per UI frame
+    template <typename F> void get(F&& fn) {
+        AVFrame* frame = nextFrame();
         if (frame) {
-            fn(frame);
+            fn(frame, m_frame_queue.getGeneration());
             stat --;
         }
     }
 
-    void prepare() {
-        m_frame_queue.limit = Settings::instance().frames_queue_size();
+    void prepare(int queue_size, int stream_fps) {
+        m_frame_queue.prepare(queue_size, (uint64_t)Settings::instance().frame_max_age() * 1000);
+        m_stream_interval_us = stream_fps > 0 ? 1000000 / stream_fps : 0;
+        m_pacing = Settings::instance().frame_pacing();
+        m_display_interval_us = 0;
+        m_last_get_us = 0;
+        m_frozen = false;
     }
 
     void cleanup() {
@@ -60,12 +105,27 @@ class AVFrameHolder : public Singleton<AVFrameHolder> {
         stat = 0;
     }
 
+    // Frame shown last, null before the first one, UI thread
+    [[nodiscard]] AVFrame* current() const { return m_frame_queue.current(); }
+
     [[nodiscard]] int getStat() const { return stat; }
     [[nodiscard]] size_t getFakeFrameStat() const { return m_frame_queue.getFakeFrameUsage(); }
     [[nodiscard]] size_t getFrameDropStat() const { return m_frame_queue.getFramesDropStat(); }
+    [[nodiscard]] size_t getFrameOverflowStat() const { return m_frame_queue.getFramesOverflowStat(); }
+    [[nodiscard]] size_t getFrameStaleStat() const { return m_frame_queue.getFramesStaleStat(); }
     [[nodiscard]] size_t getFrameQueueSize() const { return m_frame_queue.size(); }
+    [[nodiscard]] float getDisplayRefreshRate() const {
+        return m_display_interval_us > 0 ? 1000000.0f / (float)m_display_interval_us : 0;
+    }
 
   private:
+    AVFrame* nextFrame();
+
     AVFrameQueue m_frame_queue;
-    int stat = 0;
+    FramePacing m_pacing = PACING_QUEUE;
+    uint64_t m_display_interval_us = 0;
+    uint64_t m_stream_interval_us = 0;
+    uint64_t m_last_get_us = 0;
+    std::atomic<bool> m_frozen = false;
+    std::atomic<int> stat = 0;
 };
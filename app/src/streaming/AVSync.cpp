@@ -0,0 +1,56 @@
+//
+//  AVSync.cpp
+//  Moonlight
+//
+
+#include "AVSync.hpp"
+#include "HighResClock.hpp"
+#include <algorithm>
+#include <cmath>
+
+void AVSync::reset() {
+    m_audio_bias_ms = 0;
+    m_video_max_age_us = 0;
+    m_offset_ms = 0;
+    m_video_delay_ms = 0;
+    m_measured = false;
+    m_last_update_us = 0;
+}
+
+void AVSync::update(const AudioRenderStats& audio, float video_delay_ms, uint64_t frame_interval_us) {
+    if (video_delay_ms > 0)
+        m_video_delay_ms = m_video_delay_ms > 0 ? m_video_delay_ms + (video_delay_ms - m_video_delay_ms) / 16.0f
+                                                : video_delay_ms;
+
+    uint64_t now = HighResClock::now_us();
+    if (now - m_last_update_us < AV_SYNC_INTERVAL_US)
+        return;
+    m_last_update_us = now;
+
+    // Nothing to sync before both streams are playing
+    if (audio.decoded_packets == 0 || m_video_delay_ms <= 0)
+        return;
+
+    float offset = audio.queued_time + audio.output_latency - m_video_delay_ms;
+    m_offset_ms = m_measured ? m_offset_ms + (offset - m_offset_ms) / 4.0f : offset;
+    m_measured = true;
+
+    float bias = m_audio_bias_ms.load(std::memory_order_relaxed);
+
+    if (m_offset_ms > AV_SYNC_DEADBAND_MS) {
+        // Audio is late, its queue is shortened, video is left alone
+        m_video_max_age_us = 0;
+        bias = std::max(bias - AV_SYNC_STEP_MS, -(float)AV_SYNC_MAX_BIAS_MS);
+    } else if (m_offset_ms < -AV_SYNC_DEADBAND_MS) {
+        // Video is late, queued frames which add to it are skipped, two
+        // intervals still leave room for arrival jitter. Audio is held
+        // back only if what's left comes from decoding and display
+        m_video_max_age_us = frame_interval_us * 2;
+        if (frame_interval_us == 0 || -m_offset_ms * 1000 > frame_interval_us * 3)
+            bias = std::min(bias + AV_SYNC_STEP_MS, (float)AV_SYNC_MAX_BIAS_MS);
+    } else {
+        m_video_max_age_us = 0;
+    }
+
+    m_audio_bias_ms.store(bias, std::memory_order_relaxed);
+}
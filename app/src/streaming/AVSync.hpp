@@ -0,0 +1,50 @@
+//
+//  AVSync.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "IAudioRenderer.hpp"
+#include "Singleton.hpp"
+#include <atomic>
+#include <cstdint>
+
+// Correction is only changed that often, offset of a single frame says
+// nothing, and audio queue moves slowly by stretching anyway
+#define AV_SYNC_INTERVAL_US 250000
+// Offsets within that aren't corrected, they can't be noticed
+#define AV_SYNC_DEADBAND_MS 20
+// Audio queue target is moved from its own jitter target by that much
+// per interval, and not further than max bias in total
+#define AV_SYNC_STEP_MS 2
+#define AV_SYNC_MAX_BIAS_MS 80
+
+// Keeps audio and video delays after arrival close to each other.
+// Audio playback position is the master clock: queue still to be played
+// plus device latency is how late audio is heard, video is compared to
+// it by end-to-end latency of presented frames. Late audio gets shorter
+// queue, late video has queued frames dropped first and only then
+// audio is held back by deeper queue
+class AVSync : public Singleton<AVSync> {
+  public:
+    void reset();
+
+    // UI thread, every drawn frame, video delay is 0 when it's unknown
+    void update(const AudioRenderStats& audio, float video_delay_ms, uint64_t frame_interval_us);
+
+    // Audio thread, added to renderer queue target, could be negative
+    [[nodiscard]] float audio_bias_ms() const { return m_audio_bias_ms.load(std::memory_order_relaxed); }
+    // Queued video frames older than that are dropped, 0 when video isn't late
+    [[nodiscard]] uint64_t video_max_age_us() const { return m_video_max_age_us; }
+    // Positive when audio is heard later than video
+    [[nodiscard]] float offset_ms() const { return m_offset_ms; }
+
+  private:
+    std::atomic<float> m_audio_bias_ms = 0;
+    uint64_t m_video_max_age_us = 0;
+    float m_offset_ms = 0;
+    float m_video_delay_ms = 0;
+    bool m_measured = false;
+    uint64_t m_last_update_us = 0;
+};
@@ -0,0 +1,70 @@
+//
+//  AdaptiveBitrate.cpp
+//  Moonlight
+//
+
+#include "AdaptiveBitrate.hpp"
+#include "HighResClock.hpp"
+#include <borealis.hpp>
+#include <algorithm>
+
+void AdaptiveBitrate::reset(int max_kbps, int start_kbps) {
+    *this = AdaptiveBitrate();
+    m_max_bitrate = max_kbps;
+    m_bitrate = start_kbps > 0 ? std::min(start_kbps, max_kbps) : max_kbps;
+}
+
+int AdaptiveBitrate::update(const VideoDecodeStats& stats, bool connection_poor, int fps) {
+    uint64_t now = HighResClock::now_us();
+    uint32_t dropped = stats.network_dropped_frames;
+    uint32_t received = stats.total_received_frames + stats.current_received_frames;
+
+    // Decoder counters start over after reconnect
+    if (m_window_start_us == 0 || dropped < m_last_dropped || received < m_last_received) {
+        m_window_start_us = now;
+        m_last_dropped = dropped;
+        m_last_received = received;
+        return 0;
+    }
+
+    m_window_poor |= connection_poor;
+    if (fps > 0)
+        m_window_slow_decode |= stats.current_decoding_time > 900.f / fps;
+
+    if (now - m_window_start_us < ABR_WINDOW_US)
+        return 0;
+
+    uint32_t windowDropped = dropped - m_last_dropped;
+    uint32_t windowReceived = received - m_last_received;
+    bool bad = m_window_poor || m_window_slow_decode ||
+               windowDropped > (windowDropped + windowReceived) * ABR_DROP_RATIO;
+
+    m_window_start_us = now;
+    m_last_dropped = dropped;
+    m_last_received = received;
+    m_window_poor = false;
+    m_window_slow_decode = false;
+
+    if (now < m_hold_until_us)
+        return 0;
+
+    m_bad_windows = bad ? m_bad_windows + 1 : 0;
+    m_good_windows = bad ? 0 : m_good_windows + 1;
+
+    int bitrate = m_bitrate;
+    if (m_bad_windows >= ABR_BAD_WINDOWS)
+        bitrate = std::max((int)(m_bitrate * ABR_DECREASE), std::min(ABR_MIN_BITRATE, m_max_bitrate));
+    else if (m_good_windows >= ABR_GOOD_WINDOWS)
+        bitrate = std::min((int)(m_bitrate * ABR_INCREASE), m_max_bitrate);
+
+    if (bitrate == m_bitrate)
+        return 0;
+
+    brls::Logger::info("AdaptiveBitrate: {} -> {} kbps, dropped {} of {} frames",
+                       m_bitrate, bitrate, windowDropped, windowDropped + windowReceived);
+    m_bitrate = bitrate;
+    m_bad_windows = 0;
+    m_good_windows = 0;
+    m_hold_until_us = now + ABR_HOLD_US;
+    return bitrate;
+}
@@ -0,0 +1,53 @@
+//
+//  AdaptiveBitrate.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "IVideoDecoder.hpp"
+#include <cstdint>
+
+// Stats are judged in windows of this length
+#define ABR_WINDOW_US 2000000
+// Window is bad when more frames than this part are lost
+#define ABR_DROP_RATIO 0.03f
+// Bad windows in a row before bitrate goes down, good ones before it goes up
+#define ABR_BAD_WINDOWS 2
+#define ABR_GOOD_WINDOWS 15
+#define ABR_DECREASE 0.7f
+#define ABR_INCREASE 1.2f
+#define ABR_MIN_BITRATE 1500
+// Every change reconnects stream, so after one there is a pause
+// to let new bitrate settle
+#define ABR_HOLD_US 20000000
+
+// Picks stream bitrate from client side stats. Host can't change it
+// inside running session, so every new value means fast reconnect
+class AdaptiveBitrate {
+  public:
+    // max is bitrate from settings, it's never exceeded, stream starts
+    // with start_kbps when it's given
+    void reset(int max_kbps, int start_kbps = 0);
+
+    // Called every drawn frame, returns new bitrate when it should change or 0
+    int update(const VideoDecodeStats& stats, bool connection_poor, int fps);
+
+    [[nodiscard]] int bitrate() const { return m_bitrate; }
+
+    // Stats of new connection are not compared with old one
+    void restarted() { m_window_start_us = 0; }
+
+  private:
+    int m_max_bitrate = 0;
+    int m_bitrate = 0;
+
+    uint64_t m_window_start_us = 0;
+    uint64_t m_hold_until_us = 0;
+    uint32_t m_last_dropped = 0;
+    uint32_t m_last_received = 0;
+    bool m_window_poor = false;
+    bool m_window_slow_decode = false;
+    int m_bad_windows = 0;
+    int m_good_windows = 0;
+};
@@ -0,0 +1,112 @@
+//
+//  AppSearchIndex.cpp
+//  Moonlight
+//
+
+#include "AppSearchIndex.hpp"
+#include <algorithm>
+
+std::string AppSearchIndex::fold(const std::string& text) {
+    std::string folded;
+    folded.reserve(text.size());
+
+    for (size_t i = 0; i < text.size(); i++) {
+        unsigned char c = text[i];
+
+        if (c >= 'A' && c <= 'Z') {
+            folded += (char)(c + 'a' - 'A');
+        } else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+            folded += (char)c;
+        } else if (c < 0x80) {
+            if (!folded.empty() && folded.back() != ' ')
+                folded += ' ';
+        } else if (c == 0xD0 && i + 1 < text.size()) {
+            // Cyrillic capitals, U+0410..U+042F and U+0401
+            unsigned char next = text[++i];
+            if (next >= 0x90 && next <= 0x9F) {
+                folded += (char)0xD0;
+                folded += (char)(next + 0x20);
+            } else if (next >= 0xA0 && next <= 0xAF) {
+                folded += (char)0xD1;
+                folded += (char)(next - 0x20);
+            } else if (next == 0x81) {
+                folded += (char)0xD1;
+                folded += (char)0x91;
+            } else {
+                folded += (char)c;
+                folded += (char)next;
+            }
+        } else {
+            folded += (char)c;
+        }
+    }
+
+    if (!folded.empty() && folded.back() == ' ')
+        folded.pop_back();
+    return folded;
+}
+
+void AppSearchIndex::update(const AppInfoList& apps) {
+    std::unordered_map<int, Entry> entries;
+    entries.reserve(apps.size());
+    m_folded.clear();
+    m_folded.reserve(apps.size());
+
+    for (const AppInfo& app : apps) {
+        auto known = m_entries.find(app.app_id);
+        if (known != m_entries.end() && known->second.name == app.name)
+            entries[app.app_id] = std::move(known->second);
+        else
+            entries[app.app_id] = {app.name, fold(app.name)};
+        m_folded.push_back(entries[app.app_id].folded);
+    }
+    m_entries = std::move(entries);
+
+    // Positions shift with every change, lists are cheap to fill again
+    m_trigrams.clear();
+    for (int index = 0; index < (int)m_folded.size(); index++) {
+        const std::string& name = m_folded[index];
+        for (size_t i = 0; i + APP_SEARCH_TRIGRAM <= name.size(); i++) {
+            auto& list = m_trigrams[trigram(name.data() + i)];
+            if (list.empty() || list.back() != index)
+                list.push_back(index);
+        }
+    }
+}
+
+std::vector<int> AppSearchIndex::search(const std::string& query) const {
+    std::string folded = fold(query);
+    std::vector<int> result;
+
+    if (folded.empty()) {
+        result.resize(m_folded.size());
+        for (int i = 0; i < (int)result.size(); i++)
+            result[i] = i;
+        return result;
+    }
+
+    if (folded.size() < APP_SEARCH_TRIGRAM) {
+        for (int i = 0; i < (int)m_folded.size(); i++) {
+            if (m_folded[i].find(folded) != std::string::npos)
+                result.push_back(i);
+        }
+        return result;
+    }
+
+    // Shortest posting list of query trigrams gives candidates, each one
+    // is checked for whole query
+    const std::vector<int>* candidates = nullptr;
+    for (size_t i = 0; i + APP_SEARCH_TRIGRAM <= folded.size(); i++) {
+        auto list = m_trigrams.find(trigram(folded.data() + i));
+        if (list == m_trigrams.end())
+            return result;
+        if (!candidates || list->second.size() < candidates->size())
+            candidates = &list->second;
+    }
+
+    for (int index : *candidates) {
+        if (m_folded[index].find(folded) != std::string::npos)
+            result.push_back(index);
+    }
+    return result;
+}
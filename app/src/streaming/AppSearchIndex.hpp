@@ -0,0 +1,46 @@
+//
+//  AppSearchIndex.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "GameStreamClient.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Shorter queries are matched by scanning folded names, which is faster
+// than merging posting lists for them
+#define APP_SEARCH_TRIGRAM 3
+
+// Substring search over names of an app list. Names are folded once per
+// list: lower case for Latin and Cyrillic, punctuation as single spaces.
+// Trigram posting lists narrow down candidates of longer queries
+class AppSearchIndex {
+  public:
+    // Only new and renamed apps are folded again
+    void update(const AppInfoList& apps);
+
+    // Indices into last list, in its order. Empty query matches all
+    [[nodiscard]] std::vector<int> search(const std::string& query) const;
+
+    static std::string fold(const std::string& text);
+
+  private:
+    struct Entry {
+        std::string name;
+        std::string folded;
+    };
+
+    static uint32_t trigram(const char* text) {
+        return (uint8_t)text[0] | ((uint8_t)text[1] << 8) | ((uint8_t)text[2] << 16);
+    }
+
+    // Folded name of every app in list order
+    std::vector<std::string> m_folded;
+    // Last known name of every app id, so unchanged ones skip folding
+    std::unordered_map<int, Entry> m_entries;
+    std::unordered_map<uint32_t, std::vector<int>> m_trigrams;
+};
@@ -0,0 +1,109 @@
+//
+//  ButtonMapper.cpp
+//  Moonlight
+//
+
+#include "ButtonMapper.hpp"
+#include "Limelight.h"
+
+// Moonlight flag sent for mapped button
+static short button_flag(int button) {
+    switch (button) {
+        case brls::BUTTON_UP:
+            return UP_FLAG;
+        case brls::BUTTON_DOWN:
+            return DOWN_FLAG;
+        case brls::BUTTON_LEFT:
+            return LEFT_FLAG;
+        case brls::BUTTON_RIGHT:
+            return RIGHT_FLAG;
+#ifdef __SWITCH__
+        // Nintendo layout, buttons are placed by position
+        case brls::BUTTON_B:
+            return A_FLAG;
+        case brls::BUTTON_A:
+            return B_FLAG;
+        case brls::BUTTON_Y:
+            return X_FLAG;
+        case brls::BUTTON_X:
+            return Y_FLAG;
+#else
+        case brls::BUTTON_A:
+            return A_FLAG;
+        case brls::BUTTON_B:
+            return B_FLAG;
+        case brls::BUTTON_X:
+            return X_FLAG;
+        case brls::BUTTON_Y:
+            return Y_FLAG;
+#endif
+        case brls::BUTTON_BACK:
+            return BACK_FLAG;
+        case brls::BUTTON_START:
+            return PLAY_FLAG;
+        case brls::BUTTON_LB:
+            return LB_FLAG;
+        case brls::BUTTON_RB:
+            return RB_FLAG;
+        case brls::BUTTON_LSB:
+            return LS_CLK_FLAG;
+        case brls::BUTTON_RSB:
+            return RS_CLK_FLAG;
+        default:
+            return 0;
+    }
+}
+
+ButtonMapper::ButtonMapper() {
+    brls::ControllerButton identity[brls::_BUTTON_MAX];
+    for (int i = 0; i < brls::_BUTTON_MAX; i++)
+        identity[i] = (brls::ControllerButton)i;
+    compile(identity, {});
+}
+
+void ButtonMapper::compile(const brls::ControllerButton* mapping,
+                           const std::vector<brls::ControllerButton>& guideKeys) {
+    for (int chunk = 0; chunk < BUTTON_MAPPER_CHUNKS; chunk++) {
+        for (int value = 0; value < (1 << BUTTON_MAPPER_CHUNK_BITS); value++) {
+            Entry& entry = m_tables[chunk][value];
+            entry = {0, 0};
+
+            for (int bit = 0; bit < BUTTON_MAPPER_CHUNK_BITS; bit++) {
+                int button = chunk * BUTTON_MAPPER_CHUNK_BITS + bit;
+                if (!(value & (1 << bit)) || button >= brls::_BUTTON_MAX)
+                    continue;
+
+                entry.buttons |= ButtonMapper::bit(mapping[button]);
+                entry.flags |= button_flag(mapping[button]);
+            }
+        }
+    }
+
+    m_guide_mask = 0;
+    for (auto key : guideKeys)
+        m_guide_mask |= ButtonMapper::bit(key);
+}
+
+uint64_t ButtonMapper::map(const brls::ControllerState& raw, short& flags, uint64_t* raw_bits) const {
+    uint64_t buttons = 0;
+    uint64_t raw_buttons = 0;
+    flags = 0;
+
+    for (int chunk = 0; chunk < BUTTON_MAPPER_CHUNKS; chunk++) {
+        int value = 0;
+        for (int bit = 0; bit < BUTTON_MAPPER_CHUNK_BITS; bit++) {
+            int button = chunk * BUTTON_MAPPER_CHUNK_BITS + bit;
+            if (button < brls::_BUTTON_MAX)
+                value |= (int)raw.buttons[button] << bit;
+        }
+
+        const Entry& entry = m_tables[chunk][value];
+        buttons |= entry.buttons;
+        flags |= entry.flags;
+        raw_buttons |= (uint64_t)value << (chunk * BUTTON_MAPPER_CHUNK_BITS);
+    }
+
+    if (raw_bits)
+        *raw_bits = raw_buttons;
+    return buttons;
+}
@@ -0,0 +1,47 @@
+//
+//  ButtonMapper.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <borealis.hpp>
+#include <cstdint>
+#include <vector>
+
+#define BUTTON_MAPPER_CHUNK_BITS 8
+#define BUTTON_MAPPER_CHUNKS ((brls::_BUTTON_MAX + BUTTON_MAPPER_CHUNK_BITS - 1) / BUTTON_MAPPER_CHUNK_BITS)
+
+static_assert(brls::_BUTTON_MAX <= 64, "Buttons don't fit into 64 bit mask");
+
+// Mapping layout compiled into byte tables, so raw buttons become mapped
+// buttons and Moonlight flags with one lookup per 8 buttons
+class ButtonMapper {
+  public:
+    ButtonMapper();
+
+    // mapping[i] is button raw button i acts as, guide keys are mapped
+    // buttons which pressed together act as guide
+    void compile(const brls::ControllerButton* mapping,
+                 const std::vector<brls::ControllerButton>& guideKeys);
+
+    // Mapped buttons as bitmask, flags are Moonlight buttonFlags without
+    // guide which is resolved by caller with guide_combo(). Unmapped
+    // buttons as bitmask go to raw_bits when it's given
+    uint64_t map(const brls::ControllerState& raw, short& flags, uint64_t* raw_bits = nullptr) const;
+
+    bool guide_combo(uint64_t buttons) const {
+        return m_guide_mask != 0 && (buttons & m_guide_mask) == m_guide_mask;
+    }
+
+    static uint64_t bit(brls::ControllerButton button) { return 1ull << button; }
+
+  private:
+    struct Entry {
+        uint64_t buttons;
+        short flags;
+    };
+
+    Entry m_tables[BUTTON_MAPPER_CHUNKS][1 << BUTTON_MAPPER_CHUNK_BITS];
+    uint64_t m_guide_mask = 0;
+};
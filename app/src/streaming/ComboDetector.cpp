@@ -0,0 +1,46 @@
+//
+//  ComboDetector.cpp
+//  Moonlight
+//
+
+#include "ComboDetector.hpp"
+#include "ButtonMapper.hpp"
+#include <algorithm>
+
+void ComboDetector::compile(ComboEvent event, const KeyComboOptions& options) {
+    Combo& combo = m_combos[event];
+    combo = {};
+    for (auto button : options.buttons)
+        combo.mask |= ButtonMapper::bit(button);
+    combo.hold_us = (uint64_t)std::max(options.holdTime, 0) * 1000000;
+}
+
+void ComboDetector::update(uint64_t buttons, uint64_t now_us) {
+    for (int i = 0; i < COMBO_COUNT; i++) {
+        Combo& combo = m_combos[i];
+        bool pressed = combo.mask != 0 && (buttons & combo.mask) == combo.mask;
+
+        if (!pressed) {
+            combo.pressed = false;
+            combo.fired = false;
+            continue;
+        }
+
+        if (!combo.pressed) {
+            combo.pressed = true;
+            combo.pressed_us = now_us;
+        }
+
+        if (!combo.fired && now_us - combo.pressed_us >= combo.hold_us) {
+            combo.fired = true;
+            m_events.fetch_or(1u << i, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool ComboDetector::take(ComboEvent event) {
+    uint32_t bit = 1u << event;
+    if (!(m_events.load(std::memory_order_relaxed) & bit))
+        return false;
+    return m_events.fetch_and(~bit, std::memory_order_relaxed) & bit;
+}
@@ -0,0 +1,40 @@
+//
+//  ComboDetector.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Settings.hpp"
+#include <atomic>
+#include <cstdint>
+
+enum ComboEvent : int { COMBO_OVERLAY, COMBO_MOUSE_INPUT, COMBO_COUNT };
+
+// Key combos compiled into button masks with hold time. Raw buttons of
+// all controllers are fed once per input poll, combo held long enough
+// fires once until it's released. Fired events are bits taken by UI
+// thread, so render path only reads an atomic
+class ComboDetector {
+  public:
+    // Combo without buttons never fires
+    void compile(ComboEvent event, const KeyComboOptions& options);
+
+    // Polling side, calls are serialized by caller
+    void update(uint64_t buttons, uint64_t now_us);
+
+    // Any thread, true once for every time combo fired
+    bool take(ComboEvent event);
+
+  private:
+    struct Combo {
+        uint64_t mask = 0;
+        uint64_t hold_us = 0;
+        uint64_t pressed_us = 0;
+        bool pressed = false;
+        bool fired = false;
+    };
+
+    Combo m_combos[COMBO_COUNT];
+    std::atomic<uint32_t> m_events = 0;
+};
@@ -7,9 +7,84 @@
 
 #include "DiscoverManager.hpp"
 #include "GameStreamClient.hpp"
+#include "HighResClock.hpp"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
 
 using namespace brls::literals;
 
+// Returns addresses in [begin, end) accepting TCP connection on GameStream
+// HTTP port, all of them are probed at once with non-blocking connect
+static std::vector<std::string> probe_addresses(const std::vector<std::string>& addresses,
+                                                size_t begin, size_t end) {
+    std::vector<std::string> responders;
+    std::vector<struct pollfd> fds;
+    std::vector<size_t> indexes;
+
+    for (size_t i = begin; i < end; i++) {
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(DISCOVERY_PROBE_PORT);
+        if (inet_pton(AF_INET, addresses[i].c_str(), &addr.sin_addr) != 1)
+            continue;
+
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            continue;
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        int res = connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+        if (res == 0) {
+            responders.push_back(addresses[i]);
+            close(fd);
+            continue;
+        } else if (errno != EINPROGRESS) {
+            close(fd);
+            continue;
+        }
+
+        fds.push_back({fd, POLLOUT, 0});
+        indexes.push_back(i);
+    }
+
+    uint64_t deadline = HighResClock::now_us() + DISCOVERY_PROBE_TIMEOUT_MS * 1000;
+    size_t pending = fds.size();
+    while (pending > 0) {
+        int64_t remaining = (int64_t)(deadline - HighResClock::now_us()) / 1000;
+        if (remaining <= 0 || poll(fds.data(), fds.size(), (int)remaining) <= 0)
+            break;
+
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (fds[i].fd < 0 || !fds[i].revents)
+                continue;
+
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error == 0 && (fds[i].revents & POLLOUT))
+                responders.push_back(addresses[indexes[i]]);
+
+            close(fds[i].fd);
+            // Negative descriptors are ignored by poll
+            fds[i].fd = -1;
+            pending--;
+        }
+    }
+
+    for (auto& fd : fds) {
+        if (fd.fd >= 0)
+            close(fd.fd);
+    }
+    return responders;
+}
+
 DiscoverManager::DiscoverManager() {
     reset();
     start();
@@ -47,20 +122,36 @@ void DiscoverManager::pause() { paused = true; }
 void DiscoverManager::loop() {
     brls::async([this] {
         while (counter < addresses.size() && !paused) {
-            SERVER_DATA server_data;
-
-            int status = gs_init(&server_data, addresses[counter]);
-            if (status == GS_OK) {
-                Host host;
-                host.address = addresses[counter];
-                host.hostname = server_data.hostname;
-                host.mac = server_data.mac;
-                _hosts.push_back(host);
-                hosts = hosts.success(_hosts);
-                brls::sync([this] { getHostsUpdateEvent()->fire(hosts); });
+            size_t end = std::min(addresses.size(), (size_t)counter + DISCOVERY_PROBE_BATCH);
+            auto responders = probe_addresses(addresses, counter, end);
+
+            // Only hosts with open port get full serverinfo request
+            for (auto& address : responders) {
+                if (paused)
+                    break;
+
+                bool known = std::any_of(_hosts.begin(), _hosts.end(),
+                                         [&address](const Host& host) { return host.address == address; });
+                if (known)
+                    continue;
+
+                SERVER_DATA server_data;
+
+                int status = gs_init(&server_data, address);
+                if (status == GS_OK) {
+                    Host host;
+                    host.address = address;
+                    host.hostname = server_data.hostname;
+                    host.mac = server_data.mac;
+                    _hosts.push_back(host);
+                    hosts = hosts.success(_hosts);
+                    brls::sync([this] { getHostsUpdateEvent()->fire(hosts); });
+                }
             }
 
-            counter++;
+            // Paused batch is probed again on resume, found hosts are skipped
+            if (!paused)
+                counter = (int)end;
         }
 
         if (counter == addresses.size() && _hosts.empty()) {
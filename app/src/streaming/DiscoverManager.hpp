@@ -14,6 +14,11 @@
 #include <pthread.h>
 #include <stdio.h>
 
+// Addresses probed at the same time and how long to wait for them
+#define DISCOVERY_PROBE_BATCH 64
+#define DISCOVERY_PROBE_TIMEOUT_MS 300
+#define DISCOVERY_PROBE_PORT 47989
+
 class DiscoverManager : public Singleton<DiscoverManager> {
   public:
     DiscoverManager();
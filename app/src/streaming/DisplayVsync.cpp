@@ -0,0 +1,216 @@
+//
+//  DisplayVsync.cpp
+//  Moonlight
+//
+
+#include "DisplayVsync.hpp"
+
+#ifdef PLATFORM_ANDROID
+#include "HighResClock.hpp"
+#include "ThreadProfiler.hpp"
+#include <SDL.h>
+#include <SDL_syswm.h>
+#include <android/looper.h>
+#include <android/native_window.h>
+#include <borealis.hpp>
+#include <dlfcn.h>
+
+// ANativeWindow_setFrameRate values, video is content of fixed rate
+// and panel may switch even if that isn't seamless
+#define VSYNC_FRAME_RATE_FIXED_SOURCE 1
+#define VSYNC_CHANGE_FRAME_RATE_ALWAYS 1
+// Looper wakes up this often to check stop flag, in case wake came
+// before looper existed
+#define VSYNC_POLL_MS 100
+
+// Entry points of libandroid newer than minimum API level,
+// choreographer is 24+, 64 bit callback 29+, frame rate 30+
+struct ChoreographerApi {
+    void* (*get_instance)();
+    void (*post_frame_callback)(void*, void (*)(long, void*), void*);
+    void (*post_frame_callback64)(void*, void (*)(int64_t, void*), void*);
+    void (*register_refresh_rate)(void*, void (*)(int64_t, void*), void*);
+    void (*unregister_refresh_rate)(void*, void (*)(int64_t, void*), void*);
+    int32_t (*set_frame_rate)(ANativeWindow*, float, int8_t);
+    int32_t (*set_frame_rate_strategy)(ANativeWindow*, float, int8_t, int8_t);
+};
+
+static const ChoreographerApi* choreographer() {
+    static ChoreographerApi api;
+    static const ChoreographerApi* loaded = []() -> const ChoreographerApi* {
+        void* library = dlopen("libandroid.so", RTLD_NOW);
+        if (!library)
+            return nullptr;
+
+        api.get_instance = (void* (*)())dlsym(library, "AChoreographer_getInstance");
+        api.post_frame_callback = (decltype(api.post_frame_callback))dlsym(library, "AChoreographer_postFrameCallback");
+        api.post_frame_callback64 = (decltype(api.post_frame_callback64))dlsym(library, "AChoreographer_postFrameCallback64");
+        api.register_refresh_rate = (decltype(api.register_refresh_rate))dlsym(library, "AChoreographer_registerRefreshRateCallback");
+        api.unregister_refresh_rate = (decltype(api.unregister_refresh_rate))dlsym(library, "AChoreographer_unregisterRefreshRateCallback");
+        api.set_frame_rate = (decltype(api.set_frame_rate))dlsym(library, "ANativeWindow_setFrameRate");
+        api.set_frame_rate_strategy = (decltype(api.set_frame_rate_strategy))dlsym(library, "ANativeWindow_setFrameRateWithChangeStrategy");
+
+        if (!api.get_instance || (!api.post_frame_callback && !api.post_frame_callback64)) {
+            brls::Logger::warning("DisplayVsync: AChoreographer isn't available");
+            return nullptr;
+        }
+        return &api;
+    }();
+    return loaded;
+}
+
+static ANativeWindow* stream_window() {
+    SDL_SysWMinfo info;
+    SDL_VERSION(&info.version);
+    SDL_Window* window = SDL_GL_GetCurrentWindow();
+    if (!window || !SDL_GetWindowWMInfo(window, &info))
+        return nullptr;
+    return info.info.android.window;
+}
+
+void DisplayVsync::start(int stream_fps) {
+    stop();
+    set_frame_rate((float)stream_fps);
+
+    if (!choreographer())
+        return;
+
+    m_last_vsync_ns = 0;
+    m_period_ns = 0;
+    m_period_reported = false;
+    m_running = true;
+    m_thread = std::thread(&DisplayVsync::run, this);
+}
+
+void DisplayVsync::stop() {
+    if (m_running.exchange(false)) {
+        if (void* looper = m_looper.load())
+            ALooper_wake((ALooper*)looper);
+        m_thread.join();
+    }
+
+    // Panel goes back to what UI wants
+    set_frame_rate(0);
+    m_last_vsync_ns = 0;
+    m_period_ns = 0;
+}
+
+void DisplayVsync::set_frame_rate(float fps) {
+    const ChoreographerApi* api = choreographer();
+    ANativeWindow* window = api ? stream_window() : nullptr;
+    if (!window)
+        return;
+
+    int32_t result = -1;
+    if (api->set_frame_rate_strategy)
+        result = api->set_frame_rate_strategy(window, fps, VSYNC_FRAME_RATE_FIXED_SOURCE,
+                                              VSYNC_CHANGE_FRAME_RATE_ALWAYS);
+    else if (api->set_frame_rate)
+        result = api->set_frame_rate(window, fps, VSYNC_FRAME_RATE_FIXED_SOURCE);
+    else
+        return;
+
+    brls::Logger::info("DisplayVsync: Frame rate {} - {}", fps, result == 0 ? "set" : "failed");
+}
+
+void DisplayVsync::run() {
+    ThreadProfileScope profile("Vsync");
+
+    // Choreographer instance belongs to thread with a looper
+    ALooper* looper = ALooper_prepare(0);
+    ALooper_acquire(looper);
+    m_looper = looper;
+
+    const ChoreographerApi* api = choreographer();
+    m_choreographer = api->get_instance();
+    if (m_choreographer) {
+        if (api->register_refresh_rate)
+            api->register_refresh_rate(m_choreographer, refresh_rate_callback, this);
+        if (api->post_frame_callback64)
+            api->post_frame_callback64(m_choreographer, frame_callback64, this);
+        else
+            api->post_frame_callback(m_choreographer, frame_callback, this);
+
+        while (m_running)
+            ALooper_pollOnce(VSYNC_POLL_MS, nullptr, nullptr, nullptr);
+
+        if (api->unregister_refresh_rate)
+            api->unregister_refresh_rate(m_choreographer, refresh_rate_callback, this);
+    }
+
+    m_choreographer = nullptr;
+    m_looper = nullptr;
+    ALooper_release(looper);
+}
+
+void DisplayVsync::frame_callback(long frame_time_ns, void* data) {
+    auto* self = (DisplayVsync*)data;
+    int64_t frame_time = (int64_t)frame_time_ns;
+    if (sizeof(long) < sizeof(int64_t)) {
+        // 32 bit long wraps every 4 s, high bits are taken from clock,
+        // vsync is always a bit in the past
+        int64_t now = (int64_t)HighResClock::now_ns();
+        frame_time = (now & ~(int64_t)0xFFFFFFFF) | (uint32_t)frame_time_ns;
+        if (frame_time > now)
+            frame_time -= (int64_t)1 << 32;
+    }
+
+    self->on_vsync(frame_time);
+    if (self->m_running)
+        choreographer()->post_frame_callback(self->m_choreographer, frame_callback, self);
+}
+
+void DisplayVsync::frame_callback64(int64_t frame_time_ns, void* data) {
+    auto* self = (DisplayVsync*)data;
+    self->on_vsync(frame_time_ns);
+    if (self->m_running)
+        choreographer()->post_frame_callback64(self->m_choreographer, frame_callback64, self);
+}
+
+void DisplayVsync::refresh_rate_callback(int64_t period_ns, void* data) {
+    auto* self = (DisplayVsync*)data;
+    if (period_ns < VSYNC_MIN_PERIOD_NS || period_ns > VSYNC_MAX_PERIOD_NS)
+        return;
+
+    self->m_period_reported = true;
+    self->m_period_ns = period_ns;
+    brls::Logger::info("DisplayVsync: Refresh rate {:.1f} Hz", 1e9 / (double)period_ns);
+}
+
+void DisplayVsync::on_vsync(int64_t frame_time_ns) {
+    int64_t last = m_last_vsync_ns.exchange(frame_time_ns);
+    if (last == 0 || m_period_reported)
+        return;
+
+    // Missed callbacks span several periods, they're divided back
+    int64_t delta = frame_time_ns - last;
+    int64_t period = m_period_ns;
+    if (period > 0 && delta > period * 3 / 2)
+        delta /= (delta + period / 2) / period;
+    if (delta < VSYNC_MIN_PERIOD_NS || delta > VSYNC_MAX_PERIOD_NS)
+        return;
+
+    m_period_ns = period == 0 ? delta : (period * 15 + delta) / 16;
+}
+#else
+void DisplayVsync::start(int stream_fps) {}
+
+void DisplayVsync::stop() {}
+#endif
+
+bool DisplayVsync::next_vsync(uint64_t now_us, uint64_t* vsync_us, uint64_t* period_us) const {
+    int64_t last = m_last_vsync_ns.load(std::memory_order_relaxed);
+    int64_t period = m_period_ns.load(std::memory_order_relaxed);
+    if (last == 0 || period == 0)
+        return false;
+
+    // Timeline goes on from last callback, it could be a few periods old
+    int64_t now = (int64_t)now_us * 1000;
+    int64_t next = last + period;
+    if (next <= now)
+        next += ((now - next) / period + 1) * period;
+
+    *vsync_us = (uint64_t)(next / 1000);
+    *period_us = (uint64_t)(period / 1000);
+    return true;
+}
@@ -0,0 +1,52 @@
+//
+//  DisplayVsync.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Singleton.hpp"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+// Accepted vsync period, 20 - 240 Hz, callbacks outside are missed ones
+#define VSYNC_MIN_PERIOD_NS (1000000000LL / 240)
+#define VSYNC_MAX_PERIOD_NS (1000000000LL / 20)
+
+// Vsync timeline of display stream is shown on. On Android it follows
+// AChoreographer callbacks on a looper thread of its own and asks panel
+// for refresh matching stream fps, so 60, 90 or 120 fps isn't shown with
+// 3:2 cadence on 120 Hz phones. Elsewhere timeline is unknown and frame
+// pacing estimates refresh from UI draws
+class DisplayVsync : public Singleton<DisplayVsync> {
+  public:
+    // UI thread, window of the stream has to exist
+    void start(int stream_fps);
+    void stop();
+
+    // Next vsync after now and refresh period, in HighResClock micros,
+    // false while timeline is unknown
+    bool next_vsync(uint64_t now_us, uint64_t* vsync_us, uint64_t* period_us) const;
+
+  private:
+#ifdef PLATFORM_ANDROID
+    void run();
+    void on_vsync(int64_t frame_time_ns);
+    void set_frame_rate(float fps);
+
+    static void frame_callback(long frame_time_ns, void* data);
+    static void frame_callback64(int64_t frame_time_ns, void* data);
+    static void refresh_rate_callback(int64_t period_ns, void* data);
+
+    std::thread m_thread;
+    std::atomic<bool> m_running = false;
+    std::atomic<void*> m_looper = nullptr;
+    void* m_choreographer = nullptr;
+    // Refresh rate callback reports exact period, estimate is kept then
+    bool m_period_reported = false;
+#endif
+
+    std::atomic<int64_t> m_last_vsync_ns = 0;
+    std::atomic<int64_t> m_period_ns = 0;
+};
@@ -0,0 +1,38 @@
+//
+//  FrameArrival.cpp
+//  Moonlight
+//
+
+#include "FrameArrival.hpp"
+#include <chrono>
+
+std::atomic<bool> FrameArrival::m_enabled = false;
+std::mutex FrameArrival::m_mutex;
+std::condition_variable FrameArrival::m_condition;
+uint64_t FrameArrival::m_arrived = 0;
+uint64_t FrameArrival::m_seen = 0;
+
+void FrameArrival::set_enabled(bool enabled) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_enabled = enabled;
+    m_seen = m_arrived;
+}
+
+void FrameArrival::notify() {
+    if (!enabled())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_arrived++;
+    }
+    m_condition.notify_one();
+}
+
+void FrameArrival::wait(uint64_t timeout_us) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // Frame which came while previous one was drawn doesn't wait
+    m_condition.wait_for(lock, std::chrono::microseconds(timeout_us),
+                         [] { return m_arrived != m_seen || !m_enabled; });
+    m_seen = m_arrived;
+}
@@ -0,0 +1,33 @@
+//
+//  FrameArrival.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Wakes UI loop when decoder queues a frame, so with variable refresh
+// the loop runs at stream cadence instead of display one. Decoder side
+// is a single relaxed load while nobody listens
+class FrameArrival {
+  public:
+    static void set_enabled(bool enabled);
+    [[nodiscard]] static bool enabled() { return m_enabled.load(std::memory_order_relaxed); }
+
+    // Decoder thread, after frame is queued
+    static void notify();
+    // UI thread, returns when a frame came since previous wait or after
+    // timeout, so input and overlays are still handled without frames
+    static void wait(uint64_t timeout_us);
+
+  private:
+    static std::atomic<bool> m_enabled;
+    static std::mutex m_mutex;
+    static std::condition_variable m_condition;
+    static uint64_t m_arrived;
+    static uint64_t m_seen;
+};
@@ -0,0 +1,167 @@
+//
+//  FrameCapture.cpp
+//  Moonlight
+//
+
+#include "FrameCapture.hpp"
+#include "AVResources.hpp"
+#include "ColorConversion.hpp"
+#include <borealis.hpp>
+#include <algorithm>
+#include <CImg.h>
+
+extern "C" {
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
+}
+
+using namespace cimg_library;
+
+void FrameCapture::request(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_path = path;
+    m_pending = true;
+}
+
+void FrameCapture::frame_drawn(const AVFrame* frame) {
+    if (!m_pending.exchange(false))
+        return;
+
+    // Only reference counts change here, pixels stay where they are
+    AVFrame* clone = av_frame_clone(frame);
+    if (!clone) {
+        brls::Logger::error("FrameCapture: Couldn't reference frame");
+        return;
+    }
+
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        path = m_path;
+    }
+    // Task has to be copyable, save() takes ownership of the clone
+    brls::async([clone, path] { save(clone, path); });
+}
+
+// Returns sample of plane normalized as shader texture would give it
+template <typename T> static float sample(const AVFrame* frame, int plane, int x, int y, int stride, int component) {
+    const T* row = (const T*)(frame->data[plane] + (size_t)y * frame->linesize[plane]);
+    return (float)row[x * stride + component] / (float)((1 << (sizeof(T) * 8)) - 1);
+}
+
+// Takes ownership of drawn frame, returns copy of it in system memory
+static AVFramePtr system_copy(AVFrame* drawn) {
+    AVFramePtr source(drawn);
+    AVFramePtr owned(av_frame_alloc());
+    if (!owned) {
+        brls::Logger::error("FrameCapture: Not enough memory");
+        return nullptr;
+    }
+
+    // Hardware surface goes back to decoder pool as soon as it's copied
+    if (source->hw_frames_ctx) {
+        if (av_hwframe_transfer_data(owned.get(), source.get(), 0) < 0) {
+            brls::Logger::error("FrameCapture: Couldn't read hardware frame");
+            return nullptr;
+        }
+    } else {
+        // Decoder copies hardware frames into pooled surfaces,
+        // so take pixels before the surface comes around again
+        owned->format = source->format;
+        owned->width = source->width;
+        owned->height = source->height;
+        if (av_frame_get_buffer(owned.get(), 0) < 0 || av_frame_copy(owned.get(), source.get()) < 0) {
+            brls::Logger::error("FrameCapture: Couldn't copy frame");
+            return nullptr;
+        }
+    }
+    av_frame_copy_props(owned.get(), source.get());
+
+    int format = owned->format;
+    // Full range planar ones come from JPEG decoder
+    if (format != AV_PIX_FMT_NV12 && format != AV_PIX_FMT_P010 && format != AV_PIX_FMT_YUV420P &&
+        format != AV_PIX_FMT_YUVJ420P && format != AV_PIX_FMT_YUVJ422P && format != AV_PIX_FMT_YUVJ444P) {
+        brls::Logger::error("FrameCapture: Unsupported frame format {}", format);
+        return nullptr;
+    }
+    return owned;
+}
+
+// Calls put with RGB of every pixel of width x height image, frame is
+// sampled at nearest pixel when sizes differ
+template <typename F> static void convert(const AVFrame* frame, int width, int height, F&& put) {
+    int format = frame->format;
+    const ColorConversion& conversion = color_conversion(frame);
+    const float* m = conversion.matrix;
+    const float* offset = conversion.offset;
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)format);
+    int shift_x = desc->log2_chroma_w;
+    int shift_y = desc->log2_chroma_h;
+
+    for (int dy = 0; dy < height; dy++) {
+        int y = (int)((int64_t)dy * frame->height / height);
+        for (int dx = 0; dx < width; dx++) {
+            int x = (int)((int64_t)dx * frame->width / width);
+            float yuv[3];
+            if (format == AV_PIX_FMT_P010) {
+                yuv[0] = sample<uint16_t>(frame, 0, x, y, 1, 0);
+                yuv[1] = sample<uint16_t>(frame, 1, x >> shift_x, y >> shift_y, 2, 0);
+                yuv[2] = sample<uint16_t>(frame, 1, x >> shift_x, y >> shift_y, 2, 1);
+            } else if (format == AV_PIX_FMT_NV12) {
+                yuv[0] = sample<uint8_t>(frame, 0, x, y, 1, 0);
+                yuv[1] = sample<uint8_t>(frame, 1, x >> shift_x, y >> shift_y, 2, 0);
+                yuv[2] = sample<uint8_t>(frame, 1, x >> shift_x, y >> shift_y, 2, 1);
+            } else {
+                yuv[0] = sample<uint8_t>(frame, 0, x, y, 1, 0);
+                yuv[1] = sample<uint8_t>(frame, 1, x >> shift_x, y >> shift_y, 1, 0);
+                yuv[2] = sample<uint8_t>(frame, 2, x >> shift_x, y >> shift_y, 1, 0);
+            }
+
+            for (int i = 0; i < 3; i++)
+                yuv[i] -= offset[i];
+
+            // Column major, same as shaders take it
+            unsigned char rgb[3];
+            for (int c = 0; c < 3; c++) {
+                float value = m[c] * yuv[0] + m[3 + c] * yuv[1] + m[6 + c] * yuv[2];
+                rgb[c] = (unsigned char)(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+            }
+            put(dx, dy, rgb);
+        }
+    }
+}
+
+void FrameCapture::save(AVFrame* drawn, const std::string& path) {
+    AVFramePtr frame = system_copy(drawn);
+    if (!frame)
+        return;
+
+    CImg<unsigned char> image(frame->width, frame->height, 1, 3);
+    convert(frame.get(), frame->width, frame->height, [&image](int x, int y, const unsigned char* rgb) {
+        for (int c = 0; c < 3; c++)
+            image(x, y, 0, c) = rgb[c];
+    });
+    frame.reset();
+
+    try {
+        image.save_png(path.c_str());
+        brls::Logger::info("FrameCapture: Saved {}", path);
+    } catch (CImgException& e) {
+        brls::Logger::error("FrameCapture: Couldn't save {}: {}", path, e.what());
+    }
+}
+
+bool FrameCapture::thumbnail(AVFrame* drawn, int width, int height, unsigned char* pixels) {
+    AVFramePtr frame = system_copy(drawn);
+    if (!frame)
+        return false;
+
+    convert(frame.get(), width, height, [pixels, width](int x, int y, const unsigned char* rgb) {
+        unsigned char* pixel = pixels + ((size_t)y * width + x) * 4;
+        pixel[0] = rgb[0];
+        pixel[1] = rgb[1];
+        pixel[2] = rgb[2];
+        pixel[3] = 255;
+    });
+    return true;
+}
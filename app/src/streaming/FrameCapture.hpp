@@ -0,0 +1,38 @@
+//
+//  FrameCapture.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Singleton.hpp"
+#include <atomic>
+#include <mutex>
+#include <string>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Screenshot of decoded stream frame at its own resolution, without UI.
+// Render thread only takes a reference to drawn frame, copy, RGB
+// conversion and PNG encoding run in background
+class FrameCapture : public Singleton<FrameCapture> {
+  public:
+    // Next drawn frame is saved into path
+    void request(const std::string& path);
+
+    // Called by session for every drawn frame
+    void frame_drawn(const AVFrame* frame);
+
+    // Background thread, takes ownership of frame reference and fills
+    // width x height RGBA pixels with it, nearest sampled
+    static bool thumbnail(AVFrame* frame, int width, int height, unsigned char* pixels);
+
+  private:
+    static void save(AVFrame* frame, const std::string& path);
+
+    std::atomic<bool> m_pending = false;
+    std::mutex m_mutex;
+    std::string m_path;
+};
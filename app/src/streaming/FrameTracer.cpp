@@ -0,0 +1,154 @@
+//
+//  FrameTracer.cpp
+//  Moonlight
+//
+
+#include "FrameTracer.hpp"
+#include "HighResClock.hpp"
+#include "PipelineTrace.hpp"
+#include <borealis.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// Recalculate percentiles not more often than that
+#define SUMMARY_INTERVAL_US 250000
+
+void FrameTracer::reset() {
+    std::fill(std::begin(m_records), std::end(m_records), FrameTraceRecord{});
+    m_last_drawn_frame = 0;
+    m_last_popped_frame = 0;
+    m_summary = {};
+    m_summary_timestamp = 0;
+}
+
+FrameTraceRecord* FrameTracer::record(uint32_t frame_number) {
+    FrameTraceRecord* record = &m_records[frame_number % FRAME_TRACE_SIZE];
+    return record->frame_number == frame_number ? record : nullptr;
+}
+
+void FrameTracer::decode_submitted(uint32_t frame_number, uint64_t receive_ms, uint64_t submit_ms) {
+    FrameTraceRecord& record = m_records[frame_number % FRAME_TRACE_SIZE];
+    record = {};
+    record.frame_number = frame_number;
+    record.receive_ms = receive_ms;
+    record.submit_ms = submit_ms;
+    record.decode_submit_us = HighResClock::now_us();
+}
+
+void FrameTracer::decode_done(uint32_t frame_number) {
+    if (auto record = this->record(frame_number))
+        record->decode_done_us = HighResClock::now_us();
+}
+
+void FrameTracer::queue_popped(uint32_t frame_number) {
+    // Same frame could be drawn several times if queue is empty
+    if (frame_number == m_last_popped_frame)
+        return;
+
+    m_last_popped_frame = frame_number;
+    if (auto record = this->record(frame_number))
+        record->queue_pop_us = HighResClock::now_us();
+}
+
+void FrameTracer::draw_done(uint32_t frame_number) {
+    if (auto record = this->record(frame_number)) {
+        if (record->draw_done_us == 0) {
+            record->draw_done_us = HighResClock::now_us();
+            m_last_drawn_frame = frame_number;
+        }
+    }
+}
+
+void FrameTracer::swap_done() {
+    if (auto record = this->record(m_last_drawn_frame)) {
+        if (record->swap_us == 0) {
+            record->swap_us = HighResClock::now_us();
+            // Rest of UI drawing and buffer swap, borealis does both
+            TRACE_SPAN("Overlay and swap", record->draw_done_us, record->swap_us);
+        }
+    }
+}
+
+float FrameTracer::end_to_end_ms(const FrameTraceRecord& record) {
+    return (float)(record.submit_ms - record.receive_ms) +
+           (float)(record.swap_us - record.decode_submit_us) / 1000.0f;
+}
+
+float FrameTracer::last_latency_ms() {
+    auto record = this->record(m_last_drawn_frame);
+    if (!record || record->swap_us == 0 || record->decode_submit_us == 0)
+        return 0;
+    return end_to_end_ms(*record);
+}
+
+FrameLatencySummary FrameTracer::summary() {
+    uint64_t now = HighResClock::now_us();
+    if (now - m_summary_timestamp < SUMMARY_INTERVAL_US)
+        return m_summary;
+    m_summary_timestamp = now;
+
+    std::vector<float> latencies;
+    latencies.reserve(FRAME_TRACE_SIZE);
+    for (const auto& record : m_records) {
+        if (record.swap_us != 0)
+            latencies.push_back(end_to_end_ms(record));
+    }
+
+    m_summary = {};
+    m_summary.samples = latencies.size();
+    if (latencies.empty())
+        return m_summary;
+
+    for (float latency : latencies) {
+        if (latency < 8) m_summary.histogram[0]++;
+        else if (latency < 16) m_summary.histogram[1]++;
+        else if (latency < 33) m_summary.histogram[2]++;
+        else if (latency < 50) m_summary.histogram[3]++;
+        else m_summary.histogram[4]++;
+    }
+
+    size_t p50 = latencies.size() / 2;
+    size_t p99 = std::min(latencies.size() - 1, latencies.size() * 99 / 100);
+    std::nth_element(latencies.begin(), latencies.begin() + p50, latencies.end());
+    m_summary.p50_ms = latencies[p50];
+    std::nth_element(latencies.begin(), latencies.begin() + p99, latencies.end());
+    m_summary.p99_ms = latencies[p99];
+
+    return m_summary;
+}
+
+bool FrameTracer::dump(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        brls::Logger::error("FrameTracer: Failed to open {}", path);
+        return false;
+    }
+
+    fprintf(file, "frame,receive_ms,submit_ms,decode_submit_us,decode_done_us,queue_pop_us,draw_done_us,swap_us,end_to_end_ms\n");
+
+    std::vector<FrameTraceRecord> records(std::begin(m_records), std::end(m_records));
+    std::sort(records.begin(), records.end(), [](const auto& l, const auto& r) {
+        return l.frame_number < r.frame_number;
+    });
+
+    for (const auto& record : records) {
+        if (record.frame_number == 0)
+            continue;
+
+        fprintf(file, "%u,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.3f\n",
+                record.frame_number,
+                (unsigned long long)record.receive_ms,
+                (unsigned long long)record.submit_ms,
+                (unsigned long long)record.decode_submit_us,
+                (unsigned long long)record.decode_done_us,
+                (unsigned long long)record.queue_pop_us,
+                (unsigned long long)record.draw_done_us,
+                (unsigned long long)record.swap_us,
+                record.swap_us != 0 ? end_to_end_ms(record) : 0.0f);
+    }
+
+    fclose(file);
+    brls::Logger::info("FrameTracer: Trace saved to {}", path);
+    return true;
+}
@@ -0,0 +1,67 @@
+//
+//  FrameTracer.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Singleton.hpp"
+#include <cstdint>
+#include <string>
+
+// Number of last frames kept for latency statistics
+#define FRAME_TRACE_SIZE 512
+
+// Timestamps of a single frame passing through the pipeline.
+// receive_ms comes from moonlight-common-c millisecond clock,
+// everything after decode submit uses microsecond steady clock.
+struct FrameTraceRecord {
+    uint32_t frame_number;
+    uint64_t receive_ms;
+    uint64_t submit_ms;
+    uint64_t decode_submit_us;
+    uint64_t decode_done_us;
+    uint64_t queue_pop_us;
+    uint64_t draw_done_us;
+    uint64_t swap_us;
+};
+
+struct FrameLatencySummary {
+    size_t samples;
+    float p50_ms;
+    float p99_ms;
+    // Frames by end-to-end latency: <8, <16, <33, <50, >=50 ms
+    uint32_t histogram[5];
+};
+
+class FrameTracer : public Singleton<FrameTracer> {
+  public:
+    void reset();
+
+    // Decoder thread
+    void decode_submitted(uint32_t frame_number, uint64_t receive_ms, uint64_t submit_ms);
+    void decode_done(uint32_t frame_number);
+
+    // UI thread
+    void queue_popped(uint32_t frame_number);
+    void draw_done(uint32_t frame_number);
+    // Swap is not observable from app side, so it's marked when next
+    // draw starts, right after previous buffer was presented
+    void swap_done();
+
+    [[nodiscard]] FrameLatencySummary summary();
+    // End-to-end latency of the last presented frame, 0 until it's known
+    [[nodiscard]] float last_latency_ms();
+    bool dump(const std::string& path);
+
+  private:
+    FrameTraceRecord* record(uint32_t frame_number);
+    static float end_to_end_ms(const FrameTraceRecord& record);
+
+    FrameTraceRecord m_records[FRAME_TRACE_SIZE] = {};
+    uint32_t m_last_drawn_frame = 0;
+    uint32_t m_last_popped_frame = 0;
+
+    FrameLatencySummary m_summary = {};
+    uint64_t m_summary_timestamp = 0;
+};
@@ -1,12 +1,20 @@
 #include "GameStreamClient.hpp"
+#include "BoxArtManager.hpp"
 #include "Settings.hpp"
 #include "WakeOnLanManager.hpp"
+#include "HighResClock.hpp"
+#include "HostPinger.hpp"
+#include "PathMtu.hpp"
+#include "ThreadProfiler.hpp"
 #include <borealis.hpp>
+#include <algorithm>
+#include <memory>
 #include <thread>
 #include <unistd.h>
 #include <vector>
 
 #include <curl/curl.h>
+#include <jansson.h>
 #include <libretro-common/retro_timers.h>
 #include <cstring>
 
@@ -31,18 +39,21 @@ struct ipv6_mreq {
 #endif
 
 #ifndef MULTICAST_DISABLED
-extern "C" {
-#include <mdns.h>
-}
+#include "MdnsDiscovery.hpp"
 #endif
 
 using namespace brls;
 
 GameStreamClient::GameStreamClient() { start(); }
 
-void GameStreamClient::start() {}
+void GameStreamClient::start() { load_host_cache(); }
 
-void GameStreamClient::stop() {}
+void GameStreamClient::stop() {
+    GameStreamExecutor::instance().stop();
+    // Placeholders made since app list was saved
+    if (BoxArtManager::instance().placeholder_generation() != m_saved_placeholders)
+        save_host_cache();
+}
 
 static uint32_t get_my_ip_address() {
     uint32_t address = 0;
@@ -62,26 +73,52 @@ static uint32_t get_my_ip_address() {
     return address;
 }
 
-std::vector<std::string> GameStreamClient::host_addresses_for_find() {
-    std::vector<std::string> addresses;
+// Network byte order, 0 when platform can't tell it
+static uint32_t get_my_netmask() {
+    uint32_t netmask = 0;
+#if defined(__linux) || defined(__APPLE__)
+    struct ifreq ifr;
+    ifr.ifr_addr.sa_family = AF_INET;
+    strncpy(ifr.ifr_name, "en0", IFNAMSIZ - 1);
 
-    uint32_t address = get_my_ip_address();
-    bool isSucceed = address != 0;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (ioctl(fd, SIOCGIFNETMASK, &ifr) == 0)
+        netmask = ((struct sockaddr_in*)&ifr.ifr_addr)->sin_addr.s_addr;
+    close(fd);
+#elif defined(__SWITCH__)
+    u32 address, gateway, dns1, dns2;
+    if (R_FAILED(nifmGetCurrentIpConfigInfo(&address, &netmask, &gateway, &dns1, &dns2)))
+        netmask = 0;
+#endif
+    return netmask;
+}
 
-    if (isSucceed) {
-        uint32_t a = address & 0xFF;
-        uint32_t b = (address >> 8) & 0xFF;
-        uint32_t c = (address >> 16) & 0xFF;
-        uint32_t d = (address >> 24) & 0xFF;
+std::vector<std::string> GameStreamClient::host_addresses_for_find() {
+    std::vector<std::string> addresses;
 
-        for (int i = 0; i < 256; i++) {
-            if (i == d) {
-                continue;
-            }
-            addresses.push_back(std::to_string(a) + "." + std::to_string(b) +
-                                "." + std::to_string(c) + "." +
-                                std::to_string(i));
-        }
+    uint32_t address = ntohl(get_my_ip_address());
+    if (address == 0)
+        return addresses;
+
+    // Unknown mask is scanned as /24, wider ones are limited so
+    // discovery still ends in reasonable time
+    uint32_t netmask = ntohl(get_my_netmask());
+    if (netmask == 0)
+        netmask = 0xFFFFFF00;
+    netmask |= DISCOVERY_MIN_NETMASK;
+
+    uint32_t network = address & netmask;
+    uint32_t broadcast = network | ~netmask;
+
+    for (uint32_t host = network + 1; host < broadcast; host++) {
+        if (host == address)
+            continue;
+
+        struct in_addr host_addr;
+        host_addr.s_addr = htonl(host);
+        char buffer[INET_ADDRSTRLEN];
+        if (inet_ntop(AF_INET, &host_addr, buffer, sizeof(buffer)))
+            addresses.push_back(buffer);
     }
     return addresses;
 }
@@ -89,152 +126,211 @@ std::vector<std::string> GameStreamClient::host_addresses_for_find() {
 bool GameStreamClient::can_find_host() { return get_my_ip_address() != 0; }
 
 #ifndef MULTICAST_DISABLED
- static std::vector<Host> foundHosts;
- static std::string foundHost;
-
-std::string get_ip_str(const struct sockaddr *addr)
-{
-    char addrStr[INET6_ADDRSTRLEN];
-    if (addr->sa_family == AF_INET) {
-        inet_ntop(addr->sa_family, &((struct sockaddr_in*)addr)->sin_addr, addrStr, sizeof(addrStr));
-        unsigned short port = htons(((struct sockaddr_in*)addr)->sin_port);
-        return fmt::format("{}", addrStr);
-    }
-    else {
-        struct sockaddr_in6* sin6 = (struct sockaddr_in6*)addr;
-        inet_ntop(addr->sa_family, &sin6->sin6_addr, addrStr, sizeof(addrStr));
-        unsigned short port = ntohs(((struct sockaddr_in6*)addr)->sin6_port);
-        if (sin6->sin6_scope_id != 0) {
-            // Link-local addresses with scope IDs are special
-            return fmt::format("{}{}", addrStr, sin6->sin6_scope_id);
-        }
-        else {
-            return fmt::format("{}", addrStr);
-        }
-    }
+void GameStreamClient::find_hosts(ServerCallback<std::vector<Host>>& callback) {
+    MdnsDiscovery::instance().start(callback);
 }
 
-static int mdns_discovery_callback(int sock, const struct sockaddr* from, size_t addrlen,
-                                   mdns_entry_type_t entry, uint16_t query_id, uint16_t type,
-                                   uint16_t rclass, uint32_t ttl, const void* data, size_t size,
-                                   size_t offset, size_t length, size_t record_offset,
-                                   size_t record_length, void* user_data)
-{
-    if (type == MDNS_RECORDTYPE_A) {
-        foundHost = get_ip_str(from);
-    }
-    return 0;
+void GameStreamClient::stop_find_hosts() {
+    MdnsDiscovery::instance().stop();
 }
+#endif
 
-void GameStreamClient::find_hosts(ServerCallback<std::vector<Host>>& callback) {
-    brls::async([callback] {
-        foundHosts.clear();
-
-        size_t capacity = 2048;
-        void* buffer = malloc(capacity);
-        size_t records;
+bool GameStreamClient::can_wake_up_host(const Host& host) {
+    return WakeOnLanManager::can_wake_up_host(host);
+}
 
+void GameStreamClient::wake_up_host(const Host& host,
+                                    ServerCallback<bool>& callback) {
+    // Unknown mask is taken as /24, as in host discovery
+    uint32_t address = ntohl(get_my_ip_address());
+    uint32_t netmask = ntohl(get_my_netmask());
+    if (netmask == 0)
+        netmask = 0xFFFFFF00;
+    uint32_t subnet_broadcast = address ? htonl((address & netmask) | ~netmask) : 0;
+
+    brls::async([host, callback, subnet_broadcast] {
+        auto result = WakeOnLanManager::wake_up_and_wait(host, subnet_broadcast);
+        brls::sync([callback, result = std::move(result)]() mutable { callback(std::move(result)); });
+    });
+}
 
-        int sock = mdns_socket_open_ipv4(nullptr);
-        if (sock < 0) {
-            return;
-        }
+// Copied server info keeps pointing to strings of the source
+static void attach_server_info(SERVER_DATA& data) {
+    data.serverInfo.address = data.address.c_str();
+    data.serverInfo.serverInfoAppVersion = data.serverInfoAppVersion.c_str();
+    data.serverInfo.serverInfoGfeVersion = data.serverInfoGfeVersion.c_str();
+}
 
-        if (mdns_query_send(sock, MDNS_RECORDTYPE_PTR,
-                        MDNS_STRING_CONST("_nvstream._tcp.local"),
-                        buffer, capacity, 0)) {
-            brls::sync([callback] {
-                callback(GSResult<std::vector<Host>>::failure(
-                        "error/unknown_error"_i18n));
-            });
-            return;
-        }
+SERVER_DATA GameStreamClient::server_data(const std::string& address) {
+    SERVER_DATA data{};
+    {
+        std::lock_guard<std::mutex> lock(m_server_data_mutex);
+        auto it = m_server_data.find(address);
+        if (it != m_server_data.end())
+            data = it->second;
+    }
+    attach_server_info(data);
+    return data;
+}
 
-        int empty_cnt = 0;
-        while (true) {
-            records = mdns_query_recv(sock, buffer, capacity, mdns_discovery_callback, (void*)(&callback), 0);
-            if (records == 0) {
-                empty_cnt++;
-            } else {
-                empty_cnt = 0;
-
-                SERVER_DATA server_data;
-
-                int status = gs_init(&server_data, foundHost);
-                if (status == GS_OK) {
-                    Host host;
-                    host.address = foundHost;
-                    host.hostname = server_data.hostname;
-                    host.mac = server_data.mac;
-                    foundHosts.push_back(host);
-
-                    brls::sync([callback] {
-                        callback(GSResult<std::vector<Host>>::success(foundHosts));
-                    });
-                }
-            }
-            // wait 30sec after last receive
-            if (empty_cnt >= 10) {
-                break;
-            }
+bool GameStreamClient::has_server_data(const std::string& address) {
+    std::lock_guard<std::mutex> lock(m_server_data_mutex);
+    return m_server_data.count(address) != 0;
+}
 
-            retro_sleep(500);
-        }
-    });
+void GameStreamClient::set_server_data(const std::string& address, const SERVER_DATA& data) {
+    std::lock_guard<std::mutex> lock(m_server_data_mutex);
+    SERVER_DATA& stored = m_server_data[address];
+    stored = data;
+    attach_server_info(stored);
 }
-#endif
 
-bool GameStreamClient::can_wake_up_host(const Host& host) {
-    return WakeOnLanManager::can_wake_up_host(host);
+static std::string server_tag(const SERVER_DATA& data) {
+    return fmt::format("{}:{}", data.currentGame, data.paired);
 }
 
-void GameStreamClient::wake_up_host(const Host& host,
-                                    ServerCallback<bool>& callback) {
-    brls::async([host, callback] {
-        auto result = WakeOnLanManager::wake_up_host(host);
-
-        if (result.isSuccess()) {
-            usleep(5'000'000);
-            brls::sync([callback, result] { callback(result); });
-        } else {
-            brls::sync([callback, result] { callback(result); });
-        }
-    });
+static std::string applist_tag(const AppInfoList& apps) {
+    std::string tag = std::to_string(apps.size());
+    for (const AppInfo& app : apps)
+        tag += ":" + std::to_string(app.app_id);
+    return tag;
 }
 
 void GameStreamClient::connect(const std::string& address,
-                               ServerCallback<SERVER_DATA>& callback) {
+                               ServerCallback<SERVER_DATA>& callback, bool cached) {
     if (address.empty()) {
         callback(GSResult<SERVER_DATA>::failure("Address is Empty"));
         return;
     }
 
-    SERVER_DATA* data = new SERVER_DATA();
-    brls::async([this, address, callback, data] {
-        int status = gs_init(data, address);
+    HostCache& cache = m_host_cache[address];
+    if (cached && cache.server_time_us && has_server_data(address)) {
+        callback(GSResult<SERVER_DATA>::success(server_data(address)));
 
-        brls::sync([this, address, callback, status, data] {
-            if (status == GS_OK) {
-                m_server_data[address] = *data;
-                callback(GSResult<SERVER_DATA>::success(m_server_data[address]));
-            } else {
-                callback(GSResult<SERVER_DATA>::failure(gs_error()));
-            }
+        if (HighResClock::now_us() - cache.server_time_us < HOST_CACHE_FRESH_US ||
+            cache.server_refreshing)
+            return;
+
+        fetch_server(address, callback, true);
+        return;
+    }
+
+    fetch_server(address, callback, false);
+}
+
+void GameStreamClient::warm_up(const std::string& address) {
+    connect(address, [this, address](GSResult<SERVER_DATA> result) {
+        if (result.isSuccess())
+            applist(address, [](auto result) {}, true);
+    });
+}
+
+void GameStreamClient::refresh_hosts(const std::vector<Host>& hosts) {
+    for (const Host& host : hosts) {
+        if (!host.address.empty())
+            fetch_server(host.address, [](auto result) {}, true);
+    }
+}
+
+void GameStreamClient::fetch_server(const std::string& address,
+                                    ServerCallback<SERVER_DATA>& callback, bool only_changes) {
+    HostCache& cache = m_host_cache[address];
+    cache.server_requests.push_back({callback, only_changes});
+
+    // Host is already being queried, its result goes to every caller
+    if (cache.server_refreshing)
+        return;
+
+    cache.server_refreshing = true;
+    uint32_t generation = ++cache.server_generation;
+
+    // Own thread instead of async pool, so refresh of all saved hosts
+    // isn't queued behind box art downloads and each other
+    std::thread([this, address, generation] {
+        ThreadProfileScope profile("Host refresh");
+        auto data = std::make_shared<SERVER_DATA>();
+        int status = gs_init(data.get(), address);
+        std::string error = status == GS_OK ? "" : gs_error();
+
+        brls::sync([this, address, generation, status, data, error] {
+            HostCache& cache = m_host_cache[address];
+            if (!cache.server_refreshing || cache.server_generation != generation)
+                return;
+
+            if (status == GS_OK)
+                finish_fetch_server(address, GSResult<SERVER_DATA>::success(std::move(*data)));
+            else
+                finish_fetch_server(address, GSResult<SERVER_DATA>::failure(error));
         });
+    }).detach();
+
+    brls::delay(HOST_REFRESH_TIMEOUT_MS, [this, address, generation] {
+        HostCache& cache = m_host_cache[address];
+        if (!cache.server_refreshing || cache.server_generation != generation)
+            return;
+
+        brls::Logger::warning("GameStreamClient: {} did not answer in {} ms",
+                              address, HOST_REFRESH_TIMEOUT_MS);
+        finish_fetch_server(address, GSResult<SERVER_DATA>::failure("Host did not answer in time"));
     });
 }
 
+void GameStreamClient::finish_fetch_server(const std::string& address,
+                                           GSResult<SERVER_DATA> result) {
+    HostCache& cache = m_host_cache[address];
+    cache.server_refreshing = false;
+
+    auto requests = std::move(cache.server_requests);
+    cache.server_requests.clear();
+
+    // Going from cached state to unreachable is a change too
+    bool changed = true;
+    if (result.isSuccess()) {
+        set_server_data(address, result.value());
+
+        std::string tag = server_tag(result.value());
+        changed = tag != cache.server_tag;
+        cache.server_tag = tag;
+        cache.server_time_us = HighResClock::now_us();
+
+        if (changed)
+            save_host_cache();
+    } else {
+        // Next access waits for host instead of showing stale state
+        cache.server_time_us = 0;
+        cache.apps_time_us = 0;
+    }
+
+    m_host_status_event.fire(address, result);
+
+    // Several views can wait for same host, each gets its own copy
+    for (auto& request : requests) {
+        if (!request.only_changes || changed)
+            request.callback(GSResult<SERVER_DATA>(result));
+    }
+}
+
 void GameStreamClient::pair(const std::string& address, const std::string& pin,
-                            ServerCallback<bool>& callback) {
-    if (m_server_data.count(address) == 0) {
+                            ServerCallback<bool>& callback, GSCancelToken token) {
+    if (!has_server_data(address)) {
         callback(GSResult<bool>::failure("Firstly call connect()..."));
         return;
     }
 
-    brls::async([this, address, pin, callback] {
-        int status = gs_pair(&m_server_data[address], (char*)pin.c_str());
+    GameStreamExecutor::instance().submit(GS_LANE_INTERACTIVE, [this, address, pin, callback, token] {
+        if (gs_is_cancelled(token))
+            return;
+
+        SERVER_DATA server = server_data(address);
+        int status = gs_pair(&server, (char*)pin.c_str(), token ? token->flag() : nullptr);
+        if (status == GS_OK)
+            set_server_data(address, server);
+
+        brls::sync([callback, status, token] {
+            // View which cancelled is done with pairing already
+            if (gs_is_cancelled(token))
+                return;
 
-        brls::sync([callback, status] {
             if (status == GS_OK) {
                 callback(GSResult<bool>::success(true));
             } else {
@@ -245,65 +341,371 @@ void GameStreamClient::pair(const std::string& address, const std::string& pin,
 }
 
 void GameStreamClient::applist(const std::string& address,
-                               ServerCallback<AppInfoList>& callback) {
-    if (m_server_data.count(address) == 0) {
+                               ServerCallback<AppInfoList>& callback, bool cached,
+                               GSCancelToken token) {
+    if (!has_server_data(address)) {
         callback(GSResult<AppInfoList>::failure(
             "Firstly call connect() & pair()..."));
         return;
     }
 
-    brls::async([this, address, callback] {
-        PAPP_LIST list;
+    HostCache& cache = m_host_cache[address];
+    if (cached && cache.apps_time_us) {
+        callback(GSResult<AppInfoList>::success(cache.apps));
 
-        int status = gs_applist(&m_server_data[address], &list);
-        if (status != CURLE_OK) {
-            callback(GSResult<AppInfoList>::failure(gs_error()));
+        if (HighResClock::now_us() - cache.apps_time_us < HOST_CACHE_FRESH_US ||
+            cache.apps_refreshing)
             return;
-        }
 
-        AppInfoList app_list;
+        fetch_applist(address, callback, true, token);
+        return;
+    }
 
-        while (list) {
+    fetch_applist(address, callback, false, token);
+}
 
-            std::string name = std::string(list->name);
-            int id = list->id;
-            AppInfo info;
-            info.name = name;
-            info.app_id = id;
-            app_list.push_back(info);
-            list = list->next;
+void GameStreamClient::fetch_applist(const std::string& address,
+                                     ServerCallback<AppInfoList>& callback, bool only_changes,
+                                     GSCancelToken token) {
+    m_host_cache[address].apps_refreshing = true;
+    // List rarely changes size, last one tells how much to reserve
+    size_t expected_apps = m_host_cache[address].apps.size();
+
+    GameStreamExecutor::instance().submit(GS_LANE_APPLIST, [this, address, callback, only_changes, token,
+                                                           expected_apps] {
+        // View is gone before request got its turn
+        if (gs_is_cancelled(token)) {
+            brls::sync([this, address] { m_host_cache[address].apps_refreshing = false; });
+            return;
         }
 
+        AppInfoList app_list;
+        app_list.reserve(expected_apps);
+
+        SERVER_DATA server = server_data(address);
+        int status = gs_applist(&server, [&app_list](int id, const char* name, size_t name_size) {
+            app_list.push_back({std::string(name, name_size), id});
+        });
+        std::string error = status == GS_OK ? "" : gs_error();
+        if (status != GS_OK)
+            app_list.clear();
+
         std::sort(app_list.begin(), app_list.end(),
                   [](const AppInfo& a, const AppInfo& b) { return a.name < b.name; });
 
-        brls::sync([app_list, callback, status] {
+        // List is moved from worker into callback, only cache takes a copy
+        brls::sync([this, address, app_list = std::move(app_list), callback, status, only_changes, error,
+                    token]() mutable {
+            HostCache& cache = m_host_cache[address];
+            cache.apps_refreshing = false;
+
             if (status == GS_OK) {
-                callback(GSResult<AppInfoList>::success(app_list));
+                std::string tag = applist_tag(app_list);
+                bool changed = tag != cache.apps_tag;
+                cache.apps = app_list;
+                cache.apps_tag = tag;
+                cache.apps_time_us = HighResClock::now_us();
+
+                if (changed || BoxArtManager::instance().placeholder_generation() != m_saved_placeholders)
+                    save_host_cache();
+
+                // Cache is updated anyway, only result is dropped
+                if ((!only_changes || changed) && !gs_is_cancelled(token))
+                    callback(GSResult<AppInfoList>::success(std::move(app_list)));
             } else {
-                callback(GSResult<AppInfoList>::failure(gs_error()));
+                cache.apps_time_us = 0;
+
+                if (!only_changes && !gs_is_cancelled(token))
+                    callback(GSResult<AppInfoList>::failure(error));
             }
         });
     });
 }
 
+static std::string json_string_field(json_t* object, const char* key) {
+    const char* value = json_string_value(json_object_get(object, key));
+    return value ? value : "";
+}
+
+void GameStreamClient::load_host_cache() {
+    json_t* root = json_load_file(Settings::instance().host_cache_path().c_str(), 0, nullptr);
+
+    if (!root || json_typeof(root) != JSON_OBJECT) {
+        if (root)
+            json_decref(root);
+        return;
+    }
+
+    const char* address;
+    json_t* json;
+    json_object_foreach(root, address, json) {
+        if (json_typeof(json) != JSON_OBJECT)
+            continue;
+
+        SERVER_DATA& data = m_server_data[address];
+        LiInitializeServerInformation(&data.serverInfo);
+
+        data.address = json_string_field(json, "host");
+        data.hostname = json_string_field(json, "hostname");
+        data.mac = json_string_field(json, "mac");
+        data.gpuType = json_string_field(json, "gpu_type");
+        data.gsVersion = json_string_field(json, "gs_version");
+        data.serverInfoAppVersion = json_string_field(json, "app_version");
+        data.serverInfoGfeVersion = json_string_field(json, "gfe_version");
+        data.paired = json_is_true(json_object_get(json, "paired"));
+        data.serverInfo.serverCodecModeSupport = (int)json_integer_value(json_object_get(json, "codec_support"));
+        data.httpPort = (unsigned short)json_integer_value(json_object_get(json, "http_port"));
+        data.httpsPort = (unsigned short)json_integer_value(json_object_get(json, "https_port"));
+
+        // Running game is never trusted from disk, host reports it on revalidation
+        data.currentGame = 0;
+        data.supports4K = data.serverInfo.serverCodecModeSupport != 0;
+        data.serverMajorVersion = atoi(data.serverInfoAppVersion.c_str());
+        data.serverInfo.address = data.address.c_str();
+        data.serverInfo.serverInfoAppVersion = data.serverInfoAppVersion.c_str();
+        data.serverInfo.serverInfoGfeVersion = data.serverInfoGfeVersion.c_str();
+
+        if (data.address.empty() || !data.httpPort || !data.httpsPort) {
+            m_server_data.erase(address);
+            continue;
+        }
+
+        // Oldest possible time, so first access shows it and revalidates
+        HostCache& cache = m_host_cache[address];
+        cache.server_time_us = 1;
+        cache.server_tag = server_tag(data);
+        cache.path_mtu = (int)json_integer_value(json_object_get(json, "path_mtu"));
+        if (json_t* rtt = json_object_get(json, "rtt_ms"))
+            HostPinger::instance().seed(address, (float)json_number_value(rtt),
+                                        (float)json_number_value(json_object_get(json, "jitter_ms")));
+
+        // Placeholders are kept by host id, same as box art
+        std::string boxart_host;
+        for (const Host& host : Settings::instance().hosts()) {
+            if (host.address == address)
+                boxart_host = BoxArtManager::host_id(host);
+        }
+
+        if (json_t* apps = json_object_get(json, "apps")) {
+            size_t size = json_array_size(apps);
+            for (size_t i = 0; i < size; i++) {
+                json_t* app = json_array_get(apps, i);
+                const char* name = json_string_value(json_object_get(app, "name"));
+                if (!name)
+                    continue;
+
+                AppInfo info;
+                info.name = name;
+                info.app_id = (int)json_integer_value(json_object_get(app, "id"));
+                cache.apps.push_back(info);
+
+                const char* placeholder = json_string_value(json_object_get(app, "placeholder"));
+                if (placeholder && !boxart_host.empty())
+                    BoxArtManager::instance().set_placeholder({boxart_host, info.app_id}, placeholder);
+            }
+
+            cache.apps_time_us = 1;
+            cache.apps_tag = applist_tag(cache.apps);
+        }
+    }
+
+    json_decref(root);
+    m_saved_placeholders = BoxArtManager::instance().placeholder_generation();
+    brls::Logger::info("GameStreamClient: Loaded cached state of {} hosts", m_host_cache.size());
+}
+
+void GameStreamClient::save_host_cache() {
+    json_t* root = json_object();
+
+    std::lock_guard<std::mutex> lock(m_server_data_mutex);
+    m_saved_placeholders = BoxArtManager::instance().placeholder_generation();
+
+    // Only saved hosts are kept, removed ones drop out on next save
+    for (const Host& host : Settings::instance().hosts()) {
+        auto server = m_server_data.find(host.address);
+        auto cache = m_host_cache.find(host.address);
+        if (server == m_server_data.end() || cache == m_host_cache.end() ||
+            !cache->second.server_time_us)
+            continue;
+
+        const SERVER_DATA& data = server->second;
+        json_t* json = json_object();
+        json_object_set_new(json, "host", json_string(data.address.c_str()));
+        json_object_set_new(json, "hostname", json_string(data.hostname.c_str()));
+        json_object_set_new(json, "mac", json_string(data.mac.c_str()));
+        json_object_set_new(json, "gpu_type", json_string(data.gpuType.c_str()));
+        json_object_set_new(json, "gs_version", json_string(data.gsVersion.c_str()));
+        json_object_set_new(json, "app_version", json_string(data.serverInfoAppVersion.c_str()));
+        json_object_set_new(json, "gfe_version", json_string(data.serverInfoGfeVersion.c_str()));
+        json_object_set_new(json, "paired", json_boolean(data.paired));
+        json_object_set_new(json, "codec_support", json_integer(data.serverInfo.serverCodecModeSupport));
+        json_object_set_new(json, "http_port", json_integer(data.httpPort));
+        json_object_set_new(json, "https_port", json_integer(data.httpsPort));
+        if (cache->second.path_mtu)
+            json_object_set_new(json, "path_mtu", json_integer(cache->second.path_mtu));
+        HostLatency latency = HostPinger::instance().latency(host.address);
+        if (latency.rtt_ms > 0) {
+            json_object_set_new(json, "rtt_ms", json_real(latency.rtt_ms));
+            json_object_set_new(json, "jitter_ms", json_real(latency.jitter_ms));
+        }
+
+        if (cache->second.apps_time_us) {
+            json_t* apps = json_array();
+            std::string boxart_host = BoxArtManager::host_id(host);
+            for (const AppInfo& info : cache->second.apps) {
+                json_t* app = json_object();
+                json_object_set_new(app, "id", json_integer(info.app_id));
+                json_object_set_new(app, "name", json_string(info.name.c_str()));
+                std::string placeholder = BoxArtManager::instance().placeholder({boxart_host, info.app_id});
+                if (!placeholder.empty())
+                    json_object_set_new(app, "placeholder", json_string(placeholder.c_str()));
+                json_array_append_new(apps, app);
+            }
+            json_object_set_new(json, "apps", apps);
+        }
+
+        json_object_set_new(root, host.address.c_str(), json);
+    }
+
+    json_dump_file(root, Settings::instance().host_cache_path().c_str(), JSON_COMPACT);
+    json_decref(root);
+}
+
+static std::string boxart_key(const std::string& address, int app_id) {
+    return address + "/" + std::to_string(app_id);
+}
+
 void GameStreamClient::app_boxart(const std::string& address, int app_id,
-                                  ServerCallback<Data>& callback) {
-    if (m_server_data.count(address) == 0) {
+                                  ServerCallback<Data>& callback, GSCancelToken token,
+                                  bool refresh) {
+    if (!has_server_data(address)) {
         callback(GSResult<Data>::failure("Firstly call connect() & pair()..."));
         return;
     }
 
-    brls::async([this, address, app_id, callback] {
-        Data data;
-        int status = gs_app_boxart(&m_server_data[address], app_id, &data);
+    std::string key = boxart_key(address, app_id);
 
-        brls::sync([callback, data, status] {
-            if (status == GS_OK) {
-                callback(GSResult<Data>::success(data));
-            } else {
-                callback(GSResult<Data>::failure(gs_error()));
+    std::lock_guard<std::mutex> lock(m_boxart_mutex);
+    auto request = m_boxart_requests.find(key);
+    if (request != m_boxart_requests.end()) {
+        // Same app is already queued or downloading, share its result
+        request->second.waiters.push_back({callback, token});
+
+        auto queued = std::find(m_boxart_refresh_queue.begin(), m_boxart_refresh_queue.end(), key);
+        if (!refresh && queued != m_boxart_refresh_queue.end()) {
+            m_boxart_refresh_queue.erase(queued);
+            m_boxart_queue.push_back(key);
+        }
+        return;
+    }
+
+    m_boxart_requests[key] = {address, app_id, {{callback, token}}};
+    (refresh ? m_boxart_refresh_queue : m_boxart_queue).push_back(key);
+
+    if (m_boxart_workers < BOXART_MAX_CONCURRENT) {
+        m_boxart_workers++;
+        GameStreamExecutor::instance().submit(GS_LANE_BOXART, [this] { run_boxart_request(); });
+    }
+}
+
+void GameStreamClient::prioritize_boxart(const std::string& address, int app_id) {
+    std::string key = boxart_key(address, app_id);
+
+    std::lock_guard<std::mutex> lock(m_boxart_mutex);
+    auto it = std::find(m_boxart_queue.begin(), m_boxart_queue.end(), key);
+    if (it == m_boxart_queue.end() || it == m_boxart_queue.begin())
+        return;
+
+    m_boxart_queue.erase(it);
+    m_boxart_queue.push_front(key);
+}
+
+void GameStreamClient::run_boxart_request() {
+    auto cancelled = [](const std::vector<BoxArtWaiter>& waiters) {
+        return std::all_of(waiters.begin(), waiters.end(),
+                           [](auto& waiter) { return gs_is_cancelled(waiter.token); });
+    };
+
+    std::string key;
+    std::string address;
+    int app_id;
+    {
+        std::lock_guard<std::mutex> lock(m_boxart_mutex);
+
+        // Requests of cells that are gone are dropped without download
+        for (auto* queue : {&m_boxart_queue, &m_boxart_refresh_queue}) {
+            while (!queue->empty() && cancelled(m_boxart_requests[queue->front()].waiters)) {
+                m_boxart_requests.erase(queue->front());
+                queue->pop_front();
             }
+        }
+
+        auto& queue = m_boxart_queue.empty() ? m_boxart_refresh_queue : m_boxart_queue;
+        if (queue.empty()) {
+            m_boxart_workers--;
+            return;
+        }
+
+        key = queue.front();
+        queue.pop_front();
+        address = m_boxart_requests[key].address;
+        app_id = m_boxart_requests[key].app_id;
+    }
+
+    Data data;
+    SERVER_DATA server = server_data(address);
+    int status = gs_app_boxart(&server, app_id, &data);
+    std::string error = status == GS_OK ? "" : gs_error();
+
+    std::vector<BoxArtWaiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_boxart_mutex);
+        waiters = std::move(m_boxart_requests[key].waiters);
+        m_boxart_requests.erase(key);
+    }
+
+    // Box art is moved into result, callbacks share it
+    GSResult<Data> result = status == GS_OK
+                                ? GSResult<Data>::success(std::move(data))
+                                : GSResult<Data>::failure(error);
+
+    // Waiters of the same app are rare, all but the last get a copy
+    brls::sync([waiters = std::move(waiters), result = std::move(result)]() mutable {
+        for (size_t i = 0; i < waiters.size(); i++) {
+            if (gs_is_cancelled(waiters[i].token))
+                continue;
+            if (i + 1 == waiters.size())
+                waiters[i].callback(std::move(result));
+            else
+                waiters[i].callback(GSResult<Data>(result));
+        }
+    });
+
+    GameStreamExecutor::instance().submit(GS_LANE_BOXART, [this] { run_boxart_request(); });
+}
+
+int GameStreamClient::path_mtu(const std::string& address) {
+    HostCache& cache = m_host_cache[address];
+    int mtu = PathMtu::discover(address);
+    if (mtu > 0 && mtu != cache.path_mtu) {
+        cache.path_mtu = mtu;
+        save_host_cache();
+    }
+    return cache.path_mtu;
+}
+
+void GameStreamClient::probe(const std::string& address, int app_id,
+                             ServerCallback<NetworkProbeResult>& callback) {
+    if (!has_server_data(address)) {
+        callback(GSResult<NetworkProbeResult>::failure("Firstly call connect() & pair()..."));
+        return;
+    }
+
+    // Same lane as launch, so it's done before launch request goes out
+    GameStreamExecutor::instance().submit(GS_LANE_INTERACTIVE, [this, address, app_id, callback] {
+        NetworkProbeResult result = NetworkProbe::run(server_data(address), app_id);
+        brls::sync([callback, result] {
+            callback(GSResult<NetworkProbeResult>::success(result));
         });
     });
 }
@@ -311,7 +713,7 @@ void GameStreamClient::app_boxart(const std::string& address, int app_id,
 void GameStreamClient::start(const std::string& address,
                              STREAM_CONFIGURATION config, int app_id,
                              ServerCallback<STREAM_CONFIGURATION>& callback) {
-    if (m_server_data.count(address) == 0) {
+    if (!has_server_data(address)) {
         callback(GSResult<STREAM_CONFIGURATION>::failure(
             "Firstly call connect() & pair()..."));
         return;
@@ -319,12 +721,17 @@ void GameStreamClient::start(const std::string& address,
 
     m_config = config;
 
-    brls::async([this, address, app_id, callback] {
-        int status = gs_start_app(&m_server_data[address], &m_config, app_id,
+    GameStreamExecutor::instance().submit(GS_LANE_INTERACTIVE, [this, address, app_id, callback] {
+        auto server = std::make_shared<SERVER_DATA>(server_data(address));
+        int status = gs_start_app(server.get(), &m_config, app_id,
                                   Settings::instance().sops(),
                                   Settings::instance().play_audio(), 0x1);
 
-        brls::sync([this, callback, status] {
+        brls::sync([this, address, server, callback, status] {
+            // Running game and RTSP session URL are read by the stream. Set
+            // on UI thread right before callback, so host refresh running
+            // alongside launch doesn't replace them in between
+            set_server_data(address, *server);
             if (status == GS_OK) {
                 callback(GSResult<STREAM_CONFIGURATION>::success(m_config));
             } else {
@@ -334,17 +741,29 @@ void GameStreamClient::start(const std::string& address,
     });
 }
 
+int GameStreamClient::resume(const std::string& address,
+                             STREAM_CONFIGURATION& config, int app_id) {
+    if (!has_server_data(address))
+        return GS_FAILED;
+
+    SERVER_DATA server = server_data(address);
+    int status = gs_start_app(&server, &config, app_id,
+                              Settings::instance().sops(),
+                              Settings::instance().play_audio(), 0x1);
+    set_server_data(address, server);
+    return status;
+}
+
 void GameStreamClient::quit(const std::string& address,
                             ServerCallback<bool>& callback) {
-    if (m_server_data.count(address) == 0) {
+    if (!has_server_data(address)) {
         callback(GSResult<bool>::failure("Firstly call connect() & pair()..."));
         return;
     }
 
-    auto server_data = m_server_data[address];
-
-    brls::async([server_data, callback] {
-        int status = gs_quit_app((PSERVER_DATA)&server_data);
+    GameStreamExecutor::instance().submit(GS_LANE_INTERACTIVE, [this, address, callback] {
+        SERVER_DATA server = server_data(address);
+        int status = gs_quit_app(&server);
 
         brls::sync([callback, status] {
             if (status == GS_OK) {
@@ -1,34 +1,46 @@
 #include "Data.hpp"
+#include "GameStreamExecutor.hpp"
+#include "NetworkProbe.hpp"
 #include "Singleton.hpp"
 #include "Settings.hpp"
 #include "client.h"
 #include "errors.h"
+#include <borealis.hpp>
+#include <atomic>
+#include <deque>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #pragma once
 
 template <typename T> struct GSResult {
   public:
-    static GSResult success(T value) { return result(value, "", true); }
+    static GSResult success(T value) { return result(std::move(value), "", true); }
 
     static GSResult failure(std::string error) {
-        return result(T(), error, false);
+        return result(T(), std::move(error), false);
     }
 
     [[nodiscard]] bool isSuccess() const { return _isSuccess; }
 
-    T value() const { return _value; }
+    const T& value() const& { return _value; }
 
-    [[nodiscard]] std::string error() const { return _error; }
+    // Payload taken out of result callback owns, std::move(result).value()
+    T&& value() && { return std::move(_value); }
+
+    [[nodiscard]] const std::string& error() const { return _error; }
 
   private:
-    static GSResult result(T value, const std::string& error, bool isSuccess) {
+    static GSResult result(T value, std::string error, bool isSuccess) {
         GSResult result;
-        result._value = value;
-        result._error = error;
+        result._value = std::move(value);
+        result._error = std::move(error);
         result._isSuccess = isSuccess;
         return result;
     }
@@ -38,8 +50,34 @@ template <typename T> struct GSResult {
     bool _isSuccess = false;
 };
 
+// Result is handed over to callback, which can keep its payload without
+// copy. Callbacks taking it by value or const reference fit too
+template <class T>
+using GSCallback = std::function<void(GSResult<T>&&)>;
+
 template <class T>
-using ServerCallback = const std::function<void(GSResult<T>)>;
+using ServerCallback = const GSCallback<T>;
+
+// Held by view which requested work, once it's cancelled queued request
+// is dropped and its result isn't delivered. Request already sent to
+// host runs to the end, except pairing, which polls flag itself
+class GSCancellation {
+  public:
+    static std::shared_ptr<GSCancellation> create() { return std::make_shared<GSCancellation>(); }
+
+    void cancel() { m_cancelled = true; }
+    [[nodiscard]] bool is_cancelled() const { return m_cancelled; }
+    [[nodiscard]] const std::atomic<bool>* flag() const { return &m_cancelled; }
+
+  private:
+    std::atomic<bool> m_cancelled = false;
+};
+
+using GSCancelToken = std::shared_ptr<GSCancellation>;
+
+inline bool gs_is_cancelled(const GSCancelToken& token) {
+    return token && token->is_cancelled();
+}
 
 //struct Host;
 
@@ -50,10 +88,39 @@ struct AppInfo {
 
 using AppInfoList = std::vector<AppInfo>;
 
+// Box art downloads running at the same time, so host isn't flooded
+// when app list with hundreds of games is opened
+#define BOXART_MAX_CONCURRENT 3
+
+// Widest subnet scanned by discovery, /20 is 4094 addresses
+#define DISCOVERY_MIN_NETMASK 0xFFFFF000
+
+// Cached host state younger than this is served without revalidation
+#define HOST_CACHE_FRESH_US 5000000
+
+// Host that doesn't answer in this time is reported unreachable, covers
+// HTTPS attempt and plain HTTP fallback of gs_init()
+#define HOST_REFRESH_TIMEOUT_MS 6000
+
+// Address and result of every finished host state request
+using HostStatusEvent = brls::Event<std::string, GSResult<SERVER_DATA>>;
+
 class GameStreamClient : public Singleton<GameStreamClient> {
   public:
-    SERVER_DATA server_data(const std::string& address) {
-        return m_server_data[address];
+    // Copy with server info pointing to its own strings, safe to use
+    // from any thread
+    SERVER_DATA server_data(const std::string& address);
+    bool has_server_data(const std::string& address);
+    // Reads fields of stored state under lock instead of copying all of
+    // it, nullopt when host isn't known
+    template <typename Read>
+    auto read_server_data(const std::string& address, Read&& read)
+        -> std::optional<decltype(read(std::declval<const SERVER_DATA&>()))> {
+        std::lock_guard<std::mutex> lock(m_server_data_mutex);
+        auto it = m_server_data.find(address);
+        if (it == m_server_data.end())
+            return std::nullopt;
+        return read(it->second);
     }
 
     GameStreamClient();
@@ -64,24 +131,109 @@ class GameStreamClient : public Singleton<GameStreamClient> {
     static std::vector<std::string> host_addresses_for_find();
 
     static bool can_find_host();
+    // Keeps listening for mDNS announcements until stop_find_hosts()
     static void find_hosts(ServerCallback<std::vector<Host>>& callback);
+    static void stop_find_hosts();
 
     static bool can_wake_up_host(const Host& host);
     static void wake_up_host(const Host& host, ServerCallback<bool>& callback);
 
+    // With cached set, known state is returned at once and revalidated
+    // in background, callback is called again only if host state changed
     void connect(const std::string& address,
-                 ServerCallback<SERVER_DATA>& callback);
+                 ServerCallback<SERVER_DATA>& callback, bool cached = false);
+    // Fresh host state and app list in background, run at start for last
+    // used host, so its TLS session is in cache before app list is opened
+    void warm_up(const std::string& address);
+    // Queries all hosts at once, results come with host_status_event()
+    void refresh_hosts(const std::vector<Host>& hosts);
+    HostStatusEvent* host_status_event() { return &m_host_status_event; }
+    // Cancelled pairing stops waiting for PIN entry and is undone on host
     void pair(const std::string& address, const std::string& pin,
-              ServerCallback<bool>& callback);
+              ServerCallback<bool>& callback, GSCancelToken token = nullptr);
     void applist(const std::string& address,
-                 ServerCallback<AppInfoList>& callback);
+                 ServerCallback<AppInfoList>& callback, bool cached = false,
+                 GSCancelToken token = nullptr);
+    // Refresh of box art which is already shown waits until no other box
+    // art is queued
     void app_boxart(const std::string& address, int app_id,
-                    ServerCallback<Data>& callback);
+                    ServerCallback<Data>& callback, GSCancelToken token = nullptr,
+                    bool refresh = false);
+    // Moves queued box art request ahead, called once cell gets on screen
+    void prioritize_boxart(const std::string& address, int app_id);
+    // MTU toward host, discovered again on every call and kept per host
+    // for platforms and paths which can't tell it, 0 when never known
+    int path_mtu(const std::string& address);
+    // Round trip, jitter and throughput to host, asked before launch
+    void probe(const std::string& address, int app_id,
+               ServerCallback<NetworkProbeResult>& callback);
     void start(const std::string& address, STREAM_CONFIGURATION config,
                int app_id, ServerCallback<STREAM_CONFIGURATION>& callback);
     void quit(const std::string& address, ServerCallback<bool>& callback);
+    // Blocking resume of running app for reconnect, gets new input key
+    // and RTSP session, called from reconnect thread
+    int resume(const std::string& address, STREAM_CONFIGURATION& config,
+               int app_id);
 
   private:
+    struct BoxArtWaiter {
+        GSCallback<Data> callback;
+        GSCancelToken token;
+    };
+
+    struct BoxArtRequest {
+        std::string address;
+        int app_id;
+        std::vector<BoxArtWaiter> waiters;
+    };
+
+    struct ServerRequest {
+        GSCallback<SERVER_DATA> callback;
+        bool only_changes;
+    };
+
+    // Accessed from main thread only, tags are used to detect changes
+    struct HostCache {
+        uint64_t server_time_us = 0;
+        std::string server_tag;
+        bool server_refreshing = false;
+        // Result of request is dropped once it's timed out
+        uint32_t server_generation = 0;
+        std::vector<ServerRequest> server_requests;
+        AppInfoList apps;
+        uint64_t apps_time_us = 0;
+        std::string apps_tag;
+        bool apps_refreshing = false;
+        int path_mtu = 0;
+    };
+
+    void fetch_server(const std::string& address,
+                      ServerCallback<SERVER_DATA>& callback, bool only_changes);
+    void finish_fetch_server(const std::string& address, GSResult<SERVER_DATA> result);
+    void set_server_data(const std::string& address, const SERVER_DATA& data);
+    void fetch_applist(const std::string& address,
+                       ServerCallback<AppInfoList>& callback, bool only_changes,
+                       GSCancelToken token);
+    // Downloads one box art, then queues itself again while there are
+    // more, so app list requests get their turn in between
+    void run_boxart_request();
+    // Last known state of saved hosts, so cold start has something to show
+    void load_host_cache();
+    void save_host_cache();
+
+    // Written by pair and start workers too, copies are taken under lock
+    std::mutex m_server_data_mutex;
     std::map<std::string, SERVER_DATA> m_server_data;
+    HostStatusEvent m_host_status_event;
     STREAM_CONFIGURATION m_config;
+    std::map<std::string, HostCache> m_host_cache;
+    // Placeholder generation of box art written with last save
+    uint32_t m_saved_placeholders = 0;
+
+    // Requests are deduplicated by address and app id, queue front goes first
+    std::mutex m_boxart_mutex;
+    std::deque<std::string> m_boxart_queue;
+    std::deque<std::string> m_boxart_refresh_queue;
+    std::map<std::string, BoxArtRequest> m_boxart_requests;
+    int m_boxart_workers = 0;
 };
@@ -0,0 +1,87 @@
+//
+//  GameStreamExecutor.cpp
+//  Moonlight
+//
+
+#include "GameStreamExecutor.hpp"
+
+void GameStreamExecutor::submit(GSLane lane, std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopped)
+            return;
+
+        m_lanes[lane].push_back(std::move(task));
+
+        // Workers are started on first request, not at app launch
+        if (m_workers.empty()) {
+            for (int i = 0; i < GS_EXECUTOR_WORKERS; i++)
+                m_workers.emplace_back([this] { run_worker(); });
+        }
+    }
+    m_condition.notify_one();
+}
+
+bool GameStreamExecutor::take_task(std::function<void()>& task, GSLane& lane) {
+    for (int i = 0; i < GS_LANE_COUNT; i++) {
+        auto& queue = m_lanes[i];
+        if (queue.empty())
+            continue;
+
+        if (i != GS_LANE_INTERACTIVE && m_background_running >= GS_EXECUTOR_WORKERS - 1)
+            return false;
+
+        task = std::move(queue.front());
+        queue.pop_front();
+        lane = (GSLane)i;
+        return true;
+    }
+    return false;
+}
+
+void GameStreamExecutor::run_worker() {
+    while (true) {
+        std::function<void()> task;
+        GSLane lane;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this, &task, &lane] {
+                return m_stopped || take_task(task, lane);
+            });
+            if (m_stopped)
+                return;
+
+            if (lane != GS_LANE_INTERACTIVE)
+                m_background_running++;
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (lane != GS_LANE_INTERACTIVE)
+                m_background_running--;
+        }
+        // Finished background task could let one more in
+        m_condition.notify_all();
+    }
+}
+
+void GameStreamExecutor::stop() {
+    std::vector<std::thread> workers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopped = true;
+        for (auto& queue : m_lanes)
+            queue.clear();
+        workers = std::move(m_workers);
+    }
+    m_condition.notify_all();
+
+    for (auto& worker : workers) {
+        if (worker.joinable())
+            worker.join();
+    }
+}
+
+GameStreamExecutor::~GameStreamExecutor() { stop(); }
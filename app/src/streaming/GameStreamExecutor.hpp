@@ -0,0 +1,50 @@
+//
+//  GameStreamExecutor.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Singleton.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Blocking host requests run at the same time
+#define GS_EXECUTOR_WORKERS 4
+
+// Lower lane is picked first
+enum GSLane {
+    GS_LANE_INTERACTIVE, // launch, quit, pair
+    GS_LANE_APPLIST,
+    GS_LANE_BOXART,
+    GS_LANE_DISCOVERY,
+    GS_LANE_COUNT,
+};
+
+// Fixed pool for libgamestream calls, so box art downloads and
+// discovery can't hold back launch or pair. One worker is kept for
+// interactive lane, background ones never take all of them
+class GameStreamExecutor : public Singleton<GameStreamExecutor> {
+  public:
+    void submit(GSLane lane, std::function<void()> task);
+    // Queued tasks are dropped, waits for running ones
+    void stop();
+
+    ~GameStreamExecutor();
+
+  private:
+    void run_worker();
+    // Called with lock held, false when nothing can be taken now
+    bool take_task(std::function<void()>& task, GSLane& lane);
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<std::function<void()>> m_lanes[GS_LANE_COUNT];
+    std::vector<std::thread> m_workers;
+    int m_background_running = 0;
+    bool m_stopped = false;
+};
@@ -0,0 +1,42 @@
+//
+//  GyroMouse.cpp
+//  Moonlight
+//
+
+#include "GyroMouse.hpp"
+#include "HighResClock.hpp"
+#include <algorithm>
+#include <cmath>
+
+void GyroMouse::reset() { *this = GyroMouse(); }
+
+void GyroMouse::update(float pitch, float yaw, float sensitivity, float& dx, float& dy) {
+    uint64_t now = HighResClock::now_us();
+    float dt = m_last_us == 0 ? 0 : (float)std::min<uint64_t>(now - m_last_us, GYRO_MOUSE_MAX_STEP_US) / 1000000.f;
+    m_last_us = now;
+
+    float speed = std::sqrt(pitch * pitch + yaw * yaw);
+
+    // Soft tiered smoothing, slow part goes through moving average and
+    // fast part is used directly, so there is no edge between them
+    float direct = std::clamp((speed - GYRO_MOUSE_SMOOTH_DPS / 2) / (GYRO_MOUSE_SMOOTH_DPS / 2), 0.f, 1.f);
+    m_history[m_history_next][0] = pitch * (1 - direct);
+    m_history[m_history_next][1] = yaw * (1 - direct);
+    m_history_next = (m_history_next + 1) % GYRO_MOUSE_SMOOTH_SAMPLES;
+
+    float smoothPitch = 0;
+    float smoothYaw = 0;
+    for (auto& sample : m_history) {
+        smoothPitch += sample[0];
+        smoothYaw += sample[1];
+    }
+    pitch = pitch * direct + smoothPitch / GYRO_MOUSE_SMOOTH_SAMPLES;
+    yaw = yaw * direct + smoothYaw / GYRO_MOUSE_SMOOTH_SAMPLES;
+
+    float accel = 1 + (GYRO_MOUSE_ACCEL_MAX - 1) * std::min(speed / GYRO_MOUSE_ACCEL_DPS, 1.f);
+    float scale = dt * GYRO_MOUSE_PIXELS_PER_DEGREE * sensitivity * accel;
+
+    // Turning left or tilting up moves cursor left or up
+    dx = -yaw * scale;
+    dy = -pitch * scale;
+}
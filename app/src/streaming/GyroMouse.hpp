@@ -0,0 +1,34 @@
+//
+//  GyroMouse.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <cstdint>
+
+// Cursor travel for one degree of rotation at 100% sensitivity
+#define GYRO_MOUSE_PIXELS_PER_DEGREE 12.f
+// Rotation slower than this is averaged over last samples, so hand
+// tremor doesn't shake cursor, half of it is smoothed fully
+#define GYRO_MOUSE_SMOOTH_DPS 6.f
+#define GYRO_MOUSE_SMOOTH_SAMPLES 8
+// Fast turns get up to this multiplier for big flicks
+#define GYRO_MOUSE_ACCEL_DPS 90.f
+#define GYRO_MOUSE_ACCEL_MAX 2.f
+// Samples further apart (like after pause) don't make cursor jump
+#define GYRO_MOUSE_MAX_STEP_US 50000
+
+// Turns gyro of one controller into relative mouse motion
+class GyroMouse {
+  public:
+    void reset();
+
+    // Rates are in deg/s, result is in pixels
+    void update(float pitch, float yaw, float sensitivity, float& dx, float& dy);
+
+  private:
+    float m_history[GYRO_MOUSE_SMOOTH_SAMPLES][2] = {};
+    int m_history_next = 0;
+    uint64_t m_last_us = 0;
+};
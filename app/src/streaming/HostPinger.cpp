@@ -0,0 +1,173 @@
+//
+//  HostPinger.cpp
+//  Moonlight
+//
+
+#include "HostPinger.hpp"
+#include "HighResClock.hpp"
+#include "HostAddress.hpp"
+#include "ThreadProfiler.hpp"
+#include "http.h"
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SWITCH__
+#include <switch.h>
+#endif
+
+void HostPinger::set_hosts(const std::vector<std::string>& addresses) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::map<std::string, HostState> hosts;
+    for (const auto& address : addresses) {
+        auto it = m_hosts.find(address);
+        hosts[address] = it != m_hosts.end() ? it->second : HostState();
+    }
+    m_hosts = std::move(hosts);
+
+    if (!m_running) {
+        m_running = true;
+        m_thread = std::thread(&HostPinger::run, this);
+    }
+    m_condition.notify_one();
+}
+
+void HostPinger::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_condition.notify_one();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void HostPinger::set_streaming(bool streaming) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_streaming = streaming;
+
+    // Numbers from before stream are stale, so ping right away after it
+    if (!streaming) {
+        for (auto& [address, state] : m_hosts) {
+            state.next_ping_us = 0;
+            state.interval_us = HOST_PING_INTERVAL_MIN_MS * 1000;
+        }
+    }
+    m_condition.notify_one();
+}
+
+void HostPinger::seed(const std::string& address, float rtt_ms, float jitter_ms) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    HostLatency& latency = m_hosts[address].latency;
+    if (latency.samples == 0) {
+        latency.rtt_ms = rtt_ms;
+        latency.jitter_ms = jitter_ms;
+    }
+}
+
+HostLatency HostPinger::latency(const std::string& address) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_hosts.find(address);
+    return it != m_hosts.end() ? it->second.latency : HostLatency();
+}
+
+bool HostPinger::paused() {
+#ifdef __SWITCH__
+    if (appletGetFocusState() != AppletFocusState_InFocus)
+        return true;
+#endif
+    return m_streaming;
+}
+
+void HostPinger::run() {
+    ThreadProfileScope profile("Host pinger");
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (m_running) {
+        if (paused()) {
+            m_condition.wait_for(lock, std::chrono::milliseconds(HOST_PING_PAUSE_CHECK_MS));
+            continue;
+        }
+
+        uint64_t now = HighResClock::now_us();
+        uint64_t next = now + (uint64_t)HOST_PING_INTERVAL_MAX_MS * 1000;
+        std::string due;
+        for (auto& [address, state] : m_hosts) {
+            if (state.next_ping_us <= now) {
+                due = address;
+                break;
+            }
+            next = std::min(next, state.next_ping_us);
+        }
+
+        if (due.empty()) {
+            m_condition.wait_for(lock, std::chrono::microseconds(next - now));
+            continue;
+        }
+
+        lock.unlock();
+        float rtt_ms = 0;
+        bool reachable = ping(due, rtt_ms);
+        lock.lock();
+
+        // Host could be removed while it was pinged
+        auto it = m_hosts.find(due);
+        if (it == m_hosts.end())
+            continue;
+
+        bool was_reachable = it->second.latency.reachable;
+        if (update(it->second, reachable, rtt_ms)) {
+            HostLatency latency = it->second.latency;
+            brls::sync([this, due, latency] { m_latency_event.fire(due, latency); });
+        }
+
+        // Status requests skip hosts which didn't answer them lately
+        if (reachable && !was_reachable)
+            http_host_reachable(due);
+    }
+}
+
+bool HostPinger::update(HostState& state, bool reachable, float rtt_ms) {
+    HostLatency& latency = state.latency;
+    uint64_t now = HighResClock::now_us();
+
+    if (!reachable) {
+        bool changed = latency.reachable || latency.samples == 0;
+        latency.reachable = false;
+        latency.samples = std::max(latency.samples, 1u);
+        state.interval_us = HOST_PING_INTERVAL_MIN_MS * 1000;
+        state.next_ping_us = now + (uint64_t)HOST_PING_OFFLINE_INTERVAL_MS * 1000;
+        return changed;
+    }
+
+    int shown_rtt = (int)std::lround(latency.rtt_ms);
+    int shown_jitter = (int)std::lround(latency.jitter_ms * 10);
+    bool changed = !latency.reachable;
+
+    if (latency.rtt_ms == 0) {
+        latency.rtt_ms = rtt_ms;
+        latency.jitter_ms = rtt_ms / 2;
+    }
+
+    // Moved out of jitter, ping often again until it settles
+    float deviation = std::fabs(rtt_ms - latency.rtt_ms);
+    if (deviation > std::max(latency.jitter_ms * 2, 1.0f))
+        state.interval_us = HOST_PING_INTERVAL_MIN_MS * 1000;
+    else
+        state.interval_us = std::min(state.interval_us * 3 / 2, (uint64_t)HOST_PING_INTERVAL_MAX_MS * 1000);
+
+    latency.jitter_ms += (deviation - latency.jitter_ms) / 8;
+    latency.rtt_ms += (rtt_ms - latency.rtt_ms) / 8;
+    latency.reachable = true;
+    latency.samples++;
+    state.next_ping_us = now + state.interval_us;
+
+    return changed || shown_rtt != (int)std::lround(latency.rtt_ms) ||
+           shown_jitter != (int)std::lround(latency.jitter_ms * 10);
+}
+
+bool HostPinger::ping(const std::string& address, float& rtt_ms) {
+    // Names would need resolving, which could block
+    HostAddress host = HostAddress::parse(address, HOST_PING_PORT);
+    return host_connect_race({host}, HOST_PING_TIMEOUT_MS, &rtt_ms) == 0;
+}
@@ -0,0 +1,79 @@
+//
+//  HostPinger.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Singleton.hpp"
+#include <borealis.hpp>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Hosts are pinged with TCP connect to HTTP port, interval grows while
+// round trip stays within jitter and drops back once it moves
+#define HOST_PING_PORT 47989
+#define HOST_PING_TIMEOUT_MS 1000
+#define HOST_PING_INTERVAL_MIN_MS 1000
+#define HOST_PING_INTERVAL_MAX_MS 10000
+// Unreachable hosts are pinged this often, sleeping PC could wake up
+#define HOST_PING_OFFLINE_INTERVAL_MS 5000
+// While paused, state is checked again this often
+#define HOST_PING_PAUSE_CHECK_MS 1000
+
+struct HostLatency {
+    // Smoothed connect time and its mean deviation between pings
+    float rtt_ms = 0;
+    float jitter_ms = 0;
+    bool reachable = false;
+    // 0 for numbers taken from host cache
+    uint32_t samples = 0;
+};
+
+using HostLatencyEvent = brls::Event<std::string, HostLatency>;
+
+// Round trip and jitter of saved hosts, without serverinfo request over
+// HTTPS. Pauses while streaming and while app is in background
+class HostPinger : public Singleton<HostPinger> {
+  public:
+    ~HostPinger() { stop(); }
+
+    // Starts pinging on first call, list replaces previous one
+    void set_hosts(const std::vector<std::string>& addresses);
+    void stop();
+
+    void set_streaming(bool streaming);
+
+    // Last numbers from cache of host list, replaced by first ping
+    void seed(const std::string& address, float rtt_ms, float jitter_ms);
+    HostLatency latency(const std::string& address);
+
+    // Fired on main thread after every ping which changed something
+    HostLatencyEvent* latency_event() { return &m_latency_event; }
+
+  private:
+    struct HostState {
+        HostLatency latency;
+        uint64_t next_ping_us = 0;
+        uint64_t interval_us = HOST_PING_INTERVAL_MIN_MS * 1000;
+    };
+
+    void run();
+    bool paused();
+    // Returns false when host doesn't accept connection
+    static bool ping(const std::string& address, float& rtt_ms);
+    // Returns true when shown numbers changed
+    bool update(HostState& state, bool reachable, float rtt_ms);
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::map<std::string, HostState> m_hosts;
+    bool m_running = false;
+    bool m_streaming = false;
+    std::thread m_thread;
+    HostLatencyEvent m_latency_event;
+};
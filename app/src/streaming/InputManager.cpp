@@ -5,20 +5,26 @@
 
 #include "InputManager.hpp"
 #include "Limelight.h"
+#include "Log.hpp"
+#include "PipelineTrace.hpp"
 #include "Settings.hpp"
+#include "ThreadAffinity.hpp"
+#include "ThreadProfiler.hpp"
+#include "HighResClock.hpp"
 #include <borealis.hpp>
 #include <streaming_view.hpp>
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
 
 using namespace brls;
 
-float fsqrt_(float f) {
-    int i = *(int *)&f;
-    i = (i >> 1) + 0x1fbb67ae;
-    float f1 = *(float *)&i;
-    return 0.5F * (f1 + f / f1);
-
-}
+#ifdef HAPTICS_TRIGGER_RUMBLE
+#define CONTROLLER_CAPABILITIES (LI_CCAP_RUMBLE | LI_CCAP_TRIGGER_RUMBLE | LI_CCAP_ACCEL | LI_CCAP_GYRO)
+#else
+#define CONTROLLER_CAPABILITIES (LI_CCAP_RUMBLE | LI_CCAP_ACCEL | LI_CCAP_GYRO)
+#endif
 
 MoonlightInputManager::MoonlightInputManager() {
     auto inputManager = brls::Application::getPlatform()->getInputManager();
@@ -33,9 +39,10 @@ MoonlightInputManager::MoonlightInputManager() {
                         (float) Settings::instance().get_mouse_speed_multiplier() / 100.f *
                         1.5f + 0.5f;
 
-                if (!this->inputDropped) {
-                    LiSendMouseMoveEvent(short(offset.x * multiplier),
-                                         short(offset.y * multiplier));
+                short x, y;
+                if (!this->inputDropped &&
+                    mouseMotion.add(offset.x * multiplier, offset.y * multiplier, x, y)) {
+                    LiSendMouseMoveEvent(x, y);
                 }
             }
         });
@@ -46,11 +53,11 @@ MoonlightInputManager::MoonlightInputManager() {
             if (!inputEnabled) return;
 
             if (scroll.x != 0) {
-                brls::Logger::info("Mouse scroll X sended: {}", scroll.x);
+                CLOG_DEBUG(LOG_INPUT, "Mouse scroll X sended: {}", scroll.x);
                 LiSendHighResHScrollEvent( short(scroll.x));
             }
             if (scroll.y != 0) {
-                brls::Logger::info("Mouse scroll Y sended: {}", scroll.y);
+                CLOG_DEBUG(LOG_INPUT, "Mouse scroll Y sended: {}", scroll.y);
                 LiSendHighResScrollEvent( short(scroll.y));
             }
         });
@@ -62,6 +69,8 @@ MoonlightInputManager::MoonlightInputManager() {
 
             int vkKey = MoonlightInputManager::glfwKeyToVKKey(state.key);
             char modifiers = state.mods;
+            if (state.key >= 0 && state.key <= BRLS_KBD_KEY_LAST)
+                pressedKeys.set(state.key, state.pressed);
             LiSendKeyboardEvent(vkKey,
                                 state.pressed ? KEY_ACTION_DOWN : KEY_ACTION_UP,
                                 modifiers);
@@ -74,22 +83,111 @@ MoonlightInputManager::MoonlightInputManager() {
             
             switch (event.type) {
                 case brls::SensorEventType::ACCEL:
-                    LiSendControllerMotionEvent((uint8_t)event.controllerIndex, LI_MOTION_TYPE_ACCEL, event.data[0], event.data[1], event.data[2]);
+                    queueMotion(event.controllerIndex, LI_MOTION_TYPE_ACCEL, event.data[0], event.data[1], event.data[2]);
                     break;
                 case brls::SensorEventType::GYRO:
                     // Convert rad/s to deg/s
-                    LiSendControllerMotionEvent((uint8_t)event.controllerIndex, LI_MOTION_TYPE_GYRO, 
-                        event.data[0] * 57.2957795f, 
-                        event.data[1] * 57.2957795f, 
+                    queueMotion(event.controllerIndex, LI_MOTION_TYPE_GYRO,
+                        event.data[0] * 57.2957795f,
+                        event.data[1] * 57.2957795f,
                         event.data[2] * 57.2957795f);
                     break;
             }
         });
 }
 
+void MoonlightInputManager::queueMotion(int controller, uint8_t type, float x, float y, float z) {
+    if (controller < 0 || controller >= GAMEPADS_MAX)
+        return;
+
+    std::lock_guard<std::mutex> lock(motionMutex);
+    auto settings = Settings::instance().stream();
+
+    if (type == LI_MOTION_TYPE_GYRO && settings.gyro_mouse) {
+        float dx, dy;
+        float sensitivity = (float)settings.gyro_mouse_sensitivity / 100.f;
+        gyroMice[controller].update(x, y, sensitivity, dx, dy);
+
+        // Ratchet lets to recenter hand without moving cursor
+        if (!gyroRatchet[controller]) {
+            gyroMotion.x += dx;
+            gyroMotion.y += dy;
+        }
+        return;
+    }
+
+    MotionBatch& batch = motionBatches[controller][type == LI_MOTION_TYPE_GYRO];
+    batch.sum[0] += x;
+    batch.sum[1] += y;
+    batch.sum[2] += z;
+    batch.count++;
+
+    int rate = settings.motion_rate;
+    uint64_t now = HighResClock::now_us();
+    if (rate > 0 && now - batch.lastSentUs < 1000000 / (uint64_t)rate)
+        return;
+
+    // Average keeps integrated gyro angle same as with every sample sent
+    LiSendControllerMotionEvent((uint8_t)controller, type, batch.sum[0] / batch.count,
+                                batch.sum[1] / batch.count, batch.sum[2] / batch.count);
+    batch = MotionBatch();
+    batch.lastSentUs = now;
+}
+
+void MoonlightInputManager::flushMotion(int controller, bool force) {
+    if (controller < 0 || controller >= GAMEPADS_MAX)
+        return;
+
+    std::lock_guard<std::mutex> lock(motionMutex);
+    int rate = Settings::instance().stream().motion_rate;
+    uint64_t now = HighResClock::now_us();
+
+    for (int i = 0; i < 2; i++) {
+        MotionBatch& batch = motionBatches[controller][i];
+        if (batch.count == 0)
+            continue;
+        if (!force && rate > 0 && now - batch.lastSentUs < 1000000 / (uint64_t)rate)
+            continue;
+
+        LiSendControllerMotionEvent((uint8_t)controller, i ? LI_MOTION_TYPE_GYRO : LI_MOTION_TYPE_ACCEL,
+                                    batch.sum[0] / batch.count, batch.sum[1] / batch.count,
+                                    batch.sum[2] / batch.count);
+        batch = MotionBatch();
+        batch.lastSentUs = now;
+    }
+}
+
+bool MoonlightInputManager::isSignificantChange(const GamepadState& last, const GamepadState& current) {
+    if (last.buttonFlags != current.buttonFlags)
+        return true;
+
+    // Released stick or trigger must reach host even if it moved only a bit
+    auto axisChanged = [](int last, int current, int threshold) {
+        return std::abs(current - last) >= threshold || (current == 0 && last != 0);
+    };
+
+    return axisChanged(last.leftTrigger, current.leftTrigger, TRIGGER_JITTER_THRESHOLD) ||
+           axisChanged(last.rightTrigger, current.rightTrigger, TRIGGER_JITTER_THRESHOLD) ||
+           axisChanged(last.leftStickX, current.leftStickX, ANALOG_JITTER_THRESHOLD) ||
+           axisChanged(last.leftStickY, current.leftStickY, ANALOG_JITTER_THRESHOLD) ||
+           axisChanged(last.rightStickX, current.rightStickX, ANALOG_JITTER_THRESHOLD) ||
+           axisChanged(last.rightStickY, current.rightStickY, ANALOG_JITTER_THRESHOLD);
+}
+
+void MoonlightInputManager::reloadInputShaping() {
+    std::lock_guard<std::mutex> lock(controllersMutex);
+    Settings& settings = Settings::instance();
+    leftStickShaper.configure(settings.get_deadzone_stick_left(), settings.anti_deadzone(),
+                              settings.stick_curve_power(), settings.deadzone_type());
+    rightStickShaper.configure(settings.get_deadzone_stick_right(), settings.anti_deadzone(),
+                               settings.stick_curve_power(), settings.deadzone_type());
+}
+
 void MoonlightInputManager::reloadButtonMappingLayout() {
+    std::lock_guard<std::mutex> lock(controllersMutex);
     KeyMappingLayout layout = (*Settings::instance().get_mapping_laouts())
         [Settings::instance().get_current_mapping_layout()];
+    brls::ControllerButton mappingButtons[_BUTTON_MAX];
     for (int i = 0; i < _BUTTON_MAX; i++) {
         if (layout.mapping.count(i) == 1) {
             mappingButtons[i] = (brls::ControllerButton)layout.mapping.at(i);
@@ -97,6 +195,9 @@ void MoonlightInputManager::reloadButtonMappingLayout() {
             mappingButtons[i] = (brls::ControllerButton)i;
         }
     }
+    buttonMapper.compile(mappingButtons, Settings::instance().guide_key_options().buttons);
+    comboDetector.compile(COMBO_OVERLAY, Settings::instance().overlay_options());
+    comboDetector.compile(COMBO_MOUSE_INPUT, Settings::instance().mouse_input_options());
 }
 
 void MoonlightInputManager::updateTouchScreenPanDelta(
@@ -104,38 +205,83 @@ void MoonlightInputManager::updateTouchScreenPanDelta(
     this->panStatus = panStatus;
 }
 
+const FrameInput& MoonlightInputManager::frameInput() {
+    if (frameInputValid)
+        return currentFrameInput;
+
+    int touches = 0;
+    for (const auto& touch : brls::Application::currentTouchState) {
+        if (touch.phase == TouchPhase::START || touch.phase == TouchPhase::STAY)
+            touches++;
+    }
+    currentFrameInput.touches = touches;
+    brls::Application::getPlatform()->getInputManager()->updateMouseStates(&currentFrameInput.mouse);
+    frameInputValid = true;
+    return currentFrameInput;
+}
+
 void MoonlightInputManager::handleRumble(unsigned short controller,
                                          unsigned short lowFreqMotor,
                                          unsigned short highFreqMotor) {
-    brls::Logger::debug("Rumble {} {}", lowFreqMotor, highFreqMotor);
-
-    float rumbleMultiplier = Settings::instance().get_rumble_force();
+    CLOG_DEBUG(LOG_INPUT, "Rumble {} {}", lowFreqMotor, highFreqMotor);
+    if (controller >= GAMEPADS_MAX)
+        return;
 
-    rumbleCache[controller].lowFreqMotor = lowFreqMotor * rumbleMultiplier;
-    rumbleCache[controller].highFreqMotor = highFreqMotor * rumbleMultiplier;
+    float rumbleMultiplier = Settings::instance().stream().rumble_force;
+    {
+        std::lock_guard<std::mutex> lock(rumbleMutex);
+        rumbleCache[controller].pending.lowFreqMotor = lowFreqMotor * rumbleMultiplier;
+        rumbleCache[controller].pending.highFreqMotor = highFreqMotor * rumbleMultiplier;
+    }
 
-    brls::Application::getPlatform()->getInputManager()->sendRumble(
-        controller, 
-        rumbleCache[controller].lowFreqMotor,
-        rumbleCache[controller].highFreqMotor);
+    flushRumble(controller, false);
 }
 
 void MoonlightInputManager::handleRumbleTriggers(uint16_t controllerNumber, 
                                                   uint16_t leftTriggerMotor, 
                                                   uint16_t rightTriggerMotor) {
-    brls::Logger::debug("Rumble Trigger {} {}", leftTriggerMotor, rightTriggerMotor);
+    CLOG_DEBUG(LOG_INPUT, "Rumble Trigger {} {}", leftTriggerMotor, rightTriggerMotor);
+    if (controllerNumber >= GAMEPADS_MAX)
+        return;
 
-    float rumbleMultiplier = Settings::instance().get_rumble_force();
+    float rumbleMultiplier = Settings::instance().stream().rumble_force;
+    {
+        std::lock_guard<std::mutex> lock(rumbleMutex);
+        rumbleCache[controllerNumber].pending.leftTriggerMotor = leftTriggerMotor * rumbleMultiplier;
+        rumbleCache[controllerNumber].pending.rightTriggerMotor = rightTriggerMotor * rumbleMultiplier;
+    }
+
+    flushRumble(controllerNumber, false);
+}
+
+void MoonlightInputManager::flushRumble(int controller, bool force) {
+    std::lock_guard<std::mutex> lock(rumbleMutex);
+    RumbleSchedule& schedule = rumbleCache[controller];
+    if (schedule.pending.is_equal(schedule.sent))
+        return;
+
+    // Stop is never delayed, motors shouldn't keep running after effect
+    uint64_t now = HighResClock::now_us();
+    if (!force && !schedule.pending.is_stopped() &&
+        now - schedule.lastSentUs < RUMBLE_MIN_INTERVAL_US)
+        return;
 
-    rumbleCache[controllerNumber].leftTriggerMotor = leftTriggerMotor * rumbleMultiplier;
-    rumbleCache[controllerNumber].rightTriggerMotor = rightTriggerMotor * rumbleMultiplier;
+    schedule.sent = schedule.pending;
+    schedule.lastSentUs = now;
 
+#ifdef HAPTICS_TRIGGER_RUMBLE
+    brls::Application::getPlatform()->getInputManager()->sendRumble(
+        controller,
+        schedule.sent.lowFreqMotor,
+        schedule.sent.highFreqMotor,
+        schedule.sent.leftTriggerMotor,
+        schedule.sent.rightTriggerMotor);
+#else
     brls::Application::getPlatform()->getInputManager()->sendRumble(
-        controllerNumber, 
-        rumbleCache[controllerNumber].lowFreqMotor,
-        rumbleCache[controllerNumber].highFreqMotor,
-        rumbleCache[controllerNumber].leftTriggerMotor,
-        rumbleCache[controllerNumber].rightTriggerMotor);
+        controller,
+        schedule.sent.lowFreqMotor,
+        schedule.sent.highFreqMotor);
+#endif
 }
 
 void MoonlightInputManager::dropInput() {
@@ -161,16 +307,18 @@ void MoonlightInputManager::dropInput() {
     LiSendMouseButtonEvent(BUTTON_ACTION_RELEASE,BUTTON_MOUSE_LEFT);
 
     // Drop touchscreen state
-    for (auto id: activeTouchIDs) {
-        LiSendTouchEvent(LI_TOUCH_EVENT_CANCEL, id.first, 0, 0, 0, 0, 0, LI_ROT_UNKNOWN);
+    for (auto& slot : touchSlots) {
+        if (slot.active)
+            LiSendTouchEvent(LI_TOUCH_EVENT_CANCEL, slot.fingerId, 0, 0, 0, 0, 0, LI_ROT_UNKNOWN);
+        slot.active = false;
     }
-    activeTouchIDs.clear();
 
-    // Drop keyboard state
-    for (int i = BRLS_KBD_KEY_SPACE; i < BrlsKeyboardScancode::BRLS_KBD_KEY_LAST; i++)  {
-        short vkKey = MoonlightInputManager::glfwKeyToVKKey((BrlsKeyboardScancode)i);
+    // Drop keyboard state, only keys which are still held
+    pressedKeys.forEachSet([](int key) {
+        short vkKey = MoonlightInputManager::glfwKeyToVKKey((BrlsKeyboardScancode)key);
         LiSendKeyboardEvent(vkKey, KEY_ACTION_UP, 0);
-    }
+    });
+    pressedKeys = KeyBitset<BRLS_KBD_KEY_LAST + 1>();
 
     inputDropped = res;
 }
@@ -178,44 +326,33 @@ void MoonlightInputManager::dropInput() {
 GamepadState MoonlightInputManager::getControllerState(int controllerNum,
                                                        bool specialKey) {
     brls::ControllerState rawController{};
-    brls::ControllerState controller{};
+    auto settings = Settings::instance().stream();
 
-    brls::Application::setSwapHalfJoyconStickToDpad(Settings::instance().swap_joycon_stick_to_dpad());
+    brls::Application::setSwapHalfJoyconStickToDpad(settings.swap_joycon_stick_to_dpad);
     brls::Application::getPlatform()->getInputManager()->updateControllerState(
         &rawController, controllerNum);
-    controller = mapController(rawController);
+
+    short buttonFlags;
+    uint64_t rawButtons;
+    uint64_t buttons = buttonMapper.map(rawController, buttonFlags, &rawButtons);
+    polledButtons |= rawButtons;
+    const float* axes = rawController.axes;
 
     // Use axis or button if axis is not available (equals 0)
-    float lzAxis = controller.axes[LEFT_Z] > 0 ? controller.axes[LEFT_Z] : (controller.buttons[brls::BUTTON_LT] ? 1.f : 0.f);
-    float rzAxis = controller.axes[RIGHT_Z] > 0 ? controller.axes[RIGHT_Z] : (controller.buttons[brls::BUTTON_RT] ? 1.f : 0.f);
-
-    // Truncate dead zones
-    float leftStickDeadzone = Settings::instance().get_deadzone_stick_left();
-    float rightStickDeadzone = Settings::instance().get_deadzone_stick_right();
-
-    float leftXAxis = controller.axes[brls::LEFT_X];
-    float leftYAxis = controller.axes[brls::LEFT_Y];
-    float rightXAxis = controller.axes[brls::RIGHT_X];
-    float rightYAxis = controller.axes[brls::RIGHT_Y];
-
-    if (leftStickDeadzone > 0) {
-        float magnitude = fsqrt_(std::powf(leftXAxis, 2) + std::powf(leftYAxis, 2));
-        if (magnitude < leftStickDeadzone) {
-            leftXAxis = 0;
-            leftYAxis = 0;
-        }
-    }
+    float lzAxis = axes[LEFT_Z] > 0 ? axes[LEFT_Z] : ((buttons & ButtonMapper::bit(brls::BUTTON_LT)) ? 1.f : 0.f);
+    float rzAxis = axes[RIGHT_Z] > 0 ? axes[RIGHT_Z] : ((buttons & ButtonMapper::bit(brls::BUTTON_RT)) ? 1.f : 0.f);
 
-    if (rightStickDeadzone > 0) {
-        float magnitude = fsqrt_(std::powf(rightXAxis, 2) + std::powf(rightYAxis, 2));
-        if (magnitude < rightStickDeadzone) {
-            rightXAxis = 0;
-            rightYAxis = 0;
-        }
-    }
+    float leftXAxis = axes[brls::LEFT_X];
+    float leftYAxis = axes[brls::LEFT_Y];
+    float rightXAxis = axes[brls::RIGHT_X];
+    float rightYAxis = axes[brls::RIGHT_Y];
+
+    // Dead zones and response curve
+    leftStickShaper.apply(leftXAxis, leftYAxis);
+    rightStickShaper.apply(rightXAxis, rightYAxis);
 
     GamepadState gamepadState{
-        .buttonFlags = 0,
+        .buttonFlags = buttonFlags,
         .leftTrigger = static_cast<unsigned char>(
             0xFF * (!specialKey ? lzAxis : 0)),
         .rightTrigger = static_cast<unsigned char>(
@@ -230,52 +367,16 @@ GamepadState MoonlightInputManager::getControllerState(int controllerNum,
             -0x7FFF * (!specialKey ? rightYAxis : 0)),
     };
 
-    brls::ControllerButton a = brls::BUTTON_A;
-    brls::ControllerButton b = brls::BUTTON_B;
-    brls::ControllerButton x = brls::BUTTON_X;
-    brls::ControllerButton y = brls::BUTTON_Y;
-
-#define SET_GAME_PAD_STATE(LIMELIGHT_KEY, GAMEPAD_BUTTON)                      \
-    controller.buttons[GAMEPAD_BUTTON]                                         \
-        ? (gamepadState.buttonFlags |= LIMELIGHT_KEY)                          \
-        : (gamepadState.buttonFlags &= ~LIMELIGHT_KEY);
-
-    SET_GAME_PAD_STATE(UP_FLAG, brls::BUTTON_UP);
-    SET_GAME_PAD_STATE(DOWN_FLAG, brls::BUTTON_DOWN);
-    SET_GAME_PAD_STATE(LEFT_FLAG, brls::BUTTON_LEFT);
-    SET_GAME_PAD_STATE(RIGHT_FLAG, brls::BUTTON_RIGHT);
-
-#ifdef __SWITCH__
-    SET_GAME_PAD_STATE(A_FLAG, b);
-    SET_GAME_PAD_STATE(B_FLAG, a);
-    SET_GAME_PAD_STATE(X_FLAG, y);
-    SET_GAME_PAD_STATE(Y_FLAG, x);
-#else
-    SET_GAME_PAD_STATE(A_FLAG, a);
-    SET_GAME_PAD_STATE(B_FLAG, b);
-    SET_GAME_PAD_STATE(X_FLAG, x);
-    SET_GAME_PAD_STATE(Y_FLAG, y);
-#endif
-
-    SET_GAME_PAD_STATE(BACK_FLAG, brls::BUTTON_BACK);
-    SET_GAME_PAD_STATE(PLAY_FLAG, brls::BUTTON_START);
-
-    SET_GAME_PAD_STATE(LB_FLAG, brls::BUTTON_LB);
-    SET_GAME_PAD_STATE(RB_FLAG, brls::BUTTON_RB);
-
-    SET_GAME_PAD_STATE(LS_CLK_FLAG, brls::BUTTON_LSB);
-    SET_GAME_PAD_STATE(RS_CLK_FLAG, brls::BUTTON_RSB);
-
-    auto guideKeys = Settings::instance().guide_key_options().buttons;
-    bool guideCombo = !guideKeys.empty();
-    for (auto key : guideKeys)
-        guideCombo &= controller.buttons[key];
+    int ratchet = settings.gyro_mouse_ratchet;
+    if (controllerNum < GAMEPADS_MAX)
+        gyroRatchet[controllerNum] = ratchet >= 0 && (buttons & ButtonMapper::bit((brls::ControllerButton)ratchet));
 
+    bool guideCombo = buttonMapper.guide_combo(buttons);
     if (guideCombo ||
         lastGamepadStates[controllerNum].buttonFlags & SPECIAL_FLAG)
         gamepadState.buttonFlags = 0;
 
-    bool guidePressed = guideCombo || controller.buttons[brls::BUTTON_GUIDE];
+    bool guidePressed = guideCombo || (buttons & ButtonMapper::bit(brls::BUTTON_GUIDE));
     guidePressed ? (gamepadState.buttonFlags |= SPECIAL_FLAG)
                : (gamepadState.buttonFlags &= ~SPECIAL_FLAG);
 
@@ -283,6 +384,7 @@ GamepadState MoonlightInputManager::getControllerState(int controllerNum,
 }
 
 void MoonlightInputManager::handleControllers(bool specialKey) {
+    std::lock_guard<std::mutex> lock(controllersMutex);
     static int lastControllerCount = 0;
 
     auto controllersCount = brls::Application::getPlatform()
@@ -291,18 +393,26 @@ void MoonlightInputManager::handleControllers(bool specialKey) {
 
     short mappedControllersCount = controllersToMap();
 
+    polledButtons = 0;
     for (int i = 0; i < controllersCount; i++) {
         GamepadState gamepadState = getControllerState(i, specialKey);
+        bool buttonsChanged = gamepadState.buttonFlags != lastGamepadStates[i].buttonFlags;
 
-        if (!gamepadState.is_equal(lastGamepadStates[i])) {
+        // Motion queued so far goes before button edge, so host sees
+        // aim where it was at the moment of press
+        flushMotion(i, buttonsChanged);
+        flushRumble(i, false);
+
+        if (isSignificantChange(lastGamepadStates[i], gamepadState)) {
+            TRACE_SCOPE("Input send");
             lastGamepadStates[i] = gamepadState;
 
             if (lastControllerCount != controllersCount) {
                 lastControllerCount = controllersCount;
                 
                 for (int i = 0; i < controllersCount; i++) {
-                    Logger::debug("StreamingView: send features message for controller #{}", i);
-                    LiSendControllerArrivalEvent(i, mappedControllersCount, LI_CTYPE_UNKNOWN, 0, LI_CCAP_RUMBLE | LI_CCAP_ACCEL | LI_CCAP_GYRO);
+                    CLOG_DEBUG(LOG_INPUT, "StreamingView: send features message for controller #{}", i);
+                    LiSendControllerArrivalEvent(i, mappedControllersCount, LI_CTYPE_UNKNOWN, 0, CONTROLLER_CAPABILITIES);
                 }
             }
 
@@ -311,31 +421,41 @@ void MoonlightInputManager::handleControllers(bool specialKey) {
                     gamepadState.leftTrigger, gamepadState.rightTrigger,
                     gamepadState.leftStickX, gamepadState.leftStickY,
                     gamepadState.rightStickX, gamepadState.rightStickY) != 0)
-                brls::Logger::info("StreamingView: error sending input data");
+                CLOG_WARNING_LIMITED(LOG_INPUT, "StreamingView: error sending input data");
         }
     }
+    comboDetector.update(polledButtons, HighResClock::now_us());
+
+    // Gyro mouse is integrated at sensor rate, sent once per poll
+    std::lock_guard<std::mutex> motionLock(motionMutex);
+    short x, y;
+    if (gyroMotion.add(0, 0, x, y))
+        LiSendMouseMoveEvent(x, y);
 }
 
 void MoonlightInputManager::handleInput(bool ignoreTouch) {
     inputDropped = false;
     static brls::ControllerState rawController;
     static brls::ControllerState controller;
-    static brls::RawMouseState mouse;
+    auto settings = Settings::instance().stream();
 
     brls::Application::getPlatform()
             ->getInputManager()
             ->updateUnifiedControllerState(&rawController);
-    brls::Application::getPlatform()->getInputManager()->updateMouseStates(
-            &mouse);
     controller = mapController(rawController);
 
-    std::vector<brls::RawTouchState> states;
-    brls::Application::getPlatform()->getInputManager()->updateTouchStates(&states);
+    // Gestures of this frame are done by now, next frame takes a new one
+    FrameInput input = frameInput();
+    frameInputValid = false;
+    const brls::RawMouseState& mouse = input.mouse;
 
     //Do not use gamepad for mouse controll assist if touchscreen mode enabled
-    bool specialKey = !ignoreTouch && !Settings::instance().touchscreen_mouse_mode() && states.size() == 1;
+    bool specialKey = !ignoreTouch && !settings.touchscreen_mouse_mode && input.touches == 1;
 
-    handleControllers(specialKey);
+    // Touch state only changes with UI frames, polling thread takes it from here
+    specialKeyState = specialKey;
+    if (!polling)
+        handleControllers(specialKey);
 
     float stickScrolling =
             specialKey
@@ -345,7 +465,7 @@ void MoonlightInputManager::handleInput(bool ignoreTouch) {
     static MouseStateS lastMouseState;
 
     MouseStateS mouseState;
-    if (!Settings::instance().touchscreen_mouse_mode()) {
+    if (!settings.touchscreen_mouse_mode) {
         mouseState = {
                 .scroll_y = stickScrolling,
                 .l_pressed = (specialKey && controller.buttons[brls::BUTTON_RT]) || mouse.leftButton,
@@ -361,18 +481,18 @@ void MoonlightInputManager::handleInput(bool ignoreTouch) {
         };
     }
 
-    if (Settings::instance().swap_mouse_scroll())
+    if (settings.swap_mouse_scroll)
         mouseState.scroll_y *= -1;
 
     if (mouseState.l_pressed != lastMouseState.l_pressed) {
         lastMouseState.l_pressed = mouseState.l_pressed;
-        auto lb = Settings::instance().swap_mouse_keys() ? BUTTON_MOUSE_RIGHT
-                                                         : BUTTON_MOUSE_LEFT;
+        auto lb = settings.swap_mouse_keys ? BUTTON_MOUSE_RIGHT
+                                           : BUTTON_MOUSE_LEFT;
         LiSendMouseButtonEvent(mouseState.l_pressed ? BUTTON_ACTION_PRESS
                                                     : BUTTON_ACTION_RELEASE,
                                lb);
         if (!mouseState.l_pressed)
-            Logger::debug("Release key lmb");
+            CLOG_DEBUG(LOG_INPUT, "Release key lmb");
     }
 
     if (mouseState.m_pressed != lastMouseState.m_pressed) {
@@ -384,48 +504,49 @@ void MoonlightInputManager::handleInput(bool ignoreTouch) {
 
     if (mouseState.r_pressed != lastMouseState.r_pressed) {
         lastMouseState.r_pressed = mouseState.r_pressed;
-        auto rb = Settings::instance().swap_mouse_keys() ? BUTTON_MOUSE_LEFT
-                                                         : BUTTON_MOUSE_RIGHT;
+        auto rb = settings.swap_mouse_keys ? BUTTON_MOUSE_LEFT
+                                           : BUTTON_MOUSE_RIGHT;
         LiSendMouseButtonEvent(mouseState.r_pressed ? BUTTON_ACTION_PRESS
                                                     : BUTTON_ACTION_RELEASE,
                                rb);
     }
 
-    std::chrono::high_resolution_clock::time_point timeNow =
-            std::chrono::high_resolution_clock::now();
-    static std::chrono::high_resolution_clock::time_point timeStamp = timeNow;
-
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-            timeNow - timeStamp)
-            .count();
-    if (mouseState.scroll_y != 0 &&
-        (float) duration > 550 - std::fabs(mouseState.scroll_y) * 500) {
-        timeStamp = timeNow;
-        brls::Logger::info("Scroll sended: {}", mouseState.scroll_y);
-        lastMouseState.scroll_y = mouseState.scroll_y;
-        LiSendScrollEvent(mouseState.scroll_y > 0 ? 1 : -1);
-    }
+    short scroll = stickScroll.update(mouseState.scroll_y);
+    lastMouseState.scroll_y = mouseState.scroll_y;
+    if (scroll != 0)
+        LiSendHighResScrollEvent(scroll);
 
-    if (!Settings::instance().touchscreen_mouse_mode()) {
+    if (!settings.touchscreen_mouse_mode) {
         // Do not process touch events, useful if onscreen keyboard is presented
         if (ignoreTouch) { return; }
 
         if (panStatus.has_value()) {
             float multiplier =
-                    Settings::instance().get_mouse_speed_multiplier() / 100.f * 1.5f +
+                    settings.mouse_speed_multiplier / 100.f * 1.5f +
                     0.5f;
-            LiSendMouseMoveEvent(-panStatus->delta.x * multiplier,
-                                 -panStatus->delta.y * multiplier);
+            short x, y;
+            if (mouseMotion.add(-panStatus->delta.x * multiplier,
+                                -panStatus->delta.y * multiplier, x, y))
+                LiSendMouseMoveEvent(x, y);
             panStatus.reset();
         }
     } else {
         uint8_t eventType;
+        uint64_t now = HighResClock::now_us();
 
-        auto touches = brls::Application::currentTouchState;
+        const auto& touches = brls::Application::currentTouchState;
         for (int i = 0; i < touches.size(); i++) {
-            auto touch = touches[i];
+            const auto& touch = touches[i];
             if (touch.view && touch.view->hasParent() && dynamic_cast<StreamingView*>(touch.view->getParent()) == nullptr) return;
 
+            float x = touch.position.x / (float) Application::contentWidth;
+            float y = touch.position.y / (float) Application::contentHeight;
+
+            TouchSlot* slot = touchSlot(touch.fingerId, touch.phase == TouchPhase::START);
+            // Fingers above slots count aren't tracked, so never sent
+            if (!slot)
+                continue;
+
             switch (touch.phase) {
                 case TouchPhase::START:
                     eventType = LI_TOUCH_EVENT_DOWN;
@@ -441,14 +562,22 @@ void MoonlightInputManager::handleInput(bool ignoreTouch) {
                     break;
             }
 
-            if (touch.phase != TouchPhase::NONE) {
-                activeTouchIDs.insert(std::pair(touch.fingerId, true));
-            } else {
-                activeTouchIDs.erase(touch.fingerId);
+            if (eventType == LI_TOUCH_EVENT_MOVE) {
+                // Resting or barely moving finger is not resent every frame
+                if (std::fabs(x - slot->x) < TOUCH_MOVE_THRESHOLD &&
+                    std::fabs(y - slot->y) < TOUCH_MOVE_THRESHOLD)
+                    continue;
+                if (now - slot->lastSentUs < TOUCH_MOVE_MIN_INTERVAL_US)
+                    continue;
             }
 
-            if (LiSendTouchEvent(eventType, touch.fingerId, touch.position.x / (float) Application::contentWidth,
-                                 touch.position.y / (float) Application::contentHeight, 0, 0, 0, LI_ROT_UNKNOWN) ==
+            slot->active = touch.phase == TouchPhase::START || touch.phase == TouchPhase::STAY;
+            slot->fingerId = touch.fingerId;
+            slot->x = x;
+            slot->y = y;
+            slot->lastSentUs = now;
+
+            if (LiSendTouchEvent(eventType, touch.fingerId, x, y, 0, 0, 0, LI_ROT_UNKNOWN) ==
                 LI_ERR_UNSUPPORTED && i == 0) {
                 // Fallback to move cursor and click if touch unsupported
                 if (touch.phase != TouchPhase::NONE) {
@@ -466,6 +595,80 @@ void MoonlightInputManager::handleInput(bool ignoreTouch) {
     }
 }
 
+short ScrollAccumulator::update(float speed) {
+    uint64_t now = HighResClock::now_us();
+    uint64_t elapsed = std::min<uint64_t>(now - lastUs, SCROLL_MAX_STEP_US);
+    lastUs = now;
+
+    if (speed == 0) {
+        value = 0;
+        return 0;
+    }
+
+    // Squared response leaves small deflection for slow precise scroll
+    value += speed * std::fabs(speed) * SCROLL_NOTCHES_PER_SECOND *
+             SCROLL_WHEEL_DELTA * elapsed / 1000000.f;
+    short result = (short)value;
+    value -= result;
+    return result;
+}
+
+TouchSlot* MoonlightInputManager::touchSlot(uint32_t fingerId, bool allocate) {
+    TouchSlot* free = nullptr;
+    for (auto& slot : touchSlots) {
+        if (slot.active && slot.fingerId == fingerId)
+            return &slot;
+        if (!slot.active && !free)
+            free = &slot;
+    }
+
+    return allocate ? free : nullptr;
+}
+
+void MoonlightInputManager::startPolling() {
+#ifdef __SWITCH__
+    int rate = Settings::instance().input_rate();
+    if (rate <= 0 || polling)
+        return;
+
+    polling = true;
+    pollingThread = std::thread([this, rate] { runPolling(rate); });
+#endif
+}
+
+void MoonlightInputManager::stopPolling() {
+    if (!polling)
+        return;
+
+    polling = false;
+    if (pollingThread.joinable())
+        pollingThread.join();
+}
+
+void MoonlightInputManager::runPolling(int rate) {
+    ThreadAffinity::apply(THREAD_ROLE_INPUT);
+    ThreadProfileScope profile("Input");
+    brls::Logger::info("InputManager: Polling controllers at {} Hz", rate);
+
+    // HID shared memory is updated by system on its own, reading pads
+    // here doesn't need UI thread
+    uint64_t interval = 1000000 / rate;
+    uint64_t next = HighResClock::now_us();
+    while (polling) {
+        if (inputEnabled) {
+            TRACE_SCOPE("Input poll");
+            handleControllers(specialKeyState);
+        }
+
+        next += interval;
+        uint64_t now = HighResClock::now_us();
+        if (next > now)
+            std::this_thread::sleep_for(std::chrono::microseconds(next - now));
+        else
+            next = now;
+    }
+}
+
 short MoonlightInputManager::controllersToMap() {
     switch (brls::Application::getPlatform()
                 ->getInputManager()
@@ -484,17 +687,16 @@ short MoonlightInputManager::controllersToMap() {
 }
 
 brls::ControllerState
-MoonlightInputManager::mapController(brls::ControllerState controller) {
+MoonlightInputManager::mapController(const brls::ControllerState& controller) {
     brls::ControllerState result{};
 
-    std::fill(result.buttons, result.buttons + sizeof(result.buttons), false);
-
     for (int i = 0; i < _AXES_MAX; i++)
         result.axes[i] = controller.axes[i];
 
-    for (int i = 0; i < _BUTTON_MAX; i++) {
-        result.buttons[mappingButtons[i]] |= controller.buttons[i];
-    }
+    short flags;
+    uint64_t buttons = buttonMapper.map(controller, flags);
+    for (int i = 0; i < _BUTTON_MAX; i++)
+        result.buttons[i] = (buttons >> i) & 1;
 
     return result;
 }
@@ -7,10 +7,17 @@
 
 #pragma once
 
+#include "ButtonMapper.hpp"
+#include "ComboDetector.hpp"
+#include "GyroMouse.hpp"
+#include "InputShaper.hpp"
 #include "Singleton.hpp"
 #include "keyboard_view.hpp"
 #include <borealis.hpp>
+#include <atomic>
+#include <mutex>
 #include <optional>
+#include <thread>
 
 // Moonlight ready gamepad
 struct GamepadState {
@@ -40,11 +47,101 @@ struct MouseStateS {
     bool r_pressed = 0;
 };
 
+// Stick movement smaller than this since last sent state is sensor noise
+#define ANALOG_JITTER_THRESHOLD 192
+#define TRIGGER_JITTER_THRESHOLD 2
+
+// Motion samples collected for one sensor between two sends
+struct MotionBatch {
+    float sum[3] = {0, 0, 0};
+    int count = 0;
+    uint64_t lastSentUs = 0;
+};
+
+// Stick held fully gives this many wheel notches per second
+#define SCROLL_NOTCHES_PER_SECOND 20
+#define SCROLL_WHEEL_DELTA 120
+// Longer gaps between updates (like a hitch) don't turn into scroll jump
+#define SCROLL_MAX_STEP_US 100000
+
+// Relative motion with sub-pixel remainder carried to next send
+struct MotionAccumulator {
+    float x = 0;
+    float y = 0;
+
+    // Adds delta, out values are whole part ready to send
+    bool add(float dx, float dy, short& outX, short& outY) {
+        x += dx;
+        y += dy;
+        outX = (short)x;
+        outY = (short)y;
+        x -= outX;
+        y -= outY;
+        return outX != 0 || outY != 0;
+    }
+};
+
+// Turns stick deflection into high resolution scroll in wheel delta units
+struct ScrollAccumulator {
+    float value = 0;
+    uint64_t lastUs = 0;
+
+    short update(float speed);
+};
+
+#define TOUCH_SLOTS_MAX 10
+// Finger move is sent when it travels this part of screen since last
+// sent position, but not more often than interval
+#define TOUCH_MOVE_THRESHOLD 0.002f
+#define TOUCH_MOVE_MIN_INTERVAL_US 8000
+
+// Touch and mouse state of one UI frame. Taken once, by whichever of
+// gesture callbacks and input forwarding asks first, so they don't poll
+// the platform again each
+struct FrameInput {
+    // Fingers down, from touches borealis already polled for gestures
+    int touches = 0;
+    brls::RawMouseState mouse;
+};
+
+struct TouchSlot {
+    bool active = false;
+    uint32_t fingerId = 0;
+    float x = 0;
+    float y = 0;
+    uint64_t lastSentUs = 0;
+};
+
+// Only these platforms have driver for controllers with trigger motors
+#if defined(PLATFORM_APPLE) || defined(PLATFORM_ANDROID)
+#define HAPTICS_TRIGGER_RUMBLE
+#endif
+
+// Host sends rumble updates much faster than motors can follow,
+// values in between are merged and only last one is written
+#define RUMBLE_MIN_INTERVAL_US 20000
+
 struct RumbleValues {
-    unsigned short lowFreqMotor;
-    unsigned short highFreqMotor;
-    uint16_t leftTriggerMotor;
-    uint16_t rightTriggerMotor;
+    unsigned short lowFreqMotor = 0;
+    unsigned short highFreqMotor = 0;
+    uint16_t leftTriggerMotor = 0;
+    uint16_t rightTriggerMotor = 0;
+
+    bool is_equal(const RumbleValues& other) const {
+        return lowFreqMotor == other.lowFreqMotor &&
+               highFreqMotor == other.highFreqMotor &&
+               leftTriggerMotor == other.leftTriggerMotor &&
+               rightTriggerMotor == other.rightTriggerMotor;
+    }
+
+    bool is_stopped() const { return is_equal(RumbleValues()); }
+};
+
+// Rumble requested by host and what was last written to controller
+struct RumbleSchedule {
+    RumbleValues pending;
+    RumbleValues sent;
+    uint64_t lastSentUs = 0;
 };
 
 class MoonlightInputManager : public Singleton<MoonlightInputManager> {
@@ -55,21 +152,66 @@ class MoonlightInputManager : public Singleton<MoonlightInputManager> {
     void handleRumble(unsigned short controller, unsigned short lowFreqMotor, unsigned short highFreqMotor);
     void handleRumbleTriggers(unsigned short controller, unsigned short lowFreqMotor, unsigned short highFreqMotor);
     void updateTouchScreenPanDelta(brls::PanGestureStatus panStatus);
+    // State of current UI frame, valid until handleInput() consumes it
+    const FrameInput& frameInput();
+    // True once for every time combo was held, combos are checked with
+    // each controllers poll
+    bool takeCombo(ComboEvent event) { return comboDetector.take(event); }
     void reloadButtonMappingLayout();
+    // Rebuilds stick lookup tables from deadzone and curve settings
+    void reloadInputShaping();
     void setInputEnabled(bool enabled) { inputEnabled = enabled; }
+    // Controllers are polled on own thread at input rate from settings,
+    // so their latency doesn't depend on render time. No-op when rate is 0
+    void startPolling();
+    void stopPolling();
     static void leftMouseClick();
     static void rightMouseClick();
 
   private:
-    RumbleValues rumbleCache[GAMEPADS_MAX];
+    // Written from connection thread, flushed from input polling
+    std::mutex rumbleMutex;
+    RumbleSchedule rumbleCache[GAMEPADS_MAX];
     GamepadState lastGamepadStates[GAMEPADS_MAX];
-    brls::ControllerButton mappingButtons[brls::_BUTTON_MAX];
+    // Same settings for every controller, so tables are shared by all
+    StickShaper leftStickShaper;
+    StickShaper rightStickShaper;
+    ButtonMapper buttonMapper;
+    ComboDetector comboDetector;
+    // Raw buttons of all controllers in current poll, for combos
+    uint64_t polledButtons = 0;
     std::optional<brls::PanGestureStatus> panStatus;
-    std::map<uint32_t, bool> activeTouchIDs;
+    MotionAccumulator mouseMotion;
+    ScrollAccumulator stickScroll;
+    TouchSlot touchSlots[TOUCH_SLOTS_MAX];
+    // Physical keyboard keys sent as down, released by dropInput()
+    KeyBitset<brls::BRLS_KBD_KEY_LAST + 1> pressedKeys;
+    FrameInput currentFrameInput;
+    bool frameInputValid = false;
     bool inputDropped = false;
-    bool inputEnabled = true;
+    std::atomic<bool> inputEnabled = true;
+
+    // Guards controller state shared with polling thread
+    std::mutex controllersMutex;
+    std::thread pollingThread;
+    std::atomic<bool> polling = false;
+    std::atomic<bool> specialKeyState = false;
+
+    // Accel and gyro of each controller, sent averaged at motion rate
+    std::mutex motionMutex;
+    MotionBatch motionBatches[GAMEPADS_MAX][2];
+    GyroMouse gyroMice[GAMEPADS_MAX];
+    MotionAccumulator gyroMotion;
+    std::atomic<bool> gyroRatchet[GAMEPADS_MAX] = {};
+
+    void flushRumble(int controller, bool force);
+    void queueMotion(int controller, uint8_t type, float x, float y, float z);
+    void flushMotion(int controller, bool force);
+    TouchSlot* touchSlot(uint32_t fingerId, bool allocate);
+    static bool isSignificantChange(const GamepadState& last, const GamepadState& current);
 
-    brls::ControllerState mapController(brls::ControllerState controller);
+    void runPolling(int rate);
+    brls::ControllerState mapController(const brls::ControllerState& controller);
     static short glfwKeyToVKKey(brls::BrlsKeyboardScancode key);
 
     GamepadState getControllerState(int controllerNum, bool specialKey);
@@ -0,0 +1,51 @@
+//
+//  InputShaper.cpp
+//  Moonlight
+//
+
+#include "InputShaper.hpp"
+#include <algorithm>
+#include <cmath>
+
+StickShaper::StickShaper() { configure(0, 0, 1, DEADZONE_RADIAL); }
+
+void StickShaper::configure(float deadzone, float antiDeadzone, float exponent,
+                            DeadzoneType type) {
+    m_deadzone = std::clamp(deadzone, 0.f, 0.99f);
+    m_anti_deadzone = std::clamp(antiDeadzone, 0.f, 0.99f);
+    m_exponent = std::max(exponent, 0.1f);
+    m_type = type;
+
+    for (int i = 0; i <= STICK_LUT_SIZE; i++) {
+        if (m_type == DEADZONE_RADIAL) {
+            float magnitude = std::sqrt(STICK_LUT_MAX_SQUARED * i / STICK_LUT_SIZE);
+            m_lut[i] = magnitude > 0 ? shape(magnitude) / magnitude : 0;
+        } else {
+            m_lut[i] = shape((float)i / STICK_LUT_SIZE);
+        }
+    }
+}
+
+float StickShaper::shape(float magnitude) const {
+    if (magnitude <= m_deadzone)
+        return 0;
+
+    // Range past deadzone is stretched back to full travel, so there is
+    // no jump at its edge
+    float t = std::min((magnitude - m_deadzone) / (1 - m_deadzone), 1.f);
+    return m_anti_deadzone + (1 - m_anti_deadzone) * std::pow(t, m_exponent);
+}
+
+void StickShaper::apply(float& x, float& y) const {
+    if (m_type == DEADZONE_RADIAL) {
+        float squared = std::min(x * x + y * y, STICK_LUT_MAX_SQUARED);
+        float scale = m_lut[(int)(squared * (STICK_LUT_SIZE / STICK_LUT_MAX_SQUARED))];
+        x *= scale;
+        y *= scale;
+    } else {
+        float ax = m_lut[(int)(std::min(std::fabs(x), 1.f) * STICK_LUT_SIZE)];
+        float ay = m_lut[(int)(std::min(std::fabs(y), 1.f) * STICK_LUT_SIZE)];
+        x = std::copysign(ax, x);
+        y = std::copysign(ay, y);
+    }
+}
@@ -0,0 +1,38 @@
+//
+//  InputShaper.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Settings.hpp"
+
+// Radial table is indexed by squared magnitude, so no sqrt is needed per
+// frame. Covers magnitudes up to sqrt(2) which square gates reach on diagonal
+#define STICK_LUT_SIZE 4096
+#define STICK_LUT_MAX_SQUARED 2.f
+
+// Deadzone, anti-deadzone and response curve of one stick baked into a
+// lookup table. Rebuilt by configure() only when settings change
+class StickShaper {
+  public:
+    StickShaper();
+
+    void configure(float deadzone, float antiDeadzone, float exponent,
+                   DeadzoneType type);
+
+    // Axes are in -1..1 range, result is clamped to unit circle
+    // (or unit square for axial deadzone)
+    void apply(float& x, float& y) const;
+
+  private:
+    float shape(float magnitude) const;
+
+    float m_deadzone = 0;
+    float m_anti_deadzone = 0;
+    float m_exponent = 1;
+    DeadzoneType m_type = DEADZONE_RADIAL;
+
+    // Radial: scale factor for squared magnitude, axial: output for |axis|
+    float m_lut[STICK_LUT_SIZE + 1];
+};
@@ -0,0 +1,182 @@
+//
+//  LatencyProbe.cpp
+//  Moonlight
+//
+
+#include "LatencyProbe.hpp"
+#include "HighResClock.hpp"
+#include "Limelight.h"
+#include <borealis.hpp>
+#include <algorithm>
+#include <vector>
+
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+extern "C" {
+#include <libavutil/hwcontext_nvtegra.h>
+}
+#endif
+
+// Sampled corner of the frame, in pixels
+#define PROBE_REGION_SIZE 64
+#define PROBE_REGION_STEP 4
+// Block linear surface, first bytes of luma plane are top left tiles
+#define PROBE_TILED_BYTES 8192
+#define PROBE_TILED_STEP 16
+
+void LatencyProbe::set_enabled(bool enabled) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_enabled == enabled)
+        return;
+
+    m_enabled = enabled;
+    if (m_state == WAITING || m_state == RELEASING)
+        LiSendMouseButtonEvent(BUTTON_ACTION_RELEASE, BUTTON_MOUSE_LEFT);
+
+    m_state = IDLE;
+    m_next_probe_us = 0;
+    m_baseline_luma = -1;
+    m_last_luma = -1;
+    m_reaction_pts = -1;
+    m_supported = true;
+    m_samples_count = 0;
+    m_samples_next = 0;
+    m_misses = 0;
+}
+
+void LatencyProbe::tick() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_enabled || !m_supported)
+        return;
+
+    uint64_t now = HighResClock::now_us();
+    switch (m_state) {
+        case IDLE:
+            // Last probe reaction has to fade out before next one
+            if (now < m_next_probe_us || m_last_luma < 0 ||
+                (m_baseline_luma >= 0 && m_last_luma >= m_baseline_luma + LATENCY_PROBE_LUMA_DELTA))
+                return;
+
+            m_baseline_luma = m_last_luma;
+            m_reaction_pts = -1;
+            m_sent_us = now;
+            m_state = WAITING;
+            LiSendMouseButtonEvent(BUTTON_ACTION_PRESS, BUTTON_MOUSE_LEFT);
+            break;
+        case WAITING:
+            if (now - m_sent_us < LATENCY_PROBE_TIMEOUT_US)
+                return;
+
+            m_misses++;
+            m_state = RELEASING;
+            break;
+        case RELEASING:
+            break;
+    }
+
+    if (m_state == RELEASING) {
+        LiSendMouseButtonEvent(BUTTON_ACTION_RELEASE, BUTTON_MOUSE_LEFT);
+        m_state = IDLE;
+        m_next_probe_us = now + LATENCY_PROBE_INTERVAL_US;
+    }
+}
+
+void LatencyProbe::frame_decoded(AVFrame* frame) {
+    if (!m_enabled)
+        return;
+
+    int luma = sample_luma(frame);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (luma < 0) {
+        if (m_supported)
+            brls::Logger::warning("LatencyProbe: Frames of this decoder can't be read by CPU");
+        m_supported = false;
+        return;
+    }
+
+    m_last_luma = luma;
+    if (m_state == WAITING && m_reaction_pts < 0 &&
+        luma >= m_baseline_luma + LATENCY_PROBE_LUMA_DELTA)
+        m_reaction_pts = frame->pts;
+}
+
+void LatencyProbe::frame_drawn(AVFrame* frame) {
+    if (!m_enabled)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_state != WAITING || m_reaction_pts < 0 || frame->pts != m_reaction_pts)
+        return;
+
+    add_sample((float)(HighResClock::now_us() - m_sent_us) / 1000.f);
+    m_state = RELEASING;
+}
+
+void LatencyProbe::add_sample(float ms) {
+    m_samples[m_samples_next] = ms;
+    m_samples_next = (m_samples_next + 1) % LATENCY_PROBE_SAMPLES;
+    m_samples_count = std::min<size_t>(m_samples_count + 1, LATENCY_PROBE_SAMPLES);
+}
+
+LatencyProbeSummary LatencyProbe::summary() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    LatencyProbeSummary summary = {};
+    summary.supported = m_supported;
+    summary.samples = m_samples_count;
+    summary.misses = m_misses;
+    if (m_samples_count == 0)
+        return summary;
+
+    std::vector<float> sorted(m_samples, m_samples + m_samples_count);
+    std::sort(sorted.begin(), sorted.end());
+    summary.min_ms = sorted.front();
+    summary.p50_ms = sorted[sorted.size() / 2];
+    summary.p95_ms = sorted[std::min(sorted.size() - 1, sorted.size() * 95 / 100)];
+    summary.max_ms = sorted.back();
+    return summary;
+}
+
+int LatencyProbe::sample_luma(AVFrame* frame) {
+    int sum = 0;
+    int count = 0;
+
+    switch (frame->format) {
+        case AV_PIX_FMT_NV12:
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+        case AV_PIX_FMT_P010: {
+            if (!frame->data[0])
+                return -1;
+
+            // P010 keeps 10 bits in high part of 16 bit sample
+            int bytes = frame->format == AV_PIX_FMT_P010 ? 2 : 1;
+            int size = std::min({PROBE_REGION_SIZE, frame->width, frame->height});
+            for (int y = 0; y < size; y += PROBE_REGION_STEP) {
+                const uint8_t* row = frame->data[0] + (size_t)y * frame->linesize[0];
+                for (int x = 0; x < size; x += PROBE_REGION_STEP) {
+                    sum += row[x * bytes + bytes - 1];
+                    count++;
+                }
+            }
+            break;
+        }
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+        case AV_PIX_FMT_NVTEGRA: {
+            AVNVTegraMap* map = av_nvtegra_frame_get_fbuf_map(frame);
+            auto* luma = (const uint8_t*)av_nvtegra_map_get_addr(map);
+            if (!luma)
+                return -1;
+
+            for (int i = 0; i < PROBE_TILED_BYTES; i += PROBE_TILED_STEP) {
+                sum += luma[i];
+                count++;
+            }
+            break;
+        }
+#endif
+        default:
+            return -1;
+    }
+
+    return count > 0 ? sum / count : -1;
+}
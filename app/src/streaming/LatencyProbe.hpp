@@ -0,0 +1,75 @@
+//
+//  LatencyProbe.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Singleton.hpp"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#define LATENCY_PROBE_SAMPLES 64
+// Pause between probes, host app needs time to go back to dark screen
+#define LATENCY_PROBE_INTERVAL_US 1000000
+// No reaction in this time counts as a miss
+#define LATENCY_PROBE_TIMEOUT_US 1000000
+// Frame counts as reaction when top left corner gets that much brighter
+#define LATENCY_PROBE_LUMA_DELTA 64
+
+struct LatencyProbeSummary {
+    bool supported;
+    size_t samples;
+    uint32_t misses;
+    float min_ms;
+    float p50_ms;
+    float p95_ms;
+    float max_ms;
+};
+
+// Input to photon measurement: sends mouse click and waits for a frame
+// where top left corner of the stream turns bright. Needs host app which
+// flashes screen on click, like a web latency tester
+class LatencyProbe : public Singleton<LatencyProbe> {
+  public:
+    void set_enabled(bool enabled);
+    [[nodiscard]] bool enabled() const { return m_enabled; }
+
+    // UI thread, sends probes and releases button after reaction
+    void tick();
+
+    // Decoder thread, for every decoded frame
+    void frame_decoded(AVFrame* frame);
+    // UI thread, reaction is timed when its frame is drawn
+    void frame_drawn(AVFrame* frame);
+
+    [[nodiscard]] LatencyProbeSummary summary();
+
+  private:
+    enum State { IDLE, WAITING, RELEASING };
+
+    void add_sample(float ms);
+    static int sample_luma(AVFrame* frame);
+
+    std::mutex m_mutex;
+    std::atomic<bool> m_enabled = false;
+    State m_state = IDLE;
+    uint64_t m_sent_us = 0;
+    uint64_t m_next_probe_us = 0;
+
+    // Luma before click, and pts of first frame which reacted to it
+    int m_baseline_luma = -1;
+    int m_last_luma = -1;
+    int64_t m_reaction_pts = -1;
+    bool m_supported = true;
+
+    float m_samples[LATENCY_PROBE_SAMPLES] = {};
+    size_t m_samples_count = 0;
+    size_t m_samples_next = 0;
+    uint32_t m_misses = 0;
+};
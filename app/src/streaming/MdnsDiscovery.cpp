@@ -0,0 +1,254 @@
+//
+//  MdnsDiscovery.cpp
+//  Moonlight
+//
+
+#ifndef MULTICAST_DISABLED
+
+#include "MdnsDiscovery.hpp"
+#include "GameStreamExecutor.hpp"
+#include "HighResClock.hpp"
+#include <borealis.hpp>
+#include <algorithm>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+
+extern "C" {
+#include <mdns.h>
+}
+
+using namespace brls::literals;
+
+#define MDNS_SERVICE "_nvstream._tcp.local"
+
+static int mdns_record_callback(int sock, const struct sockaddr* from, size_t addrlen,
+                                mdns_entry_type_t entry, uint16_t query_id, uint16_t type,
+                                uint16_t rclass, uint32_t ttl, const void* data, size_t size,
+                                size_t name_offset, size_t name_length, size_t record_offset,
+                                size_t record_length, void* user_data) {
+    auto* discovery = (MdnsDiscovery*)user_data;
+    char buffer[INET6_ADDRSTRLEN];
+
+    if (type == MDNS_RECORDTYPE_A) {
+        struct sockaddr_in addr;
+        mdns_record_parse_a(data, size, record_offset, record_length, &addr);
+        if (inet_ntop(AF_INET, &addr.sin_addr, buffer, sizeof(buffer)))
+            discovery->on_answer(buffer, ttl, false);
+    } else if (type == MDNS_RECORDTYPE_AAAA) {
+        struct sockaddr_in6 addr;
+        mdns_record_parse_aaaa(data, size, record_offset, record_length, &addr);
+        // Saved address has no interface scope, link local one can't be used
+        if (IN6_IS_ADDR_LINKLOCAL(&addr.sin6_addr))
+            return 0;
+        if (inet_ntop(AF_INET6, &addr.sin6_addr, buffer, sizeof(buffer)))
+            discovery->on_answer(buffer, ttl, true);
+    }
+    return 0;
+}
+
+void MdnsDiscovery::start(ServerCallback<std::vector<Host>>& callback) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_callback = callback;
+    }
+
+    // Already known hosts are shown right away
+    notify();
+
+    m_running = true;
+    if (!m_loop_active.exchange(true))
+        brls::async([this] { loop(); });
+}
+
+void MdnsDiscovery::stop() { m_running = false; }
+
+void MdnsDiscovery::loop() {
+    do {
+        run();
+        m_loop_active = false;
+        // start() could be called while the last run was finishing
+    } while (m_running && !m_loop_active.exchange(true));
+}
+
+void MdnsDiscovery::run() {
+    int sockets[2];
+    int count = 0;
+
+    int sock = mdns_socket_open_ipv4(nullptr);
+    if (sock >= 0)
+        sockets[count++] = sock;
+
+    sock = mdns_socket_open_ipv6(nullptr);
+    if (sock >= 0)
+        sockets[count++] = sock;
+
+    if (count == 0) {
+        fail("error/unknown_error"_i18n);
+        m_running = false;
+        return;
+    }
+
+    void* buffer = malloc(MDNS_BUFFER_SIZE);
+    uint64_t next_query = 0;
+    uint64_t interval = MDNS_QUERY_INTERVAL_MIN_MS;
+
+    while (m_running) {
+        uint64_t now = HighResClock::now_us();
+
+        if (now >= next_query) {
+            bool sent = false;
+            for (int i = 0; i < count; i++) {
+                if (mdns_query_send(sockets[i], MDNS_RECORDTYPE_PTR,
+                                    MDNS_STRING_CONST(MDNS_SERVICE),
+                                    buffer, MDNS_BUFFER_SIZE, 0) >= 0)
+                    sent = true;
+            }
+
+            if (!sent) {
+                fail("error/unknown_error"_i18n);
+                break;
+            }
+
+            next_query = now + interval * 1000;
+            interval = std::min<uint64_t>(interval * 2, MDNS_QUERY_INTERVAL_MAX_MS);
+        }
+
+        struct pollfd fds[2];
+        for (int i = 0; i < count; i++)
+            fds[i] = {sockets[i], POLLIN, 0};
+
+        uint64_t wait_ms = std::min<uint64_t>((next_query - now) / 1000, MDNS_POLL_TIMEOUT_MS);
+        if (poll(fds, count, (int)wait_ms) > 0) {
+            for (int i = 0; i < count; i++) {
+                if (fds[i].revents & POLLIN) {
+                    mdns_query_recv(sockets[i], buffer, MDNS_BUFFER_SIZE, mdns_record_callback, this, 0);
+                    flush_answer();
+                }
+            }
+        }
+
+        expire(HighResClock::now_us());
+    }
+
+    free(buffer);
+    for (int i = 0; i < count; i++)
+        mdns_socket_close(sockets[i]);
+}
+
+void MdnsDiscovery::on_answer(const std::string& address, uint32_t ttl, bool ipv6) {
+    m_answer[ipv6 ? 1 : 0].push_back({address, ttl});
+}
+
+void MdnsDiscovery::flush_answer() {
+    // Dual stack host stays under its IPv4 address, as it was saved
+    // before, IPv6 one is taken only from hosts which have nothing else
+    auto& records = m_answer[0].empty() ? m_answer[1] : m_answer[0];
+    for (auto& [address, ttl] : records)
+        on_record(address, ttl);
+
+    m_answer[0].clear();
+    m_answer[1].clear();
+}
+
+void MdnsDiscovery::on_record(const std::string& address, uint32_t ttl) {
+    bool is_new;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        is_new = m_expiry.count(address) == 0 && m_resolving.count(address) == 0;
+
+        // Zero TTL is goodbye packet, host goes away on next expire()
+        m_expiry[address] = HighResClock::now_us() + (uint64_t)ttl * 1000000;
+        if (is_new)
+            m_resolving.insert(address);
+    }
+
+    if (is_new)
+        resolve(address);
+}
+
+void MdnsDiscovery::resolve(const std::string& address) {
+    // Each host is resolved on its own, slow one doesn't hold others.
+    // Lowest lane, so discovery doesn't delay requests of opened views
+    GameStreamExecutor::instance().submit(GS_LANE_DISCOVERY, [this, address] {
+        SERVER_DATA server_data;
+        int status = gs_init(&server_data, address);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_resolving.erase(address);
+
+            if (status != GS_OK) {
+                // Retried when host answers one of next queries
+                m_expiry.erase(address);
+                return;
+            }
+
+            auto exists = std::any_of(m_hosts.begin(), m_hosts.end(),
+                                      [&address](const Host& host) { return host.address == address; });
+            if (!exists) {
+                Host host;
+                host.address = address;
+                host.hostname = server_data.hostname;
+                host.mac = server_data.mac;
+                m_hosts.push_back(host);
+            }
+        }
+
+        notify();
+    });
+}
+
+void MdnsDiscovery::expire(uint64_t now) {
+    bool changed = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_expiry.begin(); it != m_expiry.end();) {
+            if (it->second > now || m_resolving.count(it->first)) {
+                ++it;
+                continue;
+            }
+
+            std::string address = it->first;
+            it = m_expiry.erase(it);
+            auto removed = std::remove_if(m_hosts.begin(), m_hosts.end(),
+                                          [&address](const Host& host) { return host.address == address; });
+            if (removed != m_hosts.end()) {
+                m_hosts.erase(removed, m_hosts.end());
+                changed = true;
+            }
+        }
+    }
+
+    if (changed)
+        notify();
+}
+
+void MdnsDiscovery::notify() {
+    GSCallback<std::vector<Host>> callback;
+    std::vector<Host> hosts;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        callback = m_callback;
+        hosts = m_hosts;
+    }
+
+    if (callback)
+        brls::sync([callback, hosts = std::move(hosts)]() mutable {
+            callback(GSResult<std::vector<Host>>::success(std::move(hosts)));
+        });
+}
+
+void MdnsDiscovery::fail(const std::string& error) {
+    GSCallback<std::vector<Host>> callback;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        callback = m_callback;
+    }
+
+    if (callback)
+        brls::sync([callback, error] { callback(GSResult<std::vector<Host>>::failure(error)); });
+}
+
+#endif
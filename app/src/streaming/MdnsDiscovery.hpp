@@ -0,0 +1,56 @@
+//
+//  MdnsDiscovery.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#ifndef MULTICAST_DISABLED
+
+#include "GameStreamClient.hpp"
+#include "Singleton.hpp"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+
+// Queries are repeated with doubling interval up to the max, so
+// staying on host tab costs almost nothing after first seconds
+#define MDNS_QUERY_INTERVAL_MIN_MS 1000
+#define MDNS_QUERY_INTERVAL_MAX_MS 60000
+// Listener wakes up at least this often to check stop flag and TTLs
+#define MDNS_POLL_TIMEOUT_MS 1000
+#define MDNS_BUFFER_SIZE 2048
+
+class MdnsDiscovery : public Singleton<MdnsDiscovery> {
+  public:
+    // Runs until stop(), callback gets whole list every time it changes
+    void start(ServerCallback<std::vector<Host>>& callback);
+    void stop();
+
+    // Addresses of one response are collected, then flushed together
+    void on_answer(const std::string& address, uint32_t ttl, bool ipv6);
+
+  private:
+    void flush_answer();
+    void on_record(const std::string& address, uint32_t ttl);
+    void loop();
+    void run();
+    void resolve(const std::string& address);
+    void expire(uint64_t now);
+    void notify();
+    void fail(const std::string& error);
+
+    std::mutex m_mutex;
+    GSCallback<std::vector<Host>> m_callback;
+    // Address to time its record expires at, in microseconds
+    std::map<std::string, uint64_t> m_expiry;
+    std::set<std::string> m_resolving;
+    std::vector<Host> m_hosts;
+    // A and AAAA records of response being read, listener thread only
+    std::vector<std::pair<std::string, uint32_t>> m_answer[2];
+    std::atomic<bool> m_running = false;
+    std::atomic<bool> m_loop_active = false;
+};
+
+#endif
@@ -0,0 +1,203 @@
+//
+//  MockHost.cpp
+//  Moonlight
+//
+
+#include "MockHost.hpp"
+#include "ThreadProfiler.hpp"
+#include "http.h"
+#include <borealis.hpp>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Listener wakes up this often to check stop flag
+#define MOCK_HOST_ACCEPT_POLL_MS 100
+// Headers of one request, larger ones drop the connection
+#define MOCK_HOST_REQUEST_MAX 8192
+
+static std::string mock_applist(int count) {
+    std::string xml = "<?xml version=\"1.0\" encoding=\"utf-8\"?><root status_code=\"200\">";
+    for (int i = 0; i < count; i++)
+        xml += "<App><IsHdrSupported>0</IsHdrSupported><AppTitle>Application " + std::to_string(i) +
+               "</AppTitle><ID>" + std::to_string(100000 + i) + "</ID></App>";
+    xml += "</root>";
+    return xml;
+}
+
+static bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t result = send(fd, data.data() + sent, data.size() - sent, 0);
+        if (result <= 0)
+            return false;
+        sent += result;
+    }
+    return true;
+}
+
+bool MockHost::start(const MockHostConfig& config) {
+    stop();
+    m_config = config;
+    m_applist = mock_applist(config.app_count);
+    m_boxart.resize(config.boxart_bytes);
+    std::minstd_rand random(config.app_count);
+    for (auto& byte : m_boxart)
+        byte = (char)random();
+
+    m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listen_fd < 0)
+        return false;
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    if (bind(m_listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(m_listen_fd, 16) != 0 ||
+        getsockname(m_listen_fd, (struct sockaddr*)&addr, &length) != 0) {
+        brls::Logger::error("MockHost: Couldn't listen on loopback");
+        close(m_listen_fd);
+        m_listen_fd = -1;
+        return false;
+    }
+
+    m_port = ntohs(addr.sin_port);
+    m_requests = 0;
+    // Client calls https port the same one, it's served without TLS
+    http_set_plaintext_host(address(), true);
+
+    m_running = true;
+    m_accept_thread = std::thread(&MockHost::accept_loop, this);
+    brls::Logger::info("MockHost: Listening on {}, {} apps, {} ms latency, {:.1f}% loss", address(),
+                       config.app_count, config.latency_ms, config.loss * 100);
+    return true;
+}
+
+void MockHost::stop() {
+    if (!m_running.exchange(false))
+        return;
+
+    if (m_accept_thread.joinable())
+        m_accept_thread.join();
+    close(m_listen_fd);
+    m_listen_fd = -1;
+
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // Wakes connections waiting in recv, they close themselves
+        for (int fd : m_connections)
+            shutdown(fd, SHUT_RDWR);
+        threads = std::move(m_threads);
+        m_threads.clear();
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    http_set_plaintext_host(address(), false);
+}
+
+std::string MockHost::address() const { return "127.0.0.1:" + std::to_string(m_port); }
+
+void MockHost::accept_loop() {
+    ThreadProfileScope profile("Mock host");
+    while (m_running) {
+        struct pollfd pfd = {m_listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, MOCK_HOST_ACCEPT_POLL_MS) <= 0)
+            continue;
+
+        int fd = accept(m_listen_fd, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_connections.push_back(fd);
+        m_threads.emplace_back(&MockHost::serve, this, fd);
+    }
+}
+
+void MockHost::serve(int fd) {
+    std::minstd_rand random(fd + (uint32_t)m_requests);
+    std::uniform_real_distribution<float> chance(0, 1);
+    std::string buffer;
+    char chunk[2048];
+
+    // Keep-alive, curl sends next request on the same connection
+    while (m_running) {
+        size_t end = buffer.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            if (buffer.size() > MOCK_HOST_REQUEST_MAX)
+                break;
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0)
+                break;
+            buffer.append(chunk, received);
+            continue;
+        }
+
+        // "GET /path?query HTTP/1.1"
+        size_t path_start = buffer.find(' ') + 1;
+        std::string path = buffer.substr(path_start, buffer.find(' ', path_start) - path_start);
+        buffer.erase(0, end + 4);
+        m_requests++;
+
+        int delay_ms = m_config.latency_ms;
+        if (m_config.loss > 0 && chance(random) < m_config.loss)
+            delay_ms += MOCK_HOST_RETRANSMIT_MS;
+        if (delay_ms > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+
+        std::string content_type = "text/xml";
+        std::string body = respond(path, content_type);
+        std::string status = body.empty() ? "404 Not Found" : "200 OK";
+        if (body.empty())
+            body = "<root status_code=\"404\"/>";
+
+        std::string header = "HTTP/1.1 " + status + "\r\nContent-Type: " + content_type +
+                             "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+        if (!send_all(fd, header) || !send_all(fd, body))
+            break;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_connections.erase(std::remove(m_connections.begin(), m_connections.end(), fd), m_connections.end());
+    }
+    close(fd);
+}
+
+std::string MockHost::respond(const std::string& path, std::string& content_type) {
+    std::string endpoint = path.substr(0, path.find('?'));
+
+    if (endpoint == "/serverinfo") {
+        std::string port = std::to_string(m_port);
+        return "<?xml version=\"1.0\" encoding=\"utf-8\"?><root status_code=\"200\">"
+               "<hostname>MockHost</hostname><appversion>7.1.431.-1</appversion>"
+               "<GfeVersion>3.23.0.74</GfeVersion><uniqueid>0123456789ABCDEF</uniqueid>"
+               "<HttpsPort>" + port + "</HttpsPort><ExternalPort>" + port + "</ExternalPort>"
+               "<mac>00:11:22:33:44:55</mac><MaxLumaPixelsHEVC>1869449984</MaxLumaPixelsHEVC>"
+               "<LocalIP>127.0.0.1</LocalIP><ServerCodecModeSupport>259</ServerCodecModeSupport>"
+               "<PairStatus>1</PairStatus><currentgame>0</currentgame>"
+               "<state>SUNSHINE_SERVER_FREE</state></root>";
+    }
+    if (endpoint == "/applist")
+        return m_applist;
+    if (endpoint == "/appasset") {
+        content_type = "image/png";
+        return m_boxart;
+    }
+    if (endpoint == "/launch" || endpoint == "/resume")
+        return "<?xml version=\"1.0\" encoding=\"utf-8\"?><root status_code=\"200\">"
+               "<gamesession>1</gamesession><sessionUrl0>rtsp://127.0.0.1:48010</sessionUrl0></root>";
+    if (endpoint == "/cancel")
+        return "<?xml version=\"1.0\" encoding=\"utf-8\"?><root status_code=\"200\"><cancel>1</cancel></root>";
+    if (endpoint == "/unpair")
+        return "<?xml version=\"1.0\" encoding=\"utf-8\"?><root status_code=\"200\"/>";
+    return "";
+}
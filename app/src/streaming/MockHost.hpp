@@ -0,0 +1,62 @@
+//
+//  MockHost.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Lost segment comes again after TCP retransmission timeout, so loss is
+// simulated as this extra delay instead of a failed request
+#define MOCK_HOST_RETRANSMIT_MS 200
+
+struct MockHostConfig {
+    // Added before every response, as round trip to a remote host
+    int latency_ms = 0;
+    // Chance of a response being delayed by retransmission
+    float loss = 0;
+    int app_count = 50;
+    size_t boxart_bytes = 64 * 1024;
+};
+
+// GameStream host on loopback for benchmarks of client flows: answers
+// serverinfo, applist, appasset, launch, resume and cancel as paired
+// Sunshine host would. There is no TLS, https requests to it go over
+// plain HTTP, and no RTSP, launch ends with session URL
+class MockHost {
+  public:
+    ~MockHost() { stop(); }
+
+    // Listens on a free port, returns false when socket couldn't be bound
+    bool start(const MockHostConfig& config);
+    void stop();
+
+    // "127.0.0.1:<port>", as saved host address is written
+    [[nodiscard]] std::string address() const;
+    [[nodiscard]] unsigned short port() const { return m_port; }
+    [[nodiscard]] uint64_t requests() const { return m_requests; }
+
+  private:
+    void accept_loop();
+    void serve(int fd);
+    std::string respond(const std::string& path, std::string& content_type);
+
+    MockHostConfig m_config;
+    std::string m_applist;
+    std::string m_boxart;
+    int m_listen_fd = -1;
+    unsigned short m_port = 0;
+    std::atomic<bool> m_running = false;
+    std::atomic<uint64_t> m_requests = 0;
+    std::thread m_accept_thread;
+    std::mutex m_mutex;
+    std::vector<int> m_connections;
+    std::vector<std::thread> m_threads;
+};
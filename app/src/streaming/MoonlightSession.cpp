@@ -1,46 +1,92 @@
 #include "MoonlightSession.hpp"
 #include "AVFrameHolder.hpp"
+#include "AVSync.hpp"
+#include "AsyncLog.hpp"
+#include "DecoderCapabilities.hpp"
+#include "FrameCapture.hpp"
+#include "FrameTracer.hpp"
+#include "HighResClock.hpp"
+#include "LatencyProbe.hpp"
+#include "PathMtu.hpp"
+#include "PerformanceHints.hpp"
+#include "PipelineTrace.hpp"
+#include "SessionRecorder.hpp"
+#include "SocketQos.hpp"
+#include "StreamPercentiles.hpp"
+#include "StreamProfile.hpp"
+#include "StreamRecorder.hpp"
+#include "TelemetryRecorder.hpp"
+#ifdef __SWITCH__
+#include "SwitchPower.hpp"
+#endif
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+#include "DKPresentControl.hpp"
+#endif
 #include "GameStreamClient.hpp"
 #include "InputManager.hpp"
 #include "Settings.hpp"
+#include "ThreadAffinity.hpp"
+#include "ThreadProfiler.hpp"
 #include "borealis.hpp"
+#include "PlatformBackends.hpp"
+#include <algorithm>
+#include <chrono>
 #include <string.h>
+#include <thread>
 
 using namespace brls;
 
-int m_video_format;
-static MoonlightSession* m_active_session = nullptr;
+static std::atomic<MoonlightSession*> s_connection = nullptr;
 static MoonlightSessionDecoderAndRenderProvider* m_provider = nullptr;
+static std::thread m_teardown_thread;
 
 void MoonlightSession::set_provider(
     MoonlightSessionDecoderAndRenderProvider* provider) {
     m_provider = provider;
 }
 
-MoonlightSession::MoonlightSession(const std::string& address, int app_id) {
+MoonlightSessionDecoderAndRenderProvider* MoonlightSession::provider() {
+    return m_provider;
+}
+
+MoonlightSession::MoonlightSession(const std::string& address, int app_id)
+    : m_pipeline(m_provider) {
+    // Pipeline is the session's own, but recorders, tuning and audio
+    // device are shared with the draining one
+    wait_teardown();
+
     m_address = address;
     m_app_id = app_id;
-    m_active_session = this;
-
-    m_video_decoder = m_provider->video_decoder();
-    m_video_renderer = m_provider->video_renderer();
-    m_audio_renderer = m_provider->audio_renderer();
 }
 
 MoonlightSession::~MoonlightSession() {
-    if (m_video_decoder) {
-        delete m_video_decoder;
-    }
-
-    if (m_video_renderer) {
-        delete m_video_renderer;
+    // Reconnect thread still uses this session
+    m_abort_reconnect = true;
+    while (m_reconnecting)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    wait_prepared();
+
+    if (Settings::instance().write_log()) {
+        FrameTracer::instance().dump(Settings::instance().frame_trace_path());
     }
-
-    if (m_audio_renderer) {
-        delete m_audio_renderer;
-    }
-
-    m_active_session = nullptr;
+    SessionRecorder::instance().stop();
+    StreamRecorder::instance().stop();
+    TelemetryRecorder::instance().stop();
+    // Trace left running from overlay is written when session ends
+    PipelineTrace::instance().stop(Settings::instance().pipeline_trace_path());
+
+    // Next sessions learn whether this resolution decodes in time
+    auto& decode_stats = m_pipeline.stats().video_decode_stats;
+    if (decode_stats.total_decoded_frames >= DECODE_MEASURE_MIN_FRAMES)
+        DecoderCapabilities::instance().record_session(m_video_setup.format, decode_stats.hw_decoding,
+                                                       m_video_setup.height,
+                                                       decode_stats.session_decoding_time);
+    Settings::instance().set_session_tuning(0, 0);
+
+    // Connection and decoder threads are gone at this point, pipeline
+    // is released with the session
+    unbind_connection();
+    AsyncLog::instance().stop();
 }
 
 // MARK: Connection callbacks
@@ -68,56 +114,47 @@ void MoonlightSession::connection_stage_complete(int stage) {
 
 void MoonlightSession::connection_stage_failed(int stage, int error_code) {
     brls::Logger::error("MoonlightSession: Failed: {} with error code: {}", stages[stage], error_code);
+#ifdef __SWITCH__
+    SwitchPower::set_boost(SWITCH_BOOST_SESSION_SETUP, false);
+#endif
 }
 
 void MoonlightSession::connection_started() {
     brls::Logger::info("MoonlightSession: Connection started");
-        m_active_session->m_is_active = true;
+#ifdef __SWITCH__
+    SwitchPower::set_boost(SWITCH_BOOST_SESSION_SETUP, false);
+#endif
+    if (auto session = s_connection.load())
+        session->m_is_active = true;
 }
 
 void MoonlightSession::connection_terminated(int error_code) {
     brls::Logger::info("MoonlightSession: Connection terminated with code: {}", error_code);
 
+    auto session = s_connection.load();
     if (error_code != 0) {
-        if (!m_active_session) return;
-        brls::Logger::info("MoonlightSession: Reconnection attempt");
-
-        m_active_session->stop(false);
-
-        m_active_session->start([](const GSResult<bool>& result) {
-            if (result.isSuccess()) {
-                brls::Logger::info("MoonlightSession: Reconnected");
-            } else {
-                brls::Logger::info("MoonlightSession: Reconnection failed");
-                if (m_active_session) {
-                    m_active_session->m_is_active = false;
-                    m_active_session->m_is_terminated = true;
-                }
-            }
-        }, m_active_session->m_is_sunshine);
+        if (!session) return;
+        session->reconnect(session->m_bitrate);
         return;
     }
 
-    if (m_active_session) {
-        m_active_session->m_is_active = false;
-        m_active_session->m_is_terminated = true;
+    if (session) {
+        session->m_is_active = false;
+        session->m_is_terminated = true;
     }
 }
 
 void MoonlightSession::connection_log_message(const char* format, ...) {
     va_list arglist;
     va_start(arglist, format);
-    int size = vsnprintf(NULL, 0, format, arglist);
-    char buffer[size];
-    vsnprintf(buffer, size, format, arglist);
+    AsyncLog::instance().log(ASYNC_LOG_INFO, "", format, arglist);
     va_end(arglist);
-
-    brls::Logger::info(fmt::runtime(std::string(buffer)));
 }
 
 void MoonlightSession::connection_rumble(unsigned short controller,
                                          unsigned short lowFreqMotor,
                                          unsigned short highFreqMotor) {
+    SessionRecorder::instance().rumble(controller, lowFreqMotor, highFreqMotor);
     MoonlightInputManager::instance().handleRumble(controller, lowFreqMotor,
                                                    highFreqMotor);
 }
@@ -127,19 +164,25 @@ void MoonlightSession::connection_rumble_triggers(uint16_t controllerNumber,
                                                   uint16_t leftTriggerMotor, 
                                                   uint16_t rightTriggerMotor) 
 {
-    // MoonlightInputManager::instance().handleRumbleTriggers(controllerNumber, leftTriggerMotor, rightTriggerMotor);                                                
+#ifdef HAPTICS_TRIGGER_RUMBLE
+    MoonlightInputManager::instance().handleRumbleTriggers(controllerNumber, leftTriggerMotor, rightTriggerMotor);
+#endif
 }
 
 void MoonlightSession::connection_status_update(int connection_status) {
-    if (m_active_session) {
-        m_active_session->m_connection_status_is_poor =
+    SessionRecorder::instance().connection_status(connection_status);
+    auto session = s_connection.load();
+    if (session) {
+        session->m_connection_status_is_poor =
             connection_status == CONN_STATUS_POOR;
     }
 }
 
 void MoonlightSession::connection_set_hdr_mode(bool use_hdr) {
-    if (m_active_session) {
-        m_active_session->m_use_hdr = use_hdr;
+    SessionRecorder::instance().hdr_mode(use_hdr);
+    auto session = s_connection.load();
+    if (session) {
+        session->m_use_hdr = use_hdr;
     }
 }
 
@@ -148,37 +191,77 @@ void MoonlightSession::connection_set_hdr_mode(bool use_hdr) {
 int MoonlightSession::video_decoder_setup(int video_format, int width,
                                           int height, int redraw_rate,
                                           void* context, int dr_flags) {
-    m_video_format = video_format;
-    if (m_active_session && m_active_session->m_video_decoder) {
-        return m_active_session->m_video_decoder->setup(
+    SessionRecorder::instance().video_setup(video_format, width, height, redraw_rate);
+    StreamRecorder::instance().video_setup(video_format, width, height, redraw_rate);
+    TelemetryRecorder::instance().video_setup(video_format, width, height, redraw_rate);
+    auto session = s_connection.load();
+    if (session)
+        session->m_pipeline.set_video_format(video_format);
+    if (session && session->m_pipeline.video_decoder()) {
+        session->wait_prepared();
+        if (session->m_video_ready) {
+            auto& last = session->m_video_setup;
+            // Stream resumed with the same format, new one starts from IDR
+            if (last.format == video_format && last.width == width &&
+                last.height == height && last.fps == redraw_rate) {
+                brls::Logger::info("MoonlightSession: Reuse video decoder");
+                return DR_OK;
+            }
+            session->m_pipeline.video_decoder()->cleanup();
+            session->m_video_ready = false;
+        }
+
+        int result = session->m_pipeline.video_decoder()->setup(
             video_format, width, height, redraw_rate, context, dr_flags);
+        if (result == DR_OK) {
+            session->m_video_ready = true;
+            session->m_video_setup = {video_format, width, height, redraw_rate};
+        }
+        return result;
     }
     return DR_OK;
 }
 
 void MoonlightSession::video_decoder_start() {
-    if (m_active_session && m_active_session->m_video_decoder) {
-        m_active_session->m_video_decoder->start();
+    auto session = s_connection.load();
+    if (session && session->m_pipeline.video_decoder()) {
+        session->m_pipeline.video_decoder()->start();
     }
 }
 
 void MoonlightSession::video_decoder_stop() {
-    if (m_active_session && m_active_session->m_video_decoder) {
-        m_active_session->m_video_decoder->stop();
+    auto session = s_connection.load();
+    if (session && session->m_pipeline.video_decoder()) {
+        session->m_pipeline.video_decoder()->stop();
     }
 }
 
 void MoonlightSession::video_decoder_cleanup() {
-    if (m_active_session && m_active_session->m_video_decoder) {
-        m_active_session->m_video_decoder->cleanup();
+    auto session = s_connection.load();
+    if (session && session->m_pipeline.video_decoder()) {
+        if (session->m_keep_pipeline)
+            return;
+        session->m_pipeline.video_decoder()->cleanup();
+        session->m_video_ready = false;
     }
 }
 
 int MoonlightSession::video_decoder_submit_decode_unit(
     PDECODE_UNIT decode_unit) {
-    if (m_active_session && m_active_session->m_video_decoder) {
-        return m_active_session->m_video_decoder->submit_decode_unit(
-            decode_unit);
+    ThreadProfiler::instance().register_once("Video receive");
+    TRACE_SCOPE("Submit decode unit");
+    SessionRecorder::instance().video_unit(decode_unit);
+    StreamRecorder::instance().video_unit(decode_unit);
+    auto session = s_connection.load();
+    if (session && session->m_pipeline.video_decoder()) {
+        if (session->m_suspended || session->m_audio_only)
+            return DR_OK;
+        // Frames dropped while suspended were referenced by this one
+        if (session->m_needs_idr.exchange(false) && decode_unit->frameType != FRAME_TYPE_IDR)
+            return DR_NEED_IDR;
+
+        return session->m_pipeline.video_decoder_stage().call(
+            [decode_unit](auto* decoder) { return decoder->submit_decode_unit(decode_unit); });
     }
     return DR_OK;
 }
@@ -188,68 +271,181 @@ int MoonlightSession::video_decoder_submit_decode_unit(
 int MoonlightSession::audio_renderer_init(
     int audio_configuration, const POPUS_MULTISTREAM_CONFIGURATION opus_config,
     void* context, int ar_flags) {
-    if (m_active_session && m_active_session->m_audio_renderer) {
-        return m_active_session->m_audio_renderer->init(
+    SessionRecorder::instance().audio_config(audio_configuration, opus_config);
+    StreamRecorder::instance().audio_config(opus_config);
+    auto session = s_connection.load();
+    if (session && session->m_pipeline.audio_renderer()) {
+        session->wait_prepared();
+        if (session->m_audio_ready) {
+            if (session->m_audio_configuration == audio_configuration &&
+                memcmp(&session->m_opus_config, opus_config,
+                       sizeof(OPUS_MULTISTREAM_CONFIGURATION)) == 0) {
+                brls::Logger::info("MoonlightSession: Reuse audio renderer");
+                return DR_OK;
+            }
+            session->m_pipeline.audio_renderer()->cleanup();
+            session->m_audio_ready = false;
+        }
+
+        int result = session->m_pipeline.audio_renderer()->init(
             audio_configuration, opus_config, context, ar_flags);
+        if (result == DR_OK) {
+            session->m_audio_ready = true;
+            session->m_audio_configuration = audio_configuration;
+            session->m_opus_config = *opus_config;
+        }
+        return result;
     }
     return DR_OK;
 }
 
 void MoonlightSession::audio_renderer_start() {
-    if (m_active_session && m_active_session->m_audio_renderer) {
-        m_active_session->m_audio_renderer->start();
+    auto session = s_connection.load();
+    if (session && session->m_pipeline.audio_renderer()) {
+        session->m_pipeline.audio_renderer()->start();
+        if (Settings::instance().audio_thread())
+            session->m_audio_worker.start(session->m_pipeline.audio_renderer_stage());
     }
 }
 
 void MoonlightSession::audio_renderer_stop() {
-    if (m_active_session && m_active_session->m_audio_renderer) {
-        m_active_session->m_audio_renderer->stop();
+    auto session = s_connection.load();
+    if (session && session->m_pipeline.audio_renderer()) {
+        session->m_audio_worker.stop();
+        session->m_pipeline.audio_renderer()->stop();
     }
 }
 
 void MoonlightSession::audio_renderer_cleanup() {
-    if (m_active_session && m_active_session->m_audio_renderer) {
-        m_active_session->m_audio_renderer->cleanup();
+    auto session = s_connection.load();
+    if (session && session->m_pipeline.audio_renderer()) {
+        session->m_audio_worker.stop();
+        if (session->m_keep_pipeline)
+            return;
+        session->m_pipeline.audio_renderer()->cleanup();
+        session->m_audio_ready = false;
     }
 }
 
 void MoonlightSession::audio_renderer_decode_and_play_sample(
     char* sample_data, int sample_length) {
-    if (m_active_session && m_active_session->m_audio_renderer) {
-        m_active_session->m_audio_renderer->decode_and_play_sample(
-            sample_data, sample_length);
+    // Audio is called from moonlight-common-c thread, pin it on first sample
+    ThreadAffinity::apply_once(THREAD_ROLE_AUDIO);
+    ThreadProfiler::instance().register_once("Audio receive");
+    TRACE_SCOPE("Audio sample");
+    SessionRecorder::instance().audio_packet(sample_data, sample_length);
+    StreamRecorder::instance().audio_packet(sample_data, sample_length);
+
+    auto session = s_connection.load();
+    if (session && session->m_pipeline.audio_renderer() &&
+        !session->m_suspended) {
+        // With worker receive thread only copies packet, so a blocked
+        // output doesn't delay reception
+        if (session->m_audio_worker.running())
+            session->m_audio_worker.push(sample_data, sample_length);
+        else {
+            session->m_pipeline.audio_renderer_stage().call([=](auto* renderer) {
+                renderer->decode_and_play_sample(sample_data, sample_length);
+                renderer->publish_stats();
+            });
+        }
     }
 }
 
 // MARK: MoonlightSession
 
-void MoonlightSession::start(ServerCallback<bool> callback, bool is_sunshine) {
+void MoonlightSession::start(ServerCallback<bool> callback, bool is_sunshine, bool cached_host) {
     m_is_sunshine = is_sunshine;
+    m_cached_host = cached_host;
+#ifdef __SWITCH__
+    // Launch, RTSP handshake and decoder setup, until connection started
+    SwitchPower::set_boost(SWITCH_BOOST_SESSION_SETUP, true);
+#endif
+
+    AsyncLog::instance().start();
+
+    if (Settings::instance().record_session())
+        SessionRecorder::instance().start(Settings::instance().session_capture_path());
 
     LiInitializeStreamConfiguration(&m_config);
 
-    int h = Settings::instance().resolution();
-    int w = h * 16 / 9;
-    if (h == -1) {
-        h = Application::windowHeight;
-        w = Application::windowWidth;
+    m_profile = StreamProfiles::select();
+    m_config.width = m_profile.width;
+    m_config.height = m_profile.height;
+    m_config.fps = m_profile.fps;
+    brls::Logger::info("MoonlightSession: Stream profile {}x{}x{} for display mode {}",
+                       m_profile.width, m_profile.height, m_profile.fps, (int)m_profile.mode);
+#ifdef __SWITCH__
+    if (Settings::instance().battery_saver() && SwitchPower::low_battery() &&
+        m_config.fps > SWITCH_LOW_BATTERY_FPS) {
+        brls::Logger::info("MoonlightSession: Low battery, frame rate capped to {}", SWITCH_LOW_BATTERY_FPS);
+        m_config.fps = SWITCH_LOW_BATTERY_FPS;
     }
-
-    // 480p cannot fit into 16/9 aspect ratio without manual adjustments
-    if (h == 480) {
-        h = 480;
-        w = 854;
+#endif
+    m_audio_only = Settings::instance().audio_only();
+    m_reduced_video = m_audio_only;
+    if (m_audio_only && m_config.fps > AUDIO_ONLY_FPS)
+        m_config.fps = AUDIO_ONLY_FPS;
+    switch (Settings::instance().audio_channels()) {
+    case AUDIO_CHANNELS_51:
+        m_config.audioConfiguration = AUDIO_CONFIGURATION_51_SURROUND;
+        break;
+    case AUDIO_CHANNELS_71:
+        m_config.audioConfiguration = AUDIO_CONFIGURATION_71_SURROUND;
+        break;
+    default:
+        m_config.audioConfiguration = AUDIO_CONFIGURATION_STEREO;
+        break;
     }
-    m_config.width = w;
-    m_config.height = h;
-    m_config.fps = Settings::instance().fps();
-    m_config.audioConfiguration = AUDIO_CONFIGURATION_STEREO;
-    m_config.packetSize = 1392;
+    // Largest packets path takes without fragments, fewer of them per frame
+    bool local = PathMtu::is_private(m_address);
+    int mtu = GameStreamClient::instance().path_mtu(m_address);
+    m_config.packetSize = PathMtu::packet_size(mtu, local, m_is_sunshine);
+    brls::Logger::info("MoonlightSession: Packet size {} for MTU {}, {} network",
+                       m_config.packetSize, mtu, local ? "local" : "remote");
     m_config.streamingRemotely = STREAM_CFG_AUTO;
-    m_config.bitrate = Settings::instance().bitrate();
+    bool probe = false;
+    if (m_bitrate == 0) {
+        m_bitrate = Settings::instance().bitrate();
+        m_adaptive_bitrate.reset(m_bitrate);
+        probe = Settings::instance().network_probe();
+        // Video is dropped anyway, link capacity doesn't matter
+        if (m_audio_only) {
+            m_adaptive_bitrate.reset(m_bitrate, ABR_MIN_BITRATE);
+            m_bitrate = ABR_MIN_BITRATE;
+            probe = false;
+        }
+    }
+    m_config.bitrate = m_bitrate;
     m_config.encryptionFlags = m_is_sunshine ? ENCFLG_ALL : ENCFLG_VIDEO;
 
-    switch (Settings::instance().video_codec()) {
+    // Codec which failed decoder probe would end up with black screen
+    VideoCodec codec = DecoderCapabilities::instance().usable_codec(Settings::instance().video_codec());
+#ifdef __PSV__
+    // sceAvcdec is H.264 only
+    if (Settings::instance().use_hw_decoding())
+        codec = H264;
+#endif
+    if (codec != Settings::instance().video_codec())
+        brls::Logger::warning("MoonlightSession: {} can't be decoded, using {}",
+                              getVideoCodecName(Settings::instance().video_codec()),
+                              getVideoCodecName(codec));
+    if (!DecoderCapabilities::instance().realtime(codec, m_config.height, m_config.fps))
+        brls::Logger::warning("MoonlightSession: {} at {}p was too slow to decode before",
+                              getVideoCodecName(codec), m_config.height);
+
+    // Smallest queue and decoder threads which kept this host smooth
+    m_codec = codec;
+    if (Settings::instance().auto_tune()) {
+        auto tuning = DecoderCapabilities::instance().tuning(m_address, codec);
+        Settings::instance().set_session_tuning(tuning.frames_queue_size, tuning.decoder_threads);
+    }
+    AVSync::instance().reset();
+    m_tuner.reset(Settings::instance().configured_frames_queue_size(),
+                  Settings::instance().configured_decoder_threads(),
+                  Settings::instance().frames_queue_size(), Settings::instance().decoder_threads());
+
+    switch (codec) {
     case H264:
         m_config.supportedVideoFormats = VIDEO_FORMAT_H264;
         break;
@@ -286,8 +482,8 @@ void MoonlightSession::start(ServerCallback<bool> callback, bool is_sunshine) {
     m_video_callbacks.cleanup = video_decoder_cleanup;
     m_video_callbacks.submitDecodeUnit = video_decoder_submit_decode_unit;
 
-    if (m_video_decoder) {
-        m_video_callbacks.capabilities = m_video_decoder->capabilities();
+    if (m_pipeline.video_decoder()) {
+        m_video_callbacks.capabilities = m_pipeline.video_decoder()->capabilities();
     }
 
     LiInitializeAudioCallbacks(&m_audio_callbacks);
@@ -298,10 +494,70 @@ void MoonlightSession::start(ServerCallback<bool> callback, bool is_sunshine) {
     m_audio_callbacks.decodeAndPlaySample =
         audio_renderer_decode_and_play_sample;
 
-    if (m_audio_renderer) {
-        m_audio_callbacks.capabilities = m_audio_renderer->capabilities();
+    if (m_pipeline.audio_renderer()) {
+        m_audio_callbacks.capabilities = m_pipeline.audio_renderer()->capabilities();
+    }
+
+    TelemetrySession telemetry;
+    telemetry.host = GameStreamClient::instance()
+                         .read_server_data(m_address, [](auto& data) { return data.hostname; })
+                         .value_or("");
+    telemetry.address = m_address;
+    telemetry.app_id = m_app_id;
+    telemetry.width = m_config.width;
+    telemetry.height = m_config.height;
+    telemetry.fps = m_config.fps;
+    telemetry.bitrate = m_config.bitrate;
+    telemetry.supported_video_formats = m_config.supportedVideoFormats;
+    telemetry.is_sunshine = m_is_sunshine;
+    telemetry.qos = Settings::instance().qos_marking() && SocketQos::supported();
+    StreamPercentiles::instance().reset();
+    TelemetryRecorder::instance().start(Settings::instance().telemetry_path(), telemetry);
+
+    // Renderer is prepared here on UI thread, which is the render one
+    if (m_pipeline.video_renderer()) {
+        m_pipeline.video_renderer()->prepare();
+        if (m_pipeline.video_decoder()) {
+            IVideoFrameUploader* uploader = m_pipeline.video_renderer()->frame_uploader();
+            m_pipeline.video_decoder()->set_frame_uploader(uploader);
+            // Pool is for uploads on render thread, decoder side ones read
+            // frames from system memory
+            m_pipeline.video_decoder()->set_frame_allocator(
+                uploader ? nullptr : m_pipeline.video_renderer()->frame_allocator(m_config.width, m_config.height));
+        }
+    }
+
+    wait_prepared();
+    m_prepare_thread = std::thread([this] {
+        ThreadProfileScope profile("Session prepare");
+        if (m_pipeline.video_decoder())
+            m_pipeline.video_decoder()->prepare();
+        if (m_pipeline.audio_renderer())
+            m_pipeline.audio_renderer()->prepare();
+    });
+
+    if (!probe) {
+        launch(callback);
+        return;
     }
 
+    // Stream starts at what link carries, adaptive bitrate moves from there
+    GameStreamClient::instance().probe(m_address, m_app_id, [this, callback](auto result) {
+        if (result.isSuccess()) {
+            int configured = Settings::instance().bitrate();
+            int bitrate = NetworkProbe::initial_bitrate(result.value(), configured, ABR_MIN_BITRATE);
+            if (bitrate != m_bitrate) {
+                brls::Logger::info("MoonlightSession: Starting at {} Kbps instead of {} Kbps", bitrate, m_bitrate);
+                m_bitrate = bitrate;
+                m_config.bitrate = bitrate;
+                m_adaptive_bitrate.reset(configured, bitrate);
+            }
+        }
+        launch(callback);
+    });
+}
+
+void MoonlightSession::launch(ServerCallback<bool> callback) {
     GameStreamClient::instance().start(
         m_address, m_config, m_app_id, [this, callback](auto result) {
             if (result.isSuccess()) {
@@ -309,6 +565,8 @@ void MoonlightSession::start(ServerCallback<bool> callback, bool is_sunshine) {
 
                 auto m_data =
                     GameStreamClient::instance().server_data(m_address);
+                bind_connection();
+                SocketQos::Scope qos(Settings::instance().qos_marking());
                 int result = LiStartConnection(
                     &m_data.serverInfo, &m_config, &m_connection_callbacks,
                     &m_video_callbacks, &m_audio_callbacks, NULL, 0, NULL, 0);
@@ -320,6 +578,24 @@ void MoonlightSession::start(ServerCallback<bool> callback, bool is_sunshine) {
                 } else {
                     callback(GSResult<bool>::success(true));
                 }
+            } else if (m_cached_host) {
+                // Cached state may be stale, pairing or running app changed
+                brls::Logger::warning(
+                    "MoonlightSession: Launch with cached host state failed, "
+                    "retrying with fresh one: {}",
+                    result.error().c_str());
+                m_cached_host = false;
+                GameStreamClient::instance().connect(
+                    m_address, [this, callback](GSResult<SERVER_DATA> result) {
+                        if (!result.isSuccess()) {
+                            callback(GSResult<bool>::failure(result.error()));
+                            return;
+                        }
+
+                        m_is_sunshine = result.value().isSunshine();
+                        m_config.encryptionFlags = m_is_sunshine ? ENCFLG_ALL : ENCFLG_VIDEO;
+                        launch(callback);
+                    });
             } else {
                 brls::Logger::error(
                     "MoonlightSession: Failed to start stream: {}",
@@ -329,24 +605,282 @@ void MoonlightSession::start(ServerCallback<bool> callback, bool is_sunshine) {
         });
 }
 
+void MoonlightSession::reconnect(int bitrate) {
+    if (m_reconnecting.exchange(true))
+        return;
+
+    brls::Logger::info("MoonlightSession: Reconnecting with {} kbps", bitrate);
+#ifdef __SWITCH__
+    SwitchPower::set_boost(SWITCH_BOOST_SESSION_SETUP, true);
+#endif
+    m_bitrate = bitrate;
+    TelemetryRecorder::instance().reconnect(bitrate);
+
+    // Stop joins connection threads, so it's not done on UI thread.
+    // Whole loop is blocking, so it never waits for UI thread either
+    brls::async([this] {
+        m_is_active = false;
+        m_keep_pipeline = true;
+        LiStopConnection();
+
+        bool connected = false;
+        int delay = RECONNECT_BACKOFF_MIN_MS;
+        for (int attempt = 1; attempt <= RECONNECT_ATTEMPTS_MAX; attempt++) {
+            for (int waited = 0; waited < delay && !m_abort_reconnect; waited += 10)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            if (m_abort_reconnect)
+                break;
+
+            brls::Logger::info("MoonlightSession: Reconnection attempt {}", attempt);
+            if ((connected = resume_connection()))
+                break;
+            delay = std::min(delay * 2, RECONNECT_BACKOFF_MAX_MS);
+        }
+
+        m_keep_pipeline = false;
+        if (connected) {
+            brls::Logger::info("MoonlightSession: Reconnected");
+            m_adaptive_bitrate.restarted();
+            m_tuner.restarted();
+        } else {
+            brls::Logger::info("MoonlightSession: Reconnection failed");
+            release_pipeline();
+            m_is_terminated = true;
+        }
+        m_reconnecting = false;
+    });
+}
+
+void MoonlightSession::check_profile() {
+    uint64_t now = HighResClock::now_us();
+    if (now - m_profile_checked_us < STREAM_PROFILE_CHECK_US)
+        return;
+    m_profile_checked_us = now;
+
+    StreamProfile profile = StreamProfiles::select();
+    if (profile.same_stream(m_profile)) {
+        m_profile_changed_us = 0;
+        return;
+    }
+
+    // New display has to stay for a while, docking flips mode back and forth
+    if (!m_profile_changed_us) {
+        m_profile_changed_us = now;
+        return;
+    }
+    if (now - m_profile_changed_us < STREAM_PROFILE_SETTLE_US)
+        return;
+
+    brls::Logger::info("MoonlightSession: Display changed, switching stream to {}x{}x{}",
+                       profile.width, profile.height, profile.fps);
+    m_profile = profile;
+    m_profile_changed_us = 0;
+    m_config.width = profile.width;
+    m_config.height = profile.height;
+    m_config.fps = profile.fps;
+    reconnect(m_bitrate);
+}
+
+void MoonlightSession::wait_prepared() {
+    if (m_prepare_thread.joinable())
+        m_prepare_thread.join();
+}
+
+bool MoonlightSession::resume_connection() {
+    // Only RTSP and ENet streams are started again, host needs resume
+    // request for new input key and session url
+    STREAM_CONFIGURATION config = m_config;
+    config.bitrate = m_bitrate;
+    if (GameStreamClient::instance().resume(m_address, config, m_app_id) != GS_OK) {
+        brls::Logger::error("MoonlightSession: Resume failed: {}", gs_error());
+        return false;
+    }
+    m_config = config;
+
+    auto m_data = GameStreamClient::instance().server_data(m_address);
+    bind_connection();
+    SocketQos::Scope qos(Settings::instance().qos_marking());
+    int result = LiStartConnection(
+        &m_data.serverInfo, &m_config, &m_connection_callbacks,
+        &m_video_callbacks, &m_audio_callbacks, NULL, 0, NULL, 0);
+    if (result != 0) {
+        LiStopConnection();
+        return false;
+    }
+    return true;
+}
+
+void MoonlightSession::bind_connection() {
+    s_connection = this;
+}
+
+void MoonlightSession::unbind_connection() {
+    // Newer session could have bound itself already
+    MoonlightSession* expected = this;
+    s_connection.compare_exchange_strong(expected, nullptr);
+}
+
+void MoonlightSession::release_pipeline() {
+    // Cleanup callbacks were skipped while reconnecting
+    if (m_video_ready && m_pipeline.video_decoder()) {
+        m_pipeline.video_decoder()->cleanup();
+        m_video_ready = false;
+    }
+    m_audio_worker.stop();
+    if (m_audio_ready && m_pipeline.audio_renderer()) {
+        m_pipeline.audio_renderer()->cleanup();
+        m_audio_ready = false;
+    }
+}
+
 void MoonlightSession::stop(int terminate_app) {
     if (terminate_app) {
         GameStreamClient::instance().quit(m_address, [](auto _) {});
     }
 
+    // Reconnect thread owns connection until it gives up
+    m_abort_reconnect = true;
+    while (m_reconnecting)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
     LiStopConnection();
+    unbind_connection();
+    release_pipeline();
+#ifdef __SWITCH__
+    SwitchPower::set_boost(SWITCH_BOOST_SESSION_SETUP, false);
+#endif
 }
 
-void MoonlightSession::draw(NVGcontext* vg, int width, int height) {
-    if (m_video_decoder && m_video_renderer) {
-        AVFrameHolder::instance().get(
-            [this, vg, width, height](AVFrame* frame) {
-                m_video_renderer->draw(vg, width, height, frame, m_video_format);
-            });
+void MoonlightSession::stop_async(MoonlightSession* session, int terminate_app) {
+    wait_teardown();
+
+    // Host cache belongs to UI thread, quit request runs in background anyway
+    if (terminate_app)
+        GameStreamClient::instance().quit(session->m_address, [](auto _) {});
+
+    m_teardown_thread = std::thread([session] {
+        ThreadProfileScope profile("Session teardown");
+        uint64_t start = HighResClock::now_us();
+        session->stop(false);
+
+        IVideoRenderer* renderer = session->m_pipeline.take_video_renderer();
+        delete session;
+
+        brls::Logger::info("MoonlightSession: Torn down in {} ms", (HighResClock::now_us() - start) / 1000);
+        if (renderer)
+            brls::sync([renderer] { delete renderer; });
+    });
+}
+
+void MoonlightSession::wait_teardown() {
+    if (m_teardown_thread.joinable())
+        m_teardown_thread.join();
+}
+
+void MoonlightSession::set_suspended(bool suspended) {
+    if (m_suspended == suspended)
+        return;
+
+    brls::Logger::info("MoonlightSession: {}", suspended ? "Suspended" : "Resumed");
+    if (suspended)
+        m_needs_idr = true;
+    m_suspended = suspended;
+}
 
-        m_session_stats.video_decode_stats =
-            *m_video_decoder->video_decode_stats();
-        m_session_stats.video_render_stats =
-            *m_video_renderer->video_render_stats();
+void MoonlightSession::set_audio_only(bool audio_only) {
+    if (m_audio_only == audio_only)
+        return;
+
+    brls::Logger::info("MoonlightSession: Audio only {}", audio_only ? "on" : "off");
+    if (audio_only) {
+        m_needs_idr = true;
+        m_audio_only = true;
+        return;
+    }
+
+    m_audio_only = false;
+    if (!m_reduced_video) {
+        // Decoding starts again from next IDR, host sends it right away
+        if (m_is_active)
+            LiRequestIdrFrame();
+        return;
+    }
+
+    // Resumed stream starts with IDR anyway
+    m_reduced_video = false;
+    m_config.fps = m_profile.fps;
+#ifdef __SWITCH__
+    if (Settings::instance().battery_saver() && SwitchPower::low_battery() &&
+        m_config.fps > SWITCH_LOW_BATTERY_FPS)
+        m_config.fps = SWITCH_LOW_BATTERY_FPS;
+#endif
+    reconnect(Settings::instance().bitrate());
+}
+
+void MoonlightSession::draw(NVGcontext* vg, int width, int height) {
+    if (m_pipeline.video_decoder() && m_pipeline.video_renderer()) {
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+        // Previous frame is done by then, so swap mark is closer to present
+        DKPresentControl::frame_start();
+#endif
+        FrameTracer::instance().swap_done();
+
+        // Nothing is decoded, so there is nothing to draw or tune
+        bool video = !m_audio_only;
+        if (video) {
+            m_pipeline.frames().get(
+                [this, vg, width, height](AVFrame* frame, uint64_t generation) {
+                    FrameTracer::instance().queue_popped((uint32_t)frame->pts);
+                    {
+                        TRACE_SCOPE("Render video");
+                        uint64_t before_draw = HighResClock::now_us();
+                        m_pipeline.video_renderer_stage().call([&](auto* renderer) {
+                            renderer->draw(vg, width, height, frame, m_pipeline.video_format(), generation);
+                        });
+                        uint64_t draw_time_us = HighResClock::now_us() - before_draw;
+                        PerformanceHints::instance().report(PERF_HINT_RENDER, draw_time_us);
+                        StreamPercentiles::instance().record(STREAM_STAT_RENDER, draw_time_us);
+                    }
+                    FrameTracer::instance().draw_done((uint32_t)frame->pts);
+                    LatencyProbe::instance().frame_drawn(frame);
+                    FrameCapture::instance().frame_drawn(frame);
+                });
+        }
+
+        m_pipeline.stats().video_decode_stats =
+            m_pipeline.video_decoder()->video_decode_stats();
+
+        if (m_is_active && !m_reconnecting)
+            check_profile();
+
+        if (Settings::instance().auto_bitrate() && video && m_is_active && !m_reconnecting) {
+            int bitrate = m_adaptive_bitrate.update(m_pipeline.stats().video_decode_stats,
+                                                    m_connection_status_is_poor, m_config.fps);
+            if (bitrate > 0)
+                reconnect(bitrate);
+        }
+        if (Settings::instance().auto_tune() && video && m_is_active && !m_reconnecting) {
+            auto& holder = m_pipeline.frames();
+            if (m_tuner.update(m_pipeline.stats().video_decode_stats, holder.getFakeFrameStat(),
+                               holder.getFrameDropStat(), holder.getDisplayRefreshRate(), m_config.fps))
+                DecoderCapabilities::instance().record_tuning(m_address, m_codec, m_tuner.result());
+        }
+
+        m_pipeline.stats().video_render_stats =
+            *m_pipeline.video_renderer()->video_render_stats();
+
+        if (m_pipeline.audio_renderer()) {
+            m_pipeline.stats().audio_render_stats =
+                m_pipeline.audio_renderer()->audio_render_stats();
+            AVSync::instance().update(m_pipeline.stats().audio_render_stats,
+                                      FrameTracer::instance().last_latency_ms(),
+                                      m_config.fps > 0 ? 1000000 / m_config.fps : 0);
+        }
+
+        if (m_is_active) {
+            ThreadProfiler::instance().update();
+            TelemetryRecorder::instance().sample(m_pipeline.stats(), m_pipeline.frames(), m_bitrate,
+                                                 m_connection_status_is_poor);
+        }
     }
 }
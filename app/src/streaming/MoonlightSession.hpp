@@ -1,25 +1,47 @@
 #pragma once
 
+#include "AdaptiveBitrate.hpp"
+#include "AudioWorker.hpp"
 #include "GameStreamClient.hpp"
 #include "MoonlightSessionDecoderAndRenderProvider.hpp"
+#include "PipelineTuner.hpp"
+#include "Settings.hpp"
+#include "StreamPipeline.hpp"
+#include "StreamProfile.hpp"
+#include <atomic>
 #include <nanovg.h>
+#include <thread>
 
-struct SessionStats {
-    VideoDecodeStats video_decode_stats;
-    VideoRenderStats video_render_stats;
-};
+// Dropped stream is resumed with doubling delay between attempts,
+// decoder and audio device stay alive all that time
+#define RECONNECT_ATTEMPTS_MAX 5
+#define RECONNECT_BACKOFF_MIN_MS 250
+#define RECONNECT_BACKOFF_MAX_MS 4000
+// Audio only stream asks host for least video, bitrate is ABR_MIN_BITRATE
+#define AUDIO_ONLY_FPS 30
 
 class MoonlightSession {
   public:
     static void
     set_provider(MoonlightSessionDecoderAndRenderProvider* provider);
+    static MoonlightSessionDecoderAndRenderProvider* provider();
 
     MoonlightSession(const std::string& address, int app_id);
     ~MoonlightSession();
 
-    void start(ServerCallback<bool> callback, bool is_sunshine);
+    // With cached_host set, app is launched with host state from cache
+    // without asking host first, launch is retried once with fresh state
+    // if it fails
+    void start(ServerCallback<bool> callback, bool is_sunshine, bool cached_host = false);
     void stop(int terminate_app);
 
+    // Stops stream and deletes session on a worker, so UI doesn't wait
+    // for connection shutdown and decoder and audio cleanup. Renderer
+    // owns GPU objects, it's deleted back on UI thread
+    static void stop_async(MoonlightSession* session, int terminate_app);
+    // Previous session has to be torn down before a new one starts
+    static void wait_teardown();
+
     void draw(NVGcontext* vg, int width, int height);
 
     bool is_active() const { return m_is_active; }
@@ -33,9 +55,27 @@ class MoonlightSession {
         return m_use_hdr;
     }
 
-    SessionStats* session_stats() const {
-        return (SessionStats*)&m_session_stats;
-    }
+    // Frame rate stream was negotiated with, follows display mode changes
+    int stream_fps() const { return m_config.fps; }
+
+    // Bitrate stream runs with, can be lower than settings with auto bitrate
+    int bitrate() const { return m_bitrate; }
+
+    // While app is in background connection stays up, video and audio are
+    // dropped, decoding starts again from an IDR frame
+    void set_suspended(bool suspended);
+    bool is_suspended() const { return m_suspended; }
+
+    // Video units are dropped without decoding and nothing is rendered,
+    // control and audio streams go on. Video comes back from an IDR
+    // frame, stream started audio only is then switched to full config
+    void set_audio_only(bool audio_only);
+    bool is_audio_only() const { return m_audio_only; }
+
+    SessionStats* session_stats() { return &m_pipeline.stats(); }
+
+    // Frame queue of this session's pipeline
+    AVFrameHolder& frames() { return m_pipeline.frames(); }
 
   private:
     static void connection_stage_starting(int);
@@ -67,19 +107,62 @@ class MoonlightSession {
     std::string m_address;
     int m_app_id;
     bool m_is_sunshine = false;
+    bool m_cached_host = false;
     STREAM_CONFIGURATION m_config;
     CONNECTION_LISTENER_CALLBACKS m_connection_callbacks;
     DECODER_RENDERER_CALLBACKS m_video_callbacks;
     AUDIO_RENDERER_CALLBACKS m_audio_callbacks;
 
-    IFFmpegVideoDecoder* m_video_decoder = nullptr;
-    IVideoRenderer* m_video_renderer = nullptr;
-    IAudioRenderer* m_audio_renderer = nullptr;
+    StreamPipeline m_pipeline;
 
     bool m_is_active = false;
     bool m_is_terminated = false;
     bool m_connection_status_is_poor = false;
     bool m_use_hdr = false;
 
-    SessionStats m_session_stats = {};
+    // Launch request, after network probe when there is one
+    void launch(ServerCallback<bool> callback);
+
+    AdaptiveBitrate m_adaptive_bitrate;
+    int m_bitrate = 0;
+    PipelineTuner m_tuner;
+    VideoCodec m_codec = H264;
+    std::atomic<bool> m_reconnecting = false;
+    std::atomic<bool> m_suspended = false;
+    std::atomic<bool> m_needs_idr = false;
+    std::atomic<bool> m_audio_only = false;
+    // Stream was launched with audio only config
+    bool m_reduced_video = false;
+    std::atomic<bool> m_abort_reconnect = false;
+
+    // Decoder and audio renderer state kept between connections
+    struct VideoSetup {
+        int format, width, height, fps;
+    };
+    std::atomic<bool> m_keep_pipeline = false;
+    bool m_video_ready = false;
+    VideoSetup m_video_setup = {};
+    bool m_audio_ready = false;
+    AudioWorker m_audio_worker;
+    int m_audio_configuration = 0;
+    OPUS_MULTISTREAM_CONFIGURATION m_opus_config = {};
+
+    // Decoder and audio warm up while launch request is in flight
+    std::thread m_prepare_thread;
+    void wait_prepared();
+
+    // Stream follows display, switched with reconnect once it's settled
+    StreamProfile m_profile = {};
+    uint64_t m_profile_checked_us = 0;
+    uint64_t m_profile_changed_us = 0;
+    void check_profile();
+
+    // moonlight-common-c runs one connection, its callbacks go to the
+    // session bound before LiStartConnection
+    void bind_connection();
+    void unbind_connection();
+
+    void reconnect(int bitrate);
+    bool resume_connection();
+    void release_pipeline();
 };
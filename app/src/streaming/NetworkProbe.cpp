@@ -0,0 +1,65 @@
+//
+//  NetworkProbe.cpp
+//  Moonlight
+//
+
+#include "NetworkProbe.hpp"
+#include "HighResClock.hpp"
+#include "errors.h"
+#include <borealis.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+NetworkProbeResult NetworkProbe::run(SERVER_DATA server, int app_id) {
+    NetworkProbeResult result = {};
+    uint64_t start = HighResClock::now_us();
+
+    std::vector<float> samples;
+    for (int i = 0; i < PROBE_PINGS; i++) {
+        uint64_t sent = HighResClock::now_us();
+        if (gs_ping(&server) != GS_OK)
+            continue;
+        if (i > 0)
+            samples.push_back((float)(HighResClock::now_us() - sent) / 1000);
+    }
+
+    if (samples.size() < 2) {
+        brls::Logger::warning("NetworkProbe: Host didn't answer pings");
+        return result;
+    }
+
+    // Jitter is the mean difference of consecutive round trips, as RFC 3550 has it
+    float jitter = 0;
+    for (size_t i = 1; i < samples.size(); i++)
+        jitter += std::fabs(samples[i] - samples[i - 1]);
+    result.jitter_ms = jitter / (float)(samples.size() - 1);
+    result.rtt_ms = *std::min_element(samples.begin(), samples.end());
+    result.valid = true;
+
+    Data boxart;
+    uint64_t sent = HighResClock::now_us();
+    if (gs_app_boxart(&server, app_id, &boxart) == GS_OK && boxart.size() >= PROBE_MIN_TRANSFER) {
+        // Request round trip isn't part of transfer
+        float transfer_ms = std::max((float)(HighResClock::now_us() - sent) / 1000 - result.rtt_ms, 1.0f);
+        result.throughput_kbps = (int)((float)boxart.size() * 8 / transfer_ms);
+    }
+
+    brls::Logger::info("NetworkProbe: RTT {:.1f} ms, jitter {:.1f} ms, throughput {} Kbps, took {} ms",
+                       result.rtt_ms, result.jitter_ms, result.throughput_kbps,
+                       (HighResClock::now_us() - start) / 1000);
+    return result;
+}
+
+int NetworkProbe::initial_bitrate(const NetworkProbeResult& result, int configured_kbps, int min_kbps) {
+    if (!result.valid)
+        return configured_kbps;
+
+    float bitrate = (float)configured_kbps;
+    if (result.throughput_kbps > 0)
+        bitrate = std::min(bitrate, result.throughput_kbps * PROBE_BITRATE_SHARE);
+    if (result.jitter_ms > PROBE_JITTER_MS)
+        bitrate *= 0.8f;
+
+    return std::clamp((int)bitrate, std::min(min_kbps, configured_kbps), configured_kbps);
+}
@@ -0,0 +1,37 @@
+//
+//  NetworkProbe.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "client.h"
+
+// First request also opens connection, it's not counted
+#define PROBE_PINGS 6
+// Shorter transfers end before TCP window opens up, they tell nothing
+#define PROBE_MIN_TRANSFER 65536
+// Stream gets this share of throughput measured over TCP
+#define PROBE_BITRATE_SHARE 0.8f
+// Jitter above this takes a fifth of bitrate, late packets are lost ones
+#define PROBE_JITTER_MS 5.0f
+
+struct NetworkProbeResult {
+    bool valid;
+    float rtt_ms;
+    float jitter_ms;
+    // 0 when nothing big enough came to measure it
+    int throughput_kbps;
+};
+
+// Short check of the link before launch. Round trip and jitter come from
+// HTTP requests over kept alive connection, throughput from box art
+// download, host has nothing to answer UDP burst with before stream
+class NetworkProbe {
+  public:
+    // Blocks for few round trips and one download, worker threads only
+    static NetworkProbeResult run(SERVER_DATA server, int app_id);
+
+    // Bitrate to start with, never above configured one
+    static int initial_bitrate(const NetworkProbeResult& result, int configured_kbps, int min_kbps);
+};
@@ -0,0 +1,115 @@
+//
+//  PathMtu.cpp
+//  Moonlight
+//
+
+#include "PathMtu.hpp"
+#include "HostAddress.hpp"
+#include <borealis.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if defined(__linux) || defined(__APPLE__)
+#define PATH_MTU_SUPPORTED
+#endif
+
+// Any port does, nothing is received there
+#define PATH_MTU_PORT 9
+#define PATH_MTU_MAX 9000
+#define PATH_MTU_IP_UDP_HEADERS 28
+#define PATH_MTU_IPV6_EXTRA_HEADER 20
+
+int PathMtu::discover(const std::string& address) {
+#ifdef PATH_MTU_SUPPORTED
+    // Saved port is HTTP one, datagrams go to discard port instead
+    HostAddress target = HostAddress::parse(address, 0);
+    target.port = PATH_MTU_PORT;
+
+    // Names would need resolving, which could block
+    sockaddr_storage host;
+    int length = target.to_sockaddr(&host);
+    if (length == 0)
+        return 0;
+    bool ipv6 = host.ss_family == AF_INET6;
+
+    int fd = socket(host.ss_family, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return 0;
+
+    int mtu = 0;
+    if (connect(fd, (sockaddr*)&host, (socklen_t)length) == 0) {
+#if defined(__linux)
+        int discover = ipv6 ? IPV6_PMTUDISC_DO : IP_PMTUDISC_DO;
+        setsockopt(fd, ipv6 ? IPPROTO_IPV6 : IPPROTO_IP, ipv6 ? IPV6_MTU_DISCOVER : IP_MTU_DISCOVER,
+                   &discover, sizeof(discover));
+        socklen_t size = sizeof(mtu);
+        if (getsockopt(fd, ipv6 ? IPPROTO_IPV6 : IPPROTO_IP, ipv6 ? IPV6_MTU : IP_MTU, &mtu, &size) != 0)
+            mtu = 0;
+#else
+        // Largest datagram kernel takes with DF set, the ones it takes
+        // go to discard port of host
+        int dont_fragment = 1;
+        if (setsockopt(fd, ipv6 ? IPPROTO_IPV6 : IPPROTO_IP, ipv6 ? IPV6_DONTFRAG : IP_DONTFRAG,
+                       &dont_fragment, sizeof(dont_fragment)) == 0) {
+            static char payload[PATH_MTU_MAX];
+            int low = PATH_MTU_PACKET_MIN, high = PATH_MTU_MAX - PATH_MTU_IP_UDP_HEADERS;
+            while (low < high) {
+                int size = (low + high + 1) / 2;
+                if (send(fd, payload, size, 0) >= 0 || errno != EMSGSIZE)
+                    low = size;
+                else
+                    high = size - 1;
+            }
+            mtu = low + PATH_MTU_IP_UDP_HEADERS + (ipv6 ? PATH_MTU_IPV6_EXTRA_HEADER : 0);
+        }
+#endif
+    }
+    close(fd);
+
+    // IPv6 header is 20 bytes longer, MTU is reported as one IPv4 would
+    // need for same packets, so overhead in packet size stays the same
+    if (ipv6 && mtu > 0)
+        mtu -= PATH_MTU_IPV6_EXTRA_HEADER;
+
+    if (mtu > 0)
+        brls::Logger::info("PathMtu: {} MTU is {}", address, mtu);
+    return std::min(mtu, PATH_MTU_MAX);
+#else
+    return 0;
+#endif
+}
+
+bool PathMtu::is_private(const std::string& address) {
+    std::string literal = HostAddress::parse(address, 0).host;
+
+    // Unique local fc00::/7 and link local fe80::/10
+    in6_addr ip6;
+    if (inet_pton(AF_INET6, literal.c_str(), &ip6) == 1)
+        return (ip6.s6_addr[0] & 0xFE) == 0xFC || (ip6.s6_addr[0] == 0xFE && (ip6.s6_addr[1] & 0xC0) == 0x80);
+
+    in_addr ip;
+    if (inet_pton(AF_INET, literal.c_str(), &ip) != 1)
+        return false;
+
+    // Same ranges moonlight-common-c takes as local network
+    uint32_t host = ntohl(ip.s_addr);
+    return (host & 0xFF000000) == 0x0A000000 || // 10.0.0.0/8
+           (host & 0xFFF00000) == 0xAC100000 || // 172.16.0.0/12
+           (host & 0xFFFF0000) == 0xC0A80000 || // 192.168.0.0/16
+           (host & 0xFFFF0000) == 0xA9FE0000;   // 169.254.0.0/16
+}
+
+int PathMtu::packet_size(int mtu, bool local, bool sunshine) {
+    // GFE only takes sizes up to the default one
+    int max = !local ? PATH_MTU_REMOTE_PACKET : sunshine ? PATH_MTU_LOCAL_PACKET_MAX : PATH_MTU_DEFAULT_PACKET;
+    if (mtu <= 0)
+        return std::min(PATH_MTU_DEFAULT_PACKET, max);
+
+    // Multiple of 16 like the default, so encrypted blocks line up
+    int size = (mtu - PATH_MTU_OVERHEAD) & ~15;
+    return std::clamp(size, PATH_MTU_PACKET_MIN, max);
+}
@@ -0,0 +1,31 @@
+//
+//  PathMtu.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <string>
+
+// IP, UDP, RTP and video headers with encryption, 1500 MTU gives 1392
+#define PATH_MTU_OVERHEAD 108
+#define PATH_MTU_DEFAULT_PACKET 1392
+// moonlight-common-c size for remote streams, VPNs often go below 1500
+#define PATH_MTU_REMOTE_PACKET 1024
+// Jumbo frames pay off on LAN, but one lost packet takes more of frame
+#define PATH_MTU_LOCAL_PACKET_MAX 4096
+#define PATH_MTU_PACKET_MIN 512
+
+// Route MTU toward host, as kernel knows it from interface and ICMP
+// replies. Linux reports route MTU of connected socket without sending
+// anything, Apple platforms refuse don't fragment datagrams above it,
+// so it's found by a few datagrams to discard port. Others give 0
+class PathMtu {
+  public:
+    static int discover(const std::string& address);
+
+    static bool is_private(const std::string& address);
+
+    // Video packet size for stream, mtu of 0 keeps the default
+    static int packet_size(int mtu, bool local, bool sunshine);
+};
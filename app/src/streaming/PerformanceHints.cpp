@@ -0,0 +1,101 @@
+//
+//  PerformanceHints.cpp
+//  Moonlight
+//
+
+#include "PerformanceHints.hpp"
+
+#ifdef PLATFORM_ANDROID
+#include <SDL.h>
+#include <borealis.hpp>
+#include <dlfcn.h>
+#include <unistd.h>
+
+// Entry points of libandroid newer than minimum API level, 33+
+struct PerformanceHintApi {
+    void* (*get_manager)();
+    void* (*create_session)(void*, const int32_t*, size_t, int64_t);
+    int (*update_target)(void*, int64_t);
+    int (*report_actual)(void*, int64_t);
+    void (*close_session)(void*);
+};
+
+static const PerformanceHintApi* performance_hint() {
+    static PerformanceHintApi api;
+    static const PerformanceHintApi* loaded = []() -> const PerformanceHintApi* {
+        void* library = dlopen("libandroid.so", RTLD_NOW);
+        if (!library)
+            return nullptr;
+
+        api.get_manager = (decltype(api.get_manager))dlsym(library, "APerformanceHint_getManager");
+        api.create_session = (decltype(api.create_session))dlsym(library, "APerformanceHint_createSession");
+        api.update_target = (decltype(api.update_target))dlsym(library, "APerformanceHint_updateTargetWorkDuration");
+        api.report_actual = (decltype(api.report_actual))dlsym(library, "APerformanceHint_reportActualWorkDuration");
+        api.close_session = (decltype(api.close_session))dlsym(library, "APerformanceHint_closeSession");
+
+        if (!api.get_manager || !api.create_session || !api.update_target || !api.report_actual ||
+            !api.close_session) {
+            brls::Logger::warning("PerformanceHints: APerformanceHint isn't available");
+            return nullptr;
+        }
+        return &api;
+    }();
+    return loaded;
+}
+
+void PerformanceHints::start(int stream_fps) {
+    stop();
+
+    // Wi-Fi lock and window mode are Java side, activity runs them on its thread
+    SDL_AndroidSendMessage(PERF_ANDROID_COMMAND_STREAMING, 1);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_target_ns = 1000000000LL / (stream_fps > 0 ? stream_fps : 60);
+    if (const PerformanceHintApi* api = performance_hint())
+        m_manager = api->get_manager();
+    m_running = m_manager != nullptr;
+}
+
+void PerformanceHints::stop() {
+    SDL_AndroidSendMessage(PERF_ANDROID_COMMAND_STREAMING, 0);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_running = false;
+    for (int i = 0; i < PERF_HINT_COUNT; i++) {
+        if (m_sessions[i])
+            performance_hint()->close_session(m_sessions[i]);
+        m_sessions[i] = nullptr;
+        m_unsupported[i] = false;
+    }
+    m_manager = nullptr;
+}
+
+void PerformanceHints::report(PerfHintThread thread, uint64_t duration_us) {
+    if (!m_running.load(std::memory_order_relaxed))
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_running || m_unsupported[thread])
+        return;
+
+    const PerformanceHintApi* api = performance_hint();
+    if (!m_sessions[thread]) {
+        int32_t tid = gettid();
+        m_sessions[thread] = api->create_session(m_manager, &tid, 1, m_target_ns);
+        m_unsupported[thread] = m_sessions[thread] == nullptr;
+        brls::Logger::info("PerformanceHints: {} thread session {}",
+                           thread == PERF_HINT_DECODER ? "Decoder" : "Render",
+                           m_sessions[thread] ? "created" : "not supported");
+        if (!m_sessions[thread])
+            return;
+    }
+
+    api->report_actual(m_sessions[thread], (int64_t)duration_us * 1000);
+}
+#else
+void PerformanceHints::start(int stream_fps) {}
+
+void PerformanceHints::stop() {}
+
+void PerformanceHints::report(PerfHintThread thread, uint64_t duration_us) {}
+#endif
@@ -0,0 +1,44 @@
+//
+//  PerformanceHints.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Singleton.hpp"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+// SDL_AndroidSendMessage() command handled by activity, param is 1 while
+// stream is shown
+#define PERF_ANDROID_COMMAND_STREAMING (0x8000 + 1)
+
+enum PerfHintThread : int { PERF_HINT_DECODER, PERF_HINT_RENDER, PERF_HINT_COUNT };
+
+// Tells platform a stream is running, what Switch gets from wireless
+// priority mode. On Android activity holds a low latency Wi-Fi lock and
+// sustained performance mode while stream is shown, and decoder and
+// render threads have ADPF hint sessions, each reporting work time of a
+// frame against frame period, so governor doesn't downclock between
+// frames. No-op elsewhere
+class PerformanceHints : public Singleton<PerformanceHints> {
+  public:
+    // UI thread
+    void start(int stream_fps);
+    void stop();
+
+    // Thread doing work, its hint session is created on first report
+    void report(PerfHintThread thread, uint64_t duration_us);
+
+  private:
+#ifdef PLATFORM_ANDROID
+    std::mutex m_mutex;
+    std::atomic<bool> m_running = false;
+    void* m_manager = nullptr;
+    void* m_sessions[PERF_HINT_COUNT] = {};
+    // Thread failed to get session, it isn't asked again
+    bool m_unsupported[PERF_HINT_COUNT] = {};
+    int64_t m_target_ns = 0;
+#endif
+};
@@ -0,0 +1,105 @@
+//
+//  PipelineTuner.cpp
+//  Moonlight
+//
+
+#include "PipelineTuner.hpp"
+#include "HighResClock.hpp"
+#include <borealis.hpp>
+#include <algorithm>
+#include <cmath>
+
+void PipelineTuner::reset(int max_queue_size, int max_threads, int queue_size, int threads) {
+    *this = PipelineTuner();
+    m_max_queue_size = std::max(max_queue_size, 1);
+    m_max_threads = max_threads;
+    m_queue_size = queue_size;
+    m_threads = threads;
+}
+
+void PipelineTuner::restarted() {
+    if (m_done)
+        return;
+
+    m_start_us = 0;
+    m_windows = 0;
+    m_mean = 0;
+    m_m2 = 0;
+    m_draws = 0;
+}
+
+bool PipelineTuner::update(const VideoDecodeStats& stats, size_t reuses, size_t drops, float display_hz, int fps) {
+    if (m_done || fps <= 0)
+        return false;
+
+    uint64_t now = HighResClock::now_us();
+    if (m_start_us == 0)
+        m_start_us = now;
+    if (now - m_start_us < TUNE_WARMUP_US)
+        return false;
+
+    uint32_t decoded = stats.total_decoded_frames + stats.current_decoded_frames;
+    if (m_draws == 0) {
+        m_first_reuses = reuses;
+        m_first_drops = drops;
+        m_first_decoded = decoded;
+    }
+    m_draws++;
+    m_reuses = reuses;
+    m_drops = drops;
+    m_display_hz = display_hz;
+
+    // Cache is replaced once per stats window, it has new start time then
+    if (stats.measurement_start_timestamp_us != m_last_window) {
+        m_last_window = stats.measurement_start_timestamp_us;
+        double time = stats.current_decoding_time;
+        if (std::isfinite(time) && time > 0) {
+            m_windows++;
+            double delta = time - m_mean;
+            m_mean += delta / m_windows;
+            m_m2 += delta * (time - m_mean);
+        }
+    }
+
+    if (now - m_start_us < TUNE_WARMUP_US + TUNE_MEASURE_US || m_windows < 2)
+        return false;
+
+    finish(stats, fps);
+    m_done = true;
+    return true;
+}
+
+void PipelineTuner::finish(const VideoDecodeStats& stats, int fps) {
+    double interval = 1000.0 / fps;
+    double peak = m_mean + 2 * std::sqrt(m_m2 / (m_windows - 1));
+
+    uint32_t decoded = stats.total_decoded_frames + stats.current_decoded_frames - m_first_decoded;
+    float reuse_ratio = (float)(m_reuses - m_first_reuses) / (float)m_draws;
+    float drop_ratio = decoded == 0 ? 0 : (float)(m_drops - m_first_drops) / (float)decoded;
+    // Display faster than stream repeats frames by design
+    float expected_reuse = m_display_hz > fps ? 1 - fps / m_display_hz : 0;
+
+    // Frame which may take longer than interval needs one queued behind it
+    int queue_size = 1 + (int)(peak / interval);
+    if (reuse_ratio - expected_reuse > TUNE_REUSE_RATIO && drop_ratio <= TUNE_DROP_RATIO)
+        queue_size++;
+    m_result.frames_queue_size = std::min(queue_size, m_max_queue_size);
+
+    // Thread count of 0 is left for FFmpeg to pick, hardware has none
+    if (!stats.hw_decoding && m_threads >= 2 && m_max_threads >= 2) {
+        // Work splits between threads more or less evenly
+        double work = peak * m_threads;
+        m_result.decoder_threads = m_max_threads;
+        for (int threads = 2; threads < m_max_threads; threads++) {
+            if (work / threads <= interval * TUNE_DECODE_LOAD) {
+                m_result.decoder_threads = threads;
+                break;
+            }
+        }
+    }
+
+    brls::Logger::info("PipelineTuner: Decoding {:.2f} ms at peak, repeats {:.3f}, drops {:.3f}, "
+                       "queue {} -> {}, threads {} -> {}",
+                       peak, reuse_ratio, drop_ratio, m_queue_size, m_result.frames_queue_size,
+                       m_threads, m_result.decoder_threads);
+}
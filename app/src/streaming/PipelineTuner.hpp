@@ -0,0 +1,73 @@
+//
+//  PipelineTuner.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "IVideoDecoder.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// Start of stream is skipped, decoder and queue are still settling
+#define TUNE_WARMUP_US 2000000
+#define TUNE_MEASURE_US 10000000
+// Queue gets one more frame when renderer repeats frames this much more
+// often than display and stream rates explain
+#define TUNE_REUSE_RATIO 0.05f
+// Above this part of frames dropped from queue, repeats come from bursts
+// and deeper queue would only add latency
+#define TUNE_DROP_RATIO 0.02f
+// Share of frame interval decoding peaks may take with picked threads
+#define TUNE_DECODE_LOAD 0.8f
+
+// Picked queue depth and decoder threads, 0 means keep the setting
+struct PipelineTuning {
+    int frames_queue_size = 0;
+    int decoder_threads = 0;
+};
+
+// Measures first seconds of a session and picks the smallest frame queue
+// and decoder thread count that keep stream smooth. Every queued frame
+// and every frame thread adds a frame of latency, so settings only give
+// upper bounds. Result comes into effect with the next session
+class PipelineTuner {
+  public:
+    // Limits are user settings, current ones are what session runs with
+    void reset(int max_queue_size, int max_threads, int queue_size, int threads);
+
+    // Called every drawn frame, returns true once when result is ready
+    bool update(const VideoDecodeStats& stats, size_t reuses, size_t drops, float display_hz, int fps);
+
+    [[nodiscard]] PipelineTuning result() const { return m_result; }
+
+    // Counters of new connection start over, so does measurement
+    void restarted();
+
+  private:
+    void finish(const VideoDecodeStats& stats, int fps);
+
+    int m_max_queue_size = 0;
+    int m_max_threads = 0;
+    int m_queue_size = 0;
+    int m_threads = 0;
+
+    uint64_t m_start_us = 0;
+    bool m_done = false;
+    uint64_t m_last_window = 0;
+
+    // Decoding time of stats windows, Welford running variance
+    uint32_t m_windows = 0;
+    double m_mean = 0;
+    double m_m2 = 0;
+
+    uint32_t m_draws = 0;
+    size_t m_first_reuses = 0;
+    size_t m_first_drops = 0;
+    uint32_t m_first_decoded = 0;
+    size_t m_reuses = 0;
+    size_t m_drops = 0;
+    float m_display_hz = 0;
+
+    PipelineTuning m_result;
+};
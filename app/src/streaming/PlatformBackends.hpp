@@ -0,0 +1,38 @@
+//
+//  PlatformBackends.hpp
+//  Moonlight
+//
+
+#pragma once
+
+// Every backend the build has, for provider and for the places which
+// call PlatformPipeline.hpp stages
+#include "FFmpegVideoDecoder.hpp"
+#include "PlatformPipeline.hpp"
+#include "SDLAudiorenderer.hpp"
+
+#ifdef __SWITCH__
+#include "AudrenAudioRenderer.hpp"
+#endif
+
+#ifdef PLATFORM_ANDROID
+#include "AAudioRenderer.hpp"
+#endif
+
+#ifdef __APPLE__
+#include "AudioUnitAudioRenderer.hpp"
+#endif
+
+#ifdef __PSV__
+#include "VitaVideoDecoder.hpp"
+#endif
+
+#ifdef BOREALIS_USE_DEKO3D
+#include "DKVideoRenderer.hpp"
+#elif defined(USE_METAL_RENDERER)
+#include "MetalVideoRenderer.hpp"
+#elif defined(USE_GL_RENDERER)
+#include "GLVideoRenderer.hpp"
+#else
+#error No renderer selected, enable USE_GL_RENDERER or USE_METAL_RENDERER
+#endif
@@ -0,0 +1,62 @@
+//
+//  PlatformPipeline.hpp
+//  Moonlight
+//
+
+#pragma once
+
+// Backends build ends up with under default settings, renderer is the
+// only one most builds have. Only declared here, PlatformBackends.hpp
+// has their headers
+class FFmpegVideoDecoder;
+using PlatformVideoDecoder = FFmpegVideoDecoder;
+
+#if defined(BOREALIS_USE_DEKO3D)
+class DKVideoRenderer;
+using PlatformVideoRenderer = DKVideoRenderer;
+#elif defined(USE_METAL_RENDERER)
+class MetalVideoRenderer;
+using PlatformVideoRenderer = MetalVideoRenderer;
+#else
+class GLVideoRenderer;
+using PlatformVideoRenderer = GLVideoRenderer;
+#endif
+
+#if defined(PLATFORM_ANDROID)
+class AAudioRenderer;
+using PlatformAudioRenderer = AAudioRenderer;
+#elif defined(__APPLE__)
+class AudioUnitAudioRenderer;
+using PlatformAudioRenderer = AudioUnitAudioRenderer;
+#else
+class SDLAudioRenderer;
+using PlatformAudioRenderer = SDLAudioRenderer;
+#endif
+
+// Pipeline object behind its interface, typed as well when provider gave
+// exactly Static, which is final. Per frame and per packet calls go
+// through call(), generic lambda is instantiated for both pointers, so
+// one to Static is a direct call compiler can inline. Anything else
+// provider gives, wrappers and other backends, stays virtual
+template <typename Interface, typename Static> class PipelineStage {
+  public:
+    // Static has to be complete where stage is set
+    void set(Interface* object) {
+        m_object = object;
+        m_static = dynamic_cast<Static*>(object);
+    }
+
+    [[nodiscard]] Interface* get() const { return m_object; }
+    [[nodiscard]] bool is_static() const { return m_static != nullptr; }
+
+    // Static has to be complete where it's called
+    template <typename F> decltype(auto) call(F&& fn) const {
+        if (m_static)
+            return fn(m_static);
+        return fn(m_object);
+    }
+
+  private:
+    Interface* m_object = nullptr;
+    Static* m_static = nullptr;
+};
@@ -0,0 +1,115 @@
+//
+//  SessionRecorder.cpp
+//  Moonlight
+//
+
+#include "SessionRecorder.hpp"
+#include "HighResClock.hpp"
+#include <borealis.hpp>
+
+bool SessionRecorder::start(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_file)
+        return true;
+
+    m_file = fopen(path.c_str(), "wb");
+    if (!m_file) {
+        brls::Logger::error("SessionRecorder: Failed to open {}", path);
+        return false;
+    }
+
+    uint32_t header[2] = {SESSION_CAPTURE_MAGIC, SESSION_CAPTURE_VERSION};
+    fwrite(header, sizeof(header), 1, m_file);
+
+    m_start_us = HighResClock::now_us();
+    m_active = true;
+    brls::Logger::info("SessionRecorder: Recording into {}", path);
+    return true;
+}
+
+void SessionRecorder::stop() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_active = false;
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+void SessionRecorder::video_setup(int video_format, int width, int height, int fps) {
+    if (!m_active)
+        return;
+
+    SessionVideoSetup setup = {video_format, width, height, fps};
+    write(SESSION_EVENT_VIDEO_SETUP, &setup, sizeof(setup));
+}
+
+void SessionRecorder::video_unit(PDECODE_UNIT decode_unit) {
+    if (!m_active)
+        return;
+
+    SessionVideoUnit unit = {decode_unit->frameNumber, decode_unit->frameType};
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file)
+        return;
+
+    write_header(SESSION_EVENT_VIDEO_UNIT, sizeof(unit) + decode_unit->fullLength);
+    fwrite(&unit, sizeof(unit), 1, m_file);
+    for (PLENTRY entry = decode_unit->bufferList; entry != nullptr; entry = entry->next)
+        fwrite(entry->data, 1, entry->length, m_file);
+}
+
+void SessionRecorder::audio_config(int audio_configuration, const POPUS_MULTISTREAM_CONFIGURATION opus_config) {
+    if (!m_active)
+        return;
+
+    SessionAudioConfig config = {audio_configuration, *opus_config};
+    write(SESSION_EVENT_AUDIO_CONFIG, &config, sizeof(config));
+}
+
+void SessionRecorder::audio_packet(const char* data, int length) {
+    if (!m_active)
+        return;
+
+    write(SESSION_EVENT_AUDIO_PACKET, data, data ? (uint32_t)length : 0);
+}
+
+void SessionRecorder::connection_status(int status) {
+    if (!m_active)
+        return;
+
+    int32_t value = status;
+    write(SESSION_EVENT_CONNECTION_STATUS, &value, sizeof(value));
+}
+
+void SessionRecorder::hdr_mode(bool enabled) {
+    if (!m_active)
+        return;
+
+    int32_t value = enabled;
+    write(SESSION_EVENT_HDR_MODE, &value, sizeof(value));
+}
+
+void SessionRecorder::rumble(uint16_t controller, uint16_t low_freq, uint16_t high_freq) {
+    if (!m_active)
+        return;
+
+    SessionRumble rumble = {controller, low_freq, high_freq};
+    write(SESSION_EVENT_RUMBLE, &rumble, sizeof(rumble));
+}
+
+void SessionRecorder::write_header(uint32_t type, uint32_t length) {
+    SessionEventHeader header = {type, length, HighResClock::now_us() - m_start_us};
+    fwrite(&header, sizeof(header), 1, m_file);
+}
+
+void SessionRecorder::write(uint32_t type, const void* data, uint32_t length) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file)
+        return;
+
+    write_header(type, length);
+    if (length > 0)
+        fwrite(data, 1, length, m_file);
+}
@@ -0,0 +1,79 @@
+//
+//  SessionRecorder.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Singleton.hpp"
+#include <Limelight.h>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#define SESSION_CAPTURE_MAGIC 0x43534c4d // "MLSC"
+#define SESSION_CAPTURE_VERSION 1
+
+// Everything moonlight-common-c hands to the session, in arrival order
+enum SessionEventType : uint32_t {
+    SESSION_EVENT_VIDEO_SETUP = 1,
+    SESSION_EVENT_VIDEO_UNIT,
+    SESSION_EVENT_AUDIO_CONFIG,
+    SESSION_EVENT_AUDIO_PACKET,
+    SESSION_EVENT_CONNECTION_STATUS,
+    SESSION_EVENT_HDR_MODE,
+    SESSION_EVENT_RUMBLE,
+};
+
+struct SessionEventHeader {
+    uint32_t type;
+    uint32_t length;
+    // Since recording start
+    uint64_t time_us;
+};
+
+struct SessionVideoSetup {
+    int32_t video_format, width, height, fps;
+};
+
+// Followed by frame data
+struct SessionVideoUnit {
+    int32_t frame_number;
+    int32_t frame_type;
+};
+
+struct SessionAudioConfig {
+    int32_t audio_configuration;
+    OPUS_MULTISTREAM_CONFIGURATION opus_config;
+};
+
+struct SessionRumble {
+    uint16_t controller, low_freq, high_freq;
+};
+
+// Captures session for SessionReplay. Lost audio packets are recorded
+// too, as empty ones, so replay keeps host side losses
+class SessionRecorder : public Singleton<SessionRecorder> {
+  public:
+    bool start(const std::string& path);
+    void stop();
+    bool active() const { return m_active; }
+
+    void video_setup(int video_format, int width, int height, int fps);
+    void video_unit(PDECODE_UNIT decode_unit);
+    void audio_config(int audio_configuration, const POPUS_MULTISTREAM_CONFIGURATION opus_config);
+    void audio_packet(const char* data, int length);
+    void connection_status(int status);
+    void hdr_mode(bool enabled);
+    void rumble(uint16_t controller, uint16_t low_freq, uint16_t high_freq);
+
+  private:
+    void write_header(uint32_t type, uint32_t length);
+    void write(uint32_t type, const void* data, uint32_t length);
+
+    std::mutex m_mutex;
+    std::atomic<bool> m_active = false;
+    FILE* m_file = nullptr;
+    uint64_t m_start_us = 0;
+};
@@ -0,0 +1,211 @@
+//
+//  SessionReplay.cpp
+//  Moonlight
+//
+
+#include "SessionReplay.hpp"
+#include "HighResClock.hpp"
+#include "ThreadProfiler.hpp"
+#include <algorithm>
+#include <borealis.hpp>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+bool SessionReplay::load(const std::string& path) {
+    m_events.clear();
+    m_data.clear();
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        brls::Logger::error("SessionReplay: Failed to open {}", path);
+        return false;
+    }
+
+    uint32_t header[2];
+    if (fread(header, sizeof(header), 1, file) != 1 ||
+        header[0] != SESSION_CAPTURE_MAGIC || header[1] != SESSION_CAPTURE_VERSION) {
+        brls::Logger::error("SessionReplay: {} is not a session capture", path);
+        fclose(file);
+        return false;
+    }
+
+    SessionEventHeader event;
+    while (fread(&event, sizeof(event), 1, file) == 1) {
+        size_t offset = m_data.size();
+        m_data.resize(offset + event.length);
+        if (event.length > 0 && fread(m_data.data() + offset, 1, event.length, file) != event.length) {
+            // Recording was cut off, keep what's complete
+            m_data.resize(offset);
+            break;
+        }
+
+        if (event.type == SESSION_EVENT_VIDEO_SETUP && event.length >= sizeof(SessionVideoSetup))
+            m_video_format = ((SessionVideoSetup*)(m_data.data() + offset))->video_format;
+
+        m_events.push_back({event.type, event.time_us, offset, event.length});
+    }
+    fclose(file);
+
+    brls::Logger::info("SessionReplay: Loaded {} events", m_events.size());
+    return !m_events.empty();
+}
+
+void SessionReplay::start(IVideoDecoder* decoder, IAudioRenderer* audio,
+                          int loss_percent, int jitter_ms) {
+    if (m_running || m_events.empty())
+        return;
+
+    m_decoder = decoder;
+    m_audio = audio;
+    m_loss_percent = loss_percent;
+    m_jitter_ms = jitter_ms;
+    // Soak test starts it again once capture has gone through
+    m_finished = false;
+    m_running = true;
+    m_thread = std::thread(&SessionReplay::run, this);
+}
+
+void SessionReplay::stop() {
+    m_running = false;
+    if (m_thread.joinable())
+        m_thread.join();
+
+    if (m_video_ready) {
+        m_decoder->stop();
+        m_decoder->cleanup();
+        m_video_ready = false;
+    }
+
+    if (m_audio_ready) {
+        m_audio->stop();
+        m_audio->cleanup();
+        m_audio_ready = false;
+    }
+}
+
+void SessionReplay::run() {
+    ThreadProfileScope profile("Session replay");
+    std::mt19937 random(SESSION_REPLAY_SEED);
+    std::uniform_int_distribution<int> loss(0, 99);
+    std::uniform_int_distribution<int> jitter(0, m_jitter_ms * 1000);
+
+    uint64_t start = HighResClock::now_us();
+    // Packets come out of reassembly in order, jitter only delays them
+    uint64_t last_video_us = 0, last_audio_us = 0;
+
+    for (auto& event : m_events) {
+        if (!m_running)
+            break;
+
+        bool media = event.type == SESSION_EVENT_VIDEO_UNIT || event.type == SESSION_EVENT_AUDIO_PACKET;
+        uint64_t due = start + event.time_us;
+        bool lost = false;
+
+        if (media) {
+            auto& last = event.type == SESSION_EVENT_VIDEO_UNIT ? last_video_us : last_audio_us;
+            due = std::max(last, due + (m_jitter_ms > 0 ? jitter(random) : 0));
+            last = due;
+            lost = m_loss_percent > 0 && loss(random) < m_loss_percent;
+        }
+
+        uint64_t now = HighResClock::now_us();
+        if (due > now)
+            std::this_thread::sleep_for(std::chrono::microseconds(due - now));
+
+        dispatch(event, lost);
+    }
+
+    m_finished = true;
+}
+
+void SessionReplay::dispatch(const Event& event, bool lost) {
+    char* data = m_data.data() + event.offset;
+
+    switch (event.type) {
+    case SESSION_EVENT_VIDEO_SETUP: {
+        auto setup = (SessionVideoSetup*)data;
+        if (m_video_ready) {
+            m_decoder->stop();
+            m_decoder->cleanup();
+        }
+        m_video_ready = m_decoder->setup(setup->video_format, setup->width, setup->height,
+                                         setup->fps, nullptr, 0) == DR_OK;
+        if (m_video_ready)
+            m_decoder->start();
+        m_wait_idr = false;
+        break;
+    }
+    case SESSION_EVENT_VIDEO_UNIT: {
+        if (!m_video_ready)
+            break;
+
+        auto unit = (SessionVideoUnit*)data;
+        m_video_units++;
+
+        // Host would be asked for IDR, replay can only wait for next one
+        if (lost) {
+            m_video_lost++;
+            m_wait_idr = true;
+            break;
+        }
+        if (m_wait_idr && unit->frame_type != FRAME_TYPE_IDR) {
+            m_video_skipped++;
+            break;
+        }
+        m_wait_idr = false;
+
+        LENTRY entry = {};
+        entry.data = data + sizeof(SessionVideoUnit);
+        entry.length = (int)(event.length - sizeof(SessionVideoUnit));
+        entry.bufferType = BUFFER_TYPE_PICDATA;
+
+        DECODE_UNIT decode_unit = {};
+        decode_unit.frameNumber = unit->frame_number;
+        decode_unit.frameType = unit->frame_type;
+        decode_unit.receiveTimeMs = LiGetMillis();
+        decode_unit.fullLength = entry.length;
+        decode_unit.bufferList = &entry;
+        m_decoder->submit_decode_unit(&decode_unit);
+        break;
+    }
+    case SESSION_EVENT_AUDIO_CONFIG: {
+        auto config = (SessionAudioConfig*)data;
+        if (m_audio_ready) {
+            m_audio->stop();
+            m_audio->cleanup();
+        }
+        m_audio_ready = m_audio->init(config->audio_configuration, &config->opus_config,
+                                      nullptr, 0) == DR_OK;
+        if (m_audio_ready)
+            m_audio->start();
+        break;
+    }
+    case SESSION_EVENT_AUDIO_PACKET:
+        if (!m_audio_ready)
+            break;
+
+        m_audio_packets++;
+        if (lost)
+            m_audio_lost++;
+
+        // Lost packet goes in the same way moonlight-common-c reports it
+        if (lost || event.length == 0)
+            m_audio->decode_and_play_sample(nullptr, 0);
+        else
+            m_audio->decode_and_play_sample(data, (int)event.length);
+        m_audio->publish_stats();
+        break;
+    case SESSION_EVENT_CONNECTION_STATUS:
+        if (*(int32_t*)data == CONN_STATUS_POOR)
+            m_poor_status++;
+        break;
+    default:
+        break;
+    }
+}
+
+SessionReplayStats SessionReplay::stats() const {
+    return {m_finished, (uint32_t)m_events.size(), m_video_units, m_audio_packets,
+            m_video_lost, m_video_skipped, m_audio_lost, m_poor_status};
+}
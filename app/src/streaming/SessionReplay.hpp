@@ -0,0 +1,80 @@
+//
+//  SessionReplay.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "IAudioRenderer.hpp"
+#include "IVideoDecoder.hpp"
+#include "SessionRecorder.hpp"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Same seed every run, so impaired replays stay comparable
+#define SESSION_REPLAY_SEED 0x4d4c
+
+struct SessionReplayStats {
+    bool finished;
+    uint32_t events;
+    uint32_t video_units;
+    uint32_t audio_packets;
+    // Injected by replay, on top of losses recorded from host
+    uint32_t video_lost;
+    uint32_t video_skipped;
+    uint32_t audio_lost;
+    uint32_t poor_status;
+};
+
+// Plays SessionRecorder capture back into decoder and audio renderer
+// with original timing, optionally with extra loss and jitter
+class SessionReplay {
+  public:
+    ~SessionReplay() { stop(); }
+
+    bool load(const std::string& path);
+    int video_format() const { return m_video_format; }
+
+    void start(IVideoDecoder* decoder, IAudioRenderer* audio,
+               int loss_percent, int jitter_ms);
+    // Releases decoder and renderer, has to run on UI thread
+    void stop();
+
+    SessionReplayStats stats() const;
+
+  private:
+    struct Event {
+        uint32_t type;
+        uint64_t time_us;
+        size_t offset;
+        uint32_t length;
+    };
+
+    void run();
+    void dispatch(const Event& event, bool lost);
+
+    std::vector<Event> m_events;
+    std::vector<char> m_data;
+    int m_video_format = 0;
+
+    IVideoDecoder* m_decoder = nullptr;
+    IAudioRenderer* m_audio = nullptr;
+    bool m_video_ready = false;
+    bool m_audio_ready = false;
+    bool m_wait_idr = false;
+    int m_loss_percent = 0;
+    int m_jitter_ms = 0;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running = false;
+    std::atomic<bool> m_finished = false;
+
+    std::atomic<uint32_t> m_video_units = 0;
+    std::atomic<uint32_t> m_audio_packets = 0;
+    std::atomic<uint32_t> m_video_lost = 0;
+    std::atomic<uint32_t> m_video_skipped = 0;
+    std::atomic<uint32_t> m_audio_lost = 0;
+    std::atomic<uint32_t> m_poor_status = 0;
+};
@@ -0,0 +1,277 @@
+//
+//  SoakTest.cpp
+//  Moonlight
+//
+
+#include "SoakTest.hpp"
+#include "HighResClock.hpp"
+#include "Settings.hpp"
+#include "client.h"
+#include "errors.h"
+#include <Limelight.h>
+#include <borealis.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef __SWITCH__
+#include <switch.h>
+#endif
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <malloc/malloc.h>
+#elif !defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <dirent.h>
+#endif
+
+// Mock host app soak resumes, first one in its list
+#define SOAK_APP_ID 100000
+
+bool SoakTest::start(SessionReplay* replay, IVideoDecoder* decoder, IAudioRenderer* audio,
+                     int duration_min, int reconnects) {
+    stop();
+    if (!m_host.start({}))
+        return false;
+
+    m_replay = replay;
+    m_decoder = decoder;
+    m_audio = audio;
+    m_duration_us = (uint64_t)duration_min * 60 * 1000000;
+    m_target_reconnects = reconnects;
+    // Last reconnect still leaves an interval of stream to measure
+    m_reconnect_interval_us = m_duration_us / (reconnects + 1);
+    m_reconnects = 0;
+    m_baseline = 0;
+    m_samples.clear();
+
+    m_start_us = HighResClock::now_us();
+    m_next_reconnect_us = m_start_us + m_reconnect_interval_us;
+    m_next_sample_us = m_start_us;
+    m_finished = false;
+    m_running = true;
+
+    m_replay->start(m_decoder, m_audio, Settings::instance().replay_loss(), Settings::instance().replay_jitter());
+    brls::Logger::info("SoakTest: {} min with {} reconnects, one every {} s", duration_min, reconnects,
+                       m_reconnect_interval_us / 1000000);
+    return true;
+}
+
+void SoakTest::stop() {
+    if (!m_running)
+        return;
+
+    m_running = false;
+    m_replay->stop();
+    m_host.stop();
+}
+
+void SoakTest::update() {
+    if (!m_running || m_finished)
+        return;
+
+    // Capture is shorter than the run, it goes around with a new pipeline
+    if (m_replay->stats().finished) {
+        m_replay->stop();
+        m_replay->start(m_decoder, m_audio, Settings::instance().replay_loss(), Settings::instance().replay_jitter());
+    }
+
+    uint64_t now = HighResClock::now_us();
+    if (m_reconnects < m_target_reconnects && now >= m_next_reconnect_us)
+        reconnect();
+
+    if (now >= m_next_sample_us)
+        sample();
+
+    if (now - m_start_us >= m_duration_us) {
+        sample();
+        m_finished = true;
+        m_replay->stop();
+
+        auto result = report();
+        brls::Logger::info("SoakTest: {} after {} reconnects, heap {:+.1f} MB, process {:+.1f} MB, {:+} fds",
+                           result.passed ? "Passed" : "Failed", result.reconnects, result.heap_growth_mb,
+                           result.process_growth_mb, result.fd_growth);
+    }
+}
+
+void SoakTest::reconnect() {
+    m_replay->stop();
+
+    // Same host side handshake resume_connection() does, mock host is on
+    // loopback, so it doesn't hold UI thread for long
+    SERVER_DATA server;
+    if (gs_init(&server, m_host.address()) == GS_OK) {
+        STREAM_CONFIGURATION config;
+        LiInitializeStreamConfiguration(&config);
+        config.width = 1280;
+        config.height = 720;
+        config.fps = 60;
+        config.audioConfiguration = AUDIO_CONFIGURATION_STEREO;
+        server.currentGame = SOAK_APP_ID;
+        if (gs_start_app(&server, &config, SOAK_APP_ID, false, false, 1) != GS_OK)
+            brls::Logger::warning("SoakTest: Resume failed - {}", gs_error());
+        delete[] server.serverInfo.rtspSessionUrl;
+    } else {
+        brls::Logger::warning("SoakTest: Mock host didn't answer - {}", gs_error());
+    }
+
+    m_reconnects++;
+    m_next_reconnect_us += m_reconnect_interval_us;
+    m_replay->start(m_decoder, m_audio, Settings::instance().replay_loss(), Settings::instance().replay_jitter());
+
+    sample();
+    if (m_reconnects == SOAK_WARMUP_RECONNECTS)
+        m_baseline = m_samples.size() - 1;
+}
+
+void SoakTest::sample() {
+    uint64_t now = HighResClock::now_us();
+    m_next_sample_us = now + (uint64_t)SOAK_SAMPLE_INTERVAL_S * 1000000;
+
+    SoakSample sample;
+    sample.elapsed_s = (float)(now - m_start_us) / 1000000.0f;
+    sample.reconnects = m_reconnects;
+    sample.heap_kb = heap_kb();
+    sample.process_kb = process_kb();
+    sample.surface_mb = m_decoder->video_decode_stats().surface_memory_mb;
+    sample.fds = open_fds();
+    m_samples.push_back(sample);
+}
+
+SoakReport SoakTest::report() const {
+    SoakReport report = {};
+    report.finished = m_finished;
+    report.reconnects = m_reconnects;
+    report.samples = (uint32_t)m_samples.size();
+    if (m_samples.empty())
+        return report;
+
+    report.last = m_samples.back();
+    report.elapsed_s = report.last.elapsed_s;
+
+    const SoakSample& baseline = m_samples[m_baseline];
+    size_t tail = std::max(m_baseline, m_samples.size() - std::min(m_samples.size(), (size_t)SOAK_TAIL_SAMPLES));
+    SoakSample lowest = m_samples[tail];
+    for (size_t i = tail; i < m_samples.size(); i++) {
+        lowest.heap_kb = std::min(lowest.heap_kb, m_samples[i].heap_kb);
+        lowest.process_kb = std::min(lowest.process_kb, m_samples[i].process_kb);
+        lowest.fds = std::min(lowest.fds, m_samples[i].fds);
+    }
+
+    report.heap_growth_mb = ((float)lowest.heap_kb - (float)baseline.heap_kb) / 1024.0f;
+    report.process_growth_mb = ((float)lowest.process_kb - (float)baseline.process_kb) / 1024.0f;
+    report.fd_growth = lowest.fds - baseline.fds;
+    report.passed = m_finished && m_reconnects >= SOAK_WARMUP_RECONNECTS &&
+                    report.heap_growth_mb <= SOAK_HEAP_GROWTH_LIMIT_MB &&
+                    report.process_growth_mb <= SOAK_PROCESS_GROWTH_LIMIT_MB &&
+                    report.fd_growth <= SOAK_FD_GROWTH_LIMIT;
+    return report;
+}
+
+void SoakTest::save(const std::string& samples_path, const std::string& results_path,
+                    const std::string& platform) const {
+    if (FILE* file = fopen(samples_path.c_str(), "w")) {
+        fprintf(file, "elapsed_s,reconnects,heap_kb,process_kb,surface_mb,fds\n");
+        for (auto& sample : m_samples)
+            fprintf(file, "%.1f,%u,%llu,%llu,%.1f,%d\n", sample.elapsed_s, sample.reconnects,
+                    (unsigned long long)sample.heap_kb, (unsigned long long)sample.process_kb,
+                    sample.surface_mb, sample.fds);
+        fclose(file);
+    } else {
+        brls::Logger::error("SoakTest: Failed to open {}", samples_path);
+    }
+
+    bool exists = false;
+    if (FILE* file = fopen(results_path.c_str(), "r")) {
+        exists = true;
+        fclose(file);
+    }
+
+    FILE* file = fopen(results_path.c_str(), "a");
+    if (!file) {
+        brls::Logger::error("SoakTest: Failed to open {}", results_path);
+        return;
+    }
+
+    auto result = report();
+    if (!exists)
+        fprintf(file, "platform,elapsed_s,reconnects,heap_growth_mb,process_growth_mb,fd_growth,result\n");
+    fprintf(file, "%s,%.0f,%u,%.2f,%.2f,%d,%s\n", platform.c_str(), result.elapsed_s, result.reconnects,
+            result.heap_growth_mb, result.process_growth_mb, result.fd_growth, result.passed ? "pass" : "fail");
+    fclose(file);
+}
+
+uint64_t SoakTest::heap_kb() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks / 1024;
+#elif defined(__APPLE__)
+    return mstats().bytes_used / 1024;
+#elif defined(__SWITCH__) || defined(__vita__) || defined(__ANDROID__) || defined(__GLIBC__)
+    // Fields are int, fine below 2 GB
+    return (uint64_t)(unsigned int)mallinfo().uordblks / 1024;
+#else
+    return 0;
+#endif
+}
+
+uint64_t SoakTest::process_kb() {
+#if defined(__SWITCH__)
+    // Memory is unified, GPU command and image memory and nvdec surfaces
+    // are in it, usage below heap shows what renderer and decoder hold
+    u64 used = 0;
+    if (R_FAILED(svcGetInfo(&used, InfoType_UsedMemory, CUR_PROCESS_HANDLE, 0)))
+        return 0;
+    return used / 1024;
+#elif defined(__linux__)
+    unsigned long long size = 0, resident = 0;
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    bool read = fscanf(file, "%llu %llu", &size, &resident) == 2;
+    fclose(file);
+    return read ? resident * (uint64_t)sysconf(_SC_PAGESIZE) / 1024 : 0;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+        return 0;
+    return info.resident_size / 1024;
+#else
+    return 0;
+#endif
+}
+
+int SoakTest::open_fds() {
+#if defined(__linux__)
+    if (DIR* dir = opendir("/proc/self/fd")) {
+        int count = 0;
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] != '.')
+                count++;
+        }
+        closedir(dir);
+        // Directory being read has its own descriptor
+        return count - 1;
+    }
+#endif
+#ifndef _WIN32
+    int count = 0;
+    for (int fd = 0; fd < SOAK_FD_PROBE_MAX; fd++) {
+        if (fcntl(fd, F_GETFD) != -1)
+            count++;
+    }
+    return count;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,98 @@
+//
+//  SoakTest.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "IAudioRenderer.hpp"
+#include "IVideoDecoder.hpp"
+#include "MockHost.hpp"
+#include "SessionReplay.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Memory is sampled this often, and once more on every reconnect
+#define SOAK_SAMPLE_INTERVAL_S 30
+// First reconnect warms up pools and caches, growth is counted from it
+#define SOAK_WARMUP_RECONNECTS 1
+// Lowest of this many last samples is final usage, so a transient peak
+// at the end doesn't fail the run
+#define SOAK_TAIL_SAMPLES 4
+// Growth above these fails the run
+#define SOAK_HEAP_GROWTH_LIMIT_MB 16
+#define SOAK_PROCESS_GROWTH_LIMIT_MB 32
+#define SOAK_FD_GROWTH_LIMIT 4
+// Descriptors are counted by probing where there's no /proc/self/fd
+#define SOAK_FD_PROBE_MAX 1024
+
+struct SoakSample {
+    float elapsed_s;
+    uint32_t reconnects;
+    // Allocated by malloc, 0 where allocator can't tell
+    uint64_t heap_kb;
+    // Whole process, on Switch it includes GPU and decoder memory
+    uint64_t process_kb;
+    float surface_mb;
+    int fds;
+};
+
+struct SoakReport {
+    bool finished;
+    bool passed;
+    uint32_t reconnects;
+    uint32_t samples;
+    float elapsed_s;
+    // Final usage minus the one after warm-up
+    float heap_growth_mb;
+    float process_growth_mb;
+    int fd_growth;
+    SoakSample last;
+};
+
+// Hours long session replay, torn down and started again N times the
+// way a dropped stream is resumed: serverinfo and resume requests go to
+// a mock host, decoder and audio renderer are rebuilt. Memory and open
+// descriptors are sampled over time, growth above limits fails the run
+class SoakTest {
+  public:
+    ~SoakTest() { stop(); }
+
+    bool start(SessionReplay* replay, IVideoDecoder* decoder, IAudioRenderer* audio,
+               int duration_min, int reconnects);
+    void stop();
+
+    // UI thread, every frame, replay is only stopped there
+    void update();
+
+    [[nodiscard]] SoakReport report() const;
+    // Samples go to samples_path, one summary line is appended to results_path
+    void save(const std::string& samples_path, const std::string& results_path,
+              const std::string& platform) const;
+
+    static uint64_t heap_kb();
+    static uint64_t process_kb();
+    static int open_fds();
+
+  private:
+    void reconnect();
+    void sample();
+
+    SessionReplay* m_replay = nullptr;
+    IVideoDecoder* m_decoder = nullptr;
+    IAudioRenderer* m_audio = nullptr;
+    MockHost m_host;
+
+    bool m_running = false;
+    bool m_finished = false;
+    uint64_t m_start_us = 0;
+    uint64_t m_duration_us = 0;
+    uint64_t m_reconnect_interval_us = 0;
+    uint64_t m_next_reconnect_us = 0;
+    uint64_t m_next_sample_us = 0;
+    uint32_t m_reconnects = 0;
+    uint32_t m_target_reconnects = 0;
+    size_t m_baseline = 0;
+    std::vector<SoakSample> m_samples;
+};
@@ -0,0 +1,80 @@
+//
+//  SocketQos.cpp
+//  Moonlight
+//
+
+#include "SocketQos.hpp"
+#include <borealis.hpp>
+#include <atomic>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#ifdef __SWITCH__
+#include <switch.h>
+#endif
+
+static thread_local bool marking = false;
+static std::atomic<int> marked_sockets = 0;
+
+#ifdef SOCKET_QOS_WRAP
+extern "C" int __real_socket(int domain, int type, int protocol);
+
+extern "C" int __wrap_socket(int domain, int type, int protocol) {
+    int fd = __real_socket(domain, type, protocol);
+    if (fd >= 0 && marking)
+        SocketQos::mark(fd, domain, type);
+    return fd;
+}
+#endif
+
+SocketQos::Scope::Scope(bool enabled) : m_previous(marking) {
+    marked_sockets = 0;
+    marking = enabled;
+}
+
+SocketQos::Scope::~Scope() {
+    marking = m_previous;
+    if (marked_sockets > 0)
+        brls::Logger::info("SocketQos: Marked {} sockets with DSCP {}", marked_sockets.load(), SOCKET_QOS_DSCP);
+}
+
+void SocketQos::init(bool enabled) {
+#ifdef __SWITCH__
+    appletSetWirelessPriorityMode(enabled ? AppletWirelessPriorityMode_OptimizedForWlan
+                                          : AppletWirelessPriorityMode_Default);
+#endif
+    brls::Logger::info("SocketQos: Marking {}", !enabled ? "off" : supported() ? "on" : "not supported");
+}
+
+bool SocketQos::supported() {
+#ifdef SOCKET_QOS_WRAP
+    return true;
+#else
+    return false;
+#endif
+}
+
+int SocketQos::marked() { return marked_sockets; }
+
+void SocketQos::mark(int fd, int domain, int type) {
+    // Type can carry SOCK_NONBLOCK and SOCK_CLOEXEC flags above it. RTSP
+    // and other TCP sockets only carry setup, they are left alone
+    if ((type & 0xF) != SOCK_DGRAM)
+        return;
+
+    int tos = SOCKET_QOS_DSCP << 2;
+    int result = -1;
+    if (domain == AF_INET) {
+        result = setsockopt(fd, IPPROTO_IP, IP_TOS, (const char*)&tos, sizeof(tos));
+#ifdef IPV6_TCLASS
+    } else if (domain == AF_INET6) {
+        result = setsockopt(fd, IPPROTO_IPV6, IPV6_TCLASS, (const char*)&tos, sizeof(tos));
+        // Dual stack socket sends to IPv4 hosts with IPv4 header
+        setsockopt(fd, IPPROTO_IP, IP_TOS, (const char*)&tos, sizeof(tos));
+#endif
+    }
+
+    if (result == 0)
+        marked_sockets++;
+}
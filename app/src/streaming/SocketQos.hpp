@@ -0,0 +1,38 @@
+//
+//  SocketQos.hpp
+//  Moonlight
+//
+
+#pragma once
+
+// DSCP CS6, top three bits of it map to WMM voice access category on
+// Linux and most access points, EF would land in video one there
+#define SOCKET_QOS_DSCP 48
+
+// Marks UDP sockets moonlight-common-c creates for control, input and
+// stream, so input isn't queued behind bulk traffic on Wi-Fi uplink.
+// Library has no hook for its sockets, socket() is wrapped at link time
+// where linker can do it (SOCKET_QOS_WRAP), elsewhere nothing is marked
+class SocketQos {
+  public:
+    // Sockets created on this thread until scope ends are marked
+    class Scope {
+      public:
+        explicit Scope(bool enabled);
+        ~Scope();
+
+      private:
+        bool m_previous;
+    };
+
+    // Switch wireless priority mode goes along with the marking, so the
+    // option turns both off for comparison with latency probe
+    static void init(bool enabled);
+
+    [[nodiscard]] static bool supported();
+    // Sockets marked by last connection start
+    [[nodiscard]] static int marked();
+
+    // Called from socket() wrapper
+    static void mark(int fd, int domain, int type);
+};
@@ -0,0 +1,32 @@
+//
+//  StreamPercentiles.cpp
+//  Moonlight
+//
+
+#include "StreamPercentiles.hpp"
+
+void StreamPercentiles::reset() {
+    for (auto& histogram : m_histograms)
+        histogram.reset();
+}
+
+StreamStatSummary StreamPercentiles::summary(StreamStat stat) const {
+    const LogHistogram& histogram = m_histograms[stat];
+    return {histogram.count(), histogram.percentile_ms(0.5f), histogram.percentile_ms(0.95f),
+            histogram.percentile_ms(0.99f), histogram.max_ms()};
+}
+
+const char* StreamPercentiles::name(StreamStat stat) {
+    switch (stat) {
+        case STREAM_STAT_RECEIVE:
+            return "receive";
+        case STREAM_STAT_DECODE:
+            return "decode";
+        case STREAM_STAT_RENDER:
+            return "render";
+        case STREAM_STAT_AUDIO_DECODE:
+            return "audio_decode";
+        default:
+            return "unknown";
+    }
+}
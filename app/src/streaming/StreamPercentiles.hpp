@@ -0,0 +1,43 @@
+//
+//  StreamPercentiles.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "LogHistogram.hpp"
+#include "Singleton.hpp"
+
+// Per frame and per packet times percentiles are kept for
+enum StreamStat : int {
+    // Decode unit waiting from its last packet to decoder, network side
+    STREAM_STAT_RECEIVE,
+    STREAM_STAT_DECODE,
+    STREAM_STAT_RENDER,
+    STREAM_STAT_AUDIO_DECODE,
+    STREAM_STAT_COUNT
+};
+
+struct StreamStatSummary {
+    uint64_t count;
+    float p50_ms;
+    float p95_ms;
+    float p99_ms;
+    float max_ms;
+};
+
+// Session-long distributions next to windowed averages of stats, so a
+// spike averages hide still shows up at the end of hours long session.
+// Decoder, render and audio threads record, overlay and telemetry read
+class StreamPercentiles : public Singleton<StreamPercentiles> {
+  public:
+    // Session start
+    void reset();
+    void record(StreamStat stat, uint64_t time_us) { m_histograms[stat].record(time_us); }
+
+    [[nodiscard]] StreamStatSummary summary(StreamStat stat) const;
+    [[nodiscard]] static const char* name(StreamStat stat);
+
+  private:
+    LogHistogram m_histograms[STREAM_STAT_COUNT];
+};
@@ -0,0 +1,32 @@
+//
+//  StreamPipeline.cpp
+//  Moonlight
+//
+
+#include "StreamPipeline.hpp"
+#include "PlatformBackends.hpp"
+#include <borealis.hpp>
+
+StreamPipeline::StreamPipeline(MoonlightSessionDecoderAndRenderProvider* provider) {
+    m_video_decoder.set(provider->video_decoder());
+    m_video_renderer.set(provider->video_renderer());
+    m_audio_renderer.set(provider->audio_renderer());
+
+    if (m_video_decoder.get())
+        m_video_decoder.get()->set_frame_holder(&m_frames);
+    brls::Logger::debug("StreamPipeline: Static dispatch for decoder {}, renderer {}, audio {}",
+                        m_video_decoder.is_static(), m_video_renderer.is_static(),
+                        m_audio_renderer.is_static());
+}
+
+StreamPipeline::~StreamPipeline() {
+    delete m_video_decoder.get();
+    delete m_video_renderer.get();
+    delete m_audio_renderer.get();
+}
+
+IVideoRenderer* StreamPipeline::take_video_renderer() {
+    IVideoRenderer* renderer = m_video_renderer.get();
+    m_video_renderer.set(nullptr);
+    return renderer;
+}
@@ -0,0 +1,64 @@
+//
+//  StreamPipeline.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "AVFrameHolder.hpp"
+#include "MoonlightSessionDecoderAndRenderProvider.hpp"
+#include "PlatformPipeline.hpp"
+#include <atomic>
+
+struct SessionStats {
+    VideoDecodeStats video_decode_stats;
+    VideoRenderStats video_render_stats;
+    AudioRenderStats audio_render_stats;
+};
+
+// Per-session part of streaming: decoder and renderers from provider,
+// frame queue between them, stream format and stats. Nothing of it is
+// process-wide, so a new session's pipeline can be created while the
+// previous one still drains on teardown thread
+class StreamPipeline {
+  public:
+    explicit StreamPipeline(MoonlightSessionDecoderAndRenderProvider* provider);
+    ~StreamPipeline();
+
+    StreamPipeline(const StreamPipeline&) = delete;
+    StreamPipeline& operator=(const StreamPipeline&) = delete;
+
+    [[nodiscard]] IVideoDecoder* video_decoder() const { return m_video_decoder.get(); }
+    [[nodiscard]] IVideoRenderer* video_renderer() const { return m_video_renderer.get(); }
+    [[nodiscard]] IAudioRenderer* audio_renderer() const { return m_audio_renderer.get(); }
+
+    // Per unit, frame and packet paths, platform backends are called
+    // directly. Callers include PlatformBackends.hpp
+    using VideoDecoderStage = PipelineStage<IVideoDecoder, PlatformVideoDecoder>;
+    using VideoRendererStage = PipelineStage<IVideoRenderer, PlatformVideoRenderer>;
+    using AudioRendererStage = PipelineStage<IAudioRenderer, PlatformAudioRenderer>;
+    [[nodiscard]] const VideoDecoderStage& video_decoder_stage() const { return m_video_decoder; }
+    [[nodiscard]] const VideoRendererStage& video_renderer_stage() const { return m_video_renderer; }
+    [[nodiscard]] const AudioRendererStage& audio_renderer_stage() const { return m_audio_renderer; }
+
+    // Renderer owns GPU objects, teardown hands it back to UI thread
+    IVideoRenderer* take_video_renderer();
+
+    [[nodiscard]] AVFrameHolder& frames() { return m_frames; }
+    [[nodiscard]] const AVFrameHolder& frames() const { return m_frames; }
+
+    // Set from decoder setup callback, read by UI thread while drawing
+    void set_video_format(int video_format) { m_video_format = video_format; }
+    [[nodiscard]] int video_format() const { return m_video_format; }
+
+    [[nodiscard]] SessionStats& stats() { return m_stats; }
+
+  private:
+    VideoDecoderStage m_video_decoder;
+    VideoRendererStage m_video_renderer;
+    AudioRendererStage m_audio_renderer;
+
+    AVFrameHolder m_frames;
+    std::atomic<int> m_video_format = 0;
+    SessionStats m_stats = {};
+};
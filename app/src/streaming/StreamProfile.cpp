@@ -0,0 +1,64 @@
+//
+//  StreamProfile.cpp
+//  Moonlight
+//
+
+#include "StreamProfile.hpp"
+#include "Settings.hpp"
+#include <borealis.hpp>
+#include <cmath>
+
+#ifdef __SWITCH__
+#include <switch.h>
+#endif
+
+DisplayMode StreamProfiles::display_mode() {
+#ifdef __SWITCH__
+    return appletGetOperationMode() == AppletOperationMode_Console ? DISPLAY_MODE_DOCKED
+                                                                   : DISPLAY_MODE_HANDHELD;
+#else
+    return DISPLAY_MODE_WINDOW;
+#endif
+}
+
+void StreamProfiles::display_size(DisplayMode mode, int& width, int& height) {
+    switch (mode) {
+    case DISPLAY_MODE_HANDHELD:
+        width = 1280;
+        height = 720;
+        break;
+    case DISPLAY_MODE_DOCKED:
+        width = 1920;
+        height = 1080;
+        break;
+    case DISPLAY_MODE_WINDOW:
+        width = (int)brls::Application::windowWidth;
+        height = (int)brls::Application::windowHeight;
+        break;
+    }
+}
+
+StreamProfile StreamProfiles::select() {
+    StreamProfile profile;
+    profile.mode = display_mode();
+    profile.fps = Settings::instance().fps();
+
+    int display_width, display_height;
+    display_size(profile.mode, display_width, display_height);
+    if (display_width <= 0 || display_height <= 0) {
+        display_width = 1280;
+        display_height = 720;
+    }
+
+    int height = Settings::instance().resolution();
+    if (height == -1 || (Settings::instance().limit_to_display() && height > display_height)) {
+        profile.width = display_width;
+        profile.height = display_height;
+        return profile;
+    }
+
+    // Even width, 480p on 16:9 display becomes 854x480
+    profile.height = height;
+    profile.width = (int)std::lround((double)height * display_width / display_height / 2) * 2;
+    return profile;
+}
@@ -0,0 +1,36 @@
+//
+//  StreamProfile.hpp
+//  Moonlight
+//
+
+#pragma once
+
+// How often the display is checked during stream
+#define STREAM_PROFILE_CHECK_US 500000
+// Docking and window resizing settle before stream is switched
+#define STREAM_PROFILE_SETTLE_US 1500000
+
+enum DisplayMode { DISPLAY_MODE_WINDOW, DISPLAY_MODE_HANDHELD, DISPLAY_MODE_DOCKED };
+
+struct StreamProfile {
+    DisplayMode mode;
+    int width;
+    int height;
+    int fps;
+
+    bool same_stream(const StreamProfile& other) const {
+        return width == other.width && height == other.height && fps == other.fps;
+    }
+};
+
+// Picks stream size for the display it's shown on. Width follows display
+// aspect, so 16:10 panels aren't letterboxed, and with limit_to_display
+// stream never has more lines than display shows
+class StreamProfiles {
+  public:
+    static DisplayMode display_mode();
+    // Switch output is 720p in handheld and 1080p docked, others
+    // show stream in their window
+    static void display_size(DisplayMode mode, int& width, int& height);
+    static StreamProfile select();
+};
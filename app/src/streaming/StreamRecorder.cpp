@@ -0,0 +1,327 @@
+//
+//  StreamRecorder.cpp
+//  Moonlight
+//
+
+#include "StreamRecorder.hpp"
+#include "HighResClock.hpp"
+#include "ThreadProfiler.hpp"
+#include <borealis.hpp>
+#include <algorithm>
+#include <cstring>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+static AVCodecID video_codec_id(int video_format) {
+    if (video_format & VIDEO_FORMAT_MASK_H265)
+        return AV_CODEC_ID_HEVC;
+    if (video_format & VIDEO_FORMAT_MASK_AV1)
+        return AV_CODEC_ID_AV1;
+    return AV_CODEC_ID_H264;
+}
+
+static bool set_extradata(AVCodecParameters* par, const uint8_t* data, size_t length) {
+    par->extradata = (uint8_t*)av_mallocz(length + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!par->extradata)
+        return false;
+    memcpy(par->extradata, data, length);
+    par->extradata_size = (int)length;
+    return true;
+}
+
+// OpusHead of RFC 7845, containers need it to know stream layout
+static std::vector<uint8_t> opus_head(const OPUS_MULTISTREAM_CONFIGURATION& config) {
+    bool multistream = config.channelCount > 2;
+    std::vector<uint8_t> head = {'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, (uint8_t)config.channelCount};
+    // Pre-skip, host encoder starts without one
+    head.insert(head.end(), {0, 0});
+    uint32_t rate = (uint32_t)config.sampleRate;
+    head.insert(head.end(), {(uint8_t)rate, (uint8_t)(rate >> 8), (uint8_t)(rate >> 16), (uint8_t)(rate >> 24)});
+    // Output gain and mapping family
+    head.insert(head.end(), {0, 0, (uint8_t)(multistream ? 1 : 0)});
+    if (multistream) {
+        head.push_back((uint8_t)config.streams);
+        head.push_back((uint8_t)config.coupledStreams);
+        head.insert(head.end(), config.mapping, config.mapping + config.channelCount);
+    }
+    return head;
+}
+
+bool StreamRecorder::start(const std::string& path) {
+    if (m_active)
+        return true;
+
+    // Writer which gave up on its own is still joinable
+    if (m_writer.joinable())
+        m_writer.join();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_video_format) {
+            brls::Logger::error("StreamRecorder: Stream format is unknown yet");
+            return false;
+        }
+
+        m_path = path;
+        m_queue.clear();
+        m_queued_bytes = 0;
+        m_need_idr = true;
+        m_dropped = 0;
+    }
+
+    m_active = true;
+    m_writer = std::thread([this] { run(); });
+
+    // Recording can only begin with a key frame
+    LiRequestIdrFrame();
+    brls::Logger::info("StreamRecorder: Recording into {}", path);
+    return true;
+}
+
+void StreamRecorder::stop() {
+    m_active = false;
+    m_cond.notify_one();
+    if (m_writer.joinable())
+        m_writer.join();
+}
+
+void StreamRecorder::video_setup(int video_format, int width, int height, int fps) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_video_format = video_format;
+    m_width = width;
+    m_height = height;
+    m_fps = fps;
+}
+
+void StreamRecorder::audio_config(const POPUS_MULTISTREAM_CONFIGURATION opus_config) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_opus_config = *opus_config;
+    m_has_audio = true;
+}
+
+void StreamRecorder::video_unit(PDECODE_UNIT decode_unit) {
+    if (!m_active)
+        return;
+
+    Packet packet;
+    packet.video = true;
+    packet.key = decode_unit->frameType == FRAME_TYPE_IDR;
+    packet.time_us = HighResClock::now_us();
+    packet.header_length = 0;
+    packet.data.resize(decode_unit->fullLength);
+
+    size_t offset = 0;
+    bool header = true;
+    for (PLENTRY entry = decode_unit->bufferList; entry != nullptr; entry = entry->next) {
+        memcpy(packet.data.data() + offset, entry->data, entry->length);
+        offset += entry->length;
+
+        // SPS, PPS and VPS come in their own entries ahead of picture data
+        if (header && entry->bufferType != BUFFER_TYPE_PICDATA)
+            packet.header_length = offset;
+        else
+            header = false;
+    }
+
+    push(std::move(packet));
+}
+
+void StreamRecorder::audio_packet(const char* data, int length) {
+    // Lost packets come as empty ones, players conceal the gap
+    if (!m_active || !data || length <= 0)
+        return;
+
+    Packet packet;
+    packet.video = false;
+    packet.key = true;
+    packet.time_us = HighResClock::now_us();
+    packet.header_length = 0;
+    packet.data.assign((const uint8_t*)data, (const uint8_t*)data + length);
+
+    push(std::move(packet));
+}
+
+void StreamRecorder::push(Packet&& packet) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (packet.video) {
+            if (m_need_idr && !packet.key)
+                return;
+            m_need_idr = false;
+        }
+
+        // Whatever references dropped frame is useless too
+        if (m_queued_bytes + packet.data.size() > STREAM_RECORDER_QUEUE_BYTES) {
+            m_dropped++;
+            if (packet.video && !m_need_idr) {
+                m_need_idr = true;
+                LiRequestIdrFrame();
+            }
+            return;
+        }
+
+        m_queued_bytes += packet.data.size();
+        m_queue.push_back(std::move(packet));
+    }
+    m_cond.notify_one();
+}
+
+void StreamRecorder::run() {
+    ThreadProfileScope profile("Stream recorder");
+    while (true) {
+        Packet packet;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] { return !m_queue.empty() || !m_active; });
+            if (m_queue.empty())
+                break;
+
+            packet = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_queued_bytes -= packet.data.size();
+        }
+
+        if (!m_format) {
+            // Muxer starts with first key frame, audio before it is skipped
+            if (!packet.video)
+                continue;
+            if (!open_muxer(packet)) {
+                m_active = false;
+                break;
+            }
+        }
+
+        write(packet);
+    }
+
+    close_muxer();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.clear();
+    m_queued_bytes = 0;
+    if (m_dropped)
+        brls::Logger::warning("StreamRecorder: Dropped {} packets, storage is too slow", m_dropped);
+}
+
+bool StreamRecorder::open_muxer(const Packet& first) {
+    int video_format, width, height, fps;
+    OPUS_MULTISTREAM_CONFIGURATION opus_config;
+    bool has_audio;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        video_format = m_video_format;
+        width = m_width;
+        height = m_height;
+        fps = m_fps;
+        opus_config = m_opus_config;
+        has_audio = m_has_audio;
+    }
+
+    // Unknown extension is recorded as Matroska
+    if (avformat_alloc_output_context2(&m_format, nullptr, nullptr, m_path.c_str()) < 0 &&
+        avformat_alloc_output_context2(&m_format, nullptr, "matroska", m_path.c_str()) < 0) {
+        brls::Logger::error("StreamRecorder: Couldn't create muxer");
+        return false;
+    }
+
+    m_video_stream = avformat_new_stream(m_format, nullptr);
+    AVCodecParameters* video = m_video_stream->codecpar;
+    video->codec_type = AVMEDIA_TYPE_VIDEO;
+    video->codec_id = video_codec_id(video_format);
+    video->width = width;
+    video->height = height;
+    m_video_stream->time_base = {1, 1000000};
+    m_video_stream->avg_frame_rate = {fps, 1};
+
+    // Parameter sets are Annex-B, muxers convert packets to length
+    // prefixed NAL units after them. AV1 key frame carries sequence header
+    size_t header_length = video->codec_id == AV_CODEC_ID_AV1 ? first.data.size() : first.header_length;
+    if (header_length && !set_extradata(video, first.data.data(), header_length)) {
+        close_muxer();
+        return false;
+    }
+
+    if (has_audio) {
+        m_audio_stream = avformat_new_stream(m_format, nullptr);
+        AVCodecParameters* audio = m_audio_stream->codecpar;
+        audio->codec_type = AVMEDIA_TYPE_AUDIO;
+        audio->codec_id = AV_CODEC_ID_OPUS;
+        audio->sample_rate = opus_config.sampleRate;
+        av_channel_layout_default(&audio->ch_layout, opus_config.channelCount);
+        m_audio_stream->time_base = {1, 1000000};
+
+        auto head = opus_head(opus_config);
+        if (!set_extradata(audio, head.data(), head.size())) {
+            close_muxer();
+            return false;
+        }
+    }
+
+    int err;
+    if ((err = avio_open(&m_format->pb, m_path.c_str(), AVIO_FLAG_WRITE)) < 0 ||
+        (err = avformat_write_header(m_format, nullptr)) < 0) {
+        char error[AV_ERROR_MAX_STRING_SIZE] = {0};
+        brls::Logger::error("StreamRecorder: Couldn't start {}: {}", m_path,
+                            av_make_error_string(error, AV_ERROR_MAX_STRING_SIZE, err));
+        // Nothing to finish without header
+        if (m_format->pb)
+            avio_closep(&m_format->pb);
+        close_muxer();
+        return false;
+    }
+
+    m_start_us = first.time_us;
+    m_last_pts[0] = m_last_pts[1] = -1;
+    return true;
+}
+
+void StreamRecorder::write(const Packet& packet) {
+    AVStream* stream = packet.video ? m_video_stream : m_audio_stream;
+    if (!stream || packet.time_us < m_start_us)
+        return;
+
+    // Arrival time of both streams comes from one clock, so they stay
+    // in sync. Stream is low latency, decode order is display order
+    int64_t& last_pts = m_last_pts[packet.video ? 0 : 1];
+    int64_t pts = std::max<int64_t>(packet.time_us - m_start_us, last_pts + 1);
+    last_pts = pts;
+
+    AVPacket* av_packet = av_packet_alloc();
+    if (!av_packet)
+        return;
+
+    av_packet->data = (uint8_t*)packet.data.data();
+    av_packet->size = (int)packet.data.size();
+    av_packet->stream_index = stream->index;
+    av_packet->pts = av_packet->dts = pts;
+    if (packet.key)
+        av_packet->flags |= AV_PKT_FLAG_KEY;
+    av_packet_rescale_ts(av_packet, {1, 1000000}, stream->time_base);
+
+    // Packet isn't ref counted, so muxer copies what it keeps for interleaving
+    int err = av_interleaved_write_frame(m_format, av_packet);
+    if (err < 0) {
+        char error[AV_ERROR_MAX_STRING_SIZE] = {0};
+        brls::Logger::warning("StreamRecorder: Couldn't write packet: {}",
+                              av_make_error_string(error, AV_ERROR_MAX_STRING_SIZE, err));
+    }
+    av_packet_free(&av_packet);
+}
+
+void StreamRecorder::close_muxer() {
+    if (!m_format)
+        return;
+
+    if (m_format->pb) {
+        av_write_trailer(m_format);
+        avio_closep(&m_format->pb);
+        brls::Logger::info("StreamRecorder: Saved {}", m_path);
+    }
+
+    avformat_free_context(m_format);
+    m_format = nullptr;
+    m_video_stream = nullptr;
+    m_audio_stream = nullptr;
+}
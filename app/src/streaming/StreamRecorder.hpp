@@ -0,0 +1,85 @@
+//
+//  StreamRecorder.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Singleton.hpp"
+#include <Limelight.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Packets waiting for writer above this are dropped,
+// video continues from next IDR frame then
+#define STREAM_RECORDER_QUEUE_BYTES (32 * 1024 * 1024)
+
+struct AVFormatContext;
+struct AVStream;
+
+// Highlight recording of the stream as host sent it. Bitstreams are
+// muxed into MKV or MP4 without decoding or encoding them again.
+// Network threads only copy packets into a bounded queue, writer thread
+// owns the muxer and file, so a slow SD card never stalls the stream
+class StreamRecorder : public Singleton<StreamRecorder> {
+  public:
+    // Container is picked from path extension
+    bool start(const std::string& path);
+    void stop();
+    [[nodiscard]] bool active() const { return m_active; }
+
+    // Stream format is kept whether recording or not,
+    // recording usually starts in the middle of session
+    void video_setup(int video_format, int width, int height, int fps);
+    void audio_config(const POPUS_MULTISTREAM_CONFIGURATION opus_config);
+
+    void video_unit(PDECODE_UNIT decode_unit);
+    void audio_packet(const char* data, int length);
+
+  private:
+    struct Packet {
+        bool video;
+        bool key;
+        uint64_t time_us;
+        // Leading parameter sets of IDR frame, they become codec extradata
+        size_t header_length;
+        std::vector<uint8_t> data;
+    };
+
+    void push(Packet&& packet);
+    void run();
+    bool open_muxer(const Packet& first);
+    void write(const Packet& packet);
+    void close_muxer();
+
+    std::atomic<bool> m_active = false;
+    std::string m_path;
+    std::thread m_writer;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<Packet> m_queue;
+    size_t m_queued_bytes = 0;
+    bool m_need_idr = true;
+    uint32_t m_dropped = 0;
+
+    int m_video_format = 0;
+    int m_width = 0;
+    int m_height = 0;
+    int m_fps = 0;
+    OPUS_MULTISTREAM_CONFIGURATION m_opus_config = {};
+    bool m_has_audio = false;
+
+    // Writer thread only
+    AVFormatContext* m_format = nullptr;
+    AVStream* m_video_stream = nullptr;
+    AVStream* m_audio_stream = nullptr;
+    uint64_t m_start_us = 0;
+    int64_t m_last_pts[2] = {-1, -1};
+};
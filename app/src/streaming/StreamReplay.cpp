@@ -0,0 +1,220 @@
+//
+//  StreamReplay.cpp
+//  Moonlight
+//
+
+#include "StreamReplay.hpp"
+#include "AVFrameHolder.hpp"
+#include "HighResClock.hpp"
+#include "ThreadProfiler.hpp"
+#include <algorithm>
+#include <borealis.hpp>
+#include <chrono>
+#include <cstdio>
+
+static float percentile(const std::vector<float>& sorted, float p) {
+    if (sorted.empty())
+        return 0;
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * (float)sorted.size()))];
+}
+
+bool StreamReplay::load(const std::string& path) {
+    m_path = path;
+    m_frames.clear();
+    m_frame_index.clear();
+
+    FILE* index = fopen((path + ".csv").c_str(), "r");
+    if (!index) {
+        brls::Logger::error("StreamReplay: Failed to open {}.csv", path);
+        return false;
+    }
+
+    char line[256];
+    bool valid = fgets(line, sizeof(line), index) &&
+                 fscanf(index, "%d,%d,%d,%d\n", &m_video_format, &m_width, &m_height, &m_fps) == 4 &&
+                 fgets(line, sizeof(line), index);
+
+    ReplayFrame frame;
+    unsigned long long receive_ms, offset;
+    while (valid && fscanf(index, "%u,%d,%llu,%llu,%d\n", &frame.frame_number, &frame.frame_type,
+                           &receive_ms, &offset, &frame.length) == 5) {
+        frame.receive_ms = receive_ms;
+        frame.offset = offset;
+        m_frame_index[frame.frame_number] = m_frames.size();
+        m_frames.push_back(frame);
+    }
+    fclose(index);
+
+    FILE* stream = fopen((path + ".bin").c_str(), "rb");
+    if (!valid || m_frames.empty() || !stream) {
+        brls::Logger::error("StreamReplay: Nothing to replay in {}", path);
+        if (stream)
+            fclose(stream);
+        return false;
+    }
+
+    // Whole stream stays in memory, disk reads would end up in timings
+    auto& last = m_frames.back();
+    m_stream.resize(last.offset + last.length);
+    size_t read = fread(m_stream.data(), 1, m_stream.size(), stream);
+    fclose(stream);
+
+    if (read != m_stream.size()) {
+        brls::Logger::error("StreamReplay: {}.bin is shorter than its index", path);
+        return false;
+    }
+
+    brls::Logger::info("StreamReplay: Loaded {} frames, {}x{} at {} fps",
+                       m_frames.size(), m_width, m_height, m_fps);
+    return true;
+}
+
+bool StreamReplay::start(IVideoDecoder* decoder, AVFrameHolder* frames, bool as_recorded) {
+    if (m_frames.empty() || m_running)
+        return false;
+
+    if (decoder->setup(m_video_format, m_width, m_height, m_fps, nullptr, 0) != DR_OK) {
+        brls::Logger::error("StreamReplay: Decoder setup failed");
+        return false;
+    }
+    decoder->start();
+
+    m_decoder = decoder;
+    m_holder = frames;
+    m_as_recorded = as_recorded;
+    m_submit_us.assign(m_frames.size(), 0);
+    m_latencies_ms.clear();
+    m_latencies_ms.reserve(m_frames.size());
+    m_submitted = 0;
+    m_drawn = 0;
+    m_start_us = HighResClock::now_us();
+    m_last_draw_us = m_start_us;
+    m_finished = false;
+    m_running = true;
+    m_thread = std::thread(&StreamReplay::run, this);
+    return true;
+}
+
+void StreamReplay::stop() {
+    m_running = false;
+    if (m_thread.joinable())
+        m_thread.join();
+
+    if (m_decoder) {
+        m_decoder->stop();
+        m_decoder->cleanup();
+        m_decoder = nullptr;
+    }
+}
+
+void StreamReplay::run() {
+    ThreadProfileScope profile("Stream replay");
+    int pushed_base = m_holder->getStat();
+    uint64_t first_receive_ms = m_frames.front().receive_ms;
+
+    for (size_t i = 0; i < m_frames.size() && m_running; i++) {
+        auto& frame = m_frames[i];
+
+        if (m_as_recorded) {
+            uint64_t target = m_start_us + (frame.receive_ms - first_receive_ms) * 1000;
+            uint64_t now = HighResClock::now_us();
+            if (target > now)
+                std::this_thread::sleep_for(std::chrono::microseconds(target - now));
+        } else {
+            uint64_t wait_start = HighResClock::now_us();
+            while (m_running && (int)i - (m_holder->getStat() - pushed_base) >= REPLAY_MAX_IN_FLIGHT &&
+                   HighResClock::now_us() - wait_start < REPLAY_WAIT_TIMEOUT_US)
+                std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+
+        LENTRY entry = {};
+        entry.data = m_stream.data() + frame.offset;
+        entry.length = frame.length;
+        entry.bufferType = BUFFER_TYPE_PICDATA;
+
+        DECODE_UNIT unit = {};
+        unit.frameNumber = (int)frame.frame_number;
+        unit.frameType = frame.frame_type;
+        unit.receiveTimeMs = LiGetMillis();
+        unit.fullLength = frame.length;
+        unit.bufferList = &entry;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_submit_us[i] = HighResClock::now_us();
+            m_submitted++;
+        }
+        m_decoder->submit_decode_unit(&unit);
+    }
+
+    m_finished = true;
+}
+
+void StreamReplay::frame_drawn(uint32_t frame_number) {
+    auto it = m_frame_index.find(frame_number);
+    if (it == m_frame_index.end())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t& submitted = m_submit_us[it->second];
+    if (submitted == 0)
+        return;
+
+    // Same frame is drawn again when next one is late, count it once
+    m_last_draw_us = HighResClock::now_us();
+    m_latencies_ms.push_back((float)(m_last_draw_us - submitted) / 1000.0f);
+    submitted = 0;
+    m_drawn++;
+}
+
+ReplaySummary StreamReplay::summary() {
+    std::vector<float> latencies;
+    ReplaySummary summary = {};
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        latencies = m_latencies_ms;
+        summary.submitted = m_submitted;
+        summary.drawn = m_drawn;
+        summary.elapsed_s = (float)(m_last_draw_us - m_start_us) / 1000000.0f;
+    }
+    summary.finished = m_finished;
+    summary.frames = (uint32_t)m_frames.size();
+
+    if (summary.elapsed_s > 0) {
+        summary.submit_fps = (float)summary.submitted / summary.elapsed_s;
+        summary.draw_fps = (float)summary.drawn / summary.elapsed_s;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    summary.p50_ms = percentile(latencies, 0.5f);
+    summary.p95_ms = percentile(latencies, 0.95f);
+    summary.p99_ms = percentile(latencies, 0.99f);
+    summary.max_ms = latencies.empty() ? 0 : latencies.back();
+    return summary;
+}
+
+void StreamReplay::save_results(const std::string& platform) {
+    std::string path = m_path + "_results.csv";
+    bool exists = false;
+    if (FILE* file = fopen(path.c_str(), "r")) {
+        exists = true;
+        fclose(file);
+    }
+
+    FILE* file = fopen(path.c_str(), "a");
+    if (!file) {
+        brls::Logger::error("StreamReplay: Failed to open {}", path);
+        return;
+    }
+
+    auto result = summary();
+    if (!exists)
+        fprintf(file, "platform,mode,frames,drawn,elapsed_s,draw_fps,p50_ms,p95_ms,p99_ms,max_ms\n");
+    fprintf(file, "%s,%s,%u,%u,%.3f,%.2f,%.3f,%.3f,%.3f,%.3f\n", platform.c_str(),
+            m_as_recorded ? "recorded" : "full", result.frames, result.drawn, result.elapsed_s,
+            result.draw_fps, result.p50_ms, result.p95_ms, result.p99_ms, result.max_ms);
+    fclose(file);
+
+    brls::Logger::info("StreamReplay: {} frames drawn at {:.2f} fps, latency p50 {:.2f} | p99 {:.2f} ms",
+                       result.drawn, result.draw_fps, result.p50_ms, result.p99_ms);
+}
@@ -0,0 +1,93 @@
+//
+//  StreamReplay.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "AVFrameHolder.hpp"
+#include "IVideoDecoder.hpp"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// At full speed next frame waits till decoder gave out previous ones,
+// decode queue would drop frames otherwise
+#define REPLAY_MAX_IN_FLIGHT 2
+#define REPLAY_WAIT_TIMEOUT_US 100000
+
+struct ReplayFrame {
+    uint32_t frame_number;
+    int frame_type;
+    uint64_t receive_ms;
+    uint64_t offset;
+    int length;
+};
+
+struct ReplaySummary {
+    bool finished;
+    uint32_t frames;
+    uint32_t submitted;
+    uint32_t drawn;
+    float elapsed_s;
+    float submit_fps;
+    float draw_fps;
+    // Decode submit to draw done
+    float p50_ms;
+    float p95_ms;
+    float p99_ms;
+    float max_ms;
+};
+
+// Feeds stream recorded by DebugFileRecorderVideoDecoder into decoder,
+// frames go to given AVFrameHolder the same way as in live session
+class StreamReplay {
+  public:
+    ~StreamReplay() { stop(); }
+
+    bool load(const std::string& path);
+    int video_format() const { return m_video_format; }
+
+    // As recorded keeps original frame intervals, otherwise it's as fast
+    // as decoder goes
+    bool start(IVideoDecoder* decoder, AVFrameHolder* frames, bool as_recorded);
+    // Releases decoder, has to run on UI thread as frames go away with it
+    void stop();
+
+    // UI thread, right after frame was drawn
+    void frame_drawn(uint32_t frame_number);
+
+    ReplaySummary summary();
+    // Appends summary line to <path>_results.csv
+    void save_results(const std::string& platform);
+
+  private:
+    void run();
+
+    std::string m_path;
+    std::vector<ReplayFrame> m_frames;
+    std::vector<char> m_stream;
+    std::unordered_map<uint32_t, size_t> m_frame_index;
+    int m_video_format = 0;
+    int m_width = 0;
+    int m_height = 0;
+    int m_fps = 0;
+
+    IVideoDecoder* m_decoder = nullptr;
+    AVFrameHolder* m_holder = nullptr;
+    bool m_as_recorded = false;
+    std::thread m_thread;
+    std::atomic<bool> m_running = false;
+    std::atomic<bool> m_finished = false;
+
+    std::mutex m_mutex;
+    std::vector<uint64_t> m_submit_us;
+    std::vector<float> m_latencies_ms;
+    uint32_t m_submitted = 0;
+    uint32_t m_drawn = 0;
+    uint64_t m_start_us = 0;
+    uint64_t m_last_draw_us = 0;
+};
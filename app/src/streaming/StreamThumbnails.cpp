@@ -0,0 +1,58 @@
+//
+//  StreamThumbnails.cpp
+//  Moonlight
+//
+
+#include "StreamThumbnails.hpp"
+#include "FrameCapture.hpp"
+#include <borealis.hpp>
+#include <nanovg.h>
+
+void StreamThumbnails::capture(const BoxArtId& id, const AVFrame* frame) {
+    if (!frame)
+        return;
+
+    AVFrame* clone = av_frame_clone(frame);
+    if (!clone) {
+        brls::Logger::error("StreamThumbnails: Couldn't reference frame");
+        return;
+    }
+
+    uint64_t sequence = ++m_sequence;
+    m_thumbnails[id.host].sequence = sequence;
+
+    // Task has to be copyable, thumbnail() takes ownership of the clone
+    brls::async([this, id, clone, sequence] {
+        std::vector<unsigned char> pixels(STREAM_THUMBNAIL_WIDTH * STREAM_THUMBNAIL_HEIGHT * 4);
+        if (!FrameCapture::thumbnail(clone, STREAM_THUMBNAIL_WIDTH, STREAM_THUMBNAIL_HEIGHT, pixels.data()))
+            return;
+
+        brls::sync([this, id, sequence, pixels] {
+            Thumbnail& thumbnail = m_thumbnails[id.host];
+            if (thumbnail.sequence != sequence)
+                return;
+
+            NVGcontext* vg = brls::Application::getNVGContext();
+            if (thumbnail.handle > 0 && vg)
+                nvgDeleteImage(vg, thumbnail.handle);
+            thumbnail.handle = -1;
+            thumbnail.app_id = id.app_id;
+            thumbnail.pixels = pixels;
+        });
+    });
+}
+
+int StreamThumbnails::texture(NVGcontext* vg, const BoxArtId& id) {
+    auto found = m_thumbnails.find(id.host);
+    if (found == m_thumbnails.end() || found->second.app_id != id.app_id)
+        return -1;
+
+    // Uploaded on first draw, pixels aren't needed after that
+    Thumbnail& thumbnail = found->second;
+    if (thumbnail.handle <= 0 && !thumbnail.pixels.empty()) {
+        thumbnail.handle = nvgCreateImageRGBA(vg, STREAM_THUMBNAIL_WIDTH, STREAM_THUMBNAIL_HEIGHT,
+                                              0, thumbnail.pixels.data());
+        std::vector<unsigned char>().swap(thumbnail.pixels);
+    }
+    return thumbnail.handle;
+}
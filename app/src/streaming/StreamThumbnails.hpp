@@ -0,0 +1,45 @@
+//
+//  StreamThumbnails.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "BoxArtManager.hpp"
+#include "Singleton.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Size of preview, 16:9 at box art width of 2x scale
+#define STREAM_THUMBNAIL_WIDTH 300
+#define STREAM_THUMBNAIL_HEIGHT 168
+
+// Last frame of the game running on host, kept when its stream ends or
+// goes to background, so tile of that app shows where it was left. Frame
+// which was shown anyway is referenced, copy and downscale go to worker,
+// renderer does no extra work. One preview per host, in memory only
+class StreamThumbnails : public Singleton<StreamThumbnails> {
+  public:
+    // UI thread, frame is referenced, not copied
+    void capture(const BoxArtId& id, const AVFrame* frame);
+
+    // UI thread, texture of app's preview or -1 without one
+    int texture(NVGcontext* vg, const BoxArtId& id);
+
+  private:
+    struct Thumbnail {
+        int app_id = 0;
+        // Results of older captures still on worker are dropped
+        uint64_t sequence = 0;
+        std::vector<unsigned char> pixels;
+        int handle = -1;
+    };
+
+    std::map<std::string, Thumbnail> m_thumbnails;
+    uint64_t m_sequence = 0;
+};
@@ -0,0 +1,201 @@
+//
+//  TelemetryRecorder.cpp
+//  Moonlight
+//
+
+#include "TelemetryRecorder.hpp"
+#include "AVFrameHolder.hpp"
+#include "HighResClock.hpp"
+#include "MemoryAccounting.hpp"
+#include "StreamPercentiles.hpp"
+#include "ThreadProfiler.hpp"
+#include <borealis.hpp>
+#include <ctime>
+#include <jansson.h>
+
+static const char* video_format_name(int video_format) {
+    switch (video_format) {
+        case VIDEO_FORMAT_H264:
+            return "H264";
+        case VIDEO_FORMAT_H265:
+            return "HEVC";
+        case VIDEO_FORMAT_H265_MAIN10:
+            return "HEVC Main10";
+        case VIDEO_FORMAT_AV1_MAIN8:
+            return "AV1";
+        case VIDEO_FORMAT_AV1_MAIN10:
+            return "AV1 Main10";
+        default:
+            return "Unknown";
+    }
+}
+
+void TelemetryRecorder::start(const std::string& path, const TelemetrySession& session) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_file)
+        fclose(m_file);
+
+    if (FILE* file = fopen(path.c_str(), "r")) {
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fclose(file);
+
+        if (size > TELEMETRY_FILE_MAX_BYTES) {
+            std::string previous = path + ".1";
+            remove(previous.c_str());
+            rename(path.c_str(), previous.c_str());
+        }
+    }
+
+    m_file = fopen(path.c_str(), "a");
+    if (!m_file) {
+        brls::Logger::error("TelemetryRecorder: Failed to open {}", path);
+        return;
+    }
+
+    m_session_id = (uint64_t)time(nullptr);
+    m_start_us = HighResClock::now_us();
+    m_next_sample_us = m_start_us + TELEMETRY_INTERVAL_US;
+
+    json_t* object = json_object();
+    json_object_set_new(object, "type", json_string("session"));
+    json_object_set_new(object, "version", json_integer(TELEMETRY_VERSION));
+    json_object_set_new(object, "platform", json_string(brls::Application::getPlatform()->getName().c_str()));
+    json_object_set_new(object, "host", json_string(session.host.c_str()));
+    json_object_set_new(object, "address", json_string(session.address.c_str()));
+    json_object_set_new(object, "sunshine", json_boolean(session.is_sunshine));
+    json_object_set_new(object, "qos", json_boolean(session.qos));
+    json_object_set_new(object, "app_id", json_integer(session.app_id));
+    json_object_set_new(object, "width", json_integer(session.width));
+    json_object_set_new(object, "height", json_integer(session.height));
+    json_object_set_new(object, "fps", json_integer(session.fps));
+    json_object_set_new(object, "bitrate", json_integer(session.bitrate));
+    json_object_set_new(object, "formats", json_integer(session.supported_video_formats));
+    write(object);
+}
+
+void TelemetryRecorder::stop() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file)
+        return;
+
+    json_t* object = json_object();
+    json_object_set_new(object, "type", json_string("end"));
+
+    // Session-long distributions, samples only carry window averages
+    json_t* percentiles = json_object();
+    for (int i = 0; i < STREAM_STAT_COUNT; i++) {
+        auto summary = StreamPercentiles::instance().summary((StreamStat)i);
+        json_t* stat = json_object();
+        json_object_set_new(stat, "count", json_integer((json_int_t)summary.count));
+        json_object_set_new(stat, "p50_ms", json_real(summary.p50_ms));
+        json_object_set_new(stat, "p95_ms", json_real(summary.p95_ms));
+        json_object_set_new(stat, "p99_ms", json_real(summary.p99_ms));
+        json_object_set_new(stat, "max_ms", json_real(summary.max_ms));
+        json_object_set_new(percentiles, StreamPercentiles::name((StreamStat)i), stat);
+    }
+    json_object_set_new(object, "percentiles", percentiles);
+    write(object);
+
+    fclose(m_file);
+    m_file = nullptr;
+}
+
+void TelemetryRecorder::video_setup(int video_format, int width, int height, int fps) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file)
+        return;
+
+    json_t* object = json_object();
+    json_object_set_new(object, "type", json_string("video"));
+    json_object_set_new(object, "codec", json_string(video_format_name(video_format)));
+    json_object_set_new(object, "width", json_integer(width));
+    json_object_set_new(object, "height", json_integer(height));
+    json_object_set_new(object, "fps", json_integer(fps));
+    write(object);
+}
+
+void TelemetryRecorder::reconnect(int bitrate) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file)
+        return;
+
+    json_t* object = json_object();
+    json_object_set_new(object, "type", json_string("reconnect"));
+    json_object_set_new(object, "bitrate", json_integer(bitrate));
+    write(object);
+}
+
+void TelemetryRecorder::sample(const SessionStats& stats, const AVFrameHolder& holder, int bitrate,
+                               bool poor_connection) {
+    uint64_t now = HighResClock::now_us();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file || now < m_next_sample_us)
+        return;
+    m_next_sample_us = now + TELEMETRY_INTERVAL_US;
+
+    auto& video = stats.video_decode_stats;
+    auto& render = stats.video_render_stats;
+    auto& audio = stats.audio_render_stats;
+
+    json_t* object = json_object();
+    json_object_set_new(object, "type", json_string("sample"));
+    json_object_set_new(object, "bitrate", json_integer(bitrate));
+    json_object_set_new(object, "poor", json_boolean(poor_connection));
+    json_object_set_new(object, "host_fps", json_real(video.current_host_fps));
+    json_object_set_new(object, "rx_fps", json_real(video.current_received_fps));
+    json_object_set_new(object, "dec_fps", json_real(video.current_decoded_fps));
+    json_object_set_new(object, "draw_fps", json_real(render.rendered_fps));
+    json_object_set_new(object, "rx_ms", json_real(video.current_receive_time));
+    json_object_set_new(object, "dec_ms", json_real(video.current_decoding_time));
+    json_object_set_new(object, "draw_ms", json_real(render.rendering_time));
+    json_object_set_new(object, "gpu_draw_ms", json_real(render.gpu_rendering_time));
+    json_object_set_new(object, "net_drops", json_integer(video.network_dropped_frames));
+    json_object_set_new(object, "queue_drops", json_integer((json_int_t)holder.getFrameOverflowStat()));
+    json_object_set_new(object, "queue_stale", json_integer((json_int_t)holder.getFrameStaleStat()));
+    json_object_set_new(object, "queue_reuses", json_integer((json_int_t)holder.getFakeFrameStat()));
+    json_object_set_new(object, "queue", json_integer((json_int_t)holder.getFrameQueueSize()));
+    json_object_set_new(object, "display_hz", json_real(holder.getDisplayRefreshRate()));
+    json_object_set_new(object, "audio_ms", json_real(audio.queued_time));
+    json_object_set_new(object, "audio_underruns", json_integer(audio.underruns));
+    json_object_set_new(object, "audio_drops", json_integer(audio.dropped_packets));
+    json_object_set_new(object, "audio_plc", json_integer(audio.plc_packets));
+    json_object_set_new(object, "audio_fec", json_integer(audio.fec_packets));
+
+    auto& profile = ThreadProfiler::instance().profile();
+    if (!profile.threads.empty()) {
+        json_t* threads = json_object();
+        for (auto& thread : profile.threads)
+            json_object_set_new(threads, thread.name.c_str(), json_real(thread.cpu_percent));
+        json_object_set_new(object, "threads_cpu", threads);
+    }
+    if (!profile.cores.empty()) {
+        json_t* cores = json_array();
+        for (float load : profile.cores)
+            json_array_append_new(cores, json_real(load));
+        json_object_set_new(object, "cores_load", cores);
+    }
+
+    json_t* memory = json_object();
+    for (int i = 0; i < MEM_TAG_COUNT; i++) {
+        auto tag = (MemoryTag)i;
+        json_t* usage = json_object();
+        json_object_set_new(usage, "now", json_integer((json_int_t)MemoryAccounting::current(tag)));
+        json_object_set_new(usage, "peak", json_integer((json_int_t)MemoryAccounting::peak(tag)));
+        json_object_set_new(memory, MemoryAccounting::name(tag), usage);
+    }
+    json_object_set_new(object, "memory", memory);
+    write(object);
+}
+
+void TelemetryRecorder::write(json_t* json) {
+    json_object_set_new(json, "session", json_integer((json_int_t)m_session_id));
+    json_object_set_new(json, "t_ms", json_integer((json_int_t)((HighResClock::now_us() - m_start_us) / 1000)));
+
+    if (char* line = json_dumps(json, JSON_COMPACT | JSON_REAL_PRECISION(4))) {
+        fprintf(m_file, "%s\n", line);
+        free(line);
+    }
+    json_decref(json);
+}
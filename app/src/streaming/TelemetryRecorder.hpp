@@ -0,0 +1,58 @@
+//
+//  TelemetryRecorder.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "MoonlightSession.hpp"
+#include "Singleton.hpp"
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+typedef struct json_t json_t;
+
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_INTERVAL_US 1000000
+// File is moved to <path>.1 when it grows over this at session start,
+// so at most two of them are kept
+#define TELEMETRY_FILE_MAX_BYTES (8 * 1024 * 1024)
+
+struct TelemetrySession {
+    std::string host;
+    std::string address;
+    int app_id;
+    int width;
+    int height;
+    int fps;
+    int bitrate;
+    int supported_video_formats;
+    bool is_sunshine;
+    // Control and input sockets marked for WMM voice queue
+    bool qos;
+};
+
+// Writes JSON lines for fleet analysis: session metadata, negotiated
+// video format, then once per interval a sample of stream stats.
+// Counters are cumulative for the session, so gaps don't lose drops
+class TelemetryRecorder : public Singleton<TelemetryRecorder> {
+  public:
+    void start(const std::string& path, const TelemetrySession& session);
+    void stop();
+
+    void video_setup(int video_format, int width, int height, int fps);
+    void reconnect(int bitrate);
+
+    // Called for every drawn frame, writes only once per interval
+    void sample(const SessionStats& stats, const AVFrameHolder& holder, int bitrate, bool poor_connection);
+
+  private:
+    void write(json_t* object);
+
+    std::mutex m_mutex;
+    FILE* m_file = nullptr;
+    uint64_t m_session_id = 0;
+    uint64_t m_start_us = 0;
+    uint64_t m_next_sample_us = 0;
+};
@@ -1,17 +1,27 @@
 #include "WakeOnLanManager.hpp"
 #include "Data.hpp"
+#include "HighResClock.hpp"
+#include "HostAddress.hpp"
 #include "Settings.hpp"
+#include "http.h"
 #include <borealis.hpp>
+#include <algorithm>
 #include <cerrno>
+#include <chrono>
 #include <cstring>
+#include <thread>
+#include <vector>
 
 #if defined(__linux) || defined(__APPLE__) || defined(__SWITCH__) || defined(__vita__)
 #define UNIX_SOCKS
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #elif defined(_WIN32)
 #define WIN32_SOCKS
@@ -22,10 +32,6 @@
 
 #endif
 
-#if defined(__SWITCH__)
-#include <switch.h>
-#endif
-
 #if defined(UNIX_SOCKS) || defined(WIN32_SOCKS)
 
 static Data mac_string_to_bytes(std::string mac) {
@@ -58,13 +64,35 @@ static Data create_payload(const Host& host) {
 }
 #endif
 
-#if defined(UNIX_SOCKS)
-GSResult<bool> send_packet_unix(const Host& host, const Data& payload) {
-    struct sockaddr_in udpClient{}, udpServer{};
-    int broadcast = 1;
+#if defined(UNIX_SOCKS) || defined(WIN32_SOCKS)
+#if defined(WIN32_SOCKS)
+typedef SOCKET wol_socket_t;
+typedef int socklen_t;
+#define WOL_INVALID_SOCKET INVALID_SOCKET
+#define wol_close closesocket
+#define poll WSAPoll
+#else
+typedef int wol_socket_t;
+#define WOL_INVALID_SOCKET -1
+#define wol_close close
+#endif
+
+// INADDR_NONE for IPv6 hosts, they only get broadcast packets
+static uint32_t host_ip(const Host& host) {
+    HostAddress address = HostAddress::parse(host.address, WOL_HTTP_PORT);
+    return address.is_ipv6() ? INADDR_NONE : inet_addr(address.host.c_str());
+}
+
+// Same payload goes to every port and address, hosts and routers
+// differ in which of them they let through
+static GSResult<bool> send_packets(const Host& host, const Data& payload, uint32_t subnet_broadcast) {
+#if defined(WIN32_SOCKS)
+    WSADATA data;
+    WSAStartup(MAKEWORD(2, 2), &data);
+#endif
 
-    int udpSocket = socket(AF_INET, SOCK_DGRAM, 0);
-    if (udpSocket == -1) {
+    wol_socket_t udpSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (udpSocket == WOL_INVALID_SOCKET) {
         brls::Logger::error(
             "WakeOnLanManager: An error was encountered creating "
             "the UDP socket: '{}'",
@@ -74,102 +102,84 @@ GSResult<bool> send_packet_unix(const Host& host, const Data& payload) {
             std::string(strerror(errno)));
     }
 
-    int setsock_result = setsockopt(udpSocket, SOL_SOCKET, SO_BROADCAST,
-                                    &broadcast, sizeof broadcast);
-    if (setsock_result == -1) {
+    int broadcast = 1;
+    if (setsockopt(udpSocket, SOL_SOCKET, SO_BROADCAST, (const char*)&broadcast,
+                   sizeof broadcast) == -1) {
         brls::Logger::error(
             "WakeOnLanManager: Failed to set socket options: '{}'",
             strerror(errno));
+        wol_close(udpSocket);
         return GSResult<bool>::failure("Failed to set socket options: " +
                                        std::string(strerror(errno)));
     }
 
-    // Set parameters
-    udpClient.sin_family = AF_INET;
-    udpClient.sin_addr.s_addr = INADDR_ANY;
-    udpClient.sin_port = 0;
-    // Bind socket
-    int bind_result =
-        bind(udpSocket, (struct sockaddr*)&udpClient, sizeof(udpClient));
-    if (bind_result == -1) {
-        brls::Logger::error("WakeOnLanManager: Failed to bind socket: '{}'",
-                            strerror(errno));
-        return GSResult<bool>::failure("Failed to bind socket: " +
-                                       std::string(strerror(errno)));
+    std::vector<uint32_t> addresses = {INADDR_BROADCAST};
+    if (subnet_broadcast != 0 && subnet_broadcast != INADDR_BROADCAST)
+        addresses.push_back(subnet_broadcast);
+    // Last known address still works while host's ARP entry
+    // is cached by router or host NIC answers it in sleep
+    uint32_t unicast = host_ip(host);
+    if (unicast != INADDR_NONE)
+        addresses.push_back(unicast);
+
+    int sent = 0;
+    for (uint32_t address : addresses) {
+        for (unsigned short port : {7, 9}) {
+            struct sockaddr_in udpServer{};
+            udpServer.sin_family = AF_INET;
+            udpServer.sin_addr.s_addr = address;
+            udpServer.sin_port = htons(port);
+
+            if (sendto(udpSocket, (const char*)payload.bytes(), (int)payload.size(), 0,
+                       (struct sockaddr*)&udpServer, sizeof(udpServer)) != -1) {
+                sent++;
+            } else {
+                brls::Logger::warning("WakeOnLanManager: Failed to send magic packet to {}:{}: '{}'",
+                                      inet_ntoa(udpServer.sin_addr), port, strerror(errno));
+            }
+        }
     }
+    wol_close(udpSocket);
 
-    // Set server end point (the broadcast addres)
-    udpServer.sin_family = AF_INET;
-#if defined(__SWITCH__)
-    uint32_t ip, subnet_mask;
-    // Get the current IP address and subnet mask to calculate subnet broadcast address
-    nifmGetCurrentIpConfigInfo(&ip, &subnet_mask, nullptr, nullptr, nullptr);
-    udpServer.sin_addr.s_addr = ip | ~subnet_mask;
-#else
-    udpServer.sin_addr.s_addr = inet_addr(host.address.c_str());
-#endif
-    udpServer.sin_port = htons(9);
-
-    brls::Logger::info("WakeOnLanManager: Sending magic packet to: '{}'",
-                    inet_ntoa(udpServer.sin_addr));
-
-    // Send the packet
-    ssize_t result =
-        sendto(udpSocket, payload.bytes(), sizeof(unsigned char) * 102, 0,
-               (struct sockaddr*)&udpServer, sizeof(udpServer));
-    if (result == -1) {
-        brls::Logger::error(
-            "WakeOnLanManager: Failed to send magic packet to socket: '{}'",
-            strerror(errno));
-        return GSResult<bool>::failure(
-            "Failed to send magic packet to socket: " +
-            std::string(strerror(errno)));
-    }
+    brls::Logger::info("WakeOnLanManager: Sent {} magic packets for {}", sent, host.address);
+    if (sent == 0)
+        return GSResult<bool>::failure("Failed to send magic packet to socket: " +
+                                       std::string(strerror(errno)));
     return GSResult<bool>::success(true);
 }
-#elif defined(_WIN32)
-GSResult<bool> send_packet_win32(const Host& host, const Data& payload) {
-    struct sockaddr_in udpClient, udpServer;
-    int broadcast = 1;
-
-    WSADATA data;
-    SOCKET udpSocket;
-
-    // Setup broadcast socket
-    WSAStartup(MAKEWORD(2, 2), &data);
-    udpSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
 
-    if (setsockopt(udpSocket, SOL_SOCKET, SO_BROADCAST, (char*)&broadcast,
-                   sizeof(broadcast)) == -1) {
-        return GSResult<bool>::failure("Failed to setup a broadcast socket");
-    }
-
-    // Set parameters
-    udpClient.sin_family = AF_INET;
-    udpClient.sin_addr.s_addr = INADDR_ANY;
-    udpClient.sin_port = htons(0);
-    // Bind socket
-    bind(udpSocket, (struct sockaddr*)&udpClient, sizeof(udpClient));
-
-    // Set server end point (the broadcast addres)
-    udpServer.sin_family = AF_INET;
-#if defined(__SWITCH__)
-    uint32_t ip, subnet_mask;
-    // Get the current IP address and subnet mask to calculate subnet broadcast address
-    nifmGetCurrentIpConfigInfo(&ip, &subnet_mask, nullptr, nullptr, nullptr);
-    udpServer.sin_addr.s_addr = ip | ~subnet_mask;
+// Only tells that host's HTTP port accepts connections, serverinfo
+// request is done by connect() after that
+static bool probe_host(const Host& host, int timeout_ms) {
+    struct sockaddr_storage address;
+    int length = HostAddress::parse(host.address, WOL_HTTP_PORT).to_sockaddr(&address);
+    if (length == 0)
+        return false;
+
+    wol_socket_t tcpSocket = socket(address.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (tcpSocket == WOL_INVALID_SOCKET)
+        return false;
+
+#if defined(WIN32_SOCKS)
+    u_long non_blocking = 1;
+    ioctlsocket(tcpSocket, FIONBIO, &non_blocking);
 #else
-    udpServer.sin_addr.s_addr = inet_addr(host.address.c_str());
+    fcntl(tcpSocket, F_SETFL, fcntl(tcpSocket, F_GETFL, 0) | O_NONBLOCK);
 #endif
-    udpServer.sin_port = htons(9);
 
-    brls::Logger::info("WakeOnLanManager: Sending magic packet to: '{}'",
-                    inet_ntoa(udpServer.sin_addr));
+    bool connected = connect(tcpSocket, (struct sockaddr*)&address, length) == 0;
+    if (!connected) {
+        struct pollfd fd = {tcpSocket, POLLOUT, 0};
+        if (poll(&fd, 1, timeout_ms) > 0 && (fd.revents & POLLOUT)) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(tcpSocket, SOL_SOCKET, SO_ERROR, (char*)&error, &length);
+            connected = error == 0;
+        }
+    }
 
-    // Send the packet
-    sendto(udpSocket, (const char*)payload.bytes(), sizeof(unsigned char) * 102,
-           0, (struct sockaddr*)&udpServer, sizeof(udpServer));
-    return GSResult<bool>::success(true);
+    wol_close(tcpSocket);
+    return connected;
 }
 #endif
 
@@ -181,14 +191,48 @@ bool WakeOnLanManager::can_wake_up_host(const Host& host) {
 #endif
 }
 
-GSResult<bool> WakeOnLanManager::wake_up_host(const Host& host) {
-    Data payload = create_payload(host);
-
-#if defined(UNIX_SOCKS)
-    return send_packet_unix(host, payload);
-#elif defined(_WIN32)
-    return send_packet_win32(host, payload);
+GSResult<bool> WakeOnLanManager::wake_up_host(const Host& host, uint32_t subnet_broadcast) {
+#if defined(UNIX_SOCKS) || defined(WIN32_SOCKS)
+    return send_packets(host, create_payload(host), subnet_broadcast);
+#else
+    return GSResult<bool>::failure("Wake up host not supported...");
 #endif
+}
 
+GSResult<bool> WakeOnLanManager::wake_up_and_wait(const Host& host, uint32_t subnet_broadcast) {
+#if defined(UNIX_SOCKS) || defined(WIN32_SOCKS)
+    Data payload = create_payload(host);
+    auto result = send_packets(host, payload, subnet_broadcast);
+    if (!result.isSuccess())
+        return result;
+
+    uint64_t start = HighResClock::now_us();
+    uint64_t last_sent = start;
+    uint64_t interval = WOL_POLL_INTERVAL_MIN_MS;
+
+    while (HighResClock::now_us() - start < (uint64_t)WOL_WAIT_TIMEOUT_MS * 1000) {
+        if (probe_host(host, (int)interval)) {
+            brls::Logger::info("WakeOnLanManager: {} is up after {} ms", host.address,
+                               (HighResClock::now_us() - start) / 1000);
+            http_host_reachable(host.address);
+            return GSResult<bool>::success(true);
+        }
+
+        // Probe could return right away on refused connection
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+        interval = std::min<uint64_t>(interval * 2, WOL_POLL_INTERVAL_MAX_MS);
+
+        // Packets are repeated, first ones could be lost while host's
+        // NIC or switch port were still coming up
+        uint64_t now = HighResClock::now_us();
+        if (now - last_sent >= (uint64_t)WOL_RESEND_INTERVAL_MS * 1000) {
+            send_packets(host, payload, subnet_broadcast);
+            last_sent = now;
+        }
+    }
+
+    return GSResult<bool>::failure("Host didn't wake up in time");
+#else
     return GSResult<bool>::failure("Wake up host not supported...");
+#endif
 }
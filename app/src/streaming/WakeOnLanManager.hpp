@@ -2,12 +2,23 @@
 #include "Singleton.hpp"
 #include <stdio.h>
 
+// Host is polled with doubling interval until its HTTP port answers
+#define WOL_HTTP_PORT 47989
+#define WOL_POLL_INTERVAL_MIN_MS 250
+#define WOL_POLL_INTERVAL_MAX_MS 2000
+#define WOL_RESEND_INTERVAL_MS 5000
+#define WOL_WAIT_TIMEOUT_MS 60000
+
 struct Host;
 
 class WakeOnLanManager : public Singleton<WakeOnLanManager> {
   private:
     static bool can_wake_up_host(const Host& host);
-    static GSResult<bool> wake_up_host(const Host& host);
+    // Magic packet goes to ports 7 and 9 of limited and subnet directed
+    // broadcast, and of last known host address
+    static GSResult<bool> wake_up_host(const Host& host, uint32_t subnet_broadcast);
+    // Blocks until host accepts connections or timeout passes
+    static GSResult<bool> wake_up_and_wait(const Host& host, uint32_t subnet_broadcast);
 
     friend class GameStreamClient;
 };
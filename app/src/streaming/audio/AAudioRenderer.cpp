@@ -0,0 +1,297 @@
+#ifdef PLATFORM_ANDROID
+
+#include "AAudioRenderer.hpp"
+#include "HighResClock.hpp"
+#include "Log.hpp"
+#include "PipelineTrace.hpp"
+#include "Settings.hpp"
+#include "StreamPercentiles.hpp"
+#include <Limelight.h>
+#include <algorithm>
+#include <cstring>
+#include <dlfcn.h>
+
+// Entry points of libaaudio, app still starts on Android 5 - 7
+struct AAudioApi {
+    aaudio_result_t (*create_builder)(AAudioStreamBuilder**);
+    void (*set_format)(AAudioStreamBuilder*, aaudio_format_t);
+    void (*set_channel_count)(AAudioStreamBuilder*, int32_t);
+    void (*set_sample_rate)(AAudioStreamBuilder*, int32_t);
+    void (*set_sharing_mode)(AAudioStreamBuilder*, aaudio_sharing_mode_t);
+    void (*set_performance_mode)(AAudioStreamBuilder*, aaudio_performance_mode_t);
+    void (*set_data_callback)(AAudioStreamBuilder*, AAudioStream_dataCallback, void*);
+    void (*set_error_callback)(AAudioStreamBuilder*, AAudioStream_errorCallback, void*);
+    aaudio_result_t (*open_stream)(AAudioStreamBuilder*, AAudioStream**);
+    aaudio_result_t (*delete_builder)(AAudioStreamBuilder*);
+    aaudio_result_t (*request_start)(AAudioStream*);
+    aaudio_result_t (*request_stop)(AAudioStream*);
+    aaudio_result_t (*close)(AAudioStream*);
+    int32_t (*get_frames_per_burst)(AAudioStream*);
+    aaudio_result_t (*set_buffer_size)(AAudioStream*, int32_t);
+    int32_t (*get_channel_count)(AAudioStream*);
+    int32_t (*get_sample_rate)(AAudioStream*);
+    aaudio_format_t (*get_format)(AAudioStream*);
+    aaudio_sharing_mode_t (*get_sharing_mode)(AAudioStream*);
+    const char* (*result_to_text)(aaudio_result_t);
+};
+
+template <typename T> static bool load_symbol(void* library, const char* name, T& function) {
+    function = (T)dlsym(library, name);
+    return function != nullptr;
+}
+
+static const AAudioApi* aaudio() {
+    static AAudioApi api;
+    static const AAudioApi* loaded = [] () -> const AAudioApi* {
+        void* library = dlopen("libaaudio.so", RTLD_NOW);
+        if (!library)
+            return nullptr;
+
+        bool ok = load_symbol(library, "AAudio_createStreamBuilder", api.create_builder) &&
+                  load_symbol(library, "AAudioStreamBuilder_setFormat", api.set_format) &&
+                  load_symbol(library, "AAudioStreamBuilder_setChannelCount", api.set_channel_count) &&
+                  load_symbol(library, "AAudioStreamBuilder_setSampleRate", api.set_sample_rate) &&
+                  load_symbol(library, "AAudioStreamBuilder_setSharingMode", api.set_sharing_mode) &&
+                  load_symbol(library, "AAudioStreamBuilder_setPerformanceMode", api.set_performance_mode) &&
+                  load_symbol(library, "AAudioStreamBuilder_setDataCallback", api.set_data_callback) &&
+                  load_symbol(library, "AAudioStreamBuilder_setErrorCallback", api.set_error_callback) &&
+                  load_symbol(library, "AAudioStreamBuilder_openStream", api.open_stream) &&
+                  load_symbol(library, "AAudioStreamBuilder_delete", api.delete_builder) &&
+                  load_symbol(library, "AAudioStream_requestStart", api.request_start) &&
+                  load_symbol(library, "AAudioStream_requestStop", api.request_stop) &&
+                  load_symbol(library, "AAudioStream_close", api.close) &&
+                  load_symbol(library, "AAudioStream_getFramesPerBurst", api.get_frames_per_burst) &&
+                  load_symbol(library, "AAudioStream_setBufferSizeInFrames", api.set_buffer_size) &&
+                  load_symbol(library, "AAudioStream_getChannelCount", api.get_channel_count) &&
+                  load_symbol(library, "AAudioStream_getSampleRate", api.get_sample_rate) &&
+                  load_symbol(library, "AAudioStream_getFormat", api.get_format) &&
+                  load_symbol(library, "AAudioStream_getSharingMode", api.get_sharing_mode) &&
+                  load_symbol(library, "AAudio_convertResultToText", api.result_to_text);
+        if (!ok) {
+            brls::Logger::warning("AAudio: libaaudio is missing entry points");
+            dlclose(library);
+            return nullptr;
+        }
+        return &api;
+    }();
+    return loaded;
+}
+
+bool AAudioRenderer::available() { return aaudio() != nullptr; }
+
+int AAudioRenderer::init(int audio_configuration,
+                         const POPUS_MULTISTREAM_CONFIGURATION opus_config,
+                         void* context, int ar_flags) {
+    int rc;
+    m_decoder = make_opus_decoder(opus_config, &rc);
+    if (m_decoder == nullptr) {
+        brls::Logger::error("AAudio: Couldn't create Opus decoder - {}", rc);
+        return -1;
+    }
+
+    m_channel_count = opus_config->channelCount;
+    m_sample_rate = opus_config->sampleRate;
+    m_frame_size = std::min(opus_config->samplesPerFrame, AAUDIO_FRAME_SIZE);
+    m_pending_loss = false;
+
+    m_audio_render_stats = {};
+    m_underruns = 0;
+    m_target_frames = Settings::instance().audio_latency() * m_sample_rate / 1000;
+    m_audio_render_stats.target_time = Settings::instance().audio_latency();
+
+    return open_stream();
+}
+
+int AAudioRenderer::open_stream() {
+    auto api = aaudio();
+    if (!api)
+        return -1;
+
+    AAudioStreamBuilder* builder = nullptr;
+    aaudio_result_t result = api->create_builder(&builder);
+    if (result != AAUDIO_OK) {
+        brls::Logger::error("AAudio: Couldn't create stream builder - {}", api->result_to_text(result));
+        return -1;
+    }
+
+    api->set_format(builder, AAUDIO_FORMAT_PCM_I16);
+    api->set_channel_count(builder, m_channel_count);
+    api->set_sample_rate(builder, m_sample_rate);
+    api->set_sharing_mode(builder, AAUDIO_SHARING_MODE_EXCLUSIVE);
+    api->set_performance_mode(builder, AAUDIO_PERFORMANCE_MODE_LOW_LATENCY);
+    api->set_data_callback(builder, data_callback, this);
+    api->set_error_callback(builder, error_callback, this);
+
+    // Exclusive mode is only a request, device falls back to shared one
+    result = api->open_stream(builder, &m_stream);
+    api->delete_builder(builder);
+    if (result != AAUDIO_OK) {
+        brls::Logger::error("AAudio: Couldn't open stream - {}", api->result_to_text(result));
+        m_stream = nullptr;
+        return -1;
+    }
+
+    if (api->get_format(m_stream) != AAUDIO_FORMAT_PCM_I16) {
+        brls::Logger::error("AAudio: Device doesn't take 16-bit samples");
+        close_stream();
+        return -1;
+    }
+
+    int channels = api->get_channel_count(m_stream);
+    if (channels != m_channel_count && !(channels < m_channel_count && (channels == 2 || channels == 6))) {
+        brls::Logger::error("AAudio: Device gave {} channels for {}", channels, m_channel_count);
+        close_stream();
+        return -1;
+    }
+    m_output_channels = channels;
+    m_downmix = PcmProcessing::downmix_matrix(m_channel_count, m_output_channels);
+    m_resampler.reset(m_output_channels);
+
+    // Ring holds half a second, like SDL callback mode
+    m_ring.prepare(m_sample_rate * m_output_channels / 2);
+    m_queued_average = 0;
+    m_buffering = true;
+
+    int burst = api->get_frames_per_burst(m_stream);
+    api->set_buffer_size(m_stream, burst * AAUDIO_BUFFER_BURSTS);
+
+    brls::Logger::info("AAudio: {} Hz, {} channels, burst {} frames, {} mode",
+                       api->get_sample_rate(m_stream), m_output_channels, burst,
+                       api->get_sharing_mode(m_stream) == AAUDIO_SHARING_MODE_EXCLUSIVE ? "exclusive" : "shared");
+
+    result = api->request_start(m_stream);
+    if (result != AAUDIO_OK) {
+        brls::Logger::error("AAudio: Couldn't start stream - {}", api->result_to_text(result));
+        close_stream();
+        return -1;
+    }
+    return 0;
+}
+
+void AAudioRenderer::close_stream() {
+    if (!m_stream)
+        return;
+
+    aaudio()->request_stop(m_stream);
+    aaudio()->close(m_stream);
+    m_stream = nullptr;
+    m_ring.cleanup();
+}
+
+void AAudioRenderer::cleanup() {
+    close_stream();
+    m_decoder.reset();
+}
+
+void AAudioRenderer::decode_and_play_sample(char* sample_data, int sample_length) {
+    // Headphones unplugged or output changed, closing isn't allowed from
+    // error callback
+    if (m_disconnected.exchange(false)) {
+        brls::Logger::info("AAudio: Output changed, reopening stream");
+        close_stream();
+        open_stream();
+    }
+    if (!m_stream)
+        return;
+
+    // Lost packet comes as NULL. The latest lost one waits for the next
+    // packet to be recovered from its FEC data, older ones are concealed
+    if (sample_data == nullptr || sample_length <= 0) {
+        if (m_pending_loss) {
+            play_frame(nullptr, 0, false);
+            m_audio_render_stats.plc_packets++;
+        }
+        m_pending_loss = true;
+        return;
+    }
+
+    if (m_pending_loss) {
+        play_frame(sample_data, sample_length, true);
+        m_audio_render_stats.fec_packets++;
+        m_pending_loss = false;
+    }
+
+    play_frame(sample_data, sample_length, false);
+}
+
+void AAudioRenderer::play_frame(char* sample_data, int sample_length, bool fec) {
+    uint64_t before_decode = HighResClock::now_us();
+    int decoded = opus_multistream_decode(m_decoder.get(), (const unsigned char*)sample_data,
+                                          sample_length, m_pcm_buffer, m_frame_size, fec ? 1 : 0);
+    uint64_t after_decode = HighResClock::now_us();
+    m_audio_render_stats.total_decode_time_us += after_decode - before_decode;
+    StreamPercentiles::instance().record(STREAM_STAT_AUDIO_DECODE, after_decode - before_decode);
+    TRACE_SPAN("Opus decode", before_decode, after_decode);
+    m_audio_render_stats.decoded_packets++;
+
+    if (decoded <= 0) {
+        CLOG_WARNING_LIMITED(LOG_AUDIO, "AAudio: Opus error from decode - {}", decoded);
+        return;
+    }
+
+    short* output = m_pcm_buffer;
+    if (m_output_channels != m_channel_count) {
+        PcmProcessing::downmix(m_downmix, m_pcm_buffer, m_downmix_buffer, decoded);
+        output = m_downmix_buffer;
+    }
+
+    PcmProcessing::apply_volume(output, decoded * m_output_channels,
+                                Settings::instance().stream().volume);
+    push_samples(output, decoded);
+}
+
+void AAudioRenderer::push_samples(short* samples, int frames) {
+    TRACE_SCOPE("Audio write");
+    float queued = (float)(m_ring.size() / m_output_channels);
+    m_queued_average += (queued - m_queued_average) / 16.0f;
+
+    // Keep queue at target by changing playback speed up to 1%, one
+    // frame per packet for every ~2 ms of difference
+    double drift = std::clamp((m_target_frames - m_queued_average) / (100.0 * frames),
+                              -AAUDIO_MAX_DRIFT_CORRECTION, AAUDIO_MAX_DRIFT_CORRECTION);
+    frames = (int)m_resampler.process(samples, frames, m_resample_buffer, 1 + drift);
+    samples = m_resample_buffer;
+
+    // Only whole packets, so ring stays aligned to frames
+    size_t count = frames * m_output_channels;
+    if (m_ring.capacity() - m_ring.size() < count) {
+        m_audio_render_stats.dropped_packets++;
+        return;
+    }
+    m_ring.write(samples, count);
+
+    m_audio_render_stats.queued_time = m_queued_average * 1000.0f / m_sample_rate;
+}
+
+aaudio_data_callback_result_t AAudioRenderer::data_callback(AAudioStream* stream, void* userdata,
+                                                            void* audio_data, int32_t frames) {
+    auto self = (AAudioRenderer*)userdata;
+    size_t count = (size_t)frames * self->m_output_channels;
+    size_t read = 0;
+
+    // Wait for queue to be filled again after underrun
+    if (self->m_buffering)
+        self->m_buffering = self->m_ring.size() < (size_t)(self->m_target_frames * self->m_output_channels);
+
+    if (!self->m_buffering)
+        read = self->m_ring.read((short*)audio_data, count);
+
+    if (read < count) {
+        memset((short*)audio_data + read, 0, (count - read) * sizeof(short));
+
+        if (!self->m_buffering) {
+            self->m_underruns.fetch_add(1, std::memory_order_relaxed);
+            self->m_buffering = true;
+        }
+    }
+    return AAUDIO_CALLBACK_RESULT_CONTINUE;
+}
+
+void AAudioRenderer::error_callback(AAudioStream* stream, void* userdata, aaudio_result_t error) {
+    if (error == AAUDIO_ERROR_DISCONNECTED)
+        ((AAudioRenderer*)userdata)->m_disconnected = true;
+}
+
+int AAudioRenderer::capabilities() { return CAPABILITY_DIRECT_SUBMIT; }
+
+#endif // PLATFORM_ANDROID
@@ -0,0 +1,71 @@
+#ifdef PLATFORM_ANDROID
+
+#include "IAudioRenderer.hpp"
+#include "OpusResources.hpp"
+#include "PcmProcessing.hpp"
+#include "PcmResampler.hpp"
+#include "PcmRing.hpp"
+#include <aaudio/AAudio.h>
+#include <atomic>
+#pragma once
+
+#define AAUDIO_FRAME_SIZE 240
+// Speed change that keeps ring at target
+#define AAUDIO_MAX_DRIFT_CORRECTION 0.01
+// Device buffer is this many bursts, the smallest that doesn't glitch
+// on most devices
+#define AAUDIO_BUFFER_BURSTS 2
+
+// Low latency AAudio stream, exclusive when device allows it. Data
+// callback pulls packets from ring filled by decoder thread, so there's
+// no SDL queue and its minimum buffer in between. libaaudio is loaded at
+// runtime, Android before 8.0 doesn't have it
+class AAudioRenderer final : public IAudioRenderer {
+  public:
+    // False when libaaudio is missing, SDL renderer is used then
+    static bool available();
+
+    AAudioRenderer(){};
+    ~AAudioRenderer(){};
+
+    int init(int audio_configuration,
+             const POPUS_MULTISTREAM_CONFIGURATION opus_config, void* context,
+             int ar_flags) override;
+    void cleanup() override;
+    void decode_and_play_sample(char* sample_data, int sample_length) override;
+    int capabilities() override;
+
+  private:
+    static aaudio_data_callback_result_t data_callback(AAudioStream* stream, void* userdata,
+                                                       void* audio_data, int32_t frames);
+    static void error_callback(AAudioStream* stream, void* userdata, aaudio_result_t error);
+
+    int open_stream();
+    void close_stream();
+    void play_frame(char* sample_data, int sample_length, bool fec);
+    void push_samples(short* samples, int frames);
+
+    OpusMSDecoderPtr m_decoder;
+    AAudioStream* m_stream = nullptr;
+    // Set from error callback, stream is reopened on decoder thread
+    std::atomic<bool> m_disconnected = false;
+
+    PcmRing m_ring;
+    std::atomic<bool> m_buffering = true;
+    float m_queued_average = 0;
+    int m_target_frames = 0;
+
+    int m_channel_count = 0;
+    int m_output_channels = 0;
+    PcmDownmix m_downmix = {};
+    int m_sample_rate = 0;
+    int m_frame_size = AAUDIO_FRAME_SIZE;
+    bool m_pending_loss = false;
+
+    short m_pcm_buffer[AAUDIO_FRAME_SIZE * PCM_MAX_CHANNELS];
+    short m_downmix_buffer[AAUDIO_FRAME_SIZE * PCM_MAX_CHANNELS];
+    PcmResampler m_resampler;
+    short m_resample_buffer[(AAUDIO_FRAME_SIZE + 4) * PCM_MAX_CHANNELS];
+};
+
+#endif // PLATFORM_ANDROID
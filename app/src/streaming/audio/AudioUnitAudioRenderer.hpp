@@ -0,0 +1,70 @@
+#ifdef __APPLE__
+
+#include "IAudioRenderer.hpp"
+#include "OpusResources.hpp"
+#include "PcmProcessing.hpp"
+#include "PcmResampler.hpp"
+#include "PcmRing.hpp"
+#include <AudioToolbox/AudioToolbox.h>
+#include <atomic>
+#pragma once
+
+#define AUDIOUNIT_FRAME_SIZE 240
+// Speed change that keeps ring at target
+#define AUDIOUNIT_MAX_DRIFT_CORRECTION 0.01
+// IO buffer asked from system, AirPods and eARC add their own latency
+// on top of it, which is reported in stats
+#define AUDIOUNIT_IO_BUFFER_MS 5
+
+// Output AudioUnit, RemoteIO on iOS and tvOS, default output on macOS.
+// Render callback pulls packets from ring filled by decoder thread
+class AudioUnitAudioRenderer final : public IAudioRenderer {
+  public:
+    AudioUnitAudioRenderer(){};
+    ~AudioUnitAudioRenderer(){};
+
+    int init(int audio_configuration,
+             const POPUS_MULTISTREAM_CONFIGURATION opus_config, void* context,
+             int ar_flags) override;
+    void cleanup() override;
+    void decode_and_play_sample(char* sample_data, int sample_length) override;
+    int capabilities() override;
+    AudioRenderStats audio_render_stats() override;
+
+  private:
+    static OSStatus render_callback(void* userdata, AudioUnitRenderActionFlags* flags,
+                                    const AudioTimeStamp* timestamp, UInt32 bus,
+                                    UInt32 frames, AudioBufferList* data);
+
+    // Set up audio session and IO buffer, returns channels device takes
+    int configure_output(int channels);
+    // Hardware latency after samples leave render callback, in ms
+    float output_latency();
+    void play_frame(char* sample_data, int sample_length, bool fec);
+    void push_samples(short* samples, int frames);
+
+    OpusMSDecoderPtr m_decoder;
+    AudioComponentInstance m_unit = nullptr;
+
+    PcmRing m_ring;
+    std::atomic<bool> m_buffering = true;
+    float m_queued_average = 0;
+    int m_target_frames = 0;
+
+    int m_channel_count = 0;
+    int m_output_channels = 0;
+    PcmDownmix m_downmix = {};
+    int m_sample_rate = 0;
+    int m_frame_size = AUDIOUNIT_FRAME_SIZE;
+    bool m_pending_loss = false;
+    // Route can change while streaming, it's read again once in a while
+    uint64_t m_latency_checked_us = 0;
+    float m_output_latency = 0;
+
+    short m_pcm_buffer[AUDIOUNIT_FRAME_SIZE * PCM_MAX_CHANNELS];
+    short m_downmix_buffer[AUDIOUNIT_FRAME_SIZE * PCM_MAX_CHANNELS];
+    PcmResampler m_resampler;
+    short m_resample_buffer[(AUDIOUNIT_FRAME_SIZE + 4) * PCM_MAX_CHANNELS];
+};
+
+#endif // __APPLE__
@@ -0,0 +1,279 @@
+#ifdef __APPLE__
+
+#include "AudioUnitAudioRenderer.hpp"
+#include "HighResClock.hpp"
+#include "Log.hpp"
+#include "PipelineTrace.hpp"
+#include "Settings.hpp"
+#include "StreamPercentiles.hpp"
+#include <Limelight.h>
+#include <algorithm>
+#include <cstring>
+
+#if defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
+#import <AVFoundation/AVFoundation.h>
+#else
+#include <CoreAudio/CoreAudio.h>
+#endif
+
+#define OUTPUT_LATENCY_CHECK_US 1000000
+
+int AudioUnitAudioRenderer::init(int audio_configuration,
+                                 const POPUS_MULTISTREAM_CONFIGURATION opus_config,
+                                 void* context, int ar_flags) {
+    int rc;
+    m_decoder = make_opus_decoder(opus_config, &rc);
+    if (m_decoder == nullptr) {
+        brls::Logger::error("AudioUnit: Couldn't create Opus decoder - {}", rc);
+        return -1;
+    }
+
+    m_channel_count = opus_config->channelCount;
+    m_sample_rate = opus_config->sampleRate;
+    m_frame_size = std::min(opus_config->samplesPerFrame, AUDIOUNIT_FRAME_SIZE);
+    m_pending_loss = false;
+
+    m_output_channels = configure_output(m_channel_count);
+    m_downmix = PcmProcessing::downmix_matrix(m_channel_count, m_output_channels);
+    m_resampler.reset(m_output_channels);
+
+    AudioComponentDescription description = {};
+    description.componentType = kAudioUnitType_Output;
+#if defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
+    description.componentSubType = kAudioUnitSubType_RemoteIO;
+#else
+    description.componentSubType = kAudioUnitSubType_DefaultOutput;
+#endif
+    description.componentManufacturer = kAudioUnitManufacturer_Apple;
+
+    AudioComponent component = AudioComponentFindNext(nullptr, &description);
+    if (!component || AudioComponentInstanceNew(component, &m_unit) != noErr) {
+        brls::Logger::error("AudioUnit: Couldn't create output unit");
+        m_unit = nullptr;
+        return -1;
+    }
+
+    // Interleaved 16-bit, converter of output unit takes it to device format
+    AudioStreamBasicDescription format = {};
+    format.mSampleRate = m_sample_rate;
+    format.mFormatID = kAudioFormatLinearPCM;
+    format.mFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked;
+    format.mChannelsPerFrame = m_output_channels;
+    format.mBitsPerChannel = 16;
+    format.mBytesPerFrame = m_output_channels * sizeof(short);
+    format.mFramesPerPacket = 1;
+    format.mBytesPerPacket = format.mBytesPerFrame;
+    AudioUnitSetProperty(m_unit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0,
+                         &format, sizeof(format));
+
+    AURenderCallbackStruct callback = {render_callback, this};
+    AudioUnitSetProperty(m_unit, kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, 0,
+                         &callback, sizeof(callback));
+
+#if !defined(PLATFORM_IOS) && !defined(PLATFORM_TVOS)
+    // Per process IO buffer of the device, other apps keep theirs
+    UInt32 io_frames = m_sample_rate * AUDIOUNIT_IO_BUFFER_MS / 1000;
+    AudioUnitSetProperty(m_unit, kAudioDevicePropertyBufferFrameSize, kAudioUnitScope_Global, 0,
+                         &io_frames, sizeof(io_frames));
+#endif
+
+    // Ring holds half a second, like SDL callback mode
+    m_ring.prepare(m_sample_rate * m_output_channels / 2);
+    m_queued_average = 0;
+    m_buffering = true;
+    m_audio_render_stats = {};
+    m_underruns = 0;
+    m_target_frames = Settings::instance().audio_latency() * m_sample_rate / 1000;
+    m_audio_render_stats.target_time = Settings::instance().audio_latency();
+    m_latency_checked_us = 0;
+
+    if (AudioUnitInitialize(m_unit) != noErr || AudioOutputUnitStart(m_unit) != noErr) {
+        brls::Logger::error("AudioUnit: Couldn't start output unit");
+        AudioComponentInstanceDispose(m_unit);
+        m_unit = nullptr;
+        return -1;
+    }
+
+    brls::Logger::info("AudioUnit: {} Hz, {} channels, output latency {:.1f} ms",
+                       m_sample_rate, m_output_channels, output_latency());
+    return 0;
+}
+
+int AudioUnitAudioRenderer::configure_output(int channels) {
+#if defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
+    AVAudioSession* session = [AVAudioSession sharedInstance];
+    [session setCategory:AVAudioSessionCategoryPlayback error:nil];
+    [session setPreferredSampleRate:m_sample_rate error:nil];
+    [session setPreferredIOBufferDuration:AUDIOUNIT_IO_BUFFER_MS / 1000.0 error:nil];
+    [session setActive:YES error:nil];
+
+    // HDMI and eARC receivers take surround, everything else gets downmix
+    int available = (int)session.maximumOutputNumberOfChannels;
+    if (available >= channels) {
+        [session setPreferredOutputNumberOfChannels:channels error:nil];
+        return channels;
+    }
+    return available >= 6 && channels > 6 ? 6 : 2;
+#else
+    // Default output unit maps channels in order, so surround is downmixed
+    return channels > 2 ? 2 : channels;
+#endif
+}
+
+float AudioUnitAudioRenderer::output_latency() {
+#if defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
+    AVAudioSession* session = [AVAudioSession sharedInstance];
+    return (float)((session.outputLatency + session.IOBufferDuration) * 1000.0);
+#else
+    AudioDeviceID device = kAudioObjectUnknown;
+    UInt32 size = sizeof(device);
+    if (!m_unit || AudioUnitGetProperty(m_unit, kAudioOutputUnitProperty_CurrentDevice,
+                                        kAudioUnitScope_Global, 0, &device, &size) != noErr)
+        return 0;
+
+    UInt32 frames = 0;
+    UInt32 total = 0;
+    for (AudioObjectPropertySelector selector : {kAudioDevicePropertyLatency, kAudioDevicePropertySafetyOffset,
+                                                 kAudioDevicePropertyBufferFrameSize}) {
+        AudioObjectPropertyAddress address = {selector, kAudioDevicePropertyScopeOutput,
+                                              kAudioObjectPropertyElementMain};
+        size = sizeof(frames);
+        if (AudioObjectGetPropertyData(device, &address, 0, nullptr, &size, &frames) == noErr)
+            total += frames;
+    }
+
+    Float64 rate = m_sample_rate;
+    AudioObjectPropertyAddress address = {kAudioDevicePropertyNominalSampleRate,
+                                          kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMain};
+    size = sizeof(rate);
+    AudioObjectGetPropertyData(device, &address, 0, nullptr, &size, &rate);
+    return rate > 0 ? (float)(total * 1000.0 / rate) : 0;
+#endif
+}
+
+void AudioUnitAudioRenderer::cleanup() {
+    if (m_unit) {
+        AudioOutputUnitStop(m_unit);
+        AudioUnitUninitialize(m_unit);
+        AudioComponentInstanceDispose(m_unit);
+        m_unit = nullptr;
+    }
+    m_ring.cleanup();
+    m_decoder.reset();
+}
+
+void AudioUnitAudioRenderer::decode_and_play_sample(char* sample_data, int sample_length) {
+    if (!m_unit)
+        return;
+
+    // Lost packet comes as NULL. The latest lost one waits for the next
+    // packet to be recovered from its FEC data, older ones are concealed
+    if (sample_data == nullptr || sample_length <= 0) {
+        if (m_pending_loss) {
+            play_frame(nullptr, 0, false);
+            m_audio_render_stats.plc_packets++;
+        }
+        m_pending_loss = true;
+        return;
+    }
+
+    if (m_pending_loss) {
+        play_frame(sample_data, sample_length, true);
+        m_audio_render_stats.fec_packets++;
+        m_pending_loss = false;
+    }
+
+    play_frame(sample_data, sample_length, false);
+}
+
+void AudioUnitAudioRenderer::play_frame(char* sample_data, int sample_length, bool fec) {
+    uint64_t before_decode = HighResClock::now_us();
+    int decoded = opus_multistream_decode(m_decoder.get(), (const unsigned char*)sample_data,
+                                          sample_length, m_pcm_buffer, m_frame_size, fec ? 1 : 0);
+    uint64_t after_decode = HighResClock::now_us();
+    m_audio_render_stats.total_decode_time_us += after_decode - before_decode;
+    StreamPercentiles::instance().record(STREAM_STAT_AUDIO_DECODE, after_decode - before_decode);
+    TRACE_SPAN("Opus decode", before_decode, after_decode);
+    m_audio_render_stats.decoded_packets++;
+
+    if (decoded <= 0) {
+        CLOG_WARNING_LIMITED(LOG_AUDIO, "AudioUnit: Opus error from decode - {}", decoded);
+        return;
+    }
+
+    short* output = m_pcm_buffer;
+    if (m_output_channels != m_channel_count) {
+        PcmProcessing::downmix(m_downmix, m_pcm_buffer, m_downmix_buffer, decoded);
+        output = m_downmix_buffer;
+    }
+
+    PcmProcessing::apply_volume(output, decoded * m_output_channels,
+                                Settings::instance().stream().volume);
+    push_samples(output, decoded);
+}
+
+void AudioUnitAudioRenderer::push_samples(short* samples, int frames) {
+    TRACE_SCOPE("Audio write");
+    float queued = (float)(m_ring.size() / m_output_channels);
+    m_queued_average += (queued - m_queued_average) / 16.0f;
+
+    // Keep queue at target by changing playback speed up to 1%, one
+    // frame per packet for every ~2 ms of difference
+    double drift = std::clamp((m_target_frames - m_queued_average) / (100.0 * frames),
+                              -AUDIOUNIT_MAX_DRIFT_CORRECTION, AUDIOUNIT_MAX_DRIFT_CORRECTION);
+    frames = (int)m_resampler.process(samples, frames, m_resample_buffer, 1 + drift);
+    samples = m_resample_buffer;
+
+    // Only whole packets, so ring stays aligned to frames
+    size_t count = frames * m_output_channels;
+    if (m_ring.capacity() - m_ring.size() < count) {
+        m_audio_render_stats.dropped_packets++;
+        return;
+    }
+    m_ring.write(samples, count);
+
+    m_audio_render_stats.queued_time = m_queued_average * 1000.0f / m_sample_rate;
+}
+
+AudioRenderStats AudioUnitAudioRenderer::audio_render_stats() {
+    uint64_t now = HighResClock::now_us();
+    if (now - m_latency_checked_us >= OUTPUT_LATENCY_CHECK_US) {
+        m_latency_checked_us = now;
+        m_output_latency = output_latency();
+    }
+
+    // Asked on reader side, so it stays out of the audio thread
+    AudioRenderStats stats = IAudioRenderer::audio_render_stats();
+    stats.output_latency = m_output_latency;
+    return stats;
+}
+
+OSStatus AudioUnitAudioRenderer::render_callback(void* userdata, AudioUnitRenderActionFlags* flags,
+                                                 const AudioTimeStamp* timestamp, UInt32 bus,
+                                                 UInt32 frames, AudioBufferList* data) {
+    auto self = (AudioUnitAudioRenderer*)userdata;
+    short* output = (short*)data->mBuffers[0].mData;
+    size_t count = (size_t)frames * self->m_output_channels;
+    size_t read = 0;
+
+    // Wait for queue to be filled again after underrun
+    if (self->m_buffering)
+        self->m_buffering = self->m_ring.size() < (size_t)(self->m_target_frames * self->m_output_channels);
+
+    if (!self->m_buffering)
+        read = self->m_ring.read(output, count);
+
+    if (read < count) {
+        memset(output + read, 0, (count - read) * sizeof(short));
+
+        if (!self->m_buffering) {
+            self->m_underruns.fetch_add(1, std::memory_order_relaxed);
+            self->m_buffering = true;
+        }
+    }
+    return noErr;
+}
+
+int AudioUnitAudioRenderer::capabilities() { return CAPABILITY_DIRECT_SUBMIT; }
+
+#endif // __APPLE__
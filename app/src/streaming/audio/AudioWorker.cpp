@@ -0,0 +1,95 @@
+//
+//  AudioWorker.cpp
+//  Moonlight
+//
+
+#include "AudioWorker.hpp"
+#include "Log.hpp"
+#include "PlatformBackends.hpp"
+#include "ThreadAffinity.hpp"
+#include "ThreadProfiler.hpp"
+#include <borealis.hpp>
+#include <cstring>
+
+void AudioWorker::start(const Renderer& renderer) {
+    if (m_thread.joinable())
+        return;
+
+    if (!m_slots)
+        m_slots = std::make_unique<Slot[]>(AUDIO_WORKER_SLOTS);
+
+    m_renderer = renderer;
+    m_head = 0;
+    m_tail = 0;
+    m_dropped = 0;
+    m_running = true;
+    m_thread = std::thread(&AudioWorker::run, this);
+    m_active.store(true, std::memory_order_release);
+    brls::Logger::info("AudioWorker: Started");
+}
+
+void AudioWorker::stop() {
+    if (!m_active.exchange(false))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_wait_lock);
+        m_running = false;
+    }
+    m_wait_cond.notify_one();
+    m_thread.join();
+
+    if (uint32_t dropped = m_dropped.load())
+        brls::Logger::warning("AudioWorker: Stopped, {} packets dropped on full queue", dropped);
+    else
+        brls::Logger::info("AudioWorker: Stopped");
+}
+
+bool AudioWorker::push(const char* data, int length) {
+    if (length > AUDIO_WORKER_PACKET_SIZE) {
+        CLOG_ERROR_LIMITED(LOG_AUDIO, "AudioWorker: Packet of {} bytes doesn't fit slot", length);
+        length = 0;
+    }
+
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) == AUDIO_WORKER_SLOTS) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Slot& slot = m_slots[head % AUDIO_WORKER_SLOTS];
+    slot.length = data ? length : 0;
+    if (slot.length > 0)
+        memcpy(slot.data, data, slot.length);
+    m_head.store(head + 1, std::memory_order_release);
+
+    // Empty lock only orders this with worker checking the ring,
+    // so the wakeup isn't lost
+    { std::lock_guard<std::mutex> lock(m_wait_lock); }
+    m_wait_cond.notify_one();
+    return true;
+}
+
+void AudioWorker::run() {
+    ThreadAffinity::apply(THREAD_ROLE_AUDIO);
+    ThreadProfileScope profile("Audio worker");
+
+    while (true) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        {
+            std::unique_lock<std::mutex> lock(m_wait_lock);
+            m_wait_cond.wait(lock, [this, tail] {
+                return !m_running || m_head.load(std::memory_order_acquire) != tail;
+            });
+            if (!m_running)
+                return;
+        }
+
+        Slot& slot = m_slots[tail % AUDIO_WORKER_SLOTS];
+        m_renderer.call([&slot](auto* renderer) {
+            renderer->decode_and_play_sample(slot.length > 0 ? slot.data : nullptr, slot.length);
+            renderer->publish_stats();
+        });
+        m_tail.store(tail + 1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,63 @@
+//
+//  AudioWorker.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "IAudioRenderer.hpp"
+#include "PlatformPipeline.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Packets of 5 ms, so queue holds 160 ms, much more than renderers keep
+#define AUDIO_WORKER_SLOTS 32
+// Opus packets of moonlight are far below MTU even for 7.1
+#define AUDIO_WORKER_PACKET_SIZE 1500
+
+// Takes Opus decoding and output off moonlight-common-c audio receive
+// thread. Receive thread only copies packets into a single producer /
+// single consumer ring, worker decodes and plays them, so a blocked
+// output doesn't hold up packet reception
+class AudioWorker {
+  public:
+    using Renderer = PipelineStage<IAudioRenderer, PlatformAudioRenderer>;
+
+    void start(const Renderer& renderer);
+    // Packets still queued are dropped
+    void stop();
+
+    // Receive thread could ask while stop() is called on another one
+    [[nodiscard]] bool running() const { return m_active.load(std::memory_order_acquire); }
+
+    // Receive thread, lost packet comes as NULL and is queued as well,
+    // so renderer could conceal it. Returns false when queue is full
+    bool push(const char* data, int length);
+
+    [[nodiscard]] uint32_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+  private:
+    struct Slot {
+        int length;
+        char data[AUDIO_WORKER_PACKET_SIZE];
+    };
+
+    void run();
+
+    Renderer m_renderer;
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<size_t> m_head = 0;
+    std::atomic<size_t> m_tail = 0;
+    std::atomic<uint32_t> m_dropped = 0;
+    std::atomic<bool> m_active = false;
+
+    // Only for sleeping, packets never wait for it
+    std::mutex m_wait_lock;
+    std::condition_variable m_wait_cond;
+    bool m_running = false;
+    std::thread m_thread;
+};
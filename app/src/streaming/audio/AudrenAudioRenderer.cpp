@@ -1,72 +1,95 @@
 #ifdef __SWITCH__
 
 #include "AudrenAudioRenderer.hpp"
+#include "AVSync.hpp"
+#include "HighResClock.hpp"
+#include "Log.hpp"
+#include "PcmProcessing.hpp"
+#include "PipelineTrace.hpp"
+#include "StreamPercentiles.hpp"
 #include <Settings.hpp>
 #include <borealis.hpp>
+#include <algorithm>
+#include <cmath>
 #include <inttypes.h>
 #include <malloc.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static const uint8_t m_sink_channels[] = {0, 1};
+// Jitter buffer depth limits
+#define JITTER_MIN_DEPTH_MS 15
+#define JITTER_MAX_DEPTH_MS 150
 
-static const AudioRendererConfig m_ar_config = {
-    .output_rate = AudioRendererOutputRate_48kHz,
-    .num_voices = 24,
-    .num_effects = 0,
-    .num_sinks = 1,
-    .num_mix_objs = 1,
-    .num_mix_buffers = 2,
-};
+// Target depth covers that many mean packet arrival deviations
+#define JITTER_DEPTH_FACTOR 4
+
+// Speed change per queue distance from target and its limit
+#define AUDREN_DRIFT_GAIN 0.01
+#define AUDREN_MAX_DRIFT_CORRECTION 0.005
 
 int AudrenAudioRenderer::init(int audio_configuration,
                               const POPUS_MULTISTREAM_CONFIGURATION opus_config,
                               void* context, int ar_flags) {
     m_channel_count = opus_config->channelCount;
+
+    // Voice takes up to 5.1, 7.1 is folded to 5.1 before queueing. Then
+    // DSP mixes it to stereo unless docked, where HDMI sink takes 5.1
+    bool docked = appletGetOperationMode() == AppletOperationMode_Console;
+    m_voice_channels = std::min(m_channel_count, AUDREN_MAX_CHANNELS);
+    m_output_channels = docked && m_voice_channels == AUDREN_MAX_CHANNELS ? AUDREN_MAX_CHANNELS : 2;
+    m_downmix = PcmProcessing::downmix_matrix(m_channel_count, m_voice_channels);
     m_sample_rate = opus_config->sampleRate;
-    m_buffer_size = m_latency * m_samples_per_frame * sizeof(s16);
-    m_samples = m_buffer_size / m_channel_count / sizeof(s16);
+    m_samples_per_frame = opus_config->samplesPerFrame;
+    // Packets are resampled into wavebufs, keep room for
+    // frames drift correction may add
+    m_packet_size = (m_samples_per_frame + AUDREN_RESAMPLE_FRAMES) * m_voice_channels * sizeof(s16);
+    m_buffer_size = AUDREN_BATCH_PACKETS * m_packet_size;
+    m_samples = m_buffer_size / m_voice_channels / sizeof(s16);
     m_current_size = 0;
-
-    brls::Logger::info("Audren: Init with channels: {}, sample rate: {}",
-                       m_channel_count, m_sample_rate);
-
-    mutexInit(&m_update_lock);
-
-    m_decoded_buffer =
-        (s16*)malloc(m_channel_count * m_samples_per_frame * sizeof(s16));
+    m_total_queued_samples = 0;
+    m_volume = 100;
+
+    m_last_packet_us = 0;
+    m_lost_packets = 0;
+    m_pending_loss = false;
+    m_jitter_us = 0;
+    m_min_depth = std::max(m_sample_rate * JITTER_MIN_DEPTH_MS / 1000, m_samples * 2);
+    m_max_depth = std::min(m_sample_rate * JITTER_MAX_DEPTH_MS / 1000, m_samples * (BUFFER_COUNT - 2));
+    m_target_depth = m_min_depth;
+    m_queued_average = 0;
+    m_paused = true;
+    m_resampler.reset(m_voice_channels);
+    m_audio_render_stats = {};
+    m_underruns = 0;
+
+    brls::Logger::info("Audren: Init with channels: {} -> {}, sample rate: {}, frame: {}",
+                       m_channel_count, m_output_channels, m_sample_rate, m_samples_per_frame);
+
+    // Decoder output, then 7.1 downmix, both go through resampler
+    m_decoded_buffer.assign(m_channel_count * m_samples_per_frame, 0);
+    m_downmix_buffer.assign(m_voice_channels * m_samples_per_frame, 0);
 
     int error;
-    m_decoder = opus_multistream_decoder_create(
-        opus_config->sampleRate, opus_config->channelCount,
-        opus_config->streams, opus_config->coupledStreams, opus_config->mapping,
-        &error);
+    m_decoder = make_opus_decoder(opus_config, &error);
+    if (!m_decoder) {
+        brls::Logger::error("Audren: Couldn't create Opus decoder - {}", error);
+        return -1;
+    }
 
-    memset(&m_driver, 0, sizeof(m_driver));
     memset(m_wavebufs, 0, sizeof(m_wavebufs));
 
     int mempool_size =
         (m_buffer_size * BUFFER_COUNT + (AUDREN_MEMPOOL_ALIGNMENT - 1)) &
         ~(AUDREN_MEMPOOL_ALIGNMENT - 1);
-    mempool_ptr = memalign(AUDREN_MEMPOOL_ALIGNMENT, mempool_size);
 
-    if (!mempool_ptr) {
-        brls::Logger::error("Audren: mempool alloc failed");
+    // Device stays open between streams, same config only gets a new voice
+    AudrenDeviceConfig config = {m_sample_rate, m_voice_channels, m_output_channels, mempool_size};
+    if (!AudrenDevice::instance().acquire(config, PcmProcessing::downmix_matrix(m_voice_channels, m_output_channels)))
         return -1;
-    }
 
-    Result rc = audrenInitialize(&m_ar_config);
-    if (R_FAILED(rc)) {
-        brls::Logger::error("Audren: audrenInitialize: %x", rc);
-        return -1;
-    }
-
-    rc = audrvCreate(&m_driver, &m_ar_config, m_channel_count);
-    if (R_FAILED(rc)) {
-        brls::Logger::error("Audren: audrvCreate: %x", rc);
-        return -1;
-    }
+    m_driver = AudrenDevice::instance().driver();
+    mempool_ptr = AudrenDevice::instance().mempool();
 
     for (int i = 0; i < BUFFER_COUNT; i++) {
         m_wavebufs[i].data_raw = mempool_ptr;
@@ -78,29 +101,6 @@ int AudrenAudioRenderer::init(int audio_configuration,
 
     m_current_wavebuf = NULL;
 
-    int mpid = audrvMemPoolAdd(&m_driver, mempool_ptr, mempool_size);
-    audrvMemPoolAttach(&m_driver, mpid);
-
-    audrvDeviceSinkAdd(&m_driver, AUDREN_DEFAULT_DEVICE_NAME, m_channel_count,
-                       m_sink_channels);
-
-    rc = audrenStartAudioRenderer();
-    if (R_FAILED(rc)) {
-        brls::Logger::error("Audren: audrenStartAudioRenderer: %x", rc);
-    }
-
-    audrvVoiceInit(&m_driver, 0, m_channel_count, PcmFormat_Int16,
-                   m_sample_rate);
-    audrvVoiceSetDestinationMix(&m_driver, 0, AUDREN_FINAL_MIX_ID);
-
-    for (int i = 0; i < m_channel_count; i++) {
-        for (int j = 0; j < m_channel_count; j++) {
-            audrvVoiceSetMixFactor(&m_driver, 0, i == j ? 1.0f : 0.0f, i, j);
-        }
-    }
-
-    audrvVoiceStart(&m_driver, 0);
-
     m_inited_driver = true;
 
     brls::Logger::info("Audren: Init done!");
@@ -111,143 +111,201 @@ int AudrenAudioRenderer::init(int audio_configuration,
 void AudrenAudioRenderer::cleanup() {
     brls::Logger::info("Audren: Cleanup...");
 
-    if (m_decoder) {
-        opus_multistream_decoder_destroy(m_decoder);
-        m_decoder = nullptr;
-    }
-
-    if (m_decoded_buffer) {
-        free(m_decoded_buffer);
-        m_decoded_buffer = nullptr;
-    }
-
-    if (mempool_ptr) {
-        free(mempool_ptr);
-        mempool_ptr = nullptr;
-    }
+    m_decoder.reset();
+    m_decoded_buffer = {};
+    m_downmix_buffer = {};
 
     if (m_inited_driver) {
         m_inited_driver = false;
-        audrvVoiceStop(&m_driver, 0);
-        audrvClose(&m_driver);
-        audrenExit();
+        AudrenDevice::instance().release();
+        m_driver = nullptr;
+        mempool_ptr = nullptr;
     }
 
     brls::Logger::info("Audren: Cleanup done!");
 }
 
 void AudrenAudioRenderer::decode_and_play_sample(char* data, int length) {
-    if (m_decoder && m_decoded_buffer) {
-        if (data != NULL && length > 0) {
-            int decoded_samples = opus_multistream_decode(
-                m_decoder, (const unsigned char*)data, length, m_decoded_buffer,
-                m_samples_per_frame, 0);
-
-            for (int i = 0; i < m_samples_per_frame * m_channel_count; i++) {
-                int scale = (int)((double)m_decoded_buffer[i] * (Settings::instance().get_volume() / 100.0));
-                m_decoded_buffer[i] = (s16) std::min(SHRT_MAX, std::max(SHRT_MIN, scale));
-            }
-
-            if (decoded_samples > 0) {
-                write_audio(m_decoded_buffer,
-                            decoded_samples * m_channel_count * sizeof(s16));
-            }
-        }
-    } else {
-        brls::Logger::error("Audren: Invalid call of decode_and_play_sample");
+    if (!m_inited_driver) {
+        CLOG_ERROR_LIMITED(LOG_AUDIO, "Audren: Call decode_and_play_sample without init driver!");
+        return;
     }
-}
 
-int AudrenAudioRenderer::capabilities() { return CAPABILITY_DIRECT_SUBMIT; }
+    if (!m_decoder || m_decoded_buffer.empty()) {
+        CLOG_ERROR_LIMITED(LOG_AUDIO, "Audren: Invalid call of decode_and_play_sample");
+        return;
+    }
 
-ssize_t AudrenAudioRenderer::free_wavebuf_index() {
-    for (int i = 0; i < BUFFER_COUNT; i++) {
-        if (m_wavebufs[i].state == AudioDriverWaveBufState_Free ||
-            m_wavebufs[i].state == AudioDriverWaveBufState_Done) {
-            return i;
+    update_gain();
+
+    // Lost packet comes as NULL. The latest lost one waits for the next
+    // packet to be recovered from its FEC data, older ones are concealed
+    if (data == NULL || length <= 0) {
+        if (m_pending_loss) {
+            play_frame(NULL, 0, false);
+            m_audio_render_stats.plc_packets++;
         }
+        m_pending_loss = true;
+        m_lost_packets++;
+        return;
     }
-    return -1;
+
+    update_jitter();
+
+    if (m_pending_loss) {
+        play_frame((const unsigned char*)data, length, true);
+        m_audio_render_stats.fec_packets++;
+        m_pending_loss = false;
+    }
+
+    play_frame((const unsigned char*)data, length, false);
 }
 
-size_t AudrenAudioRenderer::append_audio(const void* buf, size_t size) {
-    ssize_t index = -1;
+void AudrenAudioRenderer::play_frame(const unsigned char* data, int length, bool fec) {
+    size_t queued = queued_samples();
 
-    if (!m_current_wavebuf) {
-        index = free_wavebuf_index();
-        if (index == -1) {
-            return 0;
-        }
+    if (queued == 0 && !m_paused) {
+        CLOG_DEBUG(LOG_AUDIO, "Audren: Underrun, buffering {} samples", m_target_depth);
+        audrvVoiceSetPaused(m_driver, 0, true);
+        m_paused = true;
+        m_underruns.fetch_add(1, std::memory_order_relaxed);
+    }
 
-        m_current_wavebuf = &m_wavebufs[index];
-        current_pool_ptr = mempool_ptr + (index * m_buffer_size);
-        m_current_size = 0;
+    // All wavebufs are queued, that's above max depth anyway
+    s16* slot = current_slot();
+
+    uint64_t before_decode = HighResClock::now_us();
+    int decoded_samples = opus_multistream_decode(
+        m_decoder.get(), data, length, m_decoded_buffer.data(),
+        m_samples_per_frame, fec ? 1 : 0);
+    uint64_t after_decode = HighResClock::now_us();
+    m_audio_render_stats.total_decode_time_us += after_decode - before_decode;
+    StreamPercentiles::instance().record(STREAM_STAT_AUDIO_DECODE, after_decode - before_decode);
+    TRACE_SPAN("Opus decode", before_decode, after_decode);
+    m_audio_render_stats.decoded_packets++;
+
+    s16* pcm = m_decoded_buffer.data();
+    if (m_channel_count != m_voice_channels && decoded_samples > 0) {
+        PcmProcessing::downmix(m_downmix, m_decoded_buffer.data(), m_downmix_buffer.data(), decoded_samples);
+        pcm = m_downmix_buffer.data();
     }
 
-    if (size > m_buffer_size - m_current_size) {
-        size = m_buffer_size - m_current_size;
+    TRACE_SCOPE("Audio write");
+
+    // Decoded packet is dropped when queue is too far behind
+    // to catch up by stretching
+    if (decoded_samples > 0 && slot &&
+        queued <= std::min(m_max_depth, m_target_depth * 2)) {
+        decoded_samples = (int)m_resampler.process(pcm, decoded_samples, slot, drift_ratio(queued));
+        commit_samples(decoded_samples);
+    } else {
+        m_audio_render_stats.dropped_packets++;
     }
 
-    void* dstbuf = current_pool_ptr + m_current_size;
-    memcpy(dstbuf, buf, size);
-    armDCacheFlush(dstbuf, size);
+    if (m_paused && queued_samples() >= m_target_depth) {
+        audrvVoiceSetPaused(m_driver, 0, false);
+        m_paused = false;
+    }
 
-    m_current_size += size;
-    m_total_queued_samples += size / m_channel_count / sizeof(s16);
+    audrvUpdate(m_driver);
 
-    if (m_current_size == m_buffer_size) {
-        audrvVoiceAddWaveBuf(&m_driver, 0, m_current_wavebuf);
+    m_audio_render_stats.queued_time = (float)queued * 1000.0f / m_sample_rate;
+    m_audio_render_stats.target_time = (float)m_target_depth * 1000.0f / m_sample_rate;
+}
 
-        mutexLock(&m_update_lock);
-        audrvUpdate(&m_driver);
-        mutexUnlock(&m_update_lock);
+int AudrenAudioRenderer::capabilities() { return CAPABILITY_DIRECT_SUBMIT; }
 
-        if (!audrvVoiceIsPlaying(&m_driver, 0)) {
-            audrvVoiceStart(&m_driver, 0);
-        }
+void AudrenAudioRenderer::update_jitter() {
+    uint64_t now = HighResClock::now_us();
 
-        m_current_wavebuf = NULL;
+    // Mean deviation of packet interval, same smoothing as RFC 3550.
+    // Lost packets are counted in, so a loss burst isn't taken as jitter
+    if (m_last_packet_us) {
+        float expected = (float)(m_samples_per_frame * (1 + m_lost_packets)) * 1000000.0f / (float)m_sample_rate;
+        float deviation = std::fabs((float)(now - m_last_packet_us) - expected);
+        m_jitter_us += (deviation - m_jitter_us) / 16.0f;
     }
+    m_last_packet_us = now;
+    m_lost_packets = 0;
+
+    // A/V sync moves target on top of jitter, stretching does the rest
+    int jitter_samples = (int)(m_jitter_us * JITTER_DEPTH_FACTOR * m_sample_rate / 1000000.0f);
+    int sync_samples = (int)(AVSync::instance().audio_bias_ms() * m_sample_rate / 1000.0f);
+    m_target_depth = std::clamp<size_t>(std::max(m_samples_per_frame + jitter_samples + sync_samples, 0),
+                                        m_min_depth, m_max_depth);
+}
 
-    return size;
+// Volume is applied by the decoder, so samples aren't touched twice
+void AudrenAudioRenderer::update_gain() {
+    int volume = Settings::instance().stream().volume;
+    if (volume == m_volume)
+        return;
+
+    m_volume = volume;
+
+    // Q8 dB, lowest value is silent enough for 0%
+    int gain = volume > 0 ? (int)std::lround(20.0 * std::log10(volume / 100.0) * 256.0) : SHRT_MIN;
+    opus_multistream_decoder_ctl(m_decoder.get(), OPUS_SET_GAIN(std::clamp(gain, SHRT_MIN, SHRT_MAX)));
 }
 
-// Drop audren buffer every 400 samples to prevent audio delay
-bool AudrenAudioRenderer::flush() {
-    static int count = 0;
-    count++;
-    if (count == 400) {
-        count = 0;
-        return true;
+size_t AudrenAudioRenderer::queued_samples() {
+    size_t played = audrvVoiceGetPlayedSampleCount(m_driver, 0);
+    return m_total_queued_samples > played ? m_total_queued_samples - played : 0;
+}
+
+// Playback speed follows queue distance from target, continuous
+// stretch of up to 0.5% isn't audible, unlike dropping whole buffers
+double AudrenAudioRenderer::drift_ratio(size_t queued) {
+    if (m_paused) {
+        m_queued_average = (float)queued;
+        return 1.0;
     }
-    return false;
+
+    m_queued_average += ((float)queued - m_queued_average) / 16.0f;
+    double error = ((double)m_target_depth - m_queued_average) / (double)m_target_depth;
+    return 1.0 + std::clamp(error * AUDREN_DRIFT_GAIN, -AUDREN_MAX_DRIFT_CORRECTION, AUDREN_MAX_DRIFT_CORRECTION);
 }
 
-void AudrenAudioRenderer::write_audio(const void* buf, size_t size) {
-    if (!m_inited_driver) {
-        brls::Logger::error("Audren: Call write_audio without init driver!");
-        return;
+ssize_t AudrenAudioRenderer::free_wavebuf_index() {
+    for (int i = 0; i < BUFFER_COUNT; i++) {
+        if (m_wavebufs[i].state == AudioDriverWaveBufState_Free ||
+            m_wavebufs[i].state == AudioDriverWaveBufState_Done) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+s16* AudrenAudioRenderer::current_slot() {
+    if (!m_current_wavebuf) {
+        ssize_t index = free_wavebuf_index();
+        if (index == -1) {
+            return nullptr;
+        }
+
+        m_current_wavebuf = &m_wavebufs[index];
+        current_pool_ptr = (u8*)mempool_ptr + (index * m_buffer_size);
+        m_current_size = 0;
     }
 
-    audrvUpdate(&m_driver);
+    return (s16*)((u8*)current_pool_ptr + m_current_size);
+}
 
-    size_t queued_samples = m_total_queued_samples -
-        audrvVoiceGetPlayedSampleCount(&m_driver, 0);
+void AudrenAudioRenderer::commit_samples(int samples) {
+    m_current_size += samples * m_voice_channels * sizeof(s16);
 
-    // If we have over 0.5 desync, drop samples
-    if (queued_samples > m_sample_rate / 2)
-        return;
+    // Queue wavebuf once the next packet may not fit,
+    // driver is updated once per packet by the caller
+    if (m_buffer_size - m_current_size < m_packet_size) {
+        int queued = m_current_size / m_voice_channels / sizeof(s16);
 
-    size_t written = 0;
-    while (written < size) {
-        written += append_audio(buf + written, size - written);
+        armDCacheFlush(current_pool_ptr, m_current_size);
+        m_current_wavebuf->end_sample_offset =
+            m_current_wavebuf->start_sample_offset + queued;
+        audrvVoiceAddWaveBuf(m_driver, 0, m_current_wavebuf);
 
-        if (written != size) {
-            mutexLock(&m_update_lock);
-            audrvUpdate(&m_driver);
-            mutexUnlock(&m_update_lock);
-            audrenWaitFrame();
-        }
+        m_total_queued_samples += queued;
+        m_current_wavebuf = NULL;
     }
 }
 
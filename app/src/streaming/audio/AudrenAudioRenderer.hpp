@@ -1,13 +1,23 @@
 #ifdef __SWITCH__
 
+#include "AudrenDevice.hpp"
 #include "IAudioRenderer.hpp"
-#include <opus/opus_multistream.h>
+#include "OpusResources.hpp"
+#include "PcmProcessing.hpp"
+#include "PcmResampler.hpp"
 #include <switch.h>
+#include <vector>
 #pragma once
 
-#define BUFFER_COUNT 5
+#define BUFFER_COUNT 32
 
-class AudrenAudioRenderer : public IAudioRenderer {
+// Opus packets collected into one wavebuf before it's queued
+#define AUDREN_BATCH_PACKETS 2
+
+// Room in wavebuf for frames drift correction adds to a packet
+#define AUDREN_RESAMPLE_FRAMES 4
+
+class AudrenAudioRenderer final : public IAudioRenderer {
   public:
     AudrenAudioRenderer(){};
     ~AudrenAudioRenderer(){};
@@ -20,31 +30,52 @@ class AudrenAudioRenderer : public IAudioRenderer {
     int capabilities() override;
 
   private:
+    void play_frame(const unsigned char* data, int length, bool fec);
     ssize_t free_wavebuf_index();
-    size_t append_audio(const void* buf, size_t size);
-    void write_audio(const void* buf, size_t size);
-    bool flush();
+    s16* current_slot();
+    void commit_samples(int samples);
+
+    void update_jitter();
+    void update_gain();
+    size_t queued_samples();
+    double drift_ratio(size_t queued);
 
-    OpusMSDecoder* m_decoder = nullptr;
-    s16* m_decoded_buffer = nullptr;
+    OpusMSDecoderPtr m_decoder;
+    std::vector<s16> m_decoded_buffer;
+    std::vector<s16> m_downmix_buffer;
+    PcmResampler m_resampler;
+    float m_queued_average = 0;
     void* mempool_ptr = nullptr;
     void* current_pool_ptr = nullptr;
 
-    AudioDriver m_driver;
+    // Owned by AudrenDevice, valid between init and cleanup
+    AudioDriver* m_driver = nullptr;
     AudioDriverWaveBuf m_wavebufs[BUFFER_COUNT];
     AudioDriverWaveBuf* m_current_wavebuf;
-    Mutex m_update_lock;
 
     bool m_inited_driver = false;
     int m_channel_count = 0;
+    int m_voice_channels = 0;
+    int m_output_channels = 0;
+    PcmDownmix m_downmix = {};
     int m_sample_rate = 0;
     int m_buffer_size = 0;
+    int m_packet_size = 0;
+    int m_volume = 100;
     int m_samples = 0;
     size_t m_total_queued_samples = 0;
     ssize_t m_current_size = 0;
 
-    const int m_samples_per_frame = AUDREN_SAMPLES_PER_FRAME_48KHZ;
-    const int m_latency = 5;
+    // Jitter buffer, all depths are in samples per channel
+    int m_samples_per_frame = AUDREN_SAMPLES_PER_FRAME_48KHZ;
+    uint64_t m_last_packet_us = 0;
+    int m_lost_packets = 0;
+    bool m_pending_loss = false;
+    float m_jitter_us = 0;
+    size_t m_target_depth = 0;
+    size_t m_min_depth = 0;
+    size_t m_max_depth = 0;
+    bool m_paused = true;
 };
 
-#endif // __SWITCH__
\ No newline at end of file
+#endif // __SWITCH__
@@ -0,0 +1,126 @@
+//
+//  AudrenDevice.cpp
+//  Moonlight
+//
+
+#ifdef __SWITCH__
+
+#include "AudrenDevice.hpp"
+#include "MemoryAccounting.hpp"
+#include <borealis.hpp>
+#include <malloc.h>
+
+static const uint8_t m_sink_channels[] = {0, 1, 2, 3, 4, 5};
+
+static const AudioRendererConfig m_ar_config = {
+    .output_rate = AudioRendererOutputRate_48kHz,
+    .num_voices = 24,
+    .num_effects = 0,
+    .num_sinks = 1,
+    .num_mix_objs = 1,
+    .num_mix_buffers = AUDREN_MAX_CHANNELS,
+};
+
+bool AudrenDevice::acquire(const AudrenDeviceConfig& config, const PcmDownmix& mix) {
+    if (m_acquired)
+        release();
+
+    if (m_open && !(m_config == config)) {
+        brls::Logger::info("AudrenDevice: Config changed, reopening");
+        close();
+    }
+
+    if (!m_open && !open(config))
+        return false;
+
+    // Fresh voice, played sample count starts over with the stream
+    audrvVoiceInit(&m_driver, 0, config.voice_channels, PcmFormat_Int16, config.sample_rate);
+    audrvVoiceSetDestinationMix(&m_driver, 0, AUDREN_FINAL_MIX_ID);
+
+    for (int i = 0; i < config.voice_channels; i++) {
+        for (int j = 0; j < config.output_channels; j++) {
+            audrvVoiceSetMixFactor(&m_driver, 0, mix.coeffs[i][j] / 16384.0f, i, j);
+        }
+    }
+
+    // Stay paused until renderer's jitter buffer is filled
+    audrvVoiceStart(&m_driver, 0);
+    audrvVoiceSetPaused(&m_driver, 0, true);
+    audrvUpdate(&m_driver);
+
+    m_acquired = true;
+    return true;
+}
+
+void AudrenDevice::release() {
+    if (!m_acquired)
+        return;
+
+    m_acquired = false;
+    audrvVoiceStop(&m_driver, 0);
+    audrvUpdate(&m_driver);
+}
+
+void AudrenDevice::shutdown() {
+    release();
+    close();
+}
+
+bool AudrenDevice::open(const AudrenDeviceConfig& config) {
+    m_mempool = memalign(AUDREN_MEMPOOL_ALIGNMENT, config.mempool_size);
+    if (!m_mempool) {
+        brls::Logger::error("AudrenDevice: mempool alloc failed");
+        return false;
+    }
+
+    Result rc = audrenInitialize(&m_ar_config);
+    if (R_FAILED(rc)) {
+        brls::Logger::error("AudrenDevice: audrenInitialize: {:#x}", rc);
+        free(m_mempool);
+        m_mempool = nullptr;
+        return false;
+    }
+
+    rc = audrvCreate(&m_driver, &m_ar_config, config.output_channels);
+    if (R_FAILED(rc)) {
+        brls::Logger::error("AudrenDevice: audrvCreate: {:#x}", rc);
+        audrenExit();
+        free(m_mempool);
+        m_mempool = nullptr;
+        return false;
+    }
+
+    int mpid = audrvMemPoolAdd(&m_driver, m_mempool, config.mempool_size);
+    audrvMemPoolAttach(&m_driver, mpid);
+
+    audrvDeviceSinkAdd(&m_driver, AUDREN_DEFAULT_DEVICE_NAME, config.output_channels,
+                       m_sink_channels);
+
+    rc = audrenStartAudioRenderer();
+    if (R_FAILED(rc)) {
+        brls::Logger::error("AudrenDevice: audrenStartAudioRenderer: {:#x}", rc);
+    }
+
+    m_config = config;
+    m_open = true;
+    MemoryAccounting::add(MEM_AUDIO, config.mempool_size);
+    brls::Logger::info("AudrenDevice: Opened with channels: {} -> {}, sample rate: {}",
+                       config.voice_channels, config.output_channels, config.sample_rate);
+    return true;
+}
+
+void AudrenDevice::close() {
+    if (!m_open)
+        return;
+
+    m_open = false;
+    // Driver still references mempool until it's closed
+    audrvClose(&m_driver);
+    audrenExit();
+    free(m_mempool);
+    m_mempool = nullptr;
+    MemoryAccounting::remove(MEM_AUDIO, m_config.mempool_size);
+    brls::Logger::info("AudrenDevice: Closed");
+}
+
+#endif // __SWITCH__
@@ -0,0 +1,57 @@
+//
+//  AudrenDevice.hpp
+//  Moonlight
+//
+
+#ifdef __SWITCH__
+
+#pragma once
+
+#include "PcmProcessing.hpp"
+#include "Singleton.hpp"
+#include <switch.h>
+
+// Voice and HDMI sink are limited to 5.1
+#define AUDREN_MAX_CHANNELS 6
+
+struct AudrenDeviceConfig {
+    int sample_rate;
+    int voice_channels;
+    int output_channels;
+    // Whole mempool, wavebufs are laid out in it by renderer
+    int mempool_size;
+
+    bool operator==(const AudrenDeviceConfig& other) const {
+        return sample_rate == other.sample_rate && voice_channels == other.voice_channels &&
+               output_channels == other.output_channels && mempool_size == other.mempool_size;
+    }
+};
+
+// Audio renderer service, driver, sink, mempool and voice outlive the
+// stream, so reconnects and next sessions don't bring them up again.
+// Only a different config, like 5.1 after stereo or docking, reopens it
+class AudrenDevice : public Singleton<AudrenDevice> {
+  public:
+    // Voice 0 is initialized with mix to sink, started and paused.
+    // Returns false when device couldn't be opened
+    bool acquire(const AudrenDeviceConfig& config, const PcmDownmix& mix);
+    // Stops voice so its wavebufs are done, device stays open
+    void release();
+    // App exit
+    void shutdown();
+
+    [[nodiscard]] AudioDriver* driver() { return &m_driver; }
+    [[nodiscard]] void* mempool() const { return m_mempool; }
+
+  private:
+    bool open(const AudrenDeviceConfig& config);
+    void close();
+
+    AudioDriver m_driver = {};
+    AudrenDeviceConfig m_config = {};
+    void* m_mempool = nullptr;
+    bool m_open = false;
+    bool m_acquired = false;
+};
+
+#endif // __SWITCH__
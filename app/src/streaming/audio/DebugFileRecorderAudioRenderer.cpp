@@ -1,5 +1,4 @@
 #include "DebugFileRecorderAudioRenderer.hpp"
-#include <cstdlib>
 
 #define MAX_CHANNEL_COUNT 6
 #define FRAME_SIZE 240
@@ -10,24 +9,16 @@ int DebugFileRecorderAudioRenderer::init(
     int audio_configuration, const POPUS_MULTISTREAM_CONFIGURATION opus_config,
     void* context, int ar_flags) {
     int error;
-    m_decoder = opus_multistream_decoder_create(
-        opus_config->sampleRate, opus_config->channelCount,
-        opus_config->streams, opus_config->coupledStreams, opus_config->mapping,
-        &error);
-    m_buffer = (short*)malloc(FRAME_SIZE * MAX_CHANNEL_COUNT * sizeof(short));
+    m_decoder = make_opus_decoder(opus_config, &error);
+    if (!m_decoder)
+        return -1;
+    m_buffer.assign(FRAME_SIZE * MAX_CHANNEL_COUNT, 0);
     return DR_OK;
 }
 
 void DebugFileRecorderAudioRenderer::cleanup() {
-    if (m_decoder) {
-        opus_multistream_decoder_destroy(m_decoder);
-        m_decoder = nullptr;
-    }
-
-    if (m_buffer) {
-        free(m_buffer);
-        m_buffer = nullptr;
-    }
+    m_decoder.reset();
+    m_buffer = {};
 
     if (m_enable) {
         m_data.write_to_file(
@@ -37,11 +28,14 @@ void DebugFileRecorderAudioRenderer::cleanup() {
 
 void DebugFileRecorderAudioRenderer::decode_and_play_sample(char* data,
                                                             int length) {
+    if (!m_decoder)
+        return;
+
     int decode_len = opus_multistream_decode(
-        m_decoder, (const unsigned char*)data, length, m_buffer, FRAME_SIZE, 0);
+        m_decoder.get(), (const unsigned char*)data, length, m_buffer.data(), FRAME_SIZE, 0);
     if (decode_len > 0 && m_enable) {
         m_data = m_data.append(
-            Data((char*)m_buffer, FRAME_SIZE * 2 * sizeof(short)));
+            Data((char*)m_buffer.data(), FRAME_SIZE * 2 * sizeof(short)));
     }
 }
 
@@ -1,6 +1,7 @@
 #include "Data.hpp"
 #include "IAudioRenderer.hpp"
-#include <opus/opus_multistream.h>
+#include "OpusResources.hpp"
+#include <vector>
 #pragma once
 
 class DebugFileRecorderAudioRenderer : public IAudioRenderer {
@@ -16,8 +17,8 @@ class DebugFileRecorderAudioRenderer : public IAudioRenderer {
     int capabilities() override;
 
   private:
-    OpusMSDecoder* m_decoder = nullptr;
-    short* m_buffer = nullptr;
+    OpusMSDecoderPtr m_decoder;
+    std::vector<short> m_buffer;
     bool m_enable = false;
     Data m_data;
 };
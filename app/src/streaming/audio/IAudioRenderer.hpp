@@ -1,9 +1,32 @@
+#include "StatsSnapshot.hpp"
 #include <Limelight.h>
+#include <atomic>
 #pragma once
 
+struct AudioRenderStats {
+    // NOT TO USE, INTERMEDIATE VALUES
+    uint64_t total_decode_time_us;
+    uint32_t decoded_packets;
+
+    // Times are in milliseconds
+    float queued_time;
+    float target_time;
+    float decoding_time;
+    // Added by device after samples leave renderer, 0 when unknown
+    float output_latency;
+
+    uint32_t underruns;
+    uint32_t dropped_packets;
+    // Lost packets concealed by Opus or recovered from FEC data
+    uint32_t plc_packets;
+    uint32_t fec_packets;
+};
+
 class IAudioRenderer {
   public:
     virtual ~IAudioRenderer(){};
+    // Runs while host launches the app, before opus config is known
+    virtual void prepare(){};
     virtual int init(int audio_configuration,
                      const POPUS_MULTISTREAM_CONFIGURATION opus_config,
                      void* context, int ar_flags) = 0;
@@ -13,4 +36,24 @@ class IAudioRenderer {
     virtual void decode_and_play_sample(char* sample_data,
                                         int sample_length) = 0;
     virtual int capabilities() = 0;
+    // Last published snapshot, safe to call from any thread
+    virtual AudioRenderStats audio_render_stats() { return m_audio_render_snapshot.read(); }
+
+    // Called by the thread feeding samples after decode_and_play_sample
+    void publish_stats() {
+        AudioRenderStats stats = m_audio_render_stats;
+        stats.underruns = m_underruns.load(std::memory_order_relaxed);
+        stats.decoding_time = stats.decoded_packets == 0 ? 0 :
+            (float)stats.total_decode_time_us / 1000.0f / (float)stats.decoded_packets;
+        m_audio_render_snapshot.publish(stats);
+    }
+
+  protected:
+    // Owned by the thread feeding samples, underruns are counted apart
+    // as device callbacks run on threads of their own
+    AudioRenderStats m_audio_render_stats = {};
+    std::atomic<uint32_t> m_underruns = 0;
+
+  private:
+    StatsSnapshot<AudioRenderStats> m_audio_render_snapshot;
 };
@@ -0,0 +1,24 @@
+//
+//  OpusResources.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <Limelight.h>
+#include <memory>
+#include <opus/opus_multistream.h>
+
+struct OpusMSDecoderDeleter {
+    void operator()(OpusMSDecoder* decoder) const { opus_multistream_decoder_destroy(decoder); }
+};
+
+// Decoder of renderer, goes away with renderer when init fails halfway
+using OpusMSDecoderPtr = std::unique_ptr<OpusMSDecoder, OpusMSDecoderDeleter>;
+
+// Decoder for stream config, nullptr with Opus error code in error
+inline OpusMSDecoderPtr make_opus_decoder(const POPUS_MULTISTREAM_CONFIGURATION config, int* error) {
+    return OpusMSDecoderPtr(opus_multistream_decoder_create(config->sampleRate, config->channelCount,
+                                                            config->streams, config->coupledStreams,
+                                                            config->mapping, error));
+}
@@ -0,0 +1,183 @@
+//
+//  PcmProcessing.cpp
+//  Moonlight
+//
+
+#include "PcmProcessing.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PCM_USE_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PCM_USE_SSE2
+#endif
+
+// Gain is Q12 fixed point, 500% still fits into int16
+#define PCM_GAIN_SHIFT 12
+
+// Downmix coefficients are Q14, row sums are at most 1.0
+#define PCM_MIX_SHIFT 14
+
+enum PcmChannel { FL, FR, FC, LFE, BL, BR, SL, SR };
+
+void PcmProcessing::apply_volume(int16_t* samples, size_t count, int volume) {
+    if (volume == 100)
+        return;
+
+    int32_t gain = std::max(volume, 0) * (1 << PCM_GAIN_SHIFT) / 100;
+    gain = std::min(gain, (int32_t)SHRT_MAX);
+
+    size_t i = 0;
+
+#if defined(PCM_USE_NEON)
+    int16x4_t gain_vec = vdup_n_s16((int16_t)gain);
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t in = vld1q_s16(samples + i);
+        int32x4_t low = vmull_s16(vget_low_s16(in), gain_vec);
+        int32x4_t high = vmull_s16(vget_high_s16(in), gain_vec);
+        // Rounding shift with saturating narrow back to int16
+        int16x8_t out = vcombine_s16(vqrshrn_n_s32(low, PCM_GAIN_SHIFT),
+                                     vqrshrn_n_s32(high, PCM_GAIN_SHIFT));
+        vst1q_s16(samples + i, out);
+    }
+#elif defined(PCM_USE_SSE2)
+    __m128i gain_vec = _mm_set1_epi16((int16_t)gain);
+    __m128i rounding = _mm_set1_epi32(1 << (PCM_GAIN_SHIFT - 1));
+    for (; i + 8 <= count; i += 8) {
+        __m128i in = _mm_loadu_si128((const __m128i*)(samples + i));
+        __m128i lo = _mm_mullo_epi16(in, gain_vec);
+        __m128i hi = _mm_mulhi_epi16(in, gain_vec);
+        __m128i low = _mm_add_epi32(_mm_unpacklo_epi16(lo, hi), rounding);
+        __m128i high = _mm_add_epi32(_mm_unpackhi_epi16(lo, hi), rounding);
+        // Saturating pack back to int16
+        __m128i out = _mm_packs_epi32(_mm_srai_epi32(low, PCM_GAIN_SHIFT),
+                                      _mm_srai_epi32(high, PCM_GAIN_SHIFT));
+        _mm_storeu_si128((__m128i*)(samples + i), out);
+    }
+#endif
+
+    for (; i < count; i++) {
+        int32_t scaled = (samples[i] * gain + (1 << (PCM_GAIN_SHIFT - 1))) >> PCM_GAIN_SHIFT;
+        samples[i] = (int16_t)std::clamp(scaled, (int32_t)SHRT_MIN, (int32_t)SHRT_MAX);
+    }
+}
+
+PcmDownmix PcmProcessing::downmix_matrix(int in_channels, int out_channels) {
+    PcmDownmix matrix = {};
+    matrix.in_channels = in_channels;
+    matrix.out_channels = out_channels;
+
+    float weights[PCM_MAX_CHANNELS][PCM_MAX_CHANNELS] = {};
+    const float side = 0.7071f;
+
+    if (out_channels == 2 && in_channels > 2) {
+        // ITU-R BS.775 stereo downmix, LFE is dropped
+        weights[FL][0] = 1;
+        weights[FR][1] = 1;
+        weights[FC][0] = weights[FC][1] = side;
+        if (in_channels >= 6) {
+            weights[BL][0] = side;
+            weights[BR][1] = side;
+        }
+        if (in_channels >= 8) {
+            weights[SL][0] = side;
+            weights[SR][1] = side;
+        }
+    } else if (out_channels == 6 && in_channels == 8) {
+        // Fold side channels into rear ones
+        for (int c = FL; c <= BR; c++)
+            weights[c][c] = 1;
+        weights[SL][BL] = 1;
+        weights[SR][BR] = 1;
+    } else {
+        for (int c = 0; c < std::min(in_channels, out_channels); c++)
+            weights[c][c] = 1;
+    }
+
+    // Normalize every output so mixing can't clip
+    for (int o = 0; o < out_channels; o++) {
+        float sum = 0;
+        for (int c = 0; c < in_channels; c++)
+            sum += weights[c][o];
+
+        for (int c = 0; c < in_channels; c++) {
+            float weight = sum > 1 ? weights[c][o] / sum : weights[c][o];
+            matrix.coeffs[c][o] = (int16_t)std::min(weight * (1 << PCM_MIX_SHIFT), (float)SHRT_MAX);
+        }
+    }
+
+    return matrix;
+}
+
+void PcmProcessing::downmix(const PcmDownmix& matrix, const int16_t* in, int16_t* out, size_t frames) {
+    const int in_channels = matrix.in_channels;
+    const int out_channels = matrix.out_channels;
+    const size_t out_size = out_channels * sizeof(int16_t);
+
+    // Output channels are vector lanes, one frame per iteration
+#if defined(PCM_USE_NEON)
+    int16x4_t low_coeffs[PCM_MAX_CHANNELS];
+    int16x4_t high_coeffs[PCM_MAX_CHANNELS];
+    for (int c = 0; c < in_channels; c++) {
+        low_coeffs[c] = vld1_s16(matrix.coeffs[c]);
+        high_coeffs[c] = vld1_s16(matrix.coeffs[c] + 4);
+    }
+
+    int16_t lanes[PCM_MAX_CHANNELS];
+    for (size_t i = 0; i < frames; i++, in += in_channels, out += out_channels) {
+        int32x4_t low = vdupq_n_s32(0);
+        int32x4_t high = vdupq_n_s32(0);
+        for (int c = 0; c < in_channels; c++) {
+            low = vmlal_n_s16(low, low_coeffs[c], in[c]);
+            high = vmlal_n_s16(high, high_coeffs[c], in[c]);
+        }
+        vst1q_s16(lanes, vcombine_s16(vqrshrn_n_s32(low, PCM_MIX_SHIFT),
+                                      vqrshrn_n_s32(high, PCM_MIX_SHIFT)));
+        memcpy(out, lanes, out_size);
+    }
+#elif defined(PCM_USE_SSE2)
+    // Coefficients of two input channels interleaved for _mm_madd_epi16
+    __m128i low_coeffs[PCM_MAX_CHANNELS / 2];
+    __m128i high_coeffs[PCM_MAX_CHANNELS / 2];
+    for (int c = 0; c < PCM_MAX_CHANNELS; c += 2) {
+        __m128i even = _mm_loadu_si128((const __m128i*)matrix.coeffs[c]);
+        __m128i odd = _mm_loadu_si128((const __m128i*)matrix.coeffs[c + 1]);
+        low_coeffs[c / 2] = _mm_unpacklo_epi16(even, odd);
+        high_coeffs[c / 2] = _mm_unpackhi_epi16(even, odd);
+    }
+
+    const __m128i rounding = _mm_set1_epi32(1 << (PCM_MIX_SHIFT - 1));
+    int16_t frame[PCM_MAX_CHANNELS] = {};
+    int16_t lanes[PCM_MAX_CHANNELS];
+    for (size_t i = 0; i < frames; i++, in += in_channels, out += out_channels) {
+        memcpy(frame, in, in_channels * sizeof(int16_t));
+
+        __m128i low = rounding;
+        __m128i high = rounding;
+        for (int c = 0; c < in_channels; c += 2) {
+            int32_t pair;
+            memcpy(&pair, frame + c, sizeof(pair));
+            __m128i samples = _mm_set1_epi32(pair);
+            low = _mm_add_epi32(low, _mm_madd_epi16(samples, low_coeffs[c / 2]));
+            high = _mm_add_epi32(high, _mm_madd_epi16(samples, high_coeffs[c / 2]));
+        }
+        __m128i result = _mm_packs_epi32(_mm_srai_epi32(low, PCM_MIX_SHIFT),
+                                         _mm_srai_epi32(high, PCM_MIX_SHIFT));
+        _mm_storeu_si128((__m128i*)lanes, result);
+        memcpy(out, lanes, out_size);
+    }
+#else
+    for (size_t i = 0; i < frames; i++, in += in_channels, out += out_channels) {
+        for (int o = 0; o < out_channels; o++) {
+            int32_t sum = 1 << (PCM_MIX_SHIFT - 1);
+            for (int c = 0; c < in_channels; c++)
+                sum += in[c] * matrix.coeffs[c][o];
+            out[o] = (int16_t)std::clamp(sum >> PCM_MIX_SHIFT, (int32_t)SHRT_MIN, (int32_t)SHRT_MAX);
+        }
+    }
+#endif
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define PCM_MAX_CHANNELS 8
+
+// Mixing coefficients in Q14, [input channel][output channel]
+// Channel order is the one Moonlight streams: FL FR FC LFE BL BR SL SR
+struct PcmDownmix {
+    int in_channels;
+    int out_channels;
+    int16_t coeffs[PCM_MAX_CHANNELS][PCM_MAX_CHANNELS];
+};
+
+// Post-processing of decoded PCM, applied once per packet
+// before it goes to the audio backend
+class PcmProcessing {
+  public:
+    // Scales samples by volume in percent (0 - 500) with saturation,
+    // does nothing at 100%
+    static void apply_volume(int16_t* samples, size_t count, int volume);
+
+    // Normalized matrix for 8 -> 6 and N -> 2 channels, identity otherwise
+    static PcmDownmix downmix_matrix(int in_channels, int out_channels);
+
+    // Mixes interleaved frames, in and out must not overlap
+    static void downmix(const PcmDownmix& matrix, const int16_t* in, int16_t* out, size_t frames);
+};
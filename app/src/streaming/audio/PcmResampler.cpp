@@ -0,0 +1,158 @@
+//
+//  PcmResampler.cpp
+//  Moonlight
+//
+
+#include "PcmResampler.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PCM_USE_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PCM_USE_SSE2
+#endif
+
+// Filter coefficients are Q15, every phase sums to 1.0
+#define PCM_FILTER_SHIFT 15
+
+// Kaiser window, ~80 dB stopband for this length
+#define PCM_KAISER_BETA 8.0
+// Passband edge relative to Nyquist of the lower rate
+#define PCM_CUTOFF 0.92
+
+#define PCM_PI 3.14159265358979323846
+
+static double bessel_i0(double x) {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+void PcmResampler::reset(int channels, double base_ratio) {
+    m_channels = std::clamp(channels, 1, PCM_MAX_CHANNELS);
+    m_position = 0;
+
+    // History keeps TAPS - 1 frames, first packet starts from silence
+    m_buffer.assign((PCM_RESAMPLER_TAPS * 2) * m_channels + PCM_MAX_CHANNELS, 0);
+    m_buffered = PCM_RESAMPLER_TAPS - 1;
+
+    double cutoff = PCM_CUTOFF * std::min(1.0, base_ratio);
+    double i0_beta = bessel_i0(PCM_KAISER_BETA);
+    const double half = PCM_RESAMPLER_TAPS / 2.0;
+
+    for (int p = 0; p <= PCM_RESAMPLER_PHASES; p++) {
+        // Output lies between taps TAPS/2 - 1 and TAPS/2, at fraction
+        double fraction = (double)p / PCM_RESAMPLER_PHASES;
+        double weights[PCM_RESAMPLER_TAPS];
+        double sum = 0;
+
+        for (int t = 0; t < PCM_RESAMPLER_TAPS; t++) {
+            double x = (double)t - (half - 1) - fraction;
+            double sinc = x == 0 ? 1 : std::sin(PCM_PI * cutoff * x) / (PCM_PI * cutoff * x);
+            double r = x / half;
+            double window = std::fabs(r) < 1 ? bessel_i0(PCM_KAISER_BETA * std::sqrt(1 - r * r)) / i0_beta : 0;
+            weights[t] = sinc * window;
+            sum += weights[t];
+        }
+
+        // Rounding error goes to the largest tap, so DC gain is exact
+        int total = 0, largest = 0;
+        for (int t = 0; t < PCM_RESAMPLER_TAPS; t++) {
+            m_filter[p][t] = (int16_t)std::lround(weights[t] / sum * (1 << PCM_FILTER_SHIFT));
+            total += m_filter[p][t];
+            if (std::abs(m_filter[p][t]) > std::abs(m_filter[p][largest]))
+                largest = t;
+        }
+        m_filter[p][largest] += (1 << PCM_FILTER_SHIFT) - total;
+    }
+}
+
+size_t PcmResampler::process(const int16_t* in, size_t in_frames, int16_t* out, double ratio) {
+    const int channels = m_channels;
+    ratio = std::clamp(ratio, 1.0 / PCM_RESAMPLER_MAX_RATIO, PCM_RESAMPLER_MAX_RATIO);
+
+    size_t needed = (m_buffered + in_frames) * channels + PCM_MAX_CHANNELS;
+    if (m_buffer.size() < needed)
+        m_buffer.resize(needed, 0);
+    memcpy(m_buffer.data() + m_buffered * channels, in, in_frames * channels * sizeof(int16_t));
+    m_buffered += in_frames;
+
+    const double step = 1.0 / ratio;
+    size_t written = 0;
+    int16_t coeffs[PCM_RESAMPLER_TAPS];
+
+    while ((size_t)m_position + PCM_RESAMPLER_TAPS <= m_buffered) {
+        size_t index = (size_t)m_position;
+        double phase = (m_position - (double)index) * PCM_RESAMPLER_PHASES;
+        int row = std::min((int)phase, PCM_RESAMPLER_PHASES - 1);
+        int32_t fraction = (int32_t)((phase - row) * (1 << PCM_FILTER_SHIFT));
+
+        // Filter between two nearest phases
+        const int16_t* a = m_filter[row];
+        const int16_t* b = m_filter[row + 1];
+        for (int t = 0; t < PCM_RESAMPLER_TAPS; t++)
+            coeffs[t] = (int16_t)(a[t] + (((b[t] - a[t]) * fraction) >> PCM_FILTER_SHIFT));
+
+        const int16_t* frame = m_buffer.data() + index * channels;
+        int16_t* target = out + written * channels;
+
+        // Channels are vector lanes, like in downmix. Loads may read past
+        // the last frame, buffer is padded for that
+#if defined(PCM_USE_NEON)
+        int32x4_t low = vdupq_n_s32(0);
+        int32x4_t high = vdupq_n_s32(0);
+        for (int t = 0; t < PCM_RESAMPLER_TAPS; t++, frame += channels) {
+            int16x8_t samples = vld1q_s16(frame);
+            low = vmlal_n_s16(low, vget_low_s16(samples), coeffs[t]);
+            high = vmlal_n_s16(high, vget_high_s16(samples), coeffs[t]);
+        }
+        int16_t lanes[PCM_MAX_CHANNELS];
+        vst1q_s16(lanes, vcombine_s16(vqrshrn_n_s32(low, PCM_FILTER_SHIFT),
+                                      vqrshrn_n_s32(high, PCM_FILTER_SHIFT)));
+        memcpy(target, lanes, channels * sizeof(int16_t));
+#elif defined(PCM_USE_SSE2)
+        // Two taps at once, frames interleaved for _mm_madd_epi16
+        __m128i low = _mm_set1_epi32(1 << (PCM_FILTER_SHIFT - 1));
+        __m128i high = low;
+        for (int t = 0; t < PCM_RESAMPLER_TAPS; t += 2, frame += channels * 2) {
+            __m128i even = _mm_loadu_si128((const __m128i*)frame);
+            __m128i odd = _mm_loadu_si128((const __m128i*)(frame + channels));
+            int32_t pair = (uint16_t)coeffs[t] | ((int32_t)coeffs[t + 1] << 16);
+            __m128i taps = _mm_set1_epi32(pair);
+            low = _mm_add_epi32(low, _mm_madd_epi16(_mm_unpacklo_epi16(even, odd), taps));
+            high = _mm_add_epi32(high, _mm_madd_epi16(_mm_unpackhi_epi16(even, odd), taps));
+        }
+        int16_t lanes[PCM_MAX_CHANNELS];
+        _mm_storeu_si128((__m128i*)lanes, _mm_packs_epi32(_mm_srai_epi32(low, PCM_FILTER_SHIFT),
+                                                          _mm_srai_epi32(high, PCM_FILTER_SHIFT)));
+        memcpy(target, lanes, channels * sizeof(int16_t));
+#else
+        for (int c = 0; c < channels; c++) {
+            int32_t sum = 1 << (PCM_FILTER_SHIFT - 1);
+            for (int t = 0; t < PCM_RESAMPLER_TAPS; t++)
+                sum += frame[t * channels + c] * coeffs[t];
+            target[c] = (int16_t)std::clamp(sum >> PCM_FILTER_SHIFT, (int32_t)SHRT_MIN, (int32_t)SHRT_MAX);
+        }
+#endif
+
+        written++;
+        m_position += step;
+    }
+
+    // Keep frames the next output still needs
+    size_t consumed = std::min((size_t)m_position, m_buffered);
+    memmove(m_buffer.data(), m_buffer.data() + consumed * channels,
+            (m_buffered - consumed) * channels * sizeof(int16_t));
+    m_buffered -= consumed;
+    m_position -= (double)consumed;
+
+    return written;
+}
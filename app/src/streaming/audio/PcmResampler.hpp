@@ -0,0 +1,44 @@
+//
+//  PcmResampler.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "PcmProcessing.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Filter taps per phase, 8 input frames on each side of output one
+#define PCM_RESAMPLER_TAPS 16
+// Filter phases in table, fractions between them are interpolated
+#define PCM_RESAMPLER_PHASES 128
+// Limit of output / input rate, either way
+#define PCM_RESAMPLER_MAX_RATIO 2.0
+
+// Polyphase windowed sinc resampler with ratio that may change on every
+// call. State is kept between packets, so consecutive ones are one
+// continuous signal, stretched for clock drift or converted to device
+// rate. Output is delayed by half of the filter, 8 frames
+class PcmResampler {
+  public:
+    // Base ratio is device rate / stream rate, cutoff follows the lower one
+    void reset(int channels, double base_ratio = 1.0);
+
+    // Ratio is output frames per input frame. Output must have room for
+    // max_output(in_frames, ratio) frames, returns frames written
+    size_t process(const int16_t* in, size_t in_frames, int16_t* out, double ratio);
+
+    static size_t max_output(size_t in_frames, double ratio) { return (size_t)(in_frames * ratio) + 2; }
+
+  private:
+    int m_channels = 0;
+    // Q15, PHASES + 1 rows, last one is the first shifted by a frame
+    int16_t m_filter[PCM_RESAMPLER_PHASES + 1][PCM_RESAMPLER_TAPS] = {};
+    // Input frames not consumed yet, padded for whole vector loads
+    std::vector<int16_t> m_buffer;
+    size_t m_buffered = 0;
+    // Position of next output frame in buffer, in input frames
+    double m_position = 0;
+};
@@ -0,0 +1,60 @@
+//
+//  PcmRing.cpp
+//  Moonlight
+//
+
+#include "PcmRing.hpp"
+#include <algorithm>
+#include <cstring>
+
+void PcmRing::prepare(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    m_buffer = std::make_unique<int16_t[]>(size);
+    m_mask = size - 1;
+    m_head = 0;
+    m_tail = 0;
+}
+
+void PcmRing::cleanup() {
+    m_buffer.reset();
+    m_mask = 0;
+    m_head = 0;
+    m_tail = 0;
+}
+
+size_t PcmRing::write(const int16_t* samples, size_t count) {
+    if (!m_buffer)
+        return 0;
+
+    size_t head = m_head.load(std::memory_order_relaxed);
+    size_t tail = m_tail.load(std::memory_order_acquire);
+    count = std::min(count, capacity() - (head - tail));
+
+    size_t offset = head & m_mask;
+    size_t first = std::min(count, capacity() - offset);
+    memcpy(m_buffer.get() + offset, samples, first * sizeof(int16_t));
+    memcpy(m_buffer.get(), samples + first, (count - first) * sizeof(int16_t));
+
+    m_head.store(head + count, std::memory_order_release);
+    return count;
+}
+
+size_t PcmRing::read(int16_t* samples, size_t count) {
+    if (!m_buffer)
+        return 0;
+
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t head = m_head.load(std::memory_order_acquire);
+    count = std::min(count, head - tail);
+
+    size_t offset = tail & m_mask;
+    size_t first = std::min(count, capacity() - offset);
+    memcpy(samples, m_buffer.get() + offset, first * sizeof(int16_t));
+    memcpy(samples + first, m_buffer.get(), (count - first) * sizeof(int16_t));
+
+    m_tail.store(tail + count, std::memory_order_release);
+    return count;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Single producer / single consumer ring of interleaved samples,
+// decoder thread writes and audio device callback reads
+class PcmRing {
+  public:
+    // Capacity is rounded up to power of two samples
+    void prepare(size_t capacity);
+    void cleanup();
+
+    // Both return amount of samples actually copied
+    size_t write(const int16_t* samples, size_t count);
+    size_t read(int16_t* samples, size_t count);
+
+    [[nodiscard]] size_t size() const {
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        return m_head.load(std::memory_order_acquire) - tail;
+    }
+
+    [[nodiscard]] size_t capacity() const { return m_mask + 1; }
+
+  private:
+    std::unique_ptr<int16_t[]> m_buffer;
+    size_t m_mask = 0;
+    std::atomic<size_t> m_head = 0;
+    std::atomic<size_t> m_tail = 0;
+};
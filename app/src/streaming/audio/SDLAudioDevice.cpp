@@ -0,0 +1,96 @@
+//
+//  SDLAudioDevice.cpp
+//  Moonlight
+//
+
+#include "SDLAudioDevice.hpp"
+#include "PcmResampler.hpp"
+#include <borealis.hpp>
+#include <cstring>
+
+SDL_AudioDeviceID SDLAudioDevice::acquire(const SDL_AudioSpec& want, SDL_AudioSpec* have) {
+    bool callback = want.callback != nullptr;
+    bool same = m_dev != 0 && m_want.freq == want.freq && m_want.format == want.format &&
+                m_want.channels == want.channels && m_want.samples == want.samples &&
+                (m_want.callback != nullptr) == callback;
+
+    if (!same) {
+        close();
+        if (!open(want))
+            return 0;
+    } else {
+        brls::Logger::info("SDLAudioDevice: Reuse device {}", m_dev);
+    }
+
+    SDL_LockAudioDevice(m_dev);
+    m_callback = want.callback;
+    m_userdata = want.userdata;
+    SDL_UnlockAudioDevice(m_dev);
+
+    *have = m_have;
+    return m_dev;
+}
+
+void SDLAudioDevice::release() {
+    if (m_dev == 0)
+        return;
+
+    SDL_PauseAudioDevice(m_dev, 1);
+    SDL_LockAudioDevice(m_dev);
+    m_callback = nullptr;
+    m_userdata = nullptr;
+    SDL_UnlockAudioDevice(m_dev);
+    SDL_ClearQueuedAudio(m_dev);
+}
+
+void SDLAudioDevice::audioCallback(void* userdata, Uint8* stream, int len) {
+    auto self = (SDLAudioDevice*)userdata;
+    if (self->m_callback)
+        self->m_callback(self->m_userdata, stream, len);
+    else
+        memset(stream, 0, len);
+}
+
+bool SDLAudioDevice::open(const SDL_AudioSpec& want) {
+    SDL_AudioSpec spec = want;
+    if (want.callback) {
+        spec.callback = audioCallback;
+        spec.userdata = this;
+    }
+
+    // Take device channel layout and rate, so surround is downmixed with
+    // our matrix and rate is converted by our resampler
+    m_dev = SDL_OpenAudioDevice(nullptr, 0, &spec, &m_have,
+                                SDL_AUDIO_ALLOW_CHANNELS_CHANGE | SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    bool layout = m_have.channels == want.channels ||
+                  (m_have.channels < want.channels && (m_have.channels == 2 || m_have.channels == 6));
+    bool rate = m_have.freq * PCM_RESAMPLER_MAX_RATIO >= want.freq &&
+                m_have.freq <= want.freq * PCM_RESAMPLER_MAX_RATIO;
+    if (m_dev != 0 && (!layout || !rate)) {
+        // Format we can't produce, let SDL convert it
+        SDL_CloseAudioDevice(m_dev);
+        m_dev = SDL_OpenAudioDevice(nullptr, 0, &spec, &m_have, 0);
+        m_have.channels = want.channels;
+        m_have.freq = want.freq;
+    }
+
+    if (m_dev == 0) {
+        brls::Logger::error("SDLAudioDevice: Failed to open audio: {}", SDL_GetError());
+        return false;
+    }
+
+    m_want = want;
+    brls::Logger::info("SDLAudioDevice: Opened device {} with {} channels at {} Hz",
+                       m_dev, m_have.channels, m_have.freq);
+    return true;
+}
+
+void SDLAudioDevice::close() {
+    if (m_dev == 0)
+        return;
+
+    SDL_CloseAudioDevice(m_dev);
+    m_dev = 0;
+    m_callback = nullptr;
+    m_userdata = nullptr;
+}
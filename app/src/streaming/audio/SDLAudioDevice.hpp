@@ -0,0 +1,33 @@
+//
+//  SDLAudioDevice.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Singleton.hpp"
+#include <SDL.h>
+#include <SDL_audio.h>
+
+// Output device stays open between streams, next renderer with the same
+// spec only takes it over. Callback of the device forwards to current
+// renderer, switched under device lock so it's never called on a gone one
+class SDLAudioDevice : public Singleton<SDLAudioDevice> {
+  public:
+    // Returns device paused, 0 when it couldn't be opened. Without
+    // callback samples are queued with SDL_QueueAudio
+    SDL_AudioDeviceID acquire(const SDL_AudioSpec& want, SDL_AudioSpec* have);
+    // Pauses device and drops queued samples, callback plays silence
+    void release();
+
+  private:
+    static void audioCallback(void* userdata, Uint8* stream, int len);
+    bool open(const SDL_AudioSpec& want);
+    void close();
+
+    SDL_AudioDeviceID m_dev = 0;
+    SDL_AudioSpec m_want = {};
+    SDL_AudioSpec m_have = {};
+    SDL_AudioCallback m_callback = nullptr;
+    void* m_userdata = nullptr;
+};
@@ -18,6 +18,13 @@
  */
 
 #include "SDLAudiorenderer.hpp"
+#include "AVSync.hpp"
+#include "SDLAudioDevice.hpp"
+#include "PcmProcessing.hpp"
+#include "HighResClock.hpp"
+#include "Log.hpp"
+#include "PipelineTrace.hpp"
+#include "StreamPercentiles.hpp"
 
 #include <Limelight.h>
 #include <Settings.hpp>
@@ -25,17 +32,27 @@
 #include <algorithm>
 #include <climits>
 #include <cstdio>
+#include <cstring>
+
+void SDLAudioRenderer::prepare() {
+    // Audio driver load is the slow part of init, subsystem is ref counted
+    SDL_InitSubSystem(SDL_INIT_AUDIO);
+}
 
 int SDLAudioRenderer::init(int audio_configuration,
                            const POPUS_MULTISTREAM_CONFIGURATION opus_config,
                            void* context, int ar_flags) {
     int rc;
-    decoder = opus_multistream_decoder_create(
-        opus_config->sampleRate, opus_config->channelCount,
-        opus_config->streams, opus_config->coupledStreams, opus_config->mapping,
-        &rc);
+    decoder = make_opus_decoder(opus_config, &rc);
+    if (!decoder) {
+        brls::Logger::error("SDLAudioRenderer: Couldn't create Opus decoder - {}", rc);
+        return -1;
+    }
 
     channelCount = opus_config->channelCount;
+    sampleRate = opus_config->sampleRate;
+    frameSize = std::min(opus_config->samplesPerFrame, FRAME_SIZE);
+    pendingLoss = false;
 
     SDL_InitSubSystem(SDL_INIT_AUDIO);
 
@@ -52,10 +69,38 @@ int SDLAudioRenderer::init(int audio_configuration,
     want.samples = std::max(480, opus_config->samplesPerFrame); //1024;
 #endif
 
-    dev =
-        SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+    if (callbackMode) {
+        want.callback = audioCallback;
+        want.userdata = this;
+    }
+
+    // Device is kept open between streams, reopened only for a new spec
+    dev = SDLAudioDevice::instance().acquire(want, &have);
+
+    outputChannelCount = dev != 0 ? have.channels : channelCount;
+    downmix = PcmProcessing::downmix_matrix(channelCount, outputChannelCount);
+
+    // Queue and ring are in device frames from here on
+    if (dev != 0 && have.freq != sampleRate) {
+        brls::Logger::info("SDLAudioRenderer: Resampling {} Hz stream to {} Hz", sampleRate, have.freq);
+        sampleRate = have.freq;
+    }
+    baseRatio = (double)sampleRate / opus_config->sampleRate;
+    resampler.reset(outputChannelCount, baseRatio);
+
+    // Callback isn't called until device is unpaused
+    m_audio_render_stats = {};
+    m_underruns = 0;
+    if (callbackMode) {
+        // Half a second of audio
+        ring.prepare(sampleRate * outputChannelCount / 2);
+        targetFrames = Settings::instance().audio_latency() * sampleRate / 1000;
+        queuedFramesAverage = 0;
+        buffering = true;
+        m_audio_render_stats.target_time = Settings::instance().audio_latency();
+    }
+
     if (dev == 0) {
-        brls::Logger::error("Failed to open audio: %s\n", SDL_GetError());
         return -1;
     } else {
         if (have.format != want.format) // we let this one thing change.
@@ -67,30 +112,77 @@ int SDLAudioRenderer::init(int audio_configuration,
 }
 
 void SDLAudioRenderer::cleanup() {
-    if (decoder != nullptr)
-        opus_multistream_decoder_destroy(decoder);
+    decoder.reset();
 
-    SDL_CloseAudioDevice(dev);
+    SDLAudioDevice::instance().release();
+    dev = 0;
+    ring.cleanup();
 }
 
 void SDLAudioRenderer::decode_and_play_sample(char* sample_data,
                                               int sample_length) {
+    // Lost packet comes as NULL. The latest lost one waits for the next
+    // packet to be recovered from its FEC data, older ones are concealed
+    if (sample_data == nullptr || sample_length <= 0) {
+        if (pendingLoss) {
+            playFrame(nullptr, 0, false);
+            m_audio_render_stats.plc_packets++;
+        }
+        pendingLoss = true;
+        return;
+    }
+
+    if (pendingLoss) {
+        playFrame(sample_data, sample_length, true);
+        m_audio_render_stats.fec_packets++;
+        pendingLoss = false;
+    }
+
+    playFrame(sample_data, sample_length, false);
+}
+
+void SDLAudioRenderer::playFrame(char* sample_data, int sample_length, bool fec) {
+    uint64_t before_decode = HighResClock::now_us();
     int decodeLen =
-        opus_multistream_decode(decoder, (const unsigned char*)sample_data,
-                                sample_length, pcmBuffer, FRAME_SIZE, 0);
+        opus_multistream_decode(decoder.get(), (const unsigned char*)sample_data,
+                                sample_length, pcmBuffer, frameSize, fec ? 1 : 0);
+    uint64_t after_decode = HighResClock::now_us();
+    m_audio_render_stats.total_decode_time_us += after_decode - before_decode;
+    StreamPercentiles::instance().record(STREAM_STAT_AUDIO_DECODE, after_decode - before_decode);
+    TRACE_SPAN("Opus decode", before_decode, after_decode);
+    m_audio_render_stats.decoded_packets++;
 
-    if (decodeLen <= 0) { 
-        printf("Opus error from decode: %d\n", decodeLen);
+    if (decodeLen <= 0) {
+        CLOG_WARNING_LIMITED(LOG_AUDIO, "SDLAudioRenderer: Opus error from decode - {}", decodeLen);
         return;
     }
 
-    if (LiGetPendingAudioDuration() > 30) {
+    if (!callbackMode && LiGetPendingAudioDuration() > 30) {
+        m_audio_render_stats.dropped_packets++;
         return;
     }
 
-    for (short & i : pcmBuffer) {
-        int scale = (int)((double)i * (Settings::instance().get_volume() / 100.0));
-        i = (short) std::min(SHRT_MAX, std::max(SHRT_MIN, scale));
+    short* output = pcmBuffer;
+    if (outputChannelCount != channelCount) {
+        PcmProcessing::downmix(downmix, pcmBuffer, downmixBuffer, decodeLen);
+        output = downmixBuffer;
+    }
+
+    PcmProcessing::apply_volume(output, decodeLen * outputChannelCount,
+                                Settings::instance().stream().volume);
+
+    if (callbackMode)
+        pushAudio(output, decodeLen);
+    else
+        queueAudio(output, decodeLen);
+}
+
+void SDLAudioRenderer::queueAudio(short* samples, int frames) {
+    TRACE_SCOPE("Audio write");
+    // Without callback there's nothing to correct drift against
+    if (baseRatio != 1.0) {
+        frames = (int)resampler.process(samples, frames, resampleBuffer, baseRatio);
+        samples = resampleBuffer;
     }
 
 #if defined(PLATFORM_SWITCH)
@@ -99,13 +191,67 @@ void SDLAudioRenderer::decode_and_play_sample(char* sample_data,
     int bufferOverflow = 16000;
 #endif
 
-    if (SDL_GetQueuedAudioSize(dev) > bufferOverflow) {
+    Uint32 queued = SDL_GetQueuedAudioSize(dev);
+    if (queued > bufferOverflow) {
         // clear audio queue to avoid big audio delay
         // average values are close to bufferOverflow bytes
         SDL_ClearQueuedAudio(this->dev);
+        m_audio_render_stats.dropped_packets++;
+        queued = 0;
+    }
+
+    m_audio_render_stats.queued_time = (float)queued / (outputChannelCount * sizeof(short)) * 1000.0f / sampleRate;
+    SDL_QueueAudio(dev, samples,
+                    frames * outputChannelCount * sizeof(short));
+}
+
+void SDLAudioRenderer::pushAudio(short* samples, int frames) {
+    TRACE_SCOPE("Audio write");
+    float queued = (float)(ring.size() / outputChannelCount);
+    queuedFramesAverage += (queued - queuedFramesAverage) / 16.0f;
+
+    // Keep queue at target by changing playback speed up to 1%, one
+    // frame per packet for every ~2 ms of difference. A/V sync moves
+    // the target, one packet stays queued
+    float target = std::max((float)targetFrames + AVSync::instance().audio_bias_ms() * sampleRate / 1000.0f,
+                            (float)frames);
+    double drift = std::clamp((target - queuedFramesAverage) / (100.0 * frames),
+                              -MAX_DRIFT_CORRECTION, MAX_DRIFT_CORRECTION);
+    frames = (int)resampler.process(samples, frames, resampleBuffer, baseRatio * (1 + drift));
+    samples = resampleBuffer;
+
+    // Only whole packets, so ring stays aligned to frames
+    size_t count = frames * outputChannelCount;
+    if (ring.capacity() - ring.size() < count) {
+        m_audio_render_stats.dropped_packets++;
+        return;
+    }
+    ring.write(samples, count);
+
+    m_audio_render_stats.queued_time = queuedFramesAverage * 1000.0f / sampleRate;
+    m_audio_render_stats.target_time = target * 1000.0f / sampleRate;
+}
+
+void SDLAudioRenderer::audioCallback(void* userdata, Uint8* stream, int len) {
+    auto self = (SDLAudioRenderer*)userdata;
+    size_t count = len / sizeof(short);
+    size_t read = 0;
+
+    // Wait for queue to be filled again after underrun
+    if (self->buffering)
+        self->buffering = self->ring.size() < (size_t)(self->targetFrames * self->outputChannelCount);
+
+    if (!self->buffering)
+        read = self->ring.read((short*)stream, count);
+
+    if (read < count) {
+        memset((short*)stream + read, 0, (count - read) * sizeof(short));
+
+        if (!self->buffering) {
+            self->m_underruns.fetch_add(1, std::memory_order_relaxed);
+            self->buffering = true;
+        }
     }
-    SDL_QueueAudio(dev, pcmBuffer,
-                    decodeLen * channelCount * sizeof(short));
 }
 
 int SDLAudioRenderer::capabilities() { return CAPABILITY_DIRECT_SUBMIT; }
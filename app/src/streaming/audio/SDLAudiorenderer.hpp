@@ -1,20 +1,29 @@
 #pragma once
 
 #include "IAudioRenderer.hpp"
+#include "OpusResources.hpp"
+#include "PcmProcessing.hpp"
+#include "PcmResampler.hpp"
+#include "PcmRing.hpp"
 
 #include <SDL.h>
 #include <SDL_audio.h>
-#include <opus/opus_multistream.h>
 
-#define MAX_CHANNEL_COUNT 6
+#define MAX_CHANNEL_COUNT 8
 #define FRAME_SIZE 240
 #define FRAME_BUFFER 12
 
-class SDLAudioRenderer : public IAudioRenderer {
+// Callback mode keeps queue at target by changing speed up to 1%
+#define MAX_DRIFT_CORRECTION 0.01
+
+class SDLAudioRenderer final : public IAudioRenderer {
   public:
-    SDLAudioRenderer(){};
+    // Callback mode pulls samples from ring instead of SDL_QueueAudio
+    SDLAudioRenderer(bool callback_mode = false)
+        : callbackMode(callback_mode){};
     ~SDLAudioRenderer(){};
 
+    void prepare() override;
     int init(int audio_configuration,
              const POPUS_MULTISTREAM_CONFIGURATION opus_config, void* context,
              int ar_flags) override;
@@ -23,8 +32,29 @@ class SDLAudioRenderer : public IAudioRenderer {
     int capabilities() override;
 
   private:
-    OpusMSDecoder* decoder;
+    static void audioCallback(void* userdata, Uint8* stream, int len);
+    void playFrame(char* sample_data, int sample_length, bool fec);
+    void queueAudio(short* samples, int frames);
+    void pushAudio(short* samples, int frames);
+
+    bool callbackMode;
+    PcmRing ring;
+    std::atomic<bool> buffering = true;
+    float queuedFramesAverage = 0;
+    int targetFrames = 0;
+    int sampleRate = 0;
+    int frameSize = FRAME_SIZE;
+    bool pendingLoss = false;
+    // Stream rate to device rate, with drift correction on top
+    PcmResampler resampler;
+    double baseRatio = 1.0;
+    short resampleBuffer[((size_t)(FRAME_SIZE * PCM_RESAMPLER_MAX_RATIO) + 2) * MAX_CHANNEL_COUNT];
+
+    OpusMSDecoderPtr decoder;
     short pcmBuffer[FRAME_SIZE * MAX_CHANNEL_COUNT];
+    short downmixBuffer[FRAME_SIZE * MAX_CHANNEL_COUNT];
     SDL_AudioDeviceID dev;
     int channelCount;
+    int outputChannelCount;
+    PcmDownmix downmix;
 };
@@ -0,0 +1,40 @@
+//
+//  AVResources.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <memory>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+}
+
+// Owners of libav objects, so early returns of setup and reconnects don't
+// leave them behind. Each deleter takes nullptr, as libav free functions do
+
+struct AVFrameDeleter {
+    void operator()(AVFrame* frame) const { av_frame_free(&frame); }
+};
+
+struct AVPacketDeleter {
+    void operator()(AVPacket* packet) const { av_packet_free(&packet); }
+};
+
+// Closes codec as well
+struct AVCodecContextDeleter {
+    void operator()(AVCodecContext* context) const { avcodec_free_context(&context); }
+};
+
+// Drops one reference, data goes away with the last one
+struct AVBufferRefDeleter {
+    void operator()(AVBufferRef* buffer) const { av_buffer_unref(&buffer); }
+};
+
+using AVFramePtr = std::unique_ptr<AVFrame, AVFrameDeleter>;
+using AVPacketPtr = std::unique_ptr<AVPacket, AVPacketDeleter>;
+using AVCodecContextPtr = std::unique_ptr<AVCodecContext, AVCodecContextDeleter>;
+using AVBufferRefPtr = std::unique_ptr<AVBufferRef, AVBufferRefDeleter>;
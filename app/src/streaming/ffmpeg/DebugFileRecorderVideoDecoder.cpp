@@ -0,0 +1,58 @@
+#include "DebugFileRecorderVideoDecoder.hpp"
+#include <borealis.hpp>
+
+DebugFileRecorderVideoDecoder::~DebugFileRecorderVideoDecoder() {
+    close();
+    delete m_decoder;
+}
+
+int DebugFileRecorderVideoDecoder::setup(int video_format, int width, int height,
+                                         int redraw_rate, void* context, int dr_flags) {
+    close();
+
+    m_stream = fopen((m_path + ".bin").c_str(), "wb");
+    m_index = fopen((m_path + ".csv").c_str(), "w");
+    if (!m_stream || !m_index) {
+        brls::Logger::error("VideoRecorder: Failed to open {}", m_path);
+        close();
+    } else {
+        fprintf(m_index, "video_format,width,height,fps\n%d,%d,%d,%d\n",
+                video_format, width, height, redraw_rate);
+        fprintf(m_index, "frame,type,receive_ms,offset,length\n");
+        m_offset = 0;
+        brls::Logger::info("VideoRecorder: Recording into {}", m_path);
+    }
+
+    return m_decoder->setup(video_format, width, height, redraw_rate, context, dr_flags);
+}
+
+void DebugFileRecorderVideoDecoder::cleanup() {
+    close();
+    m_decoder->cleanup();
+}
+
+int DebugFileRecorderVideoDecoder::submit_decode_unit(PDECODE_UNIT decode_unit) {
+    if (m_stream) {
+        for (PLENTRY entry = decode_unit->bufferList; entry != nullptr; entry = entry->next)
+            fwrite(entry->data, 1, entry->length, m_stream);
+
+        fprintf(m_index, "%d,%d,%llu,%llu,%d\n", decode_unit->frameNumber,
+                decode_unit->frameType, (unsigned long long)decode_unit->receiveTimeMs,
+                (unsigned long long)m_offset, decode_unit->fullLength);
+        m_offset += decode_unit->fullLength;
+    }
+
+    return m_decoder->submit_decode_unit(decode_unit);
+}
+
+void DebugFileRecorderVideoDecoder::close() {
+    if (m_stream) {
+        fclose(m_stream);
+        m_stream = nullptr;
+    }
+
+    if (m_index) {
+        fclose(m_index);
+        m_index = nullptr;
+    }
+}
@@ -0,0 +1,37 @@
+#include "IVideoDecoder.hpp"
+#include <cstdio>
+#include <string>
+#pragma once
+
+// Passes decode units on to real decoder and dumps them for StreamReplay:
+// <path>.bin keeps elementary stream as host sent it, Annex-B for H.264
+// and HEVC, <path>.csv keeps stream format and per frame index
+class DebugFileRecorderVideoDecoder : public IVideoDecoder {
+  public:
+    // Takes ownership of decoder
+    DebugFileRecorderVideoDecoder(IVideoDecoder* decoder, const std::string& path)
+        : m_decoder(decoder), m_path(path){};
+    ~DebugFileRecorderVideoDecoder();
+
+    void prepare() override { m_decoder->prepare(); }
+    int setup(int video_format, int width, int height, int redraw_rate,
+              void* context, int dr_flags) override;
+    void start() override { m_decoder->start(); }
+    void set_frame_allocator(IVideoFrameAllocator* allocator) override { m_decoder->set_frame_allocator(allocator); }
+    void set_frame_uploader(IVideoFrameUploader* uploader) override { m_decoder->set_frame_uploader(uploader); }
+    void set_frame_holder(AVFrameHolder* holder) override { m_decoder->set_frame_holder(holder); }
+    void stop() override { m_decoder->stop(); }
+    void cleanup() override;
+    int submit_decode_unit(PDECODE_UNIT decode_unit) override;
+    int capabilities() const override { return m_decoder->capabilities(); }
+    VideoDecodeStats video_decode_stats() override { return m_decoder->video_decode_stats(); }
+
+  private:
+    void close();
+
+    IVideoDecoder* m_decoder;
+    std::string m_path;
+    FILE* m_stream = nullptr;
+    FILE* m_index = nullptr;
+    uint64_t m_offset = 0;
+};
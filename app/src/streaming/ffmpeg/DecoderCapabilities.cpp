@@ -0,0 +1,293 @@
+//
+//  DecoderCapabilities.cpp
+//  Moonlight
+//
+
+#include "DecoderCapabilities.hpp"
+#include "FFmpegVideoDecoder.hpp"
+#include "HighResClock.hpp"
+#include <borealis.hpp>
+#include <jansson.h>
+
+// Size decoders are opened with, their limits are checked on open
+#define PROBE_WIDTH 1280
+#define PROBE_HEIGHT 720
+
+static const char* codec_key(VideoCodec codec) {
+    switch (codec) {
+    case H264:
+        return "h264";
+    case H265:
+        return "hevc";
+    case AV1:
+        return "av1";
+    }
+    return "unknown";
+}
+
+static int codec_format(VideoCodec codec) {
+    switch (codec) {
+    case H264:
+        return VIDEO_FORMAT_H264;
+    case H265:
+        return VIDEO_FORMAT_H265;
+    case AV1:
+        return VIDEO_FORMAT_AV1_MAIN8;
+    }
+    return 0;
+}
+
+VideoCodec DecoderCapabilities::codec_for_format(int video_format) {
+    if (video_format & VIDEO_FORMAT_MASK_H265)
+        return H265;
+    if (video_format & VIDEO_FORMAT_MASK_AV1)
+        return AV1;
+    return H264;
+}
+
+std::string DecoderCapabilities::device_key() {
+    AVHWDeviceType type = FFmpegVideoDecoder::hw_device_type();
+    const char* name = type == AV_HWDEVICE_TYPE_NONE ? "none" : av_hwdevice_get_type_name(type);
+    return fmt::format("{}/{}", name ? name : "unknown", avcodec_version());
+}
+
+std::string DecoderCapabilities::measurement_key(VideoCodec codec, bool hardware, int height) {
+    return fmt::format("{}/{}/{}", codec_key(codec), hardware ? "hw" : "sw", height);
+}
+
+static bool open_decoder(const AVCodec* decoder, AVBufferRef* device) {
+    AVCodecContext* context = avcodec_alloc_context3(decoder);
+    if (!context)
+        return false;
+
+    context->width = PROBE_WIDTH;
+    context->height = PROBE_HEIGHT;
+    if (device)
+        context->hw_device_ctx = av_buffer_ref(device);
+
+    bool opened = avcodec_open2(context, decoder, nullptr) >= 0;
+    avcodec_free_context(&context);
+    return opened;
+}
+
+// Decoder has to declare hwaccel for device, otherwise frames
+// would silently come from software path
+static bool has_hw_config(const AVCodec* decoder, AVHWDeviceType type) {
+    for (int i = 0;; i++) {
+        const AVCodecHWConfig* config = avcodec_get_hw_config(decoder, i);
+        if (!config)
+            return false;
+        if (config->device_type == type &&
+            (config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX))
+            return true;
+    }
+}
+
+void DecoderCapabilities::load(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_path = path;
+
+    json_t* root = json_load_file(path.c_str(), 0, nullptr);
+    bool valid = root && json_typeof(root) == JSON_OBJECT;
+
+    // Results of another FFmpeg build or device type are probed again
+    const char* device = valid ? json_string_value(json_object_get(root, "device")) : nullptr;
+    if (device && device == device_key()) {
+        if (json_t* codecs = json_object_get(root, "codecs")) {
+            for (VideoCodec codec : {H264, H265, AV1}) {
+                json_t* json = json_object_get(codecs, codec_key(codec));
+                if (!json)
+                    continue;
+
+                CodecCapability& capability = m_codecs[codec];
+                capability.probed = true;
+                capability.hardware = json_is_true(json_object_get(json, "hardware"));
+                capability.software = json_is_true(json_object_get(json, "software"));
+            }
+        }
+
+        if (json_t* measurements = json_object_get(root, "measurements")) {
+            const char* key;
+            json_t* json;
+            json_object_foreach(measurements, key, json) {
+                DecodeMeasurement& measurement = m_measurements[key];
+                measurement.decoding_ms = (float)json_number_value(json_object_get(json, "decoding_ms"));
+                measurement.sessions = (int)json_integer_value(json_object_get(json, "sessions"));
+            }
+        }
+
+        if (json_t* tunings = json_object_get(root, "tunings")) {
+            const char* key;
+            json_t* json;
+            json_object_foreach(tunings, key, json) {
+                PipelineTuning& tuning = m_tunings[key];
+                tuning.frames_queue_size = (int)json_integer_value(json_object_get(json, "frames_queue_size"));
+                tuning.decoder_threads = (int)json_integer_value(json_object_get(json, "decoder_threads"));
+            }
+        }
+    }
+
+    if (root)
+        json_decref(root);
+
+    if (m_codecs[H264].probed && m_codecs[H265].probed && m_codecs[AV1].probed)
+        return;
+
+    // Creating hardware device takes a while, UI doesn't wait for it
+    brls::async([this] { probe(); });
+}
+
+void DecoderCapabilities::probe() {
+    uint64_t start = HighResClock::now_us();
+
+    AVHWDeviceType type = FFmpegVideoDecoder::hw_device_type();
+    AVBufferRef* device = nullptr;
+#ifndef PLATFORM_ANDROID
+    if (type != AV_HWDEVICE_TYPE_NONE && av_hwdevice_ctx_create(&device, type, nullptr, nullptr, 0) < 0) {
+        brls::Logger::warning("DecoderCapabilities: Couldn't create hardware device");
+        device = nullptr;
+    }
+#endif
+
+    CodecCapability codecs[AV1 + 1];
+    for (VideoCodec codec : {H264, H265, AV1}) {
+        int format = codec_format(codec);
+        CodecCapability& capability = codecs[codec];
+        capability.probed = true;
+
+        if (FFmpegVideoDecoder::hw_decodes_format(format)) {
+            const AVCodec* decoder = FFmpegVideoDecoder::find_decoder(format, true);
+#ifdef PLATFORM_ANDROID
+            // MediaCodec decoders are hardware ones, device comes with surface
+            capability.hardware = decoder != nullptr;
+#else
+            capability.hardware = decoder && device && has_hw_config(decoder, type) &&
+                                  open_decoder(decoder, device);
+#endif
+        }
+
+#ifndef PLATFORM_ANDROID
+        if (const AVCodec* decoder = FFmpegVideoDecoder::find_decoder(format, false))
+            capability.software = open_decoder(decoder, nullptr);
+#endif
+
+        brls::Logger::info("DecoderCapabilities: {} hardware: {}, software: {}",
+                           codec_key(codec), capability.hardware, capability.software);
+    }
+
+    if (device)
+        av_buffer_unref(&device);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (VideoCodec codec : {H264, H265, AV1})
+            m_codecs[codec] = codecs[codec];
+        save();
+    }
+
+    brls::Logger::info("DecoderCapabilities: Probed in {} ms", (HighResClock::now_us() - start) / 1000);
+}
+
+bool DecoderCapabilities::can_decode(VideoCodec codec) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const CodecCapability& capability = m_codecs[codec];
+    return !capability.probed || capability.hardware || capability.software;
+}
+
+bool DecoderCapabilities::hw_decodes(VideoCodec codec) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const CodecCapability& capability = m_codecs[codec];
+    return !capability.probed || capability.hardware;
+}
+
+bool DecoderCapabilities::realtime(VideoCodec codec, int height, int fps) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const CodecCapability& capability = m_codecs[codec];
+    bool hardware = Settings::instance().use_hw_decoding() && (!capability.probed || capability.hardware);
+
+    auto it = m_measurements.find(measurement_key(codec, hardware, height));
+    if (it == m_measurements.end() || fps <= 0)
+        return true;
+
+    return it->second.decoding_ms <= 1000.f / fps * DECODE_REALTIME_LOAD;
+}
+
+VideoCodec DecoderCapabilities::usable_codec(VideoCodec codec) {
+    if (can_decode(codec))
+        return codec;
+
+    for (VideoCodec fallback : {H265, H264, AV1}) {
+        if (can_decode(fallback))
+            return fallback;
+    }
+    return codec;
+}
+
+void DecoderCapabilities::record_session(int video_format, bool hardware, int height, float decoding_ms) {
+    if (decoding_ms <= 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    DecodeMeasurement& measurement =
+        m_measurements[measurement_key(codec_for_format(video_format), hardware, height)];
+
+    measurement.decoding_ms = measurement.sessions == 0
+                                  ? decoding_ms
+                                  : measurement.decoding_ms * 0.5f + decoding_ms * 0.5f;
+    measurement.sessions++;
+    save();
+}
+
+PipelineTuning DecoderCapabilities::tuning(const std::string& host, VideoCodec codec) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_tunings.find(fmt::format("{}/{}", host, codec_key(codec)));
+    return it == m_tunings.end() ? PipelineTuning() : it->second;
+}
+
+void DecoderCapabilities::record_tuning(const std::string& host, VideoCodec codec, const PipelineTuning& tuning) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tunings[fmt::format("{}/{}", host, codec_key(codec))] = tuning;
+    save();
+}
+
+void DecoderCapabilities::save() {
+    if (m_path.empty())
+        return;
+
+    json_t* root = json_object();
+    json_object_set_new(root, "device", json_string(device_key().c_str()));
+
+    json_t* codecs = json_object();
+    for (VideoCodec codec : {H264, H265, AV1}) {
+        const CodecCapability& capability = m_codecs[codec];
+        if (!capability.probed)
+            continue;
+
+        json_t* json = json_object();
+        json_object_set_new(json, "hardware", json_boolean(capability.hardware));
+        json_object_set_new(json, "software", json_boolean(capability.software));
+        json_object_set_new(codecs, codec_key(codec), json);
+    }
+    json_object_set_new(root, "codecs", codecs);
+
+    json_t* measurements = json_object();
+    for (auto& [key, measurement] : m_measurements) {
+        json_t* json = json_object();
+        json_object_set_new(json, "decoding_ms", json_real(measurement.decoding_ms));
+        json_object_set_new(json, "sessions", json_integer(measurement.sessions));
+        json_object_set_new(measurements, key.c_str(), json);
+    }
+    json_object_set_new(root, "measurements", measurements);
+
+    json_t* tunings = json_object();
+    for (auto& [key, tuning] : m_tunings) {
+        json_t* json = json_object();
+        json_object_set_new(json, "frames_queue_size", json_integer(tuning.frames_queue_size));
+        json_object_set_new(json, "decoder_threads", json_integer(tuning.decoder_threads));
+        json_object_set_new(tunings, key.c_str(), json);
+    }
+    json_object_set_new(root, "tunings", tunings);
+
+    json_dump_file(root, m_path.c_str(), JSON_COMPACT);
+    json_decref(root);
+}
@@ -0,0 +1,69 @@
+//
+//  DecoderCapabilities.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "PipelineTuner.hpp"
+#include "Settings.hpp"
+#include "Singleton.hpp"
+#include <map>
+#include <mutex>
+#include <string>
+
+// Decoder has to take no more than this share of frame interval
+#define DECODE_REALTIME_LOAD 0.8f
+// Shorter sessions don't give a stable decoding time
+#define DECODE_MEASURE_MIN_FRAMES 600
+
+struct CodecCapability {
+    bool probed = false;
+    bool hardware = false;
+    bool software = false;
+};
+
+struct DecodeMeasurement {
+    // Average of past sessions, newer ones weigh more
+    float decoding_ms = 0;
+    int sessions = 0;
+};
+
+// What this device decodes, kept in a file so it's known before stream.
+// Decoders are probed once per FFmpeg build and hardware device type.
+// Whether resolution decodes in real time is learned from real
+// sessions, there is no sample clip to measure it with
+class DecoderCapabilities : public Singleton<DecoderCapabilities> {
+  public:
+    // Loads cached results, probes decoders in background when they are
+    // missing or were made by another FFmpeg build
+    void load(const std::string& path);
+
+    // Unknown codec or resolution is taken as supported
+    bool can_decode(VideoCodec codec);
+    // False when probe found no hardware decoder, stream falls back to software
+    bool hw_decodes(VideoCodec codec);
+    bool realtime(VideoCodec codec, int height, int fps);
+    // Requested codec, or first decodable one instead of it
+    VideoCodec usable_codec(VideoCodec codec);
+
+    void record_session(int video_format, bool hardware, int height, float decoding_ms);
+
+    // Queue depth and threads auto tuning picked for host and codec
+    PipelineTuning tuning(const std::string& host, VideoCodec codec);
+    void record_tuning(const std::string& host, VideoCodec codec, const PipelineTuning& tuning);
+
+    static VideoCodec codec_for_format(int video_format);
+
+  private:
+    void probe();
+    void save();
+    static std::string device_key();
+    static std::string measurement_key(VideoCodec codec, bool hardware, int height);
+
+    std::mutex m_mutex;
+    std::string m_path;
+    CodecCapability m_codecs[AV1 + 1];
+    std::map<std::string, DecodeMeasurement> m_measurements;
+    std::map<std::string, PipelineTuning> m_tunings;
+};
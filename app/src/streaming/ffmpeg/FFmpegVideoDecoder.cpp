@@ -1,7 +1,24 @@
 #include "FFmpegVideoDecoder.hpp"
 #include "AVFrameHolder.hpp"
+#include "AsyncLog.hpp"
+#include "DecoderCapabilities.hpp"
+#include "FrameTracer.hpp"
+#include "LatencyProbe.hpp"
+#include "Log.hpp"
+#include "MemoryAccounting.hpp"
+#include "HighResClock.hpp"
+#include "PerformanceHints.hpp"
+#include "PipelineTrace.hpp"
 #include "Settings.hpp"
+#include "StreamPercentiles.hpp"
+#include "ThreadAffinity.hpp"
+#include "ThreadProfiler.hpp"
 #include "borealis.hpp"
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/opt.h>
+}
 
 #ifdef PLATFORM_APPLE
 extern "C" {
@@ -13,18 +30,65 @@ extern "C" {
 #define DISABLE_LOOP_FILTER 0x1
 // Uses the low latency decode flag (disables multithreading)
 #define LOW_LATENCY_DECODE 0x2
-
-//#if defined(PLATFORM_TVOS)
-//#define DECODER_BUFFER_SIZE 92 * 1024 * 4
-//#else
-//#define DECODER_BUFFER_SIZE 92 * 1024 * 2
-//#endif
+// Passes decode units which are already contiguous in memory to FFmpeg
+// without copying them into the intermediate buffer. FFmpeg may read up to
+// AV_INPUT_BUFFER_PADDING_SIZE past the end of packet data, and buffers owned
+// by moonlight-common-c are not guaranteed to have that padding, so keep it
+// opt-in until it was validated on every platform.
+#define ZERO_COPY_SUBMIT 0x4
+
+// Initial size of packet buffers, they grow to the largest frame seen
 #define DECODER_BUFFER_SIZE (1024 * 1024)
+// Packet buffers could still be referenced by decoder while next frame
+// comes in, so keep a few of them to reuse without reallocation
+#define DECODER_BUFFER_POOL_SIZE 3
+// Low memory profile starts with smaller buffers and one spare
+#define LOW_MEMORY_DECODER_BUFFER_SIZE (256 * 1024)
+#define LOW_MEMORY_DECODER_BUFFER_POOL_SIZE 1
+// Frames waiting for dedicated decoder thread, anything above that is dropped
+#define DECODE_QUEUE_SIZE 2
+// Consecutive corrupt frames after which waiting for RFI to heal stream
+// is given up and IDR is requested, not more often than the interval
+#define RECOVERY_CORRUPT_FRAMES 3
+#define IDR_REQUEST_INTERVAL_US 500000
+// Decoding is behind when this many frames wait for it and unit arrives
+// this many frame intervals, at least min ms, after it was received.
+// Units up to IDR are skipped then instead of fast-forwarding
+#define DECODE_BACKLOG_FRAMES 4
+#define DECODE_BACKLOG_MIN_MS 100
+// IDR request is repeated while skipping, it could be lost as well
+#define DECODE_BACKLOG_IDR_RETRY_US 250000
+
+// MediaCodec implementations differ in how they handle frames referencing
+// invalidated ones, other decoders skip over them
+#if !defined(PLATFORM_ANDROID)
+#define DECODER_TOLERATES_RFI
+#endif
+
+// Automatic threading moves to frame threads once slice threads fail to
+// decode within this share of frame interval for several stats windows
+#define SLICE_THREADING_LOAD 0.9f
+#define SLICE_THREADING_SLOW_WINDOWS 8
+// Software decoder sheds work one mode at a time once packets take this
+// share of frame interval for few windows, and goes back one mode after
+// load stays under recovery share for longer than that
+#define OVERLOAD_LOAD 0.95f
+#define OVERLOAD_SLOW_WINDOWS 3
+#define OVERLOAD_RECOVER_LOAD 0.6f
+#define OVERLOAD_RECOVER_WINDOWS 16
+
+// Renderer takes hardware frames as they are, without copy to system memory
+#if defined(BOREALIS_USE_DEKO3D) || defined(PLATFORM_ANDROID) || defined(USE_METAL_RENDERER) || defined(USE_DRM_PRIME_IMPORT)
+#define HW_FRAME_PASSTHROUGH
+#endif
 
 #if defined(PLATFORM_ANDROID)
+#include "MediaCodecSurface.hpp"
 #include <jni.h>
+extern "C" {
 #include <libavcodec/jni.h>
 #include <libavutil/hwcontext_mediacodec.h>
+}
 
 //static JavaVM *mJavaVM = NULL;
 //JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved)
@@ -42,27 +106,136 @@ FFmpegVideoDecoder::FFmpegVideoDecoder() {
 //    av_hwdevice_ctx_init(deviceRef);
 }
 
-FFmpegVideoDecoder::~FFmpegVideoDecoder() = default;
-
 void ffmpegLog(void* ptr, int level, const char* fmt, va_list vargs) {
-    std::string message;
-    va_list ap_copy;
-    va_copy(ap_copy, vargs);
-    size_t len = vsnprintf(nullptr, 0, fmt, ap_copy);
-    message.resize(len + 1);  // need space for NUL
-    vsnprintf(&message[0], len + 1,fmt, vargs);
-    message.resize(len);  // remove the NUL
-    brls::Logger::debug("FFmpeg [LOG]: {}", message.c_str());
+    // Filtered before formatting, most of FFmpeg output is verbose
+    if (level > av_log_get_level())
+        return;
+
+    AsyncLogLevel log_level = level <= AV_LOG_ERROR     ? ASYNC_LOG_ERROR
+                              : level <= AV_LOG_WARNING ? ASYNC_LOG_WARNING
+                                                        : ASYNC_LOG_DEBUG;
+    AsyncLog::instance().log(log_level, "FFmpeg [LOG]: ", fmt, vargs);
+}
+
+static const char* video_format_name(int video_format) {
+    if (video_format & VIDEO_FORMAT_MASK_H264)
+        return "H264";
+    if (video_format & VIDEO_FORMAT_MASK_H265)
+        return "HEVC";
+    if (video_format & VIDEO_FORMAT_MASK_AV1)
+        return "AV1";
+    return "Unknown";
+}
+
+AVHWDeviceType FFmpegVideoDecoder::hw_device_type() {
+#if defined(PLATFORM_SWITCH)
+    return AV_HWDEVICE_TYPE_NVTEGRA;
+#elif defined(PLATFORM_ANDROID)
+    return AV_HWDEVICE_TYPE_MEDIACODEC;
+#elif defined(PLATFORM_APPLE)
+    return AV_HWDEVICE_TYPE_VIDEOTOOLBOX;
+#elif defined(USE_DRM_PRIME_IMPORT)
+    return AV_HWDEVICE_TYPE_VAAPI;
+#elif defined(_WIN32)
+    // Decoded surfaces are copied into pooled frames GL uploads from
+    return AV_HWDEVICE_TYPE_D3D11VA;
+#else
+    return AV_HWDEVICE_TYPE_NONE;
+#endif
+}
+
+bool FFmpegVideoDecoder::hw_decodes_format(int video_format) {
+    if (hw_device_type() == AV_HWDEVICE_TYPE_NONE)
+        return false;
+#if defined(PLATFORM_SWITCH)
+    // Tegra X1 has no AV1 decoding block
+    if (video_format & VIDEO_FORMAT_MASK_AV1)
+        return false;
+#endif
+    return true;
+}
+
+const AVCodec* FFmpegVideoDecoder::find_decoder(int video_format, bool hw_decoding) {
+    const AVCodec* decoder = nullptr;
+#ifdef PLATFORM_ANDROID
+    if (video_format & VIDEO_FORMAT_MASK_H264) {
+        decoder = avcodec_find_decoder_by_name("h264_mediacodec");
+    } else if (video_format & VIDEO_FORMAT_MASK_H265) {
+        decoder = avcodec_find_decoder_by_name("hevc_mediacodec");
+    } else if (video_format & VIDEO_FORMAT_MASK_AV1) {
+        // Only exposed by devices with AV1 capable MediaCodec
+        decoder = avcodec_find_decoder_by_name("av1_mediacodec");
+    } else {
+        // Unsupported decoder type
+    }
+#else
+    if (video_format & VIDEO_FORMAT_MASK_H264) {
+        decoder = avcodec_find_decoder(AV_CODEC_ID_H264);
+    } else if (video_format & VIDEO_FORMAT_MASK_H265) {
+        decoder = avcodec_find_decoder(AV_CODEC_ID_HEVC);
+    } else if (video_format & VIDEO_FORMAT_MASK_AV1) {
+        // Native AV1 decoder only works through hwaccel,
+        // dav1d is the software one
+        if (hw_decoding)
+            decoder = avcodec_find_decoder_by_name("av1");
+        else
+            decoder = avcodec_find_decoder_by_name("libdav1d");
+
+        if (decoder == nullptr)
+            decoder = avcodec_find_decoder(AV_CODEC_ID_AV1);
+    } else {
+        // Unsupported decoder type
+    }
+#endif
+    return decoder;
+}
+
+void FFmpegVideoDecoder::prepare() {
+    uint64_t start = HighResClock::now_us();
+
+    // MediaCodec takes its output surface on open, so it waits for setup
+#ifndef PLATFORM_ANDROID
+    AVHWDeviceType hwType = hw_device_type();
+    if (Settings::instance().use_hw_decoding() && hwType != AV_HWDEVICE_TYPE_NONE && !hw_device_ctx) {
+        if (create_hw_device(hwType) < 0)
+            brls::Logger::warning("FFmpeg: Couldn't prepare hardware device");
+    }
+#endif
+
+    if (m_packet_buffers.empty() && allocate_packet_buffers() < 0)
+        brls::Logger::warning("FFmpeg: Couldn't prepare packet buffers");
+
+    brls::Logger::info("FFmpeg: Prepared in {} ms", (HighResClock::now_us() - start) / 1000);
+}
+
+int FFmpegVideoDecoder::allocate_packet_buffers() {
+    bool low_memory = Settings::instance().low_memory();
+    int count = (low_memory ? LOW_MEMORY_DECODER_BUFFER_POOL_SIZE : DECODER_BUFFER_POOL_SIZE) + DECODE_QUEUE_SIZE;
+    size_t size = low_memory ? LOW_MEMORY_DECODER_BUFFER_SIZE : DECODER_BUFFER_SIZE;
+
+    m_next_packet_buffer = 0;
+    for (int i = 0; i < count; i++) {
+        AVBufferRef* buffer =
+            av_buffer_alloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (buffer == nullptr) {
+            brls::Logger::error("FFmpeg: Not enough memory");
+            return -1;
+        }
+        m_packet_buffers.emplace_back(buffer);
+        MemoryAccounting::add(MEM_PACKET_BUFFERS, buffer->size);
+    }
+    return 0;
 }
 
 int FFmpegVideoDecoder::setup(int video_format, int width, int height,
                               int redraw_rate, void* context, int dr_flags) {
     m_stream_fps = redraw_rate;
+    m_backlog_skipping = false;
 
     brls::Logger::debug("FFMpeg's AVCodec version: {}.{}.{}", AV_VERSION_MAJOR(avcodec_version()), AV_VERSION_MINOR(avcodec_version()), AV_VERSION_MICRO(avcodec_version()));
     brls::Logger::info(
         "FFmpeg: Setup with format: {}, width: {}, height: {}, fps: {}",
-        video_format == VIDEO_FORMAT_H264 ? "H264" : "HEVC", width, height,
+        video_format_name(video_format), width, height,
         redraw_rate);
 
     av_log_set_level(AV_LOG_WARNING);
@@ -71,44 +244,183 @@ int FFmpegVideoDecoder::setup(int video_format, int width, int height,
     avcodec_register_all();
 #endif
 
-    m_packet = av_packet_alloc();
+    m_packet.reset(av_packet_alloc());
 
     int perf_lvl = LOW_LATENCY_DECODE;
+    m_perf_lvl = perf_lvl;
 
-#ifdef PLATFORM_ANDROID
-    if (video_format & VIDEO_FORMAT_MASK_H264) {
-        m_decoder = avcodec_find_decoder_by_name("h264_mediacodec");
-    } else if (video_format & VIDEO_FORMAT_MASK_H265) {
-        m_decoder = avcodec_find_decoder_by_name("hevc_mediacodec");
+    AVHWDeviceType hwType = hw_device_type();
+    m_hw_decoding = Settings::instance().use_hw_decoding() && hw_decodes_format(video_format) &&
+                    DecoderCapabilities::instance().hw_decodes(DecoderCapabilities::codec_for_format(video_format));
+    m_decoder = find_decoder(video_format, m_hw_decoding);
+
+    if (m_decoder == nullptr) {
+        brls::Logger::error("FFmpeg: Couldn't find {} decoder", video_format_name(video_format));
+        return -1;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_slow_windows = 0;
+    m_overload_mode = DECODER_OVERLOAD_NONE;
+    m_overload_windows = 0;
+    m_window_packets = 0;
+
+    int decoder_threads = Settings::instance().decoder_threads();
+    DecoderThreading threading = Settings::instance().decoder_threading();
+
+    // Single threaded decoding has nothing to choose from
+    if (decoder_threads == 0 || m_hw_decoding) {
+        m_thread_type = FF_THREAD_FRAME;
+        m_thread_count = 1;
+        m_auto_threading = false;
     } else {
-        // Unsupported decoder type
+        // Frame threads add a frame of latency per thread,
+        // so automatic mode starts with slices
+        m_thread_type = threading == DECODER_THREADING_FRAME ? FF_THREAD_FRAME : FF_THREAD_SLICE;
+        m_thread_count = decoder_threads;
+        m_auto_threading = threading == DECODER_THREADING_AUTO;
     }
-#else
-    if (video_format & VIDEO_FORMAT_MASK_H264) {
-        m_decoder = avcodec_find_decoder(AV_CODEC_ID_H264);
-    } else if (video_format & VIDEO_FORMAT_MASK_H265) {
-        m_decoder = avcodec_find_decoder(AV_CODEC_ID_HEVC);
+
+    int err;
+    if (!m_hw_decoding && hw_device_ctx) {
+        // Prepared device isn't used by this format
+        hw_device_ctx.reset();
+    }
+
+    if (m_hw_decoding) {
+        // Device has to be known before codec is opened, MediaCodec
+        // picks its output mode on open
+        if (!hw_device_ctx && (err = create_hw_device(hwType)) < 0) {
+            char error[512];
+            av_strerror(err, error, sizeof(error));
+            brls::Logger::error("FFmpeg: Error initializing hardware decoder - {}", error);
+            return -1;
+        }
     } else {
-        // Unsupported decoder type
+        brls::Logger::warning("FFmpeg: HW decoding disabled or unsupported by Platform");
     }
+
+    // One extra frame for decoding processing, hardware surfaces are
+    // about the same size as system ones, so budget limits both
+    AVPixelFormat sw_format = video_format & VIDEO_FORMAT_MASK_10BIT ? AV_PIX_FMT_P010 : AV_PIX_FMT_NV12;
+    size_t budget = (size_t)Settings::instance().surface_budget() << 20;
+    size_t surface_size = SurfacePool::surface_size(sw_format, width, height);
+    m_frames_size = Settings::instance().stream().frames_queue_size + 1;
+    if (surface_size > 0)
+        m_frames_size = std::clamp((int)(budget / surface_size), SURFACE_COUNT_MIN, m_frames_size);
+
+    err = open_codec();
+    if (err < 0)
+        return err;
+
+    m_frame_holder->prepare(m_frames_size - 1, redraw_rate);
+    FrameTracer::instance().reset();
+
+    // Frames of previous stream go away here if it failed before cleanup
+    m_frames.clear();
+    m_frames.resize(m_frames_size);
+
+#ifndef HW_FRAME_PASSTHROUGH
+    bool transfer = m_hw_decoding;
+#else
+    bool transfer = false;
 #endif
+    if (transfer && m_surface_pool.init(sw_format, width, height, m_frames_size, budget) == 0)
+        return -1;
 
-    if (m_decoder == nullptr) {
-        brls::Logger::error("FFmpeg: Couldn't find decoder");
+    tmp_frame.reset(av_frame_alloc());
+    for (auto& owned : m_frames) {
+        owned.reset(av_frame_alloc());
+        AVFrame* frame = owned.get();
+        if (frame == nullptr) {
+            brls::Logger::error("FFmpeg: Couldn't allocate frame");
+            return -1;
+        }
+
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+        frame->format = AV_PIX_FMT_NVTEGRA;
+#elif defined(PLATFORM_ANDROID)
+        frame->format = AV_PIX_FMT_MEDIACODEC;
+#else
+        if (video_format & VIDEO_FORMAT_MASK_10BIT)
+            frame->format = AV_PIX_FMT_P010;
+        else
+            frame->format = AV_PIX_FMT_NV12;
+#endif
+        frame->width  = width;
+        frame->height = height;
+
+        // Hardware frames are copied into aligned pooled surfaces
+        if (transfer && (err = m_surface_pool.attach(frame)) < 0) {
+            char errs[64];
+            brls::Logger::error("FFmpeg: Couldn't allocate frame buffer: {}", av_make_error_string(errs, 64, err));
+            return -1;
+        }
+    }
+
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+    // Ring frames take scaled surfaces, decoder ones are released right away
+    int scaled_width, scaled_height;
+    m_vic_scaler.cleanup();
+    if (Settings::instance().vic_scaling() && hw_device_ctx &&
+        VicScaler::output_size(width, height, &scaled_width, &scaled_height))
+        m_vic_scaler.init(hw_device_ctx.get(), sw_format, scaled_width, scaled_height, m_frames_size);
+#endif
+
+    // Usually already there from prepare()
+    m_next_packet_buffer = 0;
+    if (m_packet_buffers.empty() && allocate_packet_buffers() < 0) {
+        cleanup();
         return -1;
     }
 
-    m_decoder_context = avcodec_alloc_context3(m_decoder);
+    brls::Logger::info("FFmpeg: Setup done!");
+    return DR_OK;
+}
+
+int FFmpegVideoDecoder::create_hw_device(AVHWDeviceType type) {
+#ifdef PLATFORM_ANDROID
+    // With output surface MediaCodec renders frames straight into GL texture,
+    // without it every frame is copied back into system memory
+    jobject surface = Settings::instance().direct_surface() ? MediaCodecSurface::instance().acquire() : nullptr;
+    if (surface) {
+        hw_device_ctx.reset(av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_MEDIACODEC));
+        if (!hw_device_ctx)
+            return AVERROR(ENOMEM);
+
+        auto device = (AVHWDeviceContext*)hw_device_ctx->data;
+        auto hwctx = (AVMediaCodecDeviceContext*)device->hwctx;
+        hwctx->surface = surface;
+
+        int err = av_hwdevice_ctx_init(hw_device_ctx.get());
+        if (err < 0) {
+            hw_device_ctx.reset();
+            return err;
+        }
+
+        brls::Logger::info("FFmpeg: MediaCodec renders into surface");
+        return 0;
+    }
+#endif
+
+    AVBufferRef* device = nullptr;
+    int err = av_hwdevice_ctx_create(&device, type, nullptr, nullptr, 0);
+    hw_device_ctx.reset(device);
+    return err;
+}
+
+int FFmpegVideoDecoder::open_codec() {
+    m_decoder_context.reset(avcodec_alloc_context3(m_decoder));
     if (m_decoder_context == nullptr) {
         brls::Logger::error("FFmpeg: Couldn't allocate context");
         return -1;
     }
 
-    if (perf_lvl & DISABLE_LOOP_FILTER)
-        // Skip the loop filter for performance reasons
-        m_decoder_context->skip_loop_filter = AVDISCARD_ALL;
+    apply_overload_mode();
 
-    if (perf_lvl & LOW_LATENCY_DECODE)
+    // Low delay flag makes FFmpeg ignore frame threads
+    if ((m_perf_lvl & LOW_LATENCY_DECODE) && !frame_threaded())
         // Use low delay single threaded encoding
         m_decoder_context->flags |= AV_CODEC_FLAG_LOW_DELAY;
 
@@ -117,18 +429,11 @@ int FFmpegVideoDecoder::setup(int video_format, int width, int height,
 
     m_decoder_context->flags2 |= AV_CODEC_FLAG2_FAST;
 
-    int decoder_threads = Settings::instance().decoder_threads();
-
-    if (decoder_threads == 0 || Settings::instance().use_hw_decoding()) {
-        m_decoder_context->thread_type = FF_THREAD_FRAME;
-        m_decoder_context->thread_count = 1;
-    } else {
-        m_decoder_context->thread_type = FF_THREAD_SLICE;
-        m_decoder_context->thread_count = decoder_threads;
-    }
+    m_decoder_context->thread_type = m_thread_type;
+    m_decoder_context->thread_count = m_thread_count;
 
-    m_decoder_context->width = width;
-    m_decoder_context->height = height;
+    m_decoder_context->width = m_width;
+    m_decoder_context->height = m_height;
 #ifdef PLATFORM_SWITCH
 #ifdef BOREALIS_USE_DEKO3D
    m_decoder_context->pix_fmt = AV_PIX_FMT_NVTEGRA;
@@ -139,7 +444,21 @@ int FFmpegVideoDecoder::setup(int video_format, int width, int height,
 //    m_decoder_context->pix_fmt = AV_PIX_FMT_NV12;
 #endif
 
-    int err = avcodec_open2(m_decoder_context, m_decoder, nullptr);
+    // Let dav1d give frame out as soon as it is decoded
+    if (strcmp(m_decoder->name, "libdav1d") == 0)
+        av_opt_set_int(m_decoder_context->priv_data, "max_frame_delay", 1, 0);
+
+    if (hw_device_ctx) {
+        m_decoder_context->hw_device_ctx = av_buffer_ref(hw_device_ctx.get());
+        // Queued frames keep their hardware surfaces when passed through
+        m_decoder_context->extra_hw_frames = m_frames_size;
+    } else if (m_frame_allocator && (m_decoder->capabilities & AV_CODEC_CAP_DR1)) {
+        // Software decoder writes into memory renderer samples directly
+        m_decoder_context->opaque = this;
+        m_decoder_context->get_buffer2 = get_buffer;
+    }
+
+    int err = avcodec_open2(m_decoder_context.get(), m_decoder, nullptr);
     if (err < 0) {
         char error[512];
         av_strerror(err, error, sizeof(error));
@@ -147,293 +466,605 @@ int FFmpegVideoDecoder::setup(int video_format, int width, int height,
         return err;
     }
 
-    AVFrameHolder::instance().prepare();
-
-    // One extra frame for decoding processing
-    m_frames_size = Settings::instance().frames_queue_size() + 1;
-    m_frames = new AVFrame*[m_frames_size];
+    brls::Logger::info("FFmpeg: Decoding with {} {} threads", m_thread_count,
+                       m_thread_type == FF_THREAD_FRAME ? "frame" : "slice");
+    return 0;
+}
 
-    tmp_frame = av_frame_alloc();
-    for (int i = 0; i < m_frames_size; i++) {
-        auto& frame = m_frames[i];
-        frame = av_frame_alloc();
-        if (frame == nullptr) {
-            brls::Logger::error("FFmpeg: Couldn't allocate frame");
-            return -1;
-        }
+int FFmpegVideoDecoder::get_buffer(AVCodecContext* context, AVFrame* frame, int flags) {
+    auto decoder = (FFmpegVideoDecoder*)context->opaque;
+    if (decoder->m_frame_allocator->get_buffer(context, frame) == 0)
+        return 0;
+    // Allocator is out of frames or doesn't take this format
+    return avcodec_default_get_buffer2(context, frame, flags);
+}
 
-#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
-        frame->format = AV_PIX_FMT_NVTEGRA;
-#elif defined(PLATFORM_ANDROID)
-        frame->format = AV_PIX_FMT_MEDIACODEC;
-#else
-        if (video_format & VIDEO_FORMAT_MASK_10BIT)
-            frame->format = AV_PIX_FMT_P010;
-        else
-            frame->format = AV_PIX_FMT_NV12;
-#endif
-        frame->width  = width;
-        frame->height = height;
+bool FFmpegVideoDecoder::frame_threaded() const {
+    return m_thread_type == FF_THREAD_FRAME && m_thread_count != 1;
+}
 
-// Need to align Switch frame to 256, need to de reviewed
-#if defined(PLATFORM_SWITCH) && !defined(BOREALIS_USE_DEKO3D)
-        int err = av_frame_get_buffer(frame, 256);
-        if (err < 0) {
-            char errs[64]; 
-            brls::Logger::error("FFmpeg: Couldn't allocate frame buffer: {}", av_make_error_string(errs, 64, err));
-            return -1;
-        }
+void FFmpegVideoDecoder::check_threading(float decoding_time) {
+    if (!m_auto_threading || m_thread_type == FF_THREAD_FRAME)
+        return;
 
-        for (int j = 0; j < 2; j++) {
-            uintptr_t ptr = (uintptr_t)frame->data[j];
-            uintptr_t dst = (((ptr)+(256)-1)&~((256)-1));
-            uintptr_t gap = dst - ptr;
-            frame->data[j] += gap;
-        }
-#endif
+    float frame_interval = 1000.0f / m_stream_fps;
+    if (decoding_time < frame_interval * SLICE_THREADING_LOAD) {
+        m_slow_windows = 0;
+        return;
     }
 
-    m_ffmpeg_buffer =
-        (char*)malloc(DECODER_BUFFER_SIZE + AV_INPUT_BUFFER_PADDING_SIZE);
-    if (m_ffmpeg_buffer == nullptr) {
-        brls::Logger::error("FFmpeg: Not enough memory");
-        cleanup();
-        return -1;
+    if (++m_slow_windows < SLICE_THREADING_SLOW_WINDOWS)
+        return;
+
+    brls::Logger::warning("FFmpeg: Slice threads need {:.2f} ms per {:.2f} ms frame, switching to frame threads",
+                          decoding_time, frame_interval);
+
+    m_decoder_context.reset();
+
+    m_thread_type = FF_THREAD_FRAME;
+    if (open_codec() < 0) {
+        brls::Logger::error("FFmpeg: Couldn't reopen decoder with frame threads");
+        return;
     }
 
-#if defined(PLATFORM_SWITCH)
-        AVHWDeviceType hwType = AV_HWDEVICE_TYPE_NVTEGRA;
-#elif defined(PLATFORM_ANDROID)
-        AVHWDeviceType hwType = AV_HWDEVICE_TYPE_MEDIACODEC;
-#elif defined(PLATFORM_APPLE)
-        AVHWDeviceType hwType = AV_HWDEVICE_TYPE_VIDEOTOOLBOX;
-#else
-        AVHWDeviceType hwType = AV_HWDEVICE_TYPE_NONE;
-#endif
+    // New decoder has no reference frames
+    LiRequestIdrFrame();
+}
 
-    if (Settings::instance().use_hw_decoding() && hwType != AV_HWDEVICE_TYPE_NONE) {
-        if ((err = av_hwdevice_ctx_create(&hw_device_ctx, hwType, nullptr, nullptr, 0)) < 0) {
-            char error[512];
-            av_strerror(err, error, sizeof(error));
-            brls::Logger::error("FFmpeg: Error initializing hardware decoder - {}", error);
-            return -1;
-        }
-        m_decoder_context->hw_device_ctx = av_buffer_ref(hw_device_ctx);
+void FFmpegVideoDecoder::check_overload(float packet_time) {
+    if (m_hw_decoding)
+        return;
+
+    float frame_interval = 1000.0f / m_stream_fps;
+    DecoderOverloadMode mode = m_overload_mode;
+
+    if (packet_time >= frame_interval * OVERLOAD_LOAD) {
+        // Going up, windows below count as recovery only from zero
+        m_overload_windows = std::max(m_overload_windows, 0) + 1;
+        if (m_overload_windows < OVERLOAD_SLOW_WINDOWS || mode == DECODER_OVERLOAD_FLUSH_QUEUE)
+            return;
+        mode = (DecoderOverloadMode)(mode + 1);
+    } else if (packet_time < frame_interval * OVERLOAD_RECOVER_LOAD && mode != DECODER_OVERLOAD_NONE) {
+        m_overload_windows = std::min(m_overload_windows, 0) - 1;
+        if (m_overload_windows > -OVERLOAD_RECOVER_WINDOWS)
+            return;
+        mode = (DecoderOverloadMode)(mode - 1);
     } else {
-        brls::Logger::warning("FFmpeg: HW decoding disabled or unsupported by Platform");
+        m_overload_windows = 0;
+        return;
     }
 
-    brls::Logger::info("FFmpeg: Setup done!");
-    return DR_OK;
+    brls::Logger::warning("FFmpeg: Decoding takes {:.2f} ms per {:.2f} ms frame, overload mode {} -> {}",
+                          packet_time, frame_interval, (int)m_overload_mode, (int)mode);
+    m_overload_windows = 0;
+    m_overload_mode = mode;
+    apply_overload_mode();
+}
+
+void FFmpegVideoDecoder::apply_overload_mode() {
+    // Both fields are read per frame, so they change without reopening
+    DecoderOverloadMode mode = m_overload_mode;
+    bool skip_loop_filter = (m_perf_lvl & DISABLE_LOOP_FILTER) || mode >= DECODER_OVERLOAD_SKIP_LOOP_FILTER;
+    m_decoder_context->skip_loop_filter = skip_loop_filter ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    // Nothing references these frames, so skipping them costs only smoothness
+    m_decoder_context->skip_frame = mode >= DECODER_OVERLOAD_SKIP_NONREF ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
 }
 
 void FFmpegVideoDecoder::cleanup() {
     brls::Logger::info("FFmpeg: Cleanup...");
 
-    av_packet_free(&m_packet);
+    m_packet.reset();
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+    m_vic_scaler.cleanup();
+#endif
+    hw_device_ctx.reset();
 
-    if (hw_device_ctx) {
-        av_buffer_unref(&hw_device_ctx);
+#ifdef PLATFORM_ANDROID
+    MediaCodecSurface::instance().release();
+#endif
+
+    m_decoder_context.reset();
+    m_frames.clear();
+    tmp_frame.reset();
+    for (auto& buffer : m_packet_buffers)
+        MemoryAccounting::remove(MEM_PACKET_BUFFERS, buffer->size);
+    m_packet_buffers.clear();
+
+    m_surface_pool.cleanup();
+    MemoryAccounting::set(MEM_DECODER_SURFACES, 0);
+    m_frame_holder->cleanup();
+
+    brls::Logger::info("FFmpeg: Cleanup done!");
+}
+
+int FFmpegVideoDecoder::submit_decode_unit(PDECODE_UNIT decode_unit) {
+    std::unique_lock<std::mutex> lock(m_decode_lock);
+    track_decode_unit(decode_unit);
+    if (skip_backlog(decode_unit))
+        return DR_OK;
+
+    if (m_decode_running && (int)m_decode_queue.size() >= DECODE_QUEUE_SIZE) {
+        // Decoder thread can't keep up, skip till next IDR instead of
+        // growing latency with every new frame
+        CLOG_WARNING_LIMITED(LOG_DECODE, "FFmpeg: Decode queue is full, dropping frame {}", decode_unit->frameNumber);
+        m_video_decode_stats_progress.network_dropped_frames++;
+
+        if (m_overload_mode == DECODER_OVERLOAD_FLUSH_QUEUE) {
+            // Queued frames are late already, IDR is shown right after
+            // decoder gets to it instead of after them
+            m_video_decode_stats_progress.network_dropped_frames += m_decode_queue.size();
+            m_decode_queue.clear();
+        }
+        return DR_NEED_IDR;
+    }
+
+    int length = 0;
+    AVBufferRef* buffer = nullptr;
+    // Decode unit memory is only valid until we return, so decoder thread
+    // always gets its own copy
+    char* data = assemble_decode_unit(decode_unit, &length, &buffer, !m_decode_running);
+    if (data == nullptr) {
+        CLOG_ERROR_LIMITED(LOG_DECODE, "FFmpeg: Not enough memory for frame of {} bytes", decode_unit->fullLength);
+        return DR_NEED_IDR;
     }
 
-    if (m_decoder_context) {
-        avcodec_close(m_decoder_context);
-        av_free(m_decoder_context);
-        m_decoder_context = nullptr;
+    // Receive time is only known in milliseconds
+    uint64_t receive_time_us = (LiGetMillis() - decode_unit->receiveTimeMs) * 1000;
+    m_video_decode_stats_progress.current_reassembly_time_us += receive_time_us;
+    StreamPercentiles::instance().record(STREAM_STAT_RECEIVE, receive_time_us);
+
+    DecodeJob job = { AVBufferRefPtr(buffer ? av_buffer_ref(buffer) : nullptr), data, length,
+                      decode_unit->frameNumber, decode_unit->frameType };
+    if (m_decode_running) {
+        m_decode_queue.push_back(std::move(job));
+        m_decode_cond.notify_one();
+        return DR_OK;
     }
 
-//    if (m_frames) {
-       for (int i = 0; i < m_frames_size; i++) {
-        //    if (m_extra_frames[i])
-               av_frame_free(&m_frames[i]);
-       }
+    lock.unlock();
+    decode_job(job);
+    return DR_OK;
+}
+
+bool FFmpegVideoDecoder::skip_backlog(PDECODE_UNIT decode_unit) {
+    uint64_t now = HighResClock::now_us();
+    bool idr = decode_unit->frameType == FRAME_TYPE_IDR;
 
-//        free(m_frames);
-//        m_frames = nullptr;
-//    }
+    if (m_backlog_skipping) {
+        if (idr) {
+            m_backlog_skipping = false;
+            CLOG_INFO(LOG_DECODE, "FFmpeg: Backlog skipped, resuming from IDR frame {}", decode_unit->frameNumber);
+            return false;
+        }
 
-    if (tmp_frame) {
-        av_frame_free(&tmp_frame);
+        m_video_decode_stats_progress.backlog_skipped_frames++;
+        if (now - m_backlog_idr_us >= DECODE_BACKLOG_IDR_RETRY_US) {
+            m_backlog_idr_us = now;
+            LiRequestIdrFrame();
+            m_video_decode_stats_progress.idr_requests++;
+        }
+        return true;
     }
 
-    if (m_ffmpeg_buffer) {
-        free(m_ffmpeg_buffer);
-        m_ffmpeg_buffer = nullptr;
+    if (idr)
+        return false;
+
+    // Units common-c still holds and age of this one only grow while
+    // decoding stalls, network delay is before receive time
+    int pending = LiGetPendingVideoFrames() + (int)m_decode_queue.size();
+    if (pending < DECODE_BACKLOG_FRAMES)
+        return false;
+    uint32_t age_ms = LiGetMillis() - decode_unit->receiveTimeMs;
+    uint32_t limit_ms = m_stream_fps > 0 ? DECODE_BACKLOG_FRAMES * 1000 / m_stream_fps : 0;
+    if (age_ms < std::max<uint32_t>(limit_ms, DECODE_BACKLOG_MIN_MS))
+        return false;
+
+    CLOG_WARNING(LOG_DECODE, "FFmpeg: Decoding is {} ms and {} frames behind, skipping to IDR frame",
+                 age_ms, pending);
+    m_video_decode_stats_progress.backlog_skips++;
+    m_video_decode_stats_progress.backlog_skipped_frames += 1 + m_decode_queue.size();
+    m_decode_queue.clear();
+
+    m_backlog_skipping = true;
+    m_backlog_idr_us = now;
+    LiRequestIdrFrame();
+    m_video_decode_stats_progress.idr_requests++;
+    return true;
+}
+
+void FFmpegVideoDecoder::track_decode_unit(PDECODE_UNIT decode_unit) {
+    if (m_video_decode_stats_progress.measurement_start_timestamp_us == 0) {
+        m_video_decode_stats_progress.measurement_start_timestamp_us = HighResClock::now_us();
     }
 
-    AVFrameHolder::instance().cleanup();
-    delete[] m_frames;
+    if (!m_last_frame) {
+        m_last_frame = decode_unit->frameNumber;
+    } else {
+        // Any frame number greater than m_LastFrameNumber + 1 represents a
+        // dropped frame
+        m_video_decode_stats_progress.network_dropped_frames +=
+            decode_unit->frameNumber - (m_last_frame + 1);
+        m_video_decode_stats_progress.total_frames +=
+            decode_unit->frameNumber - (m_last_frame + 1);
+        m_last_frame = decode_unit->frameNumber;
+    }
 
-    brls::Logger::info("FFmpeg: Cleanup done!");
+    m_video_decode_stats_progress.current_received_frames++;
+    m_video_decode_stats_progress.total_frames++;
+
+    FrameTracer::instance().decode_submitted(decode_unit->frameNumber, decode_unit->receiveTimeMs, LiGetMillis());
 }
 
-int FFmpegVideoDecoder::submit_decode_unit(PDECODE_UNIT decode_unit) {
-    if (decode_unit->fullLength < DECODER_BUFFER_SIZE) {
-        PLENTRY entry = decode_unit->bufferList;
+void FFmpegVideoDecoder::start() {
+    if (!Settings::instance().decoder_thread())
+        return;
 
-        if (m_video_decode_stats_progress.measurement_start_timestamp == 0) {
-            m_video_decode_stats_progress.measurement_start_timestamp = LiGetMillis();
-        }
+    m_decode_running = true;
+    m_decode_thread = std::thread(&FFmpegVideoDecoder::decode_loop, this);
+    brls::Logger::info("FFmpeg: Decoder thread started");
+}
 
-        if (!m_last_frame) {
-            m_last_frame = decode_unit->frameNumber;
-        } else {
-            // Any frame number greater than m_LastFrameNumber + 1 represents a
-            // dropped frame
-            m_video_decode_stats_progress.network_dropped_frames +=
-                decode_unit->frameNumber - (m_last_frame + 1);
-            m_video_decode_stats_progress.total_frames +=
-                decode_unit->frameNumber - (m_last_frame + 1);
-            m_last_frame = decode_unit->frameNumber;
+void FFmpegVideoDecoder::stop() {
+    if (!m_decode_thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_decode_lock);
+        m_decode_running = false;
+    }
+    m_decode_cond.notify_one();
+    m_decode_thread.join();
+
+    m_decode_queue.clear();
+    brls::Logger::info("FFmpeg: Decoder thread stopped");
+}
+
+void FFmpegVideoDecoder::decode_loop() {
+    ThreadAffinity::apply(THREAD_ROLE_DECODER);
+    ThreadProfileScope profile("Decoder");
+
+    while (true) {
+        DecodeJob job;
+        {
+            std::unique_lock<std::mutex> lock(m_decode_lock);
+            m_decode_cond.wait(lock, [this] { return !m_decode_running || !m_decode_queue.empty(); });
+            if (!m_decode_running)
+                return;
+
+            job = std::move(m_decode_queue.front());
+            m_decode_queue.pop_front();
         }
 
-        m_video_decode_stats_progress.current_received_frames++;
-        m_video_decode_stats_progress.total_frames++;
+        decode_job(job);
+    }
+}
+
+void FFmpegVideoDecoder::decode_job(const DecodeJob& job) {
+    uint64_t before_decode = HighResClock::now_us();
+    m_submit_times_us[job.frame_number % DECODE_DELAY_SLOTS] = before_decode;
 
-        int length = 0;
-        while (entry != nullptr) {
-            if (length > DECODER_BUFFER_SIZE) {
-                brls::Logger::error("FFmpeg: Big buffer to decode... !");
-            }
+    // Keyframe is what recovery was waiting for
+    if (job.frame_type == FRAME_TYPE_IDR) {
+        m_idr_pending = false;
+        m_corrupt_streak = 0;
+    }
 
-            memcpy(m_ffmpeg_buffer + length, entry->data, entry->length);
-            length += entry->length;
-            entry = entry->next;
+    m_window_packets++;
+
+    // Frame number goes through decoder as pts to match trace records
+    m_packet->pts = job.frame_number;
+    if (send_packet(job.data, job.length, job.buffer.get()) == 0) {
+        // Drain point, frame threads give out frames submitted few
+        // packets ago, so one packet brings none or several of them
+        drain_frames();
+
+        auto decodeTime = HighResClock::now_us() - before_decode;
+        PerformanceHints::instance().report(PERF_HINT_DECODER, decodeTime);
+        StreamPercentiles::instance().record(STREAM_STAT_DECODE, decodeTime);
+        float window_decoding_time = -1;
+        float window_packet_time = -1;
+        std::unique_lock<std::mutex> lock(m_decode_lock);
+        m_video_decode_stats_progress.current_decode_time_us += decodeTime;
+        m_video_decode_stats_progress.current_decoded_frames += m_drained_frames;
+        m_video_decode_stats_progress.current_pipeline_delay_us += m_drained_delay_us;
+        m_video_decode_stats_progress.current_pipeline_frames += m_drained_frames;
+        m_drained_frames = 0;
+        m_drained_delay_us = 0;
+
+        const int time_interval = 60000;
+        timeCount += decodeTime;
+        if (timeCount >= time_interval) {
+            // brls::Logger::debug("FPS: {}", frames / 5.0f);
+
+            m_video_decode_stats_cache = m_video_decode_stats_progress;
+            m_video_decode_stats_progress = {};
+
+            // Preserve dropped frames count
+            m_video_decode_stats_progress.total_received_frames = m_video_decode_stats_cache.total_received_frames + m_video_decode_stats_cache.current_received_frames;
+            m_video_decode_stats_progress.total_decoded_frames = m_video_decode_stats_cache.total_decoded_frames + m_video_decode_stats_cache.current_decoded_frames;
+            m_video_decode_stats_progress.total_reassembly_time_us = m_video_decode_stats_cache.total_reassembly_time_us + m_video_decode_stats_cache.current_reassembly_time_us;
+            m_video_decode_stats_progress.total_decode_time_us = m_video_decode_stats_cache.total_decode_time_us + m_video_decode_stats_cache.current_decode_time_us;
+
+            m_video_decode_stats_progress.network_dropped_frames = m_video_decode_stats_cache.network_dropped_frames;
+            m_video_decode_stats_progress.corrupt_frames = m_video_decode_stats_cache.corrupt_frames;
+            m_video_decode_stats_progress.idr_requests = m_video_decode_stats_cache.idr_requests;
+            m_video_decode_stats_progress.backlog_skips = m_video_decode_stats_cache.backlog_skips;
+            m_video_decode_stats_progress.backlog_skipped_frames = m_video_decode_stats_cache.backlog_skipped_frames;
+
+            uint64_t now = HighResClock::now_us();
+            m_video_decode_stats_cache.current_host_fps =
+                (float)m_video_decode_stats_cache.total_frames /
+                ((float)(now - m_video_decode_stats_cache.measurement_start_timestamp_us) /
+                1000000);
+            m_video_decode_stats_cache.current_received_fps =
+                    (float)m_video_decode_stats_cache.current_received_frames /
+                    ((float)(now - m_video_decode_stats_cache.measurement_start_timestamp_us) /
+                1000000);
+            m_video_decode_stats_cache.current_decoded_fps =
+                    (float)m_video_decode_stats_cache.current_decoded_frames /
+                    ((float)(now - m_video_decode_stats_cache.measurement_start_timestamp_us) /
+                1000000);
+
+            m_video_decode_stats_cache.current_receive_time = (float) m_video_decode_stats_cache.current_reassembly_time_us / 1000.0f /
+                                                              (float) m_video_decode_stats_cache.current_received_frames;
+            m_video_decode_stats_cache.current_decoding_time = (float) m_video_decode_stats_cache.current_decode_time_us / 1000.0f /
+                                                               (float) m_video_decode_stats_cache.current_decoded_frames;
+
+            m_video_decode_stats_cache.session_receive_time = (float) m_video_decode_stats_cache.total_reassembly_time_us / 1000.0f /
+                                                              (float) m_video_decode_stats_cache.total_received_frames;
+            m_video_decode_stats_cache.session_decoding_time = (float) m_video_decode_stats_cache.total_decode_time_us / 1000.0f /
+                                                               (float) m_video_decode_stats_cache.total_decoded_frames;
+
+            m_video_decode_stats_progress.total_zero_copy_frames = m_video_decode_stats_cache.total_zero_copy_frames;
+            m_video_decode_stats_progress.peak_packet_size = m_video_decode_stats_cache.peak_packet_size;
+            m_video_decode_stats_cache.current_copy_time = m_video_decode_stats_cache.current_copied_frames == 0 ? 0 :
+                                                           (float) m_video_decode_stats_cache.current_copy_time_us / 1000.0f /
+                                                           (float) m_video_decode_stats_cache.current_copied_frames;
+
+            m_video_decode_stats_cache.frame_threaded = frame_threaded();
+            m_video_decode_stats_cache.hw_decoding = m_hw_decoding;
+            m_video_decode_stats_cache.overload_mode = m_overload_mode;
+            m_video_decode_stats_cache.pipeline_latency = m_video_decode_stats_cache.current_pipeline_frames == 0 ? 0 :
+                                                          (float)m_video_decode_stats_cache.current_pipeline_delay_us / 1000.0f /
+                                                          (float)m_video_decode_stats_cache.current_pipeline_frames;
+
+            auto pool = m_surface_pool.stats();
+            m_video_decode_stats_cache.surfaces = m_frames_size;
+            m_video_decode_stats_cache.surfaces_allocated = pool.allocated;
+            m_video_decode_stats_cache.surface_memory_mb = (float)(pool.allocated * pool.surface_size) / (1 << 20);
+            MemoryAccounting::set(MEM_DECODER_SURFACES, pool.allocated * pool.surface_size);
+            m_video_decode_stats_cache.surface_budget_mb = (float)Settings::instance().surface_budget();
+            m_video_decode_stats_snapshot.publish(m_video_decode_stats_cache);
+
+            timeCount -= time_interval;
+            window_decoding_time = m_video_decode_stats_cache.current_decoding_time;
+            // Skipped frames give no output, so load is taken per packet
+            window_packet_time = (float)m_video_decode_stats_cache.current_decode_time_us / 1000.0f /
+                                 (float)std::max(m_window_packets, 1u);
+            m_window_packets = 0;
         }
 
-        m_video_decode_stats_progress.current_reassembly_time += LiGetMillis() - decode_unit->receiveTimeMs;
-        m_frames_in++;
+        lock.unlock();
 
-        uint64_t before_decode = LiGetMillis();
+        if (window_decoding_time >= 0) {
+            check_threading(window_decoding_time);
+            check_overload(window_packet_time);
+        }
+    }
+}
 
-        if (length > DECODER_BUFFER_SIZE) {
-            brls::Logger::error("FFmpeg: Big buffer to decode...");
+AVBufferRef* FFmpegVideoDecoder::acquire_packet_buffer(int size) {
+    int required_size = size + AV_INPUT_BUFFER_PADDING_SIZE;
+
+    for (int i = 0; i < (int)m_packet_buffers.size(); i++) {
+        int index = (m_next_packet_buffer + i) % (int)m_packet_buffers.size();
+        auto& buffer = m_packet_buffers[index];
+
+        // Still referenced by decoder
+        if (!av_buffer_is_writable(buffer.get()))
+            continue;
+
+        if (buffer->size < required_size) {
+            // Grow with some reserve to not reallocate on every bigger
+            // frame, buffer is left as it was when that fails
+            AVBufferRef* grown = buffer.release();
+            int err = av_buffer_realloc(&grown, required_size + required_size / 4);
+            buffer.reset(grown);
+            if (err < 0)
+                return nullptr;
+            CLOG_DEBUG(LOG_DECODE, "FFmpeg: Packet buffer {} grown to {} bytes", index, buffer->size);
         }
 
-        if (decode(m_ffmpeg_buffer, length) == 0) {
-            m_frames_out++;
-
-            auto decodeTime = LiGetMillis() - before_decode;
-            m_video_decode_stats_progress.current_decode_time += decodeTime;
-
-            // Also count the frame-to-frame delay if the decoder is delaying
-            // frames until a subsequent frame is submitted.
-            m_video_decode_stats_progress.current_decode_time +=
-                (m_frames_in - m_frames_out) * (1000 / m_stream_fps);
-            m_video_decode_stats_progress.current_decoded_frames++;
-
-            const int time_interval = 60;
-            timeCount += decodeTime;
-            if (timeCount >= time_interval) {
-                // brls::Logger::debug("FPS: {}", frames / 5.0f);
-
-                m_video_decode_stats_cache = m_video_decode_stats_progress;
-                m_video_decode_stats_progress = {};
-
-                // Preserve dropped frames count
-                m_video_decode_stats_progress.total_received_frames = m_video_decode_stats_cache.total_received_frames + m_video_decode_stats_cache.current_received_frames;
-                m_video_decode_stats_progress.total_decoded_frames = m_video_decode_stats_cache.total_decoded_frames + m_video_decode_stats_cache.current_decoded_frames;
-                m_video_decode_stats_progress.total_reassembly_time = m_video_decode_stats_cache.total_reassembly_time + m_video_decode_stats_cache.current_reassembly_time;
-                m_video_decode_stats_progress.total_decode_time = m_video_decode_stats_cache.total_decode_time + m_video_decode_stats_cache.current_decode_time;
-
-                m_video_decode_stats_progress.network_dropped_frames = m_video_decode_stats_cache.network_dropped_frames;
-
-                uint64_t now = LiGetMillis();
-                m_video_decode_stats_cache.current_host_fps =
-                    (float)m_video_decode_stats_cache.total_frames /
-                    ((float)(now - m_video_decode_stats_cache.measurement_start_timestamp) /
-                    1000);
-                m_video_decode_stats_cache.current_received_fps =
-                        (float)m_video_decode_stats_cache.current_received_frames /
-                        ((float)(now - m_video_decode_stats_cache.measurement_start_timestamp) /
-                    1000);
-                m_video_decode_stats_cache.current_decoded_fps =
-                        (float)m_video_decode_stats_cache.current_decoded_frames /
-                        ((float)(now - m_video_decode_stats_cache.measurement_start_timestamp) /
-                    1000);
-
-                m_video_decode_stats_cache.current_receive_time = (float) m_video_decode_stats_cache.current_reassembly_time /
-                                                                  (float) m_video_decode_stats_cache.current_received_frames;
-                m_video_decode_stats_cache.current_decoding_time = (float) m_video_decode_stats_cache.current_decode_time /
-                                                                   (float) m_video_decode_stats_cache.current_decoded_frames;
-
-                m_video_decode_stats_cache.session_receive_time = (float) m_video_decode_stats_cache.total_reassembly_time /
-                                                                  (float) m_video_decode_stats_cache.total_received_frames;
-                m_video_decode_stats_cache.session_decoding_time = (float) m_video_decode_stats_cache.total_decode_time /
-                                                                   (float) m_video_decode_stats_cache.total_decoded_frames;
-
-                timeCount -= time_interval;
-            }
+        m_next_packet_buffer = (index + 1) % (int)m_packet_buffers.size();
+        return buffer.get();
+    }
 
-            m_frame = get_frame(true);
-            if (m_frame != nullptr)
-                AVFrameHolder::instance().push(m_frame);
+    CLOG_ERROR_LIMITED(LOG_DECODE, "FFmpeg: All packet buffers are busy");
+    return nullptr;
+}
+
+char* FFmpegVideoDecoder::assemble_decode_unit(PDECODE_UNIT decode_unit, int* length,
+                                               AVBufferRef** buffer, bool allow_zero_copy) {
+    PLENTRY entry = decode_unit->bufferList;
+
+    if ((m_perf_lvl & ZERO_COPY_SUBMIT) && allow_zero_copy) {
+        // Check if all entries follow each other in memory,
+        // in that case the first entry already holds the whole frame
+        bool contiguous = entry != nullptr;
+        for (PLENTRY it = entry; contiguous && it->next != nullptr; it = it->next) {
+            contiguous = it->data + it->length == it->next->data;
+        }
+
+        if (contiguous) {
+            *length = decode_unit->fullLength;
+            m_video_decode_stats_progress.total_zero_copy_frames++;
+            return entry->data;
         }
-    } else {
-        brls::Logger::error("FFmpeg: Big buffer to decode... 2");
     }
-    return DR_OK;
+
+    uint64_t copy_start = HighResClock::now_us();
+
+    *buffer = acquire_packet_buffer(decode_unit->fullLength);
+    if (*buffer == nullptr)
+        return nullptr;
+
+    char* data = (char*)(*buffer)->data;
+
+    *length = 0;
+    while (entry != nullptr) {
+        memcpy(data + *length, entry->data, entry->length);
+        *length += entry->length;
+        entry = entry->next;
+    }
+    memset(data + *length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    if ((uint32_t)*length > m_video_decode_stats_progress.peak_packet_size)
+        m_video_decode_stats_progress.peak_packet_size = *length;
+
+    m_video_decode_stats_progress.current_copy_time_us += HighResClock::now_us() - copy_start;
+    m_video_decode_stats_progress.current_copied_frames++;
+
+    return data;
 }
 
 int FFmpegVideoDecoder::capabilities() const {
-    return CAPABILITY_SLICES_PER_FRAME(4) | CAPABILITY_DIRECT_SUBMIT;
+    // Each slice thread gets its own slice to work on. Slices still come
+    // in one decode unit, moonlight-common-c submits a frame only after
+    // its last packet, so decoding can't start with the first slice
+    int slices = 4;
+    int decoder_threads = Settings::instance().decoder_threads();
+    if (!Settings::instance().use_hw_decoding() && decoder_threads > 0)
+        slices = decoder_threads;
+
+    int capabilities = CAPABILITY_SLICES_PER_FRAME(slices) | CAPABILITY_DIRECT_SUBMIT;
+#ifdef DECODER_TOLERATES_RFI
+    // FFmpeg H.264 decoder doesn't cope with invalidated references
+    capabilities |= CAPABILITY_REFERENCE_FRAME_INVALIDATION_HEVC | CAPABILITY_REFERENCE_FRAME_INVALIDATION_AV1;
+#endif
+    return capabilities;
+}
+
+void FFmpegVideoDecoder::request_idr(const char* reason) {
+    uint64_t now = HighResClock::now_us();
+    if (m_idr_pending && now - m_idr_requested_us < IDR_REQUEST_INTERVAL_US)
+        return;
+
+    CLOG_WARNING(LOG_DECODE, "FFmpeg: Requesting IDR frame, {}", reason);
+    m_idr_pending = true;
+    m_idr_requested_us = now;
+    LiRequestIdrFrame();
+
+    std::lock_guard<std::mutex> lock(m_decode_lock);
+    m_video_decode_stats_progress.idr_requests++;
 }
 
-int FFmpegVideoDecoder::decode(char* indata, int inlen) {
+int FFmpegVideoDecoder::send_packet(char* indata, int inlen, AVBufferRef* buffer) {
+    // Reference counted packet lets decoder keep the data without copying it
+    m_packet->buf = buffer ? av_buffer_ref(buffer) : nullptr;
     m_packet->data = (uint8_t*)indata;
     m_packet->size = inlen;
 
-//    m_decoder_context->skip_frame = AVDISCARD_ALL;
-
-    int err = avcodec_send_packet(m_decoder_context, m_packet);
+    int err;
+    {
+        TRACE_SCOPE("avcodec_send_packet");
+        err = avcodec_send_packet(m_decoder_context.get(), m_packet.get());
+    }
     if (err == AVERROR(EAGAIN)) {
-        avcodec_flush_buffers(m_decoder_context);
-        brls::Logger::error("FFmpeg: Decode failed - Try again");
-        return 0;
+        // Input is full until output is taken, frames already decoded go
+        // out first, flushing here would throw away reference frames
+        drain_frames();
+        TRACE_SCOPE("avcodec_send_packet");
+        err = avcodec_send_packet(m_decoder_context.get(), m_packet.get());
     }
+    av_packet_unref(m_packet.get());
 
     if (err != 0) {
         char error[512];
         av_strerror(err, error, sizeof(error));
-        brls::Logger::error("FFmpeg: Decode failed - {}", error);
+        CLOG_ERROR_LIMITED(LOG_DECODE, "FFmpeg: Decode failed - {}", error);
+        // Nothing decodes from here on without new references
+        request_idr("decode failed");
         return err;
     }
 
     return 0;
 }
 
-AVFrame* FFmpegVideoDecoder::get_frame(bool native_frame) {
+void FFmpegVideoDecoder::drain_frames() {
+    // Frozen video still decodes to keep references, frames are dropped
+    // before copy, and the ring isn't advanced, so shown frame stays intact
+    if (m_frame_holder->isFrozen()) {
+        while (avcodec_receive_frame(m_decoder_context.get(), tmp_frame.get()) == 0)
+            av_frame_unref(tmp_frame.get());
+        return;
+    }
+
+    while (AVFrame* frame = receive_frame()) {
+        // Delay from submit to output, what frame threads hold back
+        m_drained_delay_us += HighResClock::now_us() - m_submit_times_us[frame->pts % DECODE_DELAY_SLOTS];
+        m_drained_frames++;
+
+        // Lost packets are handled by moonlight-common-c, with RFI host
+        // encodes next frames from references we still have, so short
+        // corruption heals by itself. Long one means references are gone
+        if ((frame->flags & AV_FRAME_FLAG_CORRUPT) || frame->decode_error_flags) {
+            {
+                std::lock_guard<std::mutex> lock(m_decode_lock);
+                m_video_decode_stats_progress.corrupt_frames++;
+            }
+            if (++m_corrupt_streak >= RECOVERY_CORRUPT_FRAMES)
+                request_idr("decoder keeps giving corrupt frames");
+        } else {
+            m_corrupt_streak = 0;
+        }
+
+        FrameTracer::instance().decode_done((uint32_t)frame->pts);
+        LatencyProbe::instance().frame_decoded(frame);
+        if (m_frame_uploader) {
+            TRACE_SCOPE("frame_upload");
+            m_frame_uploader->upload(frame);
+        }
+        m_frame_holder->push(frame);
+    }
+}
+
+AVFrame* FFmpegVideoDecoder::receive_frame() {
     int err;
-#if defined(PLATFORM_ANDROID)
-    // Android produce software copied Frame, no need in tmp_hardware frame
-    auto decodeFrame = m_frames[m_next_frame];
+#ifdef HW_FRAME_PASSTHROUGH
+    bool transfer = false;
 #else
-    // Temp hardware frame to copy into software frame later
-    auto decodeFrame = tmp_frame;
+    bool transfer = hw_device_ctx != nullptr;
 #endif
-    // Software result frame
-    AVFrame* resultFrame = m_frames[m_next_frame];
-
-    RECEIVE_RETRY:
-    if ((err = avcodec_receive_frame(m_decoder_context, decodeFrame)) < 0) {
-        if (err == AVERROR(EAGAIN)) goto RECEIVE_RETRY;
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+    bool scale = m_vic_scaler.active();
+#else
+    bool scale = false;
+#endif
+    // Frame from ring goes out as it is, unless hardware frame has to be
+    // copied into its pooled surface. Ring keeps queued frames alive
+    AVFrame* resultFrame = m_frames[m_next_frame].get();
+    auto decodeFrame = transfer || scale ? tmp_frame.get() : resultFrame;
+
+    // Never waits, EAGAIN means decoder needs more input first
+    {
+        TRACE_SCOPE("avcodec_receive_frame");
+        err = avcodec_receive_frame(m_decoder_context.get(), decodeFrame);
+    }
+    if (err < 0) {
+        if (err == AVERROR(EAGAIN) || err == AVERROR_EOF)
+            return nullptr;
 
         char a[AV_ERROR_MAX_STRING_SIZE] = { 0 };
-        brls::Logger::error("FFmpeg: Error receiving frame with error {}",  av_make_error_string(a, AV_ERROR_MAX_STRING_SIZE, err));
+        CLOG_ERROR_LIMITED(LOG_DECODE, "FFmpeg: Error receiving frame with error {}",  av_make_error_string(a, AV_ERROR_MAX_STRING_SIZE, err));
         return nullptr;
     }
 
-    if (hw_device_ctx) {
-#if defined(BOREALIS_USE_DEKO3D) || defined(PLATFORM_ANDROID) || defined(USE_METAL_RENDERER)
-        // DEKO decoder will work with hardware frame
-        // Android already produce software Frame
-        resultFrame = decodeFrame;
-#else
-
+#ifndef HW_FRAME_PASSTHROUGH
+    if (transfer) {
 #if defined(PLATFORM_SWITCH) && !defined(BOREALIS_USE_DEKO3D)
         for (int i = 0; i < 2; ++i) {
             if (((uintptr_t)resultFrame->data[i] & 0xff) || (resultFrame->linesize[i] & 0xff)) {
-                brls::Logger::error("Frame address/pitch not aligned to 256, falling back to cpu transfer");
+                CLOG_ERROR_LIMITED(LOG_DECODE, "Frame address/pitch not aligned to 256, falling back to cpu transfer");
                 break;
             }
         }
@@ -442,29 +1073,30 @@ AVFrame* FFmpegVideoDecoder::get_frame(bool native_frame) {
         // Copy hardware frame into software frame
         if ((err = av_hwframe_transfer_data(resultFrame, decodeFrame, 0)) < 0) {
             char a[AV_ERROR_MAX_STRING_SIZE] = { 0 };
-            brls::Logger::error("FFmpeg: Error transferring the data to system memory with error {}",  av_make_error_string(a, AV_ERROR_MAX_STRING_SIZE, err));
+            CLOG_ERROR_LIMITED(LOG_DECODE, "FFmpeg: Error transferring the data to system memory with error {}",  av_make_error_string(a, AV_ERROR_MAX_STRING_SIZE, err));
             return nullptr;
         }
         
         av_frame_copy_props(resultFrame, decodeFrame);
-#endif
-    } else {
-        resultFrame = decodeFrame;
     }
+#endif
 
-    if (err == 0) {
-        m_current_frame = m_next_frame;
-        m_next_frame = (m_current_frame + 1) % m_frames_size;
-        if (/*ffmpeg_decoder == SOFTWARE ||*/ native_frame)
-            return resultFrame;
-    } else {
-        char error[512];
-        av_strerror(err, error, sizeof(error));
-        brls::Logger::error("FFmpeg: Receive failed - %d/%s", err, error);
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+    if (scale) {
+        TRACE_SCOPE("vic_scale");
+        // Decoder surface goes back to decoder either way
+        if (m_vic_scaler.scale(resultFrame, decodeFrame))
+            av_frame_unref(decodeFrame);
+        else
+            av_frame_move_ref(resultFrame, decodeFrame);
     }
-    return nullptr;
+#endif
+
+    m_current_frame = m_next_frame;
+    m_next_frame = (m_current_frame + 1) % m_frames_size;
+    return resultFrame;
 }
 
-VideoDecodeStats* FFmpegVideoDecoder::video_decode_stats() {
-    return (VideoDecodeStats*)&m_video_decode_stats_cache;
+VideoDecodeStats FFmpegVideoDecoder::video_decode_stats() {
+    return m_video_decode_stats_snapshot.read();
 }
@@ -1,41 +1,130 @@
 #pragma once
-#include "IFFmpegVideoDecoder.hpp"
+#include "IVideoDecoder.hpp"
+#include "IVideoRenderer.hpp"
 #include "AVFrameHolder.hpp"
+#include "AVResources.hpp"
+#include "SurfacePool.hpp"
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+#include "VicScaler.hpp"
+#endif
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
 
-class FFmpegVideoDecoder : public IFFmpegVideoDecoder {
+// Submit times are kept for this many frames, more than any decoder delays
+#define DECODE_DELAY_SLOTS 64
+
+class FFmpegVideoDecoder final : public IVideoDecoder {
   public:
     FFmpegVideoDecoder();
-    ~FFmpegVideoDecoder();
 
+    void prepare() override;
     int setup(int video_format, int width, int height, int redraw_rate,
               void* context, int dr_flags) override;
+    void start() override;
+    void set_frame_allocator(IVideoFrameAllocator* allocator) override { m_frame_allocator = allocator; }
+    void set_frame_uploader(IVideoFrameUploader* uploader) override { m_frame_uploader = uploader; }
+    void stop() override;
     void cleanup() override;
     int submit_decode_unit(PDECODE_UNIT decode_unit) override;
     int capabilities() const override;
-    VideoDecodeStats* video_decode_stats() override;
+    VideoDecodeStats video_decode_stats() override;
+
+    static AVHWDeviceType hw_device_type();
+    // Same decoder setup() picks for format, nullptr when there is none
+    static const AVCodec* find_decoder(int video_format, bool hw_decoding);
+    // Platform has hardware decoding for format at all
+    static bool hw_decodes_format(int video_format);
 
   private:
-    int decode(char* indata, int inlen);
-    AVFrame* get_frame(bool native_frame);
+    // Assembled frame waiting for decoder thread, holds its own reference
+    // so pool won't hand buffer out again
+    struct DecodeJob {
+        AVBufferRefPtr buffer;
+        char* data;
+        int length;
+        uint32_t frame_number;
+        int frame_type;
+    };
+
+    void decode_loop();
+    void decode_job(const DecodeJob& job);
+    int create_hw_device(AVHWDeviceType type);
+    int allocate_packet_buffers();
+    int open_codec();
+    bool frame_threaded() const;
+    void check_threading(float decoding_time);
+    void check_overload(float packet_time);
+    void apply_overload_mode();
+    int send_packet(char* indata, int inlen, AVBufferRef* buffer);
+    void track_decode_unit(PDECODE_UNIT decode_unit);
+    // Submit side, with decode lock held. True when unit is dropped
+    bool skip_backlog(PDECODE_UNIT decode_unit);
+    char* assemble_decode_unit(PDECODE_UNIT decode_unit, int* length,
+                               AVBufferRef** buffer, bool allow_zero_copy);
+    AVBufferRef* acquire_packet_buffer(int size);
+    // Takes one decoded frame if there is any, never waits
+    AVFrame* receive_frame();
+    void drain_frames();
+    void request_idr(const char* reason);
+    static int get_buffer(AVCodecContext* context, AVFrame* frame, int flags);
 
-    AVPacket* m_packet;
-    AVBufferRef *hw_device_ctx = nullptr;
+    AVPacketPtr m_packet;
+    AVBufferRefPtr hw_device_ctx;
     const AVCodec* m_decoder = nullptr;
-    AVCodecContext* m_decoder_context = nullptr;
-    AVFrame *tmp_frame = nullptr;
-    AVFrame** m_frames;
-    int m_frames_size;
+    AVCodecContextPtr m_decoder_context;
+    AVFramePtr tmp_frame;
+    std::vector<AVFramePtr> m_frames;
+    int m_frames_size = 0;
+    SurfacePool m_surface_pool;
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+    VicScaler m_vic_scaler;
+#endif
+    IVideoFrameAllocator* m_frame_allocator = nullptr;
+    IVideoFrameUploader* m_frame_uploader = nullptr;
 
+    int m_perf_lvl = 0;
+    int m_width = 0, m_height = 0;
+    int m_thread_type = FF_THREAD_SLICE;
+    int m_thread_count = 1;
+    bool m_auto_threading = false;
+    bool m_hw_decoding = false;
+    int m_slow_windows = 0;
+    // Written by decoder thread, submit checks it for queue flushing
+    std::atomic<DecoderOverloadMode> m_overload_mode = DECODER_OVERLOAD_NONE;
+    int m_overload_windows = 0;
+    uint32_t m_window_packets = 0;
     int m_stream_fps = 0;
-    int m_frames_in = 0;
-    int m_frames_out = 0;
     int m_current_frame = 0, m_next_frame = 0;
     uint32_t m_last_frame = 0;
 
     VideoDecodeStats m_video_decode_stats_progress = {};
     VideoDecodeStats m_video_decode_stats_cache = {};
+    StatsSnapshot<VideoDecodeStats> m_video_decode_stats_snapshot;
     uint64_t timeCount = 0;
 
-    char* m_ffmpeg_buffer = nullptr;
-    AVFrame* m_frame = nullptr;
+    std::vector<AVBufferRefPtr> m_packet_buffers;
+    int m_next_packet_buffer = 0;
+    uint64_t m_submit_times_us[DECODE_DELAY_SLOTS] = {};
+    uint64_t m_drained_delay_us = 0;
+    uint32_t m_drained_frames = 0;
+
+    // Decoder thread only, IDR is requested once till keyframe comes
+    uint32_t m_corrupt_streak = 0;
+    bool m_idr_pending = false;
+    uint64_t m_idr_requested_us = 0;
+
+    // Submit side, units till next IDR are dropped
+    bool m_backlog_skipping = false;
+    uint64_t m_backlog_idr_us = 0;
+
+    // Guards decode queue and stats progress shared with decoder thread
+    std::mutex m_decode_lock;
+    std::condition_variable m_decode_cond;
+    std::deque<DecodeJob> m_decode_queue;
+    std::thread m_decode_thread;
+    bool m_decode_running = false;
 };
@@ -0,0 +1,106 @@
+//
+//  JpegDecoder.cpp
+//  Moonlight
+//
+
+#include "JpegDecoder.hpp"
+#include "FrameCapture.hpp"
+#include <borealis.hpp>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/hwcontext.h>
+#ifdef PLATFORM_SWITCH
+#include <libavutil/hwcontext_nvtegra.h>
+#endif
+}
+
+bool JpegDecoder::is_jpeg(const unsigned char* data, size_t size) {
+    // Start of image marker followed by any other marker
+    return size > 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+}
+
+static AVCodecContextPtr open_context(const AVCodec* decoder, AVBufferRef* device) {
+    AVCodecContextPtr context(avcodec_alloc_context3(decoder));
+    if (!context)
+        return nullptr;
+
+    if (device) {
+        context->hw_device_ctx = av_buffer_ref(device);
+#ifdef PLATFORM_SWITCH
+        context->pix_fmt = AV_PIX_FMT_NVTEGRA;
+#endif
+    }
+
+    if (avcodec_open2(context.get(), decoder, nullptr) < 0)
+        return nullptr;
+    return context;
+}
+
+void JpegDecoder::open() {
+    m_opened = true;
+    m_packet.reset(av_packet_alloc());
+
+    const AVCodec* decoder = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
+    if (!decoder || !m_packet) {
+        brls::Logger::error("JpegDecoder: No MJPEG decoder");
+        return;
+    }
+
+#ifdef PLATFORM_SWITCH
+    // Engine channel is opened with device, version is 0 when
+    // nvdrv service in use doesn't give it out
+    AVBufferRef* device = nullptr;
+    if (av_hwdevice_ctx_create(&device, AV_HWDEVICE_TYPE_NVTEGRA, nullptr, nullptr, 0) >= 0) {
+        m_device.reset(device);
+        auto* nvtegra = (AVNVTegraDeviceContext*)((AVHWDeviceContext*)device->data)->hwctx;
+        if (nvtegra->nvjpg_version)
+            m_hw_context = open_context(decoder, device);
+    }
+    if (m_hw_context)
+        brls::Logger::info("JpegDecoder: Decoding with NVJPG");
+    else
+        brls::Logger::warning("JpegDecoder: NVJPG isn't available, decoding on CPU");
+#endif
+
+    m_sw_context = open_context(decoder, nullptr);
+}
+
+bool JpegDecoder::decode(const unsigned char* data, size_t size, int* width, int* height,
+                         std::vector<unsigned char>* pixels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_opened)
+        open();
+
+    // Progressive and unusual subsampling aren't taken by engine
+    if (m_hw_context && decode_with(m_hw_context.get(), data, size, width, height, pixels))
+        return true;
+    return m_sw_context && decode_with(m_sw_context.get(), data, size, width, height, pixels);
+}
+
+bool JpegDecoder::decode_with(AVCodecContext* context, const unsigned char* data, size_t size, int* width,
+                              int* height, std::vector<unsigned char>* pixels) {
+    // Decoder reads padding past the end
+    if (av_new_packet(m_packet.get(), (int)size) < 0)
+        return false;
+    memcpy(m_packet->data, data, size);
+
+    AVFramePtr frame(av_frame_alloc());
+    int err = avcodec_send_packet(context, m_packet.get());
+    av_packet_unref(m_packet.get());
+    if (err >= 0 && frame)
+        err = avcodec_receive_frame(context, frame.get());
+
+    if (err < 0 || !frame) {
+        // Single image never leaves anything worth keeping behind
+        avcodec_flush_buffers(context);
+        return false;
+    }
+
+    // Full range BT.601 whatever decoder tells
+    frame->color_range = AVCOL_RANGE_JPEG;
+    *width = frame->width;
+    *height = frame->height;
+    pixels->resize((size_t)frame->width * frame->height * 4);
+    return FrameCapture::thumbnail(frame.release(), *width, *height, pixels->data());
+}
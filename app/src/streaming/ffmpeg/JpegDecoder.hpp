@@ -0,0 +1,38 @@
+//
+//  JpegDecoder.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "AVResources.hpp"
+#include "Singleton.hpp"
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// JPEG images, box art of hosts which serve it, decoded by libavcodec.
+// On Switch NVJPG engine decodes them through nvtegra hwaccel when nvdrv
+// service gives access to it, CPU decoder takes images engine couldn't
+// handle and every image elsewhere. CImg is built with PNG only
+class JpegDecoder : public Singleton<JpegDecoder> {
+  public:
+    static bool is_jpeg(const unsigned char* data, size_t size);
+
+    // Any thread, images are decoded one at a time. Fills RGBA pixels
+    // of image size, false when image is broken
+    bool decode(const unsigned char* data, size_t size, int* width, int* height,
+                std::vector<unsigned char>* pixels);
+
+  private:
+    void open();
+    bool decode_with(AVCodecContext* context, const unsigned char* data, size_t size, int* width,
+                     int* height, std::vector<unsigned char>* pixels);
+
+    std::mutex m_mutex;
+    bool m_opened = false;
+    AVPacketPtr m_packet;
+    AVBufferRefPtr m_device;
+    AVCodecContextPtr m_hw_context;
+    AVCodecContextPtr m_sw_context;
+};
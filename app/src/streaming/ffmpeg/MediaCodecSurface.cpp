@@ -0,0 +1,150 @@
+//
+//  MediaCodecSurface.cpp
+//  Moonlight
+//
+
+#ifdef PLATFORM_ANDROID
+
+#include "MediaCodecSurface.hpp"
+#include "borealis.hpp"
+#include <SDL.h>
+
+extern "C" {
+#include <libavcodec/jni.h>
+}
+
+static bool check_exception(JNIEnv* env, const char* action) {
+    if (!env->ExceptionCheck())
+        return false;
+
+    env->ExceptionDescribe();
+    env->ExceptionClear();
+    brls::Logger::error("MediaCodecSurface: Failed to {}", action);
+    return true;
+}
+
+JNIEnv* MediaCodecSurface::env() {
+    // Attaches calling thread to JVM if it wasn't yet
+    JNIEnv* env = (JNIEnv*)SDL_AndroidGetJNIEnv();
+
+    static std::once_flag jvm_flag;
+    std::call_once(jvm_flag, [env] {
+        JavaVM* vm = nullptr;
+        if (env && env->GetJavaVM(&vm) == JNI_OK)
+            av_jni_set_java_vm(vm, nullptr);
+    });
+    return env;
+}
+
+jobject MediaCodecSurface::acquire() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_surface)
+        return m_surface;
+
+    JNIEnv* env = this->env();
+    if (!env)
+        return nullptr;
+
+    jclass texture_class = env->FindClass("android/graphics/SurfaceTexture");
+    jclass surface_class = env->FindClass("android/view/Surface");
+    if (check_exception(env, "find SurfaceTexture classes"))
+        return nullptr;
+
+    // Detached constructor is available since API 26
+    jmethodID texture_init = env->GetMethodID(texture_class, "<init>", "(Z)V");
+    jmethodID surface_init = env->GetMethodID(surface_class, "<init>", "(Landroid/graphics/SurfaceTexture;)V");
+    m_update_tex_image = env->GetMethodID(texture_class, "updateTexImage", "()V");
+    m_get_transform_matrix = env->GetMethodID(texture_class, "getTransformMatrix", "([F)V");
+    if (check_exception(env, "find SurfaceTexture methods"))
+        return nullptr;
+
+    jobject texture = env->NewObject(texture_class, texture_init, JNI_FALSE);
+    if (check_exception(env, "create SurfaceTexture"))
+        return nullptr;
+
+    jobject surface = env->NewObject(surface_class, surface_init, texture);
+    if (check_exception(env, "create Surface")) {
+        env->DeleteLocalRef(texture);
+        return nullptr;
+    }
+
+    jfloatArray transform = env->NewFloatArray(16);
+    m_surface_texture = env->NewGlobalRef(texture);
+    m_surface = env->NewGlobalRef(surface);
+    m_transform = (jfloatArray)env->NewGlobalRef(transform);
+
+    env->DeleteLocalRef(transform);
+    env->DeleteLocalRef(surface);
+    env->DeleteLocalRef(texture);
+    env->DeleteLocalRef(surface_class);
+    env->DeleteLocalRef(texture_class);
+
+    brls::Logger::info("MediaCodecSurface: Surface created");
+    return m_surface;
+}
+
+void MediaCodecSurface::release() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_surface)
+        return;
+
+    JNIEnv* env = this->env();
+
+    jclass texture_class = env->GetObjectClass(m_surface_texture);
+    jclass surface_class = env->GetObjectClass(m_surface);
+    env->CallVoidMethod(m_surface, env->GetMethodID(surface_class, "release", "()V"));
+    env->CallVoidMethod(m_surface_texture, env->GetMethodID(texture_class, "release", "()V"));
+    check_exception(env, "release Surface");
+
+    env->DeleteLocalRef(surface_class);
+    env->DeleteLocalRef(texture_class);
+    env->DeleteGlobalRef(m_transform);
+    env->DeleteGlobalRef(m_surface);
+    env->DeleteGlobalRef(m_surface_texture);
+    m_transform = nullptr;
+    m_surface = nullptr;
+    m_surface_texture = nullptr;
+    m_attached_texture = 0;
+}
+
+bool MediaCodecSurface::update(unsigned int texture, float* transform) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_surface_texture)
+        return false;
+
+    JNIEnv* env = this->env();
+
+    if (m_attached_texture != texture) {
+        jclass texture_class = env->GetObjectClass(m_surface_texture);
+        if (m_attached_texture)
+            env->CallVoidMethod(m_surface_texture, env->GetMethodID(texture_class, "detachFromGLContext", "()V"));
+        env->CallVoidMethod(m_surface_texture, env->GetMethodID(texture_class, "attachToGLContext", "(I)V"), (jint)texture);
+        env->DeleteLocalRef(texture_class);
+        if (check_exception(env, "attach SurfaceTexture"))
+            return false;
+        m_attached_texture = texture;
+    }
+
+    env->CallVoidMethod(m_surface_texture, m_update_tex_image);
+    env->CallVoidMethod(m_surface_texture, m_get_transform_matrix, m_transform);
+    if (check_exception(env, "update SurfaceTexture"))
+        return false;
+
+    env->GetFloatArrayRegion(m_transform, 0, 16, transform);
+    return true;
+}
+
+void MediaCodecSurface::detach() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_surface_texture || !m_attached_texture)
+        return;
+
+    JNIEnv* env = this->env();
+    jclass texture_class = env->GetObjectClass(m_surface_texture);
+    env->CallVoidMethod(m_surface_texture, env->GetMethodID(texture_class, "detachFromGLContext", "()V"));
+    env->DeleteLocalRef(texture_class);
+    check_exception(env, "detach SurfaceTexture");
+    m_attached_texture = 0;
+}
+
+#endif // PLATFORM_ANDROID
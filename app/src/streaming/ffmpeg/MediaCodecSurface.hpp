@@ -0,0 +1,36 @@
+#ifdef PLATFORM_ANDROID
+
+#include "Singleton.hpp"
+#include <jni.h>
+#include <mutex>
+
+#pragma once
+
+// SurfaceTexture which MediaCodec renders decoded frames into, GL renderer
+// samples it as external OES texture so frames never leave GPU memory.
+// Surface is created detached from any GL context, because decoder is set
+// up on connection thread before renderer exists.
+class MediaCodecSurface : public Singleton<MediaCodecSurface> {
+  public:
+    // Returns android.view.Surface to pass to decoder, nullptr on failure
+    jobject acquire();
+    void release();
+
+    // Should be called from thread with current GL context, attaches
+    // surface to texture and latches latest frame with its transform
+    bool update(unsigned int texture, float* transform);
+    void detach();
+
+  private:
+    JNIEnv* env();
+
+    std::mutex m_mutex;
+    jobject m_surface_texture = nullptr;
+    jobject m_surface = nullptr;
+    jmethodID m_update_tex_image = nullptr;
+    jmethodID m_get_transform_matrix = nullptr;
+    jfloatArray m_transform = nullptr;
+    unsigned int m_attached_texture = 0;
+};
+
+#endif // PLATFORM_ANDROID
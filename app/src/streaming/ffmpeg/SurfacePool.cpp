@@ -0,0 +1,124 @@
+//
+//  SurfacePool.cpp
+//  Moonlight
+//
+
+#include "SurfacePool.hpp"
+#include <algorithm>
+#include <borealis.hpp>
+#include <cstdlib>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static bool fill_linesizes(int linesize[4], AVPixelFormat format, int width) {
+    if (av_image_fill_linesizes(linesize, format, width) < 0)
+        return false;
+    for (int i = 0; i < 4; i++)
+        linesize[i] = (int)align_up(linesize[i], SURFACE_ALIGNMENT);
+    return true;
+}
+
+static size_t fill_pointers(uint8_t* data[4], AVPixelFormat format, int height,
+                            uint8_t* base, const int linesize[4]) {
+    // Pitch is aligned, so every plane starts aligned too
+    int size = av_image_fill_pointers(data, format, height, base, linesize);
+    return size < 0 ? 0 : align_up(size, SURFACE_ALIGNMENT);
+}
+
+size_t SurfacePool::surface_size(AVPixelFormat format, int width, int height) {
+    int linesize[4];
+    uint8_t* data[4];
+    if (!fill_linesizes(linesize, format, width))
+        return 0;
+    return fill_pointers(data, format, height, nullptr, linesize);
+}
+
+int SurfacePool::init(AVPixelFormat format, int width, int height, int count, size_t budget) {
+    cleanup();
+
+    m_format = format;
+    m_width = width;
+    m_height = height;
+    m_budget = budget;
+
+    uint8_t* data[4];
+    if (!fill_linesizes(m_linesize, format, width) ||
+        (m_surface_size = fill_pointers(data, format, height, nullptr, m_linesize)) == 0) {
+        brls::Logger::error("SurfacePool: Unsupported format {}", (int)format);
+        return 0;
+    }
+
+    int fits = (int)(budget / m_surface_size);
+    m_surfaces = std::max(SURFACE_COUNT_MIN, std::min(count, fits));
+    if (m_surfaces < count)
+        brls::Logger::warning("SurfacePool: {} of {} surfaces fit into {} MB budget",
+                              m_surfaces, count, budget >> 20);
+
+    m_pool = av_buffer_pool_init2(m_surface_size, this, alloc, nullptr);
+    brls::Logger::info("SurfacePool: {} surfaces of {} KB", m_surfaces, m_surface_size >> 10);
+    return m_pool ? m_surfaces : 0;
+}
+
+void SurfacePool::cleanup() {
+    // Pool is freed for real once frames give back their buffers
+    if (m_pool)
+        av_buffer_pool_uninit(&m_pool);
+    m_surfaces = 0;
+}
+
+int SurfacePool::attach(AVFrame* frame) {
+    if (!m_pool)
+        return AVERROR(EINVAL);
+
+    AVBufferRef* buffer = av_buffer_pool_get(m_pool);
+    if (!buffer)
+        return AVERROR(ENOMEM);
+
+    av_buffer_unref(&frame->buf[0]);
+    frame->buf[0] = buffer;
+    frame->format = m_format;
+    frame->width = m_width;
+    frame->height = m_height;
+    fill_pointers(frame->data, m_format, m_height, buffer->data, m_linesize);
+    std::copy(m_linesize, m_linesize + 4, frame->linesize);
+    return 0;
+}
+
+SurfacePoolStats SurfacePool::stats() const {
+    return {m_surfaces, m_allocated, m_surface_size, m_budget};
+}
+
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+AVBufferRef* SurfacePool::alloc(void* opaque, size_t size) {
+#else
+AVBufferRef* SurfacePool::alloc(void* opaque, int size) {
+#endif
+    auto pool = (SurfacePool*)opaque;
+
+    // av_malloc alignment depends on FFmpeg build, it's not enough for nvdec
+    auto data = (uint8_t*)aligned_alloc(SURFACE_ALIGNMENT, align_up(size, SURFACE_ALIGNMENT));
+    if (!data)
+        return nullptr;
+
+    AVBufferRef* buffer = av_buffer_create(data, size, release, &pool->m_allocated, 0);
+    if (!buffer) {
+        free(data);
+        return nullptr;
+    }
+
+    pool->m_allocated++;
+    return buffer;
+}
+
+void SurfacePool::release(void* opaque, uint8_t* data) {
+    // Buffers outlive AVBufferPool after uninit, counter lives in decoder
+    auto allocated = (std::atomic<int>*)opaque;
+    (*allocated)--;
+    free(data);
+}
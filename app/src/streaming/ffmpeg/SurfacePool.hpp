@@ -0,0 +1,62 @@
+//
+//  SurfacePool.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+}
+
+// Nvdec transfers and GL uploads want planes and pitch aligned to 256
+#define SURFACE_ALIGNMENT 256
+// Frame being decoded and frame on screen
+#define SURFACE_COUNT_MIN 2
+
+struct SurfacePoolStats {
+    int surfaces;
+    int allocated;
+    size_t surface_size;
+    size_t budget;
+};
+
+// System memory surfaces hardware frames are transferred into
+class SurfacePool {
+  public:
+    ~SurfacePool() { cleanup(); }
+
+    // Size of one surface, same layout attach() gives to frames
+    static size_t surface_size(AVPixelFormat format, int width, int height);
+
+    // Returns how many of requested surfaces fit into budget
+    int init(AVPixelFormat format, int width, int height, int count, size_t budget);
+    void cleanup();
+
+    // Gives frame a pooled buffer, frame returns it on av_frame_free
+    int attach(AVFrame* frame);
+
+    SurfacePoolStats stats() const;
+
+  private:
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+    static AVBufferRef* alloc(void* opaque, size_t size);
+#else
+    static AVBufferRef* alloc(void* opaque, int size);
+#endif
+    static void release(void* opaque, uint8_t* data);
+
+    AVBufferPool* m_pool = nullptr;
+    AVPixelFormat m_format = AV_PIX_FMT_NONE;
+    int m_width = 0;
+    int m_height = 0;
+    int m_linesize[4] = {};
+    int m_surfaces = 0;
+    size_t m_surface_size = 0;
+    size_t m_budget = 0;
+    std::atomic<int> m_allocated = 0;
+};
@@ -0,0 +1,289 @@
+//
+//  VitaVideoDecoder.cpp
+//  Moonlight
+//
+
+#ifdef __PSV__
+
+#include "VitaVideoDecoder.hpp"
+#include "AVFrameHolder.hpp"
+#include "FrameTracer.hpp"
+#include "HighResClock.hpp"
+#include "LatencyProbe.hpp"
+#include "MemoryAccounting.hpp"
+#include "StreamPercentiles.hpp"
+#include <borealis.hpp>
+#include <cstring>
+#include <psp2/sysmodule.h>
+
+// Kernel hands out physically contiguous blocks in whole megabytes
+#define VITA_MEMBLOCK_ALIGN (1024 * 1024)
+#define VITA_STATS_INTERVAL_US 200000
+
+bool VitaVideoDecoder::allocate(SceUID* block, void** base, size_t size, SceKernelMemBlockType type,
+                                const char* name) {
+    *block = sceKernelAllocMemBlock(name, type, VITA_DECODER_ALIGN(size, VITA_MEMBLOCK_ALIGN), nullptr);
+    if (*block < 0) {
+        brls::Logger::error("Vita: Couldn't allocate {} bytes for {}: {:#x}", size, name, *block);
+        return false;
+    }
+    sceKernelGetMemBlockBase(*block, base);
+    return true;
+}
+
+int VitaVideoDecoder::setup(int video_format, int width, int height, int redraw_rate,
+                            void* context, int dr_flags) {
+    if (!(video_format & VIDEO_FORMAT_MASK_H264)) {
+        brls::Logger::error("Vita: sceAvcdec only decodes H.264, got format {:#x}", video_format);
+        return -1;
+    }
+
+    if (width > VITA_DECODER_MAX_WIDTH || height > VITA_DECODER_MAX_HEIGHT) {
+        brls::Logger::error("Vita: {}x{} is over decoder limit", width, height);
+        return -1;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_stream_fps = redraw_rate;
+    m_pitch = VITA_DECODER_ALIGN(width, 16);
+    int aligned_height = VITA_DECODER_ALIGN(height, 16);
+
+    // Loading module again is a no-op
+    sceSysmoduleLoadModule(SCE_SYSMODULE_AVCDEC);
+
+    SceVideodecQueryInitInfoHwAvcdec init = {};
+    init.size = sizeof(init);
+    init.horizontal = m_pitch;
+    init.vertical = aligned_height;
+    init.numOfRefFrames = VITA_DECODER_REF_FRAMES;
+    init.numOfStreams = 1;
+
+    int err = sceVideodecInitLibrary(SCE_VIDEODEC_TYPE_HW_AVCDEC, &init);
+    if (err < 0) {
+        brls::Logger::error("Vita: sceVideodecInitLibrary failed: {:#x}", err);
+        return -1;
+    }
+    m_library_ready = true;
+
+    SceAvcdecQueryDecoderInfo query = {};
+    query.horizontal = init.horizontal;
+    query.vertical = init.vertical;
+    query.numOfRefFrames = init.numOfRefFrames;
+
+    SceAvcdecDecoderInfo info = {};
+    err = sceAvcdecQueryDecoderMemSize(SCE_VIDEODEC_TYPE_HW_AVCDEC, &query, &info);
+    if (err < 0) {
+        brls::Logger::error("Vita: sceAvcdecQueryDecoderMemSize failed: {:#x}", err);
+        cleanup();
+        return -1;
+    }
+
+    // Reference frames stay with decoder in CDRAM
+    void* decoder_memory;
+    if (!allocate(&m_decoder_block, &decoder_memory, info.frameMemSize,
+                  SCE_KERNEL_MEMBLOCK_TYPE_USER_CDRAM_RW, "avcdec")) {
+        cleanup();
+        return -1;
+    }
+    m_decoder.frameBuf.pBuf = decoder_memory;
+    m_decoder.frameBuf.size = VITA_DECODER_ALIGN(info.frameMemSize, VITA_MEMBLOCK_ALIGN);
+
+    err = sceAvcdecCreateDecoder(SCE_VIDEODEC_TYPE_HW_AVCDEC, &m_decoder, &query);
+    if (err < 0) {
+        brls::Logger::error("Vita: sceAvcdecCreateDecoder failed: {:#x}", err);
+        cleanup();
+        return -1;
+    }
+
+    if (!m_frames.init(m_frame_holder, redraw_rate)) {
+        cleanup();
+        return -1;
+    }
+
+    // Output is read by CPU during upload, uncached main memory keeps
+    // it coherent with decoder writes without cache maintenance
+    m_surface_size = VITA_DECODER_ALIGN((size_t)m_pitch * aligned_height * 3 / 2, 256);
+    void* surfaces;
+    if (!allocate(&m_surface_block, &surfaces, m_surface_size * m_frames.size(),
+                  SCE_KERNEL_MEMBLOCK_TYPE_USER_MAIN_PHYCONT_NC_RW, "avcdec_output")) {
+        cleanup();
+        return -1;
+    }
+    m_surfaces = (uint8_t*)surfaces;
+
+    m_last_frame = 0;
+    m_stats_time_us = 0;
+    m_video_decode_stats_progress = {};
+    m_video_decode_stats_snapshot.publish({});
+    FrameTracer::instance().reset();
+
+    brls::Logger::info("Vita: sceAvcdec ready for {}x{}, {} surfaces", width, height, m_frames.size());
+    return DR_OK;
+}
+
+void VitaVideoDecoder::cleanup() {
+    // Frames point into surfaces, so they go first
+    m_frames.cleanup();
+
+    if (m_decoder.handle) {
+        sceAvcdecDeleteDecoder(&m_decoder);
+        m_decoder = {};
+    }
+
+    if (m_library_ready) {
+        sceVideodecTermLibrary(SCE_VIDEODEC_TYPE_HW_AVCDEC);
+        m_library_ready = false;
+    }
+
+    if (m_decoder_block >= 0) {
+        sceKernelFreeMemBlock(m_decoder_block);
+        m_decoder_block = -1;
+    }
+
+    if (m_surface_block >= 0) {
+        sceKernelFreeMemBlock(m_surface_block);
+        m_surface_block = -1;
+        m_surfaces = nullptr;
+    }
+    MemoryAccounting::set(MEM_DECODER_SURFACES, 0);
+}
+
+int VitaVideoDecoder::submit_decode_unit(PDECODE_UNIT decode_unit) {
+    if (!m_surfaces)
+        return DR_NEED_IDR;
+
+    if (m_video_decode_stats_progress.measurement_start_timestamp_us == 0)
+        m_video_decode_stats_progress.measurement_start_timestamp_us = HighResClock::now_us();
+
+    if (m_last_frame)
+        m_video_decode_stats_progress.network_dropped_frames += decode_unit->frameNumber - (m_last_frame + 1);
+    m_last_frame = decode_unit->frameNumber;
+    m_video_decode_stats_progress.current_received_frames++;
+    uint64_t receive_time_us = (LiGetMillis() - decode_unit->receiveTimeMs) * 1000;
+    m_video_decode_stats_progress.current_reassembly_time_us += receive_time_us;
+    StreamPercentiles::instance().record(STREAM_STAT_RECEIVE, receive_time_us);
+    FrameTracer::instance().decode_submitted(decode_unit->frameNumber, decode_unit->receiveTimeMs, LiGetMillis());
+
+    // Decoder needs whole access unit in one buffer
+    if (m_buffer.size() < (size_t)decode_unit->fullLength)
+        m_buffer.resize(decode_unit->fullLength + decode_unit->fullLength / 4);
+    int length = 0;
+    for (PLENTRY entry = decode_unit->bufferList; entry != nullptr; entry = entry->next) {
+        memcpy(m_buffer.data() + length, entry->data, entry->length);
+        length += entry->length;
+    }
+
+    uint64_t before_decode = HighResClock::now_us();
+
+    // Surface of next ring slot is not referenced by any frame anymore
+    uint8_t* surface = m_surfaces + m_surface_size * m_frames.next_slot();
+    uint8_t* chroma = surface + (size_t)m_pitch * VITA_DECODER_ALIGN(m_height, 16);
+
+    SceAvcdecAu au = {};
+    au.es.pBuf = m_buffer.data();
+    au.es.size = length;
+    au.dts.lower = 0xFFFFFFFF;
+    au.dts.upper = 0xFFFFFFFF;
+    au.pts.lower = decode_unit->frameNumber;
+    au.pts.upper = 0;
+
+    SceAvcdecPicture picture = {};
+    picture.size = sizeof(picture);
+    picture.frame.pixelType = SCE_AVCDEC_PIXEL_YUV420_PACKED_RASTER;
+    picture.frame.framePitch = m_pitch;
+    picture.frame.frameWidth = m_width;
+    picture.frame.frameHeight = m_height;
+    picture.frame.pPicture[0] = surface;
+    picture.frame.pPicture[1] = chroma;
+
+    SceAvcdecPicture* pictures[] = {&picture};
+    SceAvcdecArrayPicture array = {};
+    array.numOfElm = 1;
+    array.pPicture = pictures;
+
+    int err = sceAvcdecDecode(&m_decoder, &au, &array);
+    if (err < 0) {
+        brls::Logger::error("Vita: sceAvcdecDecode failed: {:#x}", err);
+        return DR_NEED_IDR;
+    }
+
+    // Stream has no B-frames, so a picture comes out for every unit
+    if (array.numOfOutput == 0)
+        return DR_OK;
+
+    NativeFrame native = {};
+    native.format = AV_PIX_FMT_NV12;
+    native.width = m_width;
+    native.height = m_height;
+    native.pts = decode_unit->frameNumber;
+    native.planes[0] = surface;
+    native.planes[1] = chroma;
+    native.pitches[0] = m_pitch;
+    native.pitches[1] = m_pitch;
+    native.color_range = AVCOL_RANGE_MPEG;
+    native.colorspace = AVCOL_SPC_BT709;
+
+    AVFrame* frame = m_frames.wrap(native);
+    update_stats(HighResClock::now_us() - before_decode);
+
+    if (frame) {
+        FrameTracer::instance().decode_done((uint32_t)frame->pts);
+        LatencyProbe::instance().frame_decoded(frame);
+        m_frame_holder->push(frame);
+    }
+    return DR_OK;
+}
+
+void VitaVideoDecoder::update_stats(uint64_t decode_time_us) {
+    m_video_decode_stats_progress.current_decoded_frames++;
+    m_video_decode_stats_progress.current_decode_time_us += decode_time_us;
+    StreamPercentiles::instance().record(STREAM_STAT_DECODE, decode_time_us);
+
+    uint64_t now = HighResClock::now_us();
+    if (m_stats_time_us == 0)
+        m_stats_time_us = now;
+    if (now - m_stats_time_us < VITA_STATS_INTERVAL_US)
+        return;
+    m_stats_time_us = now;
+
+    auto& progress = m_video_decode_stats_progress;
+    VideoDecodeStats cache;
+
+    // Session totals carry over, window counters start again
+    progress.total_received_frames += progress.current_received_frames;
+    progress.total_decoded_frames += progress.current_decoded_frames;
+    progress.total_reassembly_time_us += progress.current_reassembly_time_us;
+    progress.total_decode_time_us += progress.current_decode_time_us;
+
+    float seconds = (float)(now - progress.measurement_start_timestamp_us) / 1000000;
+    cache = progress;
+    cache.current_host_fps = cache.current_received_fps = (float)progress.current_received_frames / seconds;
+    cache.current_decoded_fps = (float)progress.current_decoded_frames / seconds;
+    cache.current_receive_time = (float)progress.current_reassembly_time_us / 1000.0f / progress.current_received_frames;
+    cache.current_decoding_time = (float)progress.current_decode_time_us / 1000.0f / progress.current_decoded_frames;
+    cache.session_receive_time = (float)progress.total_reassembly_time_us / 1000.0f / progress.total_received_frames;
+    cache.session_decoding_time = (float)progress.total_decode_time_us / 1000.0f / progress.total_decoded_frames;
+    cache.hw_decoding = true;
+    cache.surfaces = cache.surfaces_allocated = m_frames.size();
+    cache.surface_memory_mb = (float)(m_surface_size * m_frames.size()) / (1 << 20);
+    MemoryAccounting::set(MEM_DECODER_SURFACES, m_surface_size * m_frames.size());
+    m_video_decode_stats_snapshot.publish(cache);
+
+    progress.current_received_frames = 0;
+    progress.current_decoded_frames = 0;
+    progress.current_reassembly_time_us = 0;
+    progress.current_decode_time_us = 0;
+    progress.measurement_start_timestamp_us = now;
+}
+
+int VitaVideoDecoder::capabilities() const {
+    // Units are decoded on the receive thread right away
+    return CAPABILITY_DIRECT_SUBMIT;
+}
+
+VideoDecodeStats VitaVideoDecoder::video_decode_stats() {
+    return m_video_decode_stats_snapshot.read();
+}
+
+#endif // __PSV__
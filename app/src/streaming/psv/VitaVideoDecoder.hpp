@@ -0,0 +1,59 @@
+//
+//  VitaVideoDecoder.hpp
+//  Moonlight
+//
+
+#pragma once
+#ifdef __PSV__
+
+#include "IVideoDecoder.hpp"
+#include "NativeFrameWrapper.hpp"
+#include <psp2/kernel/sysmem.h>
+#include <psp2/videodec.h>
+#include <vector>
+
+// Hardware limit of sceAvcdec, also the largest stream worth it on Vita
+#define VITA_DECODER_MAX_WIDTH 1280
+#define VITA_DECODER_MAX_HEIGHT 720
+#define VITA_DECODER_REF_FRAMES 5
+#define VITA_DECODER_ALIGN(x, a) (((x) + (a) - 1) & ~((a) - 1))
+
+// H.264 through sceAvcdec. Decoder writes NV12 straight into surfaces
+// frames point at, so GL renderer uploads them the same way it does
+// FFmpeg software frames, without an extra copy in system memory
+class VitaVideoDecoder : public IVideoDecoder {
+  public:
+    ~VitaVideoDecoder() { cleanup(); }
+
+    int setup(int video_format, int width, int height, int redraw_rate,
+              void* context, int dr_flags) override;
+    void cleanup() override;
+    int submit_decode_unit(PDECODE_UNIT decode_unit) override;
+    int capabilities() const override;
+    VideoDecodeStats video_decode_stats() override;
+
+  private:
+    bool allocate(SceUID* block, void** base, size_t size, SceKernelMemBlockType type, const char* name);
+    void update_stats(uint64_t decode_time_us);
+
+    bool m_library_ready = false;
+    SceAvcdecCtrl m_decoder = {};
+    SceUID m_decoder_block = -1;
+    SceUID m_surface_block = -1;
+    uint8_t* m_surfaces = nullptr;
+    size_t m_surface_size = 0;
+    int m_pitch = 0;
+    int m_width = 0;
+    int m_height = 0;
+    int m_stream_fps = 60;
+
+    std::vector<uint8_t> m_buffer;
+    NativeFrameWrapper m_frames;
+
+    uint32_t m_last_frame = 0;
+    uint64_t m_stats_time_us = 0;
+    VideoDecodeStats m_video_decode_stats_progress = {};
+    StatsSnapshot<VideoDecodeStats> m_video_decode_stats_snapshot;
+};
+
+#endif // __PSV__
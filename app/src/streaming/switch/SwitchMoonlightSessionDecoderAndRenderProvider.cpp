@@ -1,24 +1,19 @@
 #include "SwitchMoonlightSessionDecoderAndRenderProvider.hpp"
-#include "FFmpegVideoDecoder.hpp"
+#include "DebugFileRecorderVideoDecoder.hpp"
 #include "Settings.hpp"
-#include "SDLAudiorenderer.hpp"
+#include "PlatformBackends.hpp"
 
-#ifdef __SWITCH__
-#include "AudrenAudioRenderer.hpp"
-#endif
-
-#ifdef BOREALIS_USE_DEKO3D
-#include "DKVideoRenderer.hpp"
-#elif defined(USE_METAL_RENDERER)
-#include "MetalVideoRenderer.hpp"
-#elif defined(USE_GL_RENDERER)
-#include "GLVideoRenderer.hpp"
-#else
-#error No renderer selected, enable USE_GL_RENDERER or USE_METAL_RENDERER
-#endif
-
-IFFmpegVideoDecoder*
+IVideoDecoder*
 SwitchMoonlightSessionDecoderAndRenderProvider::video_decoder() {
+    if (Settings::instance().record_video()) {
+        return new DebugFileRecorderVideoDecoder(new FFmpegVideoDecoder(),
+                                                 Settings::instance().video_capture_path());
+    }
+#ifdef __PSV__
+    // FFmpeg software decoding can't keep up with any stream on Vita
+    if (Settings::instance().use_hw_decoding())
+        return new VitaVideoDecoder();
+#endif
     return new FFmpegVideoDecoder();
 }
 
@@ -36,12 +31,22 @@ SwitchMoonlightSessionDecoderAndRenderProvider::video_renderer() {
 IAudioRenderer*
 SwitchMoonlightSessionDecoderAndRenderProvider::audio_renderer() {
 #ifdef __SWITCH__
-    if (Settings::instance().audio_backend() == SDL) {
-        return new SDLAudioRenderer();
-    } else {
+    if (Settings::instance().audio_backend() == AUDREN) {
         return new AudrenAudioRenderer();
     }
-#else
-    return new SDLAudioRenderer();
 #endif
+#ifdef PLATFORM_ANDROID
+    if (Settings::instance().audio_backend() == AAUDIO) {
+        if (AAudioRenderer::available())
+            return new AAudioRenderer();
+        // Android before 8.0, callback mode is the closest to it
+        return new SDLAudioRenderer(true);
+    }
+#endif
+#ifdef __APPLE__
+    if (Settings::instance().audio_backend() == AUDIO_UNIT) {
+        return new AudioUnitAudioRenderer();
+    }
+#endif
+    return new SDLAudioRenderer(Settings::instance().audio_backend() == SDL_CALLBACK);
 }
@@ -5,7 +5,7 @@ class SwitchMoonlightSessionDecoderAndRenderProvider
   public:
     SwitchMoonlightSessionDecoderAndRenderProvider() {}
 
-    IFFmpegVideoDecoder* video_decoder();
+    IVideoDecoder* video_decoder();
     IVideoRenderer* video_renderer();
     IAudioRenderer* audio_renderer();
 };
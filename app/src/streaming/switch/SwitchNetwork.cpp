@@ -0,0 +1,45 @@
+//
+//  SwitchNetwork.cpp
+//  Moonlight
+//
+
+#ifdef __SWITCH__
+
+#include "SwitchNetwork.hpp"
+#include <borealis.hpp>
+#include <algorithm>
+#include <switch.h>
+
+static SwitchNetworkProfile m_profile = {};
+
+void SwitchNetwork::init(int bitrate_kbps) {
+    size_t udp_rx = (size_t)bitrate_kbps * 1000 / 8 * SWITCH_UDP_RX_BUFFER_MS / 1000;
+    udp_rx = std::clamp<size_t>(udp_rx, SWITCH_UDP_RX_BUFFER_MIN, SWITCH_UDP_RX_BUFFER_MAX);
+
+    SocketInitConfig config = *socketGetDefaultInitConfig();
+    config.tcp_rx_buf_size = std::max<u32>(config.tcp_rx_buf_size, SWITCH_TCP_RX_BUFFER);
+    config.tcp_rx_buf_max_size = std::max<u32>(config.tcp_rx_buf_max_size, SWITCH_TCP_RX_BUFFER);
+    config.udp_rx_buf_size = (u32)udp_rx;
+    config.sb_efficiency = SWITCH_SOCKET_EFFICIENCY;
+
+    // Borealis starts sockets with defaults before main
+    socketExit();
+    Result rc = socketInitialize(&config);
+    if (R_FAILED(rc)) {
+        brls::Logger::error("SwitchNetwork: Couldn't initialize sockets - 0x{:x}, using defaults", rc);
+        socketInitializeDefault();
+        const SocketInitConfig* defaults = socketGetDefaultInitConfig();
+        m_profile = {false, bitrate_kbps, defaults->udp_rx_buf_size, defaults->tcp_rx_buf_size};
+        return;
+    }
+
+    m_profile = {true, bitrate_kbps, udp_rx, config.tcp_rx_buf_size};
+    brls::Logger::info("SwitchNetwork: Sockets sized for {} Kbps, UDP receive {} KB, TCP receive {} KB",
+                       bitrate_kbps, udp_rx / 1024, config.tcp_rx_buf_size / 1024);
+}
+
+const SwitchNetworkProfile& SwitchNetwork::profile() {
+    return m_profile;
+}
+
+#endif
@@ -0,0 +1,37 @@
+//
+//  SwitchNetwork.hpp
+//  Moonlight
+//
+
+#pragma once
+#ifdef __SWITCH__
+
+#include <cstddef>
+
+// Video socket holds this much of stream, host sends a frame as one burst
+#define SWITCH_UDP_RX_BUFFER_MS 40
+// Defaults of libnx, anything below them isn't worth reinitialization
+#define SWITCH_UDP_RX_BUFFER_MIN 0xA500
+#define SWITCH_UDP_RX_BUFFER_MAX 0x100000
+#define SWITCH_TCP_RX_BUFFER 0x40000
+// Transfer memory of sockets is this times buffer sizes, default is 4
+#define SWITCH_SOCKET_EFFICIENCY 8
+
+struct SwitchNetworkProfile {
+    bool applied;
+    int bitrate_kbps;
+    size_t udp_rx_buffer;
+    size_t tcp_rx_buffer;
+};
+
+// libnx socket service is set up with defaults sized for light traffic,
+// kernel drops video packets before moonlight-common-c sees them at
+// high bitrate. Socket service can only be configured on init, so it's
+// started again once settings are known and before anything connects
+class SwitchNetwork {
+  public:
+    static void init(int bitrate_kbps);
+    static const SwitchNetworkProfile& profile();
+};
+
+#endif
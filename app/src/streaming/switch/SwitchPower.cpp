@@ -0,0 +1,92 @@
+//
+//  SwitchPower.cpp
+//  Moonlight
+//
+
+#ifdef __SWITCH__
+
+#include "SwitchPower.hpp"
+#include <borealis.hpp>
+#include <mutex>
+#include <switch.h>
+
+static std::mutex m_mutex;
+static uint32_t m_boost_reasons = 0;
+static bool m_psm_ready = false;
+static bool m_lbl_ready = false;
+static bool m_backlight_off = false;
+
+void SwitchPower::init() {
+    Result rc = lblInitialize();
+    if (R_FAILED(rc))
+        brls::Logger::warning("SwitchPower: Couldn't initialize lbl - 0x{:x}, backlight stays on", rc);
+    else
+        m_lbl_ready = true;
+
+    rc = psmInitialize();
+    if (R_FAILED(rc)) {
+        brls::Logger::warning("SwitchPower: Couldn't initialize psm - 0x{:x}, battery is unknown", rc);
+        return;
+    }
+    m_psm_ready = true;
+}
+
+void SwitchPower::set_boost(SwitchBoostReason reason, bool enabled) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t reasons = enabled ? m_boost_reasons | reason : m_boost_reasons & ~reason;
+    if ((reasons != 0) == (m_boost_reasons != 0)) {
+        m_boost_reasons = reasons;
+        return;
+    }
+    m_boost_reasons = reasons;
+
+    Result rc = appletSetCpuBoostMode(reasons ? ApmCpuBoostMode_FastLoad : ApmCpuBoostMode_Normal);
+    if (R_FAILED(rc))
+        brls::Logger::warning("SwitchPower: Couldn't set CPU boost mode - 0x{:x}", rc);
+    else
+        brls::Logger::debug("SwitchPower: CPU boost {}", reasons ? "on" : "off");
+}
+
+SwitchPowerStatus SwitchPower::status() {
+    SwitchPowerStatus status = {};
+    status.docked = appletGetOperationMode() == AppletOperationMode_Console;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        status.boosted = m_boost_reasons != 0;
+    }
+
+    if (m_psm_ready) {
+        u32 percent = 0;
+        PsmChargerType charger = PsmChargerType_Unconnected;
+        if (R_SUCCEEDED(psmGetBatteryChargePercentage(&percent)))
+            status.battery_percent = percent;
+        if (R_SUCCEEDED(psmGetChargerType(&charger)))
+            status.charging = charger != PsmChargerType_Unconnected;
+    } else {
+        status.battery_percent = 100;
+        status.charging = true;
+    }
+    return status;
+}
+
+bool SwitchPower::low_battery() {
+    SwitchPowerStatus status = SwitchPower::status();
+    return !status.docked && !status.charging && status.battery_percent < SWITCH_LOW_BATTERY_PERCENT;
+}
+
+void SwitchPower::set_backlight(bool on) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_lbl_ready || m_backlight_off == !on)
+        return;
+
+    Result rc = on ? lblSwitchBacklightOn(SWITCH_BACKLIGHT_FADE_NS) : lblSwitchBacklightOff(SWITCH_BACKLIGHT_FADE_NS);
+    if (R_FAILED(rc)) {
+        brls::Logger::warning("SwitchPower: Couldn't switch backlight - 0x{:x}", rc);
+        return;
+    }
+    m_backlight_off = !on;
+    brls::Logger::debug("SwitchPower: Backlight {}", on ? "on" : "off");
+}
+
+#endif
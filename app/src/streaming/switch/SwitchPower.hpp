@@ -0,0 +1,48 @@
+//
+//  SwitchPower.hpp
+//  Moonlight
+//
+
+#pragma once
+#ifdef __SWITCH__
+
+#include <cstdint>
+
+// Battery saver caps frame rate below this charge, in handheld only
+#define SWITCH_LOW_BATTERY_PERCENT 20
+#define SWITCH_LOW_BATTERY_FPS 30
+// Backlight fade when screen is turned off or on, in nanoseconds
+#define SWITCH_BACKLIGHT_FADE_NS 250000000ULL
+
+// Work which wants CPU boost, boost lasts while any of them runs
+enum SwitchBoostReason : uint32_t {
+    SWITCH_BOOST_SESSION_SETUP = 1 << 0,
+    SWITCH_BOOST_KEY_GENERATION = 1 << 1,
+};
+
+struct SwitchPowerStatus {
+    bool docked;
+    bool boosted;
+    bool charging;
+    uint32_t battery_percent;
+};
+
+// CPU boost mode for short CPU heavy work, like RSA key generation and
+// stream setup. Boost halves GPU clock, so stream itself runs with the
+// default configuration of current performance mode, apps can't go
+// below it
+class SwitchPower {
+  public:
+    static void init();
+
+    static void set_boost(SwitchBoostReason reason, bool enabled);
+
+    static SwitchPowerStatus status();
+    // Handheld, not charging and below SWITCH_LOW_BATTERY_PERCENT
+    static bool low_battery();
+
+    // Screen backlight, off for streams nobody looks at
+    static void set_backlight(bool on);
+};
+
+#endif
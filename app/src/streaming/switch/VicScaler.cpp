@@ -0,0 +1,100 @@
+//
+//  VicScaler.cpp
+//  Moonlight
+//
+
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+
+#include "VicScaler.hpp"
+#include "Log.hpp"
+#include "SwitchPower.hpp"
+#include <borealis.hpp>
+
+extern "C" {
+#include <libavutil/hwcontext.h>
+#include <libavutil/hwcontext_nvtegra.h>
+}
+
+bool VicScaler::output_size(int width, int height, int* out_width, int* out_height) {
+    bool docked = SwitchPower::status().docked;
+    int max_width = docked ? VIC_DOCKED_WIDTH : VIC_HANDHELD_WIDTH;
+    int max_height = docked ? VIC_DOCKED_HEIGHT : VIC_HANDHELD_HEIGHT;
+    if (width <= max_width && height <= max_height)
+        return false;
+
+    // Chroma planes are half size, so both sides stay even
+    if ((int64_t)width * max_height > (int64_t)height * max_width) {
+        *out_width = max_width;
+        *out_height = (int)((int64_t)height * max_width / width) & ~1;
+    } else {
+        *out_width = (int)((int64_t)width * max_height / height) & ~1;
+        *out_height = max_height;
+    }
+    return true;
+}
+
+bool VicScaler::init(AVBufferRef* device, AVPixelFormat sw_format, int width, int height, int pool_size) {
+    cleanup();
+
+    auto* device_ctx = (AVHWDeviceContext*)device->data;
+    auto* nvtegra = (AVNVTegraDeviceContext*)device_ctx->hwctx;
+    if (!nvtegra->vic_version) {
+        brls::Logger::warning("VicScaler: No VIC on device, stream isn't scaled");
+        return false;
+    }
+
+    AVBufferRefPtr frames(av_hwframe_ctx_alloc(device));
+    if (!frames)
+        return false;
+
+    auto* frames_ctx = (AVHWFramesContext*)frames->data;
+    frames_ctx->format = AV_PIX_FMT_NVTEGRA;
+    frames_ctx->sw_format = sw_format;
+    frames_ctx->width = width;
+    frames_ctx->height = height;
+    frames_ctx->initial_pool_size = pool_size;
+
+    int err = av_hwframe_ctx_init(frames.get());
+    if (err < 0) {
+        char error[AV_ERROR_MAX_STRING_SIZE] = {0};
+        brls::Logger::warning("VicScaler: Couldn't allocate {}x{} surfaces - {}", width, height,
+                              av_make_error_string(error, AV_ERROR_MAX_STRING_SIZE, err));
+        return false;
+    }
+
+    m_frames = std::move(frames);
+    m_width = width;
+    m_height = height;
+    brls::Logger::info("VicScaler: Scaling to {}x{}, VIC {:x}", width, height, nvtegra->vic_version);
+    return true;
+}
+
+void VicScaler::cleanup() {
+    m_frames.reset();
+    m_width = 0;
+    m_height = 0;
+}
+
+bool VicScaler::scale(AVFrame* dst, const AVFrame* src) {
+    // Surface of ring frame goes back to pool, renderer doesn't hold it
+    // longer than ring does
+    av_frame_unref(dst);
+
+    int err = av_hwframe_get_buffer(m_frames.get(), dst, 0);
+    if (err >= 0)
+        err = av_hwframe_transfer_data(dst, src, 0);
+
+    if (err < 0) {
+        char error[AV_ERROR_MAX_STRING_SIZE] = {0};
+        CLOG_WARNING(LOG_DECODE, "VicScaler: Scaling failed, showing decoder surfaces - {}",
+                     av_make_error_string(error, AV_ERROR_MAX_STRING_SIZE, err));
+        av_frame_unref(dst);
+        cleanup();
+        return false;
+    }
+
+    av_frame_copy_props(dst, src);
+    return true;
+}
+
+#endif
@@ -0,0 +1,49 @@
+//
+//  VicScaler.hpp
+//  Moonlight
+//
+
+#pragma once
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+
+#include "AVResources.hpp"
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+// Output sizes of the console, stream is scaled to fit one of them
+#define VIC_DOCKED_WIDTH 1920
+#define VIC_DOCKED_HEIGHT 1080
+#define VIC_HANDHELD_WIDTH 1280
+#define VIC_HANDHELD_HEIGHT 720
+
+// Decoded NVTEGRA surfaces of streams bigger than output are copied by
+// VIC into surfaces of output size, so deko3d samples what is shown and
+// not the whole stream. VIC filters when source and destination rects
+// differ, the copy itself runs in hwcontext transfer, decoder thread
+// waits for it
+class VicScaler {
+  public:
+    // Size stream is scaled to in current operation mode, keeps aspect,
+    // false when stream already fits
+    static bool output_size(int width, int height, int* out_width, int* out_height);
+
+    // Pool of surfaces from decoder device, false when device can't
+    bool init(AVBufferRef* device, AVPixelFormat sw_format, int width, int height, int pool_size);
+    void cleanup();
+
+    // Frame from decoder into pooled one, false when VIC failed, scaling
+    // is disabled then and decoder surfaces are shown as they are
+    bool scale(AVFrame* dst, const AVFrame* src);
+
+    [[nodiscard]] bool active() const { return m_frames != nullptr; }
+
+  private:
+    AVBufferRefPtr m_frames;
+    int m_width = 0;
+    int m_height = 0;
+};
+
+#endif
@@ -0,0 +1,148 @@
+//
+//  ColorConversion.hpp
+//  Moonlight
+//
+
+#pragma once
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
+}
+
+enum ColorStandard { COLOR_STANDARD_BT601, COLOR_STANDARD_BT709, COLOR_STANDARD_BT2020 };
+
+// Shaders convert with rgb = matrix * (yuv - offset)
+struct ColorConversion {
+    // Column major, as glUniformMatrix3fv and glm::mat3 take it
+    float matrix[9];
+    float offset[3];
+};
+
+// Derived from luma weights of the standard and quantization range, so
+// renderers don't carry rounded copies of the same tables. 10 bit samples
+// come MSB aligned in 16 bit texels, as P010 and VideoToolbox frames have them
+constexpr ColorConversion make_color_conversion(double kr, double kb, bool full, bool ten_bit) {
+    double texel_max = ten_bit ? 65535.0 : 255.0;
+    double code_scale = ten_bit ? 256.0 : 1.0; // 8 bit code to 10 bit one in upper bits
+    double code_max = ten_bit ? 1023.0 * 64.0 : 255.0;
+
+    double y_offset = full ? 0.0 : 16.0 * code_scale / texel_max;
+    double c_offset = 128.0 * code_scale / texel_max;
+    double y_scale = texel_max / (full ? code_max : 219.0 * code_scale);
+    double c_scale = texel_max / (full ? code_max : 224.0 * code_scale);
+    double kg = 1.0 - kr - kb;
+
+    return {{(float)y_scale, (float)y_scale, (float)y_scale,
+             0.0f, (float)(-c_scale * 2.0 * kb * (1.0 - kb) / kg), (float)(c_scale * 2.0 * (1.0 - kb)),
+             (float)(c_scale * 2.0 * (1.0 - kr)), (float)(-c_scale * 2.0 * kr * (1.0 - kr) / kg), 0.0f},
+            {(float)y_offset, (float)c_offset, (float)c_offset}};
+}
+
+constexpr ColorConversion make_color_conversion(ColorStandard standard, bool full, bool ten_bit) {
+    switch (standard) {
+        case COLOR_STANDARD_BT709:
+            return make_color_conversion(0.2126, 0.0722, full, ten_bit);
+        case COLOR_STANDARD_BT2020:
+            return make_color_conversion(0.2627, 0.0593, full, ten_bit);
+        default:
+            return make_color_conversion(0.299, 0.114, full, ten_bit);
+    }
+}
+
+// Indexed by standard, full range and 10 bit
+inline constexpr ColorConversion k_color_conversions[3][2][2] = {
+    {{make_color_conversion(COLOR_STANDARD_BT601, false, false), make_color_conversion(COLOR_STANDARD_BT601, false, true)},
+     {make_color_conversion(COLOR_STANDARD_BT601, true, false), make_color_conversion(COLOR_STANDARD_BT601, true, true)}},
+    {{make_color_conversion(COLOR_STANDARD_BT709, false, false), make_color_conversion(COLOR_STANDARD_BT709, false, true)},
+     {make_color_conversion(COLOR_STANDARD_BT709, true, false), make_color_conversion(COLOR_STANDARD_BT709, true, true)}},
+    {{make_color_conversion(COLOR_STANDARD_BT2020, false, false), make_color_conversion(COLOR_STANDARD_BT2020, false, true)},
+     {make_color_conversion(COLOR_STANDARD_BT2020, true, false), make_color_conversion(COLOR_STANDARD_BT2020, true, true)}},
+};
+
+static_assert(k_color_conversions[COLOR_STANDARD_BT709][0][0].matrix[6] > 1.7927f &&
+                  k_color_conversions[COLOR_STANDARD_BT709][0][0].matrix[6] < 1.7928f,
+              "BT.709 limited range Cr to R coefficient");
+
+// Unspecified colorspace is what we ask encoder for by default
+inline ColorStandard color_standard(AVColorSpace colorspace) {
+    switch (colorspace) {
+        case AVCOL_SPC_BT709:
+            return COLOR_STANDARD_BT709;
+        case AVCOL_SPC_BT2020_NCL:
+        case AVCOL_SPC_BT2020_CL:
+            return COLOR_STANDARD_BT2020;
+        default:
+            return COLOR_STANDARD_BT601;
+    }
+}
+
+// Hardware frames are sampled as their software format
+inline const AVPixFmtDescriptor* color_format_desc(const AVFrame* frame) {
+    int format = frame->format;
+    if (frame->hw_frames_ctx)
+        format = ((AVHWFramesContext*)frame->hw_frames_ctx->data)->sw_format;
+    return av_pix_fmt_desc_get((AVPixelFormat)format);
+}
+
+inline bool color_ten_bit(const AVFrame* frame) {
+    const AVPixFmtDescriptor* desc = color_format_desc(frame);
+    return desc && desc->comp[0].depth > 8;
+}
+
+// Software decoded high depth frames, yuv420p10le and alike, have samples
+// in low bits of 16 bit texels. Sampled value times this is MSB aligned
+inline float color_sample_scale(const AVFrame* frame) {
+    const AVPixFmtDescriptor* desc = color_format_desc(frame);
+    if (!desc || desc->comp[0].depth <= 8 || desc->comp[0].shift > 0)
+        return 1.0f;
+    return (float)(1 << (desc->comp[0].step * 8 - desc->comp[0].depth));
+}
+
+// Same conversion for samples scaled down by scale, folded into matrix
+// and offset so shaders take low aligned texels as they are
+inline ColorConversion scaled_color_conversion(const ColorConversion& conversion, float scale) {
+    ColorConversion scaled = conversion;
+    for (float& value : scaled.matrix)
+        value *= scale;
+    for (float& value : scaled.offset)
+        value /= scale;
+    return scaled;
+}
+
+inline const ColorConversion& color_conversion(ColorStandard standard, bool full, bool ten_bit) {
+    return k_color_conversions[standard][full][ten_bit];
+}
+
+inline const ColorConversion& color_conversion(const AVFrame* frame) {
+    return color_conversion(color_standard(frame->colorspace), frame->color_range == AVCOL_RANGE_JPEG,
+                            color_ten_bit(frame));
+}
+
+// Color properties of last drawn frame, renderers only update their
+// uniforms when these change
+class ColorConversionTracker {
+  public:
+    // True for the first frame and whenever conversion or transfer changes
+    bool changed(const AVFrame* frame) {
+        bool ten_bit = color_ten_bit(frame);
+        if (m_colorspace == frame->colorspace && m_color_range == frame->color_range &&
+            m_color_trc == frame->color_trc && m_ten_bit == ten_bit)
+            return false;
+
+        m_colorspace = frame->colorspace;
+        m_color_range = frame->color_range;
+        m_color_trc = frame->color_trc;
+        m_ten_bit = ten_bit;
+        return true;
+    }
+
+    void reset() { m_colorspace = -1; }
+
+  private:
+    int m_colorspace = -1;
+    int m_color_range = -1;
+    int m_color_trc = -1;
+    bool m_ten_bit = false;
+};
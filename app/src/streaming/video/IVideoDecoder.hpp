@@ -0,0 +1,109 @@
+#pragma once
+
+#include "StatsSnapshot.hpp"
+#include <Limelight.h>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Steps decoder takes when it can't keep up with stream, each one keeps
+// what previous did
+enum DecoderOverloadMode {
+    DECODER_OVERLOAD_NONE,
+    DECODER_OVERLOAD_SKIP_LOOP_FILTER,
+    DECODER_OVERLOAD_SKIP_NONREF,
+    DECODER_OVERLOAD_FLUSH_QUEUE,
+};
+
+struct VideoDecodeStats {
+    // NOT TO USE, INTERMEDIATE VALUES
+    // All times are in microseconds
+    uint32_t current_received_frames;
+    uint32_t current_decoded_frames;
+    uint32_t total_frames;
+    uint32_t network_dropped_frames;
+    // Frames decoder flagged as damaged and IDR frames requested for them
+    uint32_t corrupt_frames;
+    uint32_t idr_requests;
+    // Stalls decoding recovered from by skipping to IDR, units skipped
+    uint32_t backlog_skips;
+    uint32_t backlog_skipped_frames;
+    uint64_t current_reassembly_time_us;
+    uint64_t current_decode_time_us;
+    uint32_t total_received_frames;
+    uint32_t total_decoded_frames;
+    uint64_t total_reassembly_time_us;
+    uint64_t total_decode_time_us;
+    uint64_t current_copy_time_us;
+    uint32_t current_copied_frames;
+    uint32_t total_zero_copy_frames;
+    uint32_t peak_packet_size;
+    uint64_t current_pipeline_delay_us;
+    uint32_t current_pipeline_frames;
+
+    // System memory surfaces hardware frames are copied into
+    uint32_t surfaces;
+    uint32_t surfaces_allocated;
+    float surface_memory_mb;
+    float surface_budget_mb;
+
+    // Calculated values, times are in milliseconds
+    float current_host_fps;
+    float current_received_fps;
+    float current_decoded_fps;
+
+    float current_receive_time;
+    float current_decoding_time;
+
+    float session_receive_time;
+    float session_decoding_time;
+
+    // Average time spent assembling decode unit into a single buffer
+    float current_copy_time;
+
+    // Measured delay from packet submit to frame output, frame threads
+    // hold frames back for few packets
+    bool frame_threaded;
+    float pipeline_latency;
+    bool hw_decoding;
+    DecoderOverloadMode overload_mode;
+
+    uint64_t measurement_start_timestamp_us;
+};
+
+// Decoders hand frames to AVFrameHolder of their pipeline, renderers
+// pick them up there.
+// AVFrame is only used as frame descriptor: FFmpeg fills it while
+// decoding, native backends (VTDecompressionSession, AMediaCodec,
+// sceAvcdec) wrap their own output buffer with NativeFrameWrapper, so
+// renderer of its format gets it without FFmpeg or copy in between.
+// Provider picks the backend, session only sees this interface
+class AVFrameHolder;
+class IVideoFrameAllocator;
+class IVideoFrameUploader;
+
+class IVideoDecoder {
+  public:
+    virtual ~IVideoDecoder()= default;
+    // Format independent part of setup, runs while host launches the app
+    virtual void prepare(){};
+    virtual int setup(int video_format, int width, int height, int redraw_rate,
+                      void* context, int dr_flags) = 0;
+    virtual void start(){};
+    // Software decoding allocates frames in renderer memory, if given
+    virtual void set_frame_allocator(IVideoFrameAllocator* allocator){};
+    // Decoded frames are uploaded on decoder thread, if given
+    virtual void set_frame_uploader(IVideoFrameUploader* uploader){};
+    // Queue decoded frames go to, set before setup
+    virtual void set_frame_holder(AVFrameHolder* holder) { m_frame_holder = holder; }
+    virtual void stop(){};
+    virtual void cleanup() = 0;
+    virtual int submit_decode_unit(PDECODE_UNIT decode_unit) = 0;
+    virtual int capabilities() const = 0;
+    // Snapshot of the last finished stats window, safe from any thread
+    virtual VideoDecodeStats video_decode_stats() = 0;
+
+  protected:
+    AVFrameHolder* m_frame_holder = nullptr;
+};
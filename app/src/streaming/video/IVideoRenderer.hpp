@@ -2,6 +2,7 @@
 
 #include <Limelight.h>
 #include <nanovg.h>
+#include "HighResClock.hpp"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -11,19 +12,54 @@ extern "C" {
 struct VideoRenderStats {
     // NOT TO USE, INTERMEDIATE VALUES
     uint32_t rendered_frames;
-    uint64_t total_render_time;
+    uint64_t total_render_time_us;
+    uint32_t gpu_timed_frames;
+    uint64_t total_gpu_time_ns;
 
     float rendered_fps;
+    // Average time in milliseconds
     float rendering_time;
+    // Average GPU execution time of a frame in milliseconds, CPU time above
+    // only covers command submission. 0 when renderer can't measure it
+    float gpu_rendering_time;
 
-    uint64_t measurement_start_timestamp;
+    uint64_t measurement_start_timestamp_us;
+};
+
+// Memory renderer samples without copy, software decoders allocate
+// their frames in it
+class IVideoFrameAllocator {
+  public:
+    virtual ~IVideoFrameAllocator() = default;
+    // Same contract as AVCodecContext::get_buffer2, called from decoder
+    // threads, error means decoder should use its default allocation
+    virtual int get_buffer(AVCodecContext* context, AVFrame* frame) = 0;
+};
+
+// Uploads frames into renderer textures on decoder side, so render
+// thread only binds them
+class IVideoFrameUploader {
+  public:
+    virtual ~IVideoFrameUploader() = default;
+    // Called from decoder threads right before frame is queued
+    virtual void upload(const AVFrame* frame) = 0;
 };
 
 class IVideoRenderer {
   public:
     virtual ~IVideoRenderer(){};
+    // Called on render thread before first frame is known
+    virtual void prepare(){};
+    // Called on render thread after prepare, frames up to this size
+    // could be allocated in returned memory. It must outlive decoder
+    virtual IVideoFrameAllocator* frame_allocator(int width, int height) { return nullptr; }
+    // Called on render thread after prepare, decoder hands every frame
+    // to returned uploader when there is one. It must outlive decoder
+    virtual IVideoFrameUploader* frame_uploader() { return nullptr; }
+    // Generation is the same when frame is handed again with nothing new
+    // decoded, renderer could skip upload and presentation for it
     virtual void draw(NVGcontext* vg, int width, int height,
-                      AVFrame* frame, int imageFormat) = 0;
+                      AVFrame* frame, int imageFormat, uint64_t generation) = 0;
     virtual VideoRenderStats* video_render_stats() = 0;
 
     // Default implementations
@@ -12,10 +12,192 @@ struct CscParams
     float3 matrix[3];
     float3 offsets;
     float bitnessScaleFactor;
+    // 0 when display takes HDR as is, 1 for PQ and 2 for HLG tone mapping to SDR
+    int toneMap;
+    // 0 bilinear, 1 bicubic, 2 Lanczos2 and 3 FSR1 style, luma only
+    int scaling;
 };
 
+float3 pqToNits(float3 e)
+{
+    float3 np = pow(e, 1.0f / 78.84375f);
+    float3 l = max(np - 0.8359375f, 0.0f) / (18.8515625f - 18.6875f * np);
+    return pow(l, 1.0f / 0.1593017578125f) * 10000.0f;
+}
+
+float3 hlgToNits(float3 e)
+{
+    float3 low = e * e / 3.0f;
+    float3 high = (exp((e - 0.55991073f) / 0.17883277f) + 0.28466892f) / 12.0f;
+    float3 scene = select(low, high, e > 0.5f);
+    // Reference OOTF for 1000 nits display
+    float y = dot(scene, float3(0.2627f, 0.6780f, 0.0593f));
+    return scene * pow(max(y, 1e-6f), 0.2f) * 1000.0f;
+}
+
+// Fused into YUV->RGB pass, so SDR displays get HDR streams without extra pass
+float3 toneMap(float3 rgb, int mode)
+{
+    if (mode == 0)
+        return rgb;
+
+    float3 color = (mode == 1 ? pqToNits(rgb) : hlgToNits(rgb)) / 203.0f;
+    float l = dot(color, float3(0.2627f, 0.6780f, 0.0593f));
+    float white = 1000.0f / 203.0f;
+    float mapped = l * (1.0f + l / (white * white)) / (1.0f + l);
+    color *= l > 0.0f ? mapped / l : 0.0f;
+
+    // BT.2020 to BT.709 primaries
+    color = float3x3(float3(1.6605f, -0.1246f, -0.0182f),
+                     float3(-0.5876f, 1.1329f, -0.1006f),
+                     float3(-0.0728f, -0.0083f, 1.1187f)) * color;
+    return pow(saturate(color), 1.0f / 2.2f);
+}
+
 constexpr sampler s(coord::normalized, address::clamp_to_edge, filter::linear);
 
+float sampleBicubic(texture2d<float> tex, float2 uv, float2 texel)
+{
+    // Catmull-Rom with 9 bilinear taps
+    float2 pos = uv / texel;
+    float2 tc = floor(pos - 0.5f) + 0.5f;
+    float2 f = pos - tc;
+    float2 w0 = f * (-0.5f + f * (1.0f - 0.5f * f));
+    float2 w1 = 1.0f + f * f * (-2.5f + 1.5f * f);
+    float2 w2 = f * (0.5f + f * (2.0f - 1.5f * f));
+    float2 w3 = f * f * (-0.5f + 0.5f * f);
+    float2 w12 = w1 + w2;
+    float2 tc0 = (tc - 1.0f) * texel;
+    float2 tc12 = (tc + w2 / w12) * texel;
+    float2 tc3 = (tc + 2.0f) * texel;
+
+    return (tex.sample(s, float2(tc0.x, tc0.y)).r * w0.x +
+            tex.sample(s, float2(tc12.x, tc0.y)).r * w12.x +
+            tex.sample(s, float2(tc3.x, tc0.y)).r * w3.x) * w0.y +
+           (tex.sample(s, float2(tc0.x, tc12.y)).r * w0.x +
+            tex.sample(s, float2(tc12.x, tc12.y)).r * w12.x +
+            tex.sample(s, float2(tc3.x, tc12.y)).r * w3.x) * w12.y +
+           (tex.sample(s, float2(tc0.x, tc3.y)).r * w0.x +
+            tex.sample(s, float2(tc12.x, tc3.y)).r * w12.x +
+            tex.sample(s, float2(tc3.x, tc3.y)).r * w3.x) * w3.y;
+}
+
+float lanczos2(float x)
+{
+    x = fabs(x) * M_PI_F;
+    if (x < 1e-4f)
+        return 1.0f;
+    return x < 2.0f * M_PI_F ? 2.0f * sin(x) * sin(x * 0.5f) / (x * x) : 0.0f;
+}
+
+float sampleLanczos(texture2d<float> tex, float2 uv, float2 texel)
+{
+    float2 pos = uv / texel - 0.5f;
+    float2 base = floor(pos);
+    float2 f = pos - base;
+
+    float wx[4], wy[4];
+    for (int i = 0; i < 4; i++) {
+        wx[i] = lanczos2(float(i - 1) - f.x);
+        wy[i] = lanczos2(float(i - 1) - f.y);
+    }
+
+    float sum = 0.0f, weights = 0.0f;
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            float w = wx[x] * wy[y];
+            sum += tex.sample(s, (base + float2(float(x), float(y)) - 0.5f) * texel).r * w;
+            weights += w;
+        }
+    }
+    return sum / weights;
+}
+
+// Same EASU and RCAS approximation as GL shaders, in a single pass
+float sampleEasu(texture2d<float> tex, float2 uv, float2 texel)
+{
+    float2 pos = uv / texel - 0.5f;
+    float2 base = floor(pos);
+    float2 f = pos - base;
+
+    float l[16];
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++)
+            l[y * 4 + x] = tex.sample(s, (base + float2(float(x), float(y)) - 0.5f) * texel).r;
+    }
+
+    float2 dir = 0.0f;
+    float len = 0.0f;
+    for (int y = 1; y < 3; y++) {
+        for (int x = 1; x < 3; x++) {
+            float w = (x == 1 ? 1.0f - f.x : f.x) * (y == 1 ? 1.0f - f.y : f.y);
+            float c = l[y * 4 + x];
+            float dx = l[y * 4 + x + 1] - l[y * 4 + x - 1];
+            float dy = l[(y + 1) * 4 + x] - l[(y - 1) * 4 + x];
+            float lx = saturate(fabs(dx) / max(max(fabs(l[y * 4 + x + 1] - c), fabs(c - l[y * 4 + x - 1])), 1e-5f));
+            float ly = saturate(fabs(dy) / max(max(fabs(l[(y + 1) * 4 + x] - c), fabs(c - l[(y - 1) * 4 + x])), 1e-5f));
+            dir += float2(dx, dy) * w;
+            len += (lx * lx + ly * ly) * 0.5f * w;
+        }
+    }
+
+    float dirLen = dot(dir, dir);
+    dir = dirLen < 1.0f / 32768.0f ? float2(1.0f, 0.0f) : dir * rsqrt(dirLen);
+    len *= len;
+    float stretch = dot(dir, dir) / max(fabs(dir.x), fabs(dir.y));
+    float2 len2 = float2(1.0f + (stretch - 1.0f) * len, 1.0f - 0.5f * len);
+    float lob = 0.5f - 0.29f * len;
+    float clp = 1.0f / lob;
+
+    float sum = 0.0f, weights = 0.0f;
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            float2 v = float2(float(x), float(y)) - 1.0f - f;
+            v = float2(dot(v, dir), dot(v, float2(-dir.y, dir.x))) * len2;
+            float d2 = min(dot(v, v), clp);
+            float wb = 0.4f * d2 - 1.0f;
+            float wa = lob * d2 - 1.0f;
+            float w = (1.5625f * wb * wb - 0.5625f) * wa * wa;
+            sum += l[y * 4 + x] * w;
+            weights += w;
+        }
+    }
+
+    float mn = min(min(l[5], l[6]), min(l[9], l[10]));
+    float mx = max(max(l[5], l[6]), max(l[9], l[10]));
+    return clamp(sum / weights, mn, mx);
+}
+
+float sharpenRcas(texture2d<float> tex, float2 uv, float2 texel, float c)
+{
+    float n = tex.sample(s, uv - float2(0.0f, texel.y)).r;
+    float so = tex.sample(s, uv + float2(0.0f, texel.y)).r;
+    float w = tex.sample(s, uv - float2(texel.x, 0.0f)).r;
+    float e = tex.sample(s, uv + float2(texel.x, 0.0f)).r;
+
+    float mn = min(min(n, so), min(w, e));
+    float mx = max(max(n, so), max(w, e));
+    float hitMin = mn / (4.0f * max(mx, 1e-5f));
+    float hitMax = (1.0f - mx) / min(4.0f * mn - 4.0f, -1e-5f);
+    float lobe = max(-0.1875f, min(max(-hitMin, hitMax), 0.0f)) * 0.87055f;
+    return saturate((lobe * (n + so + w + e) + c) / (4.0f * lobe + 1.0f));
+}
+
+float sampleLuma(texture2d<float> tex, float2 uv, int mode)
+{
+    float2 texel = 1.0f / float2(tex.get_width(), tex.get_height());
+    switch (mode) {
+    case 1:
+        return sampleBicubic(tex, uv, texel);
+    case 2:
+        return sampleLanczos(tex, uv, texel);
+    case 3:
+        return sharpenRcas(tex, uv, texel, sampleEasu(tex, uv, texel));
+    default:
+        return tex.sample(s, uv).r;
+    }
+}
+
 vertex Vertex vs_draw(constant Vertex *vertices [[ buffer(0) ]], uint id [[ vertex_id ]])
 {
     return vertices[id];
@@ -26,7 +208,7 @@ fragment float4 ps_draw_biplanar(Vertex v [[ stage_in ]],
                                  texture2d<float> luminancePlane [[ texture(0) ]],
                                  texture2d<float> chrominancePlane [[ texture(1) ]])
 {
-    float3 yuv = float3(luminancePlane.sample(s, v.texCoords).r,
+    float3 yuv = float3(sampleLuma(luminancePlane, v.texCoords, cscParams.scaling),
                         chrominancePlane.sample(s, v.texCoords).rg);
     yuv *= cscParams.bitnessScaleFactor;
     yuv -= cscParams.offsets;
@@ -35,7 +217,7 @@ fragment float4 ps_draw_biplanar(Vertex v [[ stage_in ]],
     rgb.r = dot(yuv, cscParams.matrix[0]);
     rgb.g = dot(yuv, cscParams.matrix[1]);
     rgb.b = dot(yuv, cscParams.matrix[2]);
-    return float4(rgb, 1.0f);
+    return float4(toneMap(saturate(rgb), cscParams.toneMap), 1.0f);
 }
 
 fragment float4 ps_draw_triplanar(Vertex v [[ stage_in ]],
@@ -44,7 +226,7 @@ fragment float4 ps_draw_triplanar(Vertex v [[ stage_in ]],
                                   texture2d<float> chrominancePlaneU [[ texture(1) ]],
                                   texture2d<float> chrominancePlaneV [[ texture(2) ]])
 {
-    float3 yuv = float3(luminancePlane.sample(s, v.texCoords).r,
+    float3 yuv = float3(sampleLuma(luminancePlane, v.texCoords, cscParams.scaling),
                         chrominancePlaneU.sample(s, v.texCoords).r,
                         chrominancePlaneV.sample(s, v.texCoords).r);
     yuv *= cscParams.bitnessScaleFactor;
@@ -54,7 +236,7 @@ fragment float4 ps_draw_triplanar(Vertex v [[ stage_in ]],
     rgb.r = dot(yuv, cscParams.matrix[0]);
     rgb.g = dot(yuv, cscParams.matrix[1]);
     rgb.b = dot(yuv, cscParams.matrix[2]);
-    return float4(rgb, 1.0f);
+    return float4(toneMap(saturate(rgb), cscParams.toneMap), 1.0f);
 }
 
 fragment float4 ps_draw_rgb(Vertex v [[ stage_in ]],
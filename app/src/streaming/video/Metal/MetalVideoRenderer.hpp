@@ -4,13 +4,13 @@
 #include "IVideoRenderer.hpp"
 #include <SDL2/SDL.h>
 
-class MetalVideoRenderer : public IVideoRenderer {
+class MetalVideoRenderer final : public IVideoRenderer {
 public:
     MetalVideoRenderer();
     ~MetalVideoRenderer();
 
     void waitToRender();
-    void draw(NVGcontext* vg, int width, int height, AVFrame* frame, int imageFormat) override;
+    void draw(NVGcontext* vg, int width, int height, AVFrame* frame, int imageFormat, uint64_t generation) override;
     VideoRenderStats* video_render_stats() override;
 private:
     void discardNextDrawable();
@@ -23,12 +23,15 @@ private:
 //    SDL_MetalView m_MetalView;
 
     bool initialized = false;
+    bool initializeResult = false;
     int m_LastColorSpace = -1;
     bool m_LastFullRange = false;
+    bool m_LastTenBit = false;
     int m_LastFrameWidth = -1;
     int m_LastFrameHeight = -1;
     int m_LastDrawableWidth = -1;
     int m_LastDrawableHeight = -1;
+    uint64_t m_DrawnGeneration = 0;
 };
 
 #endif // USE_METAL_RENDERER
@@ -12,22 +12,28 @@ extern "C" {
 
 #include <borealis.hpp>
 #include <borealis/platforms/sdl/sdl_video.hpp>
+#include "ColorConversion.hpp"
 #include "MTShaders.hpp"
 #include "streamutils.hpp"
 #include "MetalVideoRenderer.hpp"
+#include "Settings.hpp"
 #include <array>
+#include <atomic>
 
 #import <CoreVideo/CoreVideo.h>
 #import <Metal/Metal.h>
 #import <MetalKit/MetalKit.h>
 
 #define MAX_VIDEO_PLANES 3
+// Frames CPU may encode ahead of GPU, each one owns a uniform ring slot
+#define MAX_FRAMES_IN_FLIGHT 3
+// Metal requires constant buffer offsets to be aligned to 256 bytes
+#define UNIFORM_SLOT_ALIGNMENT 256
 
 UIView* m_MetalView;
 CAMetalLayer* m_MetalLayer;
 CVMetalTextureCacheRef m_TextureCache;
-id<MTLBuffer> m_CscParamsBuffer;
-id<MTLBuffer> m_VideoVertexBuffer;
+id<MTLBuffer> m_UniformRing;
 id<MTLRenderPipelineState> m_VideoPipelineState;
 id<MTLRenderPipelineState> m_OverlayPipelineState;
 id<MTLLibrary> m_ShaderLibrary;
@@ -36,6 +42,15 @@ id<CAMetalDrawable> m_NextDrawable;
 SDL_mutex* m_PresentationMutex = SDL_CreateMutex();
 SDL_cond* m_PresentationCond = SDL_CreateCond();
 int m_PendingPresentationCount = 0;
+dispatch_semaphore_t m_InFlightSemaphore;
+int m_UniformSlot = 0;
+CADisplayLink* m_DisplayLink;
+bool m_DisplayLinkRunning = false;
+// Updated from display link thread, in seconds
+double m_DisplayFrameDuration = 0;
+// GPU time of completed command buffers, added from completion handlers
+std::atomic<uint64_t> m_GpuTimeNs = 0;
+std::atomic<uint32_t> m_GpuTimedFrames = 0;
 
 struct CscParams
 {
@@ -47,80 +62,95 @@ struct ParamBuffer
 {
     CscParams cscParams;
     float bitnessScaleFactor;
+    int toneMap;
+    int scaling;
 };
 
-static const CscParams k_CscParams_Bt601Lim = {
-    // CSC Matrix
-    {
-        { 1.1644f, 0.0f, 1.5960f },
-        { 1.1644f, -0.3917f, -0.8129f },
-        { 1.1644f, 2.0172f, 0.0f }
-    },
+// Metal shader multiplies by rows of the shared column major matrix
+static CscParams csc_params(ColorStandard standard, bool fullRange, bool tenBit) {
+    const ColorConversion& conversion = color_conversion(standard, fullRange, tenBit);
+    CscParams params;
+    for (int i = 0; i < 3; i++)
+        params.matrix[i] = {conversion.matrix[i], conversion.matrix[3 + i], conversion.matrix[6 + i]};
+    params.offsets = {conversion.offset[0], conversion.offset[1], conversion.offset[2]};
+    return params;
+}
 
-    // Offsets
-    { 16.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f },
+struct Vertex
+{
+    vector_float4 position;
+    vector_float2 texCoord;
 };
-static const CscParams k_CscParams_Bt601Full = {
-    // CSC Matrix
-    {
-        { 1.0f, 0.0f, 1.4020f },
-        { 1.0f, -0.3441f, -0.7141f },
-        { 1.0f, 1.7720f, 0.0f },
-    },
 
-    // Offsets
-    { 0.0f, 128.0f / 255.0f, 128.0f / 255.0f },
+// Everything frame shaders read, copied into its own ring slot every frame
+// so CPU never writes memory GPU still reads from
+struct FrameUniforms
+{
+    ParamBuffer params;
+    Vertex vertices[4];
 };
-static const CscParams k_CscParams_Bt709Lim = {
-    // CSC Matrix
-    {
-        { 1.1644f, 0.0f, 1.7927f },
-        { 1.1644f, -0.2132f, -0.5329f },
-        { 1.1644f, 2.1124f, 0.0f },
-    },
 
-    // Offsets
-    { 16.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f },
-};
-static const CscParams k_CscParams_Bt709Full = {
-    // CSC Matrix
-    {
-        { 1.0f, 0.0f, 1.5748f },
-        { 1.0f, -0.1873f, -0.4681f },
-        { 1.0f, 1.8556f, 0.0f },
-    },
+static const size_t k_UniformSlotSize = (sizeof(FrameUniforms) + UNIFORM_SLOT_ALIGNMENT - 1) & ~(size_t)(UNIFORM_SLOT_ALIGNMENT - 1);
 
-    // Offsets
-    { 0.0f, 128.0f / 255.0f, 128.0f / 255.0f },
-};
-static const CscParams k_CscParams_Bt2020Lim = {
-    // CSC Matrix
-    {
-        { 1.1644f, 0.0f, 1.6781f },
-        { 1.1644f, -0.1874f, -0.6505f },
-        { 1.1644f, 2.1418f, 0.0f },
-    },
+FrameUniforms m_FrameUniforms;
+bool m_HasVertices = false;
 
-    // Offsets
-    { 16.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f },
-};
-static const CscParams k_CscParams_Bt2020Full = {
-    // CSC Matrix
-    {
-        { 1.0f, 0.0f, 1.4746f },
-        { 1.0f, -0.1646f, -0.5714f },
-        { 1.0f, 1.8814f, 0.0f },
-    },
+// Runs display link on its own thread, so its timing doesn't depend on
+// main loop and waiting for it never blocks the UI
+@interface MetalDisplayLinkTarget : NSObject
+- (void)tick:(CADisplayLink*)link;
+@end
 
-    // Offsets
-    { 0.0f, 128.0f / 255.0f, 128.0f / 255.0f },
-};
+static void setDisplayLinkRate(CADisplayLink* link, int fps) {
+    // Ask for display refresh that matches stream rate,
+    // ProMotion and 120 Hz displays otherwise run at their own rate
+    if (@available(iOS 15.0, tvOS 15.0, *)) {
+        link.preferredFrameRateRange = CAFrameRateRangeMake(fps, fps, fps);
+    } else {
+        link.preferredFramesPerSecond = fps;
+    }
+}
 
-struct Vertex
-{
-    vector_float4 position;
-    vector_float2 texCoord;
-};
+#if defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
+// Negotiated stream rate from display mode manager, 0 while none is set
+extern int preferredDisplayFrameRate();
+#endif
+
+int m_DisplayLinkFps = 0;
+
+@implementation MetalDisplayLinkTarget
+- (void)tick:(CADisplayLink*)link {
+    m_DisplayFrameDuration = link.targetTimestamp - link.timestamp;
+
+#if defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
+    // Stream switches rate with display mode, link follows
+    int fps = preferredDisplayFrameRate();
+    if (fps > 0 && fps != m_DisplayLinkFps) {
+        m_DisplayLinkFps = fps;
+        setDisplayLinkRate(link, fps);
+    }
+#endif
+}
+@end
+
+static void startDisplayLink(int fps) {
+    m_DisplayLinkRunning = true;
+    m_DisplayLinkFps = fps;
+    [NSThread detachNewThreadWithBlock:^{
+        CADisplayLink* link = [CADisplayLink displayLinkWithTarget:[MetalDisplayLinkTarget new] selector:@selector(tick:)];
+        setDisplayLinkRate(link, fps);
+
+        [link addToRunLoop:[NSRunLoop currentRunLoop] forMode:NSDefaultRunLoopMode];
+        m_DisplayLink = link;
+
+        while (m_DisplayLinkRunning) {
+            [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+        }
+
+        [link invalidate];
+        m_DisplayLink = nil;
+    }];
+}
 
 int getFramePlaneCount(AVFrame* frame)
 {
@@ -137,6 +167,19 @@ void MetalVideoRenderer::discardNextDrawable()
     m_NextDrawable = nullptr;
 }}
 
+// 10-bit drawable only helps when screen can show brighter than SDR white
+static bool displaySupportsEDR() {
+#if defined(PLATFORM_IOS)
+    if (@available(iOS 16.0, *)) {
+        return UIScreen.mainScreen.potentialEDRHeadroom > 1.0;
+    }
+    return false;
+#else
+    // Apple TV switches display into HDR mode itself
+    return true;
+#endif
+}
+
 int getBitnessScaleFactor(AVFrame* frame) {
     // VideoToolbox frames never require scaling
     return 1;
@@ -145,9 +188,10 @@ int getBitnessScaleFactor(AVFrame* frame) {
 bool MetalVideoRenderer::updateColorSpaceForFrame(AVFrame* frame) {
     int colorspace = getFrameColorspace(frame);
     bool fullRange = isFrameFullRange(frame);
-    if (colorspace != m_LastColorSpace || fullRange != m_LastFullRange) {
+    bool tenBit = color_ten_bit(frame);
+    if (colorspace != m_LastColorSpace || fullRange != m_LastFullRange || tenBit != m_LastTenBit) {
         CGColorSpaceRef newColorSpace;
-        ParamBuffer paramBuffer;
+        ParamBuffer paramBuffer = {};
 
         // Free any unpresented drawable since we're changing pixel formats
         discardNextDrawable();
@@ -156,42 +200,46 @@ bool MetalVideoRenderer::updateColorSpaceForFrame(AVFrame* frame) {
         case COLORSPACE_REC_709:
             m_MetalLayer.colorspace = newColorSpace = CGColorSpaceCreateWithName(kCGColorSpaceITUR_709);
             m_MetalLayer.pixelFormat = MTLPixelFormatBGRA8Unorm;
-            paramBuffer.cscParams = (fullRange ? k_CscParams_Bt709Full : k_CscParams_Bt709Lim);
+            paramBuffer.cscParams = csc_params(COLOR_STANDARD_BT709, fullRange, tenBit);
             break;
         case COLORSPACE_REC_2020:
             // https://developer.apple.com/documentation/metal/hdr_content/using_color_spaces_to_display_hdr_content
-            if (frame->color_trc == AVCOL_TRC_SMPTE2084) {
+            if ((frame->color_trc == AVCOL_TRC_SMPTE2084 || frame->color_trc == AVCOL_TRC_ARIB_STD_B67) && !displaySupportsEDR()) {
+                // SDR screen, tone map in shader into 8-bit BT.709 drawable
+                m_MetalLayer.colorspace = newColorSpace = CGColorSpaceCreateWithName(kCGColorSpaceITUR_709);
+                m_MetalLayer.pixelFormat = MTLPixelFormatBGRA8Unorm;
+                paramBuffer.toneMap = frame->color_trc == AVCOL_TRC_SMPTE2084 ? 1 : 2;
+            }
+            else if (frame->color_trc == AVCOL_TRC_SMPTE2084) {
                 m_MetalLayer.colorspace = newColorSpace = CGColorSpaceCreateWithName(kCGColorSpaceITUR_2100_PQ);
                 m_MetalLayer.pixelFormat = MTLPixelFormatBGR10A2Unorm;
             }
+            else if (frame->color_trc == AVCOL_TRC_ARIB_STD_B67) {
+                m_MetalLayer.colorspace = newColorSpace = CGColorSpaceCreateWithName(kCGColorSpaceITUR_2100_HLG);
+                m_MetalLayer.pixelFormat = MTLPixelFormatBGR10A2Unorm;
+            }
             else {
                 m_MetalLayer.colorspace = newColorSpace = CGColorSpaceCreateWithName(kCGColorSpaceITUR_2020);
                 m_MetalLayer.pixelFormat = MTLPixelFormatBGRA8Unorm;
             }
-            paramBuffer.cscParams = (fullRange ? k_CscParams_Bt2020Full : k_CscParams_Bt2020Lim);
+            paramBuffer.cscParams = csc_params(COLOR_STANDARD_BT2020, fullRange, tenBit);
             break;
         default:
         case COLORSPACE_REC_601:
             m_MetalLayer.colorspace = newColorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
             m_MetalLayer.pixelFormat = MTLPixelFormatBGRA8Unorm;
-            paramBuffer.cscParams = (fullRange ? k_CscParams_Bt601Full : k_CscParams_Bt601Lim);
+            paramBuffer.cscParams = csc_params(COLOR_STANDARD_BT601, fullRange, tenBit);
             break;
         }
 
         paramBuffer.bitnessScaleFactor = getBitnessScaleFactor(frame);
+        paramBuffer.scaling = Settings::instance().video_scaling();
 
         // The CAMetalLayer retains the CGColorSpace
         CGColorSpaceRelease(newColorSpace);
 
-        // Create the new colorspace parameter buffer for our fragment shader
-//        [m_CscParamsBuffer release];
-        auto bufferOptions = MTLCPUCacheModeWriteCombined | MTLResourceStorageModeShared; //MTLResourceStorageModeManaged;
-        m_CscParamsBuffer = [m_MetalLayer.device newBufferWithBytes:(void*)&paramBuffer length:sizeof(paramBuffer) options:bufferOptions];
-        if (!m_CscParamsBuffer) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "Failed to create CSC parameters buffer");
-            return false;
-        }
+        // Copied into uniform ring slot with every frame
+        m_FrameUniforms.params = paramBuffer;
 
         int planes = getFramePlaneCount(frame);
         SDL_assert(planes == 2 || planes == 3);
@@ -221,7 +269,7 @@ bool MetalVideoRenderer::updateColorSpaceForFrame(AVFrame* frame) {
         pipelineDesc.colorAttachments[0].destinationAlphaBlendFactor = MTLBlendFactorOneMinusSourceAlpha;
 //        [m_OverlayPipelineState release];
         m_OverlayPipelineState = [m_MetalLayer.device newRenderPipelineStateWithDescriptor:pipelineDesc error:nullptr];
-        if (!m_VideoPipelineState) {
+        if (!m_OverlayPipelineState) {
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "Failed to create overlay pipeline state");
             return false;
@@ -229,6 +277,7 @@ bool MetalVideoRenderer::updateColorSpaceForFrame(AVFrame* frame) {
 
         m_LastColorSpace = colorspace;
         m_LastFullRange = fullRange;
+        m_LastTenBit = tenBit;
     }
 
     return true;
@@ -239,7 +288,7 @@ bool MetalVideoRenderer::updateVideoRegionSizeForFrame(AVFrame* frame) {
     SDL_Metal_GetDrawableSize(m_Window, &drawableWidth, &drawableHeight);
 
     // Check if anything has changed since the last vertex buffer upload
-    if (m_VideoVertexBuffer &&
+    if (m_HasVertices &&
             frame->width == m_LastFrameWidth && frame->height == m_LastFrameHeight &&
             drawableWidth == m_LastDrawableWidth && drawableHeight == m_LastDrawableHeight) {
         // Nothing to do
@@ -268,14 +317,8 @@ bool MetalVideoRenderer::updateVideoRegionSizeForFrame(AVFrame* frame) {
         { { renderRect.x+renderRect.w, renderRect.y+renderRect.h, 0.0f, 1.0f }, { 1.0f, 0} },
     };
 
-//    [m_VideoVertexBuffer release];
-    auto bufferOptions = MTLCPUCacheModeWriteCombined | MTLResourceStorageModeShared; //MTLResourceStorageModeManaged;
-    m_VideoVertexBuffer = [m_MetalLayer.device newBufferWithBytes:verts length:sizeof(verts) options:bufferOptions];
-    if (!m_VideoVertexBuffer) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                     "Failed to create video vertex buffer");
-        return false;
-    }
+    memcpy(m_FrameUniforms.vertices, verts, sizeof(verts));
+    m_HasVertices = true;
 
     m_LastFrameWidth = frame->width;
     m_LastFrameHeight = frame->height;
@@ -285,12 +328,28 @@ bool MetalVideoRenderer::updateVideoRegionSizeForFrame(AVFrame* frame) {
     return true;
 }
 
-MetalVideoRenderer::MetalVideoRenderer() {}
+MetalVideoRenderer::MetalVideoRenderer() {
+    // Counters are global, handlers of previous session are done by now
+    m_GpuTimeNs = 0;
+    m_GpuTimedFrames = 0;
+}
 
 MetalVideoRenderer::~MetalVideoRenderer()
 {@autoreleasepool {
+    // Display link thread stops on its next run loop pass
+    m_DisplayLinkRunning = false;
+
+    // Let GPU finish with ring slots and cached textures
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT && m_InFlightSemaphore; i++) {
+        dispatch_semaphore_wait(m_InFlightSemaphore, dispatch_time(DISPATCH_TIME_NOW, 100 * NSEC_PER_MSEC));
+    }
+    m_InFlightSemaphore = nil;
+    m_UniformRing = nil;
+    m_HasVertices = false;
+
     if (m_TextureCache != nullptr) {
         CFRelease(m_TextureCache);
+        m_TextureCache = nullptr;
     }
 
     [m_MetalView removeFromSuperview];
@@ -323,10 +382,26 @@ void MetalVideoRenderer::waitToRender()
     }
 }}
 
-void MetalVideoRenderer::draw(NVGcontext* vg, int width, int height, AVFrame* frame, int imageFormat) {
-    initialize(imageFormat);
+void MetalVideoRenderer::draw(NVGcontext* vg, int width, int height, AVFrame* frame, int imageFormat, uint64_t generation) {
+    if (!initialize(imageFormat))
+        return;
+
+    // Video has its own layer under the UI, which keeps showing the last
+    // presented frame, so a repeated one needs neither drawable nor present
+    if (generation == m_DrawnGeneration) {
+        int drawableWidth, drawableHeight;
+        SDL_Metal_GetDrawableSize(m_Window, &drawableWidth, &drawableHeight);
+        if (drawableWidth == m_LastDrawableWidth && drawableHeight == m_LastDrawableHeight)
+            return;
+    }
+
     waitToRender();
 
+    uint64_t before_render = HighResClock::now_us();
+    if (!m_video_render_stats.rendered_frames) {
+        m_video_render_stats.measurement_start_timestamp_us = before_render;
+    }
+
     if (frame->format != AV_PIX_FMT_VIDEOTOOLBOX) { return; }
 
     // Handle changes to the frame's colorspace from last time we rendered
@@ -352,6 +427,10 @@ void MetalVideoRenderer::draw(NVGcontext* vg, int width, int height, AVFrame* fr
         return;
     }
 
+    // Drop textures of frames GPU is done with, once per frame so cache
+    // doesn't grow with every imported buffer
+    CVMetalTextureCacheFlush(m_TextureCache, 0);
+
     std::array<CVMetalTextureRef, MAX_VIDEO_PLANES> cvMetalTextures;
     size_t planes = getFramePlaneCount(frame);
 //    SDL_assert(planes <= MAX_VIDEO_PLANES);
@@ -393,10 +472,21 @@ void MetalVideoRenderer::draw(NVGcontext* vg, int width, int height, AVFrame* fr
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "CVMetalTextureCacheCreateTextureFromImage() failed: %d",
                          err);
+            for (size_t j = 0; j < i; j++) {
+                CFRelease(cvMetalTextures[j]);
+            }
             return;
         }
     }
 
+    // Wait until GPU released oldest ring slot, this also bounds
+    // how many frames CPU encodes ahead
+    dispatch_semaphore_wait(m_InFlightSemaphore, DISPATCH_TIME_FOREVER);
+
+    size_t uniformOffset = m_UniformSlot * k_UniformSlotSize;
+    m_UniformSlot = (m_UniformSlot + 1) % MAX_FRAMES_IN_FLIGHT;
+    memcpy((uint8_t*)m_UniformRing.contents + uniformOffset, &m_FrameUniforms, sizeof(m_FrameUniforms));
+
     // Prepare a render pass to render into the next drawable
     auto renderPassDescriptor = [MTLRenderPassDescriptor renderPassDescriptor];
     renderPassDescriptor.colorAttachments[0].texture = m_NextDrawable.texture;
@@ -411,15 +501,24 @@ void MetalVideoRenderer::draw(NVGcontext* vg, int width, int height, AVFrame* fr
     for (size_t i = 0; i < planes; i++) {
         [renderEncoder setFragmentTexture:CVMetalTextureGetTexture(cvMetalTextures[i]) atIndex:i];
     }
-    [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer>) {
+    dispatch_semaphore_t inFlightSemaphore = m_InFlightSemaphore;
+    [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> buffer) {
         // Free textures after completion of rendering per CVMetalTextureCache requirements
         for (size_t i = 0; i < planes; i++) {
             CFRelease(cvMetalTextures[i]);
         }
+        if (@available(iOS 10.3, tvOS 10.3, *)) {
+            double gpuTime = buffer.GPUEndTime - buffer.GPUStartTime;
+            if (gpuTime > 0) {
+                m_GpuTimeNs += (uint64_t)(gpuTime * 1000000000.0);
+                m_GpuTimedFrames++;
+            }
+        }
+        dispatch_semaphore_signal(inFlightSemaphore);
     }];
 
-    [renderEncoder setFragmentBuffer:m_CscParamsBuffer offset:0 atIndex:0];
-    [renderEncoder setVertexBuffer:m_VideoVertexBuffer offset:0 atIndex:0];
+    [renderEncoder setFragmentBuffer:m_UniformRing offset:uniformOffset + offsetof(FrameUniforms, params) atIndex:0];
+    [renderEncoder setVertexBuffer:m_UniformRing offset:uniformOffset + offsetof(FrameUniforms, vertices) atIndex:0];
     [renderEncoder drawPrimitives:MTLPrimitiveTypeTriangleStrip vertexStart:0 vertexCount:4];
 
     // Now draw any overlays that are enabled
@@ -440,15 +539,26 @@ void MetalVideoRenderer::draw(NVGcontext* vg, int width, int height, AVFrame* fr
     }];
 //    }
 
+    // Keep every frame on screen for at least one stream frame interval,
+    // so a 60 fps stream doesn't judder on 120 Hz display
+    double minimumDuration = 1.0 / Settings::instance().fps();
+    if (m_DisplayFrameDuration > minimumDuration)
+        minimumDuration = 0;
+
     // Flip to the newly rendered buffer
-    [commandBuffer presentDrawable:m_NextDrawable];
+    if (@available(iOS 10.3, tvOS 10.3, *)) {
+        [commandBuffer presentDrawable:m_NextDrawable afterMinimumDuration:minimumDuration];
+    } else {
+        [commandBuffer presentDrawable:m_NextDrawable];
+    }
     [commandBuffer commit];
 
-    // Wait for the command buffer to complete and free our CVMetalTextureCache references
-    [commandBuffer waitUntilCompleted];
-
 //    [m_NextDrawable release];
     m_NextDrawable = nullptr;
+    m_DrawnGeneration = generation;
+
+    m_video_render_stats.total_render_time_us += HighResClock::now_us() - before_render;
+    m_video_render_stats.rendered_frames++;
 }
 
 id<MTLDevice> getMetalDevice() {
@@ -474,10 +584,11 @@ id<MTLDevice> getMetalDevice() {
 
 bool MetalVideoRenderer::initialize(int imageFormat)
 { @autoreleasepool {
-    if (initialized) return;
+    if (initialized) return initializeResult;
     initialized = true;
+    initializeResult = false;
 
-    int err;
+    int err = 0;
 
     auto videoContext = (brls::SDLVideoContext*) brls::Application::getPlatform()->getVideoContext();
     m_Window = videoContext->getSDLWindow();
@@ -576,16 +687,36 @@ bool MetalVideoRenderer::initialize(int imageFormat)
 
     // Create a command queue for submission
     m_CommandQueue = [m_MetalLayer.device newCommandQueue];
+
+    m_UniformRing = [m_MetalLayer.device newBufferWithLength:k_UniformSlotSize * MAX_FRAMES_IN_FLIGHT
+                                                     options:MTLResourceCPUCacheModeWriteCombined | MTLResourceStorageModeShared];
+    if (!m_UniformRing) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to create uniform ring buffer");
+        return false;
+    }
+    m_UniformSlot = 0;
+    m_InFlightSemaphore = dispatch_semaphore_create(MAX_FRAMES_IN_FLIGHT);
+
+    startDisplayLink(Settings::instance().fps());
+
+    initializeResult = true;
     return true;
 }}
 
 VideoRenderStats* MetalVideoRenderer::video_render_stats() {
     m_video_render_stats.rendered_fps = (float)m_video_render_stats.rendered_frames /
-            ((float) (LiGetMillis() - m_video_render_stats.measurement_start_timestamp) / 1000);
+            ((float) (HighResClock::now_us() - m_video_render_stats.measurement_start_timestamp_us) / 1000000);
 
-    m_video_render_stats.rendering_time = (float)m_video_render_stats.total_render_time /
+    m_video_render_stats.rendering_time = (float)m_video_render_stats.total_render_time_us / 1000.0f /
             (float) m_video_render_stats.rendered_frames;
 
+    m_video_render_stats.total_gpu_time_ns = m_GpuTimeNs;
+    m_video_render_stats.gpu_timed_frames = m_GpuTimedFrames;
+    if (m_video_render_stats.gpu_timed_frames)
+        m_video_render_stats.gpu_rendering_time = (float)m_video_render_stats.total_gpu_time_ns / 1000000.0f /
+                (float) m_video_render_stats.gpu_timed_frames;
+
     return (VideoRenderStats*)&m_video_render_stats;
 }
 
@@ -0,0 +1,93 @@
+//
+//  NativeFrameWrapper.cpp
+//  Moonlight
+//
+
+#include "NativeFrameWrapper.hpp"
+#include "AVFrameHolder.hpp"
+#include "Settings.hpp"
+#include <borealis.hpp>
+
+struct NativeBuffer {
+    void (*release)(void* opaque, void* handle);
+    void* opaque;
+    void* handle;
+};
+
+static void release_native_buffer(void* opaque, uint8_t* data) {
+    auto buffer = (NativeBuffer*)opaque;
+    if (buffer->release)
+        buffer->release(buffer->opaque, buffer->handle);
+    delete buffer;
+}
+
+bool NativeFrameWrapper::init(AVFrameHolder* holder, int stream_fps) {
+    cleanup();
+    m_holder = holder;
+
+    // One frame on screen besides the queued ones
+    m_frames_size = Settings::instance().stream().frames_queue_size + 1;
+    m_frames = new AVFrame*[m_frames_size]();
+    for (int i = 0; i < m_frames_size; i++) {
+        m_frames[i] = av_frame_alloc();
+        if (m_frames[i] == nullptr) {
+            brls::Logger::error("NativeFrameWrapper: Couldn't allocate frame");
+            cleanup();
+            return false;
+        }
+    }
+
+    m_holder->prepare(m_frames_size - 1, stream_fps);
+    m_next_frame = 0;
+    return true;
+}
+
+void NativeFrameWrapper::cleanup() {
+    if (!m_frames)
+        return;
+
+    // Renderer must not hold any of these frames anymore
+    m_holder->cleanup();
+    for (int i = 0; i < m_frames_size; i++)
+        av_frame_free(&m_frames[i]);
+    delete[] m_frames;
+    m_frames = nullptr;
+    m_frames_size = 0;
+}
+
+AVFrame* NativeFrameWrapper::wrap(const NativeFrame& frame) {
+    AVBufferRef* ref = nullptr;
+    if (frame.release) {
+        auto buffer = new NativeBuffer{frame.release, frame.opaque, frame.handle};
+        ref = av_buffer_create((uint8_t*)frame.handle, 0, release_native_buffer, buffer, 0);
+        if (!ref) {
+            release_native_buffer(buffer, nullptr);
+            return nullptr;
+        }
+    }
+
+    if (!m_frames) {
+        av_buffer_unref(&ref);
+        return nullptr;
+    }
+
+    // Drops the handle this descriptor carried before
+    AVFrame* result = m_frames[m_next_frame];
+    m_next_frame = (m_next_frame + 1) % m_frames_size;
+    av_frame_unref(result);
+
+    result->buf[0] = ref;
+    result->data[3] = (uint8_t*)frame.handle;
+    for (int i = 0; i < 2; i++) {
+        result->data[i] = frame.planes[i];
+        result->linesize[i] = frame.pitches[i];
+    }
+    result->format = frame.format;
+    result->width = frame.width;
+    result->height = frame.height;
+    result->pts = frame.pts;
+    result->colorspace = frame.colorspace;
+    result->color_range = frame.color_range;
+    result->color_trc = frame.color_trc;
+    return result;
+}
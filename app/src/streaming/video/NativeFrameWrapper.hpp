@@ -0,0 +1,65 @@
+//
+//  NativeFrameWrapper.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+class AVFrameHolder;
+
+// Output buffer of a native decoder and how to give it back
+struct NativeFrame {
+    // Hardware format renderer reads from data[3], like
+    // AV_PIX_FMT_VIDEOTOOLBOX with CVPixelBufferRef for Metal one
+    AVPixelFormat format;
+    void* handle;
+    // Software formats point planes at decoder output memory instead
+    uint8_t* planes[2] = {nullptr, nullptr};
+    int pitches[2] = {0, 0};
+    int width;
+    int height;
+    // Frame number, FrameTracer and LatencyProbe key on it
+    int64_t pts;
+    AVColorSpace colorspace = AVCOL_SPC_UNSPECIFIED;
+    AVColorRange color_range = AVCOL_RANGE_UNSPECIFIED;
+    AVColorTransferCharacteristic color_trc = AVCOL_TRC_UNSPECIFIED;
+
+    // Called once no queued or displayed frame refers to handle anymore,
+    // decoders with fixed surfaces leave it empty and use next_slot()
+    void (*release)(void* opaque, void* handle) = nullptr;
+    void* opaque = nullptr;
+};
+
+// Ring of frame descriptors for native decoder backends. Handle ends up
+// in data[3], where renderers already look for hardware buffers, and is
+// released when its descriptor comes around again, same way FFmpeg
+// decoder recycles its frames
+class NativeFrameWrapper {
+  public:
+    ~NativeFrameWrapper() { cleanup(); }
+
+    // Sizes ring for frames queue and prepares holder for it
+    bool init(AVFrameHolder* holder, int stream_fps);
+    void cleanup();
+
+    // Returned frame goes to holder, nullptr on error,
+    // in which case handle is released already
+    AVFrame* wrap(const NativeFrame& frame);
+
+    // Ring slot next wrap() fills, nothing refers to its previous frame
+    // anymore, so decoder could write output into surface of this slot
+    [[nodiscard]] int next_slot() const { return m_next_frame; }
+    [[nodiscard]] int size() const { return m_frames_size; }
+
+  private:
+    AVFrameHolder* m_holder = nullptr;
+    AVFrame** m_frames = nullptr;
+    int m_frames_size = 0;
+    int m_next_frame = 0;
+};
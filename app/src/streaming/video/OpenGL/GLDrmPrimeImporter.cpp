@@ -0,0 +1,162 @@
+#ifdef USE_GL_RENDERER
+#ifdef USE_DRM_PRIME_IMPORT
+
+#include "GLDrmPrimeImporter.hpp"
+#include "borealis.hpp"
+#include <cstring>
+
+// Avoid libdrm dependency only for few format codes
+#define DRM_IMPORT_FOURCC(a, b, c, d) \
+    ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define DRM_IMPORT_FORMAT_R8 DRM_IMPORT_FOURCC('R', '8', ' ', ' ')
+#define DRM_IMPORT_FORMAT_GR88 DRM_IMPORT_FOURCC('G', 'R', '8', '8')
+#define DRM_IMPORT_FORMAT_R16 DRM_IMPORT_FOURCC('R', '1', '6', ' ')
+#define DRM_IMPORT_FORMAT_GR1616 DRM_IMPORT_FOURCC('G', 'R', '3', '2')
+#define DRM_IMPORT_FORMAT_MOD_INVALID 0x00ffffffffffffffULL
+
+static bool has_extension(const char* extensions, const char* name) {
+    if (!extensions) return false;
+    size_t length = strlen(name);
+    for (const char* it = strstr(extensions, name); it; it = strstr(it + length, name)) {
+        if ((it == extensions || it[-1] == ' ') && (it[length] == ' ' || it[length] == '\0'))
+            return true;
+    }
+    return false;
+}
+
+GLDrmPrimeImporter::GLDrmPrimeImporter() = default;
+
+GLDrmPrimeImporter::~GLDrmPrimeImporter() {
+    releaseImages();
+    av_frame_free(&m_drm_frame);
+}
+
+bool GLDrmPrimeImporter::isSupported() {
+    if (m_checked)
+        return m_supported;
+    m_checked = true;
+
+    // GLFW may create GLX context, in that case there is nothing to import into
+    m_display = eglGetCurrentDisplay();
+    if (m_display == EGL_NO_DISPLAY) {
+        brls::Logger::warning("GL: DRM-PRIME import unavailable, no EGL display");
+        return false;
+    }
+
+    const char* extensions = eglQueryString(m_display, EGL_EXTENSIONS);
+    if (!has_extension(extensions, "EGL_EXT_image_dma_buf_import")) {
+        brls::Logger::warning("GL: DRM-PRIME import unavailable, no EGL_EXT_image_dma_buf_import");
+        return false;
+    }
+    m_use_modifiers = has_extension(extensions, "EGL_EXT_image_dma_buf_import_modifiers");
+
+    m_eglCreateImageKHR = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
+    m_eglDestroyImageKHR = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
+    m_glEGLImageTargetTexture2DOES = (void (*)(GLenum, void*))eglGetProcAddress("glEGLImageTargetTexture2DOES");
+
+    m_supported = m_eglCreateImageKHR && m_eglDestroyImageKHR && m_glEGLImageTargetTexture2DOES;
+    m_drm_frame = m_supported ? av_frame_alloc() : nullptr;
+    m_supported = m_supported && m_drm_frame;
+
+    brls::Logger::info("GL: DRM-PRIME import: {}, modifiers: {}", m_supported, m_use_modifiers);
+    return m_supported;
+}
+
+int GLDrmPrimeImporter::softwareFormat(const AVFrame* frame) {
+    if (frame->format != AV_PIX_FMT_VAAPI || !frame->hw_frames_ctx)
+        return frame->format;
+
+    auto* ctx = (AVHWFramesContext*)frame->hw_frames_ctx->data;
+    return ctx->sw_format;
+}
+
+void GLDrmPrimeImporter::releaseImages() {
+    for (auto& image : m_images) {
+        if (image != EGL_NO_IMAGE_KHR) {
+            m_eglDestroyImageKHR(m_display, image);
+            image = EGL_NO_IMAGE_KHR;
+        }
+    }
+
+    if (m_drm_frame)
+        av_frame_unref(m_drm_frame);
+}
+
+bool GLDrmPrimeImporter::import(AVFrame* frame, const GLuint* textures, const int (*textureSizes)[2], int planes) {
+    if (!isSupported())
+        return false;
+
+    releaseImages();
+
+    m_drm_frame->format = AV_PIX_FMT_DRM_PRIME;
+    int err = av_hwframe_map(m_drm_frame, frame, AV_HWFRAME_MAP_READ);
+    if (err < 0) {
+        char error[AV_ERROR_MAX_STRING_SIZE] = { 0 };
+        brls::Logger::error("GL: Failed to map frame to DRM-PRIME - {}", av_make_error_string(error, AV_ERROR_MAX_STRING_SIZE, err));
+        return false;
+    }
+
+    auto* desc = (AVDRMFrameDescriptor*)m_drm_frame->data[0];
+    bool high_depth = softwareFormat(frame) == AV_PIX_FMT_P010;
+
+    // Planes could be split between layers or be in a single layer
+    int plane = 0;
+    for (int l = 0; l < desc->nb_layers && plane < planes; l++) {
+        const AVDRMLayerDescriptor& layer = desc->layers[l];
+        for (int p = 0; p < layer.nb_planes && plane < planes; p++, plane++) {
+            const AVDRMPlaneDescriptor& drm_plane = layer.planes[p];
+            const AVDRMObjectDescriptor& object = desc->objects[drm_plane.object_index];
+
+            uint32_t fourcc = plane == 0 ? (high_depth ? DRM_IMPORT_FORMAT_R16 : DRM_IMPORT_FORMAT_R8)
+                                         : (high_depth ? DRM_IMPORT_FORMAT_GR1616 : DRM_IMPORT_FORMAT_GR88);
+
+            EGLint attributes[32];
+            int i = 0;
+            attributes[i++] = EGL_WIDTH;
+            attributes[i++] = textureSizes[plane][0];
+            attributes[i++] = EGL_HEIGHT;
+            attributes[i++] = textureSizes[plane][1];
+            attributes[i++] = EGL_LINUX_DRM_FOURCC_EXT;
+            attributes[i++] = (EGLint)fourcc;
+            attributes[i++] = EGL_DMA_BUF_PLANE0_FD_EXT;
+            attributes[i++] = object.fd;
+            attributes[i++] = EGL_DMA_BUF_PLANE0_OFFSET_EXT;
+            attributes[i++] = (EGLint)drm_plane.offset;
+            attributes[i++] = EGL_DMA_BUF_PLANE0_PITCH_EXT;
+            attributes[i++] = (EGLint)drm_plane.pitch;
+#ifdef EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT
+            if (m_use_modifiers && object.format_modifier != DRM_IMPORT_FORMAT_MOD_INVALID) {
+                attributes[i++] = EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT;
+                attributes[i++] = (EGLint)(object.format_modifier & 0xffffffff);
+                attributes[i++] = EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT;
+                attributes[i++] = (EGLint)(object.format_modifier >> 32);
+            }
+#endif
+            attributes[i++] = EGL_NONE;
+
+            m_images[plane] = m_eglCreateImageKHR(m_display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, nullptr, attributes);
+            if (m_images[plane] == EGL_NO_IMAGE_KHR) {
+                brls::Logger::error("GL: Failed to create EGL image for plane {}, error {}", plane, eglGetError());
+                releaseImages();
+                return false;
+            }
+
+            glActiveTexture(GL_TEXTURE0 + plane);
+            glBindTexture(GL_TEXTURE_2D, textures[plane]);
+            m_glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, m_images[plane]);
+        }
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    if (plane < planes) {
+        brls::Logger::error("GL: DRM-PRIME frame has only {} planes out of {}", plane, planes);
+        releaseImages();
+        return false;
+    }
+
+    return true;
+}
+
+#endif // USE_DRM_PRIME_IMPORT
+#endif // USE_GL_RENDERER
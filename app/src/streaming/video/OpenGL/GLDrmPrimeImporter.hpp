@@ -0,0 +1,51 @@
+#ifdef USE_GL_RENDERER
+#ifdef USE_DRM_PRIME_IMPORT
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/hwcontext_drm.h>
+}
+
+#pragma once
+
+#define DRM_IMPORT_PLANES_MAX 3
+
+// Maps VAAPI hardware frames to DRM-PRIME and binds their planes to GL
+// textures through EGL DMA-BUF import, so frame never leaves GPU memory
+class GLDrmPrimeImporter {
+  public:
+    GLDrmPrimeImporter();
+    ~GLDrmPrimeImporter();
+
+    // Should be called from thread with current GL context
+    bool isSupported();
+
+    // textureSizes holds width and height of every plane texture
+    bool import(AVFrame* frame, const GLuint* textures, const int (*textureSizes)[2], int planes);
+
+    // Returns software format hardware frame will be sampled as
+    static int softwareFormat(const AVFrame* frame);
+
+  private:
+    void releaseImages();
+
+    bool m_checked = false;
+    bool m_supported = false;
+    bool m_use_modifiers = false;
+    EGLDisplay m_display = EGL_NO_DISPLAY;
+    PFNEGLCREATEIMAGEKHRPROC m_eglCreateImageKHR = nullptr;
+    PFNEGLDESTROYIMAGEKHRPROC m_eglDestroyImageKHR = nullptr;
+    void (*m_glEGLImageTargetTexture2DOES)(GLenum, void*) = nullptr;
+
+    // Kept until next frame is imported, GPU could still sample them
+    AVFrame* m_drm_frame = nullptr;
+    EGLImageKHR m_images[DRM_IMPORT_PLANES_MAX] = {EGL_NO_IMAGE_KHR, EGL_NO_IMAGE_KHR, EGL_NO_IMAGE_KHR};
+};
+
+#endif // USE_DRM_PRIME_IMPORT
+#endif // USE_GL_RENDERER
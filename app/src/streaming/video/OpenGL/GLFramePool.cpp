@@ -0,0 +1,178 @@
+#include "GLFramePool.hpp"
+
+#ifdef USE_GL_FRAME_POOL
+
+#include <algorithm>
+#include <borealis.hpp>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Pitch is aligned for decoder SIMD and GL unpack, so planes are aligned too
+static size_t frame_layout(AVPixelFormat format, int width, int height, uint8_t* base,
+                           uint8_t* data[4], int linesize[4]) {
+    if (av_image_fill_linesizes(linesize, format, width) < 0)
+        return 0;
+    for (int i = 0; i < 4; i++)
+        linesize[i] = (int)align_up(linesize[i], GL_FRAME_POOL_ALIGNMENT);
+
+    int size = av_image_fill_pointers(data, format, height, base, linesize);
+    return size < 0 ? 0 : align_up(size, GL_FRAME_POOL_ALIGNMENT);
+}
+
+bool GLFramePool::init(int width, int height, size_t budget) {
+#ifdef GL_MAP_PERSISTENT_BIT
+    if (glBufferStorage == nullptr)
+        return false;
+
+    // Decoders pad frames to their block size, 10 bit covers HDR streams
+    uint8_t* data[4];
+    int linesize[4];
+    size_t slot_size = frame_layout(AV_PIX_FMT_YUV420P10, align_up(width, 64), align_up(height, 64) + 16,
+                                    nullptr, data, linesize);
+    if (slot_size == 0)
+        return false;
+
+    // Session could start again with the same size
+    if (m_buffer && slot_size <= m_slot_size)
+        return true;
+    release();
+
+    int slots = (int)std::min<size_t>(GL_FRAME_POOL_SLOTS_MAX, budget / slot_size);
+    if (slots < 2)
+        return false;
+
+    // Decoder reads reference frames back, so storage should stay in
+    // cached client memory instead of write combined one
+    GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slot_size * slots, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+    m_mapping = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slot_size * slots, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (!m_mapping) {
+        brls::Logger::warning("GL: Couldn't map frame pool");
+        release();
+        return false;
+    }
+
+    m_slot_size = slot_size;
+    m_slots.resize(slots);
+    for (int i = 0; i < slots; i++)
+        m_slots[i].data = m_mapping + slot_size * i;
+
+    brls::Logger::info("GL: Frame pool of {} slots, {} KB each", slots, slot_size >> 10);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void GLFramePool::release() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& slot : m_slots) {
+        if (slot.referenced)
+            brls::Logger::error("GL: Frame pool released with frames in use");
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+    }
+    m_slots.clear();
+
+    if (m_buffer) {
+        if (m_mapping) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &m_buffer);
+    }
+    m_buffer = 0;
+    m_mapping = nullptr;
+    m_slot_size = 0;
+}
+
+int GLFramePool::get_buffer(AVCodecContext* context, AVFrame* frame) {
+    int width = frame->width;
+    int height = frame->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(context, &width, &height, linesize_align);
+
+    uint8_t* data[4];
+    int linesize[4];
+    size_t size = frame_layout((AVPixelFormat)frame->format, width, height, nullptr, data, linesize);
+    if (size == 0 || size > m_slot_size)
+        return AVERROR(EINVAL);
+
+    Slot* free_slot = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& slot : m_slots) {
+            if (!slot.referenced && !slot.fence) {
+                slot.referenced = true;
+                free_slot = &slot;
+                break;
+            }
+        }
+    }
+    if (!free_slot)
+        return AVERROR(ENOMEM);
+
+    frame->buf[0] = av_buffer_create(free_slot->data, m_slot_size, release_slot, this, 0);
+    if (!frame->buf[0]) {
+        release_slot(this, free_slot->data);
+        return AVERROR(ENOMEM);
+    }
+
+    frame_layout((AVPixelFormat)frame->format, width, height, free_slot->data, frame->data, frame->linesize);
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+bool GLFramePool::owns(const AVFrame* frame) const {
+    return m_buffer && frame->buf[0] && av_buffer_get_opaque(frame->buf[0]) == this;
+}
+
+GLFramePool::Slot* GLFramePool::slot_for(const uint8_t* data) {
+    size_t index = (data - m_mapping) / m_slot_size;
+    return index < m_slots.size() ? &m_slots[index] : nullptr;
+}
+
+void GLFramePool::mark_used(const AVFrame* frame) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Slot* slot = slot_for(frame->buf[0]->data);
+    if (!slot)
+        return;
+
+    if (slot->fence)
+        glDeleteSync(slot->fence);
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void GLFramePool::collect() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& slot : m_slots) {
+        if (!slot.fence)
+            continue;
+
+        GLenum state = glClientWaitSync(slot.fence, 0, 0);
+        if (state == GL_ALREADY_SIGNALED || state == GL_CONDITION_SATISFIED) {
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+    }
+}
+
+void GLFramePool::release_slot(void* opaque, uint8_t* data) {
+    auto pool = (GLFramePool*)opaque;
+    std::lock_guard<std::mutex> lock(pool->m_mutex);
+    if (Slot* slot = pool->slot_for(data))
+        slot->referenced = false;
+}
+
+#endif // USE_GL_FRAME_POOL
@@ -0,0 +1,60 @@
+#ifdef USE_GL_RENDERER
+
+// Needs buffer storage, which GLES2 targets don't have
+#if !defined(__PSV__) && !defined(__LIBRETRO__)
+#define USE_GL_FRAME_POOL
+
+#include <glad/glad.h>
+#include "IVideoRenderer.hpp"
+#include <mutex>
+#include <vector>
+
+#pragma once
+
+#define GL_FRAME_POOL_SLOTS_MAX 16
+#define GL_FRAME_POOL_ALIGNMENT 256
+
+// Persistently mapped pixel buffer split into frame sized slots. Software
+// decoders write into slots, renderer uploads textures from them on GPU
+// side, without copy through PBO. Slot is given out again once decoder
+// dropped all references to it and GPU finished reading it
+class GLFramePool : public IVideoFrameAllocator {
+  public:
+    ~GLFramePool() { release(); }
+
+    // GL thread, false when persistent mapping isn't supported
+    bool init(int width, int height, size_t budget);
+    // GL thread, frames from pool must be freed before
+    void release();
+
+    int get_buffer(AVCodecContext* context, AVFrame* frame) override;
+
+    // GL thread, frame data lives in buffer() at offset()
+    [[nodiscard]] bool owns(const AVFrame* frame) const;
+    [[nodiscard]] GLuint buffer() const { return m_buffer; }
+    [[nodiscard]] size_t offset(const uint8_t* data) const { return data - m_mapping; }
+
+    // GL thread, after commands reading frame were issued
+    void mark_used(const AVFrame* frame);
+    // GL thread, frees slots GPU is done with, called once per draw
+    void collect();
+
+  private:
+    struct Slot {
+        uint8_t* data;
+        bool referenced = false;
+        GLsync fence = nullptr;
+    };
+
+    static void release_slot(void* opaque, uint8_t* data);
+    Slot* slot_for(const uint8_t* data);
+
+    std::mutex m_mutex;
+    std::vector<Slot> m_slots;
+    GLuint m_buffer = 0;
+    uint8_t* m_mapping = nullptr;
+    size_t m_slot_size = 0;
+};
+
+#endif
+#endif // USE_GL_RENDERER
@@ -0,0 +1,192 @@
+//
+//  GLProgramCache.cpp
+//  Moonlight
+//
+
+#ifdef USE_GL_RENDERER
+
+#include "GLProgramCache.hpp"
+#include "HighResClock.hpp"
+#include "Settings.hpp"
+#include <cstdio>
+#include <vector>
+
+// Binary file starts with format and size of program binary
+struct ProgramBinaryHeader {
+    uint32_t format;
+    uint32_t length;
+};
+
+static uint64_t fnv1a(uint64_t hash, const char* string) {
+    for (; string && *string; string++) {
+        hash ^= (uint8_t)*string;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static bool check_status(GLuint handle, bool program) {
+    GLint success = 0;
+    if (program)
+        glGetProgramiv(handle, GL_LINK_STATUS, &success);
+    else
+        glGetShaderiv(handle, GL_COMPILE_STATUS, &success);
+
+    if (!success) {
+        GLint length = 0;
+        if (program)
+            glGetProgramiv(handle, GL_INFO_LOG_LENGTH, &length);
+        else
+            glGetShaderiv(handle, GL_INFO_LOG_LENGTH, &length);
+
+        std::vector<char> buffer(length + 1, 0);
+        if (program)
+            glGetProgramInfoLog(handle, length, &length, buffer.data());
+        else
+            glGetShaderInfoLog(handle, length, &length, buffer.data());
+
+        brls::Logger::error("GL: {} error: {}", program ? "Link program" : "Compile shader", buffer.data());
+    }
+    return success;
+}
+
+GLuint GLProgramCache::program(const std::string& key, const char* vertex, const char* fragment) {
+    auto it = m_programs.find(key);
+    if (it != m_programs.end())
+        return it->second;
+
+    uint64_t start = HighResClock::now_us();
+    GLuint program = 0;
+
+#ifdef USE_GL_PROGRAM_BINARY
+    std::string path = binaryPath(key, vertex, fragment);
+    program = loadBinary(path);
+    bool loaded = program != 0;
+#endif
+
+    if (!program)
+        program = compile(vertex, fragment);
+
+    if (!program)
+        return 0;
+
+#ifdef USE_GL_PROGRAM_BINARY
+    if (!loaded)
+        saveBinary(path, program);
+    brls::Logger::info("GL: Program {} {} in {} us", key, loaded ? "loaded from binary" : "compiled", HighResClock::now_us() - start);
+#else
+    brls::Logger::info("GL: Program {} compiled in {} us", key, HighResClock::now_us() - start);
+#endif
+
+    m_programs[key] = program;
+    return program;
+}
+
+GLuint GLProgramCache::compile(const char* vertex, const char* fragment) {
+    GLuint program = glCreateProgram();
+    GLuint vert = glCreateShader(GL_VERTEX_SHADER);
+    GLuint frag = glCreateShader(GL_FRAGMENT_SHADER);
+
+    glShaderSource(vert, 1, &vertex, nullptr);
+    glCompileShader(vert);
+    check_status(vert, false);
+
+    glShaderSource(frag, 1, &fragment, nullptr);
+    glCompileShader(frag);
+    check_status(frag, false);
+
+    glAttachShader(program, vert);
+    glAttachShader(program, frag);
+
+#ifdef USE_GL_PROGRAM_BINARY
+    if (glProgramParameteri)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+
+    glLinkProgram(program);
+
+    glDeleteShader(vert);
+    glDeleteShader(frag);
+
+    if (!check_status(program, true)) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+std::string GLProgramCache::binaryPath(const std::string& key, const char* vertex, const char* fragment) {
+    // Driver update makes old binaries unusable, so it is part of the name too
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = fnv1a(hash, vertex);
+    hash = fnv1a(hash, fragment);
+    hash = fnv1a(hash, (const char*)glGetString(GL_RENDERER));
+    hash = fnv1a(hash, (const char*)glGetString(GL_VERSION));
+
+    char name[32];
+    snprintf(name, sizeof(name), "-%016llx.bin", (unsigned long long)hash);
+    return Settings::instance().shader_cache_dir() + "/" + key + name;
+}
+
+#ifdef USE_GL_PROGRAM_BINARY
+GLuint GLProgramCache::loadBinary(const std::string& path) {
+    if (!glProgramBinary)
+        return 0;
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return 0;
+
+    ProgramBinaryHeader header;
+    std::vector<uint8_t> binary;
+    if (fread(&header, sizeof(header), 1, file) == 1) {
+        binary.resize(header.length);
+        if (fread(binary.data(), 1, header.length, file) != header.length)
+            binary.clear();
+    }
+    fclose(file);
+
+    if (binary.empty())
+        return 0;
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        // Driver rejected it, compile from source and overwrite
+        brls::Logger::warning("GL: Program binary {} rejected", path);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void GLProgramCache::saveBinary(const std::string& path, GLuint program) {
+    if (!glGetProgramBinary)
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<uint8_t> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    if (length <= 0)
+        return;
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+        return;
+
+    ProgramBinaryHeader header = {(uint32_t)format, (uint32_t)length};
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(binary.data(), 1, length, file);
+    fclose(file);
+}
+#endif
+
+#endif // USE_GL_RENDERER
@@ -0,0 +1,44 @@
+#ifdef USE_GL_RENDERER
+
+#if defined(__LIBRETRO__)
+#include "glsym.h"
+#elif defined(__PSV__)
+#define GL_GLEXT_PROTOTYPES
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#else
+#include <glad/glad.h>
+#endif
+
+#include "Singleton.hpp"
+#include <map>
+#include <string>
+
+#pragma once
+
+// Program binaries are not available on GLES2 targets
+#if !defined(__PSV__) && !defined(__LIBRETRO__)
+#define USE_GL_PROGRAM_BINARY
+#endif
+
+// Keeps linked shader programs for the whole app lifetime, GL context never
+// changes, and stores their binaries in working dir, so next session start
+// doesn't need to compile anything
+class GLProgramCache : public Singleton<GLProgramCache> {
+  public:
+    // Should be called from thread with current GL context, returns 0 on failure
+    GLuint program(const std::string& key, const char* vertex, const char* fragment);
+
+  private:
+    GLuint compile(const char* vertex, const char* fragment);
+    std::string binaryPath(const std::string& key, const char* vertex, const char* fragment);
+
+#ifdef USE_GL_PROGRAM_BINARY
+    GLuint loadBinary(const std::string& path);
+    void saveBinary(const std::string& path, GLuint program);
+#endif
+
+    std::map<std::string, GLuint> m_programs;
+};
+
+#endif // USE_GL_RENDERER
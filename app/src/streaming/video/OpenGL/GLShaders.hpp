@@ -1,3 +1,196 @@
+// HDR frames are tone mapped to SDR in the same pass as YUV->RGB conversion,
+// transfer is 0 for SDR, 1 for PQ and 2 for HLG
+#define GL_TONE_MAPPING_FUNCTIONS R"glsl(
+uniform int transfer;
+
+highp vec3 pq_to_nits(highp vec3 e) {
+    highp vec3 np = pow(e, vec3(1.0 / 78.84375));
+    highp vec3 l = max(np - 0.8359375, 0.0) / (18.8515625 - 18.6875 * np);
+    return pow(l, vec3(1.0 / 0.1593017578125)) * 10000.0;
+}
+
+highp vec3 hlg_to_nits(highp vec3 e) {
+    highp vec3 low = e * e / 3.0;
+    highp vec3 high = (exp((e - 0.55991073) / 0.17883277) + 0.28466892) / 12.0;
+    highp vec3 scene = mix(low, high, step(0.5, e));
+    // Reference OOTF for 1000 nits display
+    highp float y = dot(scene, vec3(0.2627, 0.6780, 0.0593));
+    return scene * pow(max(y, 1e-6), 0.2) * 1000.0;
+}
+
+highp vec3 tone_map(highp vec3 rgb) {
+    if (transfer == 0)
+        return rgb;
+
+    highp vec3 nits = transfer == 1 ? pq_to_nits(rgb) : hlg_to_nits(rgb);
+
+    // Relative to SDR reference white, extended Reinhard on luminance
+    // rolls 1000 nits highlights off to SDR peak
+    highp vec3 color = nits / 203.0;
+    highp float l = dot(color, vec3(0.2627, 0.6780, 0.0593));
+    highp float white = 1000.0 / 203.0;
+    highp float mapped = l * (1.0 + l / (white * white)) / (1.0 + l);
+    color *= l > 0.0 ? mapped / l : 0.0;
+
+    // BT.2020 to BT.709 primaries
+    color = mat3(1.6605, -0.1246, -0.0182,
+                 -0.5876, 1.1329, -0.1006,
+                 -0.0728, -0.0083, 1.1187) * color;
+    return pow(clamp(color, 0.0, 1.0), vec3(1.0 / 2.2));
+}
+)glsl"
+
+// Luma is upscaled in the same pass as YUV->RGB conversion, chroma is
+// half resolution anyway and stays bilinear. scaling is 0 for bilinear,
+// 1 for Catmull-Rom bicubic, 2 for Lanczos2 and 3 for FSR1 style
+// edge adaptive Lanczos with contrast adaptive sharpening on top
+#define GL_SCALING_FUNCTIONS R"glsl(
+uniform int scaling;
+uniform highp vec2 texel_size;
+
+highp float sample_bicubic(sampler2D tex, highp vec2 uv) {
+    // 9 bilinear taps instead of 16 point ones
+    highp vec2 pos = uv / texel_size;
+    highp vec2 tc = floor(pos - 0.5) + 0.5;
+    highp vec2 f = pos - tc;
+    highp vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    highp vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    highp vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    highp vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    highp vec2 w12 = w1 + w2;
+    highp vec2 tc0 = (tc - 1.0) * texel_size;
+    highp vec2 tc12 = (tc + w2 / w12) * texel_size;
+    highp vec2 tc3 = (tc + 2.0) * texel_size;
+
+    return (texture(tex, vec2(tc0.x, tc0.y)).r * w0.x +
+            texture(tex, vec2(tc12.x, tc0.y)).r * w12.x +
+            texture(tex, vec2(tc3.x, tc0.y)).r * w3.x) * w0.y +
+           (texture(tex, vec2(tc0.x, tc12.y)).r * w0.x +
+            texture(tex, vec2(tc12.x, tc12.y)).r * w12.x +
+            texture(tex, vec2(tc3.x, tc12.y)).r * w3.x) * w12.y +
+           (texture(tex, vec2(tc0.x, tc3.y)).r * w0.x +
+            texture(tex, vec2(tc12.x, tc3.y)).r * w12.x +
+            texture(tex, vec2(tc3.x, tc3.y)).r * w3.x) * w3.y;
+}
+
+highp float lanczos2(highp float x) {
+    x = abs(x) * 3.14159265;
+    if (x < 1e-4)
+        return 1.0;
+    return x < 6.2831853 ? 2.0 * sin(x) * sin(x * 0.5) / (x * x) : 0.0;
+}
+
+highp float sample_lanczos(sampler2D tex, highp vec2 uv) {
+    highp vec2 pos = uv / texel_size - 0.5;
+    highp vec2 base = floor(pos);
+    highp vec2 f = pos - base;
+
+    highp float wx[4];
+    highp float wy[4];
+    for (int i = 0; i < 4; i++) {
+        wx[i] = lanczos2(float(i - 1) - f.x);
+        wy[i] = lanczos2(float(i - 1) - f.y);
+    }
+
+    highp float sum = 0.0;
+    highp float weights = 0.0;
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            highp float w = wx[x] * wy[y];
+            sum += texture(tex, (base + vec2(x, y) - 0.5) * texel_size).r * w;
+            weights += w;
+        }
+    }
+    return sum / weights;
+}
+
+// EASU: Lanczos2 approximation with kernel stretched along local edge
+// and narrowed across it, clamped to center texels against ringing
+highp float sample_easu(sampler2D tex, highp vec2 uv) {
+    highp vec2 pos = uv / texel_size - 0.5;
+    highp vec2 base = floor(pos);
+    highp vec2 f = pos - base;
+
+    highp float l[16];
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++)
+            l[y * 4 + x] = texture(tex, (base + vec2(x, y) - 0.5) * texel_size).r;
+    }
+
+    // Gradient of the center 2x2 quad, bilinearly weighted
+    highp vec2 dir = vec2(0.0);
+    highp float len = 0.0;
+    for (int y = 1; y < 3; y++) {
+        for (int x = 1; x < 3; x++) {
+            highp float w = (x == 1 ? 1.0 - f.x : f.x) * (y == 1 ? 1.0 - f.y : f.y);
+            highp float c = l[y * 4 + x];
+            highp float dx = l[y * 4 + x + 1] - l[y * 4 + x - 1];
+            highp float dy = l[(y + 1) * 4 + x] - l[(y - 1) * 4 + x];
+            highp float lx = abs(dx) / max(max(abs(l[y * 4 + x + 1] - c), abs(c - l[y * 4 + x - 1])), 1e-5);
+            highp float ly = abs(dy) / max(max(abs(l[(y + 1) * 4 + x] - c), abs(c - l[(y - 1) * 4 + x])), 1e-5);
+            dir += vec2(dx, dy) * w;
+            lx = clamp(lx, 0.0, 1.0);
+            ly = clamp(ly, 0.0, 1.0);
+            len += (lx * lx + ly * ly) * 0.5 * w;
+        }
+    }
+
+    highp float dir_len = dot(dir, dir);
+    dir = dir_len < 1.0 / 32768.0 ? vec2(1.0, 0.0) : dir * inversesqrt(dir_len);
+    len *= len;
+    highp float stretch = dot(dir, dir) / max(abs(dir.x), abs(dir.y));
+    highp vec2 len2 = vec2(1.0 + (stretch - 1.0) * len, 1.0 - 0.5 * len);
+    highp float lob = 0.5 - 0.29 * len;
+    highp float clp = 1.0 / lob;
+
+    highp float sum = 0.0;
+    highp float weights = 0.0;
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            highp vec2 v = vec2(x, y) - 1.0 - f;
+            v = vec2(dot(v, dir), dot(v, vec2(-dir.y, dir.x))) * len2;
+            highp float d2 = min(dot(v, v), clp);
+            highp float wb = 0.4 * d2 - 1.0;
+            highp float wa = lob * d2 - 1.0;
+            highp float w = (1.5625 * wb * wb - 0.5625) * wa * wa;
+            sum += l[y * 4 + x] * w;
+            weights += w;
+        }
+    }
+
+    highp float mn = min(min(l[5], l[6]), min(l[9], l[10]));
+    highp float mx = max(max(l[5], l[6]), max(l[9], l[10]));
+    return clamp(sum / weights, mn, mx);
+}
+
+// RCAS: sharpening lobe limited by local contrast so it doesn't clip,
+// neighbours are taken at source texel distance as there is no second pass
+highp float sharpen_rcas(sampler2D tex, highp vec2 uv, highp float c) {
+    highp float n = texture(tex, uv - vec2(0.0, texel_size.y)).r;
+    highp float s = texture(tex, uv + vec2(0.0, texel_size.y)).r;
+    highp float w = texture(tex, uv - vec2(texel_size.x, 0.0)).r;
+    highp float e = texture(tex, uv + vec2(texel_size.x, 0.0)).r;
+
+    highp float mn = min(min(n, s), min(w, e));
+    highp float mx = max(max(n, s), max(w, e));
+    highp float hit_min = mn / (4.0 * max(mx, 1e-5));
+    highp float hit_max = (1.0 - mx) / min(4.0 * mn - 4.0, -1e-5);
+    // 0.2 stops of sharpness, lobe limit as in reference
+    highp float lobe = max(-0.1875, min(max(-hit_min, hit_max), 0.0)) * 0.87055;
+    return clamp((lobe * (n + s + w + e) + c) / (4.0 * lobe + 1.0), 0.0, 1.0);
+}
+
+highp float sample_luma(sampler2D tex, highp vec2 uv) {
+    if (scaling == 1)
+        return sample_bicubic(tex, uv);
+    if (scaling == 2)
+        return sample_lanczos(tex, uv);
+    if (scaling == 3)
+        return sharpen_rcas(tex, uv, sample_easu(tex, uv));
+    return texture(tex, uv).r;
+}
+)glsl"
+
 static const char* vertex_shader_string_core = R"glsl(
 #version 140
 in vec2 position;
@@ -17,11 +210,11 @@ uniform vec3 offset;
 uniform vec4 uv_data; 
 in mediump vec2 tex_position;
 out vec4 FragColor;
-
+)glsl" GL_TONE_MAPPING_FUNCTIONS GL_SCALING_FUNCTIONS R"glsl(
 void main() {
     vec2 uv = (tex_position - uv_data.xy) * uv_data.zw;
-    vec3 YCbCr = vec3(texture(plane0, uv).r, texture(plane1, uv).r, texture(plane1, uv).g) - offset;
-    FragColor = vec4(clamp(yuvmat * YCbCr, 0.0, 1.0), 1.0);
+    vec3 YCbCr = vec3(sample_luma(plane0, uv), texture(plane1, uv).r, texture(plane1, uv).g) - offset;
+    FragColor = vec4(tone_map(clamp(yuvmat * YCbCr, 0.0, 1.0)), 1.0);
 }
 )glsl";
 
@@ -35,11 +228,11 @@ uniform vec3 offset;
 uniform vec4 uv_data; 
 in mediump vec2 tex_position;
 out vec4 FragColor;
-
+)glsl" GL_TONE_MAPPING_FUNCTIONS GL_SCALING_FUNCTIONS R"glsl(
 void main() {
     vec2 uv = (tex_position - uv_data.xy) * uv_data.zw;
-    vec3 YCbCr = vec3(texture(plane0, uv).r, texture(plane1, uv).r, texture(plane2, uv).r) - offset;
-    FragColor = vec4(clamp(yuvmat * YCbCr, 0.0, 1.0), 1.0);
+    vec3 YCbCr = vec3(sample_luma(plane0, uv), texture(plane1, uv).r, texture(plane2, uv).r) - offset;
+    FragColor = vec4(tone_map(clamp(yuvmat * YCbCr, 0.0, 1.0)), 1.0);
 }
 )glsl";
 
@@ -61,11 +254,11 @@ uniform highp vec3 offset;
 uniform highp vec4 uv_data;
 in highp vec2 tex_position;
 out mediump vec4 fragmentColor;
-
+)glsl" GL_TONE_MAPPING_FUNCTIONS GL_SCALING_FUNCTIONS R"glsl(
 void main() {
     highp vec2 uv = (tex_position - uv_data.xy) * uv_data.zw;
-    highp vec3 YCbCr = vec3(texture(plane0, uv).r, texture(plane1, uv).r, texture(plane1, uv).g) - offset;
-    fragmentColor = vec4(clamp(yuvmat * YCbCr, 0.0, 1.0), 1.0);
+    highp vec3 YCbCr = vec3(sample_luma(plane0, uv), texture(plane1, uv).r, texture(plane1, uv).g) - offset;
+    fragmentColor = vec4(tone_map(clamp(yuvmat * YCbCr, 0.0, 1.0)), 1.0);
 }
 )glsl";
 
@@ -78,10 +271,33 @@ uniform highp vec3 offset;
 uniform highp vec4 uv_data;
 in highp vec2 tex_position;
 out mediump vec4 fragmentColor;
+)glsl" GL_TONE_MAPPING_FUNCTIONS GL_SCALING_FUNCTIONS R"glsl(
+void main() {
+    highp vec2 uv = (tex_position - uv_data.xy) * uv_data.zw;
+    highp vec3 YCbCr = vec3(sample_luma(plane0, uv), texture(plane1, uv).r, texture(plane2, uv).r) - offset;
+    fragmentColor = vec4(tone_map(clamp(yuvmat * YCbCr, 0.0, 1.0)), 1.0);
+}
+)glsl";
+
+#ifdef PLATFORM_ANDROID
+// MediaCodec surface is already converted to RGB, it only needs
+// SurfaceTexture transform which also flips it to GL origin
+static const char* fragment_external_shader_string = R"glsl(#version 300 es
+#extension GL_OES_EGL_image_external_essl3 : require
+uniform samplerExternalOES plane0;
+uniform highp mat4 transform;
+uniform highp vec4 uv_data;
+in highp vec2 tex_position;
+out mediump vec4 fragmentColor;
 
 void main() {
     highp vec2 uv = (tex_position - uv_data.xy) * uv_data.zw;
-    highp vec3 YCbCr = vec3(texture(plane0, uv).r, texture(plane1, uv).r, texture(plane2, uv).r) - offset;
-    fragmentColor = vec4(clamp(yuvmat * YCbCr, 0.0, 1.0), 1.0);
+    if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) {
+        fragmentColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+    highp vec2 st = (transform * vec4(uv.x, 1.0 - uv.y, 0.0, 1.0)).xy;
+    fragmentColor = texture(plane0, st);
 }
 )glsl";
+#endif
@@ -0,0 +1,230 @@
+#include "GLSharedUploader.hpp"
+
+#ifdef USE_GL_SHARED_UPLOAD
+
+#include "GLVideoRenderer.hpp"
+#include <borealis.hpp>
+
+#if defined(__SDL2__)
+#include <SDL2/SDL.h>
+#elif defined(__GLFW__)
+#include <GLFW/glfw3.h>
+#endif
+
+bool GLSharedUploader::init() {
+    release();
+
+#if defined(__SDL2__)
+    SDL_Window* window = SDL_GL_GetCurrentWindow();
+    SDL_GLContext context = SDL_GL_GetCurrentContext();
+    if (!window || !context)
+        return false;
+
+    // Version and profile borealis asked for still apply to new context
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+    m_window = SDL_CreateWindow("", 0, 0, 1, 1, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    if (m_window)
+        m_context = SDL_GL_CreateContext((SDL_Window*)m_window);
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+
+    // Created context was made current, UI one goes back
+    SDL_GL_MakeCurrent(window, context);
+    if (!m_context) {
+        brls::Logger::warning("GL: Shared upload context failed - {}", SDL_GetError());
+        release();
+        return false;
+    }
+#elif defined(__GLFW__)
+    GLFWwindow* window = glfwGetCurrentContext();
+    if (!window)
+        return false;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    m_window = glfwCreateWindow(1, 1, "", nullptr, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!m_window) {
+        brls::Logger::warning("GL: Shared upload context failed");
+        return false;
+    }
+    m_context = m_window;
+#endif
+
+    brls::Logger::info("GL: Decoder side upload into {} texture sets", GL_SHARED_UPLOAD_SETS);
+    return true;
+}
+
+void GLSharedUploader::release() {
+    if (!m_context)
+        return;
+
+    // Objects are shared, so they go from UI context
+    for (auto& set : m_sets) {
+        glDeleteTextures(GL_SHARED_UPLOAD_PLANES, set.textures);
+        if (set.uploaded)
+            glDeleteSync(set.uploaded);
+        if (set.sampled)
+            glDeleteSync(set.sampled);
+        set = Set();
+    }
+    m_bound = -1;
+    m_sequence = 0;
+
+#if defined(__SDL2__)
+    SDL_GL_DeleteContext((SDL_GLContext)m_context);
+    SDL_DestroyWindow((SDL_Window*)m_window);
+#elif defined(__GLFW__)
+    glfwDestroyWindow((GLFWwindow*)m_window);
+#endif
+    m_context = nullptr;
+    m_window = nullptr;
+}
+
+bool GLSharedUploader::make_current() {
+#if defined(__SDL2__)
+    return SDL_GL_MakeCurrent((SDL_Window*)m_window, (SDL_GLContext)m_context) == 0;
+#elif defined(__GLFW__)
+    glfwMakeContextCurrent((GLFWwindow*)m_window);
+    return glfwGetCurrentContext() == m_window;
+#endif
+}
+
+void GLSharedUploader::done_current() {
+#if defined(__SDL2__)
+    SDL_GL_MakeCurrent((SDL_Window*)m_window, nullptr);
+#elif defined(__GLFW__)
+    glfwMakeContextCurrent(nullptr);
+#endif
+}
+
+void GLSharedUploader::allocate(Set& set, const AVFrame* frame, int planes_num, const int (*planes)[5], int type) {
+    glDeleteTextures(GL_SHARED_UPLOAD_PLANES, set.textures);
+    for (auto& texture : set.textures)
+        texture = 0;
+
+    glGenTextures(planes_num, set.textures);
+    for (int i = 0; i < planes_num; i++) {
+        glBindTexture(GL_TEXTURE_2D, set.textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, planes[i][3], frame->width / planes[i][1], frame->height / planes[i][2],
+                     0, planes[i][4], type, nullptr);
+    }
+
+    set.width = frame->width;
+    set.height = frame->height;
+    set.format = frame->format;
+}
+
+void GLSharedUploader::upload(const AVFrame* frame) {
+    int planes_num, type;
+    const int (*planes)[5];
+    // Hardware frames are left to renderer
+    if (!GLVideoRenderer::planeLayout(frame->format, &planes_num, &planes, &type))
+        return;
+
+    // Oldest set, shown one and one being written are skipped
+    int index = -1;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int i = 0; i < GL_SHARED_UPLOAD_SETS; i++) {
+            if (i == m_bound || m_sets[i].writing)
+                continue;
+            if (index < 0 || m_sets[i].sequence < m_sets[index].sequence)
+                index = i;
+        }
+        if (index < 0)
+            return;
+
+        m_sets[index].writing = true;
+        m_sets[index].frame = nullptr;
+    }
+
+    Set& set = m_sets[index];
+    if (!make_current()) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        set.writing = false;
+        return;
+    }
+
+    // Render thread could still sample set for frame it showed before,
+    // its fence is in UI context, so nothing here to flush
+    if (set.sampled) {
+        glClientWaitSync(set.sampled, 0, GL_SHARED_UPLOAD_TIMEOUT);
+        glDeleteSync(set.sampled);
+        set.sampled = nullptr;
+    }
+
+    // Frame uploaded before was never shown
+    if (set.uploaded) {
+        glDeleteSync(set.uploaded);
+        set.uploaded = nullptr;
+    }
+
+    if (set.width != frame->width || set.height != frame->height || set.format != frame->format)
+        allocate(set, frame, planes_num, planes, type);
+
+    for (int i = 0; i < planes_num; i++) {
+        glBindTexture(GL_TEXTURE_2D, set.textures[i]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[i] / planes[i][0]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame->width / planes[i][1], frame->height / planes[i][2],
+                        planes[i][4], type, frame->data[i]);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // Other context only sees fence once commands before it are flushed
+    glFlush();
+    done_current();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    set.uploaded = fence;
+    set.frame = frame;
+    set.sequence = ++m_sequence;
+    set.writing = false;
+}
+
+bool GLSharedUploader::bind(const AVFrame* frame) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    int index = -1;
+    for (int i = 0; i < GL_SHARED_UPLOAD_SETS; i++) {
+        if (m_sets[i].writing || m_sets[i].frame != frame)
+            continue;
+        if (index < 0 || m_sets[i].sequence > m_sets[index].sequence)
+            index = i;
+    }
+    if (index < 0)
+        return false;
+
+    Set& set = m_sets[index];
+    m_bound = index;
+
+    // GPU waits for upload, render thread doesn't
+    if (set.uploaded) {
+        glWaitSync(set.uploaded, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(set.uploaded);
+        set.uploaded = nullptr;
+    }
+
+    for (int i = 0; i < GL_SHARED_UPLOAD_PLANES && set.textures[i]; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, set.textures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    return true;
+}
+
+void GLSharedUploader::mark_used() {
+    // Only render thread changes bound set, decoder never takes it
+    if (m_bound < 0)
+        return;
+
+    Set& set = m_sets[m_bound];
+    if (set.sampled)
+        glDeleteSync(set.sampled);
+    set.sampled = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+#endif
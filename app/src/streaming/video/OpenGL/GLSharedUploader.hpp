@@ -0,0 +1,75 @@
+#ifdef USE_GL_RENDERER
+
+// Second context lives in a hidden window, which only desktop window
+// systems give out, and needs fences GLES2 targets don't have
+#if !defined(__PSV__) && !defined(__LIBRETRO__) && !defined(PLATFORM_SWITCH) && \
+    !defined(PLATFORM_ANDROID) && !defined(PLATFORM_IOS) && !defined(PLATFORM_TVOS) && \
+    (defined(__SDL2__) || defined(__GLFW__))
+#define USE_GL_SHARED_UPLOAD
+
+#include <glad/glad.h>
+#include "IVideoRenderer.hpp"
+#include <mutex>
+
+#pragma once
+
+#define GL_SHARED_UPLOAD_PLANES 3
+// Sets of plane textures, one is shown, others take frames in queue
+#define GL_SHARED_UPLOAD_SETS 4
+// Maximum time decoder waits for GPU to stop sampling a set, in nanoseconds
+#define GL_SHARED_UPLOAD_TIMEOUT 100000000
+
+// Plane textures filled on decoder thread through a context shared with
+// UI one. Each frame is uploaded into one of the sets right after it's
+// decoded and fenced, render thread then waits for the fence on GPU side
+// only, binds the set and draws, so no plane upload is serialized with
+// nanovg in UI frame. Context is current on decoder thread only while
+// a frame is uploaded, so it could move between threads
+class GLSharedUploader : public IVideoFrameUploader {
+  public:
+    ~GLSharedUploader() { release(); }
+
+    // GL thread, creates context sharing objects with current one,
+    // false when window system can't
+    bool init();
+    // GL thread, decoder must not upload anymore
+    void release();
+
+    void upload(const AVFrame* frame) override;
+
+    // GL thread, binds planes of frame to texture units from 0. False when
+    // frame isn't in any set, renderer uploads it itself then. Set stays
+    // reserved for render thread until other frame is bound
+    bool bind(const AVFrame* frame);
+    // GL thread, after commands sampling bound set were issued
+    void mark_used();
+
+  private:
+    struct Set {
+        GLuint textures[GL_SHARED_UPLOAD_PLANES] = {0, 0, 0};
+        int width = 0;
+        int height = 0;
+        int format = -1;
+        // Decoder ring reuses frames, newest upload of one is what it holds
+        const AVFrame* frame = nullptr;
+        uint64_t sequence = 0;
+        // Decoder is writing into it
+        bool writing = false;
+        GLsync uploaded = nullptr;
+        GLsync sampled = nullptr;
+    };
+
+    bool make_current();
+    void done_current();
+    void allocate(Set& set, const AVFrame* frame, int planes_num, const int (*planes)[5], int type);
+
+    std::mutex m_mutex;
+    Set m_sets[GL_SHARED_UPLOAD_SETS];
+    uint64_t m_sequence = 0;
+    int m_bound = -1;
+    void* m_window = nullptr;
+    void* m_context = nullptr;
+};
+
+#endif
+#endif // USE_GL_RENDERER
@@ -0,0 +1,68 @@
+//
+//  GLSwapControl.cpp
+//  Moonlight
+//
+
+#include "GLSwapControl.hpp"
+#include "FrameArrival.hpp"
+#include <borealis.hpp>
+
+#if defined(__SDL2__)
+#include <SDL2/SDL.h>
+#elif defined(__GLFW__)
+#include <GLFW/glfw3.h>
+#endif
+
+bool GLSwapControl::m_adaptive = false;
+bool GLSwapControl::m_variable_refresh = false;
+
+void GLSwapControl::begin_stream(bool variable_refresh) {
+    if (variable_refresh) {
+#if defined(__SDL2__)
+        m_variable_refresh = SDL_GL_SetSwapInterval(0) == 0;
+#elif defined(__GLFW__)
+        glfwSwapInterval(0);
+        m_variable_refresh = true;
+#endif
+        if (m_variable_refresh) {
+            FrameArrival::set_enabled(true);
+            brls::Logger::info("GL: Variable refresh, frames are swapped as they come");
+            return;
+        }
+        brls::Logger::warning("GL: Swap interval can't be changed, variable refresh is off");
+    }
+
+#if defined(__SDL2__)
+    // Fails without EXT_swap_control_tear, interval is left as is then
+    m_adaptive = SDL_GL_SetSwapInterval(-1) == 0;
+#elif defined(__GLFW__)
+    // GLFW passes negative interval on only when driver allows it
+    m_adaptive = glfwExtensionSupported("GLX_EXT_swap_control_tear") ||
+                 glfwExtensionSupported("WGL_EXT_swap_control_tear");
+    if (m_adaptive)
+        glfwSwapInterval(-1);
+#endif
+
+    brls::Logger::info("GL: Adaptive vsync {}", m_adaptive ? "enabled" : "not supported");
+}
+
+void GLSwapControl::end_stream() {
+    if (!m_adaptive && !m_variable_refresh)
+        return;
+
+    if (m_variable_refresh)
+        FrameArrival::set_enabled(false);
+
+#if defined(__SDL2__)
+    SDL_GL_SetSwapInterval(1);
+#elif defined(__GLFW__)
+    glfwSwapInterval(1);
+#endif
+    m_adaptive = false;
+    m_variable_refresh = false;
+}
+
+void GLSwapControl::wait_frame() {
+    if (m_variable_refresh)
+        FrameArrival::wait(GL_VRR_IDLE_INTERVAL_US);
+}
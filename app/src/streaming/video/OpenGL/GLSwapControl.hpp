@@ -0,0 +1,33 @@
+//
+//  GLSwapControl.hpp
+//  Moonlight
+//
+
+#pragma once
+
+// UI loop waits this long for a frame with variable refresh, lower bound
+// of common adaptive sync ranges, panel repeats frames below it anyway
+#define GL_VRR_IDLE_INTERVAL_US 20000
+
+// Swap interval of UI window while stream is shown. Adaptive vsync
+// (interval -1) is what FIFO relaxed present mode is in GL: frame that
+// missed vblank is shown at once with a tear instead of a refresh later.
+// Window is still synced when frames come in time.
+// With variable refresh swap isn't synced at all, G-Sync / FreeSync panel
+// starts refresh when frame is swapped, and UI loop is driven by frame
+// arrival instead of vblank. Neither SDL nor GLFW tells if panel does
+// adaptive sync, so it's user's choice
+class GLSwapControl {
+  public:
+    // Must be called from thread with current GL context
+    static void begin_stream(bool variable_refresh);
+    static void end_stream();
+
+    // UI thread between loop iterations, returns at once unless stream
+    // is presented with variable refresh
+    static void wait_frame();
+
+  private:
+    static bool m_adaptive;
+    static bool m_variable_refresh;
+};
@@ -8,6 +8,19 @@
 #endif
 
 #include "GLShaders.hpp"
+#include "GLProgramCache.hpp"
+#include "Log.hpp"
+#include "Settings.hpp"
+#include <cstdlib>
+#include <cstring>
+
+#ifdef PLATFORM_ANDROID
+#include "DisplayVsync.hpp"
+#include "MediaCodecSurface.hpp"
+extern "C" {
+#include <libavcodec/mediacodec.h>
+}
+#endif
 
 // tex width | frame width | frame height | from color space | to color space
 static const int nv12Planes[][5] = {
@@ -23,81 +36,66 @@ static const int yuv420Planes[][5] = {
 };
 
 static const int p010Planes[][5] = {
-    {1, 1, 2, GL_R16, GL_RED},  // Y
-    {2, 2, 4, GL_RG16, GL_RG},  // UV
+    {2, 1, 1, GL_R16, GL_RED},  // Y
+    {4, 2, 2, GL_RG16, GL_RG},  // UV
     {0, 0, 0, 0, 0},            // NOT EXISTS
 };
 
+// Software decoded HEVC Main10, 10 bit samples in low bits
+static const int yuv420p10Planes[][5] = {
+    {2, 1, 1, GL_R16, GL_RED},  // Y
+    {2, 2, 2, GL_R16, GL_RED},  // U
+    {2, 2, 2, GL_R16, GL_RED},  // V
+};
+
 static const float vertices[] = {-1.0f, -1.0f, 1.0f, -1.0f,
                                  -1.0f, 1.0f,  1.0f, 1.0f};
 
 static const char* texture_mappings[] = {"plane0", "plane1", "plane2"};
 
-static const float* gl_color_offset(bool color_full) {
-    static const float limitedOffsets[] = {16.0f / 255.0f, 128.0f / 255.0f,
-                                           128.0f / 255.0f};
-    static const float fullOffsets[] = {0.0f, 128.0f / 255.0f, 128.0f / 255.0f};
-    return color_full ? fullOffsets : limitedOffsets;
+// GL context doesn't change during app lifetime, so query it only once
+static bool use_core_shaders() {
+    static const bool use_core = [] {
+        char* version = (char*)glGetString(GL_SHADING_LANGUAGE_VERSION);
+        return version && (version[0] == '3' || version[0] == '4');
+    }();
+    return use_core;
 }
 
-static const float* gl_color_matrix(enum AVColorSpace color_space,
-                                    bool color_full) {
-    static const float bt601Lim[] = {1.1644f, 1.1644f, 1.1644f,  0.0f, -0.3917f,
-                                     2.0172f, 1.5960f, -0.8129f, 0.0f};
-    static const float bt601Full[] = {
-        1.0f, 1.0f, 1.0f, 0.0f, -0.3441f, 1.7720f, 1.4020f, -0.7141f, 0.0f};
-    static const float bt709Lim[] = {1.1644f, 1.1644f, 1.1644f,  0.0f, -0.2132f,
-                                     2.1124f, 1.7927f, -0.5329f, 0.0f};
-    static const float bt709Full[] = {
-        1.0f, 1.0f, 1.0f, 0.0f, -0.1873f, 1.8556f, 1.5748f, -0.4681f, 0.0f};
-    static const float bt2020Lim[] = {1.1644f, 1.1644f,  1.1644f,
-                                      0.0f,    -0.1874f, 2.1418f,
-                                      1.6781f, -0.6505f, 0.0f};
-    static const float bt2020Full[] = {
-        1.0f, 1.0f, 1.0f, 0.0f, -0.1646f, 1.8814f, 1.4746f, -0.5714f, 0.0f};
-
-    switch (color_space) {
-    case AVCOL_SPC_SMPTE170M:
-    case AVCOL_SPC_BT470BG:
-        return color_full ? bt601Full : bt601Lim;
-    case AVCOL_SPC_BT709:
-        return color_full ? bt709Full : bt709Lim;
-    case AVCOL_SPC_BT2020_NCL:
-    case AVCOL_SPC_BT2020_CL:
-        return color_full ? bt2020Full : bt2020Lim;
-    default:
-        return bt601Lim;
-    }
+#ifdef USE_GL_PBO_UPLOAD
+// Maximum time to wait for GPU to release PBO, in nanoseconds
+#define PBO_FENCE_TIMEOUT 100000000
+
+// Returns GL major version, GLES version string looks like "OpenGL ES 3.2 ..."
+static int gl_major_version(bool* is_gles) {
+    const char* version = (const char*)glGetString(GL_VERSION);
+    const char* es_prefix = "OpenGL ES ";
+    *is_gles = version && strncmp(version, es_prefix, strlen(es_prefix)) == 0;
+    if (!version) return 0;
+    if (*is_gles) version += strlen(es_prefix);
+    return atoi(version);
 }
-
-static void check_shader(GLuint handle) {
-    GLint success = 0;
-    glGetShaderiv(handle, GL_COMPILE_STATUS, &success);
-
-#ifndef _WIN32
-    brls::Logger::info("GL: GL_COMPILE_STATUS: {}", success);
 #endif
 
-    if (!success) {
-        GLint length = 0;
-        glGetShaderiv(handle, GL_INFO_LOG_LENGTH, &length);
-
-        char* buffer = (char*)malloc(length);
-
-        glGetShaderInfoLog(handle, length, &length, buffer);
-
-#ifndef _WIN32
-        brls::Logger::error("GL: Compile shader error: {}", buffer);
+#ifdef USE_GL_TIMER_QUERY
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT 0x8FBB
 #endif
 
-        free(buffer);
+static bool has_gl_extension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && strcmp(extension, name) == 0)
+            return true;
     }
+    return false;
 }
-
-static bool use_core_shaders() {
-    char* version = (char*)glGetString(GL_SHADING_LANGUAGE_VERSION);
-    return version[0] == '3' || version[0] == '4';
-}
+#endif
 
 GLVideoRenderer::~GLVideoRenderer() {
 
@@ -105,10 +103,6 @@ GLVideoRenderer::~GLVideoRenderer() {
     brls::Logger::info("GL: Cleanup...");
 #endif
 
-    if (m_shader_program) {
-        glDeleteProgram(m_shader_program);
-    }
-
     if (m_vbo) {
         glDeleteBuffers(1, &m_vbo);
     }
@@ -123,73 +117,145 @@ GLVideoRenderer::~GLVideoRenderer() {
         }
     }
 
+#ifdef USE_GL_PBO_UPLOAD
+    releasePBO();
+#endif
+
+#ifdef USE_GL_SHARED_UPLOAD
+    m_shared_uploader.release();
+#endif
+
+#ifdef USE_GL_TIMER_QUERY
+    if (m_use_timer_query)
+        glDeleteQueries(GL_TIMER_QUERIES, m_timer_queries);
+#endif
+
+#ifdef USE_DRM_PRIME_IMPORT
+    av_frame_free(&m_transfer_frame);
+#endif
+
+#ifdef PLATFORM_ANDROID
+    if (m_external_texture) {
+        MediaCodecSurface::instance().detach();
+        glDeleteTextures(1, &m_external_texture);
+    }
+#endif
+
 #ifndef _WIN32
     brls::Logger::info("GL: Cleanup done!");
 #endif
 }
 
-void GLVideoRenderer::initialize(AVFrame* frame) {
-    m_shader_program = glCreateProgram();
-    GLuint vert = glCreateShader(GL_VERTEX_SHADER);
-    GLuint frag = glCreateShader(GL_FRAGMENT_SHADER);
-
-    bool use_gl_core = use_core_shaders();
+// Returns shaders frame format is drawn with, 8 and 10 bit layouts of
+// the same planes share them, sample depth is in color uniforms
+static bool program_sources(int format, bool core, std::string* key, const char** vertex, const char** fragment) {
+    *vertex = core ? vertex_shader_string_core : vertex_shader_string;
 
-    glShaderSource(vert, 1,
-                   use_gl_core ? &vertex_shader_string_core
-                               : &vertex_shader_string,
-                   nullptr);
-    glCompileShader(vert);
-    check_shader(vert);
-
-    switch (frame->format) {
+    switch (format) {
         case AV_PIX_FMT_YUV420P:
-            currentFrameTypePlanesNum = 3;
-            currentPlanes = yuv420Planes;
-            currentFormat = GL_UNSIGNED_BYTE;
-
-            glShaderSource(frag, 1,
-                   use_gl_core ? &fragment_three_planes_shader_string_core
-                               : &fragment_three_planes_shader_string, nullptr);
+        case AV_PIX_FMT_YUV420P10:
+            *key = "three_planes";
+            *fragment = core ? fragment_three_planes_shader_string_core : fragment_three_planes_shader_string;
             break;
         case AV_PIX_FMT_NV12:
-            currentFrameTypePlanesNum = 2;
-            currentPlanes = nv12Planes;
-            currentFormat = GL_UNSIGNED_BYTE;
-
-            glShaderSource(frag, 1,
-                   use_gl_core ? &fragment_two_planes_shader_string_core
-                               : &fragment_two_planes_shader_string, nullptr);
-            break;
         case AV_PIX_FMT_P010:
-            currentFrameTypePlanesNum = 2;
-            currentPlanes = p010Planes;
-            currentFormat = GL_UNSIGNED_SHORT;
-
-            glShaderSource(frag, 1,
-                   use_gl_core ? &fragment_two_planes_shader_string_core
-                               : &fragment_two_planes_shader_string, nullptr);
+            *key = "two_planes";
+            *fragment = core ? fragment_two_planes_shader_string_core : fragment_two_planes_shader_string;
             break;
+#ifdef PLATFORM_ANDROID
+        case AV_PIX_FMT_MEDIACODEC:
+            // External texture only exists on GLES
+            *key = "external";
+            *vertex = vertex_shader_string;
+            *fragment = fragment_external_shader_string;
+            return true;
+#endif
         default:
-            brls::Logger::info("GL: Unknown frame format! - {}", frame->format);
-            m_is_initialized = false;
-            return;
+            return false;
+    }
+
+    *key += core ? "_core" : "_es";
+    return true;
+}
+
+void GLVideoRenderer::warmupPrograms() {
+    bool core = use_core_shaders();
+    for (int format : {AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P}) {
+        std::string key;
+        const char *vertex, *fragment;
+        if (program_sources(format, core, &key, &vertex, &fragment))
+            GLProgramCache::instance().program(key, vertex, fragment);
+    }
+}
+
+bool GLVideoRenderer::planeLayout(int format, int* planes_num, const int (**planes)[5], int* type) {
+    switch (format) {
+        case AV_PIX_FMT_YUV420P:
+            *planes_num = 3;
+            *planes = yuv420Planes;
+            *type = GL_UNSIGNED_BYTE;
+            return true;
+        case AV_PIX_FMT_YUV420P10:
+            *planes_num = 3;
+            *planes = yuv420p10Planes;
+            *type = GL_UNSIGNED_SHORT;
+            return true;
+        case AV_PIX_FMT_NV12:
+            *planes_num = 2;
+            *planes = nv12Planes;
+            *type = GL_UNSIGNED_BYTE;
+            return true;
+        case AV_PIX_FMT_P010:
+            *planes_num = 2;
+            *planes = p010Planes;
+            *type = GL_UNSIGNED_SHORT;
+            return true;
+        default:
+            return false;
     }
+}
 
-    glCompileShader(frag);
-    check_shader(frag);
+void GLVideoRenderer::initialize(AVFrame* frame) {
+    m_use_core_shaders = use_core_shaders();
 
-    glAttachShader(m_shader_program, vert);
-    glAttachShader(m_shader_program, frag);
+    int format = frame->format;
+#ifdef USE_DRM_PRIME_IMPORT
+    // Hardware frame is sampled the same way as its software format
+    format = GLDrmPrimeImporter::softwareFormat(frame);
+#endif
+
+#ifdef PLATFORM_ANDROID
+    if (format == AV_PIX_FMT_MEDIACODEC) {
+        // Single external texture, not managed as planes
+        currentFrameTypePlanesNum = 0;
+        currentPlanes = nv12Planes;
+        currentFormat = GL_UNSIGNED_BYTE;
+    } else
+#endif
+    if (!planeLayout(format, &currentFrameTypePlanesNum, &currentPlanes, &currentFormat)) {
+        CLOG_ERROR_LIMITED(LOG_RENDER, "GL: Unknown frame format! - {}", frame->format);
+        m_is_initialized = false;
+        return;
+    }
 
-    glLinkProgram(m_shader_program);
+    std::string key;
+    const char *vertex, *fragment;
+    program_sources(format, m_use_core_shaders, &key, &vertex, &fragment);
 
-    glDeleteShader(vert);
-    glDeleteShader(frag);
+    // Program is owned by cache and reused by next sessions
+    m_shader_program = GLProgramCache::instance().program(key, vertex, fragment);
+    if (!m_shader_program) {
+        m_is_initialized = false;
+        return;
+    }
 
     glGenBuffers(1, &m_vbo);
     glGenVertexArrays(1, &m_vao);
 
+#ifdef USE_GL_TIMER_QUERY
+    initializeTimerQueries();
+#endif
+
     for (int i = 0; i < currentFrameTypePlanesNum; i++) {
         m_texture_uniform[i] =
             glGetUniformLocation(m_shader_program, texture_mappings[i]);
@@ -198,6 +264,310 @@ void GLVideoRenderer::initialize(AVFrame* frame) {
     m_yuvmat_location = glGetUniformLocation(m_shader_program, "yuvmat");
     m_offset_location = glGetUniformLocation(m_shader_program, "offset");
     m_uv_data_location = glGetUniformLocation(m_shader_program, "uv_data");
+    m_transfer_location = glGetUniformLocation(m_shader_program, "transfer");
+    m_scaling_location = glGetUniformLocation(m_shader_program, "scaling");
+    m_texel_size_location = glGetUniformLocation(m_shader_program, "texel_size");
+    m_position_location = glGetAttribLocation(m_shader_program, "position");
+
+#ifdef PLATFORM_ANDROID
+    if (format == AV_PIX_FMT_MEDIACODEC) {
+        m_transform_location = glGetUniformLocation(m_shader_program, "transform");
+        m_texture_uniform[0] = glGetUniformLocation(m_shader_program, texture_mappings[0]);
+        glGenTextures(1, &m_external_texture);
+        glBindTexture(GL_TEXTURE_EXTERNAL_OES, m_external_texture);
+        glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+    }
+#endif
+
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(m_position_location);
+    glVertexAttribPointer(m_position_location, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glBindVertexArray(0);
+
+#ifdef USE_GL_PBO_UPLOAD
+    bool is_gles = false;
+    int major_version = gl_major_version(&is_gles);
+    m_use_pbo = major_version >= 3;
+#ifdef GL_MAP_PERSISTENT_BIT
+    m_pbo_persistent = m_use_pbo && !is_gles && glBufferStorage != nullptr;
+#endif
+
+#ifndef _WIN32
+    brls::Logger::info("GL: PBO upload: {}, persistent mapping: {}", m_use_pbo, m_pbo_persistent);
+#endif
+#endif
+}
+
+#ifdef USE_GL_PBO_UPLOAD
+bool GLVideoRenderer::initializePBO(size_t size) {
+    glGenBuffers(PBO_RING_SIZE, m_pbo);
+
+    for (int i = 0; i < PBO_RING_SIZE; i++) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo[i]);
+#ifdef GL_MAP_PERSISTENT_BIT
+        if (m_pbo_persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+            m_pbo_mapping[i] = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+            if (!m_pbo_mapping[i]) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                releasePBO();
+                m_use_pbo = false;
+                return false;
+            }
+            continue;
+        }
+#endif
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    m_pbo_size = size;
+    m_pbo_index = 0;
+    return true;
+}
+
+void GLVideoRenderer::releasePBO() {
+    for (int i = 0; i < PBO_RING_SIZE; i++) {
+        if (m_pbo_fence[i]) {
+            glDeleteSync(m_pbo_fence[i]);
+            m_pbo_fence[i] = nullptr;
+        }
+
+        if (m_pbo_mapping[i]) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo[i]);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            m_pbo_mapping[i] = nullptr;
+        }
+
+        if (m_pbo[i]) {
+            glDeleteBuffers(1, &m_pbo[i]);
+            m_pbo[i] = 0;
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    m_pbo_size = 0;
+}
+
+bool GLVideoRenderer::uploadWithPBO(AVFrame* frame) {
+    size_t size = 0;
+    size_t offsets[PLANES_NUM_MAX];
+    for (int i = 0; i < currentFrameTypePlanesNum; i++) {
+        offsets[i] = size;
+        size += (size_t)frame->linesize[i] * textureHeight[i];
+    }
+
+    if (size > m_pbo_size) {
+        releasePBO();
+        if (!initializePBO(size))
+            return false;
+    }
+
+    int index = m_pbo_index;
+    m_pbo_index = (m_pbo_index + 1) % PBO_RING_SIZE;
+
+    // Wait until GPU finished reading previous upload from this buffer
+    if (m_pbo_fence[index]) {
+        glClientWaitSync(m_pbo_fence[index], GL_SYNC_FLUSH_COMMANDS_BIT, PBO_FENCE_TIMEOUT);
+        glDeleteSync(m_pbo_fence[index]);
+        m_pbo_fence[index] = nullptr;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo[index]);
+
+    uint8_t* mapping = m_pbo_mapping[index];
+    if (!m_pbo_persistent) {
+        mapping = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+                                             GL_MAP_UNSYNCHRONIZED_BIT);
+    }
+
+    if (!mapping) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+
+    for (int i = 0; i < currentFrameTypePlanesNum; i++) {
+        memcpy(mapping + offsets[i], frame->data[i], (size_t)frame->linesize[i] * textureHeight[i]);
+    }
+
+    if (!m_pbo_persistent) {
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    for (int i = 0; i < currentFrameTypePlanesNum; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        int real_width = frame->linesize[i] / currentPlanes[i][0];
+        glBindTexture(GL_TEXTURE_2D, m_texture_id[i]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, real_width);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, textureWidth[i],
+                        textureHeight[i], currentPlanes[i][4], currentFormat,
+                        (const void*)offsets[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    m_pbo_fence[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return true;
+}
+#endif
+
+#ifdef USE_GL_FRAME_POOL
+void GLVideoRenderer::uploadFromPool(AVFrame* frame) {
+    // Decoder wrote frame into pixel buffer, so upload is GPU side only
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_frame_pool.buffer());
+    for (int i = 0; i < currentFrameTypePlanesNum; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        int real_width = frame->linesize[i] / currentPlanes[i][0];
+        glBindTexture(GL_TEXTURE_2D, m_texture_id[i]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, real_width);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, textureWidth[i],
+                        textureHeight[i], currentPlanes[i][4], currentFormat,
+                        (const void*)m_frame_pool.offset(frame->data[i]));
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    m_frame_pool.mark_used(frame);
+}
+#endif
+
+IVideoFrameAllocator* GLVideoRenderer::frame_allocator(int width, int height) {
+#ifdef USE_GL_FRAME_POOL
+    bool is_gles = false;
+    if (gl_major_version(&is_gles) >= 4 && !is_gles &&
+        m_frame_pool.init(width, height, (size_t)Settings::instance().surface_budget() << 20))
+        return &m_frame_pool;
+#endif
+    return nullptr;
+}
+
+IVideoFrameUploader* GLVideoRenderer::frame_uploader() {
+#ifdef USE_GL_SHARED_UPLOAD
+    // Fences are core since GL 3.2 and GLES 3
+    bool is_gles = false;
+    if (Settings::instance().decoder_upload() && gl_major_version(&is_gles) >= 3 && m_shared_uploader.init()) {
+        m_use_shared_upload = true;
+        return &m_shared_uploader;
+    }
+#endif
+    return nullptr;
+}
+
+#ifdef PLATFORM_ANDROID
+bool GLVideoRenderer::uploadExternal(AVFrame* frame) {
+    // Queue buffer for vsync it's drawn on, SurfaceTexture then latches
+    // the newest one, older queued buffers are dropped by it
+    auto buffer = (AVMediaCodecBuffer*)frame->data[3];
+    uint64_t now = HighResClock::now_us();
+    uint64_t vsync = now, period = 0;
+    DisplayVsync::instance().next_vsync(now, &vsync, &period);
+    av_mediacodec_render_buffer_at_time(buffer, (int64_t)vsync * 1000);
+
+    float transform[16];
+    if (!MediaCodecSurface::instance().update(m_external_texture, transform))
+        return false;
+
+    glUniformMatrix4fv(m_transform_location, 1, GL_FALSE, transform);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, m_external_texture);
+    glUniform1i(m_texture_uniform[0], 0);
+    return true;
+}
+#endif
+
+void GLVideoRenderer::uploadTextures(AVFrame* frame) {
+#ifdef PLATFORM_ANDROID
+    if (frame->format == AV_PIX_FMT_MEDIACODEC) {
+        uploadExternal(frame);
+        return;
+    }
+#endif
+
+#ifdef USE_GL_SHARED_UPLOAD
+    // Decoder thread uploaded it already, GPU waits for that only
+    m_shared_bound = m_use_shared_upload && m_shared_uploader.bind(frame);
+    if (m_shared_bound)
+        return;
+#endif
+
+#ifdef USE_DRM_PRIME_IMPORT
+    if (frame->format == AV_PIX_FMT_VAAPI) {
+        int sizes[PLANES_NUM_MAX][2];
+        for (int i = 0; i < currentFrameTypePlanesNum; i++) {
+            sizes[i][0] = textureWidth[i];
+            sizes[i][1] = textureHeight[i];
+        }
+
+        if (m_drm_importer.import(frame, m_texture_id, sizes, currentFrameTypePlanesNum))
+            return;
+
+        // No EGL import available, copy through system memory
+        if (!m_transfer_frame)
+            m_transfer_frame = av_frame_alloc();
+
+        av_frame_unref(m_transfer_frame);
+        int err = av_hwframe_transfer_data(m_transfer_frame, frame, 0);
+        if (err < 0) {
+            char error[AV_ERROR_MAX_STRING_SIZE] = { 0 };
+            CLOG_ERROR_LIMITED(LOG_RENDER, "GL: Error transferring the data to system memory with error {}", av_make_error_string(error, AV_ERROR_MAX_STRING_SIZE, err));
+            return;
+        }
+        frame = m_transfer_frame;
+    }
+#endif
+
+#ifdef USE_GL_FRAME_POOL
+    if (m_frame_pool.owns(frame)) {
+        uploadFromPool(frame);
+        return;
+    }
+#endif
+
+#ifdef USE_GL_PBO_UPLOAD
+    if (m_use_pbo && uploadWithPBO(frame))
+        return;
+#endif
+
+    for (int i = 0; i < currentFrameTypePlanesNum; i++) {
+        uint8_t* image = frame->data[i];
+        glActiveTexture(GL_TEXTURE0 + i);
+        int real_width = frame->linesize[i] / currentPlanes[i][0];
+        glBindTexture(GL_TEXTURE_2D, m_texture_id[i]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, real_width);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, textureWidth[i],
+                        textureHeight[i], currentPlanes[i][4], currentFormat, image);
+        glActiveTexture(GL_TEXTURE0);
+    }
+}
+
+void GLVideoRenderer::bindFrameTextures(AVFrame* frame) {
+#ifdef PLATFORM_ANDROID
+    if (frame->format == AV_PIX_FMT_MEDIACODEC) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_EXTERNAL_OES, m_external_texture);
+        return;
+    }
+#endif
+
+#ifdef USE_GL_SHARED_UPLOAD
+    // Shown set is reserved, decoder doesn't write into it meanwhile
+    if (m_shared_bound && m_shared_uploader.bind(frame))
+        return;
+#endif
+
+    // nanovg binds its own textures in between UI frames
+    for (int i = 0; i < currentFrameTypePlanesNum; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, m_texture_id[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
 }
 
 void GLVideoRenderer::bindTexture(int id) {
@@ -237,9 +607,7 @@ void GLVideoRenderer::checkAndInitialize(int width, int height,
 void GLVideoRenderer::checkAndUpdateScale(int width, int height,
                                           AVFrame* frame) {
     if ((m_frame_width != frame->width) || (m_frame_height != frame->height) ||
-        (m_screen_width != width) || (m_screen_height != height) ||
-        !use_core_shaders()) // Dirty fix for GLES, need to investigate the source of issue
-    {
+        (m_screen_width != width) || (m_screen_height != height)) {
 
         m_frame_width = frame->width;
         m_frame_height = frame->height;
@@ -247,15 +615,6 @@ void GLVideoRenderer::checkAndUpdateScale(int width, int height,
         m_screen_width = width;
         m_screen_height = height;
 
-        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices,
-                     GL_STATIC_DRAW);
-
-        int positionLocation =
-            glGetAttribLocation(m_shader_program, "position");
-        glEnableVertexAttribArray(positionLocation);
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
-
         for (int i = 0; i < currentFrameTypePlanesNum; i++) {
             if (m_texture_id[i]) {
                 glDeleteTextures(1, &m_texture_id[i]);
@@ -263,16 +622,15 @@ void GLVideoRenderer::checkAndUpdateScale(int width, int height,
         }
 
         glGenTextures(currentFrameTypePlanesNum, m_texture_id);
+        m_uploaded_generation = 0;
 
         for (int i = 0; i < currentFrameTypePlanesNum; i++) {
             bindTexture(i);
         }
 
-        bool colorFull = frame->color_range == AVCOL_RANGE_JPEG;
-
-        glUniform3fv(m_offset_location, 1, gl_color_offset(colorFull));
-        glUniformMatrix3fv(m_yuvmat_location, 1, GL_FALSE,
-                           gl_color_matrix(frame->colorspace, colorFull));
+        // Cached program keeps uniforms of previous session, so set it every time
+        glUniform1i(m_scaling_location, Settings::instance().video_scaling());
+        glUniform2f(m_texel_size_location, 1.0f / (float)m_frame_width, 1.0f / (float)m_frame_height);
 
         float frameAspect = ((float)m_frame_height / (float)m_frame_width);
         float screenAspect = ((float)m_screen_height / (float)m_screen_width);
@@ -289,56 +647,109 @@ void GLVideoRenderer::checkAndUpdateScale(int width, int height,
     }
 }
 
+void GLVideoRenderer::checkAndUpdateColorspace(AVFrame* frame) {
+    if (!m_color_tracker.changed(frame))
+        return;
+
+    // Borealis window is always SDR, so HDR is tone mapped in shader
+    int transfer = 0;
+    if (frame->color_trc == AVCOL_TRC_SMPTE2084)
+        transfer = 1;
+    else if (frame->color_trc == AVCOL_TRC_ARIB_STD_B67)
+        transfer = 2;
+    glUniform1i(m_transfer_location, transfer);
+
+    // Low aligned 10 bit samples are scaled up in matrix, no repacking on CPU
+    ColorConversion conversion = scaled_color_conversion(color_conversion(frame), color_sample_scale(frame));
+    glUniform3fv(m_offset_location, 1, conversion.offset);
+    glUniformMatrix3fv(m_yuvmat_location, 1, GL_FALSE, conversion.matrix);
+}
+
+void GLVideoRenderer::bindVertexState() {
+    glBindVertexArray(m_vao);
+
+    // GLES has no core profile VAO guarantees, and nanovg could change
+    // attribute state in between, so only re-point the attribute, no upload
+    if (!m_use_core_shaders) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        glEnableVertexAttribArray(m_position_location);
+        glVertexAttribPointer(m_position_location, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    }
+}
+
 void GLVideoRenderer::draw(NVGcontext* vg, int width, int height,
-                           AVFrame* frame, int imageFormat) {
+                           AVFrame* frame, int imageFormat, uint64_t generation) {
     if (!m_video_render_stats_progress.rendered_frames) {
-        m_video_render_stats_progress.measurement_start_timestamp = LiGetMillis();
+        m_video_render_stats_progress.measurement_start_timestamp_us = HighResClock::now_us();
     }
 
-    uint64_t before_render = LiGetMillis();
+    uint64_t before_render = HighResClock::now_us();
 
     checkAndInitialize(width, height, frame);
 
-    glBindVertexArray(m_vao);
+#ifdef USE_GL_TIMER_QUERY
+    beginTimerQuery();
+#endif
+
+#ifdef USE_GL_FRAME_POOL
+    m_frame_pool.collect();
+#endif
+
+    bindVertexState();
 
     glUseProgram(m_shader_program);
     checkAndUpdateScale(width, height, frame);
+    checkAndUpdateColorspace(frame);
 
     glClearColor(1, 1, 0, 1);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    for (int i = 0; i < currentFrameTypePlanesNum; i++) {
-        uint8_t* image = frame->data[i];
-        glActiveTexture(GL_TEXTURE0 + i);
-		int real_width = frame->linesize[i] / currentPlanes[i][0];
-        glBindTexture(GL_TEXTURE_2D, m_texture_id[i]);
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, real_width);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, textureWidth[i],
-                        textureHeight[i], currentPlanes[i][4], currentFormat, image);
-        glActiveTexture(GL_TEXTURE0);
+    // UI redraws faster than stream, or queue ran dry, repeated frame
+    // is already in textures, so only the quad is drawn again
+    if (generation == m_uploaded_generation) {
+        bindFrameTextures(frame);
+    } else {
+        uploadTextures(frame);
+        m_uploaded_generation = generation;
     }
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
-    auto render_time = LiGetMillis() - before_render;
+#ifdef USE_GL_SHARED_UPLOAD
+    if (m_shared_bound)
+        m_shared_uploader.mark_used();
+#endif
+
+    // Leave no VAO bound, so nanovg attribute setup doesn't end up in ours
+    glBindVertexArray(0);
+
+#ifdef USE_GL_TIMER_QUERY
+    endTimerQuery();
+#endif
+
+    auto render_time = HighResClock::now_us() - before_render;
     timeCount += render_time;
 
-    m_video_render_stats_progress.total_render_time += render_time;
+    m_video_render_stats_progress.total_render_time_us += render_time;
     m_video_render_stats_progress.rendered_frames++;
 
-    const int time_interval = 200;
+    const int time_interval = 200000;
     if (timeCount >= time_interval) {
         // brls::Logger::debug("FPS: {}", frames / 5.0f);
         m_video_render_stats_cache = m_video_render_stats_progress;
         m_video_render_stats_progress = {};
 
-        uint64_t now = LiGetMillis();
+        uint64_t now = HighResClock::now_us();
         m_video_render_stats_cache.rendered_fps = (float) m_video_render_stats_cache.rendered_frames /
-                ((float)(now - m_video_render_stats_cache.measurement_start_timestamp) / 1000);
+                ((float)(now - m_video_render_stats_cache.measurement_start_timestamp_us) / 1000000);
 
-        m_video_render_stats_cache.rendering_time = (float)m_video_render_stats_cache.total_render_time /
+        m_video_render_stats_cache.rendering_time = (float)m_video_render_stats_cache.total_render_time_us / 1000.0f /
                 (float) m_video_render_stats_cache.rendered_frames;
 
+        if (m_video_render_stats_cache.gpu_timed_frames)
+            m_video_render_stats_cache.gpu_rendering_time = (float)m_video_render_stats_cache.total_gpu_time_ns / 1000000.0f /
+                    (float) m_video_render_stats_cache.gpu_timed_frames;
+
         timeCount -= time_interval;
     }
 
@@ -346,6 +757,71 @@ void GLVideoRenderer::draw(NVGcontext* vg, int width, int height,
 //    brls::Logger::error("OpenGL error: {}\n", code);
 }
 
+#ifdef USE_GL_TIMER_QUERY
+void GLVideoRenderer::initializeTimerQueries() {
+    if (m_use_timer_query)
+        return;
+
+    // GLES 3 has query objects in core, time elapsed target only with extension
+    bool is_gles = false;
+    int major = gl_major_version(&is_gles);
+    if (is_gles)
+        m_use_timer_query = major >= 3 && has_gl_extension("GL_EXT_disjoint_timer_query");
+    else
+        m_use_timer_query = major >= 4 || (major == 3 && has_gl_extension("GL_ARB_timer_query"));
+    m_check_disjoint = is_gles;
+
+    if (m_use_timer_query)
+        glGenQueries(GL_TIMER_QUERIES, m_timer_queries);
+
+#ifndef _WIN32
+    brls::Logger::info("GL: GPU timer queries {}", m_use_timer_query ? "enabled" : "not supported");
+#endif
+}
+
+void GLVideoRenderer::beginTimerQuery() {
+    if (!m_use_timer_query)
+        return;
+
+    // Query of this slot is read back once GPU has finished it,
+    // until then frames stay untimed
+    GLuint query = m_timer_queries[m_timer_index];
+    if (m_timer_pending[m_timer_index]) {
+        GLuint available = 0;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+
+        GLint disjoint = 0;
+        if (m_check_disjoint)
+            glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+        // 32 bit of nanoseconds are enough for a single frame
+        GLuint elapsed = 0;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT, &elapsed);
+        m_timer_pending[m_timer_index] = false;
+
+        if (!disjoint) {
+            m_video_render_stats_progress.total_gpu_time_ns += elapsed;
+            m_video_render_stats_progress.gpu_timed_frames++;
+        }
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    m_timer_active = true;
+}
+
+void GLVideoRenderer::endTimerQuery() {
+    if (!m_timer_active)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    m_timer_active = false;
+    m_timer_pending[m_timer_index] = true;
+    m_timer_index = (m_timer_index + 1) % GL_TIMER_QUERIES;
+}
+#endif
+
 VideoRenderStats* GLVideoRenderer::video_render_stats() {
     return (VideoRenderStats*)&m_video_render_stats_cache;
 }
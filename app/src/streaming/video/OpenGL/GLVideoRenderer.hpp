@@ -17,27 +17,101 @@ extern "C"
 #endif
 #pragma once
 
+#ifdef USE_DRM_PRIME_IMPORT
+#include "GLDrmPrimeImporter.hpp"
+#endif
+
+#include "ColorConversion.hpp"
+#include "GLFramePool.hpp"
+#include "GLSharedUploader.hpp"
+
+#ifdef PLATFORM_ANDROID
+#ifndef GL_TEXTURE_EXTERNAL_OES
+#define GL_TEXTURE_EXTERNAL_OES 0x8D65
+#endif
+#endif
+
 #define PLANES_NUM_MAX 3
 
-class GLVideoRenderer : public IVideoRenderer {
+// Pixel buffer objects are not available on GLES2 targets
+#if !defined(__PSV__) && !defined(__LIBRETRO__)
+#define USE_GL_PBO_UPLOAD
+#define PBO_RING_SIZE 3
+// Timer queries are core since GL 3.3, GLES has them as extension.
+// Results are read a few frames late, so GPU is never waited for
+#define USE_GL_TIMER_QUERY
+#define GL_TIMER_QUERIES 4
+#endif
+
+class GLVideoRenderer final : public IVideoRenderer {
   public:
     GLVideoRenderer(){};
     ~GLVideoRenderer();
 
-    void draw(NVGcontext* vg, int width, int height, AVFrame* frame, int imageFormat) override;
+    void draw(NVGcontext* vg, int width, int height, AVFrame* frame, int imageFormat, uint64_t generation) override;
 
     VideoRenderStats* video_render_stats() override;
+    IVideoFrameAllocator* frame_allocator(int width, int height) override;
+    IVideoFrameUploader* frame_uploader() override;
+
+    // Loads or compiles programs of common frame formats ahead of
+    // first session, should be called from thread with current GL context
+    static void warmupPrograms();
+
+    // Planes software format is uploaded in, false when it isn't one
+    static bool planeLayout(int format, int* planes_num, const int (**planes)[5], int* type);
 
   private:
     void bindTexture(int id);
     void initialize(AVFrame* frame);
     void checkAndInitialize(int width, int height, AVFrame* frame);
     void checkAndUpdateScale(int width, int height, AVFrame* frame);
+    void checkAndUpdateColorspace(AVFrame* frame);
+    void bindVertexState();
+    void uploadTextures(AVFrame* frame);
+    void bindFrameTextures(AVFrame* frame);
+
+#ifdef PLATFORM_ANDROID
+    bool uploadExternal(AVFrame* frame);
+
+    // MediaCodec frames are rendered into this surface texture
+    GLuint m_external_texture = 0;
+    GLint m_transform_location = -1;
+#endif
+
+#ifdef USE_GL_PBO_UPLOAD
+    bool initializePBO(size_t size);
+    void releasePBO();
+    bool uploadWithPBO(AVFrame* frame);
+
+    bool m_use_pbo = false;
+    bool m_pbo_persistent = false;
+    GLuint m_pbo[PBO_RING_SIZE] = {0, 0, 0};
+    GLsync m_pbo_fence[PBO_RING_SIZE] = {nullptr, nullptr, nullptr};
+    uint8_t* m_pbo_mapping[PBO_RING_SIZE] = {nullptr, nullptr, nullptr};
+    size_t m_pbo_size = 0;
+    int m_pbo_index = 0;
+#endif
+
+#ifdef USE_GL_TIMER_QUERY
+    void initializeTimerQueries();
+    void beginTimerQuery();
+    void endTimerQuery();
+
+    bool m_use_timer_query = false;
+    // GLES timers are dropped when GPU reports disjoint operation
+    bool m_check_disjoint = false;
+    GLuint m_timer_queries[GL_TIMER_QUERIES] = {};
+    bool m_timer_pending[GL_TIMER_QUERIES] = {};
+    int m_timer_index = 0;
+    bool m_timer_active = false;
+#endif
 
     bool m_is_initialized = false;
+    bool m_use_core_shaders = false;
     GLuint m_texture_id[PLANES_NUM_MAX] = {0, 0, 0};
     GLint m_texture_uniform[PLANES_NUM_MAX];
-    GLuint m_shader_program;
+    GLuint m_shader_program = 0;
     GLuint m_vbo, m_vao;
     int m_frame_width = 0;
     int m_frame_height = 0;
@@ -46,6 +120,11 @@ class GLVideoRenderer : public IVideoRenderer {
     int m_yuvmat_location;
     int m_offset_location;
     int m_uv_data_location;
+    int m_transfer_location;
+    int m_scaling_location;
+    int m_texel_size_location;
+    int m_position_location;
+    ColorConversionTracker m_color_tracker;
     int textureWidth[PLANES_NUM_MAX];
     int textureHeight[PLANES_NUM_MAX];
     float borderColor[PLANES_NUM_MAX] = {0.0f, 0.5f, 0.5f};
@@ -53,6 +132,27 @@ class GLVideoRenderer : public IVideoRenderer {
     VideoRenderStats m_video_render_stats_cache = {};
     uint64_t timeCount = 0;
 
+#ifdef USE_GL_FRAME_POOL
+    void uploadFromPool(AVFrame* frame);
+
+    GLFramePool m_frame_pool;
+#endif
+
+#ifdef USE_GL_SHARED_UPLOAD
+    GLSharedUploader m_shared_uploader;
+    bool m_use_shared_upload = false;
+    // Textures of frame shown are in uploader set, not in own ones
+    bool m_shared_bound = false;
+#endif
+
+#ifdef USE_DRM_PRIME_IMPORT
+    GLDrmPrimeImporter m_drm_importer;
+    AVFrame* m_transfer_frame = nullptr;
+#endif
+
+    // Generation of frame in textures now, 0 when they are empty
+    uint64_t m_uploaded_generation = 0;
+
     int currentFrameTypePlanesNum = 0;
     const int (*currentPlanes)[5];
     int currentFormat;
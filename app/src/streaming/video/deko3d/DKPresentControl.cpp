@@ -0,0 +1,46 @@
+//
+//  DKPresentControl.cpp
+//  Moonlight
+//
+
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+
+#include "DKPresentControl.hpp"
+#include "PipelineTrace.hpp"
+#include <borealis.hpp>
+#include <borealis/platforms/switch/switch_video.hpp>
+#include <switch.h>
+
+static const char* mode_names[] = {"standard", "low latency", "immediate"};
+
+PresentMode DKPresentControl::m_mode = PRESENT_STANDARD;
+
+void DKPresentControl::begin_stream(PresentMode mode) {
+    m_mode = mode;
+
+    // Swapchain queues images on default window, interval is read from
+    // it on every present
+    u32 interval = mode == PRESENT_IMMEDIATE ? 0 : 1;
+    Result rc = nwindowSetSwapInterval(nwindowGetDefault(), interval);
+    brls::Logger::info("DK: Present mode {}, swap interval {}{}", mode_names[mode], interval,
+                       R_FAILED(rc) ? " failed" : "");
+}
+
+void DKPresentControl::end_stream() {
+    if (m_mode == PRESENT_IMMEDIATE)
+        nwindowSetSwapInterval(nwindowGetDefault(), 1);
+    m_mode = PRESENT_STANDARD;
+}
+
+void DKPresentControl::frame_start() {
+    if (m_mode == PRESENT_STANDARD)
+        return;
+
+    // Borealis records next frame while GPU still renders previous one,
+    // waiting here keeps that queue one frame deep
+    TRACE_SCOPE("Present wait");
+    auto* vctx = (brls::SwitchVideoContext*)brls::Application::getPlatform()->getVideoContext();
+    vctx->getQueue().waitIdle();
+}
+
+#endif
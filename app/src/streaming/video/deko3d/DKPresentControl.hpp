@@ -0,0 +1,26 @@
+//
+//  DKPresentControl.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Settings.hpp"
+
+// Presentation of deko3d frames while stream is shown. Swapchain and its
+// images are borealis' own, so what's left to the app is swap interval of
+// the default window and how far UI frames run ahead of GPU. Low latency
+// mode lets a single frame be in flight, so the video frame is picked
+// right before it's drawn, immediate one also presents without vblank wait
+class DKPresentControl {
+  public:
+    // UI thread
+    static void begin_stream(PresentMode mode);
+    static void end_stream();
+
+    // UI thread, before stream frame is picked for next UI frame
+    static void frame_start();
+
+  private:
+    static PresentMode m_mode;
+};
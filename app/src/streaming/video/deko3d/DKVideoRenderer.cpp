@@ -3,6 +3,8 @@
 #define FF_API_AVPICTURE
 
 #include "DKVideoRenderer.hpp"
+#include "Log.hpp"
+#include "Settings.hpp"
 #include <borealis/platforms/switch/switch_platform.hpp>
 
 #include <libavcodec/avcodec.h>
@@ -11,53 +13,10 @@
 
 #include <array>
 
-static const glm::vec3 gl_color_offset(bool color_full) {
-    static const glm::vec3 limitedOffsets = {16.0f / 255.0f, 128.0f / 255.0f,
-                                           128.0f / 255.0f};
-    static const glm::vec3 fullOffsets = {0.0f, 128.0f / 255.0f, 128.0f / 255.0f};
-    return color_full ? fullOffsets : limitedOffsets;
-}
-
-static const glm::mat3 gl_color_matrix(enum AVColorSpace color_space,
-                                    bool color_full) {
-    static const glm::mat3 bt601Lim = {1.1644f, 1.1644f, 1.1644f,  0.0f, -0.3917f,
-                                     2.0172f, 1.5960f, -0.8129f, 0.0f};
-    static const glm::mat3 bt601Full = {
-        1.0f, 1.0f, 1.0f, 0.0f, -0.3441f, 1.7720f, 1.4020f, -0.7141f, 0.0f};
-    static const glm::mat3 bt709Lim = {1.1644f, 1.1644f, 1.1644f,  0.0f, -0.2132f,
-                                     2.1124f, 1.7927f, -0.5329f, 0.0f};
-    static const glm::mat3 bt709Full = {
-        1.0f, 1.0f, 1.0f, 0.0f, -0.1873f, 1.8556f, 1.5748f, -0.4681f, 0.0f};
-    static const glm::mat3 bt2020Lim = {1.1644f, 1.1644f,  1.1644f,
-                                      0.0f,    -0.1874f, 2.1418f,
-                                      1.6781f, -0.6505f, 0.0f};
-    static const glm::mat3 bt2020Full = {
-        1.0f, 1.0f, 1.0f, 0.0f, -0.1646f, 1.8814f, 1.4746f, -0.5714f, 0.0f};
-
-    switch (color_space) {
-    case AVCOL_SPC_SMPTE170M:
-    case AVCOL_SPC_BT470BG:
-        return color_full ? bt601Full : bt601Lim;
-    case AVCOL_SPC_BT709:
-        return color_full ? bt709Full : bt709Lim;
-    case AVCOL_SPC_BT2020_NCL:
-    case AVCOL_SPC_BT2020_CL:
-        return color_full ? bt2020Full : bt2020Lim;
-    default:
-        return bt601Lim;
-    }
-}
-
 namespace
 {
     static constexpr unsigned StaticCmdSize = 0x10000;
-
-    struct Transformation
-    {
-        glm::mat3 yuvmat;
-        glm::vec3 offset;
-        glm::vec4 uv_data;
-    };
+    static constexpr unsigned TimerCmdSize = 0x1000;
 
     struct Vertex
     {
@@ -88,22 +47,27 @@ namespace
 DKVideoRenderer::DKVideoRenderer() {} 
 
 DKVideoRenderer::~DKVideoRenderer() {
+    if (m_is_prepared)
+        queue.waitIdle();
+
     // Destroy the vertex buffer (not strictly needed in this case)
     vertexBuffer.destroy();
     transformUniformBuffer.destroy();
-    dkMemBlockDestroy(mappingMemblock);
+    timerReportBuffer.destroy();
+    releaseSurfaces();
 }
 
-void DKVideoRenderer::checkAndInitialize(int width, int height, AVFrame* frame) {
-    if (m_is_initialized) return;
-
-    brls::Logger::info("{}: {} / {}", __PRETTY_FUNCTION__, width, height);
-
-    m_frame_width = frame->width;
-    m_frame_height = frame->height;
+void DKVideoRenderer::releaseSurfaces() {
+    for (int i = 0; i < m_surfaces_count; i++) {
+        dkMemBlockDestroy(m_surfaces[i].memblock);
+        m_surfaces[i].address = nullptr;
+        m_surfaces[i].inFlight = false;
+    }
+    m_surfaces_count = 0;
+}
 
-    m_screen_width = width;
-    m_screen_height = height;
+void DKVideoRenderer::prepare() {
+    if (m_is_prepared) return;
 
     vctx = (brls::SwitchVideoContext *)brls::Application::getPlatform()->getVideoContext();
     this->dev = vctx->getDeko3dDevice();
@@ -133,12 +97,45 @@ void DKVideoRenderer::checkAndInitialize(int width, int height, AVFrame* frame)
 
 // Load the transform buffer
     transformUniformBuffer = pool_code->allocate(sizeof(Transformation), DK_UNIFORM_BUF_ALIGNMENT);
+    scalingUniformBuffer = pool_code->allocate(sizeof(Scaling), DK_UNIFORM_BUF_ALIGNMENT);
+
+// Record timestamp reports of every timer
+    timerReportBuffer = pool_data->allocate(DK_GPU_TIMERS * 2 * sizeof(TimestampReport), alignof(TimestampReport));
+    timerCmdbuf = dk::CmdBufMaker{dev}.create();
+    CMemPool::Handle timermem = pool_data->allocate(TimerCmdSize);
+    timerCmdbuf.addMemory(timermem.getMemBlock(), timermem.getOffset(), timermem.getSize());
+    for (int i = 0; i < DK_GPU_TIMERS; i++) {
+        DkGpuAddr reports = timerReportBuffer.getGpuAddr() + i * 2 * sizeof(TimestampReport);
+        timerCmdbuf.reportCounter(DkCounter_Timestamp, reports);
+        m_timers[i].begin = timerCmdbuf.finishList();
+        timerCmdbuf.reportCounter(DkCounter_Timestamp, reports + sizeof(TimestampReport));
+        m_timers[i].end = timerCmdbuf.finishList();
+    }
+
+    m_is_prepared = true;
+}
+
+void DKVideoRenderer::checkAndInitialize(int width, int height, AVFrame* frame) {
+    if (m_is_initialized) return;
+
+    brls::Logger::info("{}: {} / {}", __PRETTY_FUNCTION__, width, height);
 
-    bool colorFull = frame->color_range == AVCOL_RANGE_JPEG;
+    // Usually done at stream start, while host was launching the app
+    prepare();
 
-    Transformation transformState;
-    transformState.offset = {0,0.5f,0.5f};// gl_color_offset(colorFull);
-    transformState.yuvmat = gl_color_matrix(frame->colorspace, colorFull);
+    m_frame_width = frame->width;
+    m_frame_height = frame->height;
+
+    m_screen_width = width;
+    m_screen_height = height;
+
+    scalingState.mode = Settings::instance().video_scaling();
+    scalingState.texel_size = { 1.0f / (float)m_frame_width, 1.0f / (float)m_frame_height };
+
+    // Main10 surfaces keep 10 bit samples in upper bits of 16 bit ones
+    m_ten_bit = color_ten_bit(frame);
+    m_color_tracker.changed(frame);
+    setColorConversion(frame);
 
     float frameAspect = ((float)m_frame_height / (float)m_frame_width);
     float screenAspect = ((float)m_screen_height / (float)m_screen_width);
@@ -153,66 +150,114 @@ void DKVideoRenderer::checkAndInitialize(int width, int height, AVFrame* frame)
                     0.5f - 0.5f * (1.0f / multiplier), 1.0f, multiplier };
     }
 
-
-// Allocate image indexes for planes
-    lumaTextureId = vctx->allocateImageIndex();
-    chromaTextureId = vctx->allocateImageIndex();
-
-    brls::Logger::debug("{}: Luma texture ID {}", __PRETTY_FUNCTION__, lumaTextureId);
-    brls::Logger::debug("{}: Chroma texture ID {}", __PRETTY_FUNCTION__, chromaTextureId);
-
-    AVNVTegraMap *map = av_nvtegra_frame_get_fbuf_map(frame);
-    brls::Logger::info("{}: Map size: {} | {} | {} | {}", __PRETTY_FUNCTION__, map->map.handle, map->map.has_init, map->map.cpu_addr, map->map.size);
-
     dk::ImageLayoutMaker { dev }
         .setType(DkImageType_2D)
-        .setFormat(DkImageFormat_R8_Unorm)
+        .setFormat(m_ten_bit ? DkImageFormat_R16_Unorm : DkImageFormat_R8_Unorm)
         .setDimensions(m_frame_width, m_frame_height, 1)
         .setFlags(DkImageFlags_UsageLoadStore | DkImageFlags_Usage2DEngine | DkImageFlags_UsageVideo)
         .initialize(lumaMappingLayout);
 
     dk::ImageLayoutMaker { dev }
         .setType(DkImageType_2D)
-        .setFormat(DkImageFormat_RG8_Unorm)
+        .setFormat(m_ten_bit ? DkImageFormat_RG16_Unorm : DkImageFormat_RG8_Unorm)
         .setDimensions(m_frame_width / 2, m_frame_height / 2, 1)
         .setFlags(DkImageFlags_UsageLoadStore | DkImageFlags_Usage2DEngine | DkImageFlags_UsageVideo)
         .initialize(chromaMappingLayout);
 
-    mappingMemblock = dk::MemBlockMaker { dev, av_nvtegra_map_get_size(map) }
+    m_is_initialized = true;
+}
+
+DKVideoRenderer::MappedSurface* DKVideoRenderer::getMappedSurface(AVFrame* frame) {
+    AVNVTegraMap *map = av_nvtegra_frame_get_fbuf_map(frame);
+    void* address = av_nvtegra_map_get_addr(map);
+
+    for (int i = 0; i < m_surfaces_count; i++) {
+        if (m_surfaces[i].address == address)
+            return &m_surfaces[i];
+    }
+
+    // Decoder pool is bigger than expected, start over, command buffer
+    // memory is reused so all recorded lists become invalid
+    if (m_surfaces_count == DK_MAPPED_SURFACES_MAX) {
+        CLOG_WARNING_LIMITED(LOG_RENDER, "{}: Mapped surfaces cache is full, remapping", __PRETTY_FUNCTION__);
+        queue.waitIdle();
+        releaseSurfaces();
+        cmdbuf.clear();
+    }
+
+    MappedSurface& surface = m_surfaces[m_surfaces_count++];
+    mapSurface(surface, frame);
+    return &surface;
+}
+
+void DKVideoRenderer::setColorConversion(AVFrame* frame) {
+    // Planes are mapped with the depth surfaces had on initialization
+    const ColorConversion& conversion = color_conversion(color_standard(frame->colorspace),
+                                                         frame->color_range == AVCOL_RANGE_JPEG, m_ten_bit);
+    for (int i = 0; i < 3; i++)
+        transformState.yuvmat[i] = {conversion.matrix[i * 3], conversion.matrix[i * 3 + 1], conversion.matrix[i * 3 + 2], 0.0f};
+    transformState.offset = {conversion.offset[0], conversion.offset[1], conversion.offset[2], 0.0f};
+
+    // Switch output is always SDR, so HDR is tone mapped in shader
+    transformState.transfer = 0;
+    if (frame->color_trc == AVCOL_TRC_SMPTE2084)
+        transformState.transfer = 1;
+    else if (frame->color_trc == AVCOL_TRC_ARIB_STD_B67)
+        transformState.transfer = 2;
+}
+
+void DKVideoRenderer::mapSurface(MappedSurface& surface, AVFrame* frame) {
+    AVNVTegraMap *map = av_nvtegra_frame_get_fbuf_map(frame);
+    CLOG_DEBUG(LOG_RENDER, "{}: Map size: {} | {} | {} | {}", __PRETTY_FUNCTION__, map->map.handle, map->map.has_init, map->map.cpu_addr, map->map.size);
+
+    surface.address = av_nvtegra_map_get_addr(map);
+    surface.inFlight = false;
+
+    // Texture indexes are kept when surface slot is remapped
+    if (!surface.lumaTextureId) {
+        surface.lumaTextureId = vctx->allocateImageIndex();
+        surface.chromaTextureId = vctx->allocateImageIndex();
+
+        CLOG_DEBUG(LOG_RENDER, "{}: Luma texture ID {}", __PRETTY_FUNCTION__, surface.lumaTextureId);
+        CLOG_DEBUG(LOG_RENDER, "{}: Chroma texture ID {}", __PRETTY_FUNCTION__, surface.chromaTextureId);
+    }
+
+    surface.memblock = dk::MemBlockMaker { dev, av_nvtegra_map_get_size(map) }
         .setFlags(DkMemBlockFlags_CpuUncached | DkMemBlockFlags_GpuCached | DkMemBlockFlags_Image)
-        .setStorage(av_nvtegra_map_get_addr(map))
+        .setStorage(surface.address)
         .create();
 
-    luma.initialize(lumaMappingLayout, mappingMemblock, 0);
-    chroma.initialize(chromaMappingLayout, mappingMemblock, frame->data[1] - frame->data[0]);
+    surface.luma.initialize(lumaMappingLayout, surface.memblock, 0);
+    surface.chroma.initialize(chromaMappingLayout, surface.memblock, frame->data[1] - frame->data[0]);
 
-    lumaDesc.initialize(luma);
-    chromaDesc.initialize(chroma);
+    surface.lumaDesc.initialize(surface.luma);
+    surface.chromaDesc.initialize(surface.chroma);
 
-    imageDescriptorSet->update(cmdbuf, lumaTextureId, lumaDesc);
-    imageDescriptorSet->update(cmdbuf, chromaTextureId, chromaDesc);
+    imageDescriptorSet->update(cmdbuf, surface.lumaTextureId, surface.lumaDesc);
+    imageDescriptorSet->update(cmdbuf, surface.chromaTextureId, surface.chromaDesc);
 
     queue.submitCommands(cmdbuf.finishList());
     queue.waitIdle();
 
-
-
     dk::RasterizerState rasterizerState;
     dk::ColorState colorState;
     dk::ColorWriteState colorWriteState;
 
     // Clear the color buffer
-    cmdbuf.clear();
     cmdbuf.clearColor(0, DkColorMask_RGBA, 0.0f, 0.0f, 0.0f, 0.0f);
 
     // Bind state required for drawing the triangle
     cmdbuf.bindShaders(DkStageFlag_GraphicsMask, { vertexShader, fragmentShader });
-    cmdbuf.bindTextures(DkStage_Fragment, 0, dkMakeTextureHandle(lumaTextureId, 0));
-    cmdbuf.bindTextures(DkStage_Fragment, 1, dkMakeTextureHandle(chromaTextureId, 0));
+    cmdbuf.bindTextures(DkStage_Fragment, 0, dkMakeTextureHandle(surface.lumaTextureId, 0));
+    cmdbuf.bindTextures(DkStage_Fragment, 1, dkMakeTextureHandle(surface.chromaTextureId, 0));
     cmdbuf.bindUniformBuffer(DkStage_Fragment, 0, transformUniformBuffer.getGpuAddr(), transformUniformBuffer.getSize());
     cmdbuf.pushConstants(
             transformUniformBuffer.getGpuAddr(), transformUniformBuffer.getSize(),
             0, sizeof(transformState), &transformState);
+    cmdbuf.bindUniformBuffer(DkStage_Fragment, 1, scalingUniformBuffer.getGpuAddr(), scalingUniformBuffer.getSize());
+    cmdbuf.pushConstants(
+            scalingUniformBuffer.getGpuAddr(), scalingUniformBuffer.getSize(),
+            0, sizeof(scalingState), &scalingState);
     cmdbuf.bindRasterizerState(rasterizerState);
     cmdbuf.bindColorState(colorState);
     cmdbuf.bindColorWriteState(colorWriteState);
@@ -222,50 +267,103 @@ void DKVideoRenderer::checkAndInitialize(int width, int height, AVFrame* frame)
 
     // Draw the triangle
     cmdbuf.draw(DkPrimitive_Quads, QuadVertexData.size(), 1, 0, 0);
-    cmdlist = cmdbuf.finishList();
-
-    m_is_initialized = true;
+    surface.cmdlist = cmdbuf.finishList();
 }
 
 int frames = 0;
 uint64_t timeCount = 0;
 
-void DKVideoRenderer::draw(NVGcontext* vg, int width, int height, AVFrame* frame, int imageFormat) {
+bool DKVideoRenderer::readGpuTimer(int index) {
+    GpuTimer& timer = m_timers[index];
+    if (timer.fence.wait(0) != DkResult_Success)
+        return false;
+
+    // Maxwell timestamps count nanoseconds
+    auto* reports = (TimestampReport*)timerReportBuffer.getCpuAddr() + index * 2;
+    m_video_render_stats.total_gpu_time_ns += reports[1].timestamp - reports[0].timestamp;
+    m_video_render_stats.gpu_timed_frames++;
+    timer.pending = false;
+    return true;
+}
+
+void DKVideoRenderer::draw(NVGcontext* vg, int width, int height, AVFrame* frame, int imageFormat, uint64_t generation) {
+    // VIC scaling falls back to decoder surfaces of stream size
+    if (m_is_initialized && (frame->width != m_frame_width || frame->height != m_frame_height)) {
+        queue.waitIdle();
+        releaseSurfaces();
+        cmdbuf.clear();
+        m_is_initialized = false;
+    }
+
     checkAndInitialize(width, height, frame);
 
-    uint64_t before_render = LiGetMillis();
+    uint64_t before_render = HighResClock::now_us();
 
     if (!m_video_render_stats.rendered_frames) {
-        m_video_render_stats.measurement_start_timestamp = before_render;
+        m_video_render_stats.measurement_start_timestamp_us = before_render;
     }
 
-    // Finish off this command list
-    // queue = vctx->getQueue();
-    queue.submitCommands(cmdlist);
-    queue.waitIdle();
+    // Recorded draws carry their uniforms, so they are recorded again
+    if (m_color_tracker.changed(frame)) {
+        queue.waitIdle();
+        releaseSurfaces();
+        cmdbuf.clear();
+        setColorConversion(frame);
+    }
+
+    MappedSurface* surface = getMappedSurface(frame);
+
+    // Only wait for previous draw of the same surface,
+    // other surfaces could stay in flight
+    if (surface->inFlight)
+        surface->fence.wait();
+
+    // Draw of a frame is timed when its timer is free, GPU is never waited for
+    int timerIndex = m_timer_index;
+    bool timed = !m_timers[timerIndex].pending || readGpuTimer(timerIndex);
+    if (timed)
+        queue.submitCommands(m_timers[timerIndex].begin);
+
+    queue.submitCommands(surface->cmdlist);
+
+    if (timed) {
+        queue.submitCommands(m_timers[timerIndex].end);
+        queue.signalFence(m_timers[timerIndex].fence);
+        m_timers[timerIndex].pending = true;
+        m_timer_index = (timerIndex + 1) % DK_GPU_TIMERS;
+    }
+
+    queue.signalFence(surface->fence);
+    queue.flush();
+    surface->inFlight = true;
 
     frames++;
-    timeCount += LiGetMillis() - before_render;
+    uint64_t render_time = HighResClock::now_us() - before_render;
+    timeCount += render_time;
 
-    if (timeCount >= 5000) {
-        brls::Logger::debug("FPS: {}", frames / 5.0f);
+    if (timeCount >= 5000000) {
+        CLOG_DEBUG(LOG_RENDER, "FPS: {}", frames / 5.0f);
         frames = 0;
-        timeCount -= 5000;
+        timeCount -= 5000000;
     }
 
-    m_video_render_stats.total_render_time += LiGetMillis() - before_render;
+    m_video_render_stats.total_render_time_us += render_time;
     m_video_render_stats.rendered_frames++;
 }
 
 VideoRenderStats* DKVideoRenderer::video_render_stats() {
     // brls::Logger::info("{}", __PRETTY_FUNCTION__);
     m_video_render_stats.rendered_fps = (float) m_video_render_stats.rendered_frames /
-        ((float) (LiGetMillis() - m_video_render_stats.measurement_start_timestamp) / 1000);
+        ((float) (HighResClock::now_us() - m_video_render_stats.measurement_start_timestamp_us) / 1000000);
 
 
-    m_video_render_stats.rendering_time = (float)m_video_render_stats.total_render_time /
+    m_video_render_stats.rendering_time = (float)m_video_render_stats.total_render_time_us / 1000.0f /
             (float) m_video_render_stats.rendered_frames;
 
+    if (m_video_render_stats.gpu_timed_frames)
+        m_video_render_stats.gpu_rendering_time = (float)m_video_render_stats.total_gpu_time_ns / 1000000.0f /
+                (float) m_video_render_stats.gpu_timed_frames;
+
     return &m_video_render_stats;
 }
 
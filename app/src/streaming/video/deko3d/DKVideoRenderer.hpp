@@ -1,10 +1,12 @@
 #if defined(__SWITCH__) && defined(BOREALIS_USE_DEKO3D)
 
 #pragma once
+#include "ColorConversion.hpp"
 #include "IVideoRenderer.hpp"
 #include <deko3d.hpp>
 
 #include <glm/mat4x4.hpp>
+#include <glm/mat3x3.hpp>
 
 #include <borealis.hpp>
 #include <borealis/platforms/switch/switch_video.hpp>
@@ -12,23 +14,87 @@
 #include <nanovg/framework/CExternalImage.h>
 #include <nanovg/framework/CDescriptorSet.h>
 #include <optional>
+#include <array>
 
-class DKVideoRenderer : public IVideoRenderer {
+// Decoder surfaces mapped at the same time, normally it's much less
+#define DK_MAPPED_SURFACES_MAX 16
+// Draws timed by GPU at the same time, results are read without waiting
+#define DK_GPU_TIMERS 4
+
+class DKVideoRenderer final : public IVideoRenderer {
   public:
     DKVideoRenderer();
     ~DKVideoRenderer();
 
-    void draw(NVGcontext* vg, int width, int height, AVFrame* frame, int imageFormat) override;
+    void prepare() override;
+    void draw(NVGcontext* vg, int width, int height, AVFrame* frame, int imageFormat, uint64_t generation) override;
 
     VideoRenderStats* video_render_stats() override;
 
   private:
+    // std140 layout of Transformation block in texture_fsh,
+    // every mat3 column takes a vec4
+    struct Transformation {
+        glm::vec4 yuvmat[3];
+        glm::vec4 offset;
+        glm::vec4 uv_data;
+        // 0 for SDR, 1 for PQ and 2 for HLG
+        int32_t transfer;
+        float padding[3];
+    };
+
+    // std140 layout of Scaling block in texture_fsh
+    struct Scaling {
+        int32_t mode;
+        float padding;
+        glm::vec2 texel_size;
+    };
+
+    // Image views over one decoder surface with its own recorded draw
+    struct MappedSurface {
+        void* address = nullptr;
+        dk::MemBlock memblock;
+
+        dk::Image luma;
+        dk::Image chroma;
+
+        dk::ImageDescriptor lumaDesc;
+        dk::ImageDescriptor chromaDesc;
+
+        int lumaTextureId = 0;
+        int chromaTextureId = 0;
+
+        DkCmdList cmdlist = 0;
+        dk::Fence fence;
+        bool inFlight = false;
+    };
+
+    // Two of them are reported around every timed draw
+    struct TimestampReport {
+        uint64_t value;
+        uint64_t timestamp;
+    };
+
+    struct GpuTimer {
+        DkCmdList begin = 0;
+        DkCmdList end = 0;
+        dk::Fence fence;
+        bool pending = false;
+    };
+
+    bool readGpuTimer(int index);
     void checkAndInitialize(int width, int height, AVFrame* frame);
+    MappedSurface* getMappedSurface(AVFrame* frame);
+    void mapSurface(MappedSurface& surface, AVFrame* frame);
+    void releaseSurfaces();
+    void setColorConversion(AVFrame* frame);
 
+    bool m_is_prepared = false;
     bool m_is_initialized = false;
     
     int m_frame_width = 0;
     int m_frame_height = 0;
+    bool m_ten_bit = false;
     int m_screen_width = 0;
     int m_screen_height = 0;
 
@@ -41,7 +107,6 @@ class DKVideoRenderer : public IVideoRenderer {
     std::optional<CMemPool> pool_data;
 
     dk::UniqueCmdBuf cmdbuf;
-    DkCmdList cmdlist;
 
     CDescriptorSet<4096U> *imageDescriptorSet;
     // CDescriptorSet<1> samplerDescriptorSet;
@@ -51,19 +116,22 @@ class DKVideoRenderer : public IVideoRenderer {
 
     CMemPool::Handle vertexBuffer;
     CMemPool::Handle transformUniformBuffer;
+    Transformation transformState;
+    CMemPool::Handle scalingUniformBuffer;
+    Scaling scalingState;
+    ColorConversionTracker m_color_tracker;
 
     dk::ImageLayout lumaMappingLayout; 
     dk::ImageLayout chromaMappingLayout; 
-    dk::MemBlock mappingMemblock;
-
-    dk::Image luma;
-    dk::Image chroma;
 
-    dk::ImageDescriptor lumaDesc;
-    dk::ImageDescriptor chromaDesc;
+    std::array<MappedSurface, DK_MAPPED_SURFACES_MAX> m_surfaces;
+    int m_surfaces_count = 0;
 
-    int lumaTextureId = 0;
-    int chromaTextureId = 0;
+    // Report lists are recorded once, apart from surface draws
+    dk::UniqueCmdBuf timerCmdbuf;
+    CMemPool::Handle timerReportBuffer;
+    std::array<GpuTimer, DK_GPU_TIMERS> m_timers;
+    int m_timer_index = 0;
 
     VideoRenderStats m_video_render_stats = {};
 };
@@ -11,33 +11,196 @@ layout (std140, binding = 0) uniform Transformation
     mat3 yuvmat;
     vec3 offset;
     vec4 uv_data;
+    int transfer;
 } u;
 
+// Luma upscaling, same kernels as GL renderer
+layout (std140, binding = 1) uniform Scaling
+{
+    int scaling;
+    vec2 texel_size;
+};
+
+float sample_bicubic(sampler2D tex, vec2 uv) {
+    // 9 bilinear taps instead of 16 point ones
+    vec2 pos = uv / texel_size;
+    vec2 tc = floor(pos - 0.5) + 0.5;
+    vec2 f = pos - tc;
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    vec2 w12 = w1 + w2;
+    vec2 tc0 = (tc - 1.0) * texel_size;
+    vec2 tc12 = (tc + w2 / w12) * texel_size;
+    vec2 tc3 = (tc + 2.0) * texel_size;
+
+    return (texture(tex, vec2(tc0.x, tc0.y)).r * w0.x +
+            texture(tex, vec2(tc12.x, tc0.y)).r * w12.x +
+            texture(tex, vec2(tc3.x, tc0.y)).r * w3.x) * w0.y +
+           (texture(tex, vec2(tc0.x, tc12.y)).r * w0.x +
+            texture(tex, vec2(tc12.x, tc12.y)).r * w12.x +
+            texture(tex, vec2(tc3.x, tc12.y)).r * w3.x) * w12.y +
+           (texture(tex, vec2(tc0.x, tc3.y)).r * w0.x +
+            texture(tex, vec2(tc12.x, tc3.y)).r * w12.x +
+            texture(tex, vec2(tc3.x, tc3.y)).r * w3.x) * w3.y;
+}
+
+float lanczos2(float x) {
+    x = abs(x) * 3.14159265;
+    if (x < 1e-4)
+        return 1.0;
+    return x < 6.2831853 ? 2.0 * sin(x) * sin(x * 0.5) / (x * x) : 0.0;
+}
+
+float sample_lanczos(sampler2D tex, vec2 uv) {
+    vec2 pos = uv / texel_size - 0.5;
+    vec2 base = floor(pos);
+    vec2 f = pos - base;
+
+    float wx[4];
+    float wy[4];
+    for (int i = 0; i < 4; i++) {
+        wx[i] = lanczos2(float(i - 1) - f.x);
+        wy[i] = lanczos2(float(i - 1) - f.y);
+    }
+
+    float sum = 0.0;
+    float weights = 0.0;
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            float w = wx[x] * wy[y];
+            sum += texture(tex, (base + vec2(x, y) - 0.5) * texel_size).r * w;
+            weights += w;
+        }
+    }
+    return sum / weights;
+}
+
+// EASU: Lanczos2 approximation with kernel stretched along local edge
+// and narrowed across it, clamped to center texels against ringing
+float sample_easu(sampler2D tex, vec2 uv) {
+    vec2 pos = uv / texel_size - 0.5;
+    vec2 base = floor(pos);
+    vec2 f = pos - base;
+
+    float l[16];
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++)
+            l[y * 4 + x] = texture(tex, (base + vec2(x, y) - 0.5) * texel_size).r;
+    }
+
+    // Gradient of the center 2x2 quad, bilinearly weighted
+    vec2 dir = vec2(0.0);
+    float len = 0.0;
+    for (int y = 1; y < 3; y++) {
+        for (int x = 1; x < 3; x++) {
+            float w = (x == 1 ? 1.0 - f.x : f.x) * (y == 1 ? 1.0 - f.y : f.y);
+            float c = l[y * 4 + x];
+            float dx = l[y * 4 + x + 1] - l[y * 4 + x - 1];
+            float dy = l[(y + 1) * 4 + x] - l[(y - 1) * 4 + x];
+            float lx = abs(dx) / max(max(abs(l[y * 4 + x + 1] - c), abs(c - l[y * 4 + x - 1])), 1e-5);
+            float ly = abs(dy) / max(max(abs(l[(y + 1) * 4 + x] - c), abs(c - l[(y - 1) * 4 + x])), 1e-5);
+            dir += vec2(dx, dy) * w;
+            lx = clamp(lx, 0.0, 1.0);
+            ly = clamp(ly, 0.0, 1.0);
+            len += (lx * lx + ly * ly) * 0.5 * w;
+        }
+    }
+
+    float dir_len = dot(dir, dir);
+    dir = dir_len < 1.0 / 32768.0 ? vec2(1.0, 0.0) : dir * inversesqrt(dir_len);
+    len *= len;
+    float stretch = dot(dir, dir) / max(abs(dir.x), abs(dir.y));
+    vec2 len2 = vec2(1.0 + (stretch - 1.0) * len, 1.0 - 0.5 * len);
+    float lob = 0.5 - 0.29 * len;
+    float clp = 1.0 / lob;
+
+    float sum = 0.0;
+    float weights = 0.0;
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            vec2 v = vec2(x, y) - 1.0 - f;
+            v = vec2(dot(v, dir), dot(v, vec2(-dir.y, dir.x))) * len2;
+            float d2 = min(dot(v, v), clp);
+            float wb = 0.4 * d2 - 1.0;
+            float wa = lob * d2 - 1.0;
+            float w = (1.5625 * wb * wb - 0.5625) * wa * wa;
+            sum += l[y * 4 + x] * w;
+            weights += w;
+        }
+    }
+
+    float mn = min(min(l[5], l[6]), min(l[9], l[10]));
+    float mx = max(max(l[5], l[6]), max(l[9], l[10]));
+    return clamp(sum / weights, mn, mx);
+}
+
+// RCAS: sharpening lobe limited by local contrast so it doesn't clip,
+// neighbours are taken at source texel distance as there is no second pass
+float sharpen_rcas(sampler2D tex, vec2 uv, float c) {
+    float n = texture(tex, uv - vec2(0.0, texel_size.y)).r;
+    float s = texture(tex, uv + vec2(0.0, texel_size.y)).r;
+    float w = texture(tex, uv - vec2(texel_size.x, 0.0)).r;
+    float e = texture(tex, uv + vec2(texel_size.x, 0.0)).r;
+
+    float mn = min(min(n, s), min(w, e));
+    float mx = max(max(n, s), max(w, e));
+    float hit_min = mn / (4.0 * max(mx, 1e-5));
+    float hit_max = (1.0 - mx) / min(4.0 * mn - 4.0, -1e-5);
+    // 0.2 stops of sharpness, lobe limit as in reference
+    float lobe = max(-0.1875, min(max(-hit_min, hit_max), 0.0)) * 0.87055;
+    return clamp((lobe * (n + s + w + e) + c) / (4.0 * lobe + 1.0), 0.0, 1.0);
+}
+
+float sample_luma(sampler2D tex, vec2 uv) {
+    if (scaling == 1)
+        return sample_bicubic(tex, uv);
+    if (scaling == 2)
+        return sample_lanczos(tex, uv);
+    if (scaling == 3)
+        return sharpen_rcas(tex, uv, sample_easu(tex, uv));
+    return texture(tex, uv).r;
+}
+
+// Same tone mapping as GL renderer, SDR display gets HDR streams in one pass
+vec3 pq_to_nits(vec3 e) {
+    vec3 np = pow(e, vec3(1.0 / 78.84375));
+    vec3 l = max(np - 0.8359375, 0.0) / (18.8515625 - 18.6875 * np);
+    return pow(l, vec3(1.0 / 0.1593017578125)) * 10000.0;
+}
+
+vec3 hlg_to_nits(vec3 e) {
+    vec3 low = e * e / 3.0;
+    vec3 high = (exp((e - 0.55991073) / 0.17883277) + 0.28466892) / 12.0;
+    vec3 scene = mix(low, high, step(0.5, e));
+    // Reference OOTF for 1000 nits display
+    float y = dot(scene, vec3(0.2627, 0.6780, 0.0593));
+    return scene * pow(max(y, 1e-6), 0.2) * 1000.0;
+}
+
+vec3 tone_map(vec3 rgb) {
+    if (u.transfer == 0)
+        return rgb;
+
+    vec3 nits = u.transfer == 1 ? pq_to_nits(rgb) : hlg_to_nits(rgb);
+
+    // Relative to SDR reference white, extended Reinhard on luminance
+    vec3 color = nits / 203.0;
+    float l = dot(color, vec3(0.2627, 0.6780, 0.0593));
+    float white = 1000.0 / 203.0;
+    float mapped = l * (1.0 + l / (white * white)) / (1.0 + l);
+    color *= l > 0.0 ? mapped / l : 0.0;
+
+    // BT.2020 to BT.709 primaries
+    color = mat3(1.6605, -0.1246, -0.0182,
+                 -0.5876, 1.1329, -0.1006,
+                 -0.0728, -0.0083, 1.1187) * color;
+    return pow(clamp(color, 0.0, 1.0), vec3(1.0 / 2.2));
+}
+
 void main()
 {
-    // Not work
-    // vec2 uv = (vTextureCoord - u.uv_data.xy) * u.uv_data.zw;
-    // vec3 YCbCr = vec3(texture(plane0, uv).r, texture(plane1, uv).r, texture(plane1, uv).g) - u.offset;
-    // outColor = vec4(clamp(u.yuvmat * YCbCr, 0.0, 1.0), 1.0);
-
-    // Almost work
-    // vec3 YCbCr = vec3(
-	// 	texture2D(plane0, vTextureCoord)[0],
-	// 	texture2D(plane1, vTextureCoord).xy
-	// );
-
-	// YCbCr -= u.offset;
-	// outColor = vec4(clamp(u.yuvmat * YCbCr, 0.0, 1.0), 1.0f);
-
-    float r, g, b, yt, ut, vt;
-    
-    yt = texture2D(plane0, vTextureCoord).r;
-    ut = texture2D(plane1, vTextureCoord).r - 0.5;// - u.offset.y;
-    vt = texture2D(plane1, vTextureCoord).g - 0.5;// - u.offset.z;
-
-    r = yt + 1.13983*vt;
-    g = yt - 0.39465*ut - 0.58060*vt;
-    b = yt + 2.03211*ut;
-
-    outColor = vec4(r, g, b, 1.0);
+    vec3 YCbCr = vec3(sample_luma(plane0, vTextureCoord), texture(plane1, vTextureCoord).rg) - u.offset;
+    outColor = vec4(tone_map(clamp(u.yuvmat * YCbCr, 0.0, 1.0)), 1.0);
 }
@@ -6,6 +6,7 @@
 //
 
 #include "streaming_input_overlay.hpp"
+#include "InputManager.hpp"
 #include <Limelight.h>
 
 using namespace brls;
@@ -58,14 +59,12 @@ void StreamingInputOverlay::draw(NVGcontext* vg, float x, float y, float width,
         static KeyboardState oldKeyboardState;
         KeyboardState keyboardState = keyboard->getKeyboardState();
 
-        for (int i = 0; i < _VK_KEY_MAX; i++) {
-            if (keyboardState.keys[i] != oldKeyboardState.keys[i]) {
-                oldKeyboardState.keys[i] = keyboardState.keys[i];
-                LiSendKeyboardEvent(
-                    keyboard->getKeyCode((KeyboardKeys)i),
-                    keyboardState.keys[i] ? KEY_ACTION_DOWN : KEY_ACTION_UP, 0);
-            }
-        }
+        keyboardState.forEachChanged(oldKeyboardState, [this, &keyboardState](int key) {
+            LiSendKeyboardEvent(
+                keyboard->getKeyCode((KeyboardKeys)key),
+                keyboardState.test(key) ? KEY_ACTION_DOWN : KEY_ACTION_UP, 0);
+        });
+        oldKeyboardState = keyboardState;
     }
 
     if (!isKeyboardOpen) {
@@ -92,12 +91,15 @@ void StreamingInputOverlay::draw(NVGcontext* vg, float x, float y, float width,
         if (y < 2 && y > -2)
             y = 0;
 
+        static MotionAccumulator motion;
         if (x != 0 || y != 0) {
             float multiplier =
                 Settings::instance().get_mouse_speed_multiplier() / 100.f *
                     1.5f +
                 0.5f;
-            LiSendMouseMoveEvent(x * multiplier, y * multiplier);
+            short dx, dy;
+            if (motion.add(x * multiplier, y * multiplier, dx, dy))
+                LiSendMouseMoveEvent(dx, dy);
         }
 
         static bool old_l_pressed;
@@ -135,19 +137,10 @@ void StreamingInputOverlay::draw(NVGcontext* vg, float x, float y, float width,
         if (Settings::instance().swap_mouse_scroll())
             scroll_y *= -1;
 
-        std::chrono::high_resolution_clock::time_point timeNow =
-            std::chrono::high_resolution_clock::now();
-        static std::chrono::high_resolution_clock::time_point timeStamp =
-            timeNow;
-
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-                            timeNow - timeStamp)
-                            .count();
-        if (scroll_y != 0 && duration > 550 - abs(scroll_y) * 500) {
-            timeStamp = timeNow;
-            brls::Logger::info("Scroll sended: {}", scroll_y);
-            LiSendScrollEvent(scroll_y > 0 ? 1 : -1);
-        }
+        static ScrollAccumulator scroll;
+        short scrollAmount = scroll.update(scroll_y);
+        if (scrollAmount != 0)
+            LiSendHighResScrollEvent(scrollAmount);
     }
 }
 
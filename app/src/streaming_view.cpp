@@ -7,10 +7,18 @@
 
 #ifdef __SWITCH__
 #include <borealis/platforms/switch/switch_input.hpp>
+#include <switch.h>
 #endif
 
 #include "streaming_view.hpp"
 #include "AVFrameHolder.hpp"
+#include "DisplayVsync.hpp"
+#include "PerformanceHints.hpp"
+#include "HighResClock.hpp"
+#include "HostPinger.hpp"
+#include "LatencyProbe.hpp"
+#include "StreamThumbnails.hpp"
+#include "Log.hpp"
 #include "InputManager.hpp"
 #include "click_gesture_recognizer.hpp"
 #include "helper.hpp"
@@ -20,15 +28,28 @@
 #include <Limelight.h>
 #include <chrono>
 #include <nanovg.h>
+#include <thread>
 
 #if defined(__SDL2__)
 #include <SDL2/SDL.h>
 #endif
 
+#if defined(USE_GL_RENDERER) && !defined(BOREALIS_USE_DEKO3D)
+#include "GLSwapControl.hpp"
+#endif
+
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+#include "DKPresentControl.hpp"
+#endif
+
+#ifdef __SWITCH__
+#include "SwitchPower.hpp"
+#endif
+
 using namespace brls;
 
-#ifdef PLATFORM_TVOS
-extern void updatePreferredDisplayMode(bool streamActive);
+#if defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
+extern void updatePreferredDisplayMode(bool streamActive, int fps, bool hdr);
 #endif
 
 void setBottomBarStatus(const char *value) {
@@ -65,8 +86,26 @@ void overrideButtonsIfNeeded(bool value) {
 #endif
 }
 
-StreamingView::StreamingView(const Host& host, const AppInfo& app) : host(host), app(app) {
+StreamingView::StreamingView(const Host& host, const AppInfo& app, bool fastLaunch) : host(host), app(app) {
     Application::getPlatform()->disableScreenDimming(true);
+    HostPinger::instance().set_streaming(true);
+#ifdef __SWITCH__
+    // HOME menu doesn't suspend the app, so stream outlives it
+    appletSetFocusHandlingMode(AppletFocusHandlingMode_NoSuspend);
+#endif
+#if defined(USE_GL_RENDERER) && !defined(BOREALIS_USE_DEKO3D)
+    // Smoothest pacing counts on every frame waiting for vblank
+    if (Settings::instance().frame_pacing() != PACING_SMOOTHEST)
+        GLSwapControl::begin_stream(Settings::instance().variable_refresh());
+#endif
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+    DKPresentControl::begin_stream(Settings::instance().present_mode());
+#endif
+#ifdef PLATFORM_ANDROID
+    // Panel is switched to stream rate, pacing follows its vsync
+    DisplayVsync::instance().start(Settings::instance().fps());
+    PerformanceHints::instance().start(Settings::instance().fps());
+#endif
 
     setFocusable(true);
     setHideHighlight(true);
@@ -80,31 +119,45 @@ StreamingView::StreamingView(const Host& host, const AppInfo& app) : host(host),
 
     session = new MoonlightSession(host.address, app.app_id);
 
-#ifdef PLATFORM_TVOS
-        updatePreferredDisplayMode(true);
+    // Negotiated rate replaces this one once stream starts
+    m_display_fps = Settings::instance().fps();
+#if defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
+    updatePreferredDisplayMode(true, m_display_fps, false);
 #endif
 
-    ASYNC_RETAIN
-    GameStreamClient::instance().connect(
-        host.address, [ASYNC_TOKEN](GSResult<SERVER_DATA> result) {
+    auto& client = GameStreamClient::instance();
+    // Paired and Sunshine flags of cached state, nullopt for unknown host
+    auto cached = client.read_server_data(host.address, [](auto& data) {
+        return std::make_pair(data.paired, data.isSunshine());
+    });
+    if (fastLaunch && cached && cached->first) {
+        // Host is validated alongside launch, so fresh state for retry
+        // is already on its way if cached one turns out stale
+        client.connect(host.address, [](GSResult<SERVER_DATA> result) {
+            if (!result.isSuccess())
+                brls::Logger::warning("StreamingView: Host didn't answer while launching - {}", result.error());
+        });
+        brls::Logger::info("StreamingView: Launching {} from cached host state", app.app_id);
+        startSession(cached->second, true);
+    } else {
+        ASYNC_RETAIN
+        client.connect(host.address, [ASYNC_TOKEN](GSResult<SERVER_DATA> result) {
             ASYNC_RELEASE
             if (!result.isSuccess()) {
                 showError(result.error(), [this]() { terminate(false); });
                 return;
             }
 
-            ASYNC_RETAIN
-            session->start([ASYNC_TOKEN](GSResult<bool> result) {
-                ASYNC_RELEASE
+            // View was left while connecting
+            if (!session)
+                return;
 
-                loader->setHidden(true);
-                if (!result.isSuccess()) {
-                    showError(result.error(), [this]() { terminate(false); });
-                }
-            }, result.value().isSunshine());
+            startSession(result.value().isSunshine(), false);
         });
+    }
 
     MoonlightInputManager::instance().reloadButtonMappingLayout();
+    MoonlightInputManager::instance().reloadInputShaping();
 
     static bool lMouseKeyGate = false;
     static bool lMouseKeyUsed = false;
@@ -117,7 +170,7 @@ StreamingView::StreamingView(const Host& host, const AppInfo& app) : host(host),
             if (Settings::instance().touchscreen_mouse_mode()) return;
 
             if (status.state == brls::GestureState::END) {
-                Logger::debug("Left mouse click");
+                CLOG_DEBUG(LOG_INPUT, "Left mouse click");
                 MoonlightInputManager::leftMouseClick();
                 lMouseKeyGate = true;
                 delay(200, [] { lMouseKeyGate = false; });
@@ -129,7 +182,7 @@ StreamingView::StreamingView(const Host& host, const AppInfo& app) : host(host),
             if (Settings::instance().touchscreen_mouse_mode()) return;
 
             if (status.state == brls::GestureState::END) {
-                Logger::debug("Right mouse click");
+                CLOG_DEBUG(LOG_INPUT, "Right mouse click");
                 MoonlightInputManager::rightMouseClick();
             }
         }));
@@ -164,8 +217,7 @@ StreamingView::StreamingView(const Host& host, const AppInfo& app) : host(host),
                                            BUTTON_MOUSE_LEFT);
                 }
             } else if (status.state == brls::GestureState::STAY) {
-                brls::RawMouseState mouseState;
-                Application::getPlatform()->getInputManager()->updateMouseStates(&mouseState);
+                const auto& mouseState = MoonlightInputManager::instance().frameInput().mouse;
                 // Dirty hack to not update pan if mouse left button is pressed, because pan gesture recognizer will append its speed with raw mouse value
                 // Need to improve gesture recognizers to determine the input source and ignore it for mouse
                 if (!mouseState.leftButton) {
@@ -190,8 +242,8 @@ StreamingView::StreamingView(const Host& host, const AppInfo& app) : host(host),
 
                 int threshold = int(state.delta.y / 25);
                 if (threshold != this->touchScrollCounter) {
-                    Logger::debug("Scroll on: {}",
-                                  threshold - this->touchScrollCounter);
+                    CLOG_DEBUG(LOG_INPUT, "Scroll on: {}",
+                              threshold - this->touchScrollCounter);
                     int invert = Settings::instance().swap_mouse_scroll() ? -1 : 1;
                     char scrollCount = threshold - this->touchScrollCounter;
                     LiSendScrollEvent(scrollCount * invert);
@@ -235,6 +287,7 @@ StreamingView::StreamingView(const Host& host, const AppInfo& app) : host(host),
 
 void StreamingView::onFocusGained() {
     Box::onFocusGained();
+    focused = true;
 
     MoonlightInputManager::instance().setInputEnabled(true);
 
@@ -260,8 +313,10 @@ void StreamingView::onFocusGained() {
 
 void StreamingView::onFocusLost() {
     Box::onFocusLost();
+    focused = false;
 
     MoonlightInputManager::instance().setInputEnabled(false);
+    MoonlightInputManager::instance().stopPolling();
     MoonlightInputManager::instance().dropInput();
 
     if (blocked) {
@@ -281,17 +336,45 @@ void StreamingView::onFocusLost() {
 
 void StreamingView::draw(NVGcontext* vg, float x, float y, float width,
                          float height, Style style, FrameContext* ctx) {
+    // Session is torn down in background once view is terminated
+    if (!session)
+        return;
+
     if (session->is_terminated()) {
         terminate(false);
         return;
     }
 
+#ifdef __SWITCH__
+    bool wasSuspended = session->is_suspended();
+    session->set_suspended(appletGetFocusState() != AppletFocusState_InFocus);
+    if (!wasSuspended && session->is_suspended())
+        captureThumbnail();
+#endif
+    updateBacklight();
+    updateFastPath();
+    if (session->is_suspended()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(SUSPENDED_DRAW_INTERVAL_MS));
+        return;
+    }
+
     session->draw(vg, (int) width, (int) height);
+    if (session->is_audio_only())
+        drawAudioOnly(vg, width, height);
 
-    if (!tempInputLock && session->is_active())
+    if (!tempInputLock && session->is_active()) {
+        MoonlightInputManager::instance().startPolling();
         handleInput();
-    handleOverlayCombo();
-    handleMouseInputCombo();
+    }
+
+    // Video is presented on every refresh, on 90 - 120 Hz displays
+    // overlay logic keeps usual UI rate
+    uint64_t now = HighResClock::now_us();
+    bool highRefresh = session->frames().getDisplayRefreshRate() > HIGH_REFRESH_MIN_HZ;
+    if (!highRefresh || now - overlayUpdatedUs >= 1000000 / OVERLAY_UPDATE_HZ) {
+        overlayUpdatedUs = now;
+        handleOverlayCombo();
+    }
 
     if (session->connection_status_is_poor()) {
         nvgFontSize(vg, 20);
@@ -308,59 +391,65 @@ void StreamingView::draw(NVGcontext* vg, float x, float y, float width,
         nvgText(vg, 50, height - 28, "\uE140 Bad connection...", nullptr);
     }
 
-    if (session->use_hdr() != m_use_hdr) {
+    int stream_fps = session->stream_fps() ? session->stream_fps() : m_display_fps;
+    if (session->use_hdr() != m_use_hdr || stream_fps != m_display_fps) {
         m_use_hdr = session->use_hdr();
+        m_display_fps = stream_fps;
 
-#ifdef PLATFORM_TVOS
-        updatePreferredDisplayMode(true);
+#if defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
+        updatePreferredDisplayMode(true, m_display_fps, m_use_hdr);
 #endif
     }
 
-    if (draw_stats) {
-        auto stats = session->session_stats();
-
-        auto statistics = fmt::format(
-                    "Estimated host PC frame rate: {:.{}f} FPS\n"
-                        "Incoming frame rate from network: {:.{}f} FPS\n"
-                        "Decoding frame rate: {:.{}f} FPS\n"
-                        "Rendering frame rate: {:.{}f} FPS\n",
-                    stats->video_decode_stats.current_host_fps, 2,
-                    stats->video_decode_stats.current_received_fps, 2,
-                    stats->video_decode_stats.current_decoded_fps, 2,
-                    stats->video_render_stats.rendered_fps, 2);
-
-        statistics += fmt::format("Frames dropped by your network connection: {}\n"
-                                  "Average receive time: {:.{}f} | {:.{}f} ms\n"
-                                  "Average decoding time: {:.{}f} | {:.{}f} ms\n"
-                                  "Average rendering time: {:.{}f} ms\n"
-                                  "Frame holder push/get rate: {}\n"
-                                  "Frames queue reuses | drops: {} | {}\n"
-                                  "Frames queue: {}",
-                                  stats->video_decode_stats.network_dropped_frames,
-                                  stats->video_decode_stats.current_receive_time, 2,
-                                  stats->video_decode_stats.session_receive_time, 2,
-                                  stats->video_decode_stats.current_decoding_time, 2,
-                                  stats->video_decode_stats.session_decoding_time, 2,
-                                  stats->video_render_stats.rendering_time, 2,
-                                  AVFrameHolder::instance().getStat(),
-                                  AVFrameHolder::instance().getFakeFrameStat(),
-                                  AVFrameHolder::instance().getFrameDropStat(),
-                                  AVFrameHolder::instance().getFrameQueueSize());
+    if (draw_stats)
+        statsOverlay.draw(vg, width, height, session, draw_frame_graph);
+    else
+        statsOverlay.reset();
 
-        nvgFontFaceId(vg, Application::getFont(FONT_REGULAR));
-        nvgFontSize(vg, 20);
-        nvgTextAlign(vg, NVG_ALIGN_LEFT | NVG_ALIGN_BOTTOM);
+    // Loader and keyboard are the only children
+    if (!fastPath)
+        Box::draw(vg, x, y, width, height, style, ctx);
+}
 
-        nvgFontBlur(vg, 1);
-        nvgFillColor(vg, nvgRGBA(0, 0, 0, 255));
-        nvgTextBox(vg, 20, 30, width, statistics.c_str(), nullptr);
+void StreamingView::updateFastPath() {
+    // Overlays take focus from stream, so only video, stats and
+    // warning are shown while it's focused without keyboard
+    bool fast = session && session->is_active() && focused && !keyboard;
+    if (fast == fastPath)
+        return;
 
-        nvgFontBlur(vg, 0);
-        nvgFillColor(vg, nvgRGBA(0, 255, 0, 255));
-        nvgTextBox(vg, 20, 30, width, statistics.c_str(), nullptr);
-    }
+    fastPath = fast;
+    // Gone views aren't laid out, keyboard holder spans the whole view
+    keyboardHolder->setVisibility(fast ? Visibility::GONE : Visibility::VISIBLE);
+    CLOG_DEBUG(LOG_RENDER, "StreamingView: Fast path {}", fast ? "on" : "off");
+}
+
+void StreamingView::updateBacklight() {
+#ifdef __SWITCH__
+    // Overlay and HOME menu have to be seen
+    bool off = session && session->is_audio_only() && !session->is_suspended() && focused;
+    SwitchPower::set_backlight(!off);
+#endif
+}
+
+void StreamingView::captureThumbnail() {
+    if (session && !session->is_audio_only())
+        StreamThumbnails::instance().capture({BoxArtManager::host_id(host), app.app_id},
+                                             session->frames().current());
+}
 
-    Box::draw(vg, x, y, width, height, style, ctx);
+void StreamingView::drawAudioOnly(NVGcontext* vg, float width, float height) {
+    std::string text = "streaming/audio_only_hint"_i18n;
+    nvgBeginPath(vg);
+    nvgFillColor(vg, nvgRGBA(0, 0, 0, 255));
+    nvgRect(vg, 0, 0, width, height);
+    nvgFill(vg);
+
+    nvgFontSize(vg, 24);
+    nvgTextAlign(vg, NVG_ALIGN_CENTER | NVG_ALIGN_MIDDLE);
+    nvgFontFaceId(vg, Application::getFont(FONT_REGULAR));
+    nvgFillColor(vg, nvgRGBA(255, 255, 255, 160));
+    nvgText(vg, width / 2, height / 2, text.c_str(), nullptr);
 }
 
 void StreamingView::addKeyboard() {
@@ -369,6 +458,7 @@ void StreamingView::addKeyboard() {
 
     keyboard = new KeyboardView(false);
     keyboardHolder->addView(keyboard);
+    updateFastPath();
 }
 
 void StreamingView::removeKeyboard() {
@@ -385,7 +475,14 @@ void StreamingView::terminate(bool terminateApp) {
         return;
     terminated = true;
 
-    session->stop(terminateApp);
+    MoonlightInputManager::instance().stopPolling();
+    LatencyProbe::instance().set_enabled(false);
+    // Quitted app has nothing to resume
+    if (!terminateApp)
+        captureThumbnail();
+    MoonlightSession::stop_async(session, terminateApp);
+    session = nullptr;
+    updateBacklight();
 
     int controllersCount = Application::getPlatform()->getInputManager()->getControllersConnectedCount();
     for (int i = 0; i < controllersCount; i++)
@@ -409,14 +506,12 @@ void StreamingView::handleInput() {
         static KeyboardState oldKeyboardState;
         KeyboardState keyboardState = keyboard->getKeyboardState();
 
-        for (int i = 0; i < _VK_KEY_MAX; i++) {
-            if (keyboardState.keys[i] != oldKeyboardState.keys[i]) {
-                oldKeyboardState.keys[i] = keyboardState.keys[i];
-                LiSendKeyboardEvent(
-                    keyboard->getKeyCode((KeyboardKeys)i),
-                    keyboardState.keys[i] ? KEY_ACTION_DOWN : KEY_ACTION_UP, 0);
-            }
-        }
+        keyboardState.forEachChanged(oldKeyboardState, [this, &keyboardState](int key) {
+            LiSendKeyboardEvent(
+                keyboard->getKeyCode((KeyboardKeys)key),
+                keyboardState.test(key) ? KEY_ACTION_DOWN : KEY_ACTION_UP, 0);
+        });
+        oldKeyboardState = keyboardState;
 
         // Drop input if keyboard overlay presented
 //        MoonlightInputManager::instance().dropInput();
@@ -424,6 +519,7 @@ void StreamingView::handleInput() {
 //    else {
     MoonlightInputManager::instance().handleInput(keyboard != nullptr);
 //    }
+    LatencyProbe::instance().tick();
 
     if (!Application::currentTouchState.empty()) {
         setBottomBarStatus("2");
@@ -441,38 +537,20 @@ void StreamingView::handleInput() {
 }
 
 void StreamingView::handleOverlayCombo() {
+    // Combos are detected with controllers poll, fired ones are only
+    // taken here. Taken while unfocused too, so they don't fire later
+    auto& input = MoonlightInputManager::instance();
+    bool overlayCombo = input.takeCombo(COMBO_OVERLAY);
+    bool mouseInputCombo = input.takeCombo(COMBO_MOUSE_INPUT);
     if (!this->focused)
         return;
 
-    KeyComboOptions options = Settings::instance().overlay_options();
-
-    static ControllerState controller;
-    Application::getPlatform()->getInputManager()->updateUnifiedControllerState(
-        &controller);
-
-    static std::chrono::high_resolution_clock::time_point clock_counter;
-    static bool buttonState = false;
-    static bool used = false;
-
-    auto duration = std::chrono::duration_cast<std::chrono::seconds>(
-        std::chrono::high_resolution_clock::now() - clock_counter);
-
-    bool buttonsPressed = true;
-    for (auto button : options.buttons) {
-        buttonsPressed &= controller.buttons[button];
-    }
-
-    if (!buttonState && buttonsPressed) {
-        buttonState = true;
-        clock_counter = std::chrono::high_resolution_clock::now();
-    } else if (buttonState && !buttonsPressed) {
-        buttonState = false;
-        used = false;
-    } else if (buttonState && duration.count() >= options.holdTime && !used) {
-        used = true;
-
+    if (overlayCombo) {
         auto overlay = new IngameOverlay(this);
         Application::pushActivity(new Activity(overlay));
+    } else if (mouseInputCombo) {
+        auto overlay = new StreamingInputOverlay(this);
+        Application::pushActivity(new Activity(overlay));
     }
 
 #ifdef PLATFORM_SWITCH
@@ -494,44 +572,6 @@ void StreamingView::handleOverlayCombo() {
 #endif
 }
 
-void StreamingView::handleMouseInputCombo() {
-    if (!this->focused)
-        return;
-
-    KeyComboOptions options = Settings::instance().mouse_input_options();
-    if (options.buttons.empty())
-        return;
-
-    static ControllerState controller;
-    Application::getPlatform()->getInputManager()->updateUnifiedControllerState(
-        &controller);
-
-    static std::chrono::high_resolution_clock::time_point clock_counter;
-    static bool buttonState = false;
-    static bool used = false;
-
-    auto duration = std::chrono::duration_cast<std::chrono::seconds>(
-        std::chrono::high_resolution_clock::now() - clock_counter);
-
-    bool buttonsPressed = true;
-    for (auto button : options.buttons) {
-        buttonsPressed &= controller.buttons[button];
-    }
-
-    if (!buttonState && buttonsPressed) {
-        buttonState = true;
-        clock_counter = std::chrono::high_resolution_clock::now();
-    } else if (buttonState && !buttonsPressed) {
-        buttonState = false;
-        used = false;
-    } else if (buttonState && duration.count() >= options.holdTime && !used) {
-        used = true;
-
-        auto overlay = new StreamingInputOverlay(this);
-        Application::pushActivity(new Activity(overlay));
-    }
-}
-
 void StreamingView::onLayout() {
     Box::onLayout();
     if (loader)
@@ -543,16 +583,46 @@ void StreamingView::onLayout() {
     }
 }
 
+void StreamingView::startSession(bool isSunshine, bool cachedHost) {
+    ASYNC_RETAIN
+    session->start([ASYNC_TOKEN](GSResult<bool> result) {
+        ASYNC_RELEASE
+
+        loader->setHidden(true);
+        if (!result.isSuccess()) {
+            showError(result.error(), [this]() { terminate(false); });
+        }
+    }, isSunshine, cachedHost);
+}
+
 StreamingView::~StreamingView() {
-#ifdef PLATFORM_TVOS
-    updatePreferredDisplayMode(false);
+#if defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
+    updatePreferredDisplayMode(false, 0, false);
 #endif
     
     Application::getPlatform()->disableScreenDimming(false);
+    HostPinger::instance().set_streaming(false);
+#ifdef __SWITCH__
+    appletSetFocusHandlingMode(AppletFocusHandlingMode_SuspendHomeSleep);
+#endif
+#if defined(USE_GL_RENDERER) && !defined(BOREALIS_USE_DEKO3D)
+    GLSwapControl::end_stream();
+#endif
+#if defined(PLATFORM_SWITCH) && defined(BOREALIS_USE_DEKO3D)
+    DKPresentControl::end_stream();
+#endif
+#ifdef PLATFORM_ANDROID
+    DisplayVsync::instance().stop();
+    PerformanceHints::instance().stop();
+#endif
+#ifdef __SWITCH__
+    SwitchPower::set_backlight(true);
+#endif
     Application::getPlatform()
         ->getInputManager()
         ->getKeyboardKeyStateChanged()
         ->unsubscribe(keysSubscription);
-    session->stop(false);
-    delete session;
+    MoonlightInputManager::instance().stopPolling();
+    if (session)
+        MoonlightSession::stop_async(session, false);
 }
@@ -0,0 +1,49 @@
+//
+//  AllocCounter.cpp
+//  Moonlight
+//
+
+#include "AllocCounter.hpp"
+
+#ifdef USE_ALLOC_COUNTER
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> allocations = 0;
+
+static void* counted_alloc(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+void* operator new(std::size_t size) {
+    if (void* ptr = counted_alloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    if (void* ptr = counted_alloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { free(ptr); }
+
+bool AllocCounter::enabled() { return true; }
+
+uint64_t AllocCounter::count() { return allocations.load(std::memory_order_relaxed); }
+#else
+bool AllocCounter::enabled() { return false; }
+
+uint64_t AllocCounter::count() { return 0; }
+#endif
@@ -0,0 +1,17 @@
+//
+//  AllocCounter.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <cstdint>
+
+// Heap allocations of all threads made through operator new, malloc of C
+// libraries isn't seen. Only counted when built with USE_ALLOC_COUNTER,
+// replaced operator new costs an atomic increment per allocation
+class AllocCounter {
+  public:
+    [[nodiscard]] static bool enabled();
+    [[nodiscard]] static uint64_t count();
+};
@@ -0,0 +1,128 @@
+//
+//  AsyncLog.cpp
+//  Moonlight
+//
+
+#include "AsyncLog.hpp"
+#include "HighResClock.hpp"
+#include "ThreadProfiler.hpp"
+#include <borealis.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+static void format_message(char* buffer, const char* prefix, const char* format, va_list args) {
+    int length = snprintf(buffer, ASYNC_LOG_MESSAGE_SIZE, "%s", prefix);
+    length = std::min(length, ASYNC_LOG_MESSAGE_SIZE - 1);
+    vsnprintf(buffer + length, ASYNC_LOG_MESSAGE_SIZE - length, format, args);
+
+    // moonlight-common-c and FFmpeg end their messages with new line
+    size_t end = strlen(buffer);
+    while (end > 0 && (buffer[end - 1] == '\n' || buffer[end - 1] == '\r'))
+        buffer[--end] = '\0';
+}
+
+void AsyncLog::start() {
+    if (m_running)
+        return;
+
+    if (!m_slots) {
+        m_slots = std::make_unique<Slot[]>(ASYNC_LOG_SLOTS);
+        for (size_t i = 0; i < ASYNC_LOG_SLOTS; i++)
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    m_start_us = HighResClock::now_us();
+    m_dropped = 0;
+    m_running = true;
+    m_writer = std::thread([this] { run(); });
+}
+
+void AsyncLog::stop() {
+    if (!m_running.exchange(false))
+        return;
+
+    if (m_writer.joinable())
+        m_writer.join();
+    drain();
+}
+
+void AsyncLog::log(AsyncLogLevel level, const char* prefix, const char* format, va_list args) {
+    if (!m_running) {
+        char buffer[ASYNC_LOG_MESSAGE_SIZE];
+        format_message(buffer, prefix, format, args);
+        write(level, buffer, 0);
+        return;
+    }
+
+    uint64_t now = HighResClock::now_us();
+
+    // Bounded MPMC ring from D. Vyukov, every slot sequence tells
+    // whose turn it is, so producers only race for the head
+    Slot* slot;
+    size_t position = m_head.load(std::memory_order_relaxed);
+    while (true) {
+        slot = &m_slots[position % ASYNC_LOG_SLOTS];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        auto diff = (intptr_t)sequence - (intptr_t)position;
+
+        if (diff == 0) {
+            if (m_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // Writer is behind by whole ring, caller must not wait for it
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            position = m_head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->time_us = now - m_start_us;
+    slot->level = level;
+    format_message(slot->message, prefix, format, args);
+    slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+void AsyncLog::run() {
+    ThreadProfileScope profile("Log writer");
+    while (m_running) {
+        drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(ASYNC_LOG_FLUSH_MS));
+    }
+}
+
+void AsyncLog::drain() {
+    while (true) {
+        Slot& slot = m_slots[m_tail % ASYNC_LOG_SLOTS];
+        if (slot.sequence.load(std::memory_order_acquire) != m_tail + 1)
+            break;
+
+        write(slot.level, slot.message, slot.time_us);
+        slot.sequence.store(m_tail + ASYNC_LOG_SLOTS, std::memory_order_release);
+        m_tail++;
+    }
+
+    if (uint32_t dropped = m_dropped.exchange(0))
+        brls::Logger::warning("AsyncLog: Dropped {} messages", dropped);
+}
+
+void AsyncLog::write(AsyncLogLevel level, const char* message, uint64_t time_us) {
+    std::string text = time_us ? fmt::format("[{:.3f}] {}", time_us / 1000000.0, message) : message;
+
+    switch (level) {
+        case ASYNC_LOG_ERROR:
+            brls::Logger::error("{}", text);
+            break;
+        case ASYNC_LOG_WARNING:
+            brls::Logger::warning("{}", text);
+            break;
+        case ASYNC_LOG_INFO:
+            brls::Logger::info("{}", text);
+            break;
+        case ASYNC_LOG_DEBUG:
+            brls::Logger::debug("{}", text);
+            break;
+    }
+}
@@ -0,0 +1,58 @@
+//
+//  AsyncLog.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Singleton.hpp"
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+// Messages longer than slot are cut, ring full of them is dropped
+#define ASYNC_LOG_SLOTS 512
+#define ASYNC_LOG_MESSAGE_SIZE 240
+#define ASYNC_LOG_FLUSH_MS 20
+
+enum AsyncLogLevel : uint8_t {
+    ASYNC_LOG_ERROR,
+    ASYNC_LOG_WARNING,
+    ASYNC_LOG_INFO,
+    ASYNC_LOG_DEBUG,
+};
+
+// Log sink for network and decoder threads during streaming. Callers
+// only format into a slot of a lock-free ring, background writer passes
+// messages to brls::Logger, which could be writing to SD card.
+// Outside of start() / stop() messages go to brls::Logger directly
+class AsyncLog : public Singleton<AsyncLog> {
+  public:
+    void start();
+    // Writes everything left, producers must be stopped before
+    void stop();
+
+    void log(AsyncLogLevel level, const char* prefix, const char* format, va_list args);
+
+  private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        uint64_t time_us;
+        AsyncLogLevel level;
+        char message[ASYNC_LOG_MESSAGE_SIZE];
+    };
+
+    void run();
+    void drain();
+    static void write(AsyncLogLevel level, const char* message, uint64_t time_us);
+
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<size_t> m_head = 0;
+    size_t m_tail = 0;
+    std::atomic<bool> m_running = false;
+    std::atomic<uint32_t> m_dropped = 0;
+    uint64_t m_start_us = 0;
+    std::thread m_writer;
+};
@@ -1,84 +1,492 @@
 #include "BoxArtManager.hpp"
+#include "BoxArtStore.hpp"
 #include "Data.hpp"
+#include "JpegDecoder.hpp"
+#include "MemoryAccounting.hpp"
 #include "Settings.hpp"
 #include "nanovg.h"
-#include <mutex>
+#include <borealis.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
 #include <CImg.h>
 
-std::mutex m_mutex;
+// Raw thumbnail header, pixels follow as width * height RGBA
+struct BoxArtHeader {
+    char magic[4];
+    uint32_t width;
+    uint32_t height;
+};
 
-bool BoxArtManager::has_boxart(int app_id) {
-    if (m_has_boxart.count(app_id)) {
-        return m_has_boxart[app_id];
+static const char BOXART_MAGIC[4] = {'M', 'L', 'B', 'A'};
+
+// Older versions kept <app_id>.png / .rgba without host, those could
+// belong to any host and are dropped
+static void remove_legacy_files(const std::string& dir) {
+    DIR* handle = opendir(dir.c_str());
+    if (!handle)
+        return;
+
+    std::vector<std::string> legacy;
+    while (struct dirent* entry = readdir(handle)) {
+        std::string name = entry->d_name;
+        size_t dot = name.rfind('.');
+        if (dot == std::string::npos || dot == 0 ||
+            name.find_first_not_of("0123456789") != dot)
+            continue;
+        if (name.compare(dot, std::string::npos, ".png") == 0 ||
+            name.compare(dot, std::string::npos, ".rgba") == 0)
+            legacy.push_back(dir + "/" + name);
     }
+    closedir(handle);
 
-    std::string path = Settings::instance().boxart_dir() + "/" +
-                       std::to_string(app_id) + ".png";
-    Data data = Data::read_from_file(path);
-    m_has_boxart[app_id] = !data.is_empty();
+    for (auto& path : legacy)
+        remove(path.c_str());
+    if (!legacy.empty())
+        brls::Logger::info("BoxArtManager: Removed {} box art files of old layout", legacy.size());
+}
 
-    return m_has_boxart[app_id];
+BoxArtManager::~BoxArtManager() = default;
+
+std::string BoxArtManager::host_id(const Host& host) {
+    std::string id;
+    for (char c : host.mac.empty() ? host.address : host.mac) {
+        if (isalnum((unsigned char)c))
+            id += (char)tolower((unsigned char)c);
+    }
+    return id.empty() ? "host" : id;
 }
 
-void BoxArtManager::set_data(Data data, int app_id) {
-    std::lock_guard<std::mutex> guard(m_mutex);
+BoxArtStore& BoxArtManager::store(const std::string& host) {
+    std::lock_guard<std::mutex> guard(m_stores_mutex);
 
-    std::string path = Settings::instance().boxart_dir() + "/" +
-                       std::to_string(app_id) + ".png";
+    if (m_stores.empty())
+        remove_legacy_files(Settings::instance().boxart_dir());
 
-    data.write_to_file(path);
-    compress_texture(path);
+    auto& store = m_stores[host];
+    if (!store)
+        store = std::make_unique<BoxArtStore>(Settings::instance().boxart_dir() + "/" + host + ".pack");
+    return *store;
+}
 
-    m_has_boxart[app_id] = true;
+bool BoxArtManager::has_boxart(const BoxArtId& id) {
+    if (generated(id.host))
+        return true;
+
+    auto known = m_has_boxart.find(id);
+    if (known != m_has_boxart.end())
+        return known->second;
+
+    // Store index is in memory, no file is touched
+    return m_has_boxart[id] = store(id.host).contains(id.app_id);
 }
 
-void BoxArtManager::compress_texture(const std::string& path) {
+bool BoxArtManager::needs_refresh(const BoxArtId& id) {
+    if (!has_boxart(id) || generated(id.host) || m_processing.count(id) || m_refreshed.count(id))
+        return false;
+
+    BoxArtInfo info;
+    if (!store(id.host).info(id.app_id, &info))
+        return false;
+
+    if ((uint32_t)time(nullptr) - info.checked < BOXART_REFRESH_AGE_S)
+        return false;
+
+    m_refreshed.insert(id);
+    return true;
+}
+
+// Pixel size cell takes on screen, bigger thumbnail only wastes texture memory
+static void thumbnail_size(int* width, int* height) {
+    float scale = (float)brls::Application::windowWidth / brls::Application::contentWidth;
+    scale = std::min(std::max(scale, 1.0f), BOXART_MAX_SCALE);
+    *width = int((float)BOXART_WIDTH * scale);
+    *height = int((float)BOXART_HEIGHT * scale);
+}
+
+void BoxArtManager::set_generator(const std::string& host, BoxArtGenerator generator) {
+    int width, height;
+    thumbnail_size(&width, &height);
+
+    std::lock_guard<std::mutex> guard(m_generators_mutex);
+    m_generators[host] = {width, height, std::move(generator)};
+}
+
+void BoxArtManager::clear_generator(const std::string& host) {
+    {
+        std::lock_guard<std::mutex> guard(m_generators_mutex);
+        m_generators.erase(host);
+    }
+
+    std::vector<BoxArtId> textures;
+    for (auto& texture : m_textures) {
+        if (texture.first.host == host)
+            textures.push_back(texture.first);
+    }
+    for (auto& id : textures)
+        release(id);
+    for (auto it = m_preloaded.begin(); it != m_preloaded.end();)
+        it = it->first.host == host ? m_preloaded.erase(it) : std::next(it);
+}
+
+bool BoxArtManager::generated(const std::string& host) {
+    std::lock_guard<std::mutex> guard(m_generators_mutex);
+    return m_generators.count(host) > 0;
+}
+
+void BoxArtManager::set_data(Data data, const BoxArtId& id) {
+    // Not decoded for drawing until thumbnail is written
+    m_processing.insert(id);
+
+    int width, height;
+    thumbnail_size(&width, &height);
+
+    brls::async([this, data = std::move(data), id, width, height]() mutable {
+        uint32_t source_hash = BoxArtStore::hash(data.bytes(), data.size());
+        BoxArtStore& thumbnails = store(id.host);
+
+        // Same image as before, thumbnail stays as it is
+        BoxArtInfo info;
+        if (thumbnails.info(id.app_id, &info) && info.source_hash == source_hash) {
+            thumbnails.stamp(id.app_id);
+            brls::sync([this, id] { m_processing.erase(id); });
+            return;
+        }
+
+        bool success;
+        {
+            std::lock_guard<std::mutex> guard(file_mutex(id));
+            success = make_thumbnail(id, data, width, height, source_hash);
+        }
+
+        brls::sync([this, id, success] {
+            m_processing.erase(id);
+            if (!success)
+                return;
+
+            if (m_has_boxart[id])
+                brls::Logger::info("BoxArtManager: Box art of {} changed on host", id.app_id);
+
+            // Texture of replaced box art is made again on next draw
+            release(id);
+            m_has_boxart[id] = true;
+        });
+    });
+}
+
+std::mutex& BoxArtManager::file_mutex(const BoxArtId& id) {
+    std::lock_guard<std::mutex> guard(m_file_mutexes_mutex);
+    return m_file_mutexes[id];
+}
+
+bool BoxArtManager::make_thumbnail(const BoxArtId& id, const Data& data, int width, int height,
+                                   uint32_t source_hash) {
     using namespace cimg_library;
 
-    /*
-     * target width == 300
-     * target height == 400
-     * 0.75 == 300 / 400
-     */
+    // CImg decodes PNG from file only, source is there just for that
+    std::string source = source_path(id);
 
-    CImg<unsigned char> pic(path.c_str());
-    if (float(pic.width()) / float(pic.height()) < 0.75f) {
-        pic = pic.resize(300, int(float(pic.height()) * 300.0f / float(pic.width())), 1, 3);
-    } else {
-        pic = pic.resize(int(float(pic.width()) * 400.0f / float(pic.height())), 400, 1, 3);
+    try {
+        CImg<unsigned char> pic;
+        if (JpegDecoder::is_jpeg(data.bytes(), data.size())) {
+            // NVJPG or libavcodec, nothing goes through a file
+            int jpeg_width, jpeg_height;
+            std::vector<unsigned char> rgba;
+            if (!JpegDecoder::instance().decode(data.bytes(), data.size(), &jpeg_width, &jpeg_height, &rgba)) {
+                brls::Logger::error("BoxArtManager: Failed to decode JPEG {}", id.app_id);
+                return false;
+            }
+
+            pic.assign(jpeg_width, jpeg_height, 1, 3);
+            for (int y = 0; y < jpeg_height; y++) {
+                for (int x = 0; x < jpeg_width; x++) {
+                    const unsigned char* pixel = rgba.data() + ((size_t)y * jpeg_width + x) * 4;
+                    for (int c = 0; c < 3; c++)
+                        pic(x, y, 0, c) = pixel[c];
+                }
+            }
+        } else {
+            data.write_to_file(source);
+            pic.assign(source.c_str());
+        }
+
+        // Covers target size, cell crops the rest like "fill" scaling.
+        // Moving average keeps downscaled covers from aliasing
+        if (float(pic.width()) / float(pic.height()) < float(width) / float(height)) {
+            pic = pic.resize(width, int(float(pic.height()) * float(width) / float(pic.width())), 1, 3, 2);
+        } else {
+            pic = pic.resize(int(float(pic.width()) * float(height) / float(pic.height())), height, 1, 3, 2);
+        }
+
+        BoxArtHeader header;
+        memcpy(header.magic, BOXART_MAGIC, sizeof(header.magic));
+        header.width = pic.width();
+        header.height = pic.height();
+
+        // CImg keeps planes apart, NanoVG wants interleaved RGBA
+        std::vector<unsigned char> record(sizeof(header) + (size_t)header.width * header.height * 4);
+        memcpy(record.data(), &header, sizeof(header));
+        unsigned char* out = record.data() + sizeof(header);
+        for (int y = 0; y < pic.height(); y++) {
+            for (int x = 0; x < pic.width(); x++) {
+                *out++ = pic(x, y, 0, 0);
+                *out++ = pic(x, y, 0, 1);
+                *out++ = pic(x, y, 0, 2);
+                *out++ = 255;
+            }
+        }
+
+        // Tile covers the part of cover cell shows
+        unsigned char* pixels = record.data() + sizeof(header);
+        int stride = pic.width() * 4;
+        int offset = ((pic.height() - height) / 2) * stride + ((pic.width() - width) / 2) * 4;
+        set_placeholder(id, make_placeholder(pixels + offset, stride, std::min(width, pic.width()),
+                                             std::min(height, pic.height())));
+
+        if (!store(id.host).write(id.app_id, record.data(), record.size(), source_hash)) {
+            remove(source.c_str());
+            return false;
+        }
+    } catch (CImgException& e) {
+        brls::Logger::error("BoxArtManager: Failed to decode {}: {}", id.app_id, e.what());
+        remove(source.c_str());
+        return false;
     }
-    pic.save(path.c_str());
+
+    remove(source.c_str());
+    return true;
 }
 
-std::string BoxArtManager::get_texture_path(int app_id) {
-    return Settings::instance().boxart_dir() + "/" + std::to_string(app_id) +
-           ".png";
+std::string BoxArtManager::make_placeholder(const unsigned char* pixels, int stride, int width, int height) {
+    static const char digits[] = "0123456789abcdef";
+    std::string tile;
+    tile.reserve(BOXART_PLACEHOLDER_WIDTH * BOXART_PLACEHOLDER_HEIGHT * 6);
+
+    for (int ty = 0; ty < BOXART_PLACEHOLDER_HEIGHT; ty++) {
+        int y0 = ty * height / BOXART_PLACEHOLDER_HEIGHT;
+        int y1 = std::max(y0 + 1, (ty + 1) * height / BOXART_PLACEHOLDER_HEIGHT);
+        for (int tx = 0; tx < BOXART_PLACEHOLDER_WIDTH; tx++) {
+            int x0 = tx * width / BOXART_PLACEHOLDER_WIDTH;
+            int x1 = std::max(x0 + 1, (tx + 1) * width / BOXART_PLACEHOLDER_WIDTH);
+
+            uint32_t sum[3] = {0, 0, 0};
+            for (int y = y0; y < y1; y++) {
+                const unsigned char* row = pixels + (size_t)y * stride;
+                for (int x = x0; x < x1; x++) {
+                    for (int c = 0; c < 3; c++)
+                        sum[c] += row[x * 4 + c];
+                }
+            }
+
+            uint32_t count = (uint32_t)((y1 - y0) * (x1 - x0));
+            for (int c = 0; c < 3; c++) {
+                uint32_t value = sum[c] / count;
+                tile += digits[value >> 4];
+                tile += digits[value & 0xF];
+            }
+        }
+    }
+    return tile;
 }
 
-void BoxArtManager::make_texture_from_boxart(NVGcontext* ctx, int app_id) {
-    std::lock_guard<std::mutex> guard(m_mutex);
+std::string BoxArtManager::placeholder(const BoxArtId& id) {
+    std::lock_guard<std::mutex> guard(m_placeholders_mutex);
+    auto found = m_placeholders.find(id);
+    return found != m_placeholders.end() ? found->second : "";
+}
 
-    std::string path = Settings::instance().boxart_dir() + "/" +
-                       std::to_string(app_id) + ".png";
-    Data data = Data::read_from_file(path);
+void BoxArtManager::set_placeholder(const BoxArtId& id, const std::string& tile) {
+    // Cache file could be edited or come from other version
+    if (tile.size() != BOXART_PLACEHOLDER_WIDTH * BOXART_PLACEHOLDER_HEIGHT * 6 ||
+        std::any_of(tile.begin(), tile.end(), [](char c) { return !isxdigit((unsigned char)c); }))
+        return;
 
-    if (data.is_empty()) {
-        m_has_boxart[app_id] = false;
+    std::lock_guard<std::mutex> guard(m_placeholders_mutex);
+    std::string& stored = m_placeholders[id];
+    if (stored == tile)
         return;
+    stored = tile;
+    m_placeholder_generation++;
+}
+
+int BoxArtManager::placeholder_texture(NVGcontext* ctx, const BoxArtId& id) {
+    std::string tile = placeholder(id);
+    auto texture = m_placeholder_textures.find(id);
+    if (texture != m_placeholder_textures.end() && texture->second.tile == tile)
+        return texture->second.handle;
+
+    if (texture != m_placeholder_textures.end()) {
+        nvgDeleteImage(ctx, texture->second.handle);
+        m_placeholder_textures.erase(texture);
+    }
+    if (tile.empty())
+        return -1;
+
+    unsigned char pixels[BOXART_PLACEHOLDER_WIDTH * BOXART_PLACEHOLDER_HEIGHT * 4];
+    for (int i = 0; i < BOXART_PLACEHOLDER_WIDTH * BOXART_PLACEHOLDER_HEIGHT; i++) {
+        for (int c = 0; c < 3; c++)
+            pixels[i * 4 + c] = (unsigned char)std::stoi(tile.substr(i * 6 + c * 2, 2), nullptr, 16);
+        pixels[i * 4 + 3] = 255;
     }
 
-    int handle = nvgCreateImageMem(ctx, 0, data.bytes(), (int)data.size());
+    // Linear filtering blurs tile into a gradient when it's stretched
+    int handle = nvgCreateImageRGBA(ctx, BOXART_PLACEHOLDER_WIDTH, BOXART_PLACEHOLDER_HEIGHT, 0, pixels);
+    if (handle <= 0)
+        return -1;
 
-    if (handle > 0) {
-        m_texture_handle[app_id] = handle;
-    } else {
-        m_has_boxart[app_id] = false;
+    m_placeholder_textures[id] = {handle, tile};
+    return handle;
+}
+
+bool BoxArtManager::read_thumbnail(const BoxArtId& id, Decoded* decoded) {
+    Generator generator = {0, 0, nullptr};
+    {
+        std::lock_guard<std::mutex> guard(m_generators_mutex);
+        auto found = m_generators.find(id.host);
+        if (found != m_generators.end())
+            generator = found->second;
+    }
+    if (generator.fill) {
+        decoded->width = generator.width;
+        decoded->height = generator.height;
+        decoded->pixels.resize((size_t)generator.width * generator.height * 4);
+        generator.fill(id.app_id, generator.width, generator.height, decoded->pixels.data());
+        return true;
     }
+
+    BoxArtStore& thumbnails = store(id.host);
+
+    std::vector<unsigned char> record;
+    if (!thumbnails.read(id.app_id, &record))
+        return false;
+
+    BoxArtHeader header;
+    bool valid = record.size() >= sizeof(header);
+    if (valid) {
+        memcpy(&header, record.data(), sizeof(header));
+        valid = memcmp(header.magic, BOXART_MAGIC, sizeof(header.magic)) == 0 &&
+                header.width > 0 && header.width <= 4096 &&
+                header.height > 0 && header.height <= 4096 &&
+                record.size() == sizeof(header) + (size_t)header.width * header.height * 4;
+    }
+
+    if (!valid) {
+        brls::Logger::error("BoxArtManager: Broken thumbnail {} of {}", id.app_id, id.host);
+        thumbnails.remove(id.app_id);
+        return false;
+    }
+
+    decoded->width = (int)header.width;
+    decoded->height = (int)header.height;
+    decoded->pixels.assign(record.begin() + sizeof(header), record.end());
+    return true;
+}
+
+std::string BoxArtManager::source_path(const BoxArtId& id) {
+    return Settings::instance().boxart_dir() + "/" + id.host + "-" + std::to_string(id.app_id) +
+           ".png";
 }
 
-int BoxArtManager::texture_id(int app_id) {
-    if (m_texture_handle.count(app_id)) {
-        return m_texture_handle[app_id];
+int BoxArtManager::texture(NVGcontext* ctx, const BoxArtId& id) {
+    m_ctx = ctx;
+
+    // Cells show their placeholder, textures wouldn't fit applet heap
+    if (Settings::instance().low_memory())
+        return -1;
+
+    auto texture = m_textures.find(id);
+    if (texture != m_textures.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, texture->second.lru);
+        return texture->second.handle;
     }
+
+    auto preloaded = m_preloaded.find(id);
+    if (preloaded != m_preloaded.end()) {
+        upload(id, preloaded->second);
+        m_preloaded.erase(preloaded);
+        texture = m_textures.find(id);
+        return texture != m_textures.end() ? texture->second.handle : -1;
+    }
+
+    decode(id);
     return -1;
 }
+
+void BoxArtManager::preload(const BoxArtId& id) {
+    if (Settings::instance().low_memory() || m_textures.count(id) || m_preloaded.count(id) || !has_boxart(id))
+        return;
+
+    decode(id);
+}
+
+void BoxArtManager::upload(const BoxArtId& id, const Decoded& decoded) {
+    int handle = nvgCreateImageRGBA(m_ctx, decoded.width, decoded.height,
+                                    0, decoded.pixels.data());
+    if (handle <= 0) {
+        m_has_boxart[id] = false;
+        return;
+    }
+
+    size_t bytes = decoded.pixels.size();
+    size_t budget = (size_t)Settings::instance().boxart_cache_mb() * 1024 * 1024;
+    evict(budget > bytes ? budget - bytes : 0);
+
+    m_lru.push_front(id);
+    m_textures[id] = {handle, bytes, m_lru.begin()};
+    m_texture_bytes += bytes;
+    MemoryAccounting::set(MEM_BOXART_TEXTURES, m_texture_bytes);
+    m_uploads++;
+}
+
+void BoxArtManager::decode(const BoxArtId& id) {
+    if (m_decoding.count(id) || m_processing.count(id))
+        return;
+    m_decoding.insert(id);
+
+    // Thumbnail is stored decoded already, worker only reads it
+    brls::async([this, id] {
+        Decoded decoded = {0, 0, {}};
+        bool success = read_thumbnail(id, &decoded);
+
+        // Uploaded right away, so decoded pixels don't pile up in memory
+        brls::sync([this, id, success, decoded] {
+            m_decoding.erase(id);
+            if (success && !m_ctx)
+                m_preloaded[id] = decoded;
+            else if (success)
+                upload(id, decoded);
+            else
+                m_has_boxart[id] = false;
+        });
+    });
+}
+
+void BoxArtManager::evict(size_t budget) {
+    while (m_texture_bytes > budget && !m_lru.empty()) {
+        BoxArtId id = m_lru.back();
+        m_lru.pop_back();
+
+        Texture& texture = m_textures[id];
+        nvgDeleteImage(m_ctx, texture.handle);
+        m_texture_bytes -= texture.bytes;
+        MemoryAccounting::set(MEM_BOXART_TEXTURES, m_texture_bytes);
+        m_textures.erase(id);
+        m_evictions++;
+    }
+}
+
+void BoxArtManager::release(const BoxArtId& id) {
+    m_preloaded.erase(id);
+
+    auto texture = m_textures.find(id);
+    if (texture == m_textures.end())
+        return;
+
+    nvgDeleteImage(m_ctx, texture->second.handle);
+    m_texture_bytes -= texture->second.bytes;
+    MemoryAccounting::set(MEM_BOXART_TEXTURES, m_texture_bytes);
+    m_lru.erase(texture->second.lru);
+    m_textures.erase(texture);
+}
@@ -1,24 +1,150 @@
 #include "Singleton.hpp"
+#include <atomic>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <cstdio>
+#include <functional>
+#include <set>
 #include <string>
 #include <vector>
 #pragma once
 
+// Cell size in UI points, thumbnails are stored at that size times window
+// scale, up to max scale (300x400, size of Sunshine and GFE box art)
+#define BOXART_WIDTH 150
+#define BOXART_HEIGHT 200
+#define BOXART_MAX_SCALE 2.0f
+// Box art older than this is compared with host again, in background
+#define BOXART_REFRESH_AGE_S (24 * 60 * 60)
+// Placeholder tile, box art colors averaged over a grid of cell aspect,
+// drawn stretched until texture is ready
+#define BOXART_PLACEHOLDER_WIDTH 3
+#define BOXART_PLACEHOLDER_HEIGHT 4
+
 struct NVGcontext;
 struct Data;
+struct Host;
+class BoxArtStore;
+
+// Fills width * height RGBA pixels of app's box art, on worker thread
+using BoxArtGenerator = std::function<void(int app_id, int width, int height, unsigned char* pixels)>;
+
+// Box art of one app on one host, app ids are only unique per host
+struct BoxArtId {
+    std::string host;
+    int app_id;
+
+    bool operator<(const BoxArtId& other) const {
+        return app_id != other.app_id ? app_id < other.app_id : host < other.host;
+    }
+};
 
 class BoxArtManager : public Singleton<BoxArtManager> {
   public:
-    bool has_boxart(int app_id);
+    ~BoxArtManager();
+
+    // MAC stays the same when host gets another address
+    static std::string host_id(const Host& host);
+
+    bool has_boxart(const BoxArtId& id);
+    // Shown box art is due to be compared with host, once per session
+    bool needs_refresh(const BoxArtId& id);
+
+    // Hashing, resizing and conversion to raw thumbnail run on worker
+    // thread. Image which hash matches stored one only renews its time
+    void set_data(Data data, const BoxArtId& id);
 
-    void set_data(Data data, int app_id);
-    static std::string get_texture_path(int app_id);
-    void make_texture_from_boxart(NVGcontext* ctx, int app_id);
-    int texture_id(int app_id);
+    // Main thread only. Returns texture of visible box art or -1 while it's
+    // decoded in background, least recently shown ones are freed when
+    // textures take more than box art memory budget
+    int texture(NVGcontext* ctx, const BoxArtId& id);
+    // Reads stored thumbnail ahead of first draw, before UI has drawn
+    // anything decoded pixels wait for texture() to upload them
+    void preload(const BoxArtId& id);
+
+    // Tile as hex RGB, made with thumbnail and kept in app list cache of
+    // host, so cold start shows it without reading box art. Any thread
+    [[nodiscard]] std::string placeholder(const BoxArtId& id);
+    void set_placeholder(const BoxArtId& id, const std::string& tile);
+    // Changes whenever a tile is made, cache is saved again then
+    [[nodiscard]] uint32_t placeholder_generation() const { return m_placeholder_generation; }
+    // Main thread only. Texture of tile or -1, tiles take a few bytes
+    // each, so they stay out of box art budget
+    int placeholder_texture(NVGcontext* ctx, const BoxArtId& id);
+
+    // Every app of host has box art made by generator instead of stored
+    // one, so benchmarks get real decode and upload path without files
+    void set_generator(const std::string& host, BoxArtGenerator generator);
+    // Also frees textures of host
+    void clear_generator(const std::string& host);
+
+    // Since start, for benchmarks
+    [[nodiscard]] uint64_t uploads() const { return m_uploads; }
+    [[nodiscard]] uint64_t evictions() const { return m_evictions; }
+    [[nodiscard]] size_t texture_bytes() const { return m_texture_bytes; }
 
   private:
-    std::map<int, bool> m_has_boxart;
-    std::map<int, int> m_texture_handle;
-    static void compress_texture(const std::string& path);
+    struct Decoded {
+        int width;
+        int height;
+        std::vector<unsigned char> pixels;
+    };
+
+    struct Generator {
+        int width;
+        int height;
+        BoxArtGenerator fill;
+    };
+
+    struct Texture {
+        int handle;
+        size_t bytes;
+        std::list<BoxArtId>::iterator lru;
+    };
+
+    struct PlaceholderTexture {
+        int handle;
+        std::string tile;
+    };
+
+    // Thumbnails of every host are packed in a file of its own
+    BoxArtStore& store(const std::string& host);
+    static std::string source_path(const BoxArtId& id);
+    // JPEG goes to JpegDecoder, anything else to CImg through source file
+    bool make_thumbnail(const BoxArtId& id, const Data& data, int width, int height, uint32_t source_hash);
+    static std::string make_placeholder(const unsigned char* pixels, int stride, int width, int height);
+    bool read_thumbnail(const BoxArtId& id, Decoded* decoded);
+    bool generated(const std::string& host);
+    std::mutex& file_mutex(const BoxArtId& id);
+    void decode(const BoxArtId& id);
+    void upload(const BoxArtId& id, const Decoded& decoded);
+    void evict(size_t budget);
+    void release(const BoxArtId& id);
+
+    std::map<BoxArtId, bool> m_has_boxart;
+    std::map<BoxArtId, Texture> m_textures;
+    // Front is most recently shown
+    std::list<BoxArtId> m_lru;
+    size_t m_texture_bytes = 0;
+    uint64_t m_uploads = 0;
+    uint64_t m_evictions = 0;
+    std::set<BoxArtId> m_decoding;
+    std::map<BoxArtId, Decoded> m_preloaded;
+    std::set<BoxArtId> m_processing;
+    std::set<BoxArtId> m_refreshed;
+    // Source image of single app is touched by one worker at a time
+    std::mutex m_file_mutexes_mutex;
+    std::map<BoxArtId, std::mutex> m_file_mutexes;
+    std::mutex m_stores_mutex;
+    std::map<std::string, std::unique_ptr<BoxArtStore>> m_stores;
+    // Read by decode workers as well
+    std::mutex m_generators_mutex;
+    std::map<std::string, Generator> m_generators;
+    std::mutex m_placeholders_mutex;
+    std::map<BoxArtId, std::string> m_placeholders;
+    std::atomic<uint32_t> m_placeholder_generation = 0;
+    std::map<BoxArtId, PlaceholderTexture> m_placeholder_textures;
+    NVGcontext* m_ctx = nullptr;
 };
@@ -0,0 +1,280 @@
+//
+//  BoxArtStore.cpp
+//  Moonlight
+//
+
+#include "BoxArtStore.hpp"
+#include <borealis.hpp>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+
+struct BoxArtRecord {
+    char magic[4];
+    int32_t app_id;
+    uint32_t size;
+    uint32_t hash;
+    uint32_t source_hash;
+    uint32_t checked;
+};
+
+static const char RECORD_MAGIC[4] = {'M', 'L', 'B', '2'};
+static const char STAMP_MAGIC[4] = {'M', 'L', 'B', 'S'};
+
+// FNV-1a, catches records torn by power loss or a bad SD card
+uint32_t BoxArtStore::hash(const unsigned char* data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+BoxArtStore::BoxArtStore(const std::string& path) : m_path(path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    open();
+}
+
+BoxArtStore::~BoxArtStore() {
+    if (m_file)
+        fclose(m_file);
+}
+
+void BoxArtStore::open() {
+    m_entries.clear();
+    m_lru.clear();
+    m_end = 0;
+    m_live_bytes = 0;
+    m_dead_bytes = 0;
+
+    m_file = fopen(m_path.c_str(), "r+b");
+    if (!m_file)
+        m_file = fopen(m_path.c_str(), "w+b");
+    if (!m_file) {
+        brls::Logger::error("BoxArtStore: Failed to open {}", m_path);
+        return;
+    }
+
+    // Records are appended in use order, so file order is LRU order too
+    BoxArtRecord record;
+    while (fseek(m_file, (long)m_end, SEEK_SET) == 0 &&
+           fread(&record, sizeof(record), 1, m_file) == 1) {
+        if (memcmp(record.magic, STAMP_MAGIC, sizeof(record.magic)) == 0) {
+            auto entry = m_entries.find(record.app_id);
+            if (entry != m_entries.end())
+                entry->second.info.checked = record.checked;
+            m_dead_bytes += sizeof(record);
+            m_end += sizeof(record);
+            continue;
+        }
+
+        if (memcmp(record.magic, RECORD_MAGIC, sizeof(record.magic)) != 0)
+            break;
+
+        uint64_t payload = m_end + sizeof(record);
+        if (record.size && fseek(m_file, (long)(payload + record.size - 1), SEEK_SET) != 0)
+            break;
+        if (record.size && fgetc(m_file) == EOF)
+            break;
+
+        forget(record.app_id);
+        if (record.size) {
+            m_lru.push_front(record.app_id);
+            m_entries[record.app_id] = {payload, record.size, record.hash,
+                                        {record.source_hash, record.checked}, m_lru.begin()};
+            m_live_bytes += record.size;
+        }
+        m_dead_bytes += sizeof(record);
+        m_end = payload + record.size;
+    }
+
+    // Record torn by crash while appending is cut off
+    fseek(m_file, 0, SEEK_END);
+    if ((uint64_t)ftell(m_file) > m_end) {
+        fflush(m_file);
+        if (ftruncate(fileno(m_file), (off_t)m_end) != 0)
+            brls::Logger::warning("BoxArtStore: Failed to cut broken tail of {}", m_path);
+    }
+
+    brls::Logger::info("BoxArtStore: {} thumbnails, {} KB in {}", m_entries.size(),
+                       m_live_bytes / 1024, m_path);
+}
+
+bool BoxArtStore::contains(int app_id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.count(app_id) > 0;
+}
+
+bool BoxArtStore::info(int app_id, BoxArtInfo* info) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto entry = m_entries.find(app_id);
+    if (entry == m_entries.end())
+        return false;
+
+    *info = entry->second.info;
+    return true;
+}
+
+bool BoxArtStore::read(int app_id, std::vector<unsigned char>* data) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto entry = m_entries.find(app_id);
+    if (!m_file || entry == m_entries.end())
+        return false;
+
+    data->resize(entry->second.size);
+    bool valid = fseek(m_file, (long)entry->second.offset, SEEK_SET) == 0 &&
+                 fread(data->data(), data->size(), 1, m_file) == 1 &&
+                 hash(data->data(), data->size()) == entry->second.hash;
+
+    if (!valid) {
+        brls::Logger::error("BoxArtStore: Broken record of {} in {}", app_id, m_path);
+        append(RECORD_MAGIC, app_id, nullptr, 0, 0, {0, 0});
+        data->clear();
+        return false;
+    }
+
+    m_lru.splice(m_lru.begin(), m_lru, entry->second.lru);
+    return true;
+}
+
+bool BoxArtStore::write(int app_id, const unsigned char* data, size_t size, uint32_t source_hash) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!size || size > (size_t)BOXART_STORE_MAX_MB * 1024 * 1024)
+        return false;
+
+    BoxArtInfo info = {source_hash, (uint32_t)time(nullptr)};
+    if (!append(RECORD_MAGIC, app_id, data, (uint32_t)size, hash(data, size), info))
+        return false;
+
+    evict();
+    if (m_dead_bytes > m_live_bytes && m_dead_bytes > (uint64_t)BOXART_STORE_COMPACT_MIN_MB * 1024 * 1024)
+        compact();
+    return true;
+}
+
+void BoxArtStore::stamp(int app_id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto entry = m_entries.find(app_id);
+    if (entry == m_entries.end())
+        return;
+
+    BoxArtInfo info = entry->second.info;
+    info.checked = (uint32_t)time(nullptr);
+    append(STAMP_MAGIC, app_id, nullptr, 0, 0, info);
+}
+
+void BoxArtStore::remove(int app_id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_entries.count(app_id))
+        append(RECORD_MAGIC, app_id, nullptr, 0, 0, {0, 0});
+}
+
+bool BoxArtStore::append(const char* magic, int app_id, const unsigned char* data, uint32_t size,
+                         uint32_t hash, BoxArtInfo info) {
+    if (!m_file)
+        return false;
+
+    BoxArtRecord record;
+    memcpy(record.magic, magic, sizeof(record.magic));
+    record.app_id = app_id;
+    record.size = size;
+    record.hash = hash;
+    record.source_hash = info.source_hash;
+    record.checked = info.checked;
+
+    bool written = fseek(m_file, (long)m_end, SEEK_SET) == 0 &&
+                   fwrite(&record, sizeof(record), 1, m_file) == 1 &&
+                   (!size || fwrite(data, size, 1, m_file) == 1) &&
+                   fflush(m_file) == 0;
+
+    if (!written) {
+        brls::Logger::error("BoxArtStore: Failed to write {}", m_path);
+        // Half written record is cut off on next open
+        return false;
+    }
+
+    m_dead_bytes += sizeof(record);
+    m_end += sizeof(record) + size;
+
+    if (memcmp(magic, STAMP_MAGIC, sizeof(record.magic)) == 0) {
+        m_entries[app_id].info = info;
+        return true;
+    }
+
+    forget(app_id);
+    if (size) {
+        m_lru.push_front(app_id);
+        m_entries[app_id] = {m_end - size, size, hash, info, m_lru.begin()};
+        m_live_bytes += size;
+    }
+    return true;
+}
+
+void BoxArtStore::forget(int app_id) {
+    auto entry = m_entries.find(app_id);
+    if (entry == m_entries.end())
+        return;
+
+    m_live_bytes -= entry->second.size;
+    m_dead_bytes += entry->second.size;
+    m_lru.erase(entry->second.lru);
+    m_entries.erase(entry);
+}
+
+void BoxArtStore::evict() {
+    uint64_t limit = (uint64_t)BOXART_STORE_MAX_MB * 1024 * 1024;
+    while (m_live_bytes > limit && m_lru.size() > 1) {
+        int app_id = m_lru.back();
+        if (!append(RECORD_MAGIC, app_id, nullptr, 0, 0, {0, 0}))
+            forget(app_id);
+    }
+}
+
+void BoxArtStore::compact() {
+    std::string temp = m_path + ".tmp";
+    FILE* file = fopen(temp.c_str(), "wb");
+    if (!file) {
+        brls::Logger::error("BoxArtStore: Failed to open {}", temp);
+        return;
+    }
+
+    // Oldest first, so order of records keeps telling recency
+    bool written = true;
+    std::vector<unsigned char> payload;
+    for (auto app_id = m_lru.rbegin(); written && app_id != m_lru.rend(); ++app_id) {
+        const Entry& entry = m_entries[*app_id];
+        payload.resize(entry.size);
+
+        BoxArtRecord record;
+        memcpy(record.magic, RECORD_MAGIC, sizeof(record.magic));
+        record.app_id = *app_id;
+        record.size = entry.size;
+        record.hash = entry.hash;
+        record.source_hash = entry.info.source_hash;
+        record.checked = entry.info.checked;
+
+        written = fseek(m_file, (long)entry.offset, SEEK_SET) == 0 &&
+                  fread(payload.data(), payload.size(), 1, m_file) == 1 &&
+                  fwrite(&record, sizeof(record), 1, file) == 1 &&
+                  fwrite(payload.data(), payload.size(), 1, file) == 1;
+    }
+    written = fclose(file) == 0 && written;
+
+    if (!written) {
+        brls::Logger::error("BoxArtStore: Failed to compact {}", m_path);
+        ::remove(temp.c_str());
+        return;
+    }
+
+    // Switch can't rename over an open or existing file. Store is only a
+    // cache, crash in between loses box art which is downloaded again
+    fclose(m_file);
+    m_file = nullptr;
+    ::remove(m_path.c_str());
+    if (rename(temp.c_str(), m_path.c_str()) != 0)
+        brls::Logger::error("BoxArtStore: Failed to replace {}", m_path);
+    open();
+}
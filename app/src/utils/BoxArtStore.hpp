@@ -0,0 +1,76 @@
+//
+//  BoxArtStore.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Live thumbnails kept per host, least recently used ones go first
+#define BOXART_STORE_MAX_MB 256
+// Superseded records are copied out once they take more than live ones
+// and at least this much
+#define BOXART_STORE_COMPACT_MIN_MB 16
+
+// Append-only pack of box art thumbnails of one host. Every record has
+// a header with app id, size and hash of its payload, hash of image it
+// was made from and when that was last compared with host. The last
+// record of an app wins, empty one removes it, stamp only renews time. Headers are read once on open,
+// so lookups need no file access and reads take a single seek on one
+// open handle, instead of a file per app on FAT32 SD card.
+// Safe to use from several threads
+struct BoxArtInfo {
+    uint32_t source_hash;
+    // Unix time
+    uint32_t checked;
+};
+
+class BoxArtStore {
+  public:
+    explicit BoxArtStore(const std::string& path);
+    ~BoxArtStore();
+
+    bool contains(int app_id);
+    bool info(int app_id, BoxArtInfo* info);
+    // Fails and forgets app when record doesn't match its hash
+    bool read(int app_id, std::vector<unsigned char>* data);
+    bool write(int app_id, const unsigned char* data, size_t size, uint32_t source_hash);
+    // Source turned out unchanged, renews checked time only
+    void stamp(int app_id);
+    void remove(int app_id);
+
+    static uint32_t hash(const unsigned char* data, size_t size);
+
+  private:
+    struct Entry {
+        uint64_t offset;
+        uint32_t size;
+        uint32_t hash;
+        BoxArtInfo info;
+        std::list<int>::iterator lru;
+    };
+
+    void open();
+    bool append(const char* magic, int app_id, const unsigned char* data, uint32_t size,
+                uint32_t hash, BoxArtInfo info);
+    void forget(int app_id);
+    void evict();
+    void compact();
+
+    std::string m_path;
+    FILE* m_file = nullptr;
+    uint64_t m_end = 0;
+    uint64_t m_live_bytes = 0;
+    uint64_t m_dead_bytes = 0;
+    std::map<int, Entry> m_entries;
+    // Front is most recently used, compaction writes it last
+    std::list<int> m_lru;
+    std::mutex m_mutex;
+};
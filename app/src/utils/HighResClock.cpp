@@ -0,0 +1,21 @@
+//
+//  HighResClock.cpp
+//  Moonlight
+//
+
+#include "HighResClock.hpp"
+
+#ifdef __SWITCH__
+#include <switch.h>
+#else
+#include <chrono>
+#endif
+
+uint64_t HighResClock::now_ns() {
+#ifdef __SWITCH__
+    return armTicksToNs(armGetSystemTick());
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
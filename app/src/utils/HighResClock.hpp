@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+// Monotonic clock for stats and tracing, LiGetMillis() is too coarse
+// to measure sub-millisecond decode and render times
+class HighResClock {
+  public:
+    static uint64_t now_ns();
+
+    static uint64_t now_us() { return now_ns() / 1000; }
+};
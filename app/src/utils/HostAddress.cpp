@@ -0,0 +1,181 @@
+//
+//  HostAddress.cpp
+//  Moonlight
+//
+
+#include "HostAddress.hpp"
+#include "HighResClock.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+HostAddress HostAddress::parse(const std::string& address, unsigned short default_port) {
+    HostAddress result;
+    result.port = default_port;
+    std::string port;
+
+    if (!address.empty() && address[0] == '[') {
+        size_t close = address.find(']');
+        result.host = address.substr(1, close == std::string::npos ? std::string::npos : close - 1);
+        if (close != std::string::npos && close + 1 < address.size() && address[close + 1] == ':')
+            port = address.substr(close + 2);
+    } else if (std::count(address.begin(), address.end(), ':') == 1) {
+        size_t separator = address.find(':');
+        result.host = address.substr(0, separator);
+        port = address.substr(separator + 1);
+    } else {
+        result.host = address;
+    }
+
+    int value = atoi(port.c_str());
+    if (value > 0 && value <= 0xFFFF)
+        result.port = (unsigned short)value;
+    return result;
+}
+
+std::string HostAddress::url_host() const { return is_ipv6() ? "[" + host + "]" : host; }
+
+int HostAddress::to_sockaddr(struct sockaddr_storage* addr) const {
+    memset(addr, 0, sizeof(*addr));
+
+    auto* ipv4 = (struct sockaddr_in*)addr;
+    if (inet_pton(AF_INET, host.c_str(), &ipv4->sin_addr) == 1) {
+        ipv4->sin_family = AF_INET;
+        ipv4->sin_port = htons(port);
+        return sizeof(struct sockaddr_in);
+    }
+
+    auto* ipv6 = (struct sockaddr_in6*)addr;
+    if (inet_pton(AF_INET6, host.c_str(), &ipv6->sin6_addr) == 1) {
+        ipv6->sin6_family = AF_INET6;
+        ipv6->sin6_port = htons(port);
+        return sizeof(struct sockaddr_in6);
+    }
+    return 0;
+}
+
+std::vector<HostAddress> HostAddress::resolve() const {
+    struct sockaddr_storage literal;
+    if (to_sockaddr(&literal))
+        return {*this};
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* info = nullptr;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &info) != 0)
+        return {};
+
+    std::vector<HostAddress> families[2];
+    int first_family = info ? info->ai_family : AF_INET;
+    for (struct addrinfo* it = info; it; it = it->ai_next) {
+        char buffer[INET6_ADDRSTRLEN];
+        const void* src = it->ai_family == AF_INET6 ? (const void*)&((struct sockaddr_in6*)it->ai_addr)->sin6_addr
+                                                    : (const void*)&((struct sockaddr_in*)it->ai_addr)->sin_addr;
+        if ((it->ai_family != AF_INET && it->ai_family != AF_INET6) ||
+            !inet_ntop(it->ai_family, src, buffer, sizeof(buffer)))
+            continue;
+
+        auto& list = families[it->ai_family == first_family ? 0 : 1];
+        bool known = std::any_of(list.begin(), list.end(),
+                                 [&buffer](const HostAddress& address) { return address.host == buffer; });
+        if (!known)
+            list.push_back({buffer, port});
+    }
+    freeaddrinfo(info);
+
+    std::vector<HostAddress> result;
+    for (size_t i = 0; i < std::max(families[0].size(), families[1].size()); i++) {
+        for (auto& list : families) {
+            if (i < list.size())
+                result.push_back(list[i]);
+        }
+    }
+    return result;
+}
+
+int host_connect_race(const std::vector<HostAddress>& addresses, int timeout_ms, float* rtt_ms) {
+    std::vector<struct pollfd> fds;
+    std::vector<size_t> indexes;
+    std::vector<uint64_t> started;
+    size_t pending = 0;
+    size_t next = 0;
+    int winner = -1;
+
+    uint64_t now = HighResClock::now_us();
+    uint64_t deadline = now + (uint64_t)timeout_ms * 1000;
+    uint64_t next_attempt = now;
+
+    while (winner < 0 && now < deadline) {
+        if (next < addresses.size() && (now >= next_attempt || pending == 0)) {
+            size_t index = next++;
+            next_attempt = now + HOST_CONNECT_ATTEMPT_DELAY_MS * 1000;
+
+            struct sockaddr_storage addr;
+            int length = addresses[index].to_sockaddr(&addr);
+            int fd = length ? socket(addr.ss_family, SOCK_STREAM, 0) : -1;
+            if (fd < 0)
+                continue;
+
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            if (connect(fd, (struct sockaddr*)&addr, (socklen_t)length) == 0) {
+                close(fd);
+                winner = (int)index;
+                if (rtt_ms)
+                    *rtt_ms = (float)(HighResClock::now_us() - now) / 1000.0f;
+                break;
+            } else if (errno != EINPROGRESS) {
+                close(fd);
+                continue;
+            }
+
+            fds.push_back({fd, POLLOUT, 0});
+            indexes.push_back(index);
+            started.push_back(now);
+            pending++;
+            continue;
+        }
+
+        if (pending == 0)
+            break;
+
+        uint64_t wake = next < addresses.size() ? std::min(deadline, next_attempt) : deadline;
+        int wait_ms = (int)((wake - now + 999) / 1000);
+        if (poll(fds.data(), fds.size(), wait_ms) > 0) {
+            for (size_t i = 0; i < fds.size(); i++) {
+                if (fds[i].fd < 0 || !fds[i].revents)
+                    continue;
+
+                int error = 0;
+                socklen_t length = sizeof(error);
+                getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &error, &length);
+                if (error == 0 && (fds[i].revents & POLLOUT) && winner < 0) {
+                    winner = (int)indexes[i];
+                    if (rtt_ms)
+                        *rtt_ms = (float)(HighResClock::now_us() - started[i]) / 1000.0f;
+                }
+
+                close(fds[i].fd);
+                // Negative descriptors are ignored by poll
+                fds[i].fd = -1;
+                pending--;
+            }
+        }
+        now = HighResClock::now_us();
+    }
+
+    for (auto& fd : fds) {
+        if (fd.fd >= 0)
+            close(fd.fd);
+    }
+    return winner;
+}
@@ -0,0 +1,41 @@
+//
+//  HostAddress.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct sockaddr_storage;
+
+// Connect attempt to next address starts after this, unless the running
+// ones failed sooner, as RFC 8305 recommends
+#define HOST_CONNECT_ATTEMPT_DELAY_MS 250
+
+// Host and port of saved address. IPv6 literal has to be in brackets when
+// port follows it, "[fd00::2]:47989", bare one is taken whole
+struct HostAddress {
+    std::string host;
+    unsigned short port = 0;
+
+    static HostAddress parse(const std::string& address, unsigned short default_port);
+
+    [[nodiscard]] bool is_ipv6() const { return host.find(':') != std::string::npos; }
+    // Host as it goes into URL, IPv6 literal in brackets
+    [[nodiscard]] std::string url_host() const;
+    // Literals only, names would need resolving which could block.
+    // Returns length of filled address, 0 when host isn't a literal
+    int to_sockaddr(struct sockaddr_storage* addr) const;
+
+    // Literal addresses of name, families alternate starting with first
+    // one resolver returned. Blocks, literal host is returned as it is
+    [[nodiscard]] std::vector<HostAddress> resolve() const;
+};
+
+// Happy eyeballs: connect attempts start one by one with the delay above
+// and keep running side by side, first one connected wins. Returns its
+// index or -1, rtt_ms gets connect time of winner
+int host_connect_race(const std::vector<HostAddress>& addresses, int timeout_ms,
+                      float* rtt_ms = nullptr);
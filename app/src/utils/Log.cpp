@@ -0,0 +1,40 @@
+//
+//  Log.cpp
+//  Moonlight
+//
+
+#include "Log.hpp"
+#include "HighResClock.hpp"
+
+std::atomic<int> Log::s_levels[LOG_CATEGORY_COUNT] = {LOG_MIN_LEVEL, LOG_MIN_LEVEL, LOG_MIN_LEVEL,
+                                                        LOG_MIN_LEVEL, LOG_MIN_LEVEL};
+
+const char* Log::name(LogCategory category) {
+    switch (category) {
+        case LOG_NET:
+            return "net";
+        case LOG_DECODE:
+            return "decode";
+        case LOG_RENDER:
+            return "render";
+        case LOG_AUDIO:
+            return "audio";
+        case LOG_INPUT:
+            return "input";
+        default:
+            return "";
+    }
+}
+
+bool LogRateLimit::allow(uint32_t& suppressed) {
+    uint64_t now = HighResClock::now_us();
+    uint64_t next = m_next_us.load(std::memory_order_relaxed);
+    if (now < next || !m_next_us.compare_exchange_strong(next, now + LOG_RATE_LIMIT_US,
+                                                         std::memory_order_relaxed)) {
+        m_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,93 @@
+//
+//  Log.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <borealis/core/logger.hpp>
+#include <atomic>
+#include <cstdint>
+
+// Same order as brls::LogLevel
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARNING 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+// Calls above this level are compiled out with their arguments,
+// set by CMake from build type
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// Repeated messages of one call site go out at most this often
+#define LOG_RATE_LIMIT_US 1000000
+
+enum LogCategory : uint8_t {
+    LOG_NET,
+    LOG_DECODE,
+    LOG_RENDER,
+    LOG_AUDIO,
+    LOG_INPUT,
+    LOG_CATEGORY_COUNT,
+};
+
+// Runtime level of streaming subsystems, on top of LOG_MIN_LEVEL.
+// Check is a relaxed load, message isn't formatted when it fails
+class Log {
+  public:
+    [[nodiscard]] static bool enabled(LogCategory category, int level) {
+        return level <= s_levels[category].load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] static int level(LogCategory category) { return s_levels[category].load(); }
+    static void set_level(LogCategory category, int level) { s_levels[category] = level; }
+
+    [[nodiscard]] static const char* name(LogCategory category);
+
+  private:
+    static std::atomic<int> s_levels[LOG_CATEGORY_COUNT];
+};
+
+// State of one call site, shared by threads that hit it
+class LogRateLimit {
+  public:
+    // True when message may go out, suppressed gets count of ones
+    // dropped since last message
+    bool allow(uint32_t& suppressed);
+
+  private:
+    std::atomic<uint64_t> m_next_us = 0;
+    std::atomic<uint32_t> m_suppressed = 0;
+};
+
+#define CLOG_AT(level, function, category, ...)                                                 \
+    do {                                                                                        \
+        if constexpr ((level) <= LOG_MIN_LEVEL) {                                              \
+            if (Log::enabled(category, level))                                                 \
+                brls::Logger::function(__VA_ARGS__);                                           \
+        }                                                                                       \
+    } while (0)
+
+#define CLOG_LIMITED_AT(level, function, category, ...)                                         \
+    do {                                                                                        \
+        if constexpr ((level) <= LOG_MIN_LEVEL) {                                              \
+            static LogRateLimit log_rate_limit;                                                 \
+            uint32_t log_suppressed = 0;                                                        \
+            if (Log::enabled(category, level) && log_rate_limit.allow(log_suppressed)) {       \
+                brls::Logger::function(__VA_ARGS__);                                           \
+                if (log_suppressed)                                                             \
+                    brls::Logger::function("Log: {} more like above", log_suppressed);         \
+            }                                                                                   \
+        }                                                                                       \
+    } while (0)
+
+#define CLOG_ERROR(category, ...) CLOG_AT(LOG_LEVEL_ERROR, error, category, __VA_ARGS__)
+#define CLOG_WARNING(category, ...) CLOG_AT(LOG_LEVEL_WARNING, warning, category, __VA_ARGS__)
+#define CLOG_INFO(category, ...) CLOG_AT(LOG_LEVEL_INFO, info, category, __VA_ARGS__)
+#define CLOG_DEBUG(category, ...) CLOG_AT(LOG_LEVEL_DEBUG, debug, category, __VA_ARGS__)
+
+// For per-frame and per-packet paths, a burst costs one message a second
+#define CLOG_ERROR_LIMITED(category, ...) CLOG_LIMITED_AT(LOG_LEVEL_ERROR, error, category, __VA_ARGS__)
+#define CLOG_WARNING_LIMITED(category, ...) CLOG_LIMITED_AT(LOG_LEVEL_WARNING, warning, category, __VA_ARGS__)
@@ -0,0 +1,87 @@
+//
+//  LogHistogram.cpp
+//  Moonlight
+//
+
+#include "LogHistogram.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+// Power of two of the first bucket past linear ones
+#define LOG_HISTOGRAM_MIN_POWER 4
+#define LOG_HISTOGRAM_SUB_BITS 3
+
+static_assert(LOG_HISTOGRAM_LINEAR == 1 << LOG_HISTOGRAM_MIN_POWER, "Linear buckets end at first power");
+static_assert(LOG_HISTOGRAM_SUB_BUCKETS == 1 << LOG_HISTOGRAM_SUB_BITS, "Sub buckets are power of two");
+
+int LogHistogram::bucket(uint64_t value_us) {
+    if (value_us < LOG_HISTOGRAM_LINEAR)
+        return (int)value_us;
+
+    int power = std::bit_width(value_us) - 1;
+    if (power >= LOG_HISTOGRAM_MAX_POWER)
+        return LOG_HISTOGRAM_BUCKETS - 1;
+
+    // Bits right under the leading one pick the sub bucket
+    int sub = (int)(value_us >> (power - LOG_HISTOGRAM_SUB_BITS)) & (LOG_HISTOGRAM_SUB_BUCKETS - 1);
+    return LOG_HISTOGRAM_LINEAR + (power - LOG_HISTOGRAM_MIN_POWER) * LOG_HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+uint64_t LogHistogram::bucket_middle_us(int index) {
+    if (index < LOG_HISTOGRAM_LINEAR)
+        return index;
+
+    int power = LOG_HISTOGRAM_MIN_POWER + (index - LOG_HISTOGRAM_LINEAR) / LOG_HISTOGRAM_SUB_BUCKETS;
+    int sub = (index - LOG_HISTOGRAM_LINEAR) % LOG_HISTOGRAM_SUB_BUCKETS;
+    uint64_t width = 1ULL << (power - LOG_HISTOGRAM_SUB_BITS);
+    return (LOG_HISTOGRAM_SUB_BUCKETS + sub) * width + width / 2;
+}
+
+void LogHistogram::record(uint64_t value_us) {
+    m_buckets[bucket(value_us)].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = m_max_us.load(std::memory_order_relaxed);
+    while (value_us > max && !m_max_us.compare_exchange_weak(max, value_us, std::memory_order_relaxed)) {
+    }
+}
+
+void LogHistogram::reset() {
+    for (auto& bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    m_max_us.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LogHistogram::count() const {
+    uint64_t count = 0;
+    for (auto& bucket : m_buckets)
+        count += bucket.load(std::memory_order_relaxed);
+    return count;
+}
+
+float LogHistogram::max_ms() const {
+    return (float)m_max_us.load(std::memory_order_relaxed) / 1000.0f;
+}
+
+float LogHistogram::percentile_ms(float share) const {
+    uint32_t counts[LOG_HISTOGRAM_BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < LOG_HISTOGRAM_BUCKETS; i++) {
+        counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(share * (double)total));
+    uint64_t seen = 0;
+    for (int i = 0; i < LOG_HISTOGRAM_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            // Middle of the top bucket can be past the largest value
+            uint64_t value = std::min(bucket_middle_us(i), m_max_us.load(std::memory_order_relaxed));
+            return (float)value / 1000.0f;
+        }
+    }
+    return max_ms();
+}
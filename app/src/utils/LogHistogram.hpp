@@ -0,0 +1,39 @@
+//
+//  LogHistogram.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Values below this many microseconds have a bucket each
+#define LOG_HISTOGRAM_LINEAR 16
+// Buckets per power of two above, bucket middle is within 1/16 of value
+#define LOG_HISTOGRAM_SUB_BUCKETS 8
+// Values from 2^24 us, about 16 s, share the last bucket
+#define LOG_HISTOGRAM_MAX_POWER 24
+#define LOG_HISTOGRAM_BUCKETS (LOG_HISTOGRAM_LINEAR + (LOG_HISTOGRAM_MAX_POWER - 4) * LOG_HISTOGRAM_SUB_BUCKETS)
+
+// Distribution of times in fixed buckets of log scale, so percentiles
+// of hours long run cost the same memory as of a minute. Buckets are
+// relaxed atomics, any thread records and any reads without locks,
+// reader racing a writer is off by the values being recorded
+class LogHistogram {
+  public:
+    void record(uint64_t value_us);
+    void reset();
+
+    [[nodiscard]] uint64_t count() const;
+    [[nodiscard]] float max_ms() const;
+    // Middle of bucket holding given share of values, 0 while empty
+    [[nodiscard]] float percentile_ms(float share) const;
+
+  private:
+    static int bucket(uint64_t value_us);
+    static uint64_t bucket_middle_us(int index);
+
+    std::atomic<uint32_t> m_buckets[LOG_HISTOGRAM_BUCKETS] = {};
+    std::atomic<uint64_t> m_max_us = 0;
+};
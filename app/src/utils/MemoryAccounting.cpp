@@ -0,0 +1,45 @@
+//
+//  MemoryAccounting.cpp
+//  Moonlight
+//
+
+#include "MemoryAccounting.hpp"
+#include <atomic>
+#include <cstdint>
+
+static std::atomic<int64_t> current_bytes[MEM_TAG_COUNT];
+static std::atomic<int64_t> peak_bytes[MEM_TAG_COUNT];
+
+static const char* tag_names[MEM_TAG_COUNT] = {"decoder_surfaces", "packet_buffers", "data",
+                                               "http",             "boxart_textures", "audio"};
+
+static void update_peak(MemoryTag tag, int64_t value) {
+    int64_t peak = peak_bytes[tag].load(std::memory_order_relaxed);
+    while (value > peak && !peak_bytes[tag].compare_exchange_weak(peak, value, std::memory_order_relaxed)) {
+    }
+}
+
+void MemoryAccounting::add(MemoryTag tag, size_t bytes) {
+    int64_t value = current_bytes[tag].fetch_add((int64_t)bytes, std::memory_order_relaxed) + (int64_t)bytes;
+    update_peak(tag, value);
+}
+
+void MemoryAccounting::remove(MemoryTag tag, size_t bytes) {
+    current_bytes[tag].fetch_sub((int64_t)bytes, std::memory_order_relaxed);
+}
+
+void MemoryAccounting::set(MemoryTag tag, size_t bytes) {
+    current_bytes[tag].store((int64_t)bytes, std::memory_order_relaxed);
+    update_peak(tag, (int64_t)bytes);
+}
+
+size_t MemoryAccounting::current(MemoryTag tag) {
+    int64_t value = current_bytes[tag].load(std::memory_order_relaxed);
+    return value > 0 ? (size_t)value : 0;
+}
+
+size_t MemoryAccounting::peak(MemoryTag tag) {
+    return (size_t)peak_bytes[tag].load(std::memory_order_relaxed);
+}
+
+const char* MemoryAccounting::name(MemoryTag tag) { return tag_names[tag]; }
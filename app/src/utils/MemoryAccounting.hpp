@@ -0,0 +1,36 @@
+//
+//  MemoryAccounting.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <cstddef>
+
+// Subsystems whose big buffers are accounted, small allocations aren't
+enum MemoryTag : int {
+    MEM_DECODER_SURFACES,
+    MEM_PACKET_BUFFERS,
+    MEM_DATA,
+    MEM_HTTP,
+    MEM_BOXART_TEXTURES,
+    MEM_AUDIO,
+    MEM_TAG_COUNT
+};
+
+// Current and peak bytes per subsystem, registered by code which owns
+// the buffers. Counters are relaxed atomics, so any thread updates them
+// and stats overlay and telemetry read them without locks. GPU memory
+// of NanoVG atlases and FFmpeg internals isn't seen, decoder surfaces
+// are counted from surface pool
+class MemoryAccounting {
+  public:
+    static void add(MemoryTag tag, size_t bytes);
+    static void remove(MemoryTag tag, size_t bytes);
+    // For owners which already keep a total
+    static void set(MemoryTag tag, size_t bytes);
+
+    [[nodiscard]] static size_t current(MemoryTag tag);
+    [[nodiscard]] static size_t peak(MemoryTag tag);
+    [[nodiscard]] static const char* name(MemoryTag tag);
+};
@@ -0,0 +1,366 @@
+//
+//  MicroBenchmark.cpp
+//  Moonlight
+//
+
+#include "MicroBenchmark.hpp"
+#include "AVFrameHolder.hpp"
+#include "AppSearchIndex.hpp"
+#include "CryptoManager.hpp"
+#include "Data.hpp"
+#include "HostAddress.hpp"
+#include "InputManager.hpp"
+#include "MockHost.hpp"
+#include "PcmProcessing.hpp"
+#include "PcmResampler.hpp"
+#include "client.h"
+#include "xml.h"
+#include <Limelight.h>
+#include <borealis.hpp>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(USE_GL_RENDERER) && !defined(BOREALIS_USE_DEKO3D)
+#include "GLVideoRenderer.hpp"
+#endif
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+#define BENCHMARK_APPS_COUNT 50
+#define BENCHMARK_XML_CHUNK 1448
+// 10 ms of 48 kHz audio, the size of one Opus packet
+#define BENCHMARK_PCM_FRAMES 480
+// Remote, GFE and local Sunshine video packet sizes
+#define BENCHMARK_GCM_PACKET_SIZES 1024, 1392, 4096
+
+struct HostScenario {
+    const char* name;
+    MockHostConfig config;
+};
+
+// App counts from a few games to large launcher libraries, last one is
+// a remote host behind a lossy link
+static const HostScenario host_scenarios[] = {
+    {"LAN 10 apps", {0, 0, 10, 64 * 1024}},
+    {"LAN 500 apps", {0, 0, 500, 256 * 1024}},
+    {"LAN 5000 apps", {0, 0, 5000, 256 * 1024}},
+    {"WAN 20 ms 2% loss 500 apps", {20, 0.02f, 500, 256 * 1024}},
+};
+
+static Data applist_xml() {
+    std::string xml = "<?xml version=\"1.0\" encoding=\"utf-8\"?><root status_code=\"200\">";
+    for (int i = 0; i < BENCHMARK_APPS_COUNT; i++)
+        xml += "<App><IsHdrSupported>1</IsHdrSupported><AppTitle>Application " + std::to_string(i) +
+               "</AppTitle><ID>" + std::to_string(100000 + i) + "</ID></App>";
+    xml += "</root>";
+    return Data(xml.c_str(), xml.size());
+}
+
+static Data serverinfo_xml() {
+    std::string xml = "<?xml version=\"1.0\" encoding=\"utf-8\"?><root status_code=\"200\">"
+                      "<hostname>DESKTOP</hostname><appversion>7.1.431.-1</appversion>"
+                      "<GfeVersion>3.23.0.74</GfeVersion><uniqueid>0123456789ABCDEF</uniqueid>"
+                      "<HttpsPort>47984</HttpsPort><ExternalPort>47989</ExternalPort>"
+                      "<mac>00:11:22:33:44:55</mac><MaxLumaPixelsHEVC>1869449984</MaxLumaPixelsHEVC>"
+                      "<LocalIP>192.168.1.2</LocalIP><ServerCodecModeSupport>259</ServerCodecModeSupport>"
+                      "<PairStatus>1</PairStatus><currentgame>0</currentgame><state>SUNSHINE_SERVER_FREE</state>"
+                      "</root>";
+    return Data(xml.c_str(), xml.size());
+}
+
+std::vector<BenchmarkResult> MicroBenchmark::run_cpu_suite() {
+    std::vector<BenchmarkResult> results;
+
+    {
+        AVFrameQueue queue;
+        queue.prepare(3);
+        AVFrame* frames[4];
+        for (auto& frame : frames)
+            frame = av_frame_alloc();
+
+        uint64_t index = 0;
+        results.push_back(run("AVFrameQueue push/pop", [&] {
+            queue.push(frames[index & 3], index);
+            index++;
+            benchmark_keep(queue.pop());
+        }));
+
+        queue.cleanup();
+        for (auto& frame : frames)
+            av_frame_free(&frame);
+    }
+
+    {
+        Data small = Data::random_bytes(16);
+        Data key = Data::random_bytes(1024);
+        Data payload = Data::random_bytes(64 * 1024);
+
+        results.push_back(run("Data copy 64 KB", [&] {
+            Data copy(payload);
+            benchmark_keep(copy.bytes());
+        }));
+        results.push_back(run("Data hex 1 KB", [&] {
+            Data hex = key.hex();
+            benchmark_keep(hex.bytes());
+        }));
+        results.push_back(run("Data hex_encode 1 KB into buffer", [&] {
+            char hex[2049];
+            benchmark_keep(Data::hex_encode(key, hex, sizeof(hex)));
+        }));
+        results.push_back(run("Data append 16 B + 1 KB", [&] {
+            Data joined = small.append(key);
+            benchmark_keep(joined.bytes());
+        }));
+    }
+
+    {
+        // Software backend first, then hardware one where it exists
+        Data key = Data::random_bytes(16);
+        Data block = Data::random_bytes(4096);
+        Data iv = Data::random_bytes(12);
+        bool hw_acceleration = CryptoManager::hw_acceleration();
+
+        for (bool hardware : {false, true}) {
+            if (hardware && !hw_acceleration)
+                continue;
+            CryptoManager::set_hw_acceleration(hardware);
+            std::string backend = hardware ? " (hardware)" : "";
+
+            results.push_back(run("AES-128 encrypt 4 KB" + backend, [&] {
+                Data encrypted = CryptoManager::aes_encrypt(block, key);
+                benchmark_keep(encrypted.bytes());
+            }));
+            results.push_back(run("AES-128 decrypt 4 KB" + backend, [&] {
+                Data decrypted = CryptoManager::aes_decrypt(block, key);
+                benchmark_keep(decrypted.bytes());
+            }));
+            results.push_back(run("SHA-256 4 KB" + backend, [&] {
+                Data hash = CryptoManager::SHA256_hash_data(block);
+                benchmark_keep(hash.bytes());
+            }));
+
+            // Per packet, at sizes video packets are sent with
+            for (size_t size : {BENCHMARK_GCM_PACKET_SIZES}) {
+                Data packet = Data::random_bytes(size);
+                Data tag;
+                Data encrypted = CryptoManager::aes_gcm_encrypt(packet, key, iv, &tag);
+                std::string name = "AES-128-GCM " + std::to_string(size) + " B";
+
+                auto encrypt = run(name + " encrypt" + backend, [&] {
+                    Data packet_tag;
+                    Data output = CryptoManager::aes_gcm_encrypt(packet, key, iv, &packet_tag);
+                    benchmark_keep(output.bytes());
+                });
+                auto decrypt = run(name + " decrypt" + backend, [&] {
+                    Data output = CryptoManager::aes_gcm_decrypt(encrypted, key, iv, tag);
+                    benchmark_keep(output.bytes());
+                });
+                encrypt.bytes = decrypt.bytes = size;
+                results.push_back(encrypt);
+                results.push_back(decrypt);
+            }
+        }
+
+        CryptoManager::set_hw_acceleration(hw_acceleration);
+    }
+
+    {
+        Data serverinfo = serverinfo_xml();
+        Data applist = applist_xml();
+
+        results.push_back(run("xml_search serverinfo", [&] {
+            std::string value;
+            xml_search(serverinfo, "currentgame", &value);
+            benchmark_keep(value.size());
+        }));
+        // Fed in chunks of TCP segment size, as curl hands them over
+        results.push_back(run("xml_applist stream 50 apps", [&] {
+            int apps = 0;
+            xml_applist_stream* stream = xml_applist_begin([&](int id, const char* name, size_t size) {
+                apps++;
+            });
+            for (size_t offset = 0; offset < applist.size(); offset += BENCHMARK_XML_CHUNK)
+                xml_applist_feed(stream, (const char*)applist.bytes() + offset,
+                                 std::min<size_t>(BENCHMARK_XML_CHUNK, applist.size() - offset));
+            xml_applist_end(stream);
+            benchmark_keep(apps);
+        }));
+    }
+
+    {
+        std::vector<int16_t> surround(BENCHMARK_PCM_FRAMES * 8);
+        std::vector<int16_t> stereo(BENCHMARK_PCM_FRAMES * 2);
+        for (size_t i = 0; i < surround.size(); i++)
+            surround[i] = (int16_t)((i * 7919) & 0xFFFF);
+        PcmDownmix matrix = PcmProcessing::downmix_matrix(8, 2);
+
+        results.push_back(run("PCM volume 10 ms stereo", [&] {
+            PcmProcessing::apply_volume(stereo.data(), stereo.size(), 150);
+            benchmark_keep(stereo[0]);
+        }));
+        results.push_back(run("PCM downmix 10 ms 7.1", [&] {
+            PcmProcessing::downmix(matrix, surround.data(), stereo.data(), BENCHMARK_PCM_FRAMES);
+            benchmark_keep(stereo[0]);
+        }));
+
+        PcmResampler resampler;
+        resampler.reset(2);
+        std::vector<int16_t> stretched(PcmResampler::max_output(BENCHMARK_PCM_FRAMES, 1.005) * 2);
+        results.push_back(run("PCM resample 10 ms stereo +0.5%", [&] {
+            size_t frames = resampler.process(stereo.data(), BENCHMARK_PCM_FRAMES, stretched.data(), 1.005);
+            benchmark_keep(frames);
+        }));
+    }
+
+    return results;
+}
+
+std::vector<BenchmarkResult> MicroBenchmark::run_host_suite() {
+    std::vector<BenchmarkResult> results;
+
+    for (const HostScenario& scenario : host_scenarios) {
+        MockHost host;
+        if (!host.start(scenario.config))
+            continue;
+
+        std::string address = host.address();
+        std::string prefix = fmt::format("Mock host {}: ", scenario.name);
+
+        SERVER_DATA server;
+        if (gs_init(&server, address) != GS_OK) {
+            brls::Logger::error("MicroBenchmark: {} didn't answer - {}", address, gs_error());
+            continue;
+        }
+
+        // Port probe of discovery, then serverinfo of responder
+        results.push_back(run(prefix + "discovery", [&] {
+            SERVER_DATA found;
+            host_connect_race({HostAddress::parse(address, 0)}, 1000);
+            benchmark_keep(gs_init(&found, address));
+        }));
+
+        // Host tab to app list being shown, data side of its render
+        AppSearchIndex index;
+        auto load_apps = [&] {
+            AppInfoList apps;
+            gs_applist(&server, [&apps](int id, const char* name, size_t size) {
+                apps.push_back({std::string(name, size), id});
+            });
+            std::sort(apps.begin(), apps.end(), [](const AppInfo& a, const AppInfo& b) { return a.name < b.name; });
+            index.update(apps);
+            benchmark_keep(apps.size());
+        };
+        results.push_back(run(prefix + "host open", [&] {
+            SERVER_DATA opened;
+            gs_init(&opened, address);
+            load_apps();
+        }));
+        results.push_back(run(prefix + "app list", load_apps));
+
+        auto boxart = run(prefix + "box art", [&] {
+            Data data;
+            gs_app_boxart(&server, 100000, &data);
+            benchmark_keep(data.size());
+        });
+        boxart.bytes = scenario.config.boxart_bytes;
+        results.push_back(boxart);
+
+        // Launch request up to session URL, RTSP isn't mocked
+        STREAM_CONFIGURATION config;
+        LiInitializeStreamConfiguration(&config);
+        config.width = 1920;
+        config.height = 1080;
+        config.fps = 60;
+        config.audioConfiguration = AUDIO_CONFIGURATION_STEREO;
+        results.push_back(run(prefix + "launch handshake", [&] {
+            server.currentGame = 0;
+            benchmark_keep(gs_start_app(&server, &config, 100000, false, false, 1));
+            delete[] server.serverInfo.rtspSessionUrl;
+            server.serverInfo.rtspSessionUrl = nullptr;
+        }));
+
+        brls::Logger::info("MicroBenchmark: {} answered {} requests", address, host.requests());
+    }
+
+    return results;
+}
+
+std::vector<BenchmarkResult> MicroBenchmark::run_ui_suite() {
+    std::vector<BenchmarkResult> results;
+
+    results.push_back(run("getControllerState", [] {
+        GamepadState state = MoonlightInputManager::instance().getControllerState(0, false);
+        benchmark_keep(state.buttonFlags);
+    }));
+
+#if defined(USE_GL_RENDERER) && !defined(BOREALIS_USE_DEKO3D)
+    {
+        // Synthetic 1080p frames, contents change so driver can't skip upload
+        AVFrame* frames[2];
+        for (int i = 0; i < 2; i++) {
+            frames[i] = av_frame_alloc();
+            frames[i]->format = AV_PIX_FMT_NV12;
+            frames[i]->width = 1920;
+            frames[i]->height = 1080;
+            av_frame_get_buffer(frames[i], 0);
+            memset(frames[i]->data[0], 16 + i * 200, frames[i]->linesize[0] * frames[i]->height);
+            memset(frames[i]->data[1], 128, frames[i]->linesize[1] * frames[i]->height / 2);
+        }
+
+        GLVideoRenderer renderer;
+        uint64_t index = 0;
+        results.push_back(run("GL upload 1080p NV12", [&] {
+            index++;
+            renderer.draw(nullptr, (int)brls::Application::windowWidth, (int)brls::Application::windowHeight,
+                          frames[index & 1], 0, index);
+            // Count upload itself, not only submission
+            glFinish();
+        }));
+
+        for (auto& frame : frames)
+            av_frame_free(&frame);
+    }
+#endif
+
+    return results;
+}
+
+std::string MicroBenchmark::format(const std::vector<BenchmarkResult>& results) {
+    std::string text;
+    for (auto& result : results) {
+        if (result.median_ns >= 10000)
+            text += fmt::format("{}: {:.1f} us\n", result.name, result.median_ns / 1000);
+        else
+            text += fmt::format("{}: {:.0f} ns\n", result.name, result.median_ns);
+        if (result.bytes)
+            text.insert(text.size() - 1, fmt::format(" ({:.0f} Mbps)", result.bytes * 8000 / result.median_ns));
+    }
+    return text;
+}
+
+void MicroBenchmark::save(const std::vector<BenchmarkResult>& results, const std::string& path,
+                          const std::string& platform) {
+    bool exists = false;
+    if (FILE* file = fopen(path.c_str(), "r")) {
+        exists = true;
+        fclose(file);
+    }
+
+    FILE* file = fopen(path.c_str(), "a");
+    if (!file) {
+        brls::Logger::error("MicroBenchmark: Failed to open {}", path);
+        return;
+    }
+
+    if (!exists)
+        fprintf(file, "platform,kernel,iterations,median_ns,min_ns\n");
+    for (auto& result : results) {
+        fprintf(file, "%s,%s,%llu,%.1f,%.1f\n", platform.c_str(), result.name.c_str(),
+                (unsigned long long)result.iterations, result.median_ns, result.min_ns);
+        brls::Logger::info("MicroBenchmark: {} {:.1f} ns/op (min {:.1f}, {} iterations)",
+                           result.name, result.median_ns, result.min_ns, result.iterations);
+    }
+    fclose(file);
+}
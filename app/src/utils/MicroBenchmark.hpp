@@ -0,0 +1,88 @@
+//
+//  MicroBenchmark.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "HighResClock.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Every kernel is run for at least this long, split in batches, so
+// timer resolution and a single preemption don't show up in result
+#define BENCHMARK_MIN_TIME_US 200000
+#define BENCHMARK_BATCH_MIN_US 1000
+#define BENCHMARK_BATCHES_MIN 16
+
+struct BenchmarkResult {
+    std::string name;
+    uint64_t iterations;
+    // Per operation, median and best of batches
+    double median_ns;
+    double min_ns;
+    // Bytes processed per operation, reported as throughput when set
+    uint64_t bytes = 0;
+};
+
+// Keeps compiler from dropping the result of measured code
+template <typename T> inline void benchmark_keep(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    volatile T sink = value;
+    (void)sink;
+#endif
+}
+
+// Small in-app harness for hot-path kernels, results are comparable
+// between runs on the same device, not with desktop ones
+class MicroBenchmark {
+  public:
+    template <typename F> static BenchmarkResult run(const std::string& name, F&& op) {
+        // Grow batch until it's long enough to be measured
+        uint64_t batch = 1;
+        while (true) {
+            uint64_t start = HighResClock::now_us();
+            for (uint64_t i = 0; i < batch; i++)
+                op();
+            if (HighResClock::now_us() - start >= BENCHMARK_BATCH_MIN_US)
+                break;
+            batch *= 2;
+        }
+
+        std::vector<double> samples;
+        uint64_t iterations = 0;
+        uint64_t begin = HighResClock::now_us();
+        while (samples.size() < BENCHMARK_BATCHES_MIN ||
+               HighResClock::now_us() - begin < BENCHMARK_MIN_TIME_US) {
+            uint64_t start = HighResClock::now_us();
+            for (uint64_t i = 0; i < batch; i++)
+                op();
+            samples.push_back((double)(HighResClock::now_us() - start) * 1000.0 / (double)batch);
+            iterations += batch;
+        }
+
+        std::sort(samples.begin(), samples.end());
+        return {name, iterations, samples[samples.size() / 2], samples.front()};
+    }
+
+    // Decoder queue, buffers, crypto, XML parsing and PCM processing,
+    // safe to run on any thread
+    static std::vector<BenchmarkResult> run_cpu_suite();
+
+    // Discovery, host open, app list, box art and launch requests against
+    // a mock host on loopback, takes several seconds, not on UI thread
+    static std::vector<BenchmarkResult> run_host_suite();
+
+    // Input polling and video upload, must be called on UI thread
+    static std::vector<BenchmarkResult> run_ui_suite();
+
+    static std::string format(const std::vector<BenchmarkResult>& results);
+
+    // Appends results to <path>, with header when it's a new file
+    static void save(const std::vector<BenchmarkResult>& results, const std::string& path,
+                     const std::string& platform);
+};
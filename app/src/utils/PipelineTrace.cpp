@@ -0,0 +1,145 @@
+//
+//  PipelineTrace.cpp
+//  Moonlight
+//
+
+#include "PipelineTrace.hpp"
+#include <borealis.hpp>
+#include <algorithm>
+#include <cstdio>
+
+std::atomic<bool> PipelineTrace::s_enabled = false;
+
+namespace {
+// Gives ring back when thread exits, decoder and audio threads are
+// started again for every session
+struct BufferOwner {
+    std::atomic<bool>* in_use = nullptr;
+    ~BufferOwner() {
+        if (in_use)
+            in_use->store(false, std::memory_order_release);
+    }
+};
+} // namespace
+
+static thread_local void* current_buffer = nullptr;
+static thread_local const char* current_name = nullptr;
+static thread_local BufferOwner current_owner;
+
+PipelineTrace::Buffer* PipelineTrace::current() {
+    if (current_buffer)
+        return (Buffer*)current_buffer;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Buffer* buffer = nullptr;
+    for (auto& candidate : m_buffers) {
+        if (!candidate->in_use.load(std::memory_order_acquire)) {
+            buffer = candidate.get();
+            break;
+        }
+    }
+
+    if (!buffer) {
+        m_buffers.push_back(std::make_unique<Buffer>());
+        buffer = m_buffers.back().get();
+        buffer->events = std::make_unique<Event[]>(PIPELINE_TRACE_EVENTS);
+    }
+
+    buffer->count.store(0, std::memory_order_relaxed);
+    buffer->name = current_name ? current_name : "";
+    buffer->tid = m_next_tid++;
+    buffer->in_use.store(true, std::memory_order_relaxed);
+
+    current_owner.in_use = &buffer->in_use;
+    current_buffer = buffer;
+    return buffer;
+}
+
+void PipelineTrace::start() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& buffer : m_buffers)
+            buffer->count.store(0, std::memory_order_relaxed);
+    }
+    // Scope open across previous stop could still bump a count
+    m_start_us = HighResClock::now_us();
+    s_enabled = true;
+}
+
+bool PipelineTrace::stop(const std::string& path) {
+    if (!s_enabled.exchange(false))
+        return true;
+
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        brls::Logger::error("PipelineTrace: Couldn't open {}", path);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+
+    bool first = true;
+    size_t written = 0;
+    for (auto& buffer : m_buffers) {
+        uint32_t count = buffer->count.load(std::memory_order_acquire);
+        if (count == 0)
+            continue;
+
+        // Threads without a name still get one, so tracks can be told apart
+        fprintf(file,
+                "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\","
+                "\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", buffer->tid,
+                buffer->name.empty() ? "Thread" : buffer->name.c_str());
+        first = false;
+
+        uint32_t begin = 0;
+        if (count > PIPELINE_TRACE_EVENTS)
+            begin = count - PIPELINE_TRACE_EVENTS + PIPELINE_TRACE_GUARD;
+
+        for (uint32_t i = begin; i < count; i++) {
+            const Event& event = buffer->events[i % PIPELINE_TRACE_EVENTS];
+            if (event.start_us < m_start_us)
+                continue;
+            fprintf(file,
+                    ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"name\":\"%s\","
+                    "\"ts\":%llu,\"dur\":%u}",
+                    buffer->tid, event.name, (unsigned long long)event.start_us, event.duration_us);
+            written++;
+        }
+    }
+
+    fputs("\n]}\n", file);
+    bool ok = ferror(file) == 0;
+    ok &= fclose(file) == 0;
+
+    if (ok)
+        brls::Logger::info("PipelineTrace: Wrote {} events to {}", written, path);
+    else
+        brls::Logger::error("PipelineTrace: Couldn't write {}", path);
+    return ok;
+}
+
+void PipelineTrace::record(const char* name, uint64_t start_us, uint64_t end_us) {
+    if (!enabled())
+        return;
+
+    Buffer* buffer = current();
+    uint32_t count = buffer->count.load(std::memory_order_relaxed);
+    Event& event = buffer->events[count % PIPELINE_TRACE_EVENTS];
+    event.name = name;
+    event.start_us = start_us;
+    event.duration_us = (uint32_t)std::min<uint64_t>(end_us - start_us, UINT32_MAX);
+    buffer->count.store(count + 1, std::memory_order_release);
+}
+
+void PipelineTrace::name_current(const char* name) {
+    // Ring is only taken with first event, threads which never record
+    // don't cost memory
+    current_name = name;
+    if (current_buffer) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ((Buffer*)current_buffer)->name = name;
+    }
+}
@@ -0,0 +1,101 @@
+//
+//  PipelineTrace.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "HighResClock.hpp"
+#include "Singleton.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Events kept per thread, older ones are overwritten
+#define PIPELINE_TRACE_EVENTS 16384
+// Oldest slots of a wrapped ring could still be written while export
+// reads them, they are left out
+#define PIPELINE_TRACE_GUARD 64
+
+// Records scoped events of receive, decode, queue, render, audio and
+// input stages into per-thread rings and writes them as Chrome trace
+// event JSON, which chrome://tracing and ui.perfetto.dev open.
+// Without USE_PIPELINE_TRACE markers compile to nothing, when not
+// recording they cost one relaxed load
+class PipelineTrace : public Singleton<PipelineTrace> {
+  public:
+    // Drops recorded events and starts recording
+    void start();
+    // Stops recording and writes events, false when file can't be written
+    bool stop(const std::string& path);
+
+    [[nodiscard]] static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    // Name has to be a literal, only its pointer is stored
+    void record(const char* name, uint64_t start_us, uint64_t end_us);
+
+    // Called from ThreadProfiler, so threads show up by their names
+    void name_current(const char* name);
+
+  private:
+    struct Event {
+        const char* name;
+        uint64_t start_us;
+        uint32_t duration_us;
+    };
+
+    struct Buffer {
+        std::unique_ptr<Event[]> events;
+        // Events ever written, only owning thread stores it
+        std::atomic<uint32_t> count = 0;
+        std::string name;
+        uint32_t tid = 0;
+        // Cleared when thread exits, so next new thread takes it over
+        std::atomic<bool> in_use = false;
+    };
+
+    Buffer* current();
+
+    static std::atomic<bool> s_enabled;
+
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Buffer>> m_buffers;
+    uint32_t m_next_tid = 1;
+    uint64_t m_start_us = 0;
+};
+
+#ifdef USE_PIPELINE_TRACE
+class PipelineTraceScope {
+  public:
+    explicit PipelineTraceScope(const char* name)
+        : m_name(name), m_start(PipelineTrace::enabled() ? HighResClock::now_us() : 0) {}
+
+    ~PipelineTraceScope() {
+        if (m_start)
+            PipelineTrace::instance().record(m_name, m_start, HighResClock::now_us());
+    }
+
+  private:
+    const char* m_name;
+    uint64_t m_start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// Traces rest of enclosing scope
+#define TRACE_SCOPE(name) PipelineTraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+// For spans code already takes time of
+#define TRACE_SPAN(name, start_us, end_us)                                                      \
+    do {                                                                                        \
+        if (PipelineTrace::enabled())                                                           \
+            PipelineTrace::instance().record(name, start_us, end_us);                           \
+    } while (0)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_SPAN(name, start_us, end_us)                                                      \
+    do {                                                                                        \
+    } while (0)
+#endif
@@ -1,4 +1,6 @@
 #include "Settings.hpp"
+#include "Log.hpp"
+#include "StartupTrace.hpp"
 #include <jansson.h>
 #include <algorithm>
 #include <cstring>
@@ -62,12 +64,18 @@ void Settings::set_working_dir(const std::string& working_dir) {
     m_working_dir = working_dir;
     m_key_dir = working_dir + "/key";
     m_boxart_dir = working_dir + "/boxart";
+    m_recordings_dir = working_dir + "/recordings";
+    m_screenshots_dir = working_dir + "/screenshots";
+    m_shader_cache_dir = working_dir + "/shader_cache";
     m_log_path = working_dir + "/log.log";
     m_gamepad_mapping_path = working_dir + "/gamepad_mapping_v1.2.0.json";
     
     mkdirtree(m_working_dir.c_str());
     mkdirtree(m_key_dir.c_str());
     mkdirtree(m_boxart_dir.c_str());
+    mkdirtree(m_recordings_dir.c_str());
+    mkdirtree(m_screenshots_dir.c_str());
+    mkdirtree(m_shader_cache_dir.c_str());
     
     load();
 }
@@ -95,10 +103,20 @@ void Settings::remove_host(const Host& host) {
     
     if (it != m_hosts.end()) {
         m_hosts.erase(it);
+        if (m_last_host == host.address)
+            m_last_host.clear();
         save();
     }
 }
 
+void Settings::set_last_host(const std::string& address) {
+    if (m_last_host == address)
+        return;
+
+    m_last_host = address;
+    save();
+}
+
 void Settings::add_favorite(const Host& host, const App& app) {
     auto it = std::find_if(m_hosts.begin(), m_hosts.end(), [host](auto h){
         return h.address == host.address;
@@ -159,8 +177,22 @@ bool Settings::has_any_favorite() {
     });
 }
 
+float Settings::stick_curve_power() const {
+    switch (m_stick_curve) {
+        case CURVE_QUADRATIC:
+            return 2;
+        case CURVE_CUBIC:
+            return 3;
+        case CURVE_CUSTOM:
+            return (float)m_stick_curve_exponent / 100.f;
+        default:
+            return 1;
+    }
+}
+
 void Settings::load() {
     loadBaseLayouts();
+    StartupTrace::instance().mark("key layouts");
 
     json_t* root = json_load_file((m_working_dir + "/settings.json").c_str(), 0, nullptr);
     
@@ -220,6 +252,12 @@ void Settings::load() {
                 }
             }
         }
+
+        if (json_t* last_host = json_object_get(root, "last_host")) {
+            if (json_typeof(last_host) == JSON_STRING) {
+                m_last_host = json_string_value(last_host);
+            }
+        }
         
         if (json_t* settings = json_object_get(root, "settings")) {
             if (json_t* resolution = json_object_get(settings, "resolution")) {
@@ -246,6 +284,42 @@ void Settings::load() {
                 }
             }
 
+            if (json_t* audio_channels = json_object_get(settings, "audio_channels")) {
+                if (json_typeof(audio_channels) == JSON_INTEGER) {
+                    m_audio_channels = (AudioChannels)json_integer_value(audio_channels);
+                }
+            }
+
+            if (json_t* audio_latency = json_object_get(settings, "audio_latency")) {
+                if (json_typeof(audio_latency) == JSON_INTEGER) {
+                    m_audio_latency = (int)json_integer_value(audio_latency);
+                }
+            }
+
+            if (json_t* limit_to_display = json_object_get(settings, "limit_to_display")) {
+                m_limit_to_display = json_typeof(limit_to_display) == JSON_TRUE;
+            }
+
+            if (json_t* auto_bitrate = json_object_get(settings, "auto_bitrate")) {
+                m_auto_bitrate = json_typeof(auto_bitrate) == JSON_TRUE;
+            }
+
+            if (json_t* network_probe = json_object_get(settings, "network_probe")) {
+                m_network_probe = json_typeof(network_probe) == JSON_TRUE;
+            }
+
+            if (json_t* qos_marking = json_object_get(settings, "qos_marking")) {
+                m_qos_marking = json_typeof(qos_marking) == JSON_TRUE;
+            }
+
+            if (json_t* battery_saver = json_object_get(settings, "battery_saver")) {
+                m_battery_saver = json_typeof(battery_saver) == JSON_TRUE;
+            }
+
+            if (json_t* audio_only = json_object_get(settings, "audio_only")) {
+                m_audio_only = json_typeof(audio_only) == JSON_TRUE;
+            }
+
             if (json_t* bitrate = json_object_get(settings, "bitrate")) {
                 if (json_typeof(bitrate) == JSON_INTEGER) {
                     m_bitrate = (int)json_integer_value(bitrate);
@@ -275,10 +349,106 @@ void Settings::load() {
                 }
             }
 
+            if (json_t* auto_tune = json_object_get(settings, "auto_tune")) {
+                m_auto_tune = json_typeof(auto_tune) == JSON_TRUE;
+            }
+
+            if (json_t* frame_max_age = json_object_get(settings, "frame_max_age")) {
+                if (json_typeof(frame_max_age) == JSON_INTEGER) {
+                    m_frame_max_age = std::max(0, (int)json_integer_value(frame_max_age));
+                }
+            }
+
+            if (json_t* surface_budget = json_object_get(settings, "surface_budget")) {
+                if (json_typeof(surface_budget) == JSON_INTEGER) {
+                    m_surface_budget = std::max(16, (int)json_integer_value(surface_budget));
+                }
+            }
+
+            if (json_t* decoder_threading = json_object_get(settings, "decoder_threading")) {
+                if (json_typeof(decoder_threading) == JSON_INTEGER) {
+                    m_decoder_threading = (DecoderThreading)json_integer_value(decoder_threading);
+                }
+            }
+
+            if (json_t* video_scaling = json_object_get(settings, "video_scaling")) {
+                if (json_typeof(video_scaling) == JSON_INTEGER) {
+                    m_video_scaling = (VideoScaling)json_integer_value(video_scaling);
+                }
+            }
+
+            if (json_t* overlay_freeze_video = json_object_get(settings, "overlay_freeze_video")) {
+                m_overlay_freeze_video = json_typeof(overlay_freeze_video) == JSON_TRUE;
+            }
+
+            if (json_t* decoder_thread = json_object_get(settings, "decoder_thread")) {
+                m_decoder_thread = json_typeof(decoder_thread) == JSON_TRUE;
+            }
+
+            if (json_t* decoder_upload = json_object_get(settings, "decoder_upload")) {
+                m_decoder_upload = json_typeof(decoder_upload) == JSON_TRUE;
+            }
+
+            if (json_t* audio_thread = json_object_get(settings, "audio_thread")) {
+                m_audio_thread = json_typeof(audio_thread) == JSON_TRUE;
+            }
+
+            if (json_t* log_levels = json_object_get(settings, "log_levels")) {
+                for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+                    json_t* level = json_object_get(log_levels, Log::name((LogCategory)i));
+                    if (level && json_typeof(level) == JSON_INTEGER)
+                        Log::set_level((LogCategory)i, (int)json_integer_value(level));
+                }
+            }
+
+            if (json_t* cores = json_object_get(settings, "thread_cores")) {
+                for (size_t i = 0; i < json_array_size(cores) && i < THREAD_ROLE_COUNT; i++) {
+                    if (json_t* core = json_array_get(cores, i)) {
+                        if (json_typeof(core) == JSON_INTEGER) {
+                            m_thread_configs[i].core = (int)json_integer_value(core);
+                        }
+                    }
+                }
+            }
+
+            if (json_t* priorities = json_object_get(settings, "thread_priorities")) {
+                for (size_t i = 0; i < json_array_size(priorities) && i < THREAD_ROLE_COUNT; i++) {
+                    if (json_t* priority = json_array_get(priorities, i)) {
+                        if (json_typeof(priority) == JSON_INTEGER) {
+                            m_thread_configs[i].priority = (int)json_integer_value(priority);
+                        }
+                    }
+                }
+            }
+
+            if (json_t* frame_pacing = json_object_get(settings, "frame_pacing")) {
+                if (json_typeof(frame_pacing) == JSON_INTEGER) {
+                    m_frame_pacing = (FramePacing)json_integer_value(frame_pacing);
+                }
+            }
+
+            if (json_t* present_mode = json_object_get(settings, "present_mode")) {
+                if (json_typeof(present_mode) == JSON_INTEGER) {
+                    m_present_mode = (PresentMode)json_integer_value(present_mode);
+                }
+            }
+
+            if (json_t* variable_refresh = json_object_get(settings, "variable_refresh")) {
+                m_variable_refresh = json_typeof(variable_refresh) == JSON_TRUE;
+            }
+
+            if (json_t* vic_scaling = json_object_get(settings, "vic_scaling")) {
+                m_vic_scaling = json_typeof(vic_scaling) == JSON_TRUE;
+            }
+
             if (json_t* hw_decoding = json_object_get(settings, "use_hw_decoding")) {
                 m_use_hw_decoding = json_typeof(hw_decoding) == JSON_TRUE;
             }
 
+            if (json_t* direct_surface = json_object_get(settings, "direct_surface")) {
+                m_direct_surface = json_typeof(direct_surface) == JSON_TRUE;
+            }
+
             if (json_t* sops = json_object_get(settings, "sops")) {
                 m_sops = json_typeof(sops) == JSON_TRUE;
             }
@@ -287,9 +457,65 @@ void Settings::load() {
                 m_play_audio = json_typeof(play_audio) == JSON_TRUE;
             }
             
+            if (json_t* input_rate = json_object_get(settings, "input_rate")) {
+                if (json_typeof(input_rate) == JSON_INTEGER) {
+                    m_input_rate = (int)json_integer_value(input_rate);
+                }
+            }
+
+            if (json_t* motion_rate = json_object_get(settings, "motion_rate")) {
+                if (json_typeof(motion_rate) == JSON_INTEGER) {
+                    m_motion_rate = (int)json_integer_value(motion_rate);
+                }
+            }
+
+            if (json_t* boxart_cache_mb = json_object_get(settings, "boxart_cache_mb")) {
+                if (json_typeof(boxart_cache_mb) == JSON_INTEGER) {
+                    m_boxart_cache_mb = (int)json_integer_value(boxart_cache_mb);
+                }
+            }
+
             if (json_t* write_log = json_object_get(settings, "write_log")) {
                 m_write_log = json_typeof(write_log) == JSON_TRUE;
             }
+
+            if (json_t* record_video = json_object_get(settings, "record_video")) {
+                m_record_video = json_typeof(record_video) == JSON_TRUE;
+            }
+
+            if (json_t* record_session = json_object_get(settings, "record_session")) {
+                m_record_session = json_typeof(record_session) == JSON_TRUE;
+            }
+
+            if (json_t* replay_loss = json_object_get(settings, "replay_loss")) {
+                if (json_typeof(replay_loss) == JSON_INTEGER) {
+                    m_replay_loss = std::clamp((int)json_integer_value(replay_loss), 0, 100);
+                }
+            }
+
+            if (json_t* replay_jitter = json_object_get(settings, "replay_jitter")) {
+                if (json_typeof(replay_jitter) == JSON_INTEGER) {
+                    m_replay_jitter = std::max(0, (int)json_integer_value(replay_jitter));
+                }
+            }
+
+            if (json_t* soak_duration = json_object_get(settings, "soak_duration")) {
+                if (json_typeof(soak_duration) == JSON_INTEGER) {
+                    m_soak_duration = std::max(1, (int)json_integer_value(soak_duration));
+                }
+            }
+
+            if (json_t* soak_reconnects = json_object_get(settings, "soak_reconnects")) {
+                if (json_typeof(soak_reconnects) == JSON_INTEGER) {
+                    m_soak_reconnects = std::max(1, (int)json_integer_value(soak_reconnects));
+                }
+            }
+
+            if (json_t* grid_benchmark_apps = json_object_get(settings, "grid_benchmark_apps")) {
+                if (json_typeof(grid_benchmark_apps) == JSON_INTEGER) {
+                    m_grid_benchmark_apps = std::max(1, (int)json_integer_value(grid_benchmark_apps));
+                }
+            }
             
             if (json_t* swap_ui_keys = json_object_get(settings, "swap_ui_keys")) {
                 m_swap_ui_keys = json_typeof(swap_ui_keys) == JSON_TRUE;
@@ -310,6 +536,22 @@ void Settings::load() {
             if (json_t* swap_mouse_scroll = json_object_get(settings, "swap_mouse_scroll")) {
                 m_swap_mouse_scroll = json_typeof(swap_mouse_scroll) == JSON_TRUE;
             }
+
+            if (json_t* gyro_mouse = json_object_get(settings, "gyro_mouse")) {
+                m_gyro_mouse = json_typeof(gyro_mouse) == JSON_TRUE;
+            }
+
+            if (json_t* gyro_mouse_sensitivity = json_object_get(settings, "gyro_mouse_sensitivity")) {
+                if (json_typeof(gyro_mouse_sensitivity) == JSON_INTEGER) {
+                    m_gyro_mouse_sensitivity = (int)json_integer_value(gyro_mouse_sensitivity);
+                }
+            }
+
+            if (json_t* gyro_mouse_ratchet = json_object_get(settings, "gyro_mouse_ratchet")) {
+                if (json_typeof(gyro_mouse_ratchet) == JSON_INTEGER) {
+                    m_gyro_mouse_ratchet = (int)json_integer_value(gyro_mouse_ratchet);
+                }
+            }
             
             if (json_t* volume_amplification = json_object_get(settings, "volume_amplification")) {
                 m_volume_amplification = json_typeof(volume_amplification) == JSON_TRUE;
@@ -345,6 +587,30 @@ void Settings::load() {
                 }
             }
 
+            if (json_t* deadzone_type = json_object_get(settings, "deadzone_type")) {
+                if (json_typeof(deadzone_type) == JSON_INTEGER) {
+                    m_deadzone_type = (DeadzoneType)json_integer_value(deadzone_type);
+                }
+            }
+
+            if (json_t* anti_deadzone = json_object_get(settings, "anti_deadzone")) {
+                if (json_typeof(anti_deadzone) == JSON_INTEGER) {
+                    m_anti_deadzone = (float)json_integer_value(anti_deadzone) / 100.f;
+                }
+            }
+
+            if (json_t* stick_curve = json_object_get(settings, "stick_curve")) {
+                if (json_typeof(stick_curve) == JSON_INTEGER) {
+                    m_stick_curve = (StickCurve)json_integer_value(stick_curve);
+                }
+            }
+
+            if (json_t* stick_curve_exponent = json_object_get(settings, "stick_curve_exponent")) {
+                if (json_typeof(stick_curve_exponent) == JSON_INTEGER) {
+                    m_stick_curve_exponent = (int)json_integer_value(stick_curve_exponent);
+                }
+            }
+
             if (json_t* deadzone_stick_right = json_object_get(settings, "deadzone_stick_right")) {
                 if (json_typeof(deadzone_stick_right) == JSON_INTEGER) {
                     m_deadzone_stick_right = (float)json_integer_value(deadzone_stick_right) / 100.f;
@@ -462,6 +728,25 @@ void Settings::load() {
         
         json_decref(root);
     }
+
+    publish_stream();
+}
+
+void Settings::publish_stream() {
+    StreamSettingsSnapshot stream;
+    stream.volume = m_volume;
+    stream.rumble_force = get_rumble_force();
+    stream.frames_queue_size = frames_queue_size();
+    stream.motion_rate = m_motion_rate;
+    stream.gyro_mouse = m_gyro_mouse;
+    stream.gyro_mouse_sensitivity = m_gyro_mouse_sensitivity;
+    stream.gyro_mouse_ratchet = m_gyro_mouse_ratchet;
+    stream.mouse_speed_multiplier = m_mouse_speed_multiplier;
+    stream.swap_joycon_stick_to_dpad = m_swap_joycon_stick_to_dpad;
+    stream.touchscreen_mouse_mode = m_touchscreen_mouse_mode;
+    stream.swap_mouse_keys = m_swap_mouse_keys;
+    stream.swap_mouse_scroll = m_swap_mouse_scroll;
+    m_stream.publish(stream);
 }
 
 void Settings::save() {
@@ -489,26 +774,83 @@ void Settings::save() {
             }
             json_object_set_new(root, "hosts", hosts);
         }
+
+        json_object_set_new(root, "last_host", json_string(m_last_host.c_str()));
         
         if (json_t* settings = json_object()) {
             json_object_set_new(settings, "resolution", json_integer(m_resolution));
             json_object_set_new(settings, "fps", json_integer(m_fps));
             json_object_set_new(settings, "video_codec", json_integer(m_video_codec));
             json_object_set_new(settings, "audio_backend", json_integer(m_audio_backend));
+            json_object_set_new(settings, "audio_channels", json_integer(m_audio_channels));
+            json_object_set_new(settings, "audio_latency", json_integer(m_audio_latency));
             json_object_set_new(settings, "bitrate", json_integer(m_bitrate));
+            json_object_set_new(settings, "limit_to_display", m_limit_to_display ? json_true() : json_false());
+            json_object_set_new(settings, "auto_bitrate", m_auto_bitrate ? json_true() : json_false());
+            json_object_set_new(settings, "network_probe", m_network_probe ? json_true() : json_false());
+            json_object_set_new(settings, "qos_marking", m_qos_marking ? json_true() : json_false());
+            json_object_set_new(settings, "battery_saver", m_battery_saver ? json_true() : json_false());
+            json_object_set_new(settings, "audio_only", m_audio_only ? json_true() : json_false());
             json_object_set_new(settings, "decoder_threads", json_integer(m_decoder_threads));
+            json_object_set_new(settings, "decoder_threading", json_integer(m_decoder_threading));
+            json_object_set_new(settings, "video_scaling", json_integer(m_video_scaling));
             json_object_set_new(settings, "frames_queue_size", json_integer(m_frames_queue_size));
+            json_object_set_new(settings, "frame_max_age", json_integer(m_frame_max_age));
+            json_object_set_new(settings, "auto_tune", m_auto_tune ? json_true() : json_false());
+            json_object_set_new(settings, "surface_budget", json_integer(m_surface_budget));
+            json_object_set_new(settings, "frame_pacing", json_integer(m_frame_pacing));
+            json_object_set_new(settings, "present_mode", json_integer(m_present_mode));
+            json_object_set_new(settings, "variable_refresh", m_variable_refresh ? json_true() : json_false());
+            json_object_set_new(settings, "vic_scaling", m_vic_scaling ? json_true() : json_false());
+            json_object_set_new(settings, "decoder_thread", m_decoder_thread ? json_true() : json_false());
+            json_object_set_new(settings, "decoder_upload", m_decoder_upload ? json_true() : json_false());
+            json_object_set_new(settings, "overlay_freeze_video", m_overlay_freeze_video ? json_true() : json_false());
+            json_object_set_new(settings, "audio_thread", m_audio_thread ? json_true() : json_false());
+
+            if (json_t* log_levels = json_object()) {
+                for (int i = 0; i < LOG_CATEGORY_COUNT; i++)
+                    json_object_set_new(log_levels, Log::name((LogCategory)i), json_integer(Log::level((LogCategory)i)));
+                json_object_set_new(settings, "log_levels", log_levels);
+            }
+
+            if (json_t* cores = json_array()) {
+                for (auto config: m_thread_configs) {
+                    json_array_append_new(cores, json_integer(config.core));
+                }
+                json_object_set_new(settings, "thread_cores", cores);
+            }
+
+            if (json_t* priorities = json_array()) {
+                for (auto config: m_thread_configs) {
+                    json_array_append_new(priorities, json_integer(config.priority));
+                }
+                json_object_set_new(settings, "thread_priorities", priorities);
+            }
             json_object_set_new(settings, "enable_hdr", m_enable_hdr ? json_true() : json_false());
             json_object_set_new(settings, "click_by_tap", m_click_by_tap ? json_true() : json_false());
             json_object_set_new(settings, "use_hw_decoding", m_use_hw_decoding ? json_true() : json_false());
+            json_object_set_new(settings, "direct_surface", m_direct_surface ? json_true() : json_false());
             json_object_set_new(settings, "sops", m_sops ? json_true() : json_false());
             json_object_set_new(settings, "play_audio", m_play_audio ? json_true() : json_false());
             json_object_set_new(settings, "write_log", m_write_log ? json_true() : json_false());
+            json_object_set_new(settings, "record_video", m_record_video ? json_true() : json_false());
+            json_object_set_new(settings, "record_session", m_record_session ? json_true() : json_false());
+            json_object_set_new(settings, "replay_loss", json_integer(m_replay_loss));
+            json_object_set_new(settings, "replay_jitter", json_integer(m_replay_jitter));
+            json_object_set_new(settings, "soak_duration", json_integer(m_soak_duration));
+            json_object_set_new(settings, "soak_reconnects", json_integer(m_soak_reconnects));
+            json_object_set_new(settings, "grid_benchmark_apps", json_integer(m_grid_benchmark_apps));
+            json_object_set_new(settings, "boxart_cache_mb", json_integer(m_boxart_cache_mb));
+            json_object_set_new(settings, "input_rate", json_integer(m_input_rate));
+            json_object_set_new(settings, "motion_rate", json_integer(m_motion_rate));
             json_object_set_new(settings, "swap_ui_keys", m_swap_ui_keys ? json_true() : json_false());
             json_object_set_new(settings, "swap_joycon_stick_to_dpad", m_swap_joycon_stick_to_dpad ? json_true() : json_false());
             json_object_set_new(settings, "touchscreen_mouse_mode", m_touchscreen_mouse_mode ? json_true() : json_false());
             json_object_set_new(settings, "swap_mouse_keys", m_swap_mouse_keys ? json_true() : json_false());
             json_object_set_new(settings, "swap_mouse_scroll", m_swap_mouse_scroll ? json_true() : json_false());
+            json_object_set_new(settings, "gyro_mouse", m_gyro_mouse ? json_true() : json_false());
+            json_object_set_new(settings, "gyro_mouse_sensitivity", json_integer(m_gyro_mouse_sensitivity));
+            json_object_set_new(settings, "gyro_mouse_ratchet", json_integer(m_gyro_mouse_ratchet));
             json_object_set_new(settings, "volume_amplification", m_volume_amplification ? json_true() : json_false());
             json_object_set_new(settings, "stream_volume", json_integer(m_volume));
             json_object_set_new(settings, "overlay_hold_time", json_integer(m_overlay_options.holdTime));
@@ -516,6 +858,10 @@ void Settings::save() {
             json_object_set_new(settings, "mouse_speed_multiplier", json_integer(m_mouse_speed_multiplier));
             json_object_set_new(settings, "deadzone_stick_left", json_integer(int(m_deadzone_stick_left * 100.f)));
             json_object_set_new(settings, "deadzone_stick_right", json_integer(int(m_deadzone_stick_right * 100.f)));
+            json_object_set_new(settings, "deadzone_type", json_integer(m_deadzone_type));
+            json_object_set_new(settings, "anti_deadzone", json_integer(int(m_anti_deadzone * 100.f)));
+            json_object_set_new(settings, "stick_curve", json_integer(m_stick_curve));
+            json_object_set_new(settings, "stick_curve_exponent", json_integer(m_stick_curve_exponent));
             json_object_set_new(settings, "rumble_force", json_integer(m_rumble_force));
             json_object_set_new(settings, "current_mapping_layout", json_integer(m_current_mapping_layout));
             json_object_set_new(settings, "keyboard_type", json_integer(m_keyboard_type));
@@ -565,8 +911,80 @@ void Settings::save() {
             json_object_set_new(root, "mapping_layouts", hosts);
         }
         
-        json_dump_file(root, (m_working_dir + "/settings.json").c_str(), JSON_INDENT(4));
+        char* content = json_dumps(root, JSON_INDENT(4));
         json_decref(root);
+
+        if (content) {
+            std::unique_lock<std::mutex> lock(m_save_mutex);
+            if (m_save_stop) {
+                // Writer is gone already, nothing is left to coalesce with
+                lock.unlock();
+                write_file(m_working_dir + "/settings.json", content);
+            } else {
+                m_save_content = content;
+                m_save_pending = true;
+                if (!m_save_thread.joinable())
+                    m_save_thread = std::thread([this] { run_writer(); });
+                m_save_condition.notify_one();
+            }
+            free(content);
+        }
+    }
+}
+
+void Settings::run_writer() {
+    std::unique_lock<std::mutex> lock(m_save_mutex);
+    while (true) {
+        m_save_condition.wait(lock, [this] { return m_save_pending || m_save_stop; });
+        if (!m_save_pending)
+            break;
+
+        // Let following changes land in same write, unless app is closing
+        m_save_condition.wait_for(lock, std::chrono::milliseconds(SETTINGS_SAVE_DELAY_MS),
+                                  [this] { return m_save_stop; });
+
+        std::string content = std::move(m_save_content);
+        m_save_pending = false;
+
+        lock.unlock();
+        write_file(m_working_dir + "/settings.json", content);
+        lock.lock();
+    }
+}
+
+void Settings::flush() {
+    {
+        std::lock_guard<std::mutex> lock(m_save_mutex);
+        m_save_stop = true;
+    }
+    m_save_condition.notify_one();
+
+    if (m_save_thread.joinable())
+        m_save_thread.join();
+}
+
+void Settings::write_file(const std::string& path, const std::string& content) {
+    // Written aside and renamed, so crash mid-write doesn't lose settings
+    std::string temp = path + ".tmp";
+    FILE* file = fopen(temp.c_str(), "wb");
+    if (!file) {
+        brls::Logger::error("Settings: Failed to open {}", temp);
+        return;
+    }
+
+    bool written = fwrite(content.data(), 1, content.size(), file) == content.size();
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        brls::Logger::error("Settings: Failed to write {}", temp);
+        remove(temp.c_str());
+        return;
+    }
+
+    // Some filesystems (Switch SD card) don't rename over existing file
+    if (rename(temp.c_str(), path.c_str()) != 0) {
+        remove(path.c_str());
+        if (rename(temp.c_str(), path.c_str()) != 0)
+            brls::Logger::error("Settings: Failed to replace {}", path);
     }
 }
 
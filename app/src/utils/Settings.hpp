@@ -1,13 +1,27 @@
 #pragma once
 
 #include "Singleton.hpp"
+#include "StatsSnapshot.hpp"
+#include "ThreadAffinity.hpp"
+#include <algorithm>
 #include <borealis.hpp>
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <cstdio>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
+// Changes made within this time are written to disk together
+#define SETTINGS_SAVE_DELAY_MS 500
+
+// Limits of low memory profile, applet mode on Switch leaves a small
+// part of application heap
+#define LOW_MEMORY_FRAMES_QUEUE_SIZE 1
+#define LOW_MEMORY_SURFACE_BUDGET_MB 24
+
 enum VideoCodec : int { H264, H265, AV1 };
 std::string getVideoCodecName(VideoCodec codec);
 
@@ -15,11 +29,32 @@ enum AudioBackend : int {
     SDL,
 #ifdef __SWITCH__
     AUDREN,
+#endif
+    SDL_CALLBACK,
+#ifdef PLATFORM_ANDROID
+    AAUDIO,
+#endif
+#ifdef __APPLE__
+    AUDIO_UNIT,
 #endif
 };
 
+enum AudioChannels : int { AUDIO_CHANNELS_STEREO, AUDIO_CHANNELS_51, AUDIO_CHANNELS_71 };
+
 enum KeyboardType : int { COMPACT, FULLSIZED };
 
+enum FramePacing : int { PACING_QUEUE, PACING_LOWEST_LATENCY, PACING_SMOOTHEST };
+
+enum PresentMode : int { PRESENT_STANDARD, PRESENT_LOW_LATENCY, PRESENT_IMMEDIATE };
+
+enum DecoderThreading : int { DECODER_THREADING_AUTO, DECODER_THREADING_SLICE, DECODER_THREADING_FRAME };
+
+enum VideoScaling : int { SCALING_BILINEAR, SCALING_BICUBIC, SCALING_LANCZOS, SCALING_FSR };
+
+enum DeadzoneType : int { DEADZONE_RADIAL, DEADZONE_AXIAL };
+
+enum StickCurve : int { CURVE_LINEAR, CURVE_QUADRATIC, CURVE_CUBIC, CURVE_CUSTOM };
+
 enum class ButtonOverrideType : int { NONE, SCREENSHOT, HOME };
 
 struct KeyMappingLayout {
@@ -45,16 +80,58 @@ struct Host {
     std::vector<App> favorites;
 };
 
+// Settings streaming threads read per packet, poll or setup, published
+// as one copy on every change from UI thread, so audio, decoder and input
+// threads neither read members being written nor see half of a change
+struct StreamSettingsSnapshot {
+    int volume = 100;
+    float rumble_force = 1;
+    int frames_queue_size = 3;
+    int motion_rate = 120;
+    bool gyro_mouse = false;
+    int gyro_mouse_sensitivity = 100;
+    int gyro_mouse_ratchet = -1;
+    int mouse_speed_multiplier = 34;
+    bool swap_joycon_stick_to_dpad = false;
+    bool touchscreen_mouse_mode = false;
+    bool swap_mouse_keys = false;
+    bool swap_mouse_scroll = false;
+};
+
 class Settings : public Singleton<Settings> {
   public:
+    // Safe from any thread, hot loops take it once per iteration
+    [[nodiscard]] StreamSettingsSnapshot stream() const { return m_stream.read(); }
+
+    // Thread must not be left joinable, if exit skipped flush()
+    ~Settings() { flush(); }
+
     void set_working_dir(const std::string& working_dir);
 
     [[nodiscard]] std::string key_dir() const { return m_key_dir; }
 
     [[nodiscard]] std::string boxart_dir() const { return m_boxart_dir; }
+    [[nodiscard]] std::string recordings_dir() const { return m_recordings_dir; }
+    [[nodiscard]] std::string screenshots_dir() const { return m_screenshots_dir; }
+
+    [[nodiscard]] std::string shader_cache_dir() const { return m_shader_cache_dir; }
 
     [[nodiscard]] std::string log_path() const { return m_log_path; }
 
+    [[nodiscard]] std::string frame_trace_path() const { return m_working_dir + "/frame_trace.csv"; }
+    // Base name of recorded video, .bin and .csv files go next to each other
+    [[nodiscard]] std::string video_capture_path() const { return m_working_dir + "/video_capture"; }
+    [[nodiscard]] std::string session_capture_path() const { return m_working_dir + "/session_capture.bin"; }
+    [[nodiscard]] std::string telemetry_path() const { return m_working_dir + "/telemetry.jsonl"; }
+    [[nodiscard]] std::string pipeline_trace_path() const { return m_working_dir + "/pipeline_trace.json"; }
+    [[nodiscard]] std::string benchmark_results_path() const { return m_working_dir + "/benchmark_results.csv"; }
+    [[nodiscard]] std::string soak_samples_path() const { return m_working_dir + "/soak_samples.csv"; }
+    [[nodiscard]] std::string soak_results_path() const { return m_working_dir + "/soak_results.csv"; }
+    [[nodiscard]] std::string grid_benchmark_path() const { return m_working_dir + "/grid_benchmark.csv"; }
+
+    [[nodiscard]] std::string host_cache_path() const { return m_working_dir + "/host_cache.json"; }
+    [[nodiscard]] std::string decoder_capabilities_path() const { return m_working_dir + "/decoder_capabilities.json"; }
+
     [[nodiscard]] std::string gamepad_mapping_path() const { return m_gamepad_mapping_path; }
 
     [[nodiscard]] std::vector<Host> hosts() const { return m_hosts; }
@@ -62,6 +139,10 @@ class Settings : public Singleton<Settings> {
     void add_host(const Host& host);
     void remove_host(const Host& host);
 
+    // Address of host which app list was opened last, warmed up at start
+    [[nodiscard]] std::string last_host() const { return m_last_host; }
+    void set_last_host(const std::string& address);
+
     void add_favorite(const Host& host, const App& app);
     void remove_favorite(const Host& host, int app_id);
     bool is_favorite(const Host& host, int app_id);
@@ -79,9 +160,42 @@ class Settings : public Singleton<Settings> {
     [[nodiscard]] AudioBackend audio_backend() const { return m_audio_backend; }
     void set_audio_backend(AudioBackend audio_backend) { m_audio_backend = audio_backend; }
 
+    [[nodiscard]] AudioChannels audio_channels() const { return m_audio_channels; }
+    void set_audio_channels(AudioChannels audio_channels) { m_audio_channels = audio_channels; }
+
+    // Target queue length of SDL callback mode
+    [[nodiscard]] int audio_latency() const { return m_audio_latency; }
+    void set_audio_latency(int audio_latency) { m_audio_latency = audio_latency; }
+
     [[nodiscard]] int bitrate() const { return m_bitrate; }
     void set_bitrate(int bitrate) { m_bitrate = bitrate; }
 
+    // Lowers bitrate below the one from settings while network is bad
+    // Stream resolution is capped with display one
+    [[nodiscard]] bool limit_to_display() const { return m_limit_to_display; }
+    void set_limit_to_display(bool limit_to_display) { m_limit_to_display = limit_to_display; }
+
+    [[nodiscard]] bool auto_bitrate() const { return m_auto_bitrate; }
+    void set_auto_bitrate(bool auto_bitrate) { m_auto_bitrate = auto_bitrate; }
+
+    // Short check of link to host lowers starting bitrate to what it carries
+    [[nodiscard]] bool network_probe() const { return m_network_probe; }
+    void set_network_probe(bool network_probe) { m_network_probe = network_probe; }
+
+    // Control and input packets go with DSCP CS6 to WMM voice queue,
+    // takes effect with next stream
+    [[nodiscard]] bool qos_marking() const { return m_qos_marking; }
+    void set_qos_marking(bool qos_marking) { m_qos_marking = qos_marking; }
+
+    // Frame rate is capped when stream starts on low battery in handheld
+    [[nodiscard]] bool battery_saver() const { return m_battery_saver; }
+    void set_battery_saver(bool battery_saver) { m_battery_saver = battery_saver; }
+
+    // Stream starts with least video host sends and doesn't decode it,
+    // video is turned on from overlay
+    [[nodiscard]] bool audio_only() const { return m_audio_only; }
+    void set_audio_only(bool audio_only) { m_audio_only = audio_only; }
+
     [[nodiscard]] bool request_hdr() const { 
 #ifdef SUPPORT_HDR
         return m_enable_hdr; 
@@ -95,10 +209,75 @@ class Settings : public Singleton<Settings> {
     void set_click_by_tap(bool click_by_tap) { m_click_by_tap = click_by_tap; }
 
     void set_decoder_threads(int decoder_threads) { m_decoder_threads = decoder_threads; }
-    [[nodiscard]] int decoder_threads() const { return m_decoder_threads; }
+    [[nodiscard]] int decoder_threads() const { return m_tuned_decoder_threads > 0 ? m_tuned_decoder_threads : m_decoder_threads; }
+
+    void set_decoder_threading(DecoderThreading decoder_threading) { m_decoder_threading = decoder_threading; }
+    [[nodiscard]] DecoderThreading decoder_threading() const { return m_decoder_threading; }
+
+    void set_video_scaling(VideoScaling video_scaling) { m_video_scaling = video_scaling; }
+    [[nodiscard]] VideoScaling video_scaling() const { return m_video_scaling; }
+
+    void set_frames_queue_size(int frames_queue_size) { m_frames_queue_size = frames_queue_size; publish_stream(); }
+    [[nodiscard]] int frames_queue_size() const {
+        int size = m_tuned_frames_queue_size > 0 ? m_tuned_frames_queue_size : m_frames_queue_size;
+        return m_low_memory ? std::min(size, LOW_MEMORY_FRAMES_QUEUE_SIZE) : size;
+    }
+
+    // Queue depth and decoder threads are tuned per host and codec,
+    // values above stay as their upper bounds
+    void set_auto_tune(bool auto_tune) { m_auto_tune = auto_tune; }
+    [[nodiscard]] bool auto_tune() const { return m_auto_tune; }
+    // Used by one session only, never saved, 0 keeps setting
+    void set_session_tuning(int frames_queue_size, int decoder_threads) {
+        m_tuned_frames_queue_size = std::min(frames_queue_size, m_frames_queue_size);
+        m_tuned_decoder_threads = std::min(decoder_threads, m_decoder_threads);
+        publish_stream();
+    }
+    [[nodiscard]] int configured_frames_queue_size() const { return m_frames_queue_size; }
+    [[nodiscard]] int configured_decoder_threads() const { return m_decoder_threads; }
 
-    void set_frames_queue_size(int frames_queue_size) { m_frames_queue_size = frames_queue_size; }
-    [[nodiscard]] int frames_queue_size() const { return m_frames_queue_size; }
+    // Decoded frames waiting longer than this are skipped, in milliseconds, 0 disables
+    void set_frame_max_age(int frame_max_age) { m_frame_max_age = frame_max_age; }
+    [[nodiscard]] int frame_max_age() const { return m_frame_max_age; }
+
+    // Memory decoder surfaces may take, in megabytes
+    void set_surface_budget(int surface_budget) { m_surface_budget = surface_budget; }
+    [[nodiscard]] int surface_budget() const {
+        return m_low_memory ? std::min(m_surface_budget, LOW_MEMORY_SURFACE_BUDGET_MB) : m_surface_budget;
+    }
+
+    // Smaller pools and queues, no box art textures. Set at start, never saved
+    void set_low_memory(bool low_memory) { m_low_memory = low_memory; publish_stream(); }
+    [[nodiscard]] bool low_memory() const { return m_low_memory; }
+
+    void set_frame_pacing(FramePacing frame_pacing) { m_frame_pacing = frame_pacing; }
+    [[nodiscard]] FramePacing frame_pacing() const { return m_frame_pacing; }
+
+    // How deko3d frames reach the display while streaming
+    void set_present_mode(PresentMode present_mode) { m_present_mode = present_mode; }
+    [[nodiscard]] PresentMode present_mode() const { return m_present_mode; }
+
+    // Desktop GL swaps stream frames as they come, for adaptive sync panels
+    void set_variable_refresh(bool variable_refresh) { m_variable_refresh = variable_refresh; }
+    [[nodiscard]] bool variable_refresh() const { return m_variable_refresh; }
+
+    // Streams bigger than output are scaled by VIC before deko3d draws them
+    void set_vic_scaling(bool vic_scaling) { m_vic_scaling = vic_scaling; }
+    [[nodiscard]] bool vic_scaling() const { return m_vic_scaling; }
+
+    void set_decoder_thread(bool decoder_thread) { m_decoder_thread = decoder_thread; }
+    [[nodiscard]] bool decoder_thread() const { return m_decoder_thread; }
+
+    // Software frames go to GL textures on decoder thread, through
+    // context shared with UI one, instead of in UI frame
+    void set_decoder_upload(bool decoder_upload) { m_decoder_upload = decoder_upload; }
+    [[nodiscard]] bool decoder_upload() const { return m_decoder_upload; }
+
+    // Opus decoding moves from receive thread to audio worker
+    void set_audio_thread(bool audio_thread) { m_audio_thread = audio_thread; }
+    [[nodiscard]] bool audio_thread() const { return m_audio_thread; }
+
+    [[nodiscard]] ThreadConfig thread_config(ThreadRole role) const { return m_thread_configs[role]; }
 
     void set_sops(bool sops) { m_sops = sops; }
     [[nodiscard]] bool sops() const { return m_sops; }
@@ -106,24 +285,71 @@ class Settings : public Singleton<Settings> {
     void set_play_audio(bool play_audio) { m_play_audio = play_audio; }
     [[nodiscard]] bool play_audio() const { return m_play_audio; }
 
+    // GPU memory box art textures may take, least recently shown are dropped first
+    void set_boxart_cache_mb(int boxart_cache_mb) { m_boxart_cache_mb = boxart_cache_mb; }
+    [[nodiscard]] int boxart_cache_mb() const { return m_boxart_cache_mb; }
+
+    // Controller polling rate in Hz while streaming, 0 polls once per UI frame
+    void set_input_rate(int input_rate) { m_input_rate = input_rate; }
+    [[nodiscard]] int input_rate() const { return m_input_rate; }
+
+    // Motion samples per second sent for each sensor, 0 sends every sample
+    void set_motion_rate(int motion_rate) { m_motion_rate = motion_rate; publish_stream(); }
+    [[nodiscard]] int motion_rate() const { return m_motion_rate; }
+
     void set_write_log(bool write_log) { m_write_log = write_log; }
     [[nodiscard]] bool write_log() const { return m_write_log; }
 
+    void set_record_video(bool record_video) { m_record_video = record_video; }
+    [[nodiscard]] bool record_video() const { return m_record_video; }
+
+    void set_record_session(bool record_session) { m_record_session = record_session; }
+    [[nodiscard]] bool record_session() const { return m_record_session; }
+
+    // Impairments added by session replay, on top of recorded ones
+    void set_replay_loss(int replay_loss) { m_replay_loss = replay_loss; }
+    [[nodiscard]] int replay_loss() const { return m_replay_loss; }
+
+    void set_replay_jitter(int replay_jitter) { m_replay_jitter = replay_jitter; }
+    [[nodiscard]] int replay_jitter() const { return m_replay_jitter; }
+
+    // Soak test length in minutes and reconnects forced during it
+    void set_soak_duration(int soak_duration) { m_soak_duration = soak_duration; }
+    [[nodiscard]] int soak_duration() const { return m_soak_duration; }
+
+    void set_soak_reconnects(int soak_reconnects) { m_soak_reconnects = soak_reconnects; }
+    [[nodiscard]] int soak_reconnects() const { return m_soak_reconnects; }
+
+    // Synthetic library size of app grid scroll benchmark
+    void set_grid_benchmark_apps(int grid_benchmark_apps) { m_grid_benchmark_apps = grid_benchmark_apps; }
+    [[nodiscard]] int grid_benchmark_apps() const { return m_grid_benchmark_apps; }
+
     void set_swap_ui_keys(bool swap_ui_keys) { m_swap_ui_keys = swap_ui_keys; }
     [[nodiscard]] bool swap_ui_keys() const { return m_swap_ui_keys; }
 
-    void set_swap_joycon_stick_to_dpad(bool value) { m_swap_joycon_stick_to_dpad = value; }
+    void set_swap_joycon_stick_to_dpad(bool value) { m_swap_joycon_stick_to_dpad = value; publish_stream(); }
     [[nodiscard]] bool swap_joycon_stick_to_dpad() const { return m_swap_joycon_stick_to_dpad; }
 
-    void set_swap_mouse_keys(bool swap_mouse_keys) { m_swap_mouse_keys = swap_mouse_keys; }
+    void set_swap_mouse_keys(bool swap_mouse_keys) { m_swap_mouse_keys = swap_mouse_keys; publish_stream(); }
     [[nodiscard]] bool touchscreen_mouse_mode() const { return m_touchscreen_mouse_mode; }
 
-    void set_touchscreen_mouse_mode(bool touchscreen_mouse_mode) { m_touchscreen_mouse_mode = touchscreen_mouse_mode; }
+    void set_touchscreen_mouse_mode(bool touchscreen_mouse_mode) { m_touchscreen_mouse_mode = touchscreen_mouse_mode; publish_stream(); }
     [[nodiscard]] bool swap_mouse_keys() const { return m_swap_mouse_keys; }
 
-    void set_swap_mouse_scroll(bool swap_mouse_scroll) { m_swap_mouse_scroll = swap_mouse_scroll; }
+    void set_swap_mouse_scroll(bool swap_mouse_scroll) { m_swap_mouse_scroll = swap_mouse_scroll; publish_stream(); }
     [[nodiscard]] bool swap_mouse_scroll() const { return m_swap_mouse_scroll; }
 
+    // Gyro moves host mouse instead of being sent as controller motion
+    void set_gyro_mouse(bool gyro_mouse) { m_gyro_mouse = gyro_mouse; publish_stream(); }
+    [[nodiscard]] bool gyro_mouse() const { return m_gyro_mouse; }
+
+    void set_gyro_mouse_sensitivity(int sensitivity) { m_gyro_mouse_sensitivity = sensitivity; publish_stream(); }
+    [[nodiscard]] int gyro_mouse_sensitivity() const { return m_gyro_mouse_sensitivity; }
+
+    // Button which pauses gyro mouse while held, -1 if none
+    void set_gyro_mouse_ratchet(int button) { m_gyro_mouse_ratchet = button; publish_stream(); }
+    [[nodiscard]] int gyro_mouse_ratchet() const { return m_gyro_mouse_ratchet; }
+
     void set_guide_key_options(KeyComboOptions options) { m_guide_key_options = std::move(options); }
     [[nodiscard]] KeyComboOptions guide_key_options() const { return m_guide_key_options; }
 
@@ -136,9 +362,12 @@ class Settings : public Singleton<Settings> {
     void set_volume_amplification(bool allow) { m_volume_amplification = allow; }
     [[nodiscard]] bool get_volume_amplification() const { return m_volume_amplification; }
 
-    void set_volume(int volume) { m_volume = volume; }
+    void set_volume(int volume) { m_volume = volume; publish_stream(); }
     [[nodiscard]] int get_volume() const { return m_volume; }
 
+    void set_direct_surface(bool direct_surface) { m_direct_surface = direct_surface; }
+    [[nodiscard]] bool direct_surface() const { return m_direct_surface; }
+
     void set_use_hw_decoding(bool hw_decoding) { m_use_hw_decoding = hw_decoding; }
     [[nodiscard]] bool use_hw_decoding() const { return true; } //m_use_hw_decoding; }
 
@@ -148,6 +377,10 @@ class Settings : public Singleton<Settings> {
     void set_overlay_system_button(ButtonOverrideType type) { m_overlay_system_button = type; }
     [[nodiscard]] ButtonOverrideType get_overlay_system_button() const { return m_overlay_system_button; }
 
+    // Video stays on the last frame while ingame overlay is open
+    void set_overlay_freeze_video(bool overlay_freeze_video) { m_overlay_freeze_video = overlay_freeze_video; }
+    [[nodiscard]] bool overlay_freeze_video() const { return m_overlay_freeze_video; }
+
     void set_guide_system_button(ButtonOverrideType type) { m_guide_system_button = type; }
     [[nodiscard]] ButtonOverrideType get_guide_system_button() const { return m_guide_system_button; }
 
@@ -157,10 +390,10 @@ class Settings : public Singleton<Settings> {
     void set_keyboard_locale(int locale) { m_keyboard_locale = locale; }
     [[nodiscard]] int get_keyboard_locale() const { return m_keyboard_locale; }
 
-    void set_rumble_force(float rumble_force) { m_rumble_force = int(rumble_force * 100); }
+    void set_rumble_force(float rumble_force) { m_rumble_force = int(rumble_force * 100); publish_stream(); }
     [[nodiscard]] float get_rumble_force() const { return float(m_rumble_force) / 100.f; }
 
-    void set_mouse_speed_multiplier(int mouse_speed_multiplier) { m_mouse_speed_multiplier = mouse_speed_multiplier; }
+    void set_mouse_speed_multiplier(int mouse_speed_multiplier) { m_mouse_speed_multiplier = mouse_speed_multiplier; publish_stream(); }
     [[nodiscard]] int get_mouse_speed_multiplier() const { return m_mouse_speed_multiplier; }
 
     void set_deadzone_stick_left(float deadzone) { m_deadzone_stick_left = deadzone; }
@@ -169,44 +402,129 @@ class Settings : public Singleton<Settings> {
     void set_deadzone_stick_right(float deadzone) { m_deadzone_stick_right = deadzone; }
     [[nodiscard]] float get_deadzone_stick_right() const { return m_deadzone_stick_right; }
 
+    void set_deadzone_type(DeadzoneType type) { m_deadzone_type = type; }
+    [[nodiscard]] DeadzoneType deadzone_type() const { return m_deadzone_type; }
+
+    // Smallest output past deadzone, for games with own deadzone
+    void set_anti_deadzone(float anti_deadzone) { m_anti_deadzone = anti_deadzone; }
+    [[nodiscard]] float anti_deadzone() const { return m_anti_deadzone; }
+
+    void set_stick_curve(StickCurve curve) { m_stick_curve = curve; }
+    [[nodiscard]] StickCurve stick_curve() const { return m_stick_curve; }
+
+    // Exponent of custom curve, in percent
+    void set_stick_curve_exponent(int exponent) { m_stick_curve_exponent = exponent; }
+    [[nodiscard]] int stick_curve_exponent() const { return m_stick_curve_exponent; }
+
+    // Exponent of curve selected for sticks
+    [[nodiscard]] float stick_curve_power() const;
+
     int get_current_mapping_layout();
     void set_current_mapping_layout(int layout) { m_current_mapping_layout = layout; }
 
     std::vector<KeyMappingLayout>* get_mapping_laouts() { return &m_mapping_laouts; }
 
     void load();
+    // Serializes settings right away, file is written on background
+    // thread after SETTINGS_SAVE_DELAY_MS, so bursts of changes cost one write
     void save();
+    // Writes pending changes and stops writer, called on exit
+    void flush();
 
   private:
+    static void write_file(const std::string& path, const std::string& content);
+    void run_writer();
+    // UI thread only, after any field of StreamSettingsSnapshot changed
+    void publish_stream();
+    StatsSnapshot<StreamSettingsSnapshot> m_stream;
+
+    std::mutex m_save_mutex;
+    std::condition_variable m_save_condition;
+    std::string m_save_content;
+    bool m_save_pending = false;
+    bool m_save_stop = false;
+    std::thread m_save_thread;
+
     std::string m_working_dir;
+    std::string m_shader_cache_dir;
     std::string m_key_dir;
     std::string m_boxart_dir;
+    std::string m_recordings_dir;
+    std::string m_screenshots_dir;
     std::string m_log_path;
     std::string m_gamepad_mapping_path;
 
     std::vector<Host> m_hosts;
+    std::string m_last_host;
     int m_resolution = 720;
     int m_fps = 60;
     VideoCodec m_video_codec = H265;
+#ifdef PLATFORM_ANDROID
+    AudioBackend m_audio_backend = AAUDIO;
+#elif defined(__APPLE__)
+    AudioBackend m_audio_backend = AUDIO_UNIT;
+#else
     AudioBackend m_audio_backend = SDL;
+#endif
+    AudioChannels m_audio_channels = AUDIO_CHANNELS_STEREO;
+    int m_audio_latency = 40;
     int m_bitrate = 10000;
+    bool m_limit_to_display = true;
+    bool m_auto_bitrate = false;
+    bool m_network_probe = true;
+    bool m_qos_marking = true;
+    bool m_battery_saver = false;
+    bool m_audio_only = false;
     bool m_enable_hdr = false;
     bool m_click_by_tap = false;
     int m_decoder_threads = 4;
+    DecoderThreading m_decoder_threading = DECODER_THREADING_AUTO;
+    VideoScaling m_video_scaling = SCALING_BILINEAR;
     int m_frames_queue_size = 3;
+    bool m_auto_tune = true;
+    int m_tuned_frames_queue_size = 0;
+    int m_tuned_decoder_threads = 0;
+    int m_frame_max_age = 100;
+    int m_surface_budget = 128;
+    bool m_low_memory = false;
+    FramePacing m_frame_pacing = PACING_QUEUE;
+    PresentMode m_present_mode = PRESENT_STANDARD;
+    bool m_variable_refresh = false;
+    bool m_vic_scaling = false;
+    bool m_decoder_thread = false;
+    bool m_decoder_upload = false;
+    bool m_audio_thread = false;
+    // UI keeps core 0 with main thread priority it had before, lower value is higher priority
+    // Input thread mostly sleeps, so it shares UI core with a bit higher priority
+    ThreadConfig m_thread_configs[THREAD_ROLE_COUNT] = {{0, 0x20}, {1, 0x20}, {2, 0x1E}, {0, 0x1F}};
     bool m_sops = true;
     bool m_play_audio = false;
     bool m_write_log = false;
+    bool m_record_video = false;
+    bool m_record_session = false;
+    int m_replay_loss = 0;
+    int m_replay_jitter = 0;
+    int m_soak_duration = 240;
+    int m_soak_reconnects = 50;
+    int m_grid_benchmark_apps = 1000;
+    int m_input_rate = 0;
+    int m_motion_rate = 120;
+    int m_boxart_cache_mb = 64;
     bool m_swap_ui_keys = false;
     bool m_swap_joycon_stick_to_dpad = false;
     bool m_touchscreen_mouse_mode = false;
     bool m_swap_mouse_keys = false;
     bool m_swap_mouse_scroll = false;
+    bool m_gyro_mouse = false;
+    int m_gyro_mouse_sensitivity = 100;
+    int m_gyro_mouse_ratchet = -1;
     int m_rumble_force = 100;
     int m_volume = 100;
     bool m_use_hw_decoding = true;
+    bool m_direct_surface = true;
     KeyboardType m_keyboard_type = COMPACT;
     ButtonOverrideType m_overlay_system_button = ButtonOverrideType::NONE;
+    bool m_overlay_freeze_video = true;
     ButtonOverrideType m_guide_system_button = ButtonOverrideType::NONE;
     int m_keyboard_fingers = 3;
     int m_keyboard_locale = 0;
@@ -230,6 +548,10 @@ class Settings : public Singleton<Settings> {
 
     float m_deadzone_stick_left = 0;
     float m_deadzone_stick_right = 0;
+    DeadzoneType m_deadzone_type = DEADZONE_RADIAL;
+    float m_anti_deadzone = 0;
+    StickCurve m_stick_curve = CURVE_LINEAR;
+    int m_stick_curve_exponent = 150;
 
     void loadBaseLayouts();
 };
@@ -0,0 +1,40 @@
+//
+//  StartupTrace.cpp
+//  Moonlight
+//
+
+#include "StartupTrace.hpp"
+#include <borealis.hpp>
+
+void StartupTrace::start() {
+    m_start_us = HighResClock::now_us();
+    m_last_us = m_start_us;
+}
+
+void StartupTrace::mark(const char* phase) {
+    if (m_done)
+        return;
+
+    uint64_t now = HighResClock::now_us();
+    m_phases.push_back({phase, now - m_last_us});
+    m_last_us = now;
+}
+
+void StartupTrace::frame() {
+    if (m_done)
+        return;
+
+    mark("first frame");
+    m_done = true;
+
+    // Debugging view shows log, so trace is seen there as well
+    brls::Logger::info("Startup: {}", format());
+}
+
+std::string StartupTrace::format() const {
+    std::string result;
+    for (const auto& phase : m_phases)
+        result += fmt::format("{} {:.{}f} ms, ", phase.name, phase.duration_us / 1000.0, 1);
+    result += fmt::format("total {:.{}f} ms", (m_last_us - m_start_us) / 1000.0, 1);
+    return result;
+}
@@ -0,0 +1,37 @@
+//
+//  StartupTrace.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "HighResClock.hpp"
+#include "Singleton.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Duration of every startup phase up to first drawn frame, logged once
+// frame is shown, so cold start regressions can be measured
+class StartupTrace : public Singleton<StartupTrace> {
+  public:
+    // Phases are timed from here, called first thing in main
+    void start();
+    // Time since previous mark is charged to this phase
+    void mark(const char* phase);
+    // Called after every main loop pass, finishes trace after first one
+    void frame();
+
+    [[nodiscard]] std::string format() const;
+
+  private:
+    struct Phase {
+        const char* name;
+        uint64_t duration_us;
+    };
+
+    uint64_t m_start_us = 0;
+    uint64_t m_last_us = 0;
+    std::vector<Phase> m_phases;
+    bool m_done = false;
+};
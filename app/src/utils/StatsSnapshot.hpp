@@ -0,0 +1,58 @@
+//
+//  StatsSnapshot.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Seqlock for stats and other small structs one thread produces and
+// others read. Writer never waits, it bumps the sequence to odd, stores
+// and bumps it to even again. Reader copies and retries while sequence
+// was odd or changed, so it never sees half of two updates. Payload is
+// kept in relaxed atomic words, so a racing copy isn't a data race either
+template <typename T> class StatsSnapshot {
+    static_assert(std::is_trivially_copyable_v<T>, "Payload must be trivially copyable");
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  public:
+    StatsSnapshot() { publish(T{}); }
+
+    // Single writer
+    void publish(const T& value) {
+        uint64_t words[WORDS] = {};
+        memcpy(words, &value, sizeof(T));
+
+        uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; i++)
+            m_words[i].store(words[i], std::memory_order_relaxed);
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Any thread, spins only while a publish is in flight
+    [[nodiscard]] T read() const {
+        uint64_t words[WORDS];
+        uint32_t before, after;
+        do {
+            before = m_sequence.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; i++)
+                words[i] = m_words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = m_sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+
+        T value;
+        memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+  private:
+    std::atomic<uint32_t> m_sequence = 0;
+    std::atomic<uint64_t> m_words[WORDS] = {};
+};
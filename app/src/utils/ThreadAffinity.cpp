@@ -0,0 +1,36 @@
+//
+//  ThreadAffinity.cpp
+//  Moonlight
+//
+
+#include "ThreadAffinity.hpp"
+#include "Settings.hpp"
+
+#ifdef __SWITCH__
+#include <switch.h>
+#endif
+
+void ThreadAffinity::apply(ThreadRole role) {
+#ifdef __SWITCH__
+    ThreadConfig config = Settings::instance().thread_config(role);
+
+    Result rc = svcSetThreadCoreMask(CUR_THREAD_HANDLE, config.core, 1ULL << config.core);
+    if (R_FAILED(rc))
+        brls::Logger::error("ThreadAffinity: Failed to pin role {} to core {}: {:#x}", (int)role, config.core, rc);
+
+    rc = svcSetThreadPriority(CUR_THREAD_HANDLE, config.priority);
+    if (R_FAILED(rc))
+        brls::Logger::error("ThreadAffinity: Failed to set role {} priority {:#x}: {:#x}", (int)role, config.priority, rc);
+
+    brls::Logger::info("ThreadAffinity: Role {} on core {} with priority {:#x}", (int)role, config.core, config.priority);
+#endif
+}
+
+void ThreadAffinity::apply_once(ThreadRole role) {
+    static thread_local bool applied = false;
+    if (applied)
+        return;
+
+    applied = true;
+    apply(role);
+}
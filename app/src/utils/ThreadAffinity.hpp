@@ -0,0 +1,24 @@
+#pragma once
+
+enum ThreadRole : int {
+    THREAD_ROLE_UI,
+    THREAD_ROLE_DECODER,
+    THREAD_ROLE_AUDIO,
+    THREAD_ROLE_INPUT,
+    THREAD_ROLE_COUNT
+};
+
+struct ThreadConfig {
+    int core;
+    int priority;
+};
+
+// Pins calling thread to core and priority configured for its role,
+// does nothing on platforms without fixed cores
+class ThreadAffinity {
+  public:
+    static void apply(ThreadRole role);
+
+    // For callbacks which are called on threads we don't own
+    static void apply_once(ThreadRole role);
+};
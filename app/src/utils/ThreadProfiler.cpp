@@ -0,0 +1,212 @@
+//
+//  ThreadProfiler.cpp
+//  Moonlight
+//
+
+#include "ThreadProfiler.hpp"
+#include "HighResClock.hpp"
+#include "PipelineTrace.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__SWITCH__)
+#include <switch.h>
+// Core 3 belongs to system, but its ticks are reported too
+#define THREAD_PROFILE_SWITCH_CORES 4
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <pthread.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <time.h>
+#endif
+
+static void set_thread_name(const char* name) {
+#if defined(__APPLE__)
+    pthread_setname_np(name);
+#elif defined(__linux__)
+    // Kernel keeps 15 characters
+    char shortName[16];
+    snprintf(shortName, sizeof(shortName), "%s", name);
+    pthread_setname_np(pthread_self(), shortName);
+#else
+    // Horizon names threads only on creation
+    (void)name;
+#endif
+}
+
+static bool current_clock(int64_t* clock) {
+#if defined(__SWITCH__)
+    *clock = threadGetCurHandle();
+    return true;
+#elif defined(__APPLE__)
+    *clock = pthread_mach_thread_np(pthread_self());
+    return true;
+#elif defined(__linux__)
+    clockid_t id;
+    if (pthread_getcpuclockid(pthread_self(), &id) != 0)
+        return false;
+    *clock = id;
+    return true;
+#else
+    (void)clock;
+    return false;
+#endif
+}
+
+bool ThreadProfiler::read_cpu_time(const Entry& entry, uint64_t* total_ns, uint64_t* core_ns) {
+#if defined(__SWITCH__)
+    u64 ticks;
+    if (R_FAILED(svcGetInfo(&ticks, InfoType_ThreadTickCount, (Handle)entry.clock, UINT64_MAX)))
+        return false;
+    *total_ns = armTicksToNs(ticks);
+
+    for (int core = 0; core < THREAD_PROFILE_SWITCH_CORES; core++) {
+        if (R_SUCCEEDED(svcGetInfo(&ticks, InfoType_ThreadTickCount, (Handle)entry.clock, core)))
+            core_ns[core] = armTicksToNs(ticks);
+    }
+    return true;
+#elif defined(__APPLE__)
+    thread_basic_info_data_t info;
+    mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+    if (thread_info((thread_act_t)entry.clock, THREAD_BASIC_INFO, (thread_info_t)&info, &count) != KERN_SUCCESS)
+        return false;
+    *total_ns = (uint64_t)(info.user_time.seconds + info.system_time.seconds) * 1000000000 +
+                (uint64_t)(info.user_time.microseconds + info.system_time.microseconds) * 1000;
+    return true;
+#elif defined(__linux__)
+    // Clock of exited thread is rejected, so its entry is dropped
+    timespec time;
+    if (clock_gettime((clockid_t)entry.clock, &time) != 0)
+        return false;
+    *total_ns = (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool ThreadProfiler::read_core_loads(std::vector<float>& loads) {
+#if defined(__linux__)
+    // Android 8+ may deny it, then cores just aren't shown
+    FILE* file = fopen("/proc/stat", "r");
+    if (!file)
+        return false;
+
+    std::vector<uint64_t> busy, total;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long long user, nice, system, idle, iowait = 0, irq = 0, softirq = 0, steal = 0;
+        int core;
+        if (strncmp(line, "cpu", 3) != 0 || line[3] < '0' || line[3] > '9')
+            continue;
+        if (sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu", &core, &user, &nice,
+                   &system, &idle, &iowait, &irq, &softirq, &steal) < 5)
+            continue;
+
+        uint64_t sum = user + nice + system + idle + iowait + irq + softirq + steal;
+        busy.push_back(sum - idle - iowait);
+        total.push_back(sum);
+        if (busy.size() == THREAD_PROFILE_MAX_CORES)
+            break;
+    }
+    fclose(file);
+
+    if (m_core_total.size() == total.size()) {
+        for (size_t i = 0; i < total.size(); i++) {
+            uint64_t delta = total[i] - m_core_total[i];
+            loads.push_back(delta ? (float)(busy[i] - m_core_busy[i]) * 100 / delta : 0);
+        }
+    }
+    m_core_busy = std::move(busy);
+    m_core_total = std::move(total);
+    return !loads.empty();
+#else
+    (void)loads;
+    return false;
+#endif
+}
+
+void ThreadProfiler::register_current(const char* name) {
+    set_thread_name(name);
+#ifdef USE_PIPELINE_TRACE
+    PipelineTrace::instance().name_current(name);
+#endif
+
+    Entry entry;
+    entry.name = name;
+    entry.thread = std::this_thread::get_id();
+    if (!current_clock(&entry.clock) || !read_cpu_time(entry, &entry.last_ns, entry.last_core_ns))
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto existing = std::find_if(m_entries.begin(), m_entries.end(),
+                                 [&entry](const Entry& other) { return other.thread == entry.thread; });
+    if (existing != m_entries.end())
+        *existing = entry;
+    else
+        m_entries.push_back(entry);
+}
+
+void ThreadProfiler::register_once(const char* name) {
+    static thread_local bool registered = false;
+    if (registered)
+        return;
+
+    registered = true;
+    register_current(name);
+}
+
+void ThreadProfiler::unregister_current() {
+    auto thread = std::this_thread::get_id();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(),
+                                   [thread](const Entry& entry) { return entry.thread == thread; }),
+                    m_entries.end());
+}
+
+void ThreadProfiler::update() {
+    uint64_t now = HighResClock::now_us();
+    if (now - m_last_us < THREAD_PROFILE_INTERVAL_US)
+        return;
+
+    // Not called between sessions, long gap only rebases counters
+    uint64_t elapsed_ns = (now - m_last_us) * 1000;
+    bool publish = now - m_last_us < THREAD_PROFILE_INTERVAL_US * 2;
+    m_last_us = now;
+
+    ThreadProfile profile;
+    uint64_t core_busy[THREAD_PROFILE_MAX_CORES] = {};
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto entry = m_entries.begin(); entry != m_entries.end();) {
+            uint64_t total_ns = 0;
+            uint64_t core_ns[THREAD_PROFILE_MAX_CORES] = {};
+            if (!read_cpu_time(*entry, &total_ns, core_ns)) {
+                entry = m_entries.erase(entry);
+                continue;
+            }
+
+            profile.threads.push_back({entry->name, (float)(total_ns - entry->last_ns) * 100 / elapsed_ns});
+            for (int core = 0; core < THREAD_PROFILE_MAX_CORES; core++)
+                core_busy[core] += core_ns[core] - entry->last_core_ns[core];
+
+            entry->last_ns = total_ns;
+            std::copy(core_ns, core_ns + THREAD_PROFILE_MAX_CORES, entry->last_core_ns);
+            ++entry;
+        }
+    }
+
+#ifdef __SWITCH__
+    for (int core = 0; core < THREAD_PROFILE_SWITCH_CORES; core++)
+        profile.cores.push_back(std::min((float)core_busy[core] * 100 / elapsed_ns, 100.f));
+    profile.cores_app_only = true;
+#else
+    read_core_loads(profile.cores);
+#endif
+
+    if (publish)
+        m_profile = std::move(profile);
+}
@@ -0,0 +1,77 @@
+//
+//  ThreadProfiler.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Singleton.hpp"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// CPU time is sampled this often, loads are averages over it
+#define THREAD_PROFILE_INTERVAL_US 1000000
+#define THREAD_PROFILE_MAX_CORES 8
+
+struct ThreadLoad {
+    std::string name;
+    // Share of one core, 100 is a core busy for whole interval
+    float cpu_percent;
+};
+
+struct ThreadProfile {
+    std::vector<ThreadLoad> threads;
+    // Busy share of every core, empty when platform can't tell
+    std::vector<float> cores;
+    // Switch only sees registered threads, not other processes
+    bool cores_app_only = false;
+};
+
+// Names threads of the app and samples their CPU time, so stutters
+// can be traced to UI, decoder, receive or audio threads. Threads
+// register themselves, ones started by moonlight-common-c do it from
+// their first callback. Nothing is sampled on Windows
+class ThreadProfiler : public Singleton<ThreadProfiler> {
+  public:
+    // Names calling thread and starts sampling it
+    void register_current(const char* name);
+    // For callbacks which are called on threads we don't own
+    void register_once(const char* name);
+    void unregister_current();
+
+    // Called every drawn frame on UI thread, samples once per interval
+    void update();
+    [[nodiscard]] const ThreadProfile& profile() const { return m_profile; }
+
+  private:
+    struct Entry {
+        std::string name;
+        std::thread::id thread;
+        // Platform handle CPU time is read with
+        int64_t clock = 0;
+        uint64_t last_ns = 0;
+        uint64_t last_core_ns[THREAD_PROFILE_MAX_CORES] = {};
+    };
+
+    static bool read_cpu_time(const Entry& entry, uint64_t* total_ns, uint64_t* core_ns);
+    bool read_core_loads(std::vector<float>& loads);
+
+    std::mutex m_mutex;
+    std::vector<Entry> m_entries;
+    uint64_t m_last_us = 0;
+    ThreadProfile m_profile;
+
+    // Busy and total jiffies of every core from previous sample
+    std::vector<uint64_t> m_core_busy;
+    std::vector<uint64_t> m_core_total;
+};
+
+// Keeps thread registered for the scope, for loops of threads app owns
+class ThreadProfileScope {
+  public:
+    explicit ThreadProfileScope(const char* name) { ThreadProfiler::instance().register_current(name); }
+    ~ThreadProfileScope() { ThreadProfiler::instance().unregister_current(); }
+};
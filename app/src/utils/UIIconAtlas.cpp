@@ -0,0 +1,49 @@
+//
+//  UIIconAtlas.cpp
+//  Moonlight
+//
+
+#include "UIIconAtlas.hpp"
+#include <borealis.hpp>
+#include <nanovg.h>
+
+#ifdef USE_LIBROMFS
+#include <romfs/romfs.hpp>
+#endif
+
+#define UI_ICON_ATLAS_RES "img/ui_icons.png"
+
+void UIIconAtlas::load(NVGcontext* vg) {
+    if (m_image)
+        return;
+
+#ifdef USE_LIBROMFS
+    auto data = romfs::get(UI_ICON_ATLAS_RES);
+    // Decoded from embedded blob, NanoVG only reads it
+    m_image = nvgCreateImageMem(vg, 0, (unsigned char*)data.data(), (int)data.size());
+#else
+    m_image = nvgCreateImage(vg, (std::string(BRLS_RESOURCES) + UI_ICON_ATLAS_RES).c_str(), 0);
+#endif
+
+    if (!m_image)
+        brls::Logger::error("UIIconAtlas: Failed to load {}", UI_ICON_ATLAS_RES);
+}
+
+void UIIconAtlas::draw(NVGcontext* vg, UIIcon icon, float x, float y, float width, float height, float alpha) {
+    load(vg);
+    if (!m_image)
+        return;
+
+    // Pattern spans the whole atlas, scaled so icon lands in the rect
+    const UIIconRect& rect = ui_icon_rects[icon];
+    float scale_x = width / (float)rect.width;
+    float scale_y = height / (float)rect.height;
+    NVGpaint paint = nvgImagePattern(vg, x - (float)rect.x * scale_x, y - (float)rect.y * scale_y,
+                                     UI_ICON_ATLAS_WIDTH * scale_x, UI_ICON_ATLAS_HEIGHT * scale_y,
+                                     0, m_image, alpha);
+
+    nvgBeginPath(vg);
+    nvgRect(vg, x, y, width, height);
+    nvgFillPaint(vg, paint);
+    nvgFill(vg);
+}
@@ -0,0 +1,45 @@
+//
+//  UIIconAtlas.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Singleton.hpp"
+
+struct NVGcontext;
+
+// img/ui_icons.png, icons in a row with 2 px of transparency between
+// them, so filtering doesn't take in the neighbour
+#define UI_ICON_ATLAS_WIDTH 178
+#define UI_ICON_ATLAS_HEIGHT 88
+
+enum UIIcon : int {
+    UI_ICON_STAR,
+    UI_ICON_PLAY,
+    UI_ICON_COUNT,
+};
+
+struct UIIconRect {
+    int x, y, width, height;
+};
+
+// Pixels of every icon in the atlas
+static constexpr UIIconRect ui_icon_rects[UI_ICON_COUNT] = {
+    {0, 0, 88, 88},  // UI_ICON_STAR
+    {90, 0, 88, 88}, // UI_ICON_PLAY
+};
+
+// Single texture badges of all cells are drawn from, instead of an image
+// per view, so grid has one copy of them and no texture switch per badge
+class UIIconAtlas : public Singleton<UIIconAtlas> {
+  public:
+    // UI thread, once window exists
+    void load(NVGcontext* vg);
+
+    // UI thread, icon stretched into the rect
+    void draw(NVGcontext* vg, UIIcon icon, float x, float y, float width, float height, float alpha);
+
+  private:
+    int m_image = 0;
+};
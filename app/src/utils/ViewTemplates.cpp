@@ -0,0 +1,52 @@
+//
+//  ViewTemplates.cpp
+//  Moonlight
+//
+
+#include "ViewTemplates.hpp"
+#include <borealis.hpp>
+#include <tinyxml2.h>
+
+#ifdef USE_LIBROMFS
+#include <romfs/romfs.hpp>
+#endif
+
+ViewTemplates::~ViewTemplates() = default;
+
+tinyxml2::XMLDocument* ViewTemplates::document(const std::string& resource) {
+    auto it = m_documents.find(resource);
+    if (it != m_documents.end())
+        return it->second.get();
+
+    // Resource is found the way borealis looks it up
+    auto document = std::make_unique<tinyxml2::XMLDocument>();
+#ifdef USE_LIBROMFS
+    // Parsed straight from embedded blob, no copy of it
+    auto xml = romfs::get(resource).string();
+    tinyxml2::XMLError error = document->Parse(xml.data(), xml.size());
+#else
+    std::string path = std::string(BRLS_RESOURCES) + resource;
+    tinyxml2::XMLError error = document->LoadFile(path.c_str());
+#endif
+    m_parses++;
+
+    if (error != tinyxml2::XML_SUCCESS || !document->RootElement()) {
+        brls::Logger::error("ViewTemplates: Failed to parse {} - {}", resource, (int)error);
+        return nullptr;
+    }
+
+    auto* result = document.get();
+    m_documents[resource] = std::move(document);
+    return result;
+}
+
+void ViewTemplates::inflate(brls::Box* box, const std::string& resource) {
+    m_inflations++;
+    if (auto* cached = document(resource)) {
+        box->inflateFromXMLElement(cached->RootElement());
+        return;
+    }
+
+    // Borealis reports what's wrong with it
+    box->inflateFromXMLRes(resource);
+}
@@ -0,0 +1,40 @@
+//
+//  ViewTemplates.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#include "Singleton.hpp"
+#include <map>
+#include <memory>
+#include <string>
+
+namespace brls {
+class Box;
+}
+
+namespace tinyxml2 {
+class XMLDocument;
+}
+
+// Parsed XML of views inflated many times, as cells of app grid. First
+// inflation of a resource reads and parses it, later ones build view
+// tree right from kept document, without romfs read and parse per cell
+class ViewTemplates : public Singleton<ViewTemplates> {
+  public:
+    ~ViewTemplates();
+
+    // UI thread, same as Box::inflateFromXMLRes
+    void inflate(brls::Box* box, const std::string& resource);
+
+    [[nodiscard]] size_t parses() const { return m_parses; }
+    [[nodiscard]] size_t inflations() const { return m_inflations; }
+
+  private:
+    tinyxml2::XMLDocument* document(const std::string& resource);
+
+    std::map<std::string, std::unique_ptr<tinyxml2::XMLDocument>> m_documents;
+    size_t m_parses = 0;
+    size_t m_inflations = 0;
+};